@@ -30,9 +30,77 @@ extern "C" {
 #endif
 
 #include <upipe/upipe.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
 
 #define UPIPE_FILTER_BLEND_SIGNATURE UBASE_FOURCC('b', 'l', 'e', 'n')
 
+/** @This defines a function computing the per-sample mean of two lines,
+ * rounded down. */
+typedef void (*upipe_filter_blend_merge)(uint8_t *dest, const uint8_t *s1,
+                                         const uint8_t *s2, size_t bytes);
+
+/** @This merges two lines of 8-bit samples. */
+void upipe_filter_blend_merge8_c(uint8_t *dest, const uint8_t *s1,
+                                 const uint8_t *s2, size_t bytes);
+/** @This merges two lines of 16-bit samples (bytes must be even). */
+void upipe_filter_blend_merge16_c(uint8_t *dest, const uint8_t *s1,
+                                  const uint8_t *s2, size_t bytes);
+
+#ifdef UCPU_X86
+/** @This is the SSE2 version of @ref upipe_filter_blend_merge8_c. */
+void upipe_filter_blend_merge8_sse2(uint8_t *dest, const uint8_t *s1,
+                                    const uint8_t *s2, size_t bytes);
+/** @This is the SSE2 version of @ref upipe_filter_blend_merge16_c. */
+void upipe_filter_blend_merge16_sse2(uint8_t *dest, const uint8_t *s1,
+                                     const uint8_t *s2, size_t bytes);
+/** @This is the AVX2 version of @ref upipe_filter_blend_merge8_c. */
+void upipe_filter_blend_merge8_avx2(uint8_t *dest, const uint8_t *s1,
+                                    const uint8_t *s2, size_t bytes);
+/** @This is the AVX2 version of @ref upipe_filter_blend_merge16_c. */
+void upipe_filter_blend_merge16_avx2(uint8_t *dest, const uint8_t *s1,
+                                     const uint8_t *s2, size_t bytes);
+#endif
+
+/** @This extends upipe_command with specific commands for blend pipes. */
+enum upipe_filter_blend_command {
+    UPIPE_FILTER_BLEND_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the number of band threads (unsigned int) */
+    UPIPE_FILTER_BLEND_SET_THREADS,
+    /** returns the number of band threads (unsigned int *) */
+    UPIPE_FILTER_BLEND_GET_THREADS
+};
+
+/** @This sets the number of threads processing horizontal bands of each
+ * picture (1 by default, meaning no thread is created).
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static inline int upipe_filter_blend_set_threads(struct upipe *upipe,
+                                                 unsigned int threads)
+{
+    return upipe_control(upipe, UPIPE_FILTER_BLEND_SET_THREADS,
+                         UPIPE_FILTER_BLEND_SIGNATURE, threads);
+}
+
+/** @This returns the number of band threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads_p filled in with the number of threads
+ * @return an error code
+ */
+static inline int upipe_filter_blend_get_threads(struct upipe *upipe,
+                                                 unsigned int *threads_p)
+{
+    return upipe_control(upipe, UPIPE_FILTER_BLEND_GET_THREADS,
+                         UPIPE_FILTER_BLEND_SIGNATURE, threads_p);
+}
+
 /** @This returns the management structure for all avformat sources.
  *
  * @return pointer to manager
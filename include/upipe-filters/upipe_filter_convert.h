@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe pixel format conversion filter
+ *
+ * This pipe converts between planar and semi-planar layouts (such as
+ * yuv420p and nv12), swaps interleaved chroma, changes the order of planes
+ * and converts between 8-bit and 9- to 16-bit samples, without scaling and
+ * without going through libswscale. Other conversions are refused, so that
+ * callers may fall back to @ref upipe_sws_mgr_alloc.
+ */
+
+#ifndef _UPIPE_FILTERS_UPIPE_FILTER_CONVERT_H_
+/** @hidden */
+#define _UPIPE_FILTERS_UPIPE_FILTER_CONVERT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UPIPE_FILTER_CONVERT_SIGNATURE UBASE_FOURCC('f','c','n','v')
+
+/** @This defines a function interleaving two lines of samples into one. */
+typedef void (*upipe_filter_convert_interleave)(uint8_t *dest,
+        const uint8_t *src1, const uint8_t *src2, size_t width);
+/** @This defines a function splitting a line of interleaved samples. */
+typedef void (*upipe_filter_convert_deinterleave)(uint8_t *dest1,
+        uint8_t *dest2, const uint8_t *src, size_t width);
+/** @This defines a function swapping pairs of interleaved samples. */
+typedef void (*upipe_filter_convert_swap)(uint8_t *dest, const uint8_t *src,
+                                          size_t width);
+/** @This defines a function changing the bit depth of a line of samples. */
+typedef void (*upipe_filter_convert_depth)(uint8_t *dest, const uint8_t *src,
+                                           size_t width, unsigned int shift);
+
+/** @This interleaves two lines of 8-bit samples (width samples each). */
+void upipe_filter_convert_interleave8_c(uint8_t *dest, const uint8_t *src1,
+                                        const uint8_t *src2, size_t width);
+/** @This interleaves two lines of 16-bit samples (width samples each). */
+void upipe_filter_convert_interleave16_c(uint8_t *dest, const uint8_t *src1,
+                                         const uint8_t *src2, size_t width);
+/** @This splits width pairs of 8-bit samples into two lines. */
+void upipe_filter_convert_deinterleave8_c(uint8_t *dest1, uint8_t *dest2,
+                                          const uint8_t *src, size_t width);
+/** @This splits width pairs of 16-bit samples into two lines. */
+void upipe_filter_convert_deinterleave16_c(uint8_t *dest1, uint8_t *dest2,
+                                           const uint8_t *src, size_t width);
+/** @This swaps width pairs of 8-bit samples. */
+void upipe_filter_convert_swap8_c(uint8_t *dest, const uint8_t *src,
+                                  size_t width);
+/** @This swaps width pairs of 16-bit samples. */
+void upipe_filter_convert_swap16_c(uint8_t *dest, const uint8_t *src,
+                                   size_t width);
+/** @This converts 8-bit samples to 16-bit samples shifted left by shift. */
+void upipe_filter_convert_expand_c(uint8_t *dest, const uint8_t *src,
+                                   size_t width, unsigned int shift);
+/** @This converts 16-bit samples to 8-bit samples shifted right by shift
+ * (1 to 8), rounding to nearest and clipping. */
+void upipe_filter_convert_reduce_c(uint8_t *dest, const uint8_t *src,
+                                   size_t width, unsigned int shift);
+
+#ifdef UCPU_X86
+/** @hidden */
+#define UPIPE_FILTER_CONVERT_DECLARE(suffix)                                \
+void upipe_filter_convert_interleave8_##suffix(uint8_t *dest,               \
+        const uint8_t *src1, const uint8_t *src2, size_t width);            \
+void upipe_filter_convert_interleave16_##suffix(uint8_t *dest,              \
+        const uint8_t *src1, const uint8_t *src2, size_t width);            \
+void upipe_filter_convert_deinterleave8_##suffix(uint8_t *dest1,            \
+        uint8_t *dest2, const uint8_t *src, size_t width);                  \
+void upipe_filter_convert_deinterleave16_##suffix(uint8_t *dest1,           \
+        uint8_t *dest2, const uint8_t *src, size_t width);                  \
+void upipe_filter_convert_swap8_##suffix(uint8_t *dest,                     \
+        const uint8_t *src, size_t width);                                  \
+void upipe_filter_convert_swap16_##suffix(uint8_t *dest,                    \
+        const uint8_t *src, size_t width);                                  \
+void upipe_filter_convert_expand_##suffix(uint8_t *dest,                    \
+        const uint8_t *src, size_t width, unsigned int shift);              \
+void upipe_filter_convert_reduce_##suffix(uint8_t *dest,                    \
+        const uint8_t *src, size_t width, unsigned int shift);
+
+/** SSE2 versions of the conversion functions */
+UPIPE_FILTER_CONVERT_DECLARE(sse2)
+/** AVX2 versions of the conversion functions */
+UPIPE_FILTER_CONVERT_DECLARE(avx2)
+#undef UPIPE_FILTER_CONVERT_DECLARE
+#endif
+
+/** @This extends upipe_mgr_command with specific commands for convert
+ * managers. */
+enum upipe_filter_convert_mgr_command {
+    UPIPE_FILTER_CONVERT_MGR_SENTINEL = UPIPE_MGR_CONTROL_LOCAL,
+
+    /** checks if a conversion is supported (struct uref *,
+     * struct uref *) */
+    UPIPE_FILTER_CONVERT_MGR_CHECK
+};
+
+/** @This checks if pipes of this manager are able to convert pictures from
+ * the input flow definition to the format of the output flow definition.
+ * Picture sizes are not checked, as the pipe does not scale. The matrix
+ * coefficients and colour range must be the same on both sides, as the pipe
+ * does not convert colours.
+ *
+ * @param mgr pointer to manager
+ * @param flow_def_input input flow definition
+ * @param flow_def_output wanted output flow definition
+ * @return an error code
+ */
+static inline int upipe_filter_convert_mgr_check(struct upipe_mgr *mgr,
+                                                 struct uref *flow_def_input,
+                                                 struct uref *flow_def_output)
+{
+    return upipe_mgr_control(mgr, UPIPE_FILTER_CONVERT_MGR_CHECK,
+                             UPIPE_FILTER_CONVERT_SIGNATURE,
+                             flow_def_input, flow_def_output);
+}
+
+/** @This returns the management structure for convert pipes. Pipes are
+ * allocated with @ref upipe_flow_alloc and a flow definition describing the
+ * wanted output format.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_filter_convert_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
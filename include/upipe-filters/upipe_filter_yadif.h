@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2006-2011 Michael Niedermayer <michaelni@gmx.at>
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe yadif motion-adaptive deinterlace filter
+ *
+ * Missing lines are interpolated from the two neighbouring fields of the
+ * current picture and from the previous and next pictures, as in the yadif
+ * filter of libavfilter. Planes may have 8-bit samples, or 16-bit samples
+ * with no more than 12 significant bits.
+ */
+
+#ifndef _UPIPE_FILTERS_UPIPE_FILTER_YADIF_H_
+/** @hidden */
+#define _UPIPE_FILTERS_UPIPE_FILTER_YADIF_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define UPIPE_FILTER_YADIF_SIGNATURE UBASE_FOURCC('y', 'a', 'd', 'f')
+
+/** @This defines a function interpolating a line.
+ *
+ * @param dst output line
+ * @param prev same line in the previous picture
+ * @param cur same line in the current picture
+ * @param next same line in the next picture
+ * @param w width in samples
+ * @param prefs offset in bytes of the line below
+ * @param mrefs offset in bytes of the line above
+ * @param parity true if the interpolated field is temporally closer to the
+ * previous picture
+ * @param check true to apply the spatial interlacing check, which reads two
+ * lines above and below
+ */
+typedef void (*upipe_filter_yadif_line)(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check);
+
+/** @This interpolates a line of 8-bit samples. */
+void upipe_filter_yadif_line8_c(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check);
+/** @This interpolates a line of 16-bit samples. */
+void upipe_filter_yadif_line16_c(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check);
+
+#ifdef UCPU_X86
+/** @This is the SSE2 version of @ref upipe_filter_yadif_line8_c. */
+void upipe_filter_yadif_line8_sse2(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check);
+/** @This is the SSE2 version of @ref upipe_filter_yadif_line16_c. */
+void upipe_filter_yadif_line16_sse2(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check);
+/** @This is the AVX2 version of @ref upipe_filter_yadif_line8_c. */
+void upipe_filter_yadif_line8_avx2(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check);
+/** @This is the AVX2 version of @ref upipe_filter_yadif_line16_c. */
+void upipe_filter_yadif_line16_avx2(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check);
+#endif
+
+/** @This defines the output modes of yadif pipes. */
+enum upipe_filter_yadif_mode {
+    /** one picture per input picture (default) */
+    UPIPE_FILTER_YADIF_MODE_FRAME,
+    /** one picture per input field, doubling the frame rate */
+    UPIPE_FILTER_YADIF_MODE_FIELD
+};
+
+/** @This extends upipe_command with specific commands for yadif pipes. */
+enum upipe_filter_yadif_command {
+    UPIPE_FILTER_YADIF_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the output mode (int) */
+    UPIPE_FILTER_YADIF_SET_MODE,
+    /** returns the output mode (int *) */
+    UPIPE_FILTER_YADIF_GET_MODE,
+    /** sets the number of band threads (unsigned int) */
+    UPIPE_FILTER_YADIF_SET_THREADS,
+    /** returns the number of band threads (unsigned int *) */
+    UPIPE_FILTER_YADIF_GET_THREADS
+};
+
+/** @This sets the output mode. It must be called before the flow
+ * definition is set.
+ *
+ * @param upipe description structure of the pipe
+ * @param mode output mode
+ * @return an error code
+ */
+static inline int upipe_filter_yadif_set_mode(struct upipe *upipe,
+                                              enum upipe_filter_yadif_mode mode)
+{
+    return upipe_control(upipe, UPIPE_FILTER_YADIF_SET_MODE,
+                         UPIPE_FILTER_YADIF_SIGNATURE, (int)mode);
+}
+
+/** @This returns the output mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param mode_p filled in with the output mode
+ * @return an error code
+ */
+static inline int upipe_filter_yadif_get_mode(struct upipe *upipe,
+        enum upipe_filter_yadif_mode *mode_p)
+{
+    int mode;
+    int err = upipe_control(upipe, UPIPE_FILTER_YADIF_GET_MODE,
+                            UPIPE_FILTER_YADIF_SIGNATURE, &mode);
+    if (ubase_check(err))
+        *mode_p = mode;
+    return err;
+}
+
+/** @This sets the number of threads processing horizontal bands of each
+ * picture (1 by default, meaning no thread is created).
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static inline int upipe_filter_yadif_set_threads(struct upipe *upipe,
+                                                 unsigned int threads)
+{
+    return upipe_control(upipe, UPIPE_FILTER_YADIF_SET_THREADS,
+                         UPIPE_FILTER_YADIF_SIGNATURE, threads);
+}
+
+/** @This returns the number of band threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads_p filled in with the number of threads
+ * @return an error code
+ */
+static inline int upipe_filter_yadif_get_threads(struct upipe *upipe,
+                                                 unsigned int *threads_p)
+{
+    return upipe_control(upipe, UPIPE_FILTER_YADIF_GET_THREADS,
+                         UPIPE_FILTER_YADIF_SIGNATURE, threads_p);
+}
+
+/** @This returns the management structure for yadif pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_filter_yadif_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -36,6 +36,10 @@ extern "C" {
 
 #include <upipe/upipe.h>
 #include <upipe/uref_attr.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
 
 #define UPIPE_AUDIO_SPLIT_SIGNATURE UBASE_FOURCC('a','s','p','l')
 #define UPIPE_AUDIO_SPLIT_OUTPUT_SIGNATURE UBASE_FOURCC('a','s','p','o')
@@ -43,6 +47,35 @@ extern "C" {
 UREF_ATTR_SMALL_UNSIGNED_VA(audio_split, orig_index, "audio_split.orig_index[%s]",
         audio split original index, const char *plane, plane)
 
+/** @This defines a function extracting all channels of interleaved samples
+ * of a given size in one pass, into an array of planes indexed by channel
+ * (NULL for unused channels). */
+typedef void (*upipe_audio_split_extract)(uint8_t *const *outs,
+                                          const uint8_t *in, size_t samples,
+                                          uint8_t channels);
+
+/** @This extracts channels of interleaved samples of any size. */
+void upipe_audio_split_extract_c(uint8_t *const *outs, const uint8_t *in,
+                                 size_t samples, uint8_t channels,
+                                 uint8_t sample_size);
+/** @This extracts channels of 16-bit samples (s16). */
+void upipe_audio_split_extract16_c(uint8_t *const *outs, const uint8_t *in,
+                                   size_t samples, uint8_t channels);
+/** @This extracts channels of 32-bit samples (s32 and flt). */
+void upipe_audio_split_extract32_c(uint8_t *const *outs, const uint8_t *in,
+                                   size_t samples, uint8_t channels);
+
+#ifdef UCPU_X86
+/** @This is the SSE2 version of @ref upipe_audio_split_extract16_c. */
+void upipe_audio_split_extract16_sse2(uint8_t *const *outs,
+                                      const uint8_t *in, size_t samples,
+                                      uint8_t channels);
+/** @This is the SSE2 version of @ref upipe_audio_split_extract32_c. */
+void upipe_audio_split_extract32_sse2(uint8_t *const *outs,
+                                      const uint8_t *in, size_t samples,
+                                      uint8_t channels);
+#endif
+
 /** @This returns the management structure for all audio_split pipes.
  *
  * @return pointer to manager
@@ -36,10 +36,33 @@ extern "C" {
 #endif
 
 #include <upipe/upipe.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 #define UPIPE_BLIT_SIGNATURE UBASE_FOURCC('b','l','i','t')
 #define UPIPE_BLIT_SUB_SIGNATURE UBASE_FOURCC('b','l','i','s')
 
+/** @This defines a function blending a line of samples into another, with
+ * one alpha value per sample. */
+typedef void (*upipe_blit_blend)(uint8_t *dest, const uint8_t *src,
+                                 const uint8_t *alpha, size_t width);
+
+/** @This blends a line of 8-bit samples into another. */
+void upipe_blit_blend8_c(uint8_t *dest, const uint8_t *src,
+                         const uint8_t *alpha, size_t width);
+
+#ifdef UCPU_X86
+/** @This is the SSE2 version of @ref upipe_blit_blend8_c. */
+void upipe_blit_blend8_sse2(uint8_t *dest, const uint8_t *src,
+                            const uint8_t *alpha, size_t width);
+/** @This is the AVX2 version of @ref upipe_blit_blend8_c. */
+void upipe_blit_blend8_avx2(uint8_t *dest, const uint8_t *src,
+                            const uint8_t *alpha, size_t width);
+#endif
+
 /** @This returns the management structure for blit pipes.
  *
  * @return pointer to manager
@@ -56,7 +79,11 @@ enum upipe_blit_sub_command {
     UPIPE_BLIT_SUB_GET_RECT,
     /** sets the offsets of the rect onto which the input of this subpipe
      * will be blitted (uint64_t, uint64_t, uint64_t, uint64_t) */
-    UPIPE_BLIT_SUB_SET_RECT
+    UPIPE_BLIT_SUB_SET_RECT,
+    /** gets the cache mode (bool *) */
+    UPIPE_BLIT_SUB_GET_CACHE,
+    /** sets the cache mode (bool) */
+    UPIPE_BLIT_SUB_SET_CACHE
 };
 
 /** @This gets the offsets (from the respective borders of the frame) of the
@@ -96,6 +123,34 @@ static inline int upipe_blit_sub_set_rect(struct upipe *upipe,
                          loffset, roffset, toffset, boffset);
 }
 
+/** @This gets the cache mode of the subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param cache_p filled in with true if the cache mode is enabled
+ * @return an error code
+ */
+static inline int upipe_blit_sub_get_cache(struct upipe *upipe, bool *cache_p)
+{
+    return upipe_control(upipe, UPIPE_BLIT_SUB_GET_CACHE,
+                         UPIPE_BLIT_SUB_SIGNATURE, cache_p);
+}
+
+/** @This sets the cache mode of the subpipe. By default, a subpicture is
+ * blitted into the next frame only. In cache mode, the last subpicture is
+ * kept and blitted into every following frame, until it is replaced or the
+ * flow definition changes; the alpha analysis of the subpicture is done
+ * once, and only the non-transparent rectangle is recomposited.
+ *
+ * @param upipe description structure of the pipe
+ * @param cache true to enable the cache mode
+ * @return an error code
+ */
+static inline int upipe_blit_sub_set_cache(struct upipe *upipe, bool cache)
+{
+    return upipe_control(upipe, UPIPE_BLIT_SUB_SET_CACHE,
+                         UPIPE_BLIT_SUB_SIGNATURE, cache ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
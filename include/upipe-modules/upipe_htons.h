@@ -35,10 +35,74 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 #include <upipe/upipe.h>
+#include <upipe/ucpu.h>
 
 #define UPIPE_HTONS_SIGNATURE UBASE_FOURCC('h','t','o','n')
 
+/** @This defines a function reversing the bytes of words in place. */
+typedef void (*upipe_htons_swap)(uint8_t *buf, size_t words);
+
+/** @This reverses the bytes of 16-bit words. */
+void upipe_htons_swap16_c(uint8_t *buf, size_t words);
+/** @This reverses the bytes of 24-bit words. */
+void upipe_htons_swap24_c(uint8_t *buf, size_t words);
+/** @This reverses the bytes of 32-bit words. */
+void upipe_htons_swap32_c(uint8_t *buf, size_t words);
+
+#ifdef UCPU_X86
+/** @This is the SSSE3 version of @ref upipe_htons_swap16_c. */
+void upipe_htons_swap16_ssse3(uint8_t *buf, size_t words);
+/** @This is the SSSE3 version of @ref upipe_htons_swap24_c. */
+void upipe_htons_swap24_ssse3(uint8_t *buf, size_t words);
+/** @This is the SSSE3 version of @ref upipe_htons_swap32_c. */
+void upipe_htons_swap32_ssse3(uint8_t *buf, size_t words);
+/** @This is the AVX2 version of @ref upipe_htons_swap16_c. */
+void upipe_htons_swap16_avx2(uint8_t *buf, size_t words);
+/** @This is the AVX2 version of @ref upipe_htons_swap24_c. */
+void upipe_htons_swap24_avx2(uint8_t *buf, size_t words);
+/** @This is the AVX2 version of @ref upipe_htons_swap32_c. */
+void upipe_htons_swap32_avx2(uint8_t *buf, size_t words);
+#endif
+
+/** @This extends upipe_command with specific commands for htons pipes. */
+enum upipe_htons_command {
+    UPIPE_HTONS_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the size of swapped words in octets (unsigned int) */
+    UPIPE_HTONS_SET_WORD_SIZE,
+    /** returns the size of swapped words in octets (unsigned int *) */
+    UPIPE_HTONS_GET_WORD_SIZE
+};
+
+/** @This sets the size of the words to convert to network byte order:
+ * 2 (the default), 3 or 4 octets.
+ *
+ * @param upipe description structure of the pipe
+ * @param word_size size of words in octets
+ * @return an error code
+ */
+static inline int upipe_htons_set_word_size(struct upipe *upipe,
+                                            unsigned int word_size)
+{
+    return upipe_control(upipe, UPIPE_HTONS_SET_WORD_SIZE,
+                         UPIPE_HTONS_SIGNATURE, word_size);
+}
+
+/** @This returns the size of the words to convert to network byte order.
+ *
+ * @param upipe description structure of the pipe
+ * @param word_size_p filled in with the size of words in octets
+ * @return an error code
+ */
+static inline int upipe_htons_get_word_size(struct upipe *upipe,
+                                            unsigned int *word_size_p)
+{
+    return upipe_control(upipe, UPIPE_HTONS_GET_WORD_SIZE,
+                         UPIPE_HTONS_SIGNATURE, word_size_p);
+}
+
 /** @This returns the management structure for skip pipes.
  *
  * @return pointer to manager
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module recovering lost RTP packets with SMPTE 2022-1 FEC
+ *
+ * The pipe receives the RTP media stream on its input, and the column and
+ * row FEC streams on subpipes allocated with @ref upipe_void_alloc_sub.
+ * The type of each FEC packet is read from its header, so a subpipe may
+ * carry either stream. Media packets are output in sequence number order,
+ * RTP headers included, ready to be fed to @ref upipe_rtpd_mgr_alloc.
+ * Packets behind a gap are held while the missing packet may still be
+ * recovered, that is during twice the size of the FEC matrix.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_RTP_FEC_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_RTP_FEC_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UPIPE_RTP_FEC_SIGNATURE UBASE_FOURCC('r','f','e','c')
+#define UPIPE_RTP_FEC_INPUT_SIGNATURE UBASE_FOURCC('r','f','e','i')
+
+/** @This holds the counters of a rtp_fec pipe. */
+struct upipe_rtp_fec_counters {
+    /** number of received media packets */
+    uint64_t packets;
+    /** number of received FEC packets */
+    uint64_t fec_packets;
+    /** number of media packets recovered with FEC */
+    uint64_t recovered;
+    /** number of media packets which could not be recovered */
+    uint64_t lost;
+    /** number of media packets received after they were declared lost */
+    uint64_t late;
+    /** number of media packets received twice */
+    uint64_t duplicates;
+};
+
+/** @This extends upipe_command with specific commands for rtp_fec. */
+enum upipe_rtp_fec_command {
+    UPIPE_RTP_FEC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the counters (struct upipe_rtp_fec_counters *) */
+    UPIPE_RTP_FEC_GET_COUNTERS,
+    /** returns the size of the FEC matrix (unsigned int *,
+     * unsigned int *) */
+    UPIPE_RTP_FEC_GET_MATRIX
+};
+
+/** @This returns the counters of the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param counters_p filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_rtp_fec_get_counters(struct upipe *upipe,
+        struct upipe_rtp_fec_counters *counters_p)
+{
+    return upipe_control(upipe, UPIPE_RTP_FEC_GET_COUNTERS,
+                         UPIPE_RTP_FEC_SIGNATURE, counters_p);
+}
+
+/** @This returns the size of the FEC matrix, as announced by the FEC
+ * packets received so far.
+ *
+ * @param upipe description structure of the pipe
+ * @param columns_p filled in with the number of columns (L), or 0
+ * @param rows_p filled in with the number of rows (D), or 0
+ * @return an error code
+ */
+static inline int upipe_rtp_fec_get_matrix(struct upipe *upipe,
+                                           unsigned int *columns_p,
+                                           unsigned int *rows_p)
+{
+    return upipe_control(upipe, UPIPE_RTP_FEC_GET_MATRIX,
+                         UPIPE_RTP_FEC_SIGNATURE, columns_p, rows_p);
+}
+
+/** @This defines a function XORing a buffer of 64-bit words into another. */
+typedef void (*upipe_rtp_fec_xor)(uint64_t *restrict dst,
+                                  const uint64_t *restrict src, size_t words);
+
+/** @This XORs a buffer into another. */
+void upipe_rtp_fec_xor_c(uint64_t *restrict dst, const uint64_t *restrict src,
+                         size_t words);
+
+#ifdef UCPU_X86
+/** @This is the SSE2 version of @ref upipe_rtp_fec_xor_c. */
+void upipe_rtp_fec_xor_sse2(uint64_t *restrict dst,
+                            const uint64_t *restrict src, size_t words);
+/** @This is the AVX2 version of @ref upipe_rtp_fec_xor_c. */
+void upipe_rtp_fec_xor_avx2(uint64_t *restrict dst,
+                            const uint64_t *restrict src, size_t words);
+#endif
+
+/** @This returns the management structure for all rtp_fec pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtp_fec_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module merging redundant RTP streams (SMPTE 2022-7)
+ *
+ * This module has no input of its own: each path of the redundant stream is
+ * fed to an input subpipe, allocated with @ref upipe_void_alloc_sub. RTP
+ * packets are identified by their sequence number: the first copy of a
+ * packet, from whichever path, is kept and the others are dropped. Packets
+ * are output in sequence order as soon as they are contiguous, so that no
+ * latency is added as long as one path is complete. When a packet is missing
+ * on all paths, the following packets are held until the gap is filled, or
+ * until they have waited for the configured delay, or until the window of
+ * sequence numbers is full; the missing packet is then declared lost. If
+ * the pipe is given a upump manager and a uclock, a timer releases the held
+ * packets when the delay expires, even if no other packet is received.
+ *
+ * The output is the RTP stream, headers included, ready to be fed to
+ * @ref upipe_rtpd_mgr_alloc.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_RTP_MERGE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_RTP_MERGE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_RTP_MERGE_SIGNATURE UBASE_FOURCC('r','t','m','g')
+#define UPIPE_RTP_MERGE_INPUT_SIGNATURE UBASE_FOURCC('r','t','m','i')
+
+/** @This holds the counters of a merge pipe or of one of its inputs. */
+struct upipe_rtp_merge_counters {
+    /** number of packets received by an input, or output by the merge */
+    uint64_t packets;
+    /** number of packets missing on an input, or missing on all inputs */
+    uint64_t lost;
+    /** number of packets missing on an input that were received on another
+     * input */
+    uint64_t recovered;
+    /** number of packets dropped because they were already received */
+    uint64_t duplicates;
+    /** number of packets dropped because they were received after being
+     * declared lost */
+    uint64_t late;
+};
+
+/** @This extends upipe_command with specific commands for rtp_merge. */
+enum upipe_rtp_merge_command {
+    UPIPE_RTP_MERGE_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the maximum delay of a packet waiting for a gap
+     * (uint64_t *) */
+    UPIPE_RTP_MERGE_GET_DELAY,
+    /** sets the maximum delay of a packet waiting for a gap (uint64_t) */
+    UPIPE_RTP_MERGE_SET_DELAY,
+    /** returns the counters of the pipe
+     * (struct upipe_rtp_merge_counters *) */
+    UPIPE_RTP_MERGE_GET_COUNTERS
+};
+
+/** @This returns the maximum delay of a packet waiting for a gap to be
+ * filled.
+ *
+ * @param upipe description structure of the pipe
+ * @param delay_p filled in with the delay
+ * @return an error code
+ */
+static inline int upipe_rtp_merge_get_delay(struct upipe *upipe,
+                                            uint64_t *delay_p)
+{
+    return upipe_control(upipe, UPIPE_RTP_MERGE_GET_DELAY,
+                         UPIPE_RTP_MERGE_SIGNATURE, delay_p);
+}
+
+/** @This sets the maximum delay of a packet waiting for a gap to be filled.
+ * It should be slightly larger than the skew between the paths.
+ *
+ * @param upipe description structure of the pipe
+ * @param delay delay, in units of the system clock
+ * @return an error code
+ */
+static inline int upipe_rtp_merge_set_delay(struct upipe *upipe,
+                                            uint64_t delay)
+{
+    return upipe_control(upipe, UPIPE_RTP_MERGE_SET_DELAY,
+                         UPIPE_RTP_MERGE_SIGNATURE, delay);
+}
+
+/** @This returns the counters of a merge pipe, or of one of its inputs.
+ *
+ * @param upipe description structure of the pipe or subpipe
+ * @param counters_p filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_rtp_merge_get_counters(struct upipe *upipe,
+        struct upipe_rtp_merge_counters *counters_p)
+{
+    return upipe_control(upipe, UPIPE_RTP_MERGE_GET_COUNTERS,
+                         UPIPE_RTP_MERGE_SIGNATURE, counters_p);
+}
+
+/** @This returns the management structure for all rtp_merge pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtp_merge_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
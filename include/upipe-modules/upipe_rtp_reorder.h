@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module reordering RTP packets (jitter buffer)
+ *
+ * This module sorts incoming RTP packets by sequence number. Packets are
+ * output as soon as they are contiguous. When a packet is missing, the
+ * following packets are held until it arrives, or until the first held
+ * packet has waited for the configured latency budget, measured from its
+ * arrival date (cr_sys); the missing packet is then declared lost. If an
+ * upump manager and a uclock are available, a timer releases the held
+ * packets when the budget expires, otherwise they are released upon
+ * reception of the next packets.
+ *
+ * The output is the RTP stream, headers included, ready to be fed to
+ * @ref upipe_rtpd_mgr_alloc.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_RTP_REORDER_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_RTP_REORDER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_RTP_REORDER_SIGNATURE UBASE_FOURCC('r','t','p','r')
+
+/** @This holds the counters of a rtp_reorder pipe. */
+struct upipe_rtp_reorder_counters {
+    /** number of received packets */
+    uint64_t packets;
+    /** number of packets declared lost */
+    uint64_t lost;
+    /** number of packets received after they were declared lost */
+    uint64_t late;
+    /** number of packets received after a packet with a higher sequence
+     * number, and output in order */
+    uint64_t reordered;
+    /** number of packets received twice */
+    uint64_t duplicates;
+};
+
+/** @This extends upipe_command with specific commands for rtp_reorder. */
+enum upipe_rtp_reorder_command {
+    UPIPE_RTP_REORDER_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the latency budget (uint64_t *) */
+    UPIPE_RTP_REORDER_GET_LATENCY,
+    /** sets the latency budget (uint64_t) */
+    UPIPE_RTP_REORDER_SET_LATENCY,
+    /** returns the counters (struct upipe_rtp_reorder_counters *) */
+    UPIPE_RTP_REORDER_GET_COUNTERS
+};
+
+/** @This returns the latency budget.
+ *
+ * @param upipe description structure of the pipe
+ * @param latency_p filled in with the latency
+ * @return an error code
+ */
+static inline int upipe_rtp_reorder_get_latency(struct upipe *upipe,
+                                                uint64_t *latency_p)
+{
+    return upipe_control(upipe, UPIPE_RTP_REORDER_GET_LATENCY,
+                         UPIPE_RTP_REORDER_SIGNATURE, latency_p);
+}
+
+/** @This sets the latency budget, that is the maximum time a packet may be
+ * held while waiting for a missing packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param latency latency, in units of the system clock
+ * @return an error code
+ */
+static inline int upipe_rtp_reorder_set_latency(struct upipe *upipe,
+                                                uint64_t latency)
+{
+    return upipe_control(upipe, UPIPE_RTP_REORDER_SET_LATENCY,
+                         UPIPE_RTP_REORDER_SIGNATURE, latency);
+}
+
+/** @This returns the counters of the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param counters_p filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_rtp_reorder_get_counters(struct upipe *upipe,
+        struct upipe_rtp_reorder_counters *counters_p)
+{
+    return upipe_control(upipe, UPIPE_RTP_REORDER_GET_COUNTERS,
+                         UPIPE_RTP_REORDER_SIGNATURE, counters_p);
+}
+
+/** @This returns the management structure for all rtp_reorder pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtp_reorder_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
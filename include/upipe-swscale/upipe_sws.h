@@ -45,7 +45,11 @@ enum upipe_sws_command {
     /** set flags (int) */
     UPIPE_SWS_SET_FLAGS,
     /** get flags (int *) */
-    UPIPE_SWS_GET_FLAGS
+    UPIPE_SWS_GET_FLAGS,
+    /** sets the number of slice threads (unsigned int) */
+    UPIPE_SWS_SET_THREADS,
+    /** returns the number of slice threads (unsigned int *) */
+    UPIPE_SWS_GET_THREADS
 };
 
 /** @This gets the swscale flags.
@@ -72,6 +76,34 @@ static inline bool upipe_sws_set_flags(struct upipe *upipe, int flags)
                          flags);
 }
 
+/** @This sets the number of threads scaling horizontal slices of each
+ * picture, each with its own swscale context (1 by default, meaning no
+ * thread is created). Pictures too small to be split are scaled at once.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static inline int upipe_sws_set_threads(struct upipe *upipe,
+                                        unsigned int threads)
+{
+    return upipe_control(upipe, UPIPE_SWS_SET_THREADS, UPIPE_SWS_SIGNATURE,
+                         threads);
+}
+
+/** @This returns the number of slice threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads_p filled in with the number of threads
+ * @return an error code
+ */
+static inline int upipe_sws_get_threads(struct upipe *upipe,
+                                        unsigned int *threads_p)
+{
+    return upipe_control(upipe, UPIPE_SWS_GET_THREADS, UPIPE_SWS_SIGNATURE,
+                         threads_p);
+}
+
 /** @This returns the management structure for sws pipes.
  *
  * @return pointer to manager
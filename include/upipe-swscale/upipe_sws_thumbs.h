@@ -37,9 +37,35 @@ extern "C" {
 #endif
 
 #include <upipe/upipe.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
 
 #define UPIPE_SWS_THUMBS_SIGNATURE UBASE_FOURCC('s','w','s','t')
 
+/** @This defines a function adding a line of samples to accumulators. */
+typedef void (*upipe_sws_thumbs_accumulate)(uint16_t *acc, const uint8_t *src,
+                                            size_t width);
+
+/** @This adds a line of 8-bit samples to 16-bit accumulators. */
+void upipe_sws_thumbs_accumulate_c(uint16_t *acc, const uint8_t *src,
+                                   size_t width);
+/** @This averages groups of hfactor accumulators, each summing area /
+ * hfactor samples, into width 8-bit samples. */
+void upipe_sws_thumbs_average_c(uint8_t *dest, const uint16_t *acc,
+                                size_t width, unsigned int hfactor,
+                                unsigned int area);
+
+#ifdef UCPU_X86
+/** @This is the SSE2 version of @ref upipe_sws_thumbs_accumulate_c. */
+void upipe_sws_thumbs_accumulate_sse2(uint16_t *acc, const uint8_t *src,
+                                      size_t width);
+/** @This is the AVX2 version of @ref upipe_sws_thumbs_accumulate_c. */
+void upipe_sws_thumbs_accumulate_avx2(uint16_t *acc, const uint8_t *src,
+                                      size_t width);
+#endif
+
 /** @This extends upipe_command with specific commands for avcodec decode. */
 enum upipe_sws_thumbs_command {
     UPIPE_SWS_THUMBS_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe fast CRC-32/MPEG-2 computation for PSI sections
+ *
+ * This is a drop-in replacement for psi_check_crc() and psi_set_crc() from
+ * <bitstream/mpeg/psi.h>, which use a byte-wise table. The implementation is
+ * chosen at runtime: carry-less multiplication folding on x86 CPUs
+ * supporting PCLMULQDQ, and slicing-by-8 tables otherwise.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_CRC_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_CRC_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <bitstream/mpeg/psi.h>
+
+/** @This is the initial value of a CRC-32/MPEG-2 computation. */
+#define UPIPE_TS_CRC_INIT UINT32_C(0xffffffff)
+
+/** @This updates a CRC-32/MPEG-2 (polynomial 0x04c11db7, no reflection,
+ * no final xor) with the given octets, using the fastest implementation
+ * available on the running CPU.
+ *
+ * @param crc current CRC value, initialize with @ref UPIPE_TS_CRC_INIT
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value
+ */
+uint32_t upipe_ts_crc32(uint32_t crc, const uint8_t *buffer, size_t size);
+
+/** @This updates a CRC-32/MPEG-2 with the portable slicing-by-8
+ * implementation. It is mostly useful for testing purposes.
+ *
+ * @param crc current CRC value
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value
+ */
+uint32_t upipe_ts_crc32_c(uint32_t crc, const uint8_t *buffer, size_t size);
+
+/** @This updates a CRC-32/MPEG-2 with the PCLMULQDQ implementation. It
+ * is mostly useful for testing purposes.
+ *
+ * @param crc current CRC value
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value, or the result of @ref upipe_ts_crc32_c if the
+ * CPU or the compiler do not support it
+ */
+uint32_t upipe_ts_crc32_clmul(uint32_t crc, const uint8_t *buffer,
+                              size_t size);
+
+/** @This checks the CRC of a PSI section. The section length must have
+ * been validated beforehand.
+ *
+ * @param section pointer to the PSI section
+ * @return false if the CRC is invalid
+ */
+static inline bool upipe_ts_psi_check_crc(const uint8_t *section)
+{
+    /* running the CRC over the CRC field yields 0 on valid sections */
+    return !upipe_ts_crc32(UPIPE_TS_CRC_INIT, section,
+                           psi_get_length(section) + PSI_HEADER_SIZE);
+}
+
+/** @This computes and writes the CRC of a PSI section. The section length
+ * must have been set beforehand.
+ *
+ * @param section pointer to the PSI section
+ */
+static inline void upipe_ts_psi_set_crc(uint8_t *section)
+{
+    uint16_t length = psi_get_length(section) + PSI_HEADER_SIZE -
+                      PSI_CRC_SIZE;
+    uint32_t crc = upipe_ts_crc32(UPIPE_TS_CRC_INIT, section, length);
+    section[length] = crc >> 24;
+    section[length + 1] = (crc >> 16) & 0xff;
+    section[length + 2] = (crc >> 8) & 0xff;
+    section[length + 3] = crc & 0xff;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
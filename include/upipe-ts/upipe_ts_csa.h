@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module descrambling DVB-CSA transport streams
+ * Normative references:
+ *  - ETSI ETR 289 (1996-10) (support for use of scrambling and conditional
+ *  access within digital broadcasting systems)
+ *
+ * This module is meant to be placed between ts_split and ts_decaps, so each
+ * instance sees the packets of a single PID. Scrambled packets are held until
+ * @ref UPIPE_TS_CSA_BATCH (or the value set with
+ * @ref upipe_ts_csa_set_batch) of them are received, and then descrambled
+ * together: the stream cipher is bitsliced, one bit of each packet per
+ * 64-bit word. A batch is also output early when it spans more than 40 ms of
+ * cr_sys dates, when its first packet has waited 40 ms (if a upump manager
+ * is available), and when a clear packet, a packet scrambled with the other
+ * key, a new control word or a flush arrives, so the order of the packets is
+ * always kept.
+ *
+ * The even and odd control words are set with @ref upipe_ts_csa_set_cw,
+ * typically from the ECM handling of the application. Packets scrambled with
+ * a key which has not been set are dropped.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_CSA_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_CSA_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define UPIPE_TS_CSA_SIGNATURE UBASE_FOURCC('t','c','s','a')
+
+/** @This is the max number of packets descrambled in one batch. */
+#define UPIPE_TS_CSA_BATCH 64
+/** @This is the size of a DVB-CSA control word. */
+#define UPIPE_TS_CSA_CW_SIZE 8
+
+/** @This is a DVB-CSA key, derived from a control word. */
+struct upipe_ts_csa_key {
+    /** control word, used by the stream cipher */
+    uint8_t cw[UPIPE_TS_CSA_CW_SIZE];
+    /** key schedule of the block cipher */
+    uint8_t kk[56];
+};
+
+/** @This computes the key schedule of a control word.
+ *
+ * @param key key to initialize
+ * @param cw control word
+ */
+void upipe_ts_csa_key_init(struct upipe_ts_csa_key *key, const uint8_t *cw);
+
+/** @This descrambles a batch of TS payloads in place. Payloads shorter than
+ * 8 octets are not scrambled and are left untouched.
+ *
+ * @param key key used to scramble the payloads
+ * @param payloads array of pointers to the payloads
+ * @param sizes array of sizes of the payloads
+ * @param nb number of payloads, at most @ref UPIPE_TS_CSA_BATCH
+ */
+void upipe_ts_csa_descramble(const struct upipe_ts_csa_key *key,
+                             uint8_t **payloads, const size_t *sizes,
+                             unsigned int nb);
+
+/** @This scrambles a TS payload in place. This is mostly useful to generate
+ * test streams, and is not optimized.
+ *
+ * @param key key used to scramble the payload
+ * @param payload pointer to the payload
+ * @param size size of the payload
+ */
+void upipe_ts_csa_scramble(const struct upipe_ts_csa_key *key,
+                           uint8_t *payload, size_t size);
+
+/** @This extends upipe_command with specific commands for ts_csa. */
+enum upipe_ts_csa_command {
+    UPIPE_TS_CSA_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets a control word (int odd, const uint8_t *) */
+    UPIPE_TS_CSA_SET_CW,
+    /** returns the max number of packets in a batch (unsigned int *) */
+    UPIPE_TS_CSA_GET_BATCH,
+    /** sets the max number of packets in a batch (unsigned int) */
+    UPIPE_TS_CSA_SET_BATCH
+};
+
+/** @This sets the even or odd control word. Packets already received are
+ * descrambled with the previous control word.
+ *
+ * @param upipe description structure of the pipe
+ * @param odd true for the odd control word, false for the even one
+ * @param cw control word (@ref UPIPE_TS_CSA_CW_SIZE octets), or NULL to
+ * unset it
+ * @return an error code
+ */
+static inline int upipe_ts_csa_set_cw(struct upipe *upipe, bool odd,
+                                      const uint8_t *cw)
+{
+    return upipe_control(upipe, UPIPE_TS_CSA_SET_CW, UPIPE_TS_CSA_SIGNATURE,
+                         odd ? 1 : 0, cw);
+}
+
+/** @This returns the max number of packets descrambled in one batch.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch_p filled in with the number of packets
+ * @return an error code
+ */
+static inline int upipe_ts_csa_get_batch(struct upipe *upipe,
+                                         unsigned int *batch_p)
+{
+    return upipe_control(upipe, UPIPE_TS_CSA_GET_BATCH,
+                         UPIPE_TS_CSA_SIGNATURE, batch_p);
+}
+
+/** @This sets the max number of packets descrambled in one batch. Lower
+ * values reduce the latency on low-bitrate PIDs at the expense of CPU
+ * usage.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch number of packets, between 1 and @ref UPIPE_TS_CSA_BATCH
+ * @return an error code
+ */
+static inline int upipe_ts_csa_set_batch(struct upipe *upipe,
+                                         unsigned int batch)
+{
+    return upipe_control(upipe, UPIPE_TS_CSA_SET_BATCH,
+                         UPIPE_TS_CSA_SIGNATURE, batch);
+}
+
+/** @This returns the management structure for all ts_csa pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_csa_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
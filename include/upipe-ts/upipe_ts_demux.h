@@ -31,6 +31,7 @@ extern "C" {
 
 #include <upipe/upipe.h>
 #include <upipe-ts/upipe_ts.h>
+#include <upipe-ts/upipe_ts_psi_cache.h>
 
 #define UPIPE_TS_DEMUX_SIGNATURE UBASE_FOURCC('t','s','d','x')
 #define UPIPE_TS_DEMUX_PROGRAM_SIGNATURE UBASE_FOURCC('t','s','d','p')
@@ -51,9 +52,58 @@ enum upipe_ts_demux_command {
     /** returns the currently detected conformance (int *) */
     UPIPE_TS_DEMUX_GET_CONFORMANCE,
     /** sets the conformance (int) */
-    UPIPE_TS_DEMUX_SET_CONFORMANCE
+    UPIPE_TS_DEMUX_SET_CONFORMANCE,
+    /** sets the PSI cache used to warm start the demux
+     * (struct upipe_ts_psi_cache *, const char *) */
+    UPIPE_TS_DEMUX_SET_PSI_CACHE,
+
+    /** PSI decoder commands begin here */
+    UPIPE_TS_DEMUX_PSID = UPIPE_CONTROL_LOCAL + 0x1000
+};
+
+/** @This extends upipe_command with commands common to all PSI table
+ * decoders (PAT, PMT, NIT, SDT, EIT). */
+enum upipe_ts_psid_command {
+    UPIPE_TS_PSID_SENTINEL = UPIPE_TS_DEMUX_PSID,
+
+    /** returns the number of sections skipped because they were unchanged
+     * repetitions of the table in effect (uint64_t *) */
+    UPIPE_TS_PSID_GET_SKIPPED,
+    /** returns a section of the table in effect (unsigned int,
+     * struct uref **) */
+    UPIPE_TS_PSID_GET_SECTION
 };
 
+/** @This returns the number of sections that a PSI table decoder skipped
+ * because they were unchanged repetitions of the table in effect.
+ *
+ * @param upipe description structure of the PSI table decoder
+ * @param skipped_p filled in with the number of skipped sections
+ * @return an error code
+ */
+static inline int upipe_ts_psid_get_skipped(struct upipe *upipe,
+                                            uint64_t *skipped_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PSID_GET_SKIPPED,
+                         UPIPE_TS_DEMUX_SIGNATURE, skipped_p);
+}
+
+/** @This returns a section of the table in effect in a PSI table decoder.
+ * The returned uref belongs to the decoder and must not be freed.
+ *
+ * @param upipe description structure of the PSI table decoder
+ * @param section number of the section
+ * @param section_p filled in with the section
+ * @return an error code
+ */
+static inline int upipe_ts_psid_get_section(struct upipe *upipe,
+                                            unsigned int section,
+                                            struct uref **section_p)
+{
+    return upipe_control(upipe, UPIPE_TS_PSID_GET_SECTION,
+                         UPIPE_TS_DEMUX_SIGNATURE, section, section_p);
+}
+
 /** @This returns the currently detected conformance mode. It cannot return
  * UPIPE_TS_CONFORMANCE_AUTO.
  *
@@ -83,6 +133,115 @@ static inline int
                          UPIPE_TS_DEMUX_SIGNATURE, conformance);
 }
 
+/** @This sets the PSI cache used to warm start the demux. The PAT and PMTs
+ * found in the cache under the given key are fed to the decoders immediately,
+ * so that programs and outputs may be created before the tables are
+ * received; the tables received afterwards replace them if they differ. The
+ * tables received are stored in the cache under the same key.
+ *
+ * @param upipe description structure of the pipe
+ * @param cache pointer to the PSI cache, or NULL to disable it
+ * @param key key of the stream in the cache, typically the URI of the input
+ * @return an error code
+ */
+static inline int
+    upipe_ts_demux_set_psi_cache(struct upipe *upipe,
+                                 struct upipe_ts_psi_cache *cache,
+                                 const char *key)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_SET_PSI_CACHE,
+                         UPIPE_TS_DEMUX_SIGNATURE, cache, key);
+}
+
+/** @This is the number of buckets of the PCR jitter histogram. */
+#define UPIPE_TS_DEMUX_PCR_JITTER_BUCKETS 16
+
+/** @This holds the statistics of the PCRs of a program. Intervals and
+ * jitters are in 27 MHz units. */
+struct upipe_ts_demux_pcr_stats {
+    /** number of PCRs */
+    uint64_t pcrs;
+    /** number of discontinuities */
+    uint64_t discontinuities;
+    /** min interval between consecutive PCRs, or UINT64_MAX */
+    uint64_t interval_min;
+    /** max interval between consecutive PCRs */
+    uint64_t interval_max;
+
+    /** number of jitter measurements (PCRs with an arrival date) */
+    uint64_t jitters;
+    /** min difference between arrival interval and PCR interval */
+    int64_t jitter_min;
+    /** max difference between arrival interval and PCR interval */
+    int64_t jitter_max;
+    /** histogram of absolute jitters: bucket 0 counts jitters below 1 us,
+     * bucket i those between 2^(i-1) and 2^i us, and the last bucket all
+     * higher values */
+    uint64_t jitter_histogram[UPIPE_TS_DEMUX_PCR_JITTER_BUCKETS];
+
+    /** drift of the stream clock relative to the local clock, in parts
+     * per million, measured since the last discontinuity (0 if unknown) */
+    double drift_ppm;
+};
+
+/** @This returns an upper bound of the given percentile of absolute PCR
+ * jitters.
+ *
+ * @param stats PCR statistics
+ * @param percent percentile (0 to 100)
+ * @return upper bound in us, 0 if there is no measurement, or UINT64_MAX if
+ * the percentile falls in the last bucket
+ */
+static inline uint64_t upipe_ts_demux_pcr_stats_percentile(
+        const struct upipe_ts_demux_pcr_stats *stats, unsigned int percent)
+{
+    if (!stats->jitters)
+        return 0;
+    uint64_t threshold = (stats->jitters * percent + 99) / 100;
+    uint64_t count = 0;
+    for (unsigned int i = 0; i < UPIPE_TS_DEMUX_PCR_JITTER_BUCKETS - 1; i++) {
+        count += stats->jitter_histogram[i];
+        if (count >= threshold)
+            return UINT64_C(1) << i;
+    }
+    return UINT64_MAX;
+}
+
+/** @This extends upipe_command with specific commands for ts demux
+ * programs. */
+enum upipe_ts_demux_program_command {
+    UPIPE_TS_DEMUX_PROGRAM_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the PCR statistics (struct upipe_ts_demux_pcr_stats *) */
+    UPIPE_TS_DEMUX_PROGRAM_GET_PCR_STATS,
+    /** resets the PCR statistics (void) */
+    UPIPE_TS_DEMUX_PROGRAM_RESET_PCR_STATS
+};
+
+/** @This returns the statistics of the PCRs of a program.
+ *
+ * @param upipe description structure of the program subpipe
+ * @param stats_p filled in with the statistics
+ * @return an error code
+ */
+static inline int upipe_ts_demux_program_get_pcr_stats(struct upipe *upipe,
+        struct upipe_ts_demux_pcr_stats *stats_p)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_PROGRAM_GET_PCR_STATS,
+                         UPIPE_TS_DEMUX_PROGRAM_SIGNATURE, stats_p);
+}
+
+/** @This resets the statistics of the PCRs of a program.
+ *
+ * @param upipe description structure of the program subpipe
+ * @return an error code
+ */
+static inline int upipe_ts_demux_program_reset_pcr_stats(struct upipe *upipe)
+{
+    return upipe_control(upipe, UPIPE_TS_DEMUX_PROGRAM_RESET_PCR_STATS,
+                         UPIPE_TS_DEMUX_PROGRAM_SIGNATURE);
+}
+
 /** @This returns the management structure for all ts_demux pipes.
  *
  * @return pointer to manager
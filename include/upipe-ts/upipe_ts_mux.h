@@ -20,6 +20,22 @@
 
 /** @file
  * @short Upipe higher-level module muxing elementary streams in a TS
+ *
+ * When no uclock is set, the mux works in file mode: it waits until all
+ * audio and video inputs have a buffered access unit, and emits packets as
+ * fast as possible. Access units are packetized lazily by the inner
+ * ts_encaps pipes, while the mux picks the next input to splice; both
+ * steps run in the thread of the mux. Packetization is not moved to other
+ * threads: the PCR and the size of the adaptation field of a packet are
+ * only known when the packet is spliced, so packets built ahead of time
+ * would have to carry PCRs in extra packets, changing the output.
+ *
+ * To remux long multi-track files on several cores, the per-input
+ * processing upstream of the mux (demuxing, framing, transcoding) may be
+ * allocated in worker threads with @ref upipe_wlin_alloc, and the output
+ * of each worker linked to a mux input. The mux interleaves the inputs as
+ * they become available, and the input queues apply back-pressure on the
+ * workers when an input is ahead of the others.
  */
 
 #ifndef _UPIPE_TS_UPIPE_TS_MUX_H_
@@ -45,7 +61,9 @@ enum uprobe_ts_mux_event {
     UPROBE_TS_MUX_LAST_CC,
 
     /** ts_encaps events begin here */
-    UPROBE_TS_MUX_ENCAPS = UPROBE_LOCAL + 0x1000
+    UPROBE_TS_MUX_ENCAPS = UPROBE_LOCAL + 0x1000,
+    /** ts_tstd events begin here */
+    UPROBE_TS_MUX_TSTD = UPROBE_LOCAL + 0x2000
 };
 
 /** @This defines the modes of multiplexing. */
@@ -105,6 +123,10 @@ enum upipe_ts_mux_command {
     UPIPE_TS_MUX_GET_EIT_INTERVAL,
     /** sets the EIT interval (uint64_t) */
     UPIPE_TS_MUX_SET_EIT_INTERVAL,
+    /** returns the current EIT schedule interval (uint64_t *) */
+    UPIPE_TS_MUX_GET_EIT_SCHED_INTERVAL,
+    /** sets the EIT schedule interval (uint64_t) */
+    UPIPE_TS_MUX_SET_EIT_SCHED_INTERVAL,
     /** returns the current TDT interval (uint64_t *) */
     UPIPE_TS_MUX_GET_TDT_INTERVAL,
     /** sets the TDT interval (uint64_t) */
@@ -154,7 +176,9 @@ enum upipe_ts_mux_command {
     /** ts_psig_program commands begin here */
     UPIPE_TS_MUX_PSIG_PROGRAM = UPIPE_CONTROL_LOCAL + 0x3000,
     /** ts_sig commands begin here */
-    UPIPE_TS_MUX_SIG = UPIPE_CONTROL_LOCAL + 0x4000
+    UPIPE_TS_MUX_SIG = UPIPE_CONTROL_LOCAL + 0x4000,
+    /** ts_tstd commands begin here */
+    UPIPE_TS_MUX_TSTD = UPIPE_CONTROL_LOCAL + 0x5000
 };
 
 /** @This returns the current conformance mode. It cannot return
@@ -358,6 +382,34 @@ static inline int upipe_ts_mux_set_eit_interval(struct upipe *upipe,
                          UPIPE_TS_MUX_SIGNATURE, interval);
 }
 
+/** @This returns the current EIT schedule interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p filled in with the interval
+ * @return an error code
+ */
+static inline int upipe_ts_mux_get_eit_sched_interval(struct upipe *upipe,
+                                                      uint64_t *interval_p)
+{
+    return upipe_control(upipe, UPIPE_TS_MUX_GET_EIT_SCHED_INTERVAL,
+                         UPIPE_TS_MUX_SIGNATURE, interval_p);
+}
+
+/** @This sets the EIT schedule interval, which may be longer than the EIT
+ * interval used for EITp/f. It takes effect at the end of the current
+ * period. It may also be called on a program subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval new interval
+ * @return an error code
+ */
+static inline int upipe_ts_mux_set_eit_sched_interval(struct upipe *upipe,
+                                                      uint64_t interval)
+{
+    return upipe_control(upipe, UPIPE_TS_MUX_SET_EIT_SCHED_INTERVAL,
+                         UPIPE_TS_MUX_SIGNATURE, interval);
+}
+
 /** @This returns the current TDT interval.
  *
  * @param upipe description structure of the pipe
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module padding a transport stream back to CBR
+ *
+ * This module is the counterpart of @ref upipe_ts_null_strip_mgr_alloc. It
+ * outputs one packet per slot of a CBR stream at the configured octet rate,
+ * and fills the slots where no packet is dated with null packets. Each
+ * packet is given the cr_sys date of its slot. When a packet has to be moved
+ * from its original date (because it arrived late, or because the octet rate
+ * differs), the PCR it may carry is corrected by the same amount, so that
+ * PCR accuracy is kept.
+ *
+ * The octet rate is taken from the input flow definition, unless it is set
+ * with @ref upipe_ts_null_pad_set_octetrate. Gaps longer than one second are
+ * considered as discontinuities, and restart the slot clock.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_NULL_PAD_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_NULL_PAD_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_TS_NULL_PAD_SIGNATURE UBASE_FOURCC('t','s','n','p')
+
+/** @This extends upipe_command with specific commands for ts_null_pad. */
+enum upipe_ts_null_pad_command {
+    UPIPE_TS_NULL_PAD_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the octet rate of the output (uint64_t *) */
+    UPIPE_TS_NULL_PAD_GET_OCTETRATE,
+    /** sets the octet rate of the output (uint64_t) */
+    UPIPE_TS_NULL_PAD_SET_OCTETRATE
+};
+
+/** @This returns the octet rate of the output.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate_p filled in with the octet rate
+ * @return an error code
+ */
+static inline int upipe_ts_null_pad_get_octetrate(struct upipe *upipe,
+                                                  uint64_t *octetrate_p)
+{
+    return upipe_control(upipe, UPIPE_TS_NULL_PAD_GET_OCTETRATE,
+                         UPIPE_TS_NULL_PAD_SIGNATURE, octetrate_p);
+}
+
+/** @This sets the octet rate of the output, overriding the octet rate of
+ * the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate octet rate, or 0 to use the input flow definition
+ * @return an error code
+ */
+static inline int upipe_ts_null_pad_set_octetrate(struct upipe *upipe,
+                                                  uint64_t octetrate)
+{
+    return upipe_control(upipe, UPIPE_TS_NULL_PAD_SET_OCTETRATE,
+                         UPIPE_TS_NULL_PAD_SIGNATURE, octetrate);
+}
+
+/** @This returns the management structure for all ts_null_pad pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_null_pad_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module stripping null packets from a CBR transport stream
+ *
+ * This module is placed after ts_sync or ts_check, and drops the packets of
+ * PID 0x1FFF. If the input flow definition has an octet rate, the cr_sys
+ * date of each remaining packet is replaced with the date of its slot in the
+ * CBR stream, so that @ref upipe_ts_null_pad_mgr_alloc may put it back at
+ * the same position. The slot clock is initialized with the first dated
+ * packet, and follows the input dates when they drift away by more than
+ * 100 ms. Without an octet rate, dates are left untouched.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_NULL_STRIP_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_NULL_STRIP_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_TS_NULL_STRIP_SIGNATURE UBASE_FOURCC('t','s','n','s')
+
+/** @This returns the management structure for all ts_null_strip pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_null_strip_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
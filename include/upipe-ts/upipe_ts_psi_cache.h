@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe cache of PSI tables, used to warm start ts_demux
+ *
+ * The cache stores the last known PSI tables of a stream, keyed by a string
+ * given by the application (typically the URI of the input) and the PID of
+ * the table. Each entry contains the concatenated sections of the table.
+ * The cache may be saved to and loaded from a file, so that it persists
+ * across restarts. It is not thread-safe.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_PSI_CACHE_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_PSI_CACHE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/ulist.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** @This is a cache of PSI tables. */
+struct upipe_ts_psi_cache {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** list of cached tables */
+    struct uchain tables;
+};
+
+/** @This allocates an empty PSI cache.
+ *
+ * @return pointer to the cache, or NULL in case of allocation error
+ */
+struct upipe_ts_psi_cache *upipe_ts_psi_cache_alloc(void);
+
+/** @This increments the reference count of a PSI cache.
+ *
+ * @param cache pointer to the cache
+ * @return same pointer to the cache
+ */
+static inline struct upipe_ts_psi_cache *
+    upipe_ts_psi_cache_use(struct upipe_ts_psi_cache *cache)
+{
+    if (cache == NULL)
+        return NULL;
+    urefcount_use(&cache->urefcount);
+    return cache;
+}
+
+/** @This decrements the reference count of a PSI cache or frees it.
+ *
+ * @param cache pointer to the cache
+ */
+static inline void upipe_ts_psi_cache_release(struct upipe_ts_psi_cache *cache)
+{
+    if (cache != NULL)
+        urefcount_release(&cache->urefcount);
+}
+
+/** @This stores a table in the cache, replacing the previous one.
+ *
+ * @param cache pointer to the cache
+ * @param key key of the stream, typically its URI
+ * @param pid PID of the table
+ * @param table concatenated sections of the table, or NULL to remove it
+ * @param size size of the table
+ * @return an error code
+ */
+int upipe_ts_psi_cache_set(struct upipe_ts_psi_cache *cache, const char *key,
+                           uint16_t pid, const uint8_t *table, size_t size);
+
+/** @This returns a table from the cache. The returned buffer is only valid
+ * until the next change of the cache.
+ *
+ * @param cache pointer to the cache
+ * @param key key of the stream, typically its URI
+ * @param pid PID of the table
+ * @param table_p filled in with the concatenated sections of the table
+ * @param size_p filled in with the size of the table
+ * @return an error code
+ */
+int upipe_ts_psi_cache_get(struct upipe_ts_psi_cache *cache, const char *key,
+                           uint16_t pid, const uint8_t **table_p,
+                           size_t *size_p);
+
+/** @This loads the tables saved in a file, and adds them to the cache.
+ *
+ * @param cache pointer to the cache
+ * @param path path of the file
+ * @return an error code
+ */
+int upipe_ts_psi_cache_load(struct upipe_ts_psi_cache *cache,
+                            const char *path);
+
+/** @This saves all the tables of the cache to a file.
+ *
+ * @param cache pointer to the cache
+ * @param path path of the file
+ * @return an error code
+ */
+int upipe_ts_psi_cache_save(struct upipe_ts_psi_cache *cache,
+                            const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
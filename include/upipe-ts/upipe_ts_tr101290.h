@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module computing TR 101 290 priority 1 and 2 indicators
+ * Normative references:
+ *  - ETSI TR 101 290 V1.2.1 (2001-05) (measurement guidelines for DVB
+ *  systems)
+ *
+ * This module analyzes TS packets (typically the output of ts_check or
+ * ts_sync) in a single pass and forwards them unchanged. Errors are
+ * accumulated in fixed-size per-PID counters, readable at any time with
+ * @ref upipe_ts_tr101290_get_counters, and reported with
+ * @ref UPROBE_TS_TR101290_ERROR.
+ *
+ * Repetition indicators of PAT, PMT and referenced PIDs need the cr_sys
+ * date of the incoming packets. PCR accuracy assumes that the input contains
+ * the whole constant bitrate multiplex.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_TR101290_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_TR101290_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#include <stdint.h>
+
+#define UPIPE_TS_TR101290_SIGNATURE UBASE_FOURCC('t','s','t','r')
+
+/** @This defines the TR 101 290 indicators. */
+enum upipe_ts_tr101290_indicator {
+    /** 1.1 loss of synchronization */
+    UPIPE_TS_TR101290_SYNC_LOSS,
+    /** 1.2 sync byte not equal to 0x47 */
+    UPIPE_TS_TR101290_SYNC_BYTE,
+    /** 1.3 PAT missing for 0.5 s, wrong table_id or scrambled */
+    UPIPE_TS_TR101290_PAT,
+    /** 1.4 incorrect packet order, duplicate or lost packet */
+    UPIPE_TS_TR101290_CC,
+    /** 1.5 PMT missing for 0.5 s, wrong table_id or scrambled */
+    UPIPE_TS_TR101290_PMT,
+    /** 1.6 PID referenced by a PMT missing for 5 s */
+    UPIPE_TS_TR101290_PID,
+    /** 2.1 transport_error_indicator set */
+    UPIPE_TS_TR101290_TRANSPORT,
+    /** 2.2 CRC error in a PAT or PMT section */
+    UPIPE_TS_TR101290_CRC,
+    /** 2.3a PCRs more than 40 ms apart */
+    UPIPE_TS_TR101290_PCR_REPETITION,
+    /** 2.3b PCRs more than 100 ms apart or going backwards without
+     * discontinuity_indicator */
+    UPIPE_TS_TR101290_PCR_DISCONTINUITY,
+    /** 2.4 PCR off by more than 500 ns */
+    UPIPE_TS_TR101290_PCR_ACCURACY,
+    /** 2.5 PTSs more than 700 ms apart */
+    UPIPE_TS_TR101290_PTS,
+
+    /** number of indicators */
+    UPIPE_TS_TR101290_MAX
+};
+
+/** @This returns a string describing an indicator.
+ *
+ * @param indicator TR 101 290 indicator
+ * @return a description of the indicator
+ */
+static inline const char *
+    upipe_ts_tr101290_indicator_str(enum upipe_ts_tr101290_indicator indicator)
+{
+    switch (indicator) {
+        case UPIPE_TS_TR101290_SYNC_LOSS: return "TS_sync_loss";
+        case UPIPE_TS_TR101290_SYNC_BYTE: return "Sync_byte_error";
+        case UPIPE_TS_TR101290_PAT: return "PAT_error";
+        case UPIPE_TS_TR101290_CC: return "Continuity_count_error";
+        case UPIPE_TS_TR101290_PMT: return "PMT_error";
+        case UPIPE_TS_TR101290_PID: return "PID_error";
+        case UPIPE_TS_TR101290_TRANSPORT: return "Transport_error";
+        case UPIPE_TS_TR101290_CRC: return "CRC_error";
+        case UPIPE_TS_TR101290_PCR_REPETITION: return "PCR_repetition_error";
+        case UPIPE_TS_TR101290_PCR_DISCONTINUITY:
+            return "PCR_discontinuity_indicator_error";
+        case UPIPE_TS_TR101290_PCR_ACCURACY: return "PCR_accuracy_error";
+        case UPIPE_TS_TR101290_PTS: return "PTS_error";
+        default: return "unknown";
+    }
+}
+
+/** @This holds the counters of a TS or of a PID. */
+struct upipe_ts_tr101290_counters {
+    /** number of analyzed packets */
+    uint64_t packets;
+    /** number of errors per indicator */
+    uint64_t errors[UPIPE_TS_TR101290_MAX];
+};
+
+/** @This extends uprobe_event with specific events for ts_tr101290. */
+enum uprobe_ts_tr101290_event {
+    UPROBE_TS_TR101290_SENTINEL = UPROBE_LOCAL,
+
+    /** an error was detected (unsigned int indicator, unsigned int pid,
+     * 8192 if not related to a PID) */
+    UPROBE_TS_TR101290_ERROR
+};
+
+/** @This extends upipe_command with specific commands for ts_tr101290. */
+enum upipe_ts_tr101290_command {
+    UPIPE_TS_TR101290_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the counters of the TS (struct upipe_ts_tr101290_counters *) */
+    UPIPE_TS_TR101290_GET_COUNTERS,
+    /** returns the counters of a PID (unsigned int,
+     * struct upipe_ts_tr101290_counters *) */
+    UPIPE_TS_TR101290_GET_PID_COUNTERS,
+    /** resets all counters (void) */
+    UPIPE_TS_TR101290_RESET_COUNTERS
+};
+
+/** @This returns the counters of the whole TS.
+ *
+ * @param upipe description structure of the pipe
+ * @param counters_p filled in with the counters
+ * @return an error code
+ */
+static inline int upipe_ts_tr101290_get_counters(struct upipe *upipe,
+        struct upipe_ts_tr101290_counters *counters_p)
+{
+    return upipe_control(upipe, UPIPE_TS_TR101290_GET_COUNTERS,
+                         UPIPE_TS_TR101290_SIGNATURE, counters_p);
+}
+
+/** @This returns the counters of a PID.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID to query
+ * @param counters_p filled in with the counters
+ * @return an error code, UBASE_ERR_INVALID if the PID was never seen
+ */
+static inline int upipe_ts_tr101290_get_pid_counters(struct upipe *upipe,
+        unsigned int pid, struct upipe_ts_tr101290_counters *counters_p)
+{
+    return upipe_control(upipe, UPIPE_TS_TR101290_GET_PID_COUNTERS,
+                         UPIPE_TS_TR101290_SIGNATURE, pid, counters_p);
+}
+
+/** @This resets all counters. The state of the analysis is kept.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static inline int upipe_ts_tr101290_reset_counters(struct upipe *upipe)
+{
+    return upipe_control(upipe, UPIPE_TS_TR101290_RESET_COUNTERS,
+                         UPIPE_TS_TR101290_SIGNATURE);
+}
+
+/** @This returns the management structure for all ts_tr101290 pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_tr101290_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -19,8 +19,14 @@
  */
 
 /** @file
- * @short Upipe module tstding that a buffer contains a given number of
- * aligned TS packets
+ * @short Upipe module calculating the T-STD buffering latency
+ *
+ * The pipe models the elementary stream buffer of the T-STD, which is
+ * filled at the octet rate of the flow and emptied of each access unit at
+ * its DTS. Overflows and underflows of the model are thrown as events, and
+ * the fullness of the buffer may be recorded into a ring buffer of samples,
+ * so that max_delay and mux_delay can be tuned with actual data. When the
+ * pipe is part of ts_mux, its commands are forwarded by the mux input.
  */
 
 #ifndef _UPIPE_TS_UPIPE_TS_TSTD_H_
@@ -31,9 +37,94 @@ extern "C" {
 #endif
 
 #include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_mux.h>
+
+#include <stdint.h>
 
 #define UPIPE_TS_TSTD_SIGNATURE UBASE_FOURCC('t','s','t','d')
 
+/** @This is a sample of the T-STD buffer model, taken for each access unit
+ * leaving the buffer. */
+struct upipe_ts_tstd_sample {
+    /** DTS of the access unit, in the program clock */
+    uint64_t dts_prog;
+    /** buffering delay applied to the access unit */
+    uint64_t delay;
+    /** fullness of the buffer after the removal of the access unit, in
+     * octets */
+    uint32_t fullness;
+    /** size of the access unit, in octets */
+    uint32_t size;
+    /** octets of overflow (positive) or underflow (negative), 0 if the
+     * access unit fits in the buffer */
+    int32_t excess;
+};
+
+/** @This extends uprobe_event with specific events for ts tstd. */
+enum uprobe_ts_tstd_event {
+    UPROBE_TS_TSTD_SENTINEL = UPROBE_TS_MUX_TSTD,
+
+    /** the buffer underflowed (uint64_t dts_prog, uint64_t octets) */
+    UPROBE_TS_TSTD_UNDERFLOW,
+    /** the buffer overflowed (uint64_t dts_prog, uint64_t octets) */
+    UPROBE_TS_TSTD_OVERFLOW
+};
+
+/** @This extends upipe_command with specific commands for ts tstd. */
+enum upipe_ts_tstd_command {
+    UPIPE_TS_TSTD_SENTINEL = UPIPE_TS_MUX_TSTD,
+
+    /** sets the number of samples kept in the trace (unsigned int) */
+    UPIPE_TS_TSTD_SET_TRACE_SIZE,
+    /** copies the samples of the trace, oldest first
+     * (struct upipe_ts_tstd_sample *, unsigned int *) */
+    UPIPE_TS_TSTD_GET_TRACE,
+    /** prints the samples of the trace at debug level (void) */
+    UPIPE_TS_TSTD_DUMP_TRACE
+};
+
+/** @This sets the number of samples kept in the ring buffer of the trace.
+ * The previous samples are discarded.
+ *
+ * @param upipe description structure of the pipe
+ * @param trace_size number of samples, or 0 to disable the trace
+ * @return an error code
+ */
+static inline int upipe_ts_tstd_set_trace_size(struct upipe *upipe,
+                                               unsigned int trace_size)
+{
+    return upipe_control(upipe, UPIPE_TS_TSTD_SET_TRACE_SIZE,
+                         UPIPE_TS_TSTD_SIGNATURE, trace_size);
+}
+
+/** @This copies the samples of the trace, oldest first. If there are more
+ * samples than the given array can hold, the most recent ones are copied.
+ *
+ * @param upipe description structure of the pipe
+ * @param samples array filled in with the samples
+ * @param nb_p number of elements in the array, filled in with the number of
+ * copied samples
+ * @return an error code
+ */
+static inline int upipe_ts_tstd_get_trace(struct upipe *upipe,
+                                          struct upipe_ts_tstd_sample *samples,
+                                          unsigned int *nb_p)
+{
+    return upipe_control(upipe, UPIPE_TS_TSTD_GET_TRACE,
+                         UPIPE_TS_TSTD_SIGNATURE, samples, nb_p);
+}
+
+/** @This prints the samples of the trace at debug level.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static inline int upipe_ts_tstd_dump_trace(struct upipe *upipe)
+{
+    return upipe_control(upipe, UPIPE_TS_TSTD_DUMP_TRACE,
+                         UPIPE_TS_TSTD_SIGNATURE);
+}
+
 /** @This returns the management structure for all ts_tstd pipes.
  *
  * @return pointer to manager
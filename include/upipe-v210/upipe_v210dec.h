@@ -0,0 +1,153 @@
+/*
+ * V210 decoder
+ *
+ * Copyright (c) 2015 Open Broadcast Systems Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** @file
+ * @short Upipe v210dec module, converting v210 to planar 4:2:2
+ *
+ * The output is planar 10-bit (y10l u10l v10l), or 8-bit (y8 u8 v8) with
+ * the two least significant bits truncated. Large pictures may be split
+ * into horizontal slices unpacked by several threads.
+ */
+
+#ifndef _UPIPE_V210_UPIPE_V210DEC_H_
+/** @hidden */
+#define _UPIPE_V210_UPIPE_V210DEC_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe-v210/upipe_v210enc.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UPIPE_V210DEC_SIGNATURE UBASE_FOURCC('v','2','1','d')
+
+/** @This defines an 8-bit unpacking function. */
+typedef void (*upipe_v210dec_unpack_line_8)(const uint8_t *src,
+        uint8_t *y, uint8_t *u, uint8_t *v, ptrdiff_t width);
+
+/** @This defines a 10-bit unpacking function. */
+typedef void (*upipe_v210dec_unpack_line_10)(const uint8_t *src,
+        uint16_t *y, uint16_t *u, uint16_t *v, ptrdiff_t width);
+
+/** @This unpacks a line of v210 to 8-bit planar 4:2:2 (width multiple of
+ * 6). */
+void upipe_v210dec_unpack_8_c(const uint8_t *src, uint8_t *y, uint8_t *u,
+                              uint8_t *v, ptrdiff_t width);
+/** @This unpacks a line of v210 to 10-bit planar 4:2:2 (width multiple of
+ * 6). */
+void upipe_v210dec_unpack_10_c(const uint8_t *src, uint16_t *y, uint16_t *u,
+                               uint16_t *v, ptrdiff_t width);
+
+#ifdef UCPU_X86
+/** @This is the SSSE3 version of @ref upipe_v210dec_unpack_8_c. */
+void upipe_v210dec_unpack_8_ssse3(const uint8_t *src, uint8_t *y,
+                                  uint8_t *u, uint8_t *v, ptrdiff_t width);
+/** @This is the SSSE3 version of @ref upipe_v210dec_unpack_10_c. */
+void upipe_v210dec_unpack_10_ssse3(const uint8_t *src, uint16_t *y,
+                                   uint16_t *u, uint16_t *v, ptrdiff_t width);
+/** @This is the AVX2 version of @ref upipe_v210dec_unpack_8_c. */
+void upipe_v210dec_unpack_8_avx2(const uint8_t *src, uint8_t *y,
+                                 uint8_t *u, uint8_t *v, ptrdiff_t width);
+/** @This is the AVX2 version of @ref upipe_v210dec_unpack_10_c. */
+void upipe_v210dec_unpack_10_avx2(const uint8_t *src, uint16_t *y,
+                                  uint16_t *u, uint16_t *v, ptrdiff_t width);
+#endif
+
+/** @This extends upipe_command with specific commands for v210dec pipes. */
+enum upipe_v210dec_command {
+    UPIPE_V210DEC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the output bit depth (int) */
+    UPIPE_V210DEC_SET_BIT_DEPTH,
+    /** returns the output bit depth (int *) */
+    UPIPE_V210DEC_GET_BIT_DEPTH,
+    /** sets the number of slice threads (unsigned int) */
+    UPIPE_V210DEC_SET_THREADS,
+    /** returns the number of slice threads (unsigned int *) */
+    UPIPE_V210DEC_GET_THREADS
+};
+
+/** @This sets the output bit depth, 8 or 10 (default). It takes effect at
+ * the next flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param bit_depth output bit depth
+ * @return an error code
+ */
+static inline int upipe_v210dec_set_bit_depth(struct upipe *upipe,
+                                              int bit_depth)
+{
+    return upipe_control(upipe, UPIPE_V210DEC_SET_BIT_DEPTH,
+                         UPIPE_V210DEC_SIGNATURE, bit_depth);
+}
+
+/** @This returns the output bit depth.
+ *
+ * @param upipe description structure of the pipe
+ * @param bit_depth_p filled in with the output bit depth
+ * @return an error code
+ */
+static inline int upipe_v210dec_get_bit_depth(struct upipe *upipe,
+                                              int *bit_depth_p)
+{
+    return upipe_control(upipe, UPIPE_V210DEC_GET_BIT_DEPTH,
+                         UPIPE_V210DEC_SIGNATURE, bit_depth_p);
+}
+
+/** @This sets the number of threads unpacking slices of each picture
+ * (1 by default, meaning no thread is created).
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static inline int upipe_v210dec_set_threads(struct upipe *upipe,
+                                            unsigned int threads)
+{
+    return upipe_control(upipe, UPIPE_V210DEC_SET_THREADS,
+                         UPIPE_V210DEC_SIGNATURE, threads);
+}
+
+/** @This returns the number of slice threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads_p filled in with the number of threads
+ * @return an error code
+ */
+static inline int upipe_v210dec_get_threads(struct upipe *upipe,
+                                            unsigned int *threads_p)
+{
+    return upipe_control(upipe, UPIPE_V210DEC_GET_THREADS,
+                         UPIPE_V210DEC_SIGNATURE, threads_p);
+}
+
+/** @This returns the management structure for v210dec pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_v210dec_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
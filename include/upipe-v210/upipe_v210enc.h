@@ -34,6 +34,10 @@ extern "C" {
 #endif
 
 #include <upipe/upipe.h>
+#include <upipe/ucpu.h>
+
+#include <stdint.h>
+#include <stddef.h>
 
 #define UPIPE_V210ENC_SIGNATURE UBASE_FOURCC('v','2','1','e')
 
@@ -47,6 +51,35 @@ typedef void (*upipe_v210enc_pack_line_10)(
         const uint16_t *y, const uint16_t *u, const uint16_t *v,
         uint8_t *dst, ptrdiff_t width);
 
+/** @This packs a line of 8-bit planar 4:2:2 to v210 (width multiple of
+ * 12). */
+void upipe_v210enc_pack_8_c(const uint8_t *y, const uint8_t *u,
+                            const uint8_t *v, uint8_t *dst, ptrdiff_t width);
+/** @This packs a line of 10-bit planar 4:2:2 to v210 (width multiple of
+ * 6). */
+void upipe_v210enc_pack_10_c(const uint16_t *y, const uint16_t *u,
+                             const uint16_t *v, uint8_t *dst,
+                             ptrdiff_t width);
+
+#ifdef UCPU_X86
+/** @This is the SSSE3 version of @ref upipe_v210enc_pack_8_c. */
+void upipe_v210enc_pack_8_ssse3(const uint8_t *y, const uint8_t *u,
+                                const uint8_t *v, uint8_t *dst,
+                                ptrdiff_t width);
+/** @This is the SSSE3 version of @ref upipe_v210enc_pack_10_c. */
+void upipe_v210enc_pack_10_ssse3(const uint16_t *y, const uint16_t *u,
+                                 const uint16_t *v, uint8_t *dst,
+                                 ptrdiff_t width);
+/** @This is the AVX2 version of @ref upipe_v210enc_pack_8_c. */
+void upipe_v210enc_pack_8_avx2(const uint8_t *y, const uint8_t *u,
+                               const uint8_t *v, uint8_t *dst,
+                               ptrdiff_t width);
+/** @This is the AVX2 version of @ref upipe_v210enc_pack_10_c. */
+void upipe_v210enc_pack_10_avx2(const uint16_t *y, const uint16_t *u,
+                                const uint16_t *v, uint8_t *dst,
+                                ptrdiff_t width);
+#endif
+
 /** @This extends upipe_command with specific commands for v210enc pipes. */
 enum upipe_v210enc_command {
     UPIPE_V210ENC_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe pool of persistent threads processing picture bands
+ * Pipes splitting a picture into horizontal bands allocate a pool once and
+ * run each picture through it, instead of creating and joining threads for
+ * every picture. The calling thread processes bands as well, so a pool of
+ * n threads only spawns n - 1 workers.
+ */
+
+#ifndef _UPIPE_UBAND_POOL_H_
+/** @hidden */
+#define _UPIPE_UBAND_POOL_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @This defines a function processing one band of a picture.
+ *
+ * @param opaque opaque passed to @ref uband_pool_run
+ * @param band index of the band
+ * @param nb_bands number of bands
+ */
+typedef void (*uband_pool_cb)(void *opaque, unsigned int band,
+                              unsigned int nb_bands);
+
+/** @hidden */
+struct uband_pool;
+
+/** @This allocates a pool of band threads. Without thread support, or if
+ * workers cannot be created, the pool has fewer threads than requested
+ * (see @ref uband_pool_threads) and the remaining bands are processed by
+ * the calling thread.
+ *
+ * @param threads number of threads, including the calling thread
+ * @return pointer to the pool, or NULL in case of allocation error
+ */
+struct uband_pool *uband_pool_alloc(unsigned int threads);
+
+/** @This stops the workers and frees a pool.
+ *
+ * @param pool pointer to the pool, may be NULL
+ */
+void uband_pool_free(struct uband_pool *pool);
+
+/** @This returns the number of threads actually processing bands,
+ * including the calling thread.
+ *
+ * @param pool pointer to the pool
+ * @return number of threads
+ */
+unsigned int uband_pool_threads(struct uband_pool *pool);
+
+/** @This processes all bands of a picture, and returns when they are all
+ * done. Bands are dispatched on the workers and the calling thread in any
+ * order. This must not be called concurrently on the same pool.
+ *
+ * @param pool pointer to the pool
+ * @param nb_bands number of bands
+ * @param cb function processing a band
+ * @param opaque opaque passed to cb
+ */
+void uband_pool_run(struct uband_pool *pool, unsigned int nb_bands,
+                    uband_pool_cb cb, void *opaque);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe runtime detection of CPU features
+ * Modules shipping vectorized kernels compile them with per-function
+ * target attributes when @ref UCPU_X86 is defined, and select them at
+ * runtime with @ref ucpu_get_flags, so that the same binary runs on all
+ * CPUs of the architecture.
+ */
+
+#ifndef _UPIPE_UCPU_H_
+/** @hidden */
+#define _UPIPE_UCPU_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+/** @This is defined when x86 vectorized kernels may be compiled. */
+#define UCPU_X86 1
+#include <cpuid.h>
+#endif
+
+/** @This defines the CPU features that may be tested. */
+enum ucpu_flag {
+    /** SSE2 instructions */
+    UCPU_SSE2 = 0x1,
+    /** SSSE3 instructions (pshufb) */
+    UCPU_SSSE3 = 0x2,
+    /** SSE4.1 instructions */
+    UCPU_SSE41 = 0x4,
+    /** carry-less multiplication (pclmulqdq) */
+    UCPU_PCLMUL = 0x8,
+    /** AVX2 instructions, with OS support for YMM registers */
+    UCPU_AVX2 = 0x10
+};
+
+/** @internal @This queries the features supported by the running CPU.
+ *
+ * @return bitmask of @ref ucpu_flag
+ */
+static inline uint32_t ucpu_probe_flags(void)
+{
+    uint32_t flags = 0;
+#ifdef UCPU_X86
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+
+    if (edx & bit_SSE2)
+        flags |= UCPU_SSE2;
+    if (ecx & bit_SSSE3)
+        flags |= UCPU_SSSE3;
+    if (ecx & bit_SSE4_1)
+        flags |= UCPU_SSE41;
+    if (ecx & bit_PCLMUL)
+        flags |= UCPU_PCLMUL;
+
+    /* AVX2 also requires the OS to save YMM registers */
+    if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ volatile ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+        if ((xcr0_lo & 0x6) == 0x6 && __get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if (ebx & bit_AVX2)
+                flags |= UCPU_AVX2;
+        }
+    }
+#endif
+    return flags;
+}
+
+/** @This returns the features supported by the running CPU. The result is
+ * cached, as cpuid is expensive (especially in virtual machines); concurrent
+ * first calls are harmless as they all store the same value.
+ *
+ * @return bitmask of @ref ucpu_flag
+ */
+static inline uint32_t ucpu_get_flags(void)
+{
+    static volatile uint32_t flags = UINT32_MAX;
+    if (unlikely(flags == UINT32_MAX))
+        flags = ucpu_probe_flags();
+    return flags;
+}
+
+/** @This checks if the running CPU supports all the given features.
+ *
+ * @param flags bitmask of @ref ucpu_flag
+ * @return true if all features are supported
+ */
+static inline bool ucpu_has(uint32_t flags)
+{
+    return (ucpu_get_flags() & flags) == flags;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -29,6 +29,7 @@
 
 #include <upipe/ulist.h>
 #include <upipe/uprobe.h>
+#include <upipe/uband_pool.h>
 #include <upipe/udict.h>
 #include <upipe/uref.h>
 #include <upipe/uref_std.h>
@@ -51,6 +52,11 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/** maximum number of planes of a picture */
+#define UPIPE_FILTER_BLEND_MAX_PLANES 4
+/** maximum number of band threads */
+#define UPIPE_FILTER_BLEND_MAX_THREADS 16
+
 /** @hidden */
 static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
                                       struct upump **upump_p);
@@ -88,6 +94,15 @@ struct upipe_filter_blend {
     /** list of blockers (used during udeal) */
     struct uchain blockers;
 
+    /** number of band threads */
+    unsigned int threads;
+    /** pool of band threads, or NULL for a single thread */
+    struct uband_pool *band_pool;
+    /** 8-bit line merging function */
+    upipe_filter_blend_merge merge8;
+    /** 16-bit line merging function */
+    upipe_filter_blend_merge merge16;
+
     /** public structure */
     struct upipe upipe;
 };
@@ -102,6 +117,32 @@ UPIPE_HELPER_UBUF_MGR(upipe_filter_blend, ubuf_mgr, flow_format,
                       upipe_filter_blend_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_filter_blend, urefs, nb_urefs, max_urefs, blockers, upipe_filter_blend_handle)
 
+/** @internal @This describes a mapped plane to deinterlace. */
+struct upipe_filter_blend_plane {
+    /** input buffer */
+    const uint8_t *in;
+    /** output buffer */
+    uint8_t *out;
+    /** stride length of input buffer */
+    size_t stride_in;
+    /** stride length of output buffer */
+    size_t stride_out;
+    /** length of a line in bytes */
+    size_t bytes;
+    /** plane height */
+    size_t height;
+    /** line merging function */
+    upipe_filter_blend_merge merge;
+};
+
+/** @internal @This describes all planes of a picture to split in bands. */
+struct upipe_filter_blend_picture {
+    /** planes of the picture */
+    const struct upipe_filter_blend_plane *planes;
+    /** number of planes */
+    unsigned int nb_planes;
+};
+
 /** @internal @This allocates a filter pipe.
  *
  * @param mgr common management structure
@@ -119,6 +160,22 @@ static struct upipe *upipe_filter_blend_alloc(struct upipe_mgr *mgr,
     if (unlikely(upipe == NULL))
         return NULL;
 
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    upipe_filter_blend->threads = 1;
+    upipe_filter_blend->band_pool = NULL;
+    upipe_filter_blend->merge8 = upipe_filter_blend_merge8_c;
+    upipe_filter_blend->merge16 = upipe_filter_blend_merge16_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_AVX2)) {
+        upipe_filter_blend->merge8 = upipe_filter_blend_merge8_avx2;
+        upipe_filter_blend->merge16 = upipe_filter_blend_merge16_avx2;
+    } else if (ucpu_has(UCPU_SSE2)) {
+        upipe_filter_blend->merge8 = upipe_filter_blend_merge8_sse2;
+        upipe_filter_blend->merge16 = upipe_filter_blend_merge16_sse2;
+    }
+#endif
+
     upipe_filter_blend_init_urefcount(upipe);
     upipe_filter_blend_init_ubuf_mgr(upipe);
     upipe_filter_blend_init_output(upipe);
@@ -127,54 +184,84 @@ static struct upipe *upipe_filter_blend_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** @internal @This computes the per-pixel mean of two lines
- * Code from VLC.
- * - modules/video_filter/deinterlace/merge.c
+/** @internal @This processes a band of a picture plane
+ * Adapted from VLC.
+ * - modules/video_filter/deinterlace/algo_basic.c
  *
- * @param _dest dest line
- * @param _s1 first source line
- * @param _s2 second source line
- * @param bytes length in bytes
+ * @param plane description of the plane
+ * @param first first line of the band
+ * @param last line following the band
  */
-static void upipe_filter_merge8bit( void *_dest, const void *_s1,
-                       const void *_s2, size_t bytes )
+static void upipe_filter_blend_plane(const struct upipe_filter_blend_plane *plane,
+                                     size_t first, size_t last)
 {
-    uint8_t *dest = _dest;
-    const uint8_t *s1 = _s1;
-    const uint8_t *s2 = _s2;
+    const uint8_t *in = plane->in + plane->stride_in * first;
+    uint8_t *out = plane->out + plane->stride_out * first;
+
+    // Copy first line
+    if (first == 0 && first < last) {
+        memcpy(out, in, plane->bytes);
+        out += plane->stride_out;
+        first++;
+    } else {
+        in -= plane->stride_in;
+    }
 
-    for( ; bytes > 0; bytes-- )
-        *dest++ = ( *s1++ + *s2++ ) >> 1;
+    // Compute mean value for remaining lines
+    for ( ; first < last; first++) {
+        plane->merge(out, in, in + plane->stride_in, plane->bytes);
+        out += plane->stride_out;
+        in += plane->stride_in;
+    }
 }
 
-/** @internal @This processes a picture plane
- * Adapted from VLC.
- * - modules/video_filter/deinterlace/algo_basic.c 
+/** @internal @This processes a horizontal band of all planes.
  *
- * @param in input buffer
- * @param out output buffer
- * @param stride_in stride length of input buffer
- * @param stride_out stride length of output buffer
- * @param height picture height
+ * @param opaque pointer to a struct upipe_filter_blend_picture
+ * @param band index of the band
+ * @param nb_bands number of bands
  */
-static void upipe_filter_blend_plane(const uint8_t *in, uint8_t *out,
-                                     size_t stride_in, size_t stride_out,
-                                     size_t height)
+static void upipe_filter_blend_band(void *opaque, unsigned int band,
+                                    unsigned int nb_bands)
 {
-    uint8_t *out_end = out + stride_out * height;
-
-    // Copy first line
-    memcpy(out, in, stride_in);
-    out += stride_out;
-
-    // Compute mean value for remaining lines
-    while (out < out_end) {
-        upipe_filter_merge8bit(out, in, in+stride_in,
-           (stride_in < stride_out) ? stride_in : stride_out);
+    struct upipe_filter_blend_picture *picture = opaque;
+    for (unsigned int i = 0; i < picture->nb_planes; i++) {
+        const struct upipe_filter_blend_plane *plane = &picture->planes[i];
+        upipe_filter_blend_plane(plane, plane->height * band / nb_bands,
+                                 plane->height * (band + 1) / nb_bands);
+    }
+}
 
-        out += stride_out;
-        in += stride_in;
+/** @internal @This processes all planes of a picture, possibly splitting
+ * them into horizontal bands handled by the band pool.
+ *
+ * @param upipe description structure of the pipe
+ * @param planes mapped planes
+ * @param nb_planes number of planes
+ * @param height picture height
+ */
+static void upipe_filter_blend_picture(struct upipe *upipe,
+        const struct upipe_filter_blend_plane *planes,
+        unsigned int nb_planes, size_t height)
+{
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    struct upipe_filter_blend_picture picture = {
+        .planes = planes,
+        .nb_planes = nb_planes
+    };
+
+    if (upipe_filter_blend->band_pool == NULL) {
+        upipe_filter_blend_band(&picture, 0, 1);
+        return;
     }
+
+    unsigned int nb_bands = upipe_filter_blend->threads;
+    /* keep at least a few lines of the smallest plane per band */
+    while (nb_bands > 1 && height / nb_bands < 16)
+        nb_bands--;
+    uband_pool_run(upipe_filter_blend->band_pool, nb_bands,
+                   upipe_filter_blend_band, &picture);
 }
 
 /** @internal @This handles input.
@@ -198,15 +285,17 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     if (upipe_filter_blend->flow_def == NULL)
         return false;
 
-    const uint8_t *in;
-    uint8_t *out;
-    uint8_t hsub, vsub;
-    size_t stride_in = 0, stride_out = 0, width, height;
+    struct upipe_filter_blend_plane planes[UPIPE_FILTER_BLEND_MAX_PLANES];
+    const char *chromas[UPIPE_FILTER_BLEND_MAX_PLANES];
+    unsigned int nb_planes = 0;
+    uint8_t hsub, vsub, macropixel = 1, macropixel_size;
+    uint8_t out_macropixel = 1, out_macropixel_size;
+    size_t stride_in = 0, stride_out = 0, width, height, min_height;
     const char *chroma = NULL;
     struct ubuf *ubuf_deint = NULL;
 
     // Now process frames
-    uref_pic_size(uref, &width, &height, NULL);
+    uref_pic_size(uref, &width, &height, &macropixel);
     upipe_verbose_va(upipe, "received pic (%dx%d)", width, height);
 
     assert(upipe_filter_blend->ubuf_mgr);
@@ -215,29 +304,63 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
         upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
         goto error;
     }
+    ubuf_pic_size(ubuf_deint, NULL, NULL, &out_macropixel);
 
     // Iterate planes
+    min_height = height;
     while (ubase_check(uref_pic_plane_iterate(uref, &chroma)) && chroma) {
+        if (unlikely(nb_planes >= UPIPE_FILTER_BLEND_MAX_PLANES)) {
+            upipe_err_va(upipe, "too many planes");
+            goto error;
+        }
         // map all
         if (unlikely(!ubase_check(uref_pic_plane_size(uref, chroma, &stride_in,
-                                                &hsub, &vsub, NULL)))) {
+                                                &hsub, &vsub, &macropixel_size)))) {
             upipe_err_va(upipe, "Could not read origin chroma %s", chroma);
             goto error;
         }
         if (unlikely(!ubase_check(ubuf_pic_plane_size(ubuf_deint, chroma, &stride_out,
-                                                  NULL, NULL, NULL)))) {
+                                                  NULL, NULL, &out_macropixel_size)))) {
             upipe_err_va(upipe, "Could not read dest chroma %s", chroma);
             goto error;
         }
-        uref_pic_plane_read(uref, chroma, 0, 0, -1, -1, &in);
-        ubuf_pic_plane_write(ubuf_deint, chroma, 0, 0, -1, -1, &out);
 
-        // process plane
-        upipe_filter_blend_plane(in, out, stride_in, stride_out, (size_t) height/vsub);
+        struct upipe_filter_blend_plane *plane = &planes[nb_planes];
+        if (unlikely(!ubase_check(uref_pic_plane_read(uref, chroma,
+                                        0, 0, -1, -1, &plane->in)))) {
+            upipe_err_va(upipe, "Could not map origin chroma %s", chroma);
+            goto error;
+        }
+        if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf_deint, chroma,
+                                        0, 0, -1, -1, &plane->out)))) {
+            uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+            upipe_err_va(upipe, "Could not map dest chroma %s", chroma);
+            goto error;
+        }
+        chromas[nb_planes++] = chroma;
+
+        plane->stride_in = stride_in;
+        plane->stride_out = stride_out;
+        plane->bytes = width / hsub / macropixel * macropixel_size;
+        size_t out_bytes = width / hsub / out_macropixel * out_macropixel_size;
+        if (out_bytes < plane->bytes)
+            plane->bytes = out_bytes;
+        plane->height = height / vsub;
+        /* planar formats with 16-bit samples */
+        plane->merge = macropixel == 1 && macropixel_size == 2 ?
+                       upipe_filter_blend->merge16 :
+                       upipe_filter_blend->merge8;
+        if (plane->height < min_height)
+            min_height = plane->height;
+    }
 
-        // unmap all
-        uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
-        ubuf_pic_plane_unmap(ubuf_deint, chroma, 0, 0, -1, -1);
+    // process planes
+    upipe_filter_blend_picture(upipe, planes, nb_planes, min_height);
+
+    // unmap all
+    for (unsigned int i = 0; i < nb_planes; i++) {
+        uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
+        ubuf_pic_plane_unmap(ubuf_deint, chromas[i], 0, 0, -1, -1);
     }
 
     // Attach new ubuf and output frame
@@ -249,6 +372,10 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     return true;
 
 error:
+    for (unsigned int i = 0; i < nb_planes; i++) {
+        uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
+        ubuf_pic_plane_unmap(ubuf_deint, chromas[i], 0, 0, -1, -1);
+    }
     uref_free(uref);
     if (ubuf_deint) {
         ubuf_free(ubuf_deint);
@@ -327,6 +454,38 @@ static int upipe_filter_blend_set_flow_def(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the number of band threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static int _upipe_filter_blend_set_threads(struct upipe *upipe,
+                                           unsigned int threads)
+{
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
+    if (unlikely(threads < 1 || threads > UPIPE_FILTER_BLEND_MAX_THREADS))
+        return UBASE_ERR_INVALID;
+
+    struct uband_pool *band_pool = NULL;
+    if (threads > 1) {
+        band_pool = uband_pool_alloc(threads);
+        if (unlikely(band_pool == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        if (uband_pool_threads(band_pool) < threads)
+            upipe_warn_va(upipe, "only %u band threads available",
+                          uband_pool_threads(band_pool));
+    }
+
+    uband_pool_free(upipe_filter_blend->band_pool);
+    upipe_filter_blend->band_pool = band_pool;
+    upipe_filter_blend->threads = threads;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on the pipe.
  *
  * @param upipe description structure of the pipe
@@ -368,6 +527,19 @@ static int upipe_filter_blend_control(struct upipe *upipe,
             struct upipe *output = va_arg(args, struct upipe *);
             return upipe_filter_blend_set_output(upipe, output);
         }
+        case UPIPE_FILTER_BLEND_SET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_BLEND_SIGNATURE)
+            unsigned int threads = va_arg(args, unsigned int);
+            return _upipe_filter_blend_set_threads(upipe, threads);
+        }
+        case UPIPE_FILTER_BLEND_GET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_BLEND_SIGNATURE)
+            struct upipe_filter_blend *upipe_filter_blend =
+                upipe_filter_blend_from_upipe(upipe);
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = upipe_filter_blend->threads;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -379,8 +551,12 @@ static int upipe_filter_blend_control(struct upipe *upipe,
  */
 static void upipe_filter_blend_free(struct upipe *upipe)
 {
+    struct upipe_filter_blend *upipe_filter_blend =
+        upipe_filter_blend_from_upipe(upipe);
     upipe_throw_dead(upipe);
 
+    uband_pool_free(upipe_filter_blend->band_pool);
+
     upipe_filter_blend_clean_input(upipe);
     upipe_filter_blend_clean_ubuf_mgr(upipe);
     upipe_filter_blend_clean_output(upipe);
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2011 VLC authors and VideoLAN
+ * Copyright (C) 2013-2014 OpenHeadend S.A.R.L.
+ *
+ * Authors: Benjamin Cohen
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short line merging functions of the blend deinterlace filter
+ *
+ * The SIMD versions compute the rounded down mean from the rounded up mean
+ * of pavgb/pavgw, so that they give the same output as the C versions.
+ *
+ * Adapted from VLC video_filter (blend deinterlace) :
+ * - modules/video_filter/deinterlace/merge.c
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-filters/upipe_filter_blend.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @This computes the per-pixel mean of two lines of 8-bit samples.
+ *
+ * @param dest dest line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param bytes length in bytes
+ */
+void upipe_filter_blend_merge8_c(uint8_t *dest, const uint8_t *s1,
+                                 const uint8_t *s2, size_t bytes)
+{
+    for ( ; bytes > 0; bytes--)
+        *dest++ = (*s1++ + *s2++) >> 1;
+}
+
+/** @This computes the per-pixel mean of two lines of 16-bit samples.
+ *
+ * @param dest dest line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param bytes length in bytes
+ */
+void upipe_filter_blend_merge16_c(uint8_t *dest, const uint8_t *s1,
+                                  const uint8_t *s2, size_t bytes)
+{
+    for ( ; bytes >= 2; bytes -= 2) {
+        uint16_t a, b, c;
+        memcpy(&a, s1, 2);
+        memcpy(&b, s2, 2);
+        c = ((uint32_t)a + b) >> 1;
+        memcpy(dest, &c, 2);
+        dest += 2;
+        s1 += 2;
+        s2 += 2;
+    }
+}
+
+#ifdef UCPU_X86
+/** @This computes the per-pixel mean of two lines of 8-bit samples, using
+ * SSE2.
+ *
+ * @param dest dest line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param bytes length in bytes
+ */
+__attribute__((target("sse2")))
+void upipe_filter_blend_merge8_sse2(uint8_t *dest, const uint8_t *s1,
+                                    const uint8_t *s2, size_t bytes)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    for ( ; bytes >= 16; bytes -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s1);
+        __m128i b = _mm_loadu_si128((const __m128i *)s2);
+        __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), one);
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_sub_epi8(_mm_avg_epu8(a, b), odd));
+        dest += 16;
+        s1 += 16;
+        s2 += 16;
+    }
+    upipe_filter_blend_merge8_c(dest, s1, s2, bytes);
+}
+
+/** @This computes the per-pixel mean of two lines of 16-bit samples, using
+ * SSE2.
+ *
+ * @param dest dest line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param bytes length in bytes
+ */
+__attribute__((target("sse2")))
+void upipe_filter_blend_merge16_sse2(uint8_t *dest, const uint8_t *s1,
+                                     const uint8_t *s2, size_t bytes)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    for ( ; bytes >= 16; bytes -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s1);
+        __m128i b = _mm_loadu_si128((const __m128i *)s2);
+        __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), one);
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_sub_epi16(_mm_avg_epu16(a, b), odd));
+        dest += 16;
+        s1 += 16;
+        s2 += 16;
+    }
+    upipe_filter_blend_merge16_c(dest, s1, s2, bytes);
+}
+
+/** @This computes the per-pixel mean of two lines of 8-bit samples, using
+ * AVX2.
+ *
+ * @param dest dest line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param bytes length in bytes
+ */
+__attribute__((target("avx2")))
+void upipe_filter_blend_merge8_avx2(uint8_t *dest, const uint8_t *s1,
+                                    const uint8_t *s2, size_t bytes)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    for ( ; bytes >= 32; bytes -= 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s1);
+        __m256i b = _mm256_loadu_si256((const __m256i *)s2);
+        __m256i odd = _mm256_and_si256(_mm256_xor_si256(a, b), one);
+        _mm256_storeu_si256((__m256i *)dest,
+                            _mm256_sub_epi8(_mm256_avg_epu8(a, b), odd));
+        dest += 32;
+        s1 += 32;
+        s2 += 32;
+    }
+    upipe_filter_blend_merge8_sse2(dest, s1, s2, bytes);
+}
+
+/** @This computes the per-pixel mean of two lines of 16-bit samples, using
+ * AVX2.
+ *
+ * @param dest dest line
+ * @param s1 first source line
+ * @param s2 second source line
+ * @param bytes length in bytes
+ */
+__attribute__((target("avx2")))
+void upipe_filter_blend_merge16_avx2(uint8_t *dest, const uint8_t *s1,
+                                     const uint8_t *s2, size_t bytes)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    for ( ; bytes >= 32; bytes -= 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s1);
+        __m256i b = _mm256_loadu_si256((const __m256i *)s2);
+        __m256i odd = _mm256_and_si256(_mm256_xor_si256(a, b), one);
+        _mm256_storeu_si256((__m256i *)dest,
+                            _mm256_sub_epi16(_mm256_avg_epu16(a, b), odd));
+        dest += 32;
+        s1 += 32;
+        s2 += 32;
+    }
+    upipe_filter_blend_merge16_sse2(dest, s1, s2, bytes);
+}
+#endif
@@ -0,0 +1,828 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe pixel format conversion filter
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_dump.h>
+#include <upipe/ubuf.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_flow.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_input.h>
+#include <upipe-filters/upipe_filter_convert.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+/** maximum number of planes of a picture */
+#define UPIPE_FILTER_CONVERT_MAX_PLANES 4
+
+/** @internal @This describes the samples of a plane. */
+struct upipe_filter_convert_layout {
+    /** chroma type */
+    const char *chroma;
+    /** horizontal subsampling */
+    uint8_t hsub;
+    /** vertical subsampling */
+    uint8_t vsub;
+    /** number of interleaved components (1 or 2) */
+    uint8_t nb;
+    /** components ('y', 'u', 'v' or 'a') */
+    char comp[2];
+    /** bit depth of the components */
+    uint8_t depth;
+};
+
+/** @internal @This is the type of a conversion operation. */
+enum upipe_filter_convert_op_type {
+    /** copies a plane */
+    UPIPE_FILTER_CONVERT_OP_COPY,
+    /** converts 8-bit samples to 16-bit samples */
+    UPIPE_FILTER_CONVERT_OP_EXPAND,
+    /** converts 16-bit samples to 8-bit samples */
+    UPIPE_FILTER_CONVERT_OP_REDUCE,
+    /** interleaves two planes into one */
+    UPIPE_FILTER_CONVERT_OP_INTERLEAVE,
+    /** splits an interleaved plane into two */
+    UPIPE_FILTER_CONVERT_OP_DEINTERLEAVE,
+    /** swaps the components of an interleaved plane */
+    UPIPE_FILTER_CONVERT_OP_SWAP
+};
+
+/** @internal @This describes a conversion operation producing one or two
+ * planes of the output picture. */
+struct upipe_filter_convert_op {
+    /** type of operation */
+    enum upipe_filter_convert_op_type type;
+    /** input planes (the second one for interleave only) */
+    const char *input[2];
+    /** output planes (the second one for deinterleave only) */
+    const char *output[2];
+    /** horizontal subsampling */
+    uint8_t hsub;
+    /** vertical subsampling */
+    uint8_t vsub;
+    /** number of octets of an input sample */
+    uint8_t size;
+    /** number of components of the input plane */
+    uint8_t nb;
+    /** depth difference for expand and reduce */
+    unsigned int shift;
+};
+
+/** @internal @This is the list of operations converting a picture. */
+struct upipe_filter_convert_plan {
+    /** operations */
+    struct upipe_filter_convert_op ops[UPIPE_FILTER_CONVERT_MAX_PLANES];
+    /** number of operations */
+    uint8_t nb_ops;
+};
+
+/** @hidden */
+static bool upipe_filter_convert_handle(struct upipe *upipe,
+                                        struct uref *uref,
+                                        struct upump **upump_p);
+/** @hidden */
+static int upipe_filter_convert_check(struct upipe *upipe,
+                                      struct uref *flow_format);
+
+/** @internal upipe_filter_convert private structure */
+struct upipe_filter_convert {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** temporary uref storage (used during urequest) */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers (used during udeal) */
+    struct uchain blockers;
+
+    /** wanted output format */
+    struct uref *flow_def_format;
+    /** input flow definition, referenced by the plan */
+    struct uref *flow_def_input;
+    /** operations converting a picture */
+    struct upipe_filter_convert_plan plan;
+
+    /** 8-bit interleave function */
+    upipe_filter_convert_interleave interleave8;
+    /** 16-bit interleave function */
+    upipe_filter_convert_interleave interleave16;
+    /** 8-bit deinterleave function */
+    upipe_filter_convert_deinterleave deinterleave8;
+    /** 16-bit deinterleave function */
+    upipe_filter_convert_deinterleave deinterleave16;
+    /** 8-bit swap function */
+    upipe_filter_convert_swap swap8;
+    /** 16-bit swap function */
+    upipe_filter_convert_swap swap16;
+    /** 8-bit to 16-bit function */
+    upipe_filter_convert_depth expand;
+    /** 16-bit to 8-bit function */
+    upipe_filter_convert_depth reduce;
+
+    /** public structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_filter_convert, upipe, UPIPE_FILTER_CONVERT_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_filter_convert, urefcount, upipe_filter_convert_free)
+UPIPE_HELPER_FLOW(upipe_filter_convert, "pic.")
+UPIPE_HELPER_OUTPUT(upipe_filter_convert, output, flow_def, output_state, request_list)
+UPIPE_HELPER_UBUF_MGR(upipe_filter_convert, ubuf_mgr, flow_format,
+                      ubuf_mgr_request, upipe_filter_convert_check,
+                      upipe_filter_convert_register_output_request,
+                      upipe_filter_convert_unregister_output_request)
+UPIPE_HELPER_INPUT(upipe_filter_convert, urefs, nb_urefs, max_urefs, blockers, upipe_filter_convert_handle)
+
+/** @internal @This parses a chroma type made of one or two components of
+ * the same depth, such as "y8", "u8v8" or "y10l".
+ *
+ * @param chroma chroma type
+ * @param layout filled in with the components and depth
+ * @return false if the chroma type is not supported
+ */
+static bool upipe_filter_convert_parse(const char *chroma,
+                                       struct upipe_filter_convert_layout *layout)
+{
+    layout->nb = 0;
+    layout->depth = 0;
+    while (*chroma != '\0') {
+        char comp = *chroma++;
+        if (strchr("yuva", comp) == NULL || layout->nb >= 2)
+            return false;
+
+        unsigned int depth = 0;
+        while (*chroma >= '0' && *chroma <= '9')
+            depth = depth * 10 + *chroma++ - '0';
+        if (depth > 8 && *chroma++ != 'l')
+            return false;
+        if (depth < 8 || depth > 16 ||
+            (layout->depth && depth != layout->depth))
+            return false;
+
+        layout->comp[layout->nb++] = comp;
+        layout->depth = depth;
+    }
+    return layout->nb > 0;
+}
+
+/** @internal @This reads the layout of all planes of a flow definition.
+ *
+ * @param flow_def flow definition
+ * @param layouts filled in with the layouts of the planes
+ * @param nb_p filled in with the number of planes
+ * @return an error code
+ */
+static int upipe_filter_convert_layouts(struct uref *flow_def,
+        struct upipe_filter_convert_layout *layouts, uint8_t *nb_p)
+{
+    uint8_t macropixel, planes;
+    UBASE_RETURN(uref_pic_flow_get_macropixel(flow_def, &macropixel))
+    UBASE_RETURN(uref_pic_flow_get_planes(flow_def, &planes))
+    if (macropixel != 1 || !planes ||
+        planes > UPIPE_FILTER_CONVERT_MAX_PLANES)
+        return UBASE_ERR_INVALID;
+
+    for (uint8_t i = 0; i < planes; i++) {
+        struct upipe_filter_convert_layout *layout = &layouts[i];
+        uint8_t macropixel_size;
+        UBASE_RETURN(uref_pic_flow_get_chroma(flow_def, &layout->chroma, i))
+        UBASE_RETURN(uref_pic_flow_get_hsubsampling(flow_def,
+                                                    &layout->hsub, i))
+        UBASE_RETURN(uref_pic_flow_get_vsubsampling(flow_def,
+                                                    &layout->vsub, i))
+        UBASE_RETURN(uref_pic_flow_get_macropixel_size(flow_def,
+                                                       &macropixel_size, i))
+        if (!upipe_filter_convert_parse(layout->chroma, layout) ||
+            macropixel_size != layout->nb * (layout->depth > 8 ? 2 : 1))
+            return UBASE_ERR_INVALID;
+    }
+    *nb_p = planes;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This finds the input plane carrying a component.
+ *
+ * @param layouts layouts of the input planes
+ * @param nb number of input planes
+ * @param comp component to find
+ * @param index_p filled in with the index of the component in the plane
+ * @return pointer to the layout of the plane, or NULL
+ */
+static const struct upipe_filter_convert_layout *
+    upipe_filter_convert_find(const struct upipe_filter_convert_layout *layouts,
+                              uint8_t nb, char comp, uint8_t *index_p)
+{
+    for (uint8_t i = 0; i < nb; i++)
+        for (uint8_t j = 0; j < layouts[i].nb; j++)
+            if (layouts[i].comp[j] == comp) {
+                *index_p = j;
+                return &layouts[i];
+            }
+    return NULL;
+}
+
+/** @internal @This computes the operations converting pictures from the
+ * input flow definition to the output format. The plan references the
+ * chroma strings of both flow definitions.
+ *
+ * @param flow_def_input input flow definition
+ * @param flow_def_output output flow definition
+ * @param plan filled in with the operations
+ * @return an error code
+ */
+static int upipe_filter_convert_plan(struct uref *flow_def_input,
+                                     struct uref *flow_def_output,
+                                     struct upipe_filter_convert_plan *plan)
+{
+    struct upipe_filter_convert_layout in[UPIPE_FILTER_CONVERT_MAX_PLANES];
+    struct upipe_filter_convert_layout out[UPIPE_FILTER_CONVERT_MAX_PLANES];
+    uint8_t nb_in, nb_out;
+    UBASE_RETURN(upipe_filter_convert_layouts(flow_def_input, in, &nb_in))
+    UBASE_RETURN(upipe_filter_convert_layouts(flow_def_output, out, &nb_out))
+
+    plan->nb_ops = 0;
+    for (uint8_t i = 0; i < nb_out; i++) {
+        const struct upipe_filter_convert_layout *o = &out[i];
+        uint8_t j0, j1;
+        const struct upipe_filter_convert_layout *i0 =
+            upipe_filter_convert_find(in, nb_in, o->comp[0], &j0);
+        if (i0 == NULL || i0->hsub != o->hsub || i0->vsub != o->vsub)
+            return UBASE_ERR_INVALID;
+
+        struct upipe_filter_convert_op *op = &plan->ops[plan->nb_ops];
+        op->input[0] = i0->chroma;
+        op->input[1] = NULL;
+        op->output[0] = o->chroma;
+        op->output[1] = NULL;
+        op->hsub = o->hsub;
+        op->vsub = o->vsub;
+        op->size = i0->depth > 8 ? 2 : 1;
+        op->nb = i0->nb;
+        op->shift = 0;
+
+        if (o->nb == 1 && i0->nb == 1) {
+            if (i0->depth == o->depth)
+                op->type = UPIPE_FILTER_CONVERT_OP_COPY;
+            else if (i0->depth == 8) {
+                op->type = UPIPE_FILTER_CONVERT_OP_EXPAND;
+                op->shift = o->depth - 8;
+            } else if (o->depth == 8) {
+                op->type = UPIPE_FILTER_CONVERT_OP_REDUCE;
+                op->shift = i0->depth - 8;
+            } else
+                return UBASE_ERR_INVALID;
+
+        } else if (o->nb == 1) {
+            if (i0->depth != o->depth)
+                return UBASE_ERR_INVALID;
+
+            /* the other component may already be extracted */
+            struct upipe_filter_convert_op *prev = NULL;
+            for (uint8_t k = 0; k < plan->nb_ops; k++)
+                if (plan->ops[k].type == UPIPE_FILTER_CONVERT_OP_DEINTERLEAVE &&
+                    plan->ops[k].input[0] == i0->chroma)
+                    prev = &plan->ops[k];
+            if (prev != NULL) {
+                if (prev->output[j0] != NULL)
+                    return UBASE_ERR_INVALID;
+                prev->output[j0] = o->chroma;
+                continue;
+            }
+            op->type = UPIPE_FILTER_CONVERT_OP_DEINTERLEAVE;
+            op->output[0] = op->output[1] = NULL;
+            op->output[j0] = o->chroma;
+
+        } else {
+            const struct upipe_filter_convert_layout *i1 =
+                upipe_filter_convert_find(in, nb_in, o->comp[1], &j1);
+            if (i1 == NULL || i1->hsub != o->hsub || i1->vsub != o->vsub ||
+                i0->depth != o->depth || i1->depth != o->depth)
+                return UBASE_ERR_INVALID;
+
+            if (i0 == i1 && j0 != j1)
+                op->type = j0 == 0 ? UPIPE_FILTER_CONVERT_OP_COPY :
+                                     UPIPE_FILTER_CONVERT_OP_SWAP;
+            else if (i0->nb == 1 && i1->nb == 1 && i0 != i1) {
+                op->type = UPIPE_FILTER_CONVERT_OP_INTERLEAVE;
+                op->input[1] = i1->chroma;
+            } else
+                return UBASE_ERR_INVALID;
+        }
+        plan->nb_ops++;
+    }
+
+    for (uint8_t k = 0; k < plan->nb_ops; k++)
+        if (plan->ops[k].type == UPIPE_FILTER_CONVERT_OP_DEINTERLEAVE &&
+            (plan->ops[k].output[0] == NULL || plan->ops[k].output[1] == NULL))
+            return UBASE_ERR_INVALID;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This allocates a convert pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_filter_convert_alloc(struct upipe_mgr *mgr,
+                                                struct uprobe *uprobe,
+                                                uint32_t signature,
+                                                va_list args)
+{
+    struct uref *flow_def;
+    struct upipe *upipe = upipe_filter_convert_alloc_flow(mgr, uprobe,
+            signature, args, &flow_def);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_filter_convert_layout layouts[UPIPE_FILTER_CONVERT_MAX_PLANES];
+    uint8_t planes;
+    if (unlikely(!ubase_check(upipe_filter_convert_layouts(flow_def,
+                                                           layouts,
+                                                           &planes)))) {
+        uref_free(flow_def);
+        upipe_filter_convert_free_flow(upipe);
+        return NULL;
+    }
+
+    struct upipe_filter_convert *upipe_filter_convert =
+        upipe_filter_convert_from_upipe(upipe);
+    upipe_filter_convert_init_urefcount(upipe);
+    upipe_filter_convert_init_ubuf_mgr(upipe);
+    upipe_filter_convert_init_output(upipe);
+    upipe_filter_convert_init_input(upipe);
+    upipe_filter_convert->flow_def_format = flow_def;
+    upipe_filter_convert->flow_def_input = NULL;
+    upipe_filter_convert->plan.nb_ops = 0;
+
+    upipe_filter_convert->interleave8 = upipe_filter_convert_interleave8_c;
+    upipe_filter_convert->interleave16 = upipe_filter_convert_interleave16_c;
+    upipe_filter_convert->deinterleave8 = upipe_filter_convert_deinterleave8_c;
+    upipe_filter_convert->deinterleave16 =
+        upipe_filter_convert_deinterleave16_c;
+    upipe_filter_convert->swap8 = upipe_filter_convert_swap8_c;
+    upipe_filter_convert->swap16 = upipe_filter_convert_swap16_c;
+    upipe_filter_convert->expand = upipe_filter_convert_expand_c;
+    upipe_filter_convert->reduce = upipe_filter_convert_reduce_c;
+#ifdef UCPU_X86
+#define UPIPE_FILTER_CONVERT_SET(suffix)                                    \
+    upipe_filter_convert->interleave8 =                                     \
+        upipe_filter_convert_interleave8_##suffix;                          \
+    upipe_filter_convert->interleave16 =                                    \
+        upipe_filter_convert_interleave16_##suffix;                         \
+    upipe_filter_convert->deinterleave8 =                                   \
+        upipe_filter_convert_deinterleave8_##suffix;                        \
+    upipe_filter_convert->deinterleave16 =                                  \
+        upipe_filter_convert_deinterleave16_##suffix;                       \
+    upipe_filter_convert->swap8 = upipe_filter_convert_swap8_##suffix;      \
+    upipe_filter_convert->swap16 = upipe_filter_convert_swap16_##suffix;    \
+    upipe_filter_convert->expand = upipe_filter_convert_expand_##suffix;    \
+    upipe_filter_convert->reduce = upipe_filter_convert_reduce_##suffix;
+    if (ucpu_has(UCPU_AVX2)) {
+        UPIPE_FILTER_CONVERT_SET(avx2)
+    } else if (ucpu_has(UCPU_SSE2)) {
+        UPIPE_FILTER_CONVERT_SET(sse2)
+    }
+#undef UPIPE_FILTER_CONVERT_SET
+#endif
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This applies a conversion operation to a picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param op conversion operation
+ * @param uref input picture
+ * @param ubuf output picture
+ * @param hsize horizontal size of the picture
+ * @param vsize vertical size of the picture
+ * @return an error code
+ */
+static int upipe_filter_convert_apply(struct upipe *upipe,
+                                      const struct upipe_filter_convert_op *op,
+                                      struct uref *uref, struct ubuf *ubuf,
+                                      size_t hsize, size_t vsize)
+{
+    struct upipe_filter_convert *upipe_filter_convert =
+        upipe_filter_convert_from_upipe(upipe);
+    uint8_t nb_inputs = op->input[1] != NULL ? 2 : 1;
+    uint8_t nb_outputs = op->output[1] != NULL ? 2 : 1;
+    const uint8_t *in[2];
+    uint8_t *out[2];
+    size_t in_stride[2], out_stride[2];
+    uint8_t mapped_in = 0, mapped_out = 0;
+    int err = UBASE_ERR_NONE;
+
+    for ( ; mapped_in < nb_inputs; mapped_in++) {
+        const char *chroma = op->input[mapped_in];
+        err = uref_pic_plane_size(uref, chroma, &in_stride[mapped_in],
+                                  NULL, NULL, NULL);
+        if (ubase_check(err))
+            err = uref_pic_plane_read(uref, chroma, 0, 0, -1, -1,
+                                      &in[mapped_in]);
+        if (unlikely(!ubase_check(err)))
+            goto unmap;
+    }
+    for ( ; mapped_out < nb_outputs; mapped_out++) {
+        const char *chroma = op->output[mapped_out];
+        err = ubuf_pic_plane_size(ubuf, chroma, &out_stride[mapped_out],
+                                  NULL, NULL, NULL);
+        if (ubase_check(err))
+            err = ubuf_pic_plane_write(ubuf, chroma, 0, 0, -1, -1,
+                                       &out[mapped_out]);
+        if (unlikely(!ubase_check(err)))
+            goto unmap;
+    }
+
+    size_t width = hsize / op->hsub;
+    size_t lines = vsize / op->vsub;
+    for (size_t y = 0; y < lines; y++) {
+        switch (op->type) {
+            case UPIPE_FILTER_CONVERT_OP_COPY:
+                memcpy(out[0], in[0], width * op->nb * op->size);
+                break;
+            case UPIPE_FILTER_CONVERT_OP_EXPAND:
+                upipe_filter_convert->expand(out[0], in[0], width, op->shift);
+                break;
+            case UPIPE_FILTER_CONVERT_OP_REDUCE:
+                upipe_filter_convert->reduce(out[0], in[0], width, op->shift);
+                break;
+            case UPIPE_FILTER_CONVERT_OP_INTERLEAVE:
+                (op->size == 1 ? upipe_filter_convert->interleave8 :
+                                 upipe_filter_convert->interleave16)
+                    (out[0], in[0], in[1], width);
+                break;
+            case UPIPE_FILTER_CONVERT_OP_DEINTERLEAVE:
+                (op->size == 1 ? upipe_filter_convert->deinterleave8 :
+                                 upipe_filter_convert->deinterleave16)
+                    (out[0], out[1], in[0], width);
+                break;
+            case UPIPE_FILTER_CONVERT_OP_SWAP:
+                (op->size == 1 ? upipe_filter_convert->swap8 :
+                                 upipe_filter_convert->swap16)
+                    (out[0], in[0], width);
+                break;
+        }
+        for (uint8_t i = 0; i < nb_inputs; i++)
+            in[i] += in_stride[i];
+        for (uint8_t i = 0; i < nb_outputs; i++)
+            out[i] += out_stride[i];
+    }
+
+unmap:
+    while (mapped_in > 0)
+        uref_pic_plane_unmap(uref, op->input[--mapped_in], 0, 0, -1, -1);
+    while (mapped_out > 0)
+        ubuf_pic_plane_unmap(ubuf, op->output[--mapped_out], 0, 0, -1, -1);
+    return err;
+}
+
+/** @internal @This receives a new input flow definition, and computes the
+ * conversion.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def input flow definition
+ */
+static void upipe_filter_convert_new_flow_def(struct upipe *upipe,
+                                              struct uref *flow_def)
+{
+    struct upipe_filter_convert *upipe_filter_convert =
+        upipe_filter_convert_from_upipe(upipe);
+    upipe_filter_convert_store_flow_def(upipe, NULL);
+
+    struct upipe_filter_convert_plan plan;
+    struct uref *flow_def_output = uref_dup(flow_def);
+    if (unlikely(flow_def_output == NULL)) {
+        uref_free(flow_def);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    uref_pic_flow_clear_format(flow_def_output);
+    int err = uref_pic_flow_copy_format(flow_def_output,
+                                        upipe_filter_convert->flow_def_format);
+    if (ubase_check(err))
+        err = upipe_filter_convert_plan(flow_def,
+                upipe_filter_convert->flow_def_format, &plan);
+    if (unlikely(!ubase_check(err))) {
+        upipe_err(upipe, "unsupported conversion");
+        uref_free(flow_def_output);
+        uref_free(flow_def);
+        upipe_throw_error(upipe, err);
+        return;
+    }
+
+    uref_free(upipe_filter_convert->flow_def_input);
+    upipe_filter_convert->flow_def_input = flow_def;
+    upipe_filter_convert->plan = plan;
+    upipe_filter_convert_require_ubuf_mgr(upipe, flow_def_output);
+}
+
+/** @internal @This converts a picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to upump structure
+ * @return false if the input must be blocked
+ */
+static bool upipe_filter_convert_handle(struct upipe *upipe,
+                                        struct uref *uref,
+                                        struct upump **upump_p)
+{
+    struct upipe_filter_convert *upipe_filter_convert =
+        upipe_filter_convert_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_filter_convert_new_flow_def(upipe, uref);
+        return true;
+    }
+
+    if (upipe_filter_convert->flow_def == NULL)
+        return false;
+
+    size_t hsize, vsize;
+    if (unlikely(!ubase_check(uref_pic_size(uref, &hsize, &vsize, NULL)))) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return true;
+    }
+
+    struct ubuf *ubuf = ubuf_pic_alloc(upipe_filter_convert->ubuf_mgr,
+                                       hsize, vsize);
+    if (unlikely(ubuf == NULL)) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return true;
+    }
+
+    for (uint8_t i = 0; i < upipe_filter_convert->plan.nb_ops; i++) {
+        int err = upipe_filter_convert_apply(upipe,
+                &upipe_filter_convert->plan.ops[i], uref, ubuf, hsize, vsize);
+        if (unlikely(!ubase_check(err))) {
+            upipe_warn(upipe, "unable to convert picture");
+            ubuf_free(ubuf);
+            uref_free(uref);
+            return true;
+        }
+    }
+
+    uref_attach_ubuf(uref, ubuf);
+    upipe_filter_convert_output(upipe, uref, upump_p);
+    return true;
+}
+
+/** @internal @This inputs data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_filter_convert_input(struct upipe *upipe, struct uref *uref,
+                                       struct upump **upump_p)
+{
+    if (!upipe_filter_convert_check_input(upipe)) {
+        upipe_filter_convert_hold_input(upipe, uref);
+        upipe_filter_convert_block_input(upipe, upump_p);
+    } else if (!upipe_filter_convert_handle(upipe, uref, upump_p)) {
+        upipe_filter_convert_hold_input(upipe, uref);
+        upipe_filter_convert_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This checks if the input may start.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_filter_convert_check(struct upipe *upipe,
+                                      struct uref *flow_format)
+{
+    struct upipe_filter_convert *upipe_filter_convert =
+        upipe_filter_convert_from_upipe(upipe);
+    if (flow_format != NULL)
+        upipe_filter_convert_store_flow_def(upipe, flow_format);
+
+    if (upipe_filter_convert->flow_def == NULL)
+        return UBASE_ERR_NONE;
+
+    bool was_buffered = !upipe_filter_convert_check_input(upipe);
+    upipe_filter_convert_output_input(upipe);
+    upipe_filter_convert_unblock_input(upipe);
+    if (was_buffered && upipe_filter_convert_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_filter_convert_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_filter_convert_set_flow_def(struct upipe *upipe,
+                                             struct uref *flow_def)
+{
+    struct upipe_filter_convert *upipe_filter_convert =
+        upipe_filter_convert_from_upipe(upipe);
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, "pic."))
+
+    struct upipe_filter_convert_plan plan;
+    if (!ubase_check(upipe_filter_convert_plan(flow_def,
+                    upipe_filter_convert->flow_def_format, &plan))) {
+        upipe_err(upipe, "incompatible input flow def");
+        uref_dump(flow_def, upipe->uprobe);
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_input(upipe, flow_def_dup, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_filter_convert_control(struct upipe *upipe,
+                                        int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_filter_convert_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return UBASE_ERR_NONE;
+            return upipe_filter_convert_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_filter_convert_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_filter_convert_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_filter_convert_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_filter_convert_set_output(upipe, output);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_filter_convert_free(struct upipe *upipe)
+{
+    struct upipe_filter_convert *upipe_filter_convert =
+        upipe_filter_convert_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    uref_free(upipe_filter_convert->flow_def_input);
+    uref_free(upipe_filter_convert->flow_def_format);
+    upipe_filter_convert_clean_input(upipe);
+    upipe_filter_convert_clean_ubuf_mgr(upipe);
+    upipe_filter_convert_clean_output(upipe);
+    upipe_filter_convert_clean_urefcount(upipe);
+    upipe_filter_convert_free_flow(upipe);
+}
+
+/** @internal @This processes control commands on a convert manager.
+ *
+ * @param mgr pointer to manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_filter_convert_mgr_control(struct upipe_mgr *mgr,
+                                            int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_FILTER_CONVERT_MGR_CHECK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_CONVERT_SIGNATURE)
+            struct uref *flow_def_input = va_arg(args, struct uref *);
+            struct uref *flow_def_output = va_arg(args, struct uref *);
+            /* only the layout is converted, not the colour space */
+            if (uref_pic_flow_cmp_matrix_coefficients(flow_def_input,
+                                                      flow_def_output) ||
+                uref_pic_flow_cmp_full_range(flow_def_input, flow_def_output))
+                return UBASE_ERR_INVALID;
+            struct upipe_filter_convert_plan plan;
+            return upipe_filter_convert_plan(flow_def_input, flow_def_output,
+                                             &plan);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_filter_convert_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_FILTER_CONVERT_SIGNATURE,
+
+    .upipe_alloc = upipe_filter_convert_alloc,
+    .upipe_input = upipe_filter_convert_input,
+    .upipe_control = upipe_filter_convert_control,
+
+    .upipe_mgr_control = upipe_filter_convert_mgr_control
+};
+
+/** @This returns the management structure for convert pipes
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_filter_convert_mgr_alloc(void)
+{
+    return &upipe_filter_convert_mgr;
+}
@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short line functions of the pixel format conversion filter
+ *
+ * The SIMD versions handle as many samples as they can and let the C
+ * versions finish the line, so that all versions give the same output.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-filters/upipe_filter_convert.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @internal @This reads a 16-bit sample. */
+static inline uint16_t upipe_filter_convert_rd16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return v;
+}
+
+/** @internal @This writes a 16-bit sample. */
+static inline void upipe_filter_convert_wr16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, 2);
+}
+
+/** @This interleaves two lines of 8-bit samples.
+ *
+ * @param dest dest line (2 * width samples)
+ * @param src1 line of even samples
+ * @param src2 line of odd samples
+ * @param width number of samples of each source line
+ */
+void upipe_filter_convert_interleave8_c(uint8_t *dest, const uint8_t *src1,
+                                        const uint8_t *src2, size_t width)
+{
+    for ( ; width > 0; width--) {
+        *dest++ = *src1++;
+        *dest++ = *src2++;
+    }
+}
+
+/** @This interleaves two lines of 16-bit samples.
+ *
+ * @param dest dest line (2 * width samples)
+ * @param src1 line of even samples
+ * @param src2 line of odd samples
+ * @param width number of samples of each source line
+ */
+void upipe_filter_convert_interleave16_c(uint8_t *dest, const uint8_t *src1,
+                                         const uint8_t *src2, size_t width)
+{
+    for ( ; width > 0; width--) {
+        memcpy(dest, src1, 2);
+        memcpy(dest + 2, src2, 2);
+        dest += 4;
+        src1 += 2;
+        src2 += 2;
+    }
+}
+
+/** @This splits a line of interleaved 8-bit samples.
+ *
+ * @param dest1 filled in with the even samples
+ * @param dest2 filled in with the odd samples
+ * @param src source line (2 * width samples)
+ * @param width number of samples of each dest line
+ */
+void upipe_filter_convert_deinterleave8_c(uint8_t *dest1, uint8_t *dest2,
+                                          const uint8_t *src, size_t width)
+{
+    for ( ; width > 0; width--) {
+        *dest1++ = *src++;
+        *dest2++ = *src++;
+    }
+}
+
+/** @This splits a line of interleaved 16-bit samples.
+ *
+ * @param dest1 filled in with the even samples
+ * @param dest2 filled in with the odd samples
+ * @param src source line (2 * width samples)
+ * @param width number of samples of each dest line
+ */
+void upipe_filter_convert_deinterleave16_c(uint8_t *dest1, uint8_t *dest2,
+                                           const uint8_t *src, size_t width)
+{
+    for ( ; width > 0; width--) {
+        memcpy(dest1, src, 2);
+        memcpy(dest2, src + 2, 2);
+        dest1 += 2;
+        dest2 += 2;
+        src += 4;
+    }
+}
+
+/** @This swaps the samples of each pair of 8-bit samples.
+ *
+ * @param dest dest line
+ * @param src source line
+ * @param width number of pairs
+ */
+void upipe_filter_convert_swap8_c(uint8_t *dest, const uint8_t *src,
+                                  size_t width)
+{
+    for ( ; width > 0; width--) {
+        uint8_t a = src[0], b = src[1];
+        dest[0] = b;
+        dest[1] = a;
+        dest += 2;
+        src += 2;
+    }
+}
+
+/** @This swaps the samples of each pair of 16-bit samples.
+ *
+ * @param dest dest line
+ * @param src source line
+ * @param width number of pairs
+ */
+void upipe_filter_convert_swap16_c(uint8_t *dest, const uint8_t *src,
+                                   size_t width)
+{
+    for ( ; width > 0; width--) {
+        uint16_t a = upipe_filter_convert_rd16(src);
+        uint16_t b = upipe_filter_convert_rd16(src + 2);
+        upipe_filter_convert_wr16(dest, b);
+        upipe_filter_convert_wr16(dest + 2, a);
+        dest += 4;
+        src += 4;
+    }
+}
+
+/** @This converts 8-bit samples to 16-bit samples.
+ *
+ * @param dest dest line of 16-bit samples
+ * @param src source line of 8-bit samples
+ * @param width number of samples
+ * @param shift left shift to apply (depth difference)
+ */
+void upipe_filter_convert_expand_c(uint8_t *dest, const uint8_t *src,
+                                   size_t width, unsigned int shift)
+{
+    for ( ; width > 0; width--) {
+        upipe_filter_convert_wr16(dest, *src++ << shift);
+        dest += 2;
+    }
+}
+
+/** @This converts 16-bit samples to 8-bit samples.
+ *
+ * @param dest dest line of 8-bit samples
+ * @param src source line of 16-bit samples
+ * @param width number of samples
+ * @param shift right shift to apply (depth difference, 1 to 8)
+ */
+void upipe_filter_convert_reduce_c(uint8_t *dest, const uint8_t *src,
+                                   size_t width, unsigned int shift)
+{
+    unsigned int round = 1 << (shift - 1);
+    for ( ; width > 0; width--) {
+        unsigned int v = (upipe_filter_convert_rd16(src) + round) >> shift;
+        *dest++ = v > UINT8_MAX ? UINT8_MAX : v;
+        src += 2;
+    }
+}
+
+#ifdef UCPU_X86
+/** @This is the SSE2 version of @ref upipe_filter_convert_interleave8_c. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_interleave8_sse2(uint8_t *dest, const uint8_t *src1,
+                                           const uint8_t *src2, size_t width)
+{
+    for ( ; width >= 16; width -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src1);
+        __m128i b = _mm_loadu_si128((const __m128i *)src2);
+        _mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi8(a, b));
+        _mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi8(a, b));
+        dest += 32;
+        src1 += 16;
+        src2 += 16;
+    }
+    upipe_filter_convert_interleave8_c(dest, src1, src2, width);
+}
+
+/** @This is the SSE2 version of @ref upipe_filter_convert_interleave16_c. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_interleave16_sse2(uint8_t *dest,
+                                            const uint8_t *src1,
+                                            const uint8_t *src2, size_t width)
+{
+    for ( ; width >= 8; width -= 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src1);
+        __m128i b = _mm_loadu_si128((const __m128i *)src2);
+        _mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi16(a, b));
+        _mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi16(a, b));
+        dest += 32;
+        src1 += 16;
+        src2 += 16;
+    }
+    upipe_filter_convert_interleave16_c(dest, src1, src2, width);
+}
+
+/** @This is the SSE2 version of @ref upipe_filter_convert_deinterleave8_c. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_deinterleave8_sse2(uint8_t *dest1, uint8_t *dest2,
+                                             const uint8_t *src, size_t width)
+{
+    const __m128i mask = _mm_set1_epi16(0xff);
+    for ( ; width >= 16; width -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        _mm_storeu_si128((__m128i *)dest1,
+                         _mm_packus_epi16(_mm_and_si128(a, mask),
+                                          _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)dest2,
+                         _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                          _mm_srli_epi16(b, 8)));
+        dest1 += 16;
+        dest2 += 16;
+        src += 32;
+    }
+    upipe_filter_convert_deinterleave8_c(dest1, dest2, src, width);
+}
+
+/** @This is the SSE2 version of @ref upipe_filter_convert_deinterleave16_c.
+ * The samples are sign-extended so that the signed saturation of packs
+ * leaves them untouched. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_deinterleave16_sse2(uint8_t *dest1, uint8_t *dest2,
+                                              const uint8_t *src,
+                                              size_t width)
+{
+    for ( ; width >= 8; width -= 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        _mm_storeu_si128((__m128i *)dest1,
+                _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                _mm_srai_epi32(_mm_slli_epi32(b, 16), 16)));
+        _mm_storeu_si128((__m128i *)dest2,
+                _mm_packs_epi32(_mm_srai_epi32(a, 16),
+                                _mm_srai_epi32(b, 16)));
+        dest1 += 16;
+        dest2 += 16;
+        src += 32;
+    }
+    upipe_filter_convert_deinterleave16_c(dest1, dest2, src, width);
+}
+
+/** @This is the SSE2 version of @ref upipe_filter_convert_swap8_c. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_swap8_sse2(uint8_t *dest, const uint8_t *src,
+                                     size_t width)
+{
+    for ( ; width >= 8; width -= 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_or_si128(_mm_slli_epi16(a, 8),
+                                      _mm_srli_epi16(a, 8)));
+        dest += 16;
+        src += 16;
+    }
+    upipe_filter_convert_swap8_c(dest, src, width);
+}
+
+/** @This is the SSE2 version of @ref upipe_filter_convert_swap16_c. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_swap16_sse2(uint8_t *dest, const uint8_t *src,
+                                      size_t width)
+{
+    for ( ; width >= 4; width -= 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_or_si128(_mm_slli_epi32(a, 16),
+                                      _mm_srli_epi32(a, 16)));
+        dest += 16;
+        src += 16;
+    }
+    upipe_filter_convert_swap16_c(dest, src, width);
+}
+
+/** @This is the SSE2 version of @ref upipe_filter_convert_expand_c. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_expand_sse2(uint8_t *dest, const uint8_t *src,
+                                      size_t width, unsigned int shift)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for ( ; width >= 16; width -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        _mm_storeu_si128((__m128i *)dest,
+                         _mm_sll_epi16(_mm_unpacklo_epi8(a, zero), count));
+        _mm_storeu_si128((__m128i *)(dest + 16),
+                         _mm_sll_epi16(_mm_unpackhi_epi8(a, zero), count));
+        dest += 32;
+        src += 16;
+    }
+    upipe_filter_convert_expand_c(dest, src, width, shift);
+}
+
+/** @This is the SSE2 version of @ref upipe_filter_convert_reduce_c. */
+__attribute__((target("sse2")))
+void upipe_filter_convert_reduce_sse2(uint8_t *dest, const uint8_t *src,
+                                      size_t width, unsigned int shift)
+{
+    const __m128i round = _mm_set1_epi16(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for ( ; width >= 16; width -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+        a = _mm_srl_epi16(_mm_adds_epu16(a, round), count);
+        b = _mm_srl_epi16(_mm_adds_epu16(b, round), count);
+        _mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(a, b));
+        dest += 16;
+        src += 32;
+    }
+    upipe_filter_convert_reduce_c(dest, src, width, shift);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_interleave8_c.
+ * Unpacking works within 128-bit lanes, so the halves are put back in
+ * order afterwards. */
+__attribute__((target("avx2")))
+void upipe_filter_convert_interleave8_avx2(uint8_t *dest, const uint8_t *src1,
+                                           const uint8_t *src2, size_t width)
+{
+    for ( ; width >= 32; width -= 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src1);
+        __m256i b = _mm256_loadu_si256((const __m256i *)src2);
+        __m256i lo = _mm256_unpacklo_epi8(a, b);
+        __m256i hi = _mm256_unpackhi_epi8(a, b);
+        _mm256_storeu_si256((__m256i *)dest,
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dest + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+        dest += 64;
+        src1 += 32;
+        src2 += 32;
+    }
+    upipe_filter_convert_interleave8_sse2(dest, src1, src2, width);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_interleave16_c. */
+__attribute__((target("avx2")))
+void upipe_filter_convert_interleave16_avx2(uint8_t *dest,
+                                            const uint8_t *src1,
+                                            const uint8_t *src2, size_t width)
+{
+    for ( ; width >= 16; width -= 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src1);
+        __m256i b = _mm256_loadu_si256((const __m256i *)src2);
+        __m256i lo = _mm256_unpacklo_epi16(a, b);
+        __m256i hi = _mm256_unpackhi_epi16(a, b);
+        _mm256_storeu_si256((__m256i *)dest,
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dest + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+        dest += 64;
+        src1 += 32;
+        src2 += 32;
+    }
+    upipe_filter_convert_interleave16_sse2(dest, src1, src2, width);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_deinterleave8_c.
+ * Packing works within 128-bit lanes, so the quarters are put back in
+ * order afterwards. */
+__attribute__((target("avx2")))
+void upipe_filter_convert_deinterleave8_avx2(uint8_t *dest1, uint8_t *dest2,
+                                             const uint8_t *src, size_t width)
+{
+    const __m256i mask = _mm256_set1_epi16(0xff);
+    for ( ; width >= 32; width -= 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i even = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                           _mm256_and_si256(b, mask));
+        __m256i odd = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                          _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)dest1,
+                            _mm256_permute4x64_epi64(even, 0xd8));
+        _mm256_storeu_si256((__m256i *)dest2,
+                            _mm256_permute4x64_epi64(odd, 0xd8));
+        dest1 += 32;
+        dest2 += 32;
+        src += 64;
+    }
+    upipe_filter_convert_deinterleave8_sse2(dest1, dest2, src, width);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_deinterleave16_c.
+ */
+__attribute__((target("avx2")))
+void upipe_filter_convert_deinterleave16_avx2(uint8_t *dest1, uint8_t *dest2,
+                                              const uint8_t *src,
+                                              size_t width)
+{
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    for ( ; width >= 16; width -= 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        __m256i even = _mm256_packus_epi32(_mm256_and_si256(a, mask),
+                                           _mm256_and_si256(b, mask));
+        __m256i odd = _mm256_packus_epi32(_mm256_srli_epi32(a, 16),
+                                          _mm256_srli_epi32(b, 16));
+        _mm256_storeu_si256((__m256i *)dest1,
+                            _mm256_permute4x64_epi64(even, 0xd8));
+        _mm256_storeu_si256((__m256i *)dest2,
+                            _mm256_permute4x64_epi64(odd, 0xd8));
+        dest1 += 32;
+        dest2 += 32;
+        src += 64;
+    }
+    upipe_filter_convert_deinterleave16_sse2(dest1, dest2, src, width);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_swap8_c. */
+__attribute__((target("avx2")))
+void upipe_filter_convert_swap8_avx2(uint8_t *dest, const uint8_t *src,
+                                     size_t width)
+{
+    for ( ; width >= 16; width -= 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        _mm256_storeu_si256((__m256i *)dest,
+                            _mm256_or_si256(_mm256_slli_epi16(a, 8),
+                                            _mm256_srli_epi16(a, 8)));
+        dest += 32;
+        src += 32;
+    }
+    upipe_filter_convert_swap8_sse2(dest, src, width);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_swap16_c. */
+__attribute__((target("avx2")))
+void upipe_filter_convert_swap16_avx2(uint8_t *dest, const uint8_t *src,
+                                      size_t width)
+{
+    for ( ; width >= 8; width -= 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        _mm256_storeu_si256((__m256i *)dest,
+                            _mm256_or_si256(_mm256_slli_epi32(a, 16),
+                                            _mm256_srli_epi32(a, 16)));
+        dest += 32;
+        src += 32;
+    }
+    upipe_filter_convert_swap16_sse2(dest, src, width);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_expand_c. */
+__attribute__((target("avx2")))
+void upipe_filter_convert_expand_avx2(uint8_t *dest, const uint8_t *src,
+                                      size_t width, unsigned int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for ( ; width >= 16; width -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        _mm256_storeu_si256((__m256i *)dest,
+                            _mm256_sll_epi16(_mm256_cvtepu8_epi16(a), count));
+        dest += 32;
+        src += 16;
+    }
+    upipe_filter_convert_expand_c(dest, src, width, shift);
+}
+
+/** @This is the AVX2 version of @ref upipe_filter_convert_reduce_c. */
+__attribute__((target("avx2")))
+void upipe_filter_convert_reduce_avx2(uint8_t *dest, const uint8_t *src,
+                                      size_t width, unsigned int shift)
+{
+    const __m256i round = _mm256_set1_epi16(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for ( ; width >= 32; width -= 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)src);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+        a = _mm256_srl_epi16(_mm256_adds_epu16(a, round), count);
+        b = _mm256_srl_epi16(_mm256_adds_epu16(b, round), count);
+        _mm256_storeu_si256((__m256i *)dest,
+                _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+        dest += 32;
+        src += 64;
+    }
+    upipe_filter_convert_reduce_sse2(dest, src, width, shift);
+}
+#endif
@@ -48,6 +48,7 @@
 #include <upipe-modules/upipe_idem.h>
 #include <upipe-filters/upipe_filter_format.h>
 #include <upipe-filters/upipe_filter_blend.h>
+#include <upipe-filters/upipe_filter_convert.h>
 #include <upipe-swscale/upipe_sws.h>
 
 #include <stdlib.h>
@@ -67,6 +68,8 @@ struct upipe_ffmt_mgr {
     struct upipe_mgr *swr_mgr;
     /** pointer to deinterlace manager */
     struct upipe_mgr *deint_mgr;
+    /** pointer to pixel format conversion manager */
+    struct upipe_mgr *conv_mgr;
 
     /** public upipe_mgr structure */
     struct upipe_mgr mgr;
@@ -328,9 +331,15 @@ static int upipe_ffmt_check_flow_format(struct upipe *upipe,
         uref_pic_flow_delete_vsize_visible(flow_def_dup);
 
         bool need_deint = !!(uref_pic_cmp_progressive(flow_def, flow_def_dup));
+        bool need_scale = uref_pic_flow_cmp_hsize(flow_def, flow_def_dup) ||
+                          uref_pic_flow_cmp_vsize(flow_def, flow_def_dup);
         bool need_sws = !uref_pic_flow_compare_format(flow_def, flow_def_dup) ||
-                        uref_pic_flow_cmp_hsize(flow_def, flow_def_dup) ||
-                        uref_pic_flow_cmp_vsize(flow_def, flow_def_dup);
+                        need_scale;
+        /* simple format changes do not need swscale */
+        bool need_conv = need_sws && !need_scale &&
+            ffmt_mgr->conv_mgr != NULL &&
+            ubase_check(upipe_filter_convert_mgr_check(ffmt_mgr->conv_mgr,
+                                                       flow_def, flow_def_dup));
 
         if (need_deint) {
             struct upipe *input = upipe_void_alloc(ffmt_mgr->deint_mgr,
@@ -346,19 +355,22 @@ static int upipe_ffmt_check_flow_format(struct upipe *upipe,
         }
 
         if (need_sws) {
-            struct upipe *sws = upipe_flow_alloc(ffmt_mgr->sws_mgr,
+            struct upipe *sws = upipe_flow_alloc(
+                    need_conv ? ffmt_mgr->conv_mgr : ffmt_mgr->sws_mgr,
                     uprobe_pfx_alloc(uprobe_use(&upipe_ffmt->last_inner_probe),
-                                     UPROBE_LOG_VERBOSE, "sws"),
+                                     UPROBE_LOG_VERBOSE,
+                                     need_conv ? "conv" : "sws"),
                     flow_def_dup);
             if (unlikely(sws == NULL)) {
-                upipe_warn_va(upipe, "couldn't allocate swscale");
+                upipe_warn_va(upipe, "couldn't allocate %s",
+                              need_conv ? "conversion" : "swscale");
                 udict_dump(flow_def_dup->udict, upipe->uprobe);
             } else if (!need_deint)
                 upipe_ffmt_store_bin_input(upipe, upipe_use(sws));
             else
                 upipe_set_output(upipe_ffmt->first_inner, sws);
             upipe_ffmt_store_bin_output(upipe, sws);
-            if (upipe_ffmt->sws_flags)
+            if (!need_conv && upipe_ffmt->sws_flags)
                 upipe_sws_set_flags(sws, upipe_ffmt->sws_flags);
         }
 
@@ -525,6 +537,7 @@ static void upipe_ffmt_mgr_free(struct urefcount *urefcount)
     upipe_mgr_release(ffmt_mgr->swr_mgr);
     upipe_mgr_release(ffmt_mgr->sws_mgr);
     upipe_mgr_release(ffmt_mgr->deint_mgr);
+    upipe_mgr_release(ffmt_mgr->conv_mgr);
 
     urefcount_clean(urefcount);
     free(ffmt_mgr);
@@ -563,6 +576,7 @@ static int upipe_ffmt_mgr_control(struct upipe_mgr *mgr,
         GET_SET_MGR(sws, SWS)
         GET_SET_MGR(swr, SWR)
         GET_SET_MGR(deint, DEINT)
+        GET_SET_MGR(conv, CONV)
 #undef GET_SET_MGR
 
         default:
@@ -583,6 +597,7 @@ struct upipe_mgr *upipe_ffmt_mgr_alloc(void)
     ffmt_mgr->sws_mgr = NULL;
     ffmt_mgr->swr_mgr = NULL;
     ffmt_mgr->deint_mgr = upipe_filter_blend_mgr_alloc();
+    ffmt_mgr->conv_mgr = upipe_filter_convert_mgr_alloc();
 
     urefcount_init(upipe_ffmt_mgr_to_urefcount(ffmt_mgr),
                    upipe_ffmt_mgr_free);
@@ -0,0 +1,817 @@
+/*
+ * Copyright (C) 2006-2011 Michael Niedermayer <michaelni@gmx.at>
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe yadif motion-adaptive deinterlace filter
+ *
+ * Adapted from libavfilter (vf_yadif.c). Each output picture is computed
+ * from the previous, current and next input pictures, which are only
+ * referenced and read in place. The first and last pictures of a flow use
+ * the current picture in place of the missing neighbour.
+ */
+
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uband_pool.h>
+#include <upipe/udict.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_dump.h>
+#include <upipe/ubuf.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_input.h>
+#include <upipe-filters/upipe_filter_yadif.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+/** maximum number of planes of a picture */
+#define UPIPE_FILTER_YADIF_MAX_PLANES 4
+/** maximum number of band threads */
+#define UPIPE_FILTER_YADIF_MAX_THREADS 16
+
+/** @hidden */
+static bool upipe_filter_yadif_handle(struct upipe *upipe, struct uref *uref,
+                                      struct upump **upump_p);
+/** @hidden */
+static int upipe_filter_yadif_check(struct upipe *upipe,
+                                    struct uref *flow_format);
+
+/** @internal upipe_filter_yadif private structure */
+struct upipe_filter_yadif {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** temporary uref storage (used during urequest) */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers (used during udeal) */
+    struct uchain blockers;
+
+    /** output mode */
+    enum upipe_filter_yadif_mode mode;
+    /** number of band threads */
+    unsigned int threads;
+    /** pool of band threads, or NULL for a single thread */
+    struct uband_pool *band_pool;
+    /** duration of an input picture from the flow definition, or 0 */
+    uint64_t input_duration;
+    /** 8-bit line interpolation function */
+    upipe_filter_yadif_line line8;
+    /** 16-bit line interpolation function */
+    upipe_filter_yadif_line line16;
+
+    /** previous picture */
+    struct uref *prev;
+    /** current picture, waiting for the next one */
+    struct uref *cur;
+
+    /** public structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_filter_yadif, upipe, UPIPE_FILTER_YADIF_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_filter_yadif, urefcount, upipe_filter_yadif_free)
+UPIPE_HELPER_VOID(upipe_filter_yadif)
+UPIPE_HELPER_OUTPUT(upipe_filter_yadif, output, flow_def, output_state, request_list)
+UPIPE_HELPER_UBUF_MGR(upipe_filter_yadif, ubuf_mgr, flow_format,
+                      ubuf_mgr_request, upipe_filter_yadif_check,
+                      upipe_filter_yadif_register_output_request,
+                      upipe_filter_yadif_unregister_output_request)
+UPIPE_HELPER_INPUT(upipe_filter_yadif, urefs, nb_urefs, max_urefs, blockers, upipe_filter_yadif_handle)
+
+/** @internal @This describes a mapped plane to deinterlace. */
+struct upipe_filter_yadif_plane {
+    /** previous picture */
+    const uint8_t *prev;
+    /** current picture */
+    const uint8_t *cur;
+    /** next picture */
+    const uint8_t *next;
+    /** output buffer */
+    uint8_t *out;
+    /** stride length of input buffers */
+    size_t stride_in;
+    /** stride length of output buffer */
+    size_t stride_out;
+    /** plane width in samples */
+    size_t width;
+    /** length of a line in bytes */
+    size_t bytes;
+    /** plane height */
+    size_t height;
+    /** line interpolation function */
+    upipe_filter_yadif_line line;
+};
+
+/** @internal @This describes all planes of a picture to split in bands. */
+struct upipe_filter_yadif_picture {
+    /** planes of the picture */
+    const struct upipe_filter_yadif_plane *planes;
+    /** number of planes */
+    unsigned int nb_planes;
+    /** true if the even lines are interpolated */
+    bool parity;
+    /** true if the top field is first */
+    bool tff;
+};
+
+/** @internal @This allocates a yadif pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_filter_yadif_alloc(struct upipe_mgr *mgr,
+                                              struct uprobe *uprobe,
+                                              uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_filter_yadif_alloc_void(mgr, uprobe, signature,
+                                                        args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    upipe_filter_yadif->mode = UPIPE_FILTER_YADIF_MODE_FRAME;
+    upipe_filter_yadif->threads = 1;
+    upipe_filter_yadif->band_pool = NULL;
+    upipe_filter_yadif->input_duration = 0;
+    upipe_filter_yadif->prev = NULL;
+    upipe_filter_yadif->cur = NULL;
+    upipe_filter_yadif->line8 = upipe_filter_yadif_line8_c;
+    upipe_filter_yadif->line16 = upipe_filter_yadif_line16_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_AVX2)) {
+        upipe_filter_yadif->line8 = upipe_filter_yadif_line8_avx2;
+        upipe_filter_yadif->line16 = upipe_filter_yadif_line16_avx2;
+    } else if (ucpu_has(UCPU_SSE2)) {
+        upipe_filter_yadif->line8 = upipe_filter_yadif_line8_sse2;
+        upipe_filter_yadif->line16 = upipe_filter_yadif_line16_sse2;
+    }
+#endif
+
+    upipe_filter_yadif_init_urefcount(upipe);
+    upipe_filter_yadif_init_ubuf_mgr(upipe);
+    upipe_filter_yadif_init_output(upipe);
+    upipe_filter_yadif_init_input(upipe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This processes a band of a picture plane.
+ *
+ * @param plane description of the plane
+ * @param first first line of the band
+ * @param last line following the band
+ * @param parity true if the even lines are interpolated
+ * @param tff true if the top field is first
+ */
+static void upipe_filter_yadif_plane(const struct upipe_filter_yadif_plane *plane,
+                                     size_t first, size_t last,
+                                     bool parity, bool tff)
+{
+    size_t h = plane->height;
+    ptrdiff_t stride = plane->stride_in;
+
+    for (size_t y = first; y < last; y++) {
+        const uint8_t *cur = plane->cur + y * plane->stride_in;
+        uint8_t *out = plane->out + y * plane->stride_out;
+
+        if (!((y ^ parity) & 1) || h < 2) {
+            memcpy(out, cur, plane->bytes);
+            continue;
+        }
+
+        /* mirror the lines outside of the picture */
+        ptrdiff_t mrefs = y ? -stride : stride;
+        ptrdiff_t prefs = y + 1 < h ? stride : -stride;
+        bool check = y > 1 && y + 2 < h;
+        plane->line(out, plane->prev + y * plane->stride_in, cur,
+                    plane->next + y * plane->stride_in, plane->width,
+                    prefs, mrefs, parity ^ tff, check);
+    }
+}
+
+/** @internal @This processes a horizontal band of all planes.
+ *
+ * @param opaque pointer to a struct upipe_filter_yadif_picture
+ * @param band index of the band
+ * @param nb_bands number of bands
+ */
+static void upipe_filter_yadif_band(void *opaque, unsigned int band,
+                                    unsigned int nb_bands)
+{
+    struct upipe_filter_yadif_picture *picture = opaque;
+    for (unsigned int i = 0; i < picture->nb_planes; i++) {
+        const struct upipe_filter_yadif_plane *plane = &picture->planes[i];
+        upipe_filter_yadif_plane(plane, plane->height * band / nb_bands,
+                                 plane->height * (band + 1) / nb_bands,
+                                 picture->parity, picture->tff);
+    }
+}
+
+/** @internal @This processes all planes of a picture, possibly splitting
+ * them into horizontal bands handled by the band pool.
+ *
+ * @param upipe description structure of the pipe
+ * @param planes mapped planes
+ * @param nb_planes number of planes
+ * @param height height of the smallest plane
+ * @param parity true if the even lines are interpolated
+ * @param tff true if the top field is first
+ */
+static void upipe_filter_yadif_picture(struct upipe *upipe,
+        const struct upipe_filter_yadif_plane *planes,
+        unsigned int nb_planes, size_t height, bool parity, bool tff)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    struct upipe_filter_yadif_picture picture = {
+        .planes = planes,
+        .nb_planes = nb_planes,
+        .parity = parity,
+        .tff = tff
+    };
+
+    if (upipe_filter_yadif->band_pool == NULL) {
+        upipe_filter_yadif_band(&picture, 0, 1);
+        return;
+    }
+
+    unsigned int nb_bands = upipe_filter_yadif->threads;
+    /* keep at least a few lines of the smallest plane per band */
+    while (nb_bands > 1 && height / nb_bands < 16)
+        nb_bands--;
+    uband_pool_run(upipe_filter_yadif->band_pool, nb_bands,
+                   upipe_filter_yadif_band, &picture);
+}
+
+/** @internal @This unmaps the planes of the pictures.
+ *
+ * @param prev previous picture
+ * @param cur current picture
+ * @param next next picture
+ * @param ubuf output buffer
+ * @param chromas names of the mapped planes
+ * @param nb_planes number of mapped planes
+ */
+static void upipe_filter_yadif_unmap(struct uref *prev, struct uref *cur,
+                                     struct uref *next, struct ubuf *ubuf,
+                                     const char **chromas,
+                                     unsigned int nb_planes)
+{
+    for (unsigned int i = 0; i < nb_planes; i++) {
+        uref_pic_plane_unmap(prev, chromas[i], 0, 0, -1, -1);
+        uref_pic_plane_unmap(cur, chromas[i], 0, 0, -1, -1);
+        uref_pic_plane_unmap(next, chromas[i], 0, 0, -1, -1);
+        ubuf_pic_plane_unmap(ubuf, chromas[i], 0, 0, -1, -1);
+    }
+}
+
+/** @internal @This computes and outputs a deinterlaced picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param prev previous picture
+ * @param cur current picture
+ * @param next next picture
+ * @param second true for the second field of the current picture
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_filter_yadif_output_field(struct upipe *upipe,
+                                            struct uref *prev,
+                                            struct uref *cur,
+                                            struct uref *next, bool second,
+                                            struct upump **upump_p)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    struct upipe_filter_yadif_plane planes[UPIPE_FILTER_YADIF_MAX_PLANES];
+    const char *chromas[UPIPE_FILTER_YADIF_MAX_PLANES];
+    unsigned int nb_planes = 0;
+    uint8_t hsub, vsub, macropixel = 1, macropixel_size;
+    size_t stride_in, stride_prev, stride_next, stride_out;
+    size_t width, height, min_height;
+    const char *chroma = NULL;
+
+    if (unlikely(!ubase_check(uref_pic_size(cur, &width, &height,
+                                            &macropixel)))) {
+        upipe_warn(upipe, "invalid buffer received");
+        return;
+    }
+
+    struct uref *uref = uref_dup(cur);
+    struct ubuf *ubuf = ubuf_pic_alloc(upipe_filter_yadif->ubuf_mgr,
+                                       width, height);
+    if (unlikely(uref == NULL || ubuf == NULL)) {
+        if (uref != NULL)
+            uref_free(uref);
+        if (ubuf != NULL)
+            ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+
+    min_height = height;
+    while (ubase_check(uref_pic_plane_iterate(cur, &chroma)) && chroma) {
+        if (unlikely(nb_planes >= UPIPE_FILTER_YADIF_MAX_PLANES)) {
+            upipe_err(upipe, "too many planes");
+            goto error;
+        }
+        struct upipe_filter_yadif_plane *plane = &planes[nb_planes];
+        if (unlikely(!ubase_check(uref_pic_plane_size(cur, chroma,
+                            &stride_in, &hsub, &vsub, &macropixel_size)) ||
+                     !ubase_check(uref_pic_plane_size(prev, chroma,
+                            &stride_prev, NULL, NULL, NULL)) ||
+                     !ubase_check(uref_pic_plane_size(next, chroma,
+                            &stride_next, NULL, NULL, NULL)) ||
+                     !ubase_check(ubuf_pic_plane_size(ubuf, chroma,
+                            &stride_out, NULL, NULL, NULL)))) {
+            upipe_err_va(upipe, "Could not read chroma %s", chroma);
+            goto error;
+        }
+        if (unlikely(!ubase_check(uref_pic_plane_read(cur, chroma,
+                                        0, 0, -1, -1, &plane->cur)))) {
+            upipe_err_va(upipe, "Could not map chroma %s", chroma);
+            goto error;
+        }
+        if (unlikely(!ubase_check(uref_pic_plane_read(prev, chroma,
+                                        0, 0, -1, -1, &plane->prev)))) {
+            uref_pic_plane_unmap(cur, chroma, 0, 0, -1, -1);
+            upipe_err_va(upipe, "Could not map chroma %s", chroma);
+            goto error;
+        }
+        if (unlikely(!ubase_check(uref_pic_plane_read(next, chroma,
+                                        0, 0, -1, -1, &plane->next)))) {
+            uref_pic_plane_unmap(cur, chroma, 0, 0, -1, -1);
+            uref_pic_plane_unmap(prev, chroma, 0, 0, -1, -1);
+            upipe_err_va(upipe, "Could not map chroma %s", chroma);
+            goto error;
+        }
+        if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf, chroma,
+                                        0, 0, -1, -1, &plane->out)))) {
+            uref_pic_plane_unmap(cur, chroma, 0, 0, -1, -1);
+            uref_pic_plane_unmap(prev, chroma, 0, 0, -1, -1);
+            uref_pic_plane_unmap(next, chroma, 0, 0, -1, -1);
+            upipe_err_va(upipe, "Could not map chroma %s", chroma);
+            goto error;
+        }
+        chromas[nb_planes++] = chroma;
+
+        /* neighbours with a different layout are not used */
+        if (unlikely(stride_prev != stride_in))
+            plane->prev = plane->cur;
+        if (unlikely(stride_next != stride_in))
+            plane->next = plane->cur;
+        plane->stride_in = stride_in;
+        plane->stride_out = stride_out;
+        plane->width = width / hsub / macropixel * macropixel_size;
+        plane->bytes = plane->width;
+        plane->height = height / vsub;
+        if (macropixel_size == 2) {
+            plane->width /= 2;
+            plane->line = upipe_filter_yadif->line16;
+        } else
+            plane->line = upipe_filter_yadif->line8;
+        if (plane->height < min_height)
+            min_height = plane->height;
+    }
+
+    bool tff = ubase_check(uref_pic_get_tff(cur));
+    upipe_filter_yadif_picture(upipe, planes, nb_planes, min_height,
+                               second ? tff : !tff, tff);
+    upipe_filter_yadif_unmap(prev, cur, next, ubuf, chromas, nb_planes);
+
+    uref_attach_ubuf(uref, ubuf);
+    uref_pic_set_progressive(uref);
+    uref_pic_delete_tff(uref);
+
+    if (upipe_filter_yadif->mode == UPIPE_FILTER_YADIF_MODE_FIELD) {
+        uint64_t duration;
+        if (!ubase_check(uref_clock_get_duration(uref, &duration)))
+            duration = upipe_filter_yadif->input_duration;
+        duration /= 2;
+        if (duration)
+            uref_clock_set_duration(uref, duration);
+        if (second) {
+            uint64_t date;
+            int type;
+            uref_clock_get_date_sys(uref, &date, &type);
+            if (type != UREF_DATE_NONE)
+                uref_clock_set_date_sys(uref, date + duration, type);
+            uref_clock_get_date_prog(uref, &date, &type);
+            if (type != UREF_DATE_NONE)
+                uref_clock_set_date_prog(uref, date + duration, type);
+            uref_clock_get_date_orig(uref, &date, &type);
+            if (type != UREF_DATE_NONE)
+                uref_clock_set_date_orig(uref, date + duration, type);
+        }
+    }
+
+    upipe_filter_yadif_output(upipe, uref, upump_p);
+    return;
+
+error:
+    upipe_filter_yadif_unmap(prev, cur, next, ubuf, chromas, nb_planes);
+    ubuf_free(ubuf);
+    uref_free(uref);
+}
+
+/** @internal @This outputs the deinterlaced picture(s) of the current
+ * picture, and shifts the pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param next next picture, or NULL at the end of the flow
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_filter_yadif_shift(struct upipe *upipe, struct uref *next,
+                                     struct upump **upump_p)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    struct uref *cur = upipe_filter_yadif->cur;
+    struct uref *prev = upipe_filter_yadif->prev;
+
+    if (cur != NULL && upipe_filter_yadif->ubuf_mgr != NULL) {
+        struct uref *p = prev != NULL ? prev : cur;
+        struct uref *n = next != NULL ? next : cur;
+        upipe_filter_yadif_output_field(upipe, p, cur, n, false, upump_p);
+        if (upipe_filter_yadif->mode == UPIPE_FILTER_YADIF_MODE_FIELD)
+            upipe_filter_yadif_output_field(upipe, p, cur, n, true, upump_p);
+    }
+
+    if (prev != NULL)
+        uref_free(prev);
+    upipe_filter_yadif->prev = next != NULL ? cur : NULL;
+    if (next == NULL && cur != NULL)
+        uref_free(cur);
+    upipe_filter_yadif->cur = next;
+}
+
+/** @internal @This outputs and releases the held pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_filter_yadif_flush(struct upipe *upipe,
+                                     struct upump **upump_p)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    if (upipe_filter_yadif->cur != NULL)
+        upipe_filter_yadif_shift(upipe, NULL, upump_p);
+    if (upipe_filter_yadif->prev != NULL) {
+        uref_free(upipe_filter_yadif->prev);
+        upipe_filter_yadif->prev = NULL;
+    }
+}
+
+/** @internal @This handles input.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to upump structure
+ * @return false if the input must be blocked
+ */
+static bool upipe_filter_yadif_handle(struct upipe *upipe, struct uref *uref,
+                                      struct upump **upump_p)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_filter_yadif_flush(upipe, upump_p);
+        upipe_filter_yadif_store_flow_def(upipe, NULL);
+        upipe_filter_yadif_require_ubuf_mgr(upipe, uref);
+        return true;
+    }
+
+    if (upipe_filter_yadif->flow_def == NULL)
+        return false;
+
+    upipe_filter_yadif_shift(upipe, uref, upump_p);
+    return true;
+}
+
+/** @internal @This inputs data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_filter_yadif_input(struct upipe *upipe, struct uref *uref,
+                                     struct upump **upump_p)
+{
+    if (!upipe_filter_yadif_check_input(upipe)) {
+        upipe_filter_yadif_hold_input(upipe, uref);
+        upipe_filter_yadif_block_input(upipe, upump_p);
+    } else if (!upipe_filter_yadif_handle(upipe, uref, upump_p)) {
+        upipe_filter_yadif_hold_input(upipe, uref);
+        upipe_filter_yadif_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This checks if the input may start.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_filter_yadif_check(struct upipe *upipe,
+                                    struct uref *flow_format)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    if (flow_format != NULL)
+        upipe_filter_yadif_store_flow_def(upipe, flow_format);
+
+    if (upipe_filter_yadif->flow_def == NULL)
+        return UBASE_ERR_NONE;
+
+    bool was_buffered = !upipe_filter_yadif_check_input(upipe);
+    upipe_filter_yadif_output_input(upipe);
+    upipe_filter_yadif_unblock_input(upipe);
+    if (was_buffered && upipe_filter_yadif_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_filter_yadif_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_filter_yadif_set_flow_def(struct upipe *upipe,
+                                           struct uref *flow_def)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, "pic."))
+
+    /* planar formats with 8-bit or 16-bit samples only */
+    uint8_t macropixel, planes;
+    UBASE_RETURN(uref_pic_flow_get_macropixel(flow_def, &macropixel))
+    UBASE_RETURN(uref_pic_flow_get_planes(flow_def, &planes))
+    bool ok = macropixel == 1 && planes <= UPIPE_FILTER_YADIF_MAX_PLANES;
+    for (uint8_t i = 0; ok && i < planes; i++) {
+        uint8_t macropixel_size;
+        const char *chroma;
+        ok = ubase_check(uref_pic_flow_get_macropixel_size(flow_def,
+                    &macropixel_size, i)) &&
+             ubase_check(uref_pic_flow_get_chroma(flow_def, &chroma, i)) &&
+             (macropixel_size == 1 ||
+              (macropixel_size == 2 && strstr(chroma, "16") == NULL));
+    }
+    if (!ok) {
+        upipe_err(upipe, "incompatible input flow def");
+        uref_dump(flow_def, upipe->uprobe);
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct urational fps;
+    upipe_filter_yadif->input_duration = 0;
+    if (ubase_check(uref_pic_flow_get_fps(flow_def, &fps)) && fps.num) {
+        upipe_filter_yadif->input_duration = UCLOCK_FREQ * fps.den / fps.num;
+        if (upipe_filter_yadif->mode == UPIPE_FILTER_YADIF_MODE_FIELD) {
+            fps.num *= 2;
+            urational_simplify(&fps);
+            UBASE_RETURN(uref_pic_flow_set_fps(flow_def_dup, fps))
+        }
+    }
+    UBASE_RETURN(uref_pic_set_progressive(flow_def_dup))
+    uref_pic_delete_tff(flow_def_dup);
+    upipe_input(upipe, flow_def_dup, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the output mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param mode output mode
+ * @return an error code
+ */
+static int _upipe_filter_yadif_set_mode(struct upipe *upipe, int mode)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    if (unlikely(mode != UPIPE_FILTER_YADIF_MODE_FRAME &&
+                 mode != UPIPE_FILTER_YADIF_MODE_FIELD))
+        return UBASE_ERR_INVALID;
+    upipe_filter_yadif->mode = mode;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of band threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static int _upipe_filter_yadif_set_threads(struct upipe *upipe,
+                                           unsigned int threads)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    if (unlikely(threads < 1 || threads > UPIPE_FILTER_YADIF_MAX_THREADS))
+        return UBASE_ERR_INVALID;
+
+    struct uband_pool *band_pool = NULL;
+    if (threads > 1) {
+        band_pool = uband_pool_alloc(threads);
+        if (unlikely(band_pool == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        if (uband_pool_threads(band_pool) < threads)
+            upipe_warn_va(upipe, "only %u band threads available",
+                          uband_pool_threads(band_pool));
+    }
+
+    uband_pool_free(upipe_filter_yadif->band_pool);
+    upipe_filter_yadif->band_pool = band_pool;
+    upipe_filter_yadif->threads = threads;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_filter_yadif_control(struct upipe *upipe,
+                                      int command, va_list args)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_filter_yadif_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return UBASE_ERR_NONE;
+            return upipe_filter_yadif_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_filter_yadif_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_filter_yadif_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_filter_yadif_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_filter_yadif_set_output(upipe, output);
+        }
+        case UPIPE_FLUSH:
+            upipe_filter_yadif_flush(upipe, NULL);
+            return UBASE_ERR_NONE;
+
+        case UPIPE_FILTER_YADIF_SET_MODE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_YADIF_SIGNATURE)
+            int mode = va_arg(args, int);
+            return _upipe_filter_yadif_set_mode(upipe, mode);
+        }
+        case UPIPE_FILTER_YADIF_GET_MODE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_YADIF_SIGNATURE)
+            int *p = va_arg(args, int *);
+            *p = upipe_filter_yadif->mode;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_FILTER_YADIF_SET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_YADIF_SIGNATURE)
+            unsigned int threads = va_arg(args, unsigned int);
+            return _upipe_filter_yadif_set_threads(upipe, threads);
+        }
+        case UPIPE_FILTER_YADIF_GET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_FILTER_YADIF_SIGNATURE)
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = upipe_filter_yadif->threads;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_filter_yadif_free(struct upipe *upipe)
+{
+    struct upipe_filter_yadif *upipe_filter_yadif =
+        upipe_filter_yadif_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    uband_pool_free(upipe_filter_yadif->band_pool);
+
+    if (upipe_filter_yadif->prev != NULL)
+        uref_free(upipe_filter_yadif->prev);
+    if (upipe_filter_yadif->cur != NULL)
+        uref_free(upipe_filter_yadif->cur);
+    upipe_filter_yadif_clean_input(upipe);
+    upipe_filter_yadif_clean_ubuf_mgr(upipe);
+    upipe_filter_yadif_clean_output(upipe);
+    upipe_filter_yadif_clean_urefcount(upipe);
+    upipe_filter_yadif_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_filter_yadif_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_FILTER_YADIF_SIGNATURE,
+
+    .upipe_alloc = upipe_filter_yadif_alloc,
+    .upipe_input = upipe_filter_yadif_input,
+    .upipe_control = upipe_filter_yadif_control
+};
+
+/** @This returns the management structure for yadif pipes
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_filter_yadif_mgr_alloc(void)
+{
+    return &upipe_filter_yadif_mgr;
+}
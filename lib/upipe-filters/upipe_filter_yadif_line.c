@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2006-2011 Michael Niedermayer <michaelni@gmx.at>
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short line interpolation functions of the yadif deinterlace filter
+ *
+ * Adapted from libavfilter (vf_yadif.c). The SIMD versions compute 8 or 16
+ * samples at once in 16-bit lanes and give the same output as the C
+ * versions; the edge-directed search is skipped on the three samples at
+ * each end of the lines, which are handled by the C versions.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-filters/upipe_filter_yadif.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN3(a, b, c) MIN(MIN(a, b), c)
+#define MAX3(a, b, c) MAX(MAX(a, b), c)
+
+/** @internal @This tries an edge direction for a sample. */
+#define CHECK(j)                                                            \
+    {   int score = abs(cur[x + mrefs - 1 + (j)] - cur[x + prefs - 1 - (j)]) \
+                  + abs(cur[x + mrefs + (j)] - cur[x + prefs - (j)])        \
+                  + abs(cur[x + mrefs + 1 + (j)] - cur[x + prefs + 1 - (j)]); \
+        if (score < spatial_score) {                                        \
+            spatial_score = score;                                          \
+            spatial_pred = (cur[x + mrefs + (j)] + cur[x + prefs - (j)]) >> 1;
+
+/** @internal @This defines a function interpolating samples [x, end) of
+ * a line, with offsets given in samples. */
+#define YADIF_RANGE(bits, type)                                             \
+static void yadif_range##bits(type *dst, const type *prev,                  \
+        const type *cur, const type *next, ptrdiff_t x, ptrdiff_t end,      \
+        ptrdiff_t w, ptrdiff_t prefs, ptrdiff_t mrefs,                      \
+        bool parity, bool check)                                            \
+{                                                                           \
+    const type *prev2 = parity ? prev : cur;                                \
+    const type *next2 = parity ? cur : next;                                \
+    for ( ; x < end; x++) {                                                 \
+        int c = cur[x + mrefs];                                             \
+        int e = cur[x + prefs];                                             \
+        int d = (prev2[x] + next2[x]) >> 1;                                 \
+        int temporal_diff0 = abs(prev2[x] - next2[x]);                      \
+        int temporal_diff1 = (abs(prev[x + mrefs] - c) +                    \
+                              abs(prev[x + prefs] - e)) >> 1;               \
+        int temporal_diff2 = (abs(next[x + mrefs] - c) +                    \
+                              abs(next[x + prefs] - e)) >> 1;               \
+        int diff = MAX3(temporal_diff0 >> 1, temporal_diff1,                \
+                        temporal_diff2);                                    \
+        int spatial_pred = (c + e) >> 1;                                    \
+                                                                            \
+        if (x >= 3 && x + 3 < w) {                                          \
+            int spatial_score = abs(cur[x + mrefs - 1] -                    \
+                                    cur[x + prefs - 1]) + abs(c - e) +      \
+                                abs(cur[x + mrefs + 1] -                    \
+                                    cur[x + prefs + 1]) - 1;                \
+            CHECK(-1) CHECK(-2) }} }}                                       \
+            CHECK( 1) CHECK( 2) }} }}                                       \
+        }                                                                   \
+                                                                            \
+        if (check) {                                                        \
+            int b = (prev2[x + 2 * mrefs] + next2[x + 2 * mrefs]) >> 1;     \
+            int f = (prev2[x + 2 * prefs] + next2[x + 2 * prefs]) >> 1;     \
+            int max = MAX3(d - e, d - c, MIN(b - c, f - e));                \
+            int min = MIN3(d - e, d - c, MAX(b - c, f - e));                \
+            diff = MAX3(diff, min, -max);                                   \
+        }                                                                   \
+                                                                            \
+        if (spatial_pred > d + diff)                                        \
+            spatial_pred = d + diff;                                        \
+        else if (spatial_pred < d - diff)                                   \
+            spatial_pred = d - diff;                                        \
+        dst[x] = spatial_pred;                                              \
+    }                                                                       \
+}
+
+YADIF_RANGE(8, uint8_t)
+YADIF_RANGE(16, uint16_t)
+#undef YADIF_RANGE
+#undef CHECK
+
+/** @This interpolates a line of 8-bit samples.
+ *
+ * @param dst output line
+ * @param prev same line in the previous picture
+ * @param cur same line in the current picture
+ * @param next same line in the next picture
+ * @param w width in samples
+ * @param prefs offset in bytes of the line below
+ * @param mrefs offset in bytes of the line above
+ * @param parity true if the interpolated field is temporally closer to the
+ * previous picture
+ * @param check true to apply the spatial interlacing check
+ */
+void upipe_filter_yadif_line8_c(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check)
+{
+    yadif_range8(dst, prev, cur, next, 0, w, w, prefs, mrefs, parity, check);
+}
+
+/** @This interpolates a line of 16-bit samples.
+ *
+ * @param dst output line
+ * @param prev same line in the previous picture
+ * @param cur same line in the current picture
+ * @param next same line in the next picture
+ * @param w width in samples
+ * @param prefs offset in bytes of the line below
+ * @param mrefs offset in bytes of the line above
+ * @param parity true if the interpolated field is temporally closer to the
+ * previous picture
+ * @param check true to apply the spatial interlacing check
+ */
+void upipe_filter_yadif_line16_c(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check)
+{
+    yadif_range16((uint16_t *)dst, (const uint16_t *)prev,
+                  (const uint16_t *)cur, (const uint16_t *)next, 0, w, w,
+                  prefs / 2, mrefs / 2, parity, check);
+}
+
+#ifdef UCPU_X86
+#define YADIF_SUFFIX        sse2
+#define YADIF_TARGET        "sse2"
+#define YADIF_VEC           __m128i
+#define YADIF_LANES         8
+#define VLOAD8(p)           _mm_unpacklo_epi8(                              \
+                                _mm_loadl_epi64((const __m128i *)(p)),      \
+                                _mm_setzero_si128())
+#define VLOAD16(p)          _mm_loadu_si128((const __m128i *)(p))
+#define VSTORE8(p, v)       _mm_storel_epi64((__m128i *)(p),                \
+                                             _mm_packus_epi16(v, v))
+#define VSTORE16(p, v)      _mm_storeu_si128((__m128i *)(p), v)
+#define VSET1(a)            _mm_set1_epi16(a)
+#define VADD(a, b)          _mm_add_epi16(a, b)
+#define VSUB(a, b)          _mm_sub_epi16(a, b)
+#define VMIN(a, b)          _mm_min_epi16(a, b)
+#define VMAX(a, b)          _mm_max_epi16(a, b)
+#define VSRA1(a)            _mm_srai_epi16(a, 1)
+#define VCMPGT(a, b)        _mm_cmpgt_epi16(a, b)
+#define VAND(a, b)          _mm_and_si128(a, b)
+#define VBLEND(m, a, b)     _mm_or_si128(_mm_and_si128(m, a),               \
+                                         _mm_andnot_si128(m, b))
+#include "upipe_filter_yadif_simd.h"
+
+#define YADIF_SUFFIX        avx2
+#define YADIF_TARGET        "avx2"
+#define YADIF_VEC           __m256i
+#define YADIF_LANES         16
+#define VLOAD8(p)           _mm256_cvtepu8_epi16(                           \
+                                _mm_loadu_si128((const __m128i *)(p)))
+#define VLOAD16(p)          _mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE8(p, v)       _mm_storeu_si128((__m128i *)(p),                \
+                                _mm256_castsi256_si128(                     \
+                                    _mm256_permute4x64_epi64(               \
+                                        _mm256_packus_epi16(v, v), 0x08)))
+#define VSTORE16(p, v)      _mm256_storeu_si256((__m256i *)(p), v)
+#define VSET1(a)            _mm256_set1_epi16(a)
+#define VADD(a, b)          _mm256_add_epi16(a, b)
+#define VSUB(a, b)          _mm256_sub_epi16(a, b)
+#define VMIN(a, b)          _mm256_min_epi16(a, b)
+#define VMAX(a, b)          _mm256_max_epi16(a, b)
+#define VSRA1(a)            _mm256_srai_epi16(a, 1)
+#define VCMPGT(a, b)        _mm256_cmpgt_epi16(a, b)
+#define VAND(a, b)          _mm256_and_si256(a, b)
+#define VBLEND(m, a, b)     _mm256_blendv_epi8(b, a, m)
+#include "upipe_filter_yadif_simd.h"
+#endif
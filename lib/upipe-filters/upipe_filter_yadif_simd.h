@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2006-2011 Michael Niedermayer <michaelni@gmx.at>
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short SIMD template of the yadif line interpolation functions
+ *
+ * This file is included by upipe_filter_yadif_line.c once per instruction
+ * set, after defining YADIF_SUFFIX, YADIF_TARGET, YADIF_VEC, YADIF_LANES and
+ * the V* operations on vectors of signed 16-bit lanes. They are undefined
+ * at the end of the file.
+ */
+
+#define YADIF_FN3(name, suffix) name##_##suffix
+#define YADIF_FN2(name, suffix) YADIF_FN3(name, suffix)
+#define YADIF_FN(name) YADIF_FN2(name, YADIF_SUFFIX)
+
+/** @internal @This loads samples at an offset (in samples) of a pointer. */
+#define LD(p, off) (wide ? VLOAD16((p) + 2 * (off)) : VLOAD8((p) + (off)))
+
+/** @internal @This tries an edge direction for a vector of samples. */
+#define CHECK(j, guard)                                                     \
+    do {                                                                    \
+        YADIF_VEC s = VADD(VADD(                                            \
+            VABSD(LD(cur, mrefs - 1 + (j)), LD(cur, prefs - 1 - (j))),      \
+            VABSD(LD(cur, mrefs + (j)), LD(cur, prefs - (j)))),             \
+            VABSD(LD(cur, mrefs + 1 + (j)), LD(cur, prefs + 1 - (j))));     \
+        guard = VAND(VCMPGT(score, s), guard);                              \
+        score = VBLEND(guard, s, score);                                    \
+        pred = VBLEND(guard, VSRA1(VADD(LD(cur, mrefs + (j)),               \
+                                        LD(cur, prefs - (j)))), pred);      \
+    } while (0)
+
+#define VABSD(a, b) VMAX(VSUB(a, b), VSUB(b, a))
+
+/** @internal @This interpolates a vector of samples.
+ *
+ * @param prev first sample in the previous picture
+ * @param cur first sample in the current picture
+ * @param next first sample in the next picture
+ * @param prefs offset in samples of the line below
+ * @param mrefs offset in samples of the line above
+ * @param parity true if the interpolated field is temporally closer to the
+ * previous picture
+ * @param check true to apply the spatial interlacing check
+ * @param wide true for 16-bit samples
+ * @return interpolated samples
+ */
+static inline __attribute__((always_inline, target(YADIF_TARGET)))
+YADIF_VEC YADIF_FN(yadif_vector)(const uint8_t *prev, const uint8_t *cur,
+        const uint8_t *next, ptrdiff_t prefs, ptrdiff_t mrefs,
+        bool parity, bool check, bool wide)
+{
+    const uint8_t *prev2 = parity ? prev : cur;
+    const uint8_t *next2 = parity ? cur : next;
+    YADIF_VEC c = LD(cur, mrefs);
+    YADIF_VEC e = LD(cur, prefs);
+    YADIF_VEC p2 = LD(prev2, 0);
+    YADIF_VEC n2 = LD(next2, 0);
+    YADIF_VEC d = VSRA1(VADD(p2, n2));
+    YADIF_VEC temporal_diff1 = VSRA1(VADD(VABSD(LD(prev, mrefs), c),
+                                          VABSD(LD(prev, prefs), e)));
+    YADIF_VEC temporal_diff2 = VSRA1(VADD(VABSD(LD(next, mrefs), c),
+                                          VABSD(LD(next, prefs), e)));
+    YADIF_VEC diff = VMAX(VSRA1(VABSD(p2, n2)),
+                          VMAX(temporal_diff1, temporal_diff2));
+    YADIF_VEC pred = VSRA1(VADD(c, e));
+    YADIF_VEC score = VSUB(VADD(VADD(
+            VABSD(LD(cur, mrefs - 1), LD(cur, prefs - 1)), VABSD(c, e)),
+            VABSD(LD(cur, mrefs + 1), LD(cur, prefs + 1))), VSET1(1));
+    YADIF_VEC guard;
+
+    /* the second direction is only tried if the first one is better */
+    guard = VSET1(-1);
+    CHECK(-1, guard);
+    CHECK(-2, guard);
+    guard = VSET1(-1);
+    CHECK(1, guard);
+    CHECK(2, guard);
+
+    if (check) {
+        YADIF_VEC b = VSRA1(VADD(LD(prev2, 2 * mrefs), LD(next2, 2 * mrefs)));
+        YADIF_VEC f = VSRA1(VADD(LD(prev2, 2 * prefs), LD(next2, 2 * prefs)));
+        YADIF_VEC de = VSUB(d, e);
+        YADIF_VEC dc = VSUB(d, c);
+        YADIF_VEC max = VMAX(VMAX(de, dc), VMIN(VSUB(b, c), VSUB(f, e)));
+        YADIF_VEC min = VMIN(VMIN(de, dc), VMAX(VSUB(b, c), VSUB(f, e)));
+        diff = VMAX(VMAX(diff, min), VSUB(VSET1(0), max));
+    }
+
+    return VMAX(VMIN(pred, VADD(d, diff)), VSUB(d, diff));
+}
+
+/** @This interpolates a line of 8-bit samples with SIMD instructions.
+ *
+ * @param dst output line
+ * @param prev same line in the previous picture
+ * @param cur same line in the current picture
+ * @param next same line in the next picture
+ * @param w width in samples
+ * @param prefs offset in bytes of the line below
+ * @param mrefs offset in bytes of the line above
+ * @param parity true if the interpolated field is temporally closer to the
+ * previous picture
+ * @param check true to apply the spatial interlacing check
+ */
+__attribute__((target(YADIF_TARGET)))
+void YADIF_FN(upipe_filter_yadif_line8)(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check)
+{
+    ptrdiff_t x = w < 3 ? w : 3;
+    yadif_range8(dst, prev, cur, next, 0, x, w, prefs, mrefs, parity, check);
+    for ( ; x + YADIF_LANES + 3 <= w; x += YADIF_LANES)
+        VSTORE8(dst + x, YADIF_FN(yadif_vector)(prev + x, cur + x, next + x,
+                    prefs, mrefs, parity, check, false));
+    yadif_range8(dst, prev, cur, next, x, w, w, prefs, mrefs, parity, check);
+}
+
+/** @This interpolates a line of 16-bit samples with SIMD instructions.
+ *
+ * @param dst output line
+ * @param prev same line in the previous picture
+ * @param cur same line in the current picture
+ * @param next same line in the next picture
+ * @param w width in samples
+ * @param prefs offset in bytes of the line below
+ * @param mrefs offset in bytes of the line above
+ * @param parity true if the interpolated field is temporally closer to the
+ * previous picture
+ * @param check true to apply the spatial interlacing check
+ */
+__attribute__((target(YADIF_TARGET)))
+void YADIF_FN(upipe_filter_yadif_line16)(uint8_t *dst, const uint8_t *prev,
+        const uint8_t *cur, const uint8_t *next, ptrdiff_t w,
+        ptrdiff_t prefs, ptrdiff_t mrefs, bool parity, bool check)
+{
+    ptrdiff_t x = w < 3 ? w : 3;
+    prefs /= 2;
+    mrefs /= 2;
+    yadif_range16((uint16_t *)dst, (const uint16_t *)prev,
+                  (const uint16_t *)cur, (const uint16_t *)next, 0, x, w,
+                  prefs, mrefs, parity, check);
+    for ( ; x + YADIF_LANES + 3 <= w; x += YADIF_LANES)
+        VSTORE16(dst + 2 * x, YADIF_FN(yadif_vector)(prev + 2 * x,
+                    cur + 2 * x, next + 2 * x, prefs, mrefs, parity, check,
+                    true));
+    yadif_range16((uint16_t *)dst, (const uint16_t *)prev,
+                  (const uint16_t *)cur, (const uint16_t *)next, x, w, w,
+                  prefs, mrefs, parity, check);
+}
+
+#undef VABSD
+#undef CHECK
+#undef LD
+#undef YADIF_FN
+#undef YADIF_FN2
+#undef YADIF_FN3
+#undef YADIF_SUFFIX
+#undef YADIF_TARGET
+#undef YADIF_VEC
+#undef YADIF_LANES
+#undef VLOAD8
+#undef VLOAD16
+#undef VSTORE8
+#undef VSTORE16
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VMIN
+#undef VMAX
+#undef VSRA1
+#undef VCMPGT
+#undef VAND
+#undef VBLEND
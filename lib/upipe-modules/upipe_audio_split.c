@@ -53,6 +53,18 @@
 /** @hidden */
 static int upipe_audio_split_sub_check(struct upipe *upipe, struct uref *flow_format);
 
+/** @internal @This describes a mapped output plane. */
+struct upipe_audio_split_plane {
+    /** output uref */
+    struct uref *uref;
+    /** channel of the plane */
+    const char *channel;
+    /** mapped plane */
+    uint8_t *out;
+    /** index of the channel in the input */
+    uint8_t idx;
+};
+
 /** @internal @This is the private context of an audio_split pipe. */
 struct upipe_audio_split {
     /** real refcount management structure */
@@ -68,6 +80,15 @@ struct upipe_audio_split {
     /** manager to create output subpipes */
     struct upipe_mgr sub_mgr;
 
+    /** output planes mapped while processing a uref */
+    struct upipe_audio_split_plane *planes;
+    /** allocated size of the planes array */
+    size_t planes_size;
+    /** function extracting 16-bit channels */
+    upipe_audio_split_extract extract16;
+    /** function extracting 32-bit channels */
+    upipe_audio_split_extract extract32;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -109,6 +130,9 @@ struct upipe_audio_split_sub {
     /** ubuf manager request */
     struct urequest ubuf_mgr_request;
 
+    /** output uref being filled */
+    struct uref *uref_planar;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -151,6 +175,7 @@ static struct upipe *upipe_audio_split_sub_alloc(struct upipe_mgr *mgr,
                             upipe_audio_split_sub_from_upipe(upipe);
     upipe_audio_split_sub->flow_def_params = flow_def;
     upipe_audio_split_sub->flow_need_update = true;
+    upipe_audio_split_sub->uref_planar = NULL;
     upipe_audio_split_sub_init_urefcount(upipe);
     upipe_audio_split_sub_init_output(upipe);
     upipe_audio_split_sub_init_ubuf_mgr(upipe);
@@ -267,6 +292,16 @@ static struct upipe *upipe_audio_split_alloc(struct upipe_mgr *mgr,
     upipe_audio_split_init_sub_mgr(upipe);
     upipe_audio_split_init_sub_outputs(upipe);
     upipe_audio_split->flow_def = NULL;
+    upipe_audio_split->planes = NULL;
+    upipe_audio_split->planes_size = 0;
+    upipe_audio_split->extract16 = upipe_audio_split_extract16_c;
+    upipe_audio_split->extract32 = upipe_audio_split_extract32_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSE2)) {
+        upipe_audio_split->extract16 = upipe_audio_split_extract16_sse2;
+        upipe_audio_split->extract32 = upipe_audio_split_extract32_sse2;
+    }
+#endif
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -320,6 +355,110 @@ static int upipe_audio_split_sub_update_flow(struct upipe *upipe)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This allocates the output uref of a subpipe and maps its
+ * planes, recording them in the array of planes, and in the array of
+ * channels for the first plane wanting each channel.
+ *
+ * @param upipe description structure of the pipe
+ * @param split_sub output subpipe
+ * @param uref input uref
+ * @param samples number of samples
+ * @param channels number of input channels
+ * @param outs array of channels planes
+ * @param nb_planes_p number of mapped planes, incremented
+ * @return false in case of allocation error
+ */
+static bool upipe_audio_split_prepare(struct upipe *upipe,
+                                      struct upipe_audio_split_sub *split_sub,
+                                      struct uref *uref, size_t samples,
+                                      uint8_t channels, uint8_t **outs,
+                                      size_t *nb_planes_p)
+{
+    struct upipe_audio_split *upipe_audio_split =
+                              upipe_audio_split_from_upipe(upipe);
+    struct upipe *upipe_sub = upipe_audio_split_sub_to_upipe(split_sub);
+
+    if (unlikely(split_sub->flow_need_update)) {
+        upipe_audio_split_sub_update_flow(upipe_sub);
+    }
+    if (unlikely(split_sub->ubuf_mgr == NULL &&
+                 !upipe_audio_split_sub_demand_ubuf_mgr(upipe_sub,
+                                       uref_dup(split_sub->flow_def))))
+        return true;
+
+    /* dup uref, allocate new ubuf */
+    struct uref *uref_planar = uref_dup(uref);
+    if (unlikely(!uref_planar)) {
+        upipe_throw_error(upipe_sub, UBASE_ERR_ALLOC);
+        return false;
+    }
+    struct ubuf *ubuf_planar = ubuf_sound_alloc(split_sub->ubuf_mgr, samples);
+    if (unlikely(!ubuf_planar)) {
+        upipe_throw_error(upipe_sub, UBASE_ERR_ALLOC);
+        uref_free(uref_planar);
+        return false;
+    }
+    uref_attach_ubuf(uref_planar, ubuf_planar);
+    split_sub->uref_planar = uref_planar;
+
+    /* interate through output channels */
+    const char *channel = NULL;
+    while (ubase_check(uref_sound_plane_iterate(uref_planar, &channel))
+                                                             && channel) {
+        uint8_t idx = 0;
+        if (unlikely(!(ubase_check(uref_audio_split_get_orig_index(
+                               split_sub->flow_def_params, &idx, channel))
+                            && idx < channels))) {
+            continue;
+        }
+        upipe_verbose_va(upipe_sub, "chan %s idx %"PRIu8, channel, idx);
+
+        if (unlikely(*nb_planes_p >= upipe_audio_split->planes_size)) {
+            size_t planes_size = upipe_audio_split->planes_size * 2 + 8;
+            struct upipe_audio_split_plane *planes =
+                realloc(upipe_audio_split->planes,
+                        planes_size * sizeof(struct upipe_audio_split_plane));
+            if (unlikely(planes == NULL)) {
+                upipe_throw_error(upipe_sub, UBASE_ERR_ALLOC);
+                return false;
+            }
+            upipe_audio_split->planes = planes;
+            upipe_audio_split->planes_size = planes_size;
+        }
+
+        uint8_t *out;
+        if (unlikely(!ubase_check(uref_sound_plane_write_uint8_t(
+                            uref_planar, channel, 0, -1, &out)))) {
+            upipe_warn_va(upipe_sub, "could not map %s", channel);
+            continue;
+        }
+        struct upipe_audio_split_plane *plane =
+            &upipe_audio_split->planes[(*nb_planes_p)++];
+        plane->uref = uref_planar;
+        plane->channel = channel;
+        plane->out = out;
+        plane->idx = idx;
+        if (outs[idx] == NULL)
+            outs[idx] = out;
+    }
+    return true;
+}
+
+/** @internal @This unmaps the planes mapped by @ref upipe_audio_split_prepare.
+ *
+ * @param upipe description structure of the pipe
+ * @param nb_planes number of mapped planes
+ */
+static void upipe_audio_split_unmap(struct upipe *upipe, size_t nb_planes)
+{
+    struct upipe_audio_split *upipe_audio_split =
+                              upipe_audio_split_from_upipe(upipe);
+    for (size_t i = 0; i < nb_planes; i++) {
+        struct upipe_audio_split_plane *plane = &upipe_audio_split->planes[i];
+        uref_sound_plane_unmap(plane->uref, plane->channel, 0, -1);
+    }
+}
+
 /** @internal @This receives data.
  *
  * @param upipe description structure of the pipe
@@ -366,73 +505,60 @@ static void upipe_audio_split_input(struct upipe *upipe, struct uref *uref,
         return;
     }
 
-    /* interate through output subpipes */
+    /* prepare output urefs and map their planes */
+    uint8_t *outs[channels];
+    memset(outs, 0, sizeof(outs));
+    size_t nb_planes = 0;
     ulist_foreach (&upipe_audio_split->outputs, uchain) {
         struct upipe_audio_split_sub *split_sub =
             upipe_audio_split_sub_from_uchain(uchain);
-        struct upipe *upipe_sub = upipe_audio_split_sub_to_upipe(split_sub);
-        if (unlikely(split_sub->flow_need_update)) {
-            upipe_audio_split_sub_update_flow(upipe_sub);
-        }
-        if (unlikely(split_sub->ubuf_mgr == NULL &&
-                     !upipe_audio_split_sub_demand_ubuf_mgr(upipe_sub,
-                                           uref_dup(split_sub->flow_def))))
-            continue;
-
-        /* dup uref, allocate new ubuf */
-        struct uref *uref_planar = uref_dup(uref);
-        if (unlikely(!uref_planar)) {
-            upipe_throw_error(upipe_audio_split_sub_to_upipe(split_sub),
-                              UBASE_ERR_ALLOC);
+        if (unlikely(!upipe_audio_split_prepare(upipe, split_sub, uref,
+                                                samples, channels, outs,
+                                                &nb_planes)))
             goto err;
-        }
-        struct ubuf *ubuf_planar = ubuf_sound_alloc(split_sub->ubuf_mgr,
-                                                    samples);
-        if (unlikely(!ubuf_planar)) {
-            upipe_throw_error(upipe_audio_split_sub_to_upipe(split_sub),
-                              UBASE_ERR_ALLOC);
-            uref_free(uref_planar);
-            goto err;
-        }
-        uref_attach_ubuf(uref_planar, ubuf_planar);
-
-        /* interate through output channels */
-        const char *channel = NULL;
-        while (ubase_check(uref_sound_plane_iterate(uref_planar, &channel))
-                                                                 && channel) {
-            uint8_t idx = 0;
-            if (unlikely(!(ubase_check(uref_audio_split_get_orig_index(
-                                   split_sub->flow_def_params, &idx, channel))
-                                && idx < channels))) {
-                continue;
-            }
-            upipe_verbose_va(upipe_sub, "chan %s idx %"PRIu8, channel, idx);
-
-            /* planarize */
-            uint8_t *out;
-            if (unlikely(!ubase_check(uref_sound_plane_write_uint8_t(
-                                uref_planar, channel, 0, -1, &out)))) {
-                upipe_warn_va(upipe_sub, "could not map %s", channel);
-                continue;
-            }
-            const uint8_t *in = in_buf + idx * out_sample_size;
-            int i, j;
-            for (i=0; i < samples; i++) {
-                for (j=0; j < out_sample_size; j++) {
-                    out[j] = in[j];
-                }
-                in += sample_size;
-                out += out_sample_size;
-            }
-            uref_sound_plane_unmap(uref_planar, channel, 0, -1);
-        }
+    }
+
+    /* extract all channels in one pass */
+    if (out_sample_size == 2)
+        upipe_audio_split->extract16(outs, in_buf, samples, channels);
+    else if (out_sample_size == 4)
+        upipe_audio_split->extract32(outs, in_buf, samples, channels);
+    else
+        upipe_audio_split_extract_c(outs, in_buf, samples, channels,
+                                    out_sample_size);
+    uref_sound_unmap(uref, 0, -1, 1);
+    uref_free(uref);
 
-        /* send resulting planar uref */
+    /* channels wanted by several planes were extracted only once */
+    for (size_t i = 0; i < nb_planes; i++) {
+        struct upipe_audio_split_plane *plane = &upipe_audio_split->planes[i];
+        if (plane->out != outs[plane->idx])
+            memcpy(plane->out, outs[plane->idx], samples * out_sample_size);
+    }
+    upipe_audio_split_unmap(upipe, nb_planes);
+
+    /* send resulting planar urefs */
+    ulist_foreach (&upipe_audio_split->outputs, uchain) {
+        struct upipe_audio_split_sub *split_sub =
+            upipe_audio_split_sub_from_uchain(uchain);
+        struct uref *uref_planar = split_sub->uref_planar;
+        if (uref_planar == NULL)
+            continue;
+        split_sub->uref_planar = NULL;
         upipe_audio_split_sub_output(upipe_audio_split_sub_to_upipe(split_sub),
                                      uref_planar, upump_p);
     }
+    return;
 
 err:
+    /* output nothing rather than partially filled urefs */
+    upipe_audio_split_unmap(upipe, nb_planes);
+    ulist_foreach (&upipe_audio_split->outputs, uchain) {
+        struct upipe_audio_split_sub *split_sub =
+            upipe_audio_split_sub_from_uchain(uchain);
+        uref_free(split_sub->uref_planar);
+        split_sub->uref_planar = NULL;
+    }
     uref_sound_unmap(uref, 0, -1, 1);
     uref_free(uref);
 }
@@ -520,6 +646,7 @@ static void upipe_audio_split_free(struct urefcount *urefcount_real)
     upipe_audio_split_clean_sub_outputs(upipe);
     if (upipe_audio_split->flow_def != NULL)
         uref_free(upipe_audio_split->flow_def);
+    free(upipe_audio_split->planes);
     urefcount_clean(urefcount_real);
     upipe_audio_split_clean_urefcount(upipe);
     upipe_audio_split_free_void(upipe);
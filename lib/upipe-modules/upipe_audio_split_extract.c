@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short channel extraction functions of the audio_split pipe
+ *
+ * All channels are extracted in a single pass over the interleaved input,
+ * whatever the number of outputs. The SSE2 versions transpose blocks of
+ * 8x8 16-bit or 4x4 32-bit samples, or deinterleave stereo frames, and
+ * leave other layouts and the remaining samples to the C versions.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-modules/upipe_audio_split.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @internal @This extracts channels of interleaved samples, and is
+ * inlined so that the copy is specialized for constant sample sizes.
+ *
+ * @param outs array of channels planes, NULL for unused channels
+ * @param in interleaved samples
+ * @param samples number of samples per channel
+ * @param channels number of channels
+ * @param sample_size size of a sample of one channel in octets
+ */
+static inline void upipe_audio_split_extract_inline(uint8_t *const *outs,
+                                                    const uint8_t *in,
+                                                    size_t samples,
+                                                    uint8_t channels,
+                                                    uint8_t sample_size)
+{
+    for (size_t i = 0; i < samples; i++) {
+        for (uint8_t c = 0; c < channels; c++) {
+            if (outs[c] != NULL)
+                memcpy(outs[c] + i * sample_size, in, sample_size);
+            in += sample_size;
+        }
+    }
+}
+
+/** @This extracts channels of interleaved samples of any size.
+ *
+ * @param outs array of channels planes, NULL for unused channels
+ * @param in interleaved samples
+ * @param samples number of samples per channel
+ * @param channels number of channels
+ * @param sample_size size of a sample of one channel in octets
+ */
+void upipe_audio_split_extract_c(uint8_t *const *outs, const uint8_t *in,
+                                 size_t samples, uint8_t channels,
+                                 uint8_t sample_size)
+{
+    upipe_audio_split_extract_inline(outs, in, samples, channels,
+                                     sample_size);
+}
+
+/** @This extracts channels of 16-bit samples.
+ *
+ * @param outs array of channels planes, NULL for unused channels
+ * @param in interleaved samples
+ * @param samples number of samples per channel
+ * @param channels number of channels
+ */
+void upipe_audio_split_extract16_c(uint8_t *const *outs, const uint8_t *in,
+                                   size_t samples, uint8_t channels)
+{
+    upipe_audio_split_extract_inline(outs, in, samples, channels, 2);
+}
+
+/** @This extracts channels of 32-bit samples.
+ *
+ * @param outs array of channels planes, NULL for unused channels
+ * @param in interleaved samples
+ * @param samples number of samples per channel
+ * @param channels number of channels
+ */
+void upipe_audio_split_extract32_c(uint8_t *const *outs, const uint8_t *in,
+                                   size_t samples, uint8_t channels)
+{
+    upipe_audio_split_extract_inline(outs, in, samples, channels, 4);
+}
+
+#ifdef UCPU_X86
+/** @internal @This extracts the remaining samples with the C version.
+ *
+ * @param outs array of channels planes, NULL for unused channels
+ * @param in interleaved samples
+ * @param samples total number of samples per channel
+ * @param channels number of channels
+ * @param sample_size size of a sample of one channel in octets
+ * @param done number of samples already extracted
+ */
+static void upipe_audio_split_extract_tail(uint8_t *const *outs,
+                                           const uint8_t *in, size_t samples,
+                                           uint8_t channels,
+                                           uint8_t sample_size, size_t done)
+{
+    if (done == samples)
+        return;
+    uint8_t *tail[channels];
+    for (uint8_t c = 0; c < channels; c++)
+        tail[c] = outs[c] != NULL ? outs[c] + done * sample_size : NULL;
+    upipe_audio_split_extract_c(tail, in + done * channels * sample_size,
+                                samples - done, channels, sample_size);
+}
+
+/** @internal @This stores a register of samples of a channel, if used.
+ *
+ * @param out channel plane, or NULL
+ * @param offset offset in octets in the plane
+ * @param v samples to store
+ */
+__attribute__((target("sse2")))
+static inline void upipe_audio_split_store_sse2(uint8_t *out, size_t offset,
+                                                __m128i v)
+{
+    if (out != NULL)
+        _mm_storeu_si128((__m128i *)(out + offset), v);
+}
+
+/** @This extracts channels of 16-bit samples, using SSE2.
+ *
+ * @param outs array of channels planes, NULL for unused channels
+ * @param in interleaved samples
+ * @param samples number of samples per channel
+ * @param channels number of channels
+ */
+__attribute__((target("sse2")))
+void upipe_audio_split_extract16_sse2(uint8_t *const *outs,
+                                      const uint8_t *in, size_t samples,
+                                      uint8_t channels)
+{
+    size_t i = 0;
+    if (channels == 2) {
+        /* sign-extend both channels to 32 bits, and pack them back */
+        for ( ; i + 8 <= samples; i += 8) {
+            const __m128i *src = (const __m128i *)(in + i * 4);
+            __m128i v0 = _mm_loadu_si128(src);
+            __m128i v1 = _mm_loadu_si128(src + 1);
+            __m128i l = _mm_packs_epi32(
+                    _mm_srai_epi32(_mm_slli_epi32(v0, 16), 16),
+                    _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16));
+            __m128i r = _mm_packs_epi32(_mm_srai_epi32(v0, 16),
+                                        _mm_srai_epi32(v1, 16));
+            upipe_audio_split_store_sse2(outs[0], i * 2, l);
+            upipe_audio_split_store_sse2(outs[1], i * 2, r);
+        }
+    } else if (!(channels % 8)) {
+        size_t stride = channels * 2;
+        for ( ; i + 8 <= samples; i += 8) {
+            for (uint8_t c = 0; c < channels; c += 8) {
+                const uint8_t *src = in + i * stride + c * 2;
+                __m128i r0 = _mm_loadu_si128((const __m128i *)src);
+                __m128i r1 = _mm_loadu_si128((const __m128i *)(src + stride));
+                __m128i r2 = _mm_loadu_si128((const __m128i *)(src + 2 * stride));
+                __m128i r3 = _mm_loadu_si128((const __m128i *)(src + 3 * stride));
+                __m128i r4 = _mm_loadu_si128((const __m128i *)(src + 4 * stride));
+                __m128i r5 = _mm_loadu_si128((const __m128i *)(src + 5 * stride));
+                __m128i r6 = _mm_loadu_si128((const __m128i *)(src + 6 * stride));
+                __m128i r7 = _mm_loadu_si128((const __m128i *)(src + 7 * stride));
+
+                /* 8x8 transpose */
+                __m128i a0 = _mm_unpacklo_epi16(r0, r1);
+                __m128i a1 = _mm_unpacklo_epi16(r2, r3);
+                __m128i a2 = _mm_unpacklo_epi16(r4, r5);
+                __m128i a3 = _mm_unpacklo_epi16(r6, r7);
+                __m128i a4 = _mm_unpackhi_epi16(r0, r1);
+                __m128i a5 = _mm_unpackhi_epi16(r2, r3);
+                __m128i a6 = _mm_unpackhi_epi16(r4, r5);
+                __m128i a7 = _mm_unpackhi_epi16(r6, r7);
+                __m128i b0 = _mm_unpacklo_epi32(a0, a1);
+                __m128i b1 = _mm_unpacklo_epi32(a2, a3);
+                __m128i b2 = _mm_unpackhi_epi32(a0, a1);
+                __m128i b3 = _mm_unpackhi_epi32(a2, a3);
+                __m128i b4 = _mm_unpacklo_epi32(a4, a5);
+                __m128i b5 = _mm_unpacklo_epi32(a6, a7);
+                __m128i b6 = _mm_unpackhi_epi32(a4, a5);
+                __m128i b7 = _mm_unpackhi_epi32(a6, a7);
+
+                uint8_t *const *out = outs + c;
+                upipe_audio_split_store_sse2(out[0], i * 2,
+                                             _mm_unpacklo_epi64(b0, b1));
+                upipe_audio_split_store_sse2(out[1], i * 2,
+                                             _mm_unpackhi_epi64(b0, b1));
+                upipe_audio_split_store_sse2(out[2], i * 2,
+                                             _mm_unpacklo_epi64(b2, b3));
+                upipe_audio_split_store_sse2(out[3], i * 2,
+                                             _mm_unpackhi_epi64(b2, b3));
+                upipe_audio_split_store_sse2(out[4], i * 2,
+                                             _mm_unpacklo_epi64(b4, b5));
+                upipe_audio_split_store_sse2(out[5], i * 2,
+                                             _mm_unpackhi_epi64(b4, b5));
+                upipe_audio_split_store_sse2(out[6], i * 2,
+                                             _mm_unpacklo_epi64(b6, b7));
+                upipe_audio_split_store_sse2(out[7], i * 2,
+                                             _mm_unpackhi_epi64(b6, b7));
+            }
+        }
+    }
+    upipe_audio_split_extract_tail(outs, in, samples, channels, 2, i);
+}
+
+/** @This extracts channels of 32-bit samples, using SSE2.
+ *
+ * @param outs array of channels planes, NULL for unused channels
+ * @param in interleaved samples
+ * @param samples number of samples per channel
+ * @param channels number of channels
+ */
+__attribute__((target("sse2")))
+void upipe_audio_split_extract32_sse2(uint8_t *const *outs,
+                                      const uint8_t *in, size_t samples,
+                                      uint8_t channels)
+{
+    size_t i = 0;
+    if (channels == 2) {
+        for ( ; i + 4 <= samples; i += 4) {
+            const __m128i *src = (const __m128i *)(in + i * 8);
+            /* l0 l1 r0 r1 and l2 l3 r2 r3 */
+            __m128i v0 = _mm_shuffle_epi32(_mm_loadu_si128(src),
+                                           _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i v1 = _mm_shuffle_epi32(_mm_loadu_si128(src + 1),
+                                           _MM_SHUFFLE(3, 1, 2, 0));
+            upipe_audio_split_store_sse2(outs[0], i * 4,
+                                         _mm_unpacklo_epi64(v0, v1));
+            upipe_audio_split_store_sse2(outs[1], i * 4,
+                                         _mm_unpackhi_epi64(v0, v1));
+        }
+    } else if (!(channels % 4)) {
+        size_t stride = channels * 4;
+        for ( ; i + 4 <= samples; i += 4) {
+            for (uint8_t c = 0; c < channels; c += 4) {
+                const uint8_t *src = in + i * stride + c * 4;
+                __m128i r0 = _mm_loadu_si128((const __m128i *)src);
+                __m128i r1 = _mm_loadu_si128((const __m128i *)(src + stride));
+                __m128i r2 = _mm_loadu_si128((const __m128i *)(src + 2 * stride));
+                __m128i r3 = _mm_loadu_si128((const __m128i *)(src + 3 * stride));
+
+                /* 4x4 transpose */
+                __m128i a0 = _mm_unpacklo_epi32(r0, r1);
+                __m128i a1 = _mm_unpacklo_epi32(r2, r3);
+                __m128i a2 = _mm_unpackhi_epi32(r0, r1);
+                __m128i a3 = _mm_unpackhi_epi32(r2, r3);
+
+                uint8_t *const *out = outs + c;
+                upipe_audio_split_store_sse2(out[0], i * 4,
+                                             _mm_unpacklo_epi64(a0, a1));
+                upipe_audio_split_store_sse2(out[1], i * 4,
+                                             _mm_unpackhi_epi64(a0, a1));
+                upipe_audio_split_store_sse2(out[2], i * 4,
+                                             _mm_unpacklo_epi64(a2, a3));
+                upipe_audio_split_store_sse2(out[3], i * 4,
+                                             _mm_unpackhi_epi64(a2, a3));
+            }
+        }
+    }
+    upipe_audio_split_extract_tail(outs, in, samples, channels, 4, i);
+}
+#endif
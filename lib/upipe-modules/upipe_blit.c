@@ -50,6 +50,8 @@
 
 /** we only accept pictures */
 #define EXPECTED_FLOW_DEF "pic."
+/** maximum number of planes of a subpicture with an alpha plane */
+#define MAX_PLANES 8
 
 /** @internal @This is the private context of a blit pipe */
 struct upipe_blit {
@@ -83,6 +85,9 @@ struct upipe_blit {
     /** sample aspect ratio of the output picture */
     struct urational sar;
 
+    /** function blending lines of 8-bit samples */
+    upipe_blit_blend blend8;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -92,6 +97,40 @@ UPIPE_HELPER_UREFCOUNT(upipe_blit, urefcount, upipe_blit_free)
 UPIPE_HELPER_VOID(upipe_blit)
 UPIPE_HELPER_OUTPUT(upipe_blit, output, flow_def, output_state, request_list)
 
+/** @internal @This describes the non-transparent samples of a line of
+ * a subpicture. */
+struct upipe_blit_span {
+    /** first non-transparent sample */
+    size_t start;
+    /** sample following the last non-transparent sample */
+    size_t end;
+    /** true if all samples between start and end are opaque */
+    bool opaque;
+};
+
+/** @internal @This is the result of the alpha analysis of a plane of a
+ * subpicture. */
+struct upipe_blit_plane {
+    /** chroma type */
+    const char *chroma;
+    /** horizontal subsampling */
+    uint8_t hsub;
+    /** vertical subsampling */
+    uint8_t vsub;
+    /** number of samples per line */
+    size_t width;
+    /** number of lines */
+    size_t height;
+    /** alpha values at the resolution of the plane */
+    uint8_t *alpha;
+    /** non-transparent samples of each line */
+    struct upipe_blit_span *spans;
+    /** first line with non-transparent samples */
+    size_t first;
+    /** line following the last line with non-transparent samples */
+    size_t last;
+};
+
 /** @internal @This is the private context of an input of a blit pipe. */
 struct upipe_blit_sub {
     /** refcount management structure */
@@ -110,6 +149,14 @@ struct upipe_blit_sub {
 
     /** last received ubuf */
     struct ubuf *ubuf;
+    /** true if the last received ubuf is blitted into every frame */
+    bool cache;
+    /** true if the alpha plane of the ubuf was analysed for blending */
+    bool blend;
+    /** alpha analysis of the planes of the ubuf */
+    struct upipe_blit_plane planes[MAX_PLANES];
+    /** number of analysed planes */
+    uint8_t nb_planes;
 
     /** horizontal size */
     uint64_t hsize;
@@ -155,6 +202,9 @@ static struct upipe *upipe_blit_sub_alloc(struct upipe_mgr *mgr,
     upipe_blit_sub_init_sub(upipe);
     sub->loffset = sub->roffset = sub->toffset = sub->boffset = 0;
     sub->ubuf = NULL;
+    sub->cache = false;
+    sub->blend = false;
+    sub->nb_planes = 0;
     sub->hsize = sub->vsize = sub->hposition = sub->vposition = UINT64_MAX;
     ulist_init(&sub->flow_format_requests);
 
@@ -162,6 +212,196 @@ static struct upipe *upipe_blit_sub_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
+/** @internal @This releases the last received ubuf and its alpha analysis.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_blit_sub_flush(struct upipe *upipe)
+{
+    struct upipe_blit_sub *sub = upipe_blit_sub_from_upipe(upipe);
+    for (uint8_t i = 0; i < sub->nb_planes; i++) {
+        free(sub->planes[i].alpha);
+        free(sub->planes[i].spans);
+    }
+    sub->nb_planes = 0;
+    sub->blend = false;
+    ubuf_free(sub->ubuf);
+    sub->ubuf = NULL;
+}
+
+/** @internal @This analyses the alpha plane of a subpicture, if any, and
+ * computes for each plane the alpha values at the resolution of the plane
+ * and the non-transparent samples of each line.
+ *
+ * @param upipe description structure of the pipe
+ * @param ubuf subpicture
+ * @param alpha_buffer alpha plane of the subpicture
+ * @return an error code
+ */
+static int upipe_blit_sub_analyse(struct upipe *upipe, struct ubuf *ubuf,
+                                  const uint8_t *alpha_buffer)
+{
+    struct upipe_blit_sub *sub = upipe_blit_sub_from_upipe(upipe);
+    size_t hsize, vsize, alpha_stride;
+    uint8_t hsub, vsub, macropixel_size;
+    UBASE_RETURN(ubuf_pic_size(ubuf, &hsize, &vsize, NULL))
+    UBASE_RETURN(ubuf_pic_plane_size(ubuf, "a8", &alpha_stride,
+                                     &hsub, &vsub, &macropixel_size))
+    if (unlikely(hsub != 1 || vsub != 1 || macropixel_size != 1))
+        return UBASE_ERR_INVALID;
+
+    const char *chroma = NULL;
+    while (ubase_check(ubuf_pic_plane_iterate(ubuf, &chroma)) &&
+           chroma != NULL) {
+        UBASE_RETURN(ubuf_pic_plane_size(ubuf, chroma, NULL,
+                                         &hsub, &vsub, &macropixel_size))
+        if (unlikely(macropixel_size != 1 || sub->nb_planes >= MAX_PLANES))
+            return UBASE_ERR_INVALID;
+
+        struct upipe_blit_plane *plane = &sub->planes[sub->nb_planes];
+        plane->chroma = chroma;
+        plane->hsub = hsub;
+        plane->vsub = vsub;
+        plane->width = hsize / hsub;
+        plane->height = vsize / vsub;
+        plane->alpha = malloc(plane->width * plane->height);
+        plane->spans = malloc(plane->height * sizeof(struct upipe_blit_span));
+        sub->nb_planes++;
+        UBASE_ALLOC_RETURN(plane->alpha)
+        UBASE_ALLOC_RETURN(plane->spans)
+
+        plane->first = plane->height;
+        plane->last = 0;
+        unsigned int samples = hsub * vsub;
+        for (size_t y = 0; y < plane->height; y++) {
+            uint8_t *a = plane->alpha + y * plane->width;
+            const uint8_t *in = alpha_buffer + y * vsub * alpha_stride;
+            for (size_t x = 0; x < plane->width; x++) {
+                unsigned int sum = 0;
+                for (uint8_t j = 0; j < vsub; j++)
+                    for (uint8_t i = 0; i < hsub; i++)
+                        sum += in[j * alpha_stride + x * hsub + i];
+                a[x] = (sum + samples / 2) / samples;
+            }
+
+            struct upipe_blit_span *span = &plane->spans[y];
+            span->start = 0;
+            span->end = plane->width;
+            while (span->start < span->end && !a[span->start])
+                span->start++;
+            while (span->end > span->start && !a[span->end - 1])
+                span->end--;
+            span->opaque = true;
+            for (size_t x = span->start; x < span->end; x++)
+                if (a[x] != UINT8_MAX) {
+                    span->opaque = false;
+                    break;
+                }
+
+            if (span->start < span->end) {
+                if (plane->first > y)
+                    plane->first = y;
+                plane->last = y + 1;
+            }
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This composites the alpha plane of the subpicture into the
+ * alpha plane of the frame.
+ *
+ * @param dest dest line
+ * @param alpha alpha line of the subpicture
+ * @param width number of samples
+ */
+static void upipe_blit_sub_over8(uint8_t *dest, const uint8_t *alpha,
+                                 size_t width)
+{
+    for ( ; width > 0; width--) {
+        unsigned int a = *alpha++;
+        unsigned int t = *dest * (255 - a) + 128;
+        *dest++ = a + ((t + (t >> 8)) >> 8);
+    }
+}
+
+/** @internal @This blends the analysed subpicture into a frame, only
+ * touching the lines and samples which are not transparent.
+ *
+ * @param upipe description structure of the pipe
+ * @param ubuf frame
+ * @return an error code
+ */
+static int upipe_blit_sub_blend(struct upipe *upipe, struct ubuf *ubuf)
+{
+    struct upipe_blit_sub *sub = upipe_blit_sub_from_upipe(upipe);
+    struct upipe_blit *upipe_blit = upipe_blit_from_sub_mgr(upipe->mgr);
+
+    for (uint8_t i = 0; i < sub->nb_planes; i++) {
+        struct upipe_blit_plane *plane = &sub->planes[i];
+        if (plane->first >= plane->last)
+            continue;
+
+        size_t dest_stride, src_stride;
+        uint8_t hsub, vsub, macropixel_size;
+        if (!ubase_check(ubuf_pic_plane_size(ubuf, plane->chroma,
+                        &dest_stride, &hsub, &vsub, &macropixel_size))) {
+            /* the alpha plane is only composited into frames having one */
+            if (!strcmp(plane->chroma, "a8"))
+                continue;
+            return UBASE_ERR_INVALID;
+        }
+        if (unlikely(hsub != plane->hsub || vsub != plane->vsub ||
+                     macropixel_size != 1))
+            return UBASE_ERR_INVALID;
+        UBASE_RETURN(ubuf_pic_plane_size(sub->ubuf, plane->chroma,
+                        &src_stride, NULL, NULL, NULL))
+
+        int voffset = plane->first * vsub;
+        int vsize = (plane->last - plane->first) * vsub;
+        uint8_t *dest_buffer;
+        const uint8_t *src_buffer;
+        UBASE_RETURN(ubuf_pic_plane_write(ubuf, plane->chroma,
+                    sub->hposition, sub->vposition + voffset,
+                    sub->hsize, vsize, &dest_buffer))
+        int err = ubuf_pic_plane_read(sub->ubuf, plane->chroma,
+                                      0, voffset, -1, vsize, &src_buffer);
+        if (unlikely(!ubase_check(err))) {
+            ubuf_pic_plane_unmap(ubuf, plane->chroma,
+                                 sub->hposition, sub->vposition + voffset,
+                                 sub->hsize, vsize);
+            return err;
+        }
+
+        bool alpha = !strcmp(plane->chroma, "a8");
+        for (size_t y = plane->first; y < plane->last; y++) {
+            const struct upipe_blit_span *span = &plane->spans[y];
+            size_t start = span->start;
+            size_t width = span->end - start;
+            uint8_t *dest = dest_buffer + start;
+            const uint8_t *src = src_buffer + start;
+            const uint8_t *a = plane->alpha + y * plane->width + start;
+            dest_buffer += dest_stride;
+            src_buffer += src_stride;
+            if (!width)
+                continue;
+
+            if (alpha)
+                upipe_blit_sub_over8(dest, a, width);
+            else if (span->opaque)
+                memcpy(dest, src, width);
+            else
+                upipe_blit->blend8(dest, src, a, width);
+        }
+
+        ubuf_pic_plane_unmap(sub->ubuf, plane->chroma, 0, voffset, -1, vsize);
+        UBASE_RETURN(ubuf_pic_plane_unmap(ubuf, plane->chroma,
+                    sub->hposition, sub->vposition + voffset,
+                    sub->hsize, vsize))
+    }
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This blits the subpicture into the input uref.
 *
 * @param upipe description structure of the pipe
@@ -173,14 +413,18 @@ static void upipe_blit_sub_work(struct upipe *upipe, struct uref *uref)
     if (unlikely(sub->ubuf == NULL))
         return;
 
-    int err = uref_pic_blit(uref, sub->ubuf, sub->hposition, sub->vposition,
+    int err;
+    if (sub->blend)
+        err = upipe_blit_sub_blend(upipe, uref->ubuf);
+    else
+        err = uref_pic_blit(uref, sub->ubuf, sub->hposition, sub->vposition,
                             0, 0, sub->hsize, sub->vsize);
     if (unlikely(!ubase_check(err))) {
         upipe_warn(upipe, "unable to blit picture");
         upipe_throw_error(upipe, err);
     }
-    ubuf_free(sub->ubuf);
-    sub->ubuf = NULL;
+    if (!sub->cache)
+        upipe_blit_sub_flush(upipe);
 }
 
 /** @internal @This receives data.
@@ -216,9 +460,67 @@ static void upipe_blit_sub_input(struct upipe *upipe, struct uref *uref,
         return;
     }
 
-    ubuf_free(sub->ubuf);
-    sub->ubuf = uref_detach_ubuf(uref);
+    struct ubuf *ubuf = uref_detach_ubuf(uref);
     uref_free(uref);
+
+    const uint8_t *alpha_buffer = NULL;
+    if (macropixel != 1 ||
+        !ubase_check(ubuf_pic_plane_read(ubuf, "a8", 0, 0, -1, -1,
+                                         &alpha_buffer)))
+        alpha_buffer = NULL;
+
+    if (sub->blend && alpha_buffer != NULL) {
+        /* both pictures are mapped, so equal addresses mean they share the
+         * alpha plane, which cannot have been written to while shared: the
+         * analysis is still valid */
+        const uint8_t *cached_buffer;
+        bool same = false;
+        if (ubase_check(ubuf_pic_plane_read(sub->ubuf, "a8", 0, 0, -1, -1,
+                                            &cached_buffer))) {
+            same = cached_buffer == alpha_buffer;
+            ubuf_pic_plane_unmap(sub->ubuf, "a8", 0, 0, -1, -1);
+        }
+        if (same) {
+            ubuf_pic_plane_unmap(ubuf, "a8", 0, 0, -1, -1);
+            ubuf_free(sub->ubuf);
+            sub->ubuf = ubuf;
+            return;
+        }
+    }
+
+    upipe_blit_sub_flush(upipe);
+    sub->ubuf = ubuf;
+    if (alpha_buffer == NULL)
+        return;
+
+    int err = upipe_blit_sub_analyse(upipe, ubuf, alpha_buffer);
+    ubuf_pic_plane_unmap(ubuf, "a8", 0, 0, -1, -1);
+    if (unlikely(!ubase_check(err))) {
+        upipe_warn(upipe, "dropping subpicture with invalid alpha plane");
+        upipe_throw_error(upipe, err);
+        upipe_blit_sub_flush(upipe);
+        return;
+    }
+    sub->blend = true;
+}
+
+/** @internal @This checks if a flow definition has a full-resolution alpha
+ * plane.
+ *
+ * @param flow_def flow definition packet
+ * @return true if there is an alpha plane
+ */
+static bool upipe_blit_sub_check_alpha(struct uref *flow_def)
+{
+    uint8_t plane = 0, hsub = 0, vsub = 0, macropixel_size = 0;
+    return ubase_check(uref_pic_flow_find_chroma(flow_def, "a8", &plane)) &&
+           ubase_check(uref_pic_flow_get_hsubsampling(flow_def, &hsub,
+                                                      plane)) &&
+           ubase_check(uref_pic_flow_get_vsubsampling(flow_def, &vsub,
+                                                      plane)) &&
+           ubase_check(uref_pic_flow_get_macropixel_size(flow_def,
+                   &macropixel_size, plane)) &&
+           hsub == 1 && vsub == 1 && macropixel_size == 1;
 }
 
 /** @internal @This provides a flow format suggestion.
@@ -328,6 +630,13 @@ static int upipe_blit_sub_provide_flow_format(struct upipe *upipe)
         uref_pic_flow_set_vsize(uref, sub->vsize);
         uref_pic_flow_clear_format(uref);
         uref_pic_flow_copy_format(uref, upipe_blit->flow_def);
+        /* keep the alpha plane, which is blended into the frame */
+        uint8_t alpha_plane = 0;
+        if (upipe_blit->macropixel == 1 &&
+            upipe_blit_sub_check_alpha(urequest->uref) &&
+            !ubase_check(uref_pic_flow_find_chroma(uref, "a8",
+                                                   &alpha_plane)))
+            uref_pic_flow_add_plane(uref, 1, 1, 1, "a8");
         uref_pic_flow_delete_sar(uref);
         uref_pic_flow_delete_overscan(uref);
         uref_pic_flow_delete_dar(uref);
@@ -405,13 +714,11 @@ static int upipe_blit_sub_free_flow_format_provider(struct upipe *upipe,
 static int upipe_blit_sub_set_flow_def(struct upipe *upipe,
                                        struct uref *flow_def)
 {
-    struct upipe_blit_sub *sub = upipe_blit_sub_from_upipe(upipe);
     if (flow_def == NULL)
         return UBASE_ERR_INVALID;
     UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
 
-    ubuf_free(sub->ubuf);
-    sub->ubuf = NULL;
+    upipe_blit_sub_flush(upipe);
 
     return UBASE_ERR_NONE;
 }
@@ -460,6 +767,32 @@ static int _upipe_blit_sub_set_rect(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This gets the cache mode of the subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param cache_p filled in with true if the cache mode is enabled
+ * @return an error code
+ */
+static int _upipe_blit_sub_get_cache(struct upipe *upipe, bool *cache_p)
+{
+    struct upipe_blit_sub *sub = upipe_blit_sub_from_upipe(upipe);
+    *cache_p = sub->cache;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the cache mode of the subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param cache true to blit the last subpicture into every frame
+ * @return an error code
+ */
+static int _upipe_blit_sub_set_cache(struct upipe *upipe, bool cache)
+{
+    struct upipe_blit_sub *sub = upipe_blit_sub_from_upipe(upipe);
+    sub->cache = cache;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a subpipe of a blit
 * pipe.
 *
@@ -519,6 +852,16 @@ static int upipe_blit_sub_control(struct upipe *upipe,
             return _upipe_blit_sub_set_rect(upipe,
                     loffset, roffset, toffset, boffset);
         }
+        case UPIPE_BLIT_SUB_GET_CACHE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_BLIT_SUB_SIGNATURE);
+            bool *cache_p = va_arg(args, bool *);
+            return _upipe_blit_sub_get_cache(upipe, cache_p);
+        }
+        case UPIPE_BLIT_SUB_SET_CACHE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_BLIT_SUB_SIGNATURE);
+            bool cache = va_arg(args, int);
+            return _upipe_blit_sub_set_cache(upipe, cache);
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -531,9 +874,8 @@ static int upipe_blit_sub_control(struct upipe *upipe,
 */
 static void upipe_blit_sub_free(struct upipe *upipe)
 {
-    struct upipe_blit_sub *sub = upipe_blit_sub_from_upipe(upipe);
     upipe_throw_dead(upipe);
-    ubuf_free(sub->ubuf);
+    upipe_blit_sub_flush(upipe);
     upipe_blit_sub_clean_sub(upipe);
     upipe_blit_sub_clean_urefcount(upipe);
     upipe_blit_sub_free_void(upipe);
@@ -577,6 +919,15 @@ static struct upipe *upipe_blit_alloc(struct upipe_mgr *mgr,
     upipe_blit_init_sub_mgr(upipe);
     upipe_blit_init_sub_subs(upipe);
 
+    struct upipe_blit *upipe_blit = upipe_blit_from_upipe(upipe);
+    upipe_blit->blend8 = upipe_blit_blend8_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_AVX2))
+        upipe_blit->blend8 = upipe_blit_blend8_avx2;
+    else if (ucpu_has(UCPU_SSE2))
+        upipe_blit->blend8 = upipe_blit_blend8_sse2;
+#endif
+
     upipe_throw_ready(upipe);
     return upipe;
 }
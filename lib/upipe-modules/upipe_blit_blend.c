@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short alpha blending functions of the blit pipe
+ *
+ * All versions compute (src * alpha + dest * (255 - alpha)) / 255, rounded
+ * to nearest with the usual (t + (t >> 8)) >> 8 trick, so that they give
+ * the same output.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-modules/upipe_blit.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @This blends a line of 8-bit samples into another.
+ *
+ * @param dest dest line
+ * @param src source line
+ * @param alpha alpha line, at the resolution of the source line
+ * @param width number of samples
+ */
+void upipe_blit_blend8_c(uint8_t *dest, const uint8_t *src,
+                         const uint8_t *alpha, size_t width)
+{
+    for ( ; width > 0; width--) {
+        unsigned int a = *alpha++;
+        unsigned int t = *src++ * a + *dest * (255 - a) + 128;
+        *dest++ = (t + (t >> 8)) >> 8;
+    }
+}
+
+#ifdef UCPU_X86
+/** @This blends a line of 8-bit samples into another, using SSE2.
+ *
+ * @param dest dest line
+ * @param src source line
+ * @param alpha alpha line, at the resolution of the source line
+ * @param width number of samples
+ */
+__attribute__((target("sse2")))
+void upipe_blit_blend8_sse2(uint8_t *dest, const uint8_t *src,
+                            const uint8_t *alpha, size_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(128);
+    for ( ; width >= 16; width -= 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)src);
+        __m128i d = _mm_loadu_si128((const __m128i *)dest);
+        __m128i a = _mm_loadu_si128((const __m128i *)alpha);
+
+        __m128i al = _mm_unpacklo_epi8(a, zero);
+        __m128i ah = _mm_unpackhi_epi8(a, zero);
+        __m128i tl = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), al),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero),
+                                _mm_sub_epi16(max, al)));
+        __m128i th = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), ah),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero),
+                                _mm_sub_epi16(max, ah)));
+        tl = _mm_add_epi16(tl, half);
+        th = _mm_add_epi16(th, half);
+        tl = _mm_srli_epi16(_mm_add_epi16(tl, _mm_srli_epi16(tl, 8)), 8);
+        th = _mm_srli_epi16(_mm_add_epi16(th, _mm_srli_epi16(th, 8)), 8);
+        _mm_storeu_si128((__m128i *)dest, _mm_packus_epi16(tl, th));
+
+        dest += 16;
+        src += 16;
+        alpha += 16;
+    }
+    upipe_blit_blend8_c(dest, src, alpha, width);
+}
+
+/** @This blends a line of 8-bit samples into another, using AVX2.
+ *
+ * @param dest dest line
+ * @param src source line
+ * @param alpha alpha line, at the resolution of the source line
+ * @param width number of samples
+ */
+__attribute__((target("avx2")))
+void upipe_blit_blend8_avx2(uint8_t *dest, const uint8_t *src,
+                            const uint8_t *alpha, size_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi16(255);
+    const __m256i half = _mm256_set1_epi16(128);
+    for ( ; width >= 32; width -= 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)src);
+        __m256i d = _mm256_loadu_si256((const __m256i *)dest);
+        __m256i a = _mm256_loadu_si256((const __m256i *)alpha);
+
+        /* unpack and pack both work within 128-bit lanes, so the order of
+         * the samples is preserved */
+        __m256i al = _mm256_unpacklo_epi8(a, zero);
+        __m256i ah = _mm256_unpackhi_epi8(a, zero);
+        __m256i tl = _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), al),
+                _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero),
+                                   _mm256_sub_epi16(max, al)));
+        __m256i th = _mm256_add_epi16(
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), ah),
+                _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero),
+                                   _mm256_sub_epi16(max, ah)));
+        tl = _mm256_add_epi16(tl, half);
+        th = _mm256_add_epi16(th, half);
+        tl = _mm256_srli_epi16(_mm256_add_epi16(tl, _mm256_srli_epi16(tl, 8)),
+                               8);
+        th = _mm256_srli_epi16(_mm256_add_epi16(th, _mm256_srli_epi16(th, 8)),
+                               8);
+        _mm256_storeu_si256((__m256i *)dest, _mm256_packus_epi16(tl, th));
+
+        dest += 32;
+        src += 32;
+        alpha += 32;
+    }
+    upipe_blit_blend8_sse2(dest, src, alpha, width);
+}
+#endif
@@ -48,7 +48,6 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
-#include <arpa/inet.h>
 
 #define EXPECTED_FLOW_DEF "block."
 
@@ -66,6 +65,11 @@ struct upipe_htons {
     /** list of output requests */
     struct uchain request_list;
 
+    /** size of words in octets */
+    unsigned int word_size;
+    /** function swapping the bytes of words */
+    upipe_htons_swap swap;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -75,6 +79,71 @@ UPIPE_HELPER_UREFCOUNT(upipe_htons, urefcount, upipe_htons_free)
 UPIPE_HELPER_VOID(upipe_htons);
 UPIPE_HELPER_OUTPUT(upipe_htons, output, flow_def, output_state, request_list);
 
+/** @internal @This selects the fastest function swapping words of the
+ * given size.
+ *
+ * @param word_size size of words in octets
+ * @return pointer to the function
+ */
+static upipe_htons_swap upipe_htons_select_swap(unsigned int word_size)
+{
+    switch (word_size) {
+        case 2:
+#ifdef UCPU_X86
+            if (ucpu_has(UCPU_AVX2))
+                return upipe_htons_swap16_avx2;
+            if (ucpu_has(UCPU_SSSE3))
+                return upipe_htons_swap16_ssse3;
+#endif
+            return upipe_htons_swap16_c;
+        case 3:
+#ifdef UCPU_X86
+            if (ucpu_has(UCPU_AVX2))
+                return upipe_htons_swap24_avx2;
+            if (ucpu_has(UCPU_SSSE3))
+                return upipe_htons_swap24_ssse3;
+#endif
+            return upipe_htons_swap24_c;
+        case 4:
+#ifdef UCPU_X86
+            if (ucpu_has(UCPU_AVX2))
+                return upipe_htons_swap32_avx2;
+            if (ucpu_has(UCPU_SSSE3))
+                return upipe_htons_swap32_ssse3;
+#endif
+            return upipe_htons_swap32_c;
+        default:
+            return NULL;
+    }
+}
+
+/** @internal @This checks that a block may be swapped in place, that is
+ * that it is not shared and that no word straddles two segments.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param size size of the block
+ * @return true if the block may be swapped in place
+ */
+static bool upipe_htons_check_block(struct upipe *upipe, struct uref *uref,
+                                    size_t size)
+{
+    struct upipe_htons *upipe_htons = upipe_htons_from_upipe(upipe);
+    int offset = 0;
+    while (size > 0) {
+        int bufsize = -1;
+        uint8_t *buf;
+        if (!ubase_check(uref_block_write(uref, offset, &bufsize, &buf)))
+            return false;
+        uref_block_unmap(uref, offset);
+        if ((size_t)bufsize < size && bufsize % upipe_htons->word_size)
+            return false;
+        offset += bufsize;
+        size -= bufsize;
+    }
+    return true;
+}
+
 /** @internal @This handles input.
  *
  * @param upipe description structure of the pipe
@@ -84,21 +153,26 @@ UPIPE_HELPER_OUTPUT(upipe_htons, output, flow_def, output_state, request_list);
 static void upipe_htons_input(struct upipe *upipe, struct uref *uref,
                               struct upump **upump_p)
 {
+    struct upipe_htons *upipe_htons = upipe_htons_from_upipe(upipe);
     struct ubuf *ubuf;
     size_t size = 0;
-    int remain, bufsize = -1, offset = 0;
+    int bufsize = -1, offset = 0;
     uint8_t *buf = NULL;
 
+#ifdef UPIPE_WORDS_BIGENDIAN
+    /* words are already in network byte order */
+    upipe_htons_output(upipe, uref, upump_p);
+    return;
+#endif
+
     /* block size */
     if (unlikely(!ubase_check(uref_block_size(uref, &size)))) {
         upipe_warn(upipe, "could not read uref block size");
         uref_free(uref);
         return;
     }
-    /* copy ubuf if shared or not 16b-unaligned or segmented */
-    bufsize = -1;
-    if (!ubase_check(uref_block_write(uref, 0, &bufsize, &buf)) ||
-        ((uintptr_t)buf & 1) || bufsize != size) {
+    /* copy ubuf if shared or segmented in the middle of a word */
+    if (!upipe_htons_check_block(upipe, uref, size)) {
         ubuf = ubuf_block_copy(uref->ubuf->mgr, uref->ubuf, 0, size);
         if (unlikely(!ubuf)) {
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
@@ -106,8 +180,6 @@ static void upipe_htons_input(struct upipe *upipe, struct uref *uref,
             return;
         }
         uref_attach_ubuf(uref, ubuf);
-    } else {
-        uref_block_unmap(uref, 0);
     }
 
     /* process ubuf chunks */
@@ -119,13 +191,7 @@ static void upipe_htons_input(struct upipe *upipe, struct uref *uref,
             uref_free(uref);
             return;
         }
-        if (unlikely((uintptr_t)buf & 1)) {
-            upipe_warn_va(upipe, "unaligned buffer: %p", buf);
-        }
-        for (remain = bufsize; remain > 1; remain -= 2) {
-            *(uint16_t *)buf = htons(*(uint16_t *)buf);
-            buf += 2;
-        }
+        upipe_htons->swap(buf, bufsize / upipe_htons->word_size);
 
         uref_block_unmap(uref, offset);
         offset += bufsize;
@@ -153,6 +219,26 @@ static int upipe_htons_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the size of the words to convert.
+ *
+ * @param upipe description structure of the pipe
+ * @param word_size size of words in octets
+ * @return an error code
+ */
+static int _upipe_htons_set_word_size(struct upipe *upipe,
+                                      unsigned int word_size)
+{
+    struct upipe_htons *upipe_htons = upipe_htons_from_upipe(upipe);
+    upipe_htons_swap swap = upipe_htons_select_swap(word_size);
+    if (unlikely(swap == NULL)) {
+        upipe_err_va(upipe, "unsupported word size %u", word_size);
+        return UBASE_ERR_INVALID;
+    }
+    upipe_htons->word_size = word_size;
+    upipe_htons->swap = swap;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a skip pipe.
  *
  * @param upipe description structure of the pipe
@@ -188,6 +274,18 @@ static int upipe_htons_control(struct upipe *upipe, int command, va_list args)
             return upipe_htons_set_output(upipe, output);
         }
 
+        case UPIPE_HTONS_SET_WORD_SIZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTONS_SIGNATURE)
+            unsigned int word_size = va_arg(args, unsigned int);
+            return _upipe_htons_set_word_size(upipe, word_size);
+        }
+        case UPIPE_HTONS_GET_WORD_SIZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTONS_SIGNATURE)
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = upipe_htons_from_upipe(upipe)->word_size;
+            return UBASE_ERR_NONE;
+        }
+
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -212,6 +310,10 @@ static struct upipe *upipe_htons_alloc(struct upipe_mgr *mgr,
     upipe_htons_init_urefcount(upipe);
     upipe_htons_init_output(upipe);
 
+    struct upipe_htons *upipe_htons = upipe_htons_from_upipe(upipe);
+    upipe_htons->word_size = 2;
+    upipe_htons->swap = upipe_htons_select_swap(upipe_htons->word_size);
+
     upipe_throw_ready(upipe);
     return upipe;
 }
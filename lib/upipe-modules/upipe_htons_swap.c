@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short byte swapping functions of the htons pipe
+ *
+ * The vectorized versions reverse the bytes of whole registers with pshufb,
+ * and leave the remaining words to the lower version.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-modules/upipe_htons.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @This reverses the bytes of 16-bit words.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+void upipe_htons_swap16_c(uint8_t *buf, size_t words)
+{
+    for ( ; words > 0; words--) {
+        uint8_t t = buf[0];
+        buf[0] = buf[1];
+        buf[1] = t;
+        buf += 2;
+    }
+}
+
+/** @This reverses the bytes of 24-bit words.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+void upipe_htons_swap24_c(uint8_t *buf, size_t words)
+{
+    for ( ; words > 0; words--) {
+        uint8_t t = buf[0];
+        buf[0] = buf[2];
+        buf[2] = t;
+        buf += 3;
+    }
+}
+
+/** @This reverses the bytes of 32-bit words.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+void upipe_htons_swap32_c(uint8_t *buf, size_t words)
+{
+    for ( ; words > 0; words--) {
+        uint8_t t = buf[0];
+        buf[0] = buf[3];
+        buf[3] = t;
+        t = buf[1];
+        buf[1] = buf[2];
+        buf[2] = t;
+        buf += 4;
+    }
+}
+
+#ifdef UCPU_X86
+/** @This reverses the bytes of 16-bit words, using SSSE3.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+__attribute__((target("ssse3")))
+void upipe_htons_swap16_ssse3(uint8_t *buf, size_t words)
+{
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                       9, 8, 11, 10, 13, 12, 15, 14);
+    for ( ; words >= 8; words -= 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)buf);
+        _mm_storeu_si128((__m128i *)buf, _mm_shuffle_epi8(v, mask));
+        buf += 16;
+    }
+    upipe_htons_swap16_c(buf, words);
+}
+
+/** @This reverses the bytes of 24-bit words, using SSSE3. Each register
+ * holds five words, and its last byte is stored back unchanged.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+__attribute__((target("ssse3")))
+void upipe_htons_swap24_ssse3(uint8_t *buf, size_t words)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7,
+                                       6, 11, 10, 9, 14, 13, 12, 15);
+    /* the 16-byte load must not go past the last word */
+    for ( ; words >= 6; words -= 5) {
+        __m128i v = _mm_loadu_si128((const __m128i *)buf);
+        _mm_storeu_si128((__m128i *)buf, _mm_shuffle_epi8(v, mask));
+        buf += 15;
+    }
+    upipe_htons_swap24_c(buf, words);
+}
+
+/** @This reverses the bytes of 32-bit words, using SSSE3.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+__attribute__((target("ssse3")))
+void upipe_htons_swap32_ssse3(uint8_t *buf, size_t words)
+{
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                       11, 10, 9, 8, 15, 14, 13, 12);
+    for ( ; words >= 4; words -= 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)buf);
+        _mm_storeu_si128((__m128i *)buf, _mm_shuffle_epi8(v, mask));
+        buf += 16;
+    }
+    upipe_htons_swap32_c(buf, words);
+}
+
+/** @This reverses the bytes of 16-bit words, using AVX2.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+__attribute__((target("avx2")))
+void upipe_htons_swap16_avx2(uint8_t *buf, size_t words)
+{
+    const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                          9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6,
+                                          9, 8, 11, 10, 13, 12, 15, 14);
+    for ( ; words >= 16; words -= 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+        _mm256_storeu_si256((__m256i *)buf, _mm256_shuffle_epi8(v, mask));
+        buf += 32;
+    }
+    upipe_htons_swap16_ssse3(buf, words);
+}
+
+/** @This reverses the bytes of 24-bit words, using AVX2. As pshufb does
+ * not cross lanes, each lane is loaded separately with five words, and the
+ * high lane is stored last so that it overwrites the unchanged last byte of
+ * the low lane.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+__attribute__((target("avx2")))
+void upipe_htons_swap24_avx2(uint8_t *buf, size_t words)
+{
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7,
+                                          6, 11, 10, 9, 14, 13, 12, 15,
+                                          2, 1, 0, 5, 4, 3, 8, 7,
+                                          6, 11, 10, 9, 14, 13, 12, 15);
+    /* the second 16-byte load must not go past the last word */
+    for ( ; words >= 11; words -= 10) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i *)buf)),
+                _mm_loadu_si128((const __m128i *)(buf + 15)), 1);
+        v = _mm256_shuffle_epi8(v, mask);
+        _mm_storeu_si128((__m128i *)buf, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(buf + 15),
+                         _mm256_extracti128_si256(v, 1));
+        buf += 30;
+    }
+    upipe_htons_swap24_ssse3(buf, words);
+}
+
+/** @This reverses the bytes of 32-bit words, using AVX2.
+ *
+ * @param buf buffer of words, without alignment constraint
+ * @param words number of words
+ */
+__attribute__((target("avx2")))
+void upipe_htons_swap32_avx2(uint8_t *buf, size_t words)
+{
+    const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                          11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4,
+                                          11, 10, 9, 8, 15, 14, 13, 12);
+    for ( ; words >= 8; words -= 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+        _mm256_storeu_si256((__m256i *)buf, _mm256_shuffle_epi8(v, mask));
+        buf += 32;
+    }
+    upipe_htons_swap32_ssse3(buf, words);
+}
+#endif
@@ -0,0 +1,907 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module recovering lost RTP packets with SMPTE 2022-1 FEC
+ *
+ * Media packets are kept in a ring indexed by sequence number, and FEC
+ * packets in a small preallocated array. Whenever exactly one media packet
+ * covered by a FEC packet is missing, it is rebuilt by XORing the payload
+ * of the FEC packet with the payloads of the other media packets.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_flow.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe-modules/upipe_rtp_fec.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+/** we only accept blocks containing RTP packets */
+#define EXPECTED_FLOW_DEF "block."
+/** number of sequence numbers in the window (power of 2) */
+#define WINDOW_SIZE 1024
+/** number of FEC packets kept for later recovery */
+#define FEC_SLOTS 64
+/** size of the FEC header following the RTP header */
+#define FEC_HEADER_SIZE 16
+/** maximum size of a RTP payload (multiple of 8) */
+#define MAX_PAYLOAD_SIZE 2048
+/** number of consecutive packets behind the window before resyncing */
+#define MAX_OUT_OF_WINDOW 16
+
+/** @internal @This is the state of a slot of the window. */
+enum upipe_rtp_fec_state {
+    /** slot was never used */
+    SLOT_NONE,
+    /** packet is received and waits to be output */
+    SLOT_PENDING,
+    /** packet was output, and is kept for recovery */
+    SLOT_OUTPUT,
+    /** packet was declared lost */
+    SLOT_SKIPPED
+};
+
+/** @internal @This is a slot of the window, for one sequence number. */
+struct upipe_rtp_fec_slot {
+    /** packet, pending or kept for recovery */
+    struct uref *uref;
+    /** sequence number */
+    uint16_t seqnum;
+    /** state of the slot */
+    enum upipe_rtp_fec_state state;
+};
+
+/** @internal @This is a FEC packet waiting for recovery. */
+struct upipe_rtp_fec_packet {
+    /** FEC packet, or NULL if the entry is free */
+    struct uref *uref;
+    /** first sequence number protected by the packet */
+    uint16_t snbase;
+    /** distance between protected sequence numbers */
+    uint8_t offset;
+    /** number of protected media packets */
+    uint8_t na;
+    /** XOR of the payload lengths */
+    uint16_t length_rec;
+    /** XOR of the payload types */
+    uint8_t pt_rec;
+    /** XOR of the timestamps */
+    uint32_t ts_rec;
+};
+
+/** @internal @This is the private context of a rtp_fec pipe. */
+struct upipe_rtp_fec {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** list of FEC subpipes */
+    struct uchain inputs;
+    /** manager to create FEC subpipes */
+    struct upipe_mgr input_mgr;
+
+    /** number of columns of the FEC matrix (L) */
+    unsigned int columns;
+    /** number of rows of the FEC matrix (D) */
+    unsigned int rows;
+    /** number of packets a gap is kept open for recovery */
+    unsigned int depth;
+    /** true if the next sequence number is known */
+    bool synced;
+    /** next sequence number to output */
+    uint16_t next_seqnum;
+    /** highest sequence number received */
+    uint16_t max_seqnum;
+    /** number of pending packets */
+    unsigned int nb_pending;
+    /** number of consecutive packets behind the window */
+    unsigned int out_of_window;
+    /** counters */
+    struct upipe_rtp_fec_counters counters;
+    /** function XORing payloads */
+    upipe_rtp_fec_xor xor_words;
+    /** window of sequence numbers */
+    struct upipe_rtp_fec_slot slots[WINDOW_SIZE];
+    /** FEC packets waiting for recovery */
+    struct upipe_rtp_fec_packet fecs[FEC_SLOTS];
+    /** buffer where the lost payload is rebuilt */
+    uint64_t recovery[MAX_PAYLOAD_SIZE / sizeof(uint64_t)];
+    /** buffer where media payloads are copied */
+    uint64_t scratch[MAX_PAYLOAD_SIZE / sizeof(uint64_t)];
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtp_fec, upipe, UPIPE_RTP_FEC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtp_fec, urefcount, upipe_rtp_fec_free)
+UPIPE_HELPER_VOID(upipe_rtp_fec)
+UPIPE_HELPER_OUTPUT(upipe_rtp_fec, output, flow_def, output_state,
+                    request_list)
+
+/** @internal @This is the private context of a FEC input of a rtp_fec
+ * pipe. */
+struct upipe_rtp_fec_input {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtp_fec_input, upipe, UPIPE_RTP_FEC_INPUT_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtp_fec_input, urefcount,
+                       upipe_rtp_fec_input_free)
+UPIPE_HELPER_VOID(upipe_rtp_fec_input)
+
+UPIPE_HELPER_SUBPIPE(upipe_rtp_fec, upipe_rtp_fec_input, input,
+                     input_mgr, inputs, uchain)
+
+/** @internal @This returns the signed distance between two sequence
+ * numbers.
+ *
+ * @param seqnum sequence number
+ * @param ref reference sequence number
+ * @return seqnum - ref, between -32768 and 32767
+ */
+static inline int upipe_rtp_fec_diff(uint16_t seqnum, uint16_t ref)
+{
+    return (int16_t)(uint16_t)(seqnum - ref);
+}
+
+/** @internal @This returns the slot of a sequence number.
+ *
+ * @param upipe description structure of the pipe
+ * @param seqnum sequence number
+ * @return pointer to the slot
+ */
+static inline struct upipe_rtp_fec_slot *
+    upipe_rtp_fec_slot(struct upipe *upipe, uint16_t seqnum)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    return &upipe_rtp_fec->slots[seqnum & (WINDOW_SIZE - 1)];
+}
+
+/** @internal @This stores a media packet in the window.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref media packet
+ * @param seqnum sequence number of the packet
+ */
+static void upipe_rtp_fec_store(struct upipe *upipe, struct uref *uref,
+                                uint16_t seqnum)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    struct upipe_rtp_fec_slot *slot = upipe_rtp_fec_slot(upipe, seqnum);
+    uref_free(slot->uref);
+    slot->uref = uref;
+    slot->seqnum = seqnum;
+    slot->state = SLOT_PENDING;
+    upipe_rtp_fec->nb_pending++;
+    if (upipe_rtp_fec_diff(seqnum, upipe_rtp_fec->max_seqnum) > 0)
+        upipe_rtp_fec->max_seqnum = seqnum;
+}
+
+/** @internal @This outputs or skips the slot of the next sequence number,
+ * and moves to the following sequence number.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_fec_advance(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    uint16_t seqnum = upipe_rtp_fec->next_seqnum++;
+    struct upipe_rtp_fec_slot *slot = upipe_rtp_fec_slot(upipe, seqnum);
+
+    if (slot->seqnum == seqnum && slot->state == SLOT_PENDING) {
+        /* keep a reference for the recovery of the other packets */
+        struct uref *uref = uref_dup(slot->uref);
+        if (unlikely(uref == NULL)) {
+            uref = slot->uref;
+            slot->uref = NULL;
+        }
+        slot->state = SLOT_OUTPUT;
+        upipe_rtp_fec->nb_pending--;
+        upipe_rtp_fec_output(upipe, uref, upump_p);
+        return;
+    }
+
+    upipe_verbose_va(upipe, "lost RTP packet %"PRIu16, seqnum);
+    uref_free(slot->uref);
+    slot->uref = NULL;
+    slot->seqnum = seqnum;
+    slot->state = SLOT_SKIPPED;
+    upipe_rtp_fec->counters.lost++;
+}
+
+/** @internal @This outputs the contiguous packets, and skips the gaps which
+ * can no longer be recovered.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_fec_work(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    while (upipe_rtp_fec->nb_pending) {
+        uint16_t seqnum = upipe_rtp_fec->next_seqnum;
+        struct upipe_rtp_fec_slot *slot = upipe_rtp_fec_slot(upipe, seqnum);
+        if ((slot->seqnum != seqnum || slot->state != SLOT_PENDING) &&
+            upipe_rtp_fec_diff(upipe_rtp_fec->max_seqnum, seqnum) <
+                (int)upipe_rtp_fec->depth)
+            break;
+        upipe_rtp_fec_advance(upipe, upump_p);
+    }
+}
+
+/** @internal @This outputs all pending packets, skipping the gaps.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_fec_flush(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    while (upipe_rtp_fec->nb_pending)
+        upipe_rtp_fec_advance(upipe, upump_p);
+}
+
+/** @internal @This rebuilds a missing media packet from a FEC packet and
+ * the other media packets it protects.
+ *
+ * @param upipe description structure of the pipe
+ * @param fec FEC packet
+ * @param missing sequence number of the missing packet
+ * @return an error code
+ */
+static int upipe_rtp_fec_recover(struct upipe *upipe,
+                                 struct upipe_rtp_fec_packet *fec,
+                                 uint16_t missing)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    size_t fec_size;
+    UBASE_RETURN(uref_block_size(fec->uref, &fec_size))
+    size_t payload_size = fec_size - RTP_HEADER_SIZE - FEC_HEADER_SIZE;
+    size_t words = (payload_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    uint8_t *recovery = (uint8_t *)upipe_rtp_fec->recovery;
+    uint8_t *scratch = (uint8_t *)upipe_rtp_fec->scratch;
+
+    memset(recovery + payload_size, 0,
+           words * sizeof(uint64_t) - payload_size);
+    UBASE_RETURN(uref_block_extract(fec->uref,
+                                    RTP_HEADER_SIZE + FEC_HEADER_SIZE,
+                                    payload_size, recovery))
+    uint16_t length = fec->length_rec;
+    uint8_t pt = fec->pt_rec;
+    uint32_t timestamp = fec->ts_rec;
+    uint8_t ssrc[4] = { 0, 0, 0, 0 };
+
+    for (unsigned int i = 0; i < fec->na; i++) {
+        uint16_t seqnum = fec->snbase + i * fec->offset;
+        if (seqnum == missing)
+            continue;
+        struct uref *uref = upipe_rtp_fec_slot(upipe, seqnum)->uref;
+
+        uint8_t rtp_buffer[RTP_HEADER_SIZE];
+        const uint8_t *rtp_header = uref_block_peek(uref, 0, RTP_HEADER_SIZE,
+                                                    rtp_buffer);
+        if (unlikely(rtp_header == NULL))
+            return UBASE_ERR_INVALID;
+        pt ^= rtp_get_type(rtp_header);
+        timestamp ^= rtp_get_timestamp(rtp_header);
+        rtp_get_ssrc(rtp_header, ssrc);
+        uref_block_peek_unmap(uref, 0, rtp_buffer, rtp_header);
+
+        size_t size;
+        UBASE_RETURN(uref_block_size(uref, &size))
+        size -= RTP_HEADER_SIZE;
+        if (unlikely(size > payload_size))
+            return UBASE_ERR_INVALID;
+        length ^= size;
+        size_t size_words = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        memset(scratch + size, 0, size_words * sizeof(uint64_t) - size);
+        UBASE_RETURN(uref_block_extract(uref, RTP_HEADER_SIZE, size,
+                                        scratch))
+        upipe_rtp_fec->xor_words(upipe_rtp_fec->recovery,
+                                 upipe_rtp_fec->scratch, size_words);
+    }
+    if (unlikely(length > payload_size))
+        return UBASE_ERR_INVALID;
+
+    struct ubuf *ubuf = ubuf_block_alloc(fec->uref->ubuf->mgr,
+                                         RTP_HEADER_SIZE + length);
+    UBASE_ALLOC_RETURN(ubuf);
+    uint8_t *buffer;
+    int size = -1;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer)))) {
+        ubuf_free(ubuf);
+        return UBASE_ERR_ALLOC;
+    }
+    memset(buffer, 0, RTP_HEADER_SIZE);
+    rtp_set_hdr(buffer);
+    rtp_set_type(buffer, pt);
+    rtp_set_seqnum(buffer, missing);
+    rtp_set_timestamp(buffer, timestamp);
+    rtp_set_ssrc(buffer, ssrc);
+    memcpy(buffer + RTP_HEADER_SIZE, recovery, length);
+    ubuf_block_unmap(ubuf, 0);
+
+    struct uref *uref = uref_dup_inner(fec->uref);
+    if (unlikely(uref == NULL)) {
+        ubuf_free(ubuf);
+        return UBASE_ERR_ALLOC;
+    }
+    uref_attach_ubuf(uref, ubuf);
+    upipe_verbose_va(upipe, "recovered RTP packet %"PRIu16, missing);
+    upipe_rtp_fec_store(upipe, uref, missing);
+    upipe_rtp_fec->counters.recovered++;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This tries to use a FEC packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param fec FEC packet
+ * @param recovered_p set to true if a packet was recovered
+ * @return false if the FEC packet must be kept for later
+ */
+static bool upipe_rtp_fec_try(struct upipe *upipe,
+                              struct upipe_rtp_fec_packet *fec,
+                              bool *recovered_p)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    unsigned int nb_missing = 0;
+    uint16_t missing = 0;
+
+    for (unsigned int i = 0; i < fec->na; i++) {
+        uint16_t seqnum = fec->snbase + i * fec->offset;
+        int diff = upipe_rtp_fec_diff(seqnum, upipe_rtp_fec->next_seqnum);
+        if (diff >= WINDOW_SIZE)
+            return true;
+        struct upipe_rtp_fec_slot *slot = upipe_rtp_fec_slot(upipe, seqnum);
+        if (slot->seqnum == seqnum && slot->uref != NULL)
+            continue;
+        /* a missing packet which was already skipped cannot be rebuilt,
+         * nor can any other packet of this FEC packet */
+        if (diff < 0)
+            return true;
+        nb_missing++;
+        missing = seqnum;
+    }
+
+    if (nb_missing != 1)
+        return !nb_missing;
+    if (!ubase_check(upipe_rtp_fec_recover(upipe, fec, missing)))
+        upipe_warn_va(upipe, "unable to recover RTP packet %"PRIu16,
+                      missing);
+    else
+        *recovered_p = true;
+    return true;
+}
+
+/** @internal @This recovers all the packets that can be, and outputs the
+ * packets that are ready.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_fec_process(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    bool recovered = true;
+    while (recovered) {
+        /* a recovered packet may complete another FEC packet */
+        recovered = false;
+        for (unsigned int i = 0; i < FEC_SLOTS; i++) {
+            struct upipe_rtp_fec_packet *fec = &upipe_rtp_fec->fecs[i];
+            if (fec->uref != NULL &&
+                upipe_rtp_fec_try(upipe, fec, &recovered)) {
+                uref_free(fec->uref);
+                fec->uref = NULL;
+            }
+        }
+    }
+    upipe_rtp_fec_work(upipe, upump_p);
+}
+
+/** @internal @This allocates a FEC subpipe of a rtp_fec pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtp_fec_input_alloc(struct upipe_mgr *mgr,
+                                               struct uprobe *uprobe,
+                                               uint32_t signature,
+                                               va_list args)
+{
+    struct upipe *upipe = upipe_rtp_fec_input_alloc_void(mgr, uprobe,
+                                                         signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    upipe_rtp_fec_input_init_urefcount(upipe);
+    upipe_rtp_fec_input_init_sub(upipe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This receives a FEC packet.
+ *
+ * @param upipe description structure of the subpipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_fec_input_input(struct upipe *upipe, struct uref *uref,
+                                      struct upump **upump_p)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec =
+        upipe_rtp_fec_from_input_mgr(upipe->mgr);
+    struct upipe *super = upipe_rtp_fec_to_upipe(upipe_rtp_fec);
+
+    size_t size;
+    uint8_t buffer[RTP_HEADER_SIZE + FEC_HEADER_SIZE];
+    const uint8_t *rtp_header;
+    if (unlikely(!ubase_check(uref_block_size(uref, &size)) ||
+                 size <= RTP_HEADER_SIZE + FEC_HEADER_SIZE ||
+                 size > RTP_HEADER_SIZE + FEC_HEADER_SIZE + MAX_PAYLOAD_SIZE ||
+                 (rtp_header = uref_block_peek(uref, 0,
+                        RTP_HEADER_SIZE + FEC_HEADER_SIZE, buffer)) == NULL)) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return;
+    }
+
+    const uint8_t *fec_header = rtp_header + RTP_HEADER_SIZE;
+    struct upipe_rtp_fec_packet fec;
+    fec.uref = uref;
+    fec.snbase = (fec_header[0] << 8) | fec_header[1];
+    fec.length_rec = (fec_header[2] << 8) | fec_header[3];
+    fec.pt_rec = fec_header[4] & 0x7f;
+    fec.ts_rec = ((uint32_t)fec_header[8] << 24) | (fec_header[9] << 16) |
+                 (fec_header[10] << 8) | fec_header[11];
+    fec.offset = fec_header[13];
+    fec.na = fec_header[14];
+    /* we only support XOR (type 0) without the extended header (N), and
+     * plain RTP headers on the FEC stream */
+    bool valid = rtp_check_hdr(rtp_header) && !rtp_get_cc(rtp_header) &&
+                 !rtp_check_extension(rtp_header) &&
+                 (fec_header[4] & 0x80) && !(fec_header[12] & 0x80) &&
+                 !(fec_header[12] & 0x38) && fec.offset && fec.na &&
+                 fec.offset * (fec.na - 1) < WINDOW_SIZE / 2;
+    bool row = fec_header[12] & 0x40;
+    uref_block_peek_unmap(uref, 0, buffer, rtp_header);
+    if (unlikely(!valid || (row && fec.offset != 1))) {
+        upipe_warn(upipe, "invalid or unsupported FEC packet");
+        uref_free(uref);
+        return;
+    }
+    upipe_rtp_fec->counters.fec_packets++;
+
+    /* the matrix size is only announced by the FEC packets */
+    unsigned int depth;
+    if (row) {
+        upipe_rtp_fec->columns = fec.na;
+        depth = 2 * fec.na;
+    } else {
+        upipe_rtp_fec->columns = fec.offset;
+        upipe_rtp_fec->rows = fec.na;
+        depth = 2 * fec.offset * fec.na;
+    }
+    if (depth > WINDOW_SIZE / 2)
+        depth = WINDOW_SIZE / 2;
+    if (depth > upipe_rtp_fec->depth)
+        upipe_rtp_fec->depth = depth;
+
+    if (unlikely(!upipe_rtp_fec->synced)) {
+        uref_free(uref);
+        return;
+    }
+
+    /* replace the free entry, or the oldest FEC packet */
+    struct upipe_rtp_fec_packet *entry = NULL;
+    for (unsigned int i = 0; i < FEC_SLOTS; i++) {
+        struct upipe_rtp_fec_packet *fec_i = &upipe_rtp_fec->fecs[i];
+        if (fec_i->uref == NULL) {
+            entry = fec_i;
+            break;
+        }
+        if (entry == NULL ||
+            upipe_rtp_fec_diff(fec_i->snbase, entry->snbase) < 0)
+            entry = fec_i;
+    }
+    uref_free(entry->uref);
+    *entry = fec;
+    upipe_rtp_fec_process(super, upump_p);
+}
+
+/** @internal @This receives the flow definition of a FEC stream.
+ *
+ * @param upipe description structure of the subpipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_rtp_fec_input_set_flow_def(struct upipe *upipe,
+                                            struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    return uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF);
+}
+
+/** @internal @This processes control commands on a FEC subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtp_fec_input_control(struct upipe *upipe,
+                                       int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            struct upipe_rtp_fec *upipe_rtp_fec =
+                upipe_rtp_fec_from_input_mgr(upipe->mgr);
+            return upipe_rtp_fec_alloc_output_proxy(
+                    upipe_rtp_fec_to_upipe(upipe_rtp_fec), request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            struct upipe_rtp_fec *upipe_rtp_fec =
+                upipe_rtp_fec_from_input_mgr(upipe->mgr);
+            return upipe_rtp_fec_free_output_proxy(
+                    upipe_rtp_fec_to_upipe(upipe_rtp_fec), request);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_rtp_fec_input_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtp_fec_input_get_super(upipe, p);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a FEC subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ */
+static void upipe_rtp_fec_input_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_rtp_fec_input_clean_sub(upipe);
+    upipe_rtp_fec_input_clean_urefcount(upipe);
+    upipe_rtp_fec_input_free_void(upipe);
+}
+
+/** @internal @This initializes the FEC input manager for a rtp_fec pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_fec_init_input_mgr(struct upipe *upipe)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    struct upipe_mgr *input_mgr = &upipe_rtp_fec->input_mgr;
+    input_mgr->refcount = upipe_rtp_fec_to_urefcount(upipe_rtp_fec);
+    input_mgr->signature = UPIPE_RTP_FEC_INPUT_SIGNATURE;
+    input_mgr->upipe_event_str = NULL;
+    input_mgr->upipe_command_str = NULL;
+    input_mgr->upipe_alloc = upipe_rtp_fec_input_alloc;
+    input_mgr->upipe_input = upipe_rtp_fec_input_input;
+    input_mgr->upipe_control = upipe_rtp_fec_input_control;
+    input_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a rtp_fec pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtp_fec_alloc(struct upipe_mgr *mgr,
+                                         struct uprobe *uprobe,
+                                         uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_rtp_fec_alloc_void(mgr, uprobe, signature,
+                                                   args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    upipe_rtp_fec_init_urefcount(upipe);
+    upipe_rtp_fec_init_output(upipe);
+    upipe_rtp_fec_init_input_mgr(upipe);
+    upipe_rtp_fec_init_sub_inputs(upipe);
+    upipe_rtp_fec->columns = 0;
+    upipe_rtp_fec->rows = 0;
+    upipe_rtp_fec->depth = 0;
+    upipe_rtp_fec->synced = false;
+    upipe_rtp_fec->next_seqnum = 0;
+    upipe_rtp_fec->max_seqnum = 0;
+    upipe_rtp_fec->nb_pending = 0;
+    upipe_rtp_fec->out_of_window = 0;
+    memset(&upipe_rtp_fec->counters, 0, sizeof(upipe_rtp_fec->counters));
+    upipe_rtp_fec->xor_words = upipe_rtp_fec_xor_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_AVX2))
+        upipe_rtp_fec->xor_words = upipe_rtp_fec_xor_avx2;
+    else if (ucpu_has(UCPU_SSE2))
+        upipe_rtp_fec->xor_words = upipe_rtp_fec_xor_sse2;
+#endif
+    for (unsigned int i = 0; i < WINDOW_SIZE; i++) {
+        upipe_rtp_fec->slots[i].uref = NULL;
+        upipe_rtp_fec->slots[i].state = SLOT_NONE;
+    }
+    for (unsigned int i = 0; i < FEC_SLOTS; i++)
+        upipe_rtp_fec->fecs[i].uref = NULL;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This receives a media packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_fec_input(struct upipe *upipe, struct uref *uref,
+                                struct upump **upump_p)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+
+    size_t size;
+    uint8_t rtp_buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp_header;
+    if (unlikely(!ubase_check(uref_block_size(uref, &size)) ||
+                 size > RTP_HEADER_SIZE + MAX_PAYLOAD_SIZE ||
+                 (rtp_header = uref_block_peek(uref, 0, RTP_HEADER_SIZE,
+                                               rtp_buffer)) == NULL)) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return;
+    }
+    bool valid = rtp_check_hdr(rtp_header);
+    uint16_t seqnum = rtp_get_seqnum(rtp_header);
+    uref_block_peek_unmap(uref, 0, rtp_buffer, rtp_header);
+    if (unlikely(!valid)) {
+        upipe_warn(upipe, "invalid RTP header");
+        uref_free(uref);
+        return;
+    }
+
+    upipe_rtp_fec->counters.packets++;
+    if (unlikely(!upipe_rtp_fec->synced)) {
+        upipe_rtp_fec->next_seqnum = seqnum;
+        upipe_rtp_fec->max_seqnum = seqnum;
+        upipe_rtp_fec->synced = true;
+    }
+
+    int diff = upipe_rtp_fec_diff(seqnum, upipe_rtp_fec->next_seqnum);
+    if (diff <= -WINDOW_SIZE || diff >= WINDOW_SIZE) {
+        if (++upipe_rtp_fec->out_of_window >= MAX_OUT_OF_WINDOW ||
+            diff >= WINDOW_SIZE) {
+            upipe_warn_va(upipe, "resyncing on RTP packet %"PRIu16, seqnum);
+            upipe_rtp_fec_flush(upipe, upump_p);
+            upipe_rtp_fec->next_seqnum = seqnum;
+            upipe_rtp_fec->max_seqnum = seqnum;
+            upipe_rtp_fec->out_of_window = 0;
+            diff = 0;
+        } else {
+            upipe_rtp_fec->counters.late++;
+            uref_free(uref);
+            return;
+        }
+    } else
+        upipe_rtp_fec->out_of_window = 0;
+
+    struct upipe_rtp_fec_slot *slot = upipe_rtp_fec_slot(upipe, seqnum);
+    if (diff < 0 || (slot->seqnum == seqnum && slot->state == SLOT_PENDING)) {
+        if (diff < 0 && slot->seqnum == seqnum &&
+            slot->state == SLOT_SKIPPED)
+            upipe_rtp_fec->counters.late++;
+        else
+            upipe_rtp_fec->counters.duplicates++;
+        uref_free(uref);
+        return;
+    }
+
+    upipe_rtp_fec_store(upipe, uref, seqnum);
+    if (diff)
+        /* there is a gap, which may now be recovered */
+        upipe_rtp_fec_process(upipe, upump_p);
+    else
+        upipe_rtp_fec_work(upipe, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_rtp_fec_set_flow_def(struct upipe *upipe,
+                                      struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    upipe_rtp_fec_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a rtp_fec pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtp_fec_control(struct upipe *upipe,
+                                 int command, va_list args)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_rtp_fec_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_rtp_fec_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_rtp_fec_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_rtp_fec_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtp_fec_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_rtp_fec_set_output(upipe, output);
+        }
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_rtp_fec_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtp_fec_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_RTP_FEC_GET_COUNTERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_FEC_SIGNATURE)
+            *va_arg(args, struct upipe_rtp_fec_counters *) =
+                upipe_rtp_fec->counters;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_FEC_GET_MATRIX: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_FEC_SIGNATURE)
+            *va_arg(args, unsigned int *) = upipe_rtp_fec->columns;
+            *va_arg(args, unsigned int *) = upipe_rtp_fec->rows;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_fec_free(struct upipe *upipe)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+    upipe_dbg_va(upipe, "%"PRIu64" packets, %"PRIu64" FEC packets, %"PRIu64
+                 " recovered, %"PRIu64" lost, %"PRIu64" late, %"PRIu64
+                 " duplicates", upipe_rtp_fec->counters.packets,
+                 upipe_rtp_fec->counters.fec_packets,
+                 upipe_rtp_fec->counters.recovered,
+                 upipe_rtp_fec->counters.lost,
+                 upipe_rtp_fec->counters.late,
+                 upipe_rtp_fec->counters.duplicates);
+    upipe_throw_dead(upipe);
+
+    for (unsigned int i = 0; i < WINDOW_SIZE; i++)
+        uref_free(upipe_rtp_fec->slots[i].uref);
+    for (unsigned int i = 0; i < FEC_SLOTS; i++)
+        uref_free(upipe_rtp_fec->fecs[i].uref);
+    upipe_rtp_fec_clean_sub_inputs(upipe);
+    upipe_rtp_fec_clean_output(upipe);
+    upipe_rtp_fec_clean_urefcount(upipe);
+    upipe_rtp_fec_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_rtp_fec_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_RTP_FEC_SIGNATURE,
+
+    .upipe_alloc = upipe_rtp_fec_alloc,
+    .upipe_input = upipe_rtp_fec_input,
+    .upipe_control = upipe_rtp_fec_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all rtp_fec pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtp_fec_mgr_alloc(void)
+{
+    return &upipe_rtp_fec_mgr;
+}
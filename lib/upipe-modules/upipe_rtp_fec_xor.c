@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short XOR functions of the rtp_fec pipe
+ *
+ * The vectorized versions XOR whole registers, without alignment
+ * constraint, and leave the remaining words to the C version.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-modules/upipe_rtp_fec.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @This XORs a buffer into another, one word at a time.
+ *
+ * @param dst destination buffer
+ * @param src source buffer
+ * @param words number of 64-bit words
+ */
+void upipe_rtp_fec_xor_c(uint64_t *restrict dst, const uint64_t *restrict src,
+                         size_t words)
+{
+    for (size_t i = 0; i < words; i++)
+        dst[i] ^= src[i];
+}
+
+#ifdef UCPU_X86
+/** @This XORs a buffer into another, using SSE2.
+ *
+ * @param dst destination buffer
+ * @param src source buffer
+ * @param words number of 64-bit words
+ */
+__attribute__((target("sse2")))
+void upipe_rtp_fec_xor_sse2(uint64_t *restrict dst,
+                            const uint64_t *restrict src, size_t words)
+{
+    for ( ; words >= 4; words -= 4) {
+        __m128i d0 = _mm_loadu_si128((const __m128i *)dst);
+        __m128i d1 = _mm_loadu_si128((const __m128i *)dst + 1);
+        __m128i s0 = _mm_loadu_si128((const __m128i *)src);
+        __m128i s1 = _mm_loadu_si128((const __m128i *)src + 1);
+        _mm_storeu_si128((__m128i *)dst, _mm_xor_si128(d0, s0));
+        _mm_storeu_si128((__m128i *)dst + 1, _mm_xor_si128(d1, s1));
+        dst += 4;
+        src += 4;
+    }
+    upipe_rtp_fec_xor_c(dst, src, words);
+}
+
+/** @This XORs a buffer into another, using AVX2.
+ *
+ * @param dst destination buffer
+ * @param src source buffer
+ * @param words number of 64-bit words
+ */
+__attribute__((target("avx2")))
+void upipe_rtp_fec_xor_avx2(uint64_t *restrict dst,
+                            const uint64_t *restrict src, size_t words)
+{
+    for ( ; words >= 8; words -= 8) {
+        __m256i d0 = _mm256_loadu_si256((const __m256i *)dst);
+        __m256i d1 = _mm256_loadu_si256((const __m256i *)dst + 1);
+        __m256i s0 = _mm256_loadu_si256((const __m256i *)src);
+        __m256i s1 = _mm256_loadu_si256((const __m256i *)src + 1);
+        _mm256_storeu_si256((__m256i *)dst, _mm256_xor_si256(d0, s0));
+        _mm256_storeu_si256((__m256i *)dst + 1, _mm256_xor_si256(d1, s1));
+        dst += 8;
+        src += 8;
+    }
+    upipe_rtp_fec_xor_sse2(dst, src, words);
+}
+#endif
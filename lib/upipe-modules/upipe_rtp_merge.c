@@ -0,0 +1,725 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module merging redundant RTP streams (SMPTE 2022-7)
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_uclock.h>
+#include <upipe-modules/upipe_rtp_merge.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#include "upipe_rtp_window.h"
+
+/** we only accept blocks containing RTP packets */
+#define EXPECTED_FLOW_DEF "block."
+/** default maximum delay of a packet waiting for a gap */
+#define DEFAULT_DELAY (UCLOCK_FREQ / 20)
+/** maximum number of inputs */
+#define MAX_INPUTS 32
+
+/** @internal @This is the private context of a rtp_merge pipe. */
+struct upipe_rtp_merge {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** timer releasing the packets held behind a gap */
+    struct upump *upump;
+    /** uclock structure */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+
+    /** list of input subpipes */
+    struct uchain inputs;
+    /** manager to create input subpipes */
+    struct upipe_mgr input_mgr;
+    /** inputs in use (bit field) */
+    uint32_t input_ids;
+
+    /** counters */
+    struct upipe_rtp_merge_counters counters;
+    /** window of sequence numbers */
+    struct upipe_rtp_window window;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @hidden */
+static int upipe_rtp_merge_check(struct upipe *upipe,
+                                 struct uref *flow_format);
+
+UPIPE_HELPER_UPIPE(upipe_rtp_merge, upipe, UPIPE_RTP_MERGE_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtp_merge, urefcount, upipe_rtp_merge_free)
+UPIPE_HELPER_VOID(upipe_rtp_merge)
+UPIPE_HELPER_OUTPUT(upipe_rtp_merge, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UPUMP_MGR(upipe_rtp_merge, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_rtp_merge, upump, upump_mgr)
+UPIPE_HELPER_UCLOCK(upipe_rtp_merge, uclock, uclock_request,
+                    upipe_rtp_merge_check,
+                    upipe_rtp_merge_register_output_request,
+                    upipe_rtp_merge_unregister_output_request)
+
+/** @internal @This is the private context of an input of a rtp_merge
+ * pipe. */
+struct upipe_rtp_merge_input {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** identifier of the input (bit number) */
+    unsigned int id;
+    /** true if a packet was received */
+    bool synced;
+    /** last sequence number received */
+    uint16_t last_seqnum;
+    /** counters */
+    struct upipe_rtp_merge_counters counters;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtp_merge_input, upipe,
+                   UPIPE_RTP_MERGE_INPUT_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtp_merge_input, urefcount,
+                       upipe_rtp_merge_input_free)
+UPIPE_HELPER_VOID(upipe_rtp_merge_input)
+
+UPIPE_HELPER_SUBPIPE(upipe_rtp_merge, upipe_rtp_merge_input, input,
+                     input_mgr, inputs, uchain)
+
+/** @internal @This credits the inputs that missed a packet which was output.
+ *
+ * @param upipe description structure of the pipe
+ * @param missed inputs that missed the packet (bit field)
+ */
+static void upipe_rtp_merge_recovered(struct upipe *upipe, uint32_t missed)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    struct uchain *uchain;
+    ulist_foreach (&upipe_rtp_merge->inputs, uchain) {
+        struct upipe_rtp_merge_input *input =
+            upipe_rtp_merge_input_from_uchain(uchain);
+        if (missed & (UINT32_C(1) << input->id)) {
+            input->counters.recovered++;
+            upipe_rtp_merge->counters.recovered++;
+        }
+    }
+}
+
+/** @internal @This outputs a packet released by the window.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref packet to output
+ * @param missed inputs that reported the packet as missing (bit field)
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_merge_release(struct upipe *upipe, struct uref *uref,
+                                    uint32_t missed, struct upump **upump_p)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    upipe_rtp_merge->counters.packets++;
+    if (missed)
+        upipe_rtp_merge_recovered(upipe, missed);
+    upipe_rtp_merge_output(upipe, uref, upump_p);
+}
+
+/** @internal @This counts a packet declared lost by the window.
+ *
+ * @param upipe description structure of the pipe
+ * @param seqnum sequence number of the lost packet
+ */
+static void upipe_rtp_merge_lost(struct upipe *upipe, uint16_t seqnum)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    upipe_rtp_merge->counters.lost++;
+}
+
+/** @hidden */
+static void upipe_rtp_merge_timer(struct upump *upump);
+
+/** @internal @This releases the packets of the window, and arms the timer
+ * to release the packets held behind a gap when the delay of the first one
+ * expires.
+ *
+ * @param upipe description structure of the pipe
+ * @param now current date, or UINT64_MAX
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_merge_work(struct upipe *upipe, uint64_t now,
+                                 struct upump **upump_p)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    uint64_t deadline = upipe_rtp_window_work(&upipe_rtp_merge->window, now,
+                                              upump_p);
+    if (deadline == UINT64_MAX || now == UINT64_MAX ||
+        upipe_rtp_merge->upump_mgr == NULL ||
+        upipe_rtp_merge->uclock == NULL) {
+        upipe_rtp_merge_set_upump(upipe, NULL);
+        return;
+    }
+    upipe_rtp_merge_wait_upump(upipe, deadline - now, upipe_rtp_merge_timer);
+}
+
+/** @internal @This is called when the delay of the first packet behind a
+ * gap expires.
+ *
+ * @param upump description structure of the timer
+ */
+static void upipe_rtp_merge_timer(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    upipe_use(upipe);
+    upipe_rtp_merge_work(upipe, uclock_now(upipe_rtp_merge->uclock), NULL);
+    upipe_release(upipe);
+}
+
+/** @internal @This records that an input missed a packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param input input that missed the packet
+ * @param seqnum sequence number of the missing packet
+ */
+static void upipe_rtp_merge_missed(struct upipe *upipe,
+                                   struct upipe_rtp_merge_input *input,
+                                   uint16_t seqnum)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    struct upipe_rtp_window *window = &upipe_rtp_merge->window;
+    struct upipe_rtp_window_slot *slot = upipe_rtp_window_slot(window, seqnum);
+    input->counters.lost++;
+
+    if (upipe_rtp_window_diff(seqnum, window->next_seqnum) < 0) {
+        /* already handled, possibly with the packet of another input */
+        if (upipe_rtp_window_check(window, seqnum, UPIPE_RTP_WINDOW_OUTPUT))
+            upipe_rtp_merge_recovered(upipe, UINT32_C(1) << input->id);
+        return;
+    }
+
+    if (!upipe_rtp_window_check(window, seqnum, UPIPE_RTP_WINDOW_EMPTY) &&
+        !upipe_rtp_window_check(window, seqnum, UPIPE_RTP_WINDOW_PENDING)) {
+        slot->seqnum = seqnum;
+        slot->state = UPIPE_RTP_WINDOW_EMPTY;
+        slot->missed = 0;
+    }
+    slot->missed |= UINT32_C(1) << input->id;
+}
+
+/** @internal @This allocates an input subpipe of a rtp_merge pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtp_merge_input_alloc(struct upipe_mgr *mgr,
+                                                 struct uprobe *uprobe,
+                                                 uint32_t signature,
+                                                 va_list args)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge =
+        upipe_rtp_merge_from_input_mgr(mgr);
+    if (unlikely(upipe_rtp_merge->input_ids == UINT32_MAX)) {
+        uprobe_err(uprobe, NULL, "too many inputs");
+        uprobe_release(uprobe);
+        return NULL;
+    }
+
+    struct upipe *upipe = upipe_rtp_merge_input_alloc_void(mgr, uprobe,
+                                                           signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_rtp_merge_input *input =
+        upipe_rtp_merge_input_from_upipe(upipe);
+    upipe_rtp_merge_input_init_urefcount(upipe);
+    upipe_rtp_merge_input_init_sub(upipe);
+    input->id = 0;
+    while (upipe_rtp_merge->input_ids & (UINT32_C(1) << input->id))
+        input->id++;
+    upipe_rtp_merge->input_ids |= UINT32_C(1) << input->id;
+    input->synced = false;
+    input->last_seqnum = 0;
+    memset(&input->counters, 0, sizeof(input->counters));
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This receives a RTP packet from one of the paths.
+ *
+ * @param upipe description structure of the subpipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_merge_input_input(struct upipe *upipe,
+                                        struct uref *uref,
+                                        struct upump **upump_p)
+{
+    struct upipe_rtp_merge_input *input =
+        upipe_rtp_merge_input_from_upipe(upipe);
+    struct upipe_rtp_merge *upipe_rtp_merge =
+        upipe_rtp_merge_from_input_mgr(upipe->mgr);
+    struct upipe *super = upipe_rtp_merge_to_upipe(upipe_rtp_merge);
+
+    uint8_t rtp_buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp_header = uref_block_peek(uref, 0, RTP_HEADER_SIZE,
+                                                rtp_buffer);
+    if (unlikely(rtp_header == NULL)) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return;
+    }
+    bool valid = rtp_check_hdr(rtp_header);
+    uint16_t seqnum = rtp_get_seqnum(rtp_header);
+    uref_block_peek_unmap(uref, 0, rtp_buffer, rtp_header);
+    if (unlikely(!valid)) {
+        upipe_warn(upipe, "invalid RTP header");
+        uref_free(uref);
+        return;
+    }
+
+    input->counters.packets++;
+    /* without uclock, the arrival dates of the packets act as clock */
+    uint64_t now = UINT64_MAX;
+    if (upipe_rtp_merge->uclock != NULL)
+        now = uclock_now(upipe_rtp_merge->uclock);
+    uint64_t cr_sys = now;
+    uref_clock_get_cr_sys(uref, &cr_sys);
+    if (now == UINT64_MAX)
+        now = cr_sys;
+
+    /* a path well ahead, or a discontinuity on all paths, resyncs */
+    struct upipe_rtp_window *window = &upipe_rtp_merge->window;
+    int diff;
+    if (!upipe_rtp_window_locate(window, seqnum, &diff, upump_p)) {
+        input->counters.duplicates++;
+        upipe_rtp_merge->counters.duplicates++;
+        uref_free(uref);
+        return;
+    }
+
+    /* account for the packets this path missed */
+    if (input->synced) {
+        int gap = upipe_rtp_window_diff(seqnum, input->last_seqnum + 1);
+        if (gap > 0 && gap < UPIPE_RTP_WINDOW_SIZE)
+            for (uint16_t i = input->last_seqnum + 1; i != seqnum; i++)
+                upipe_rtp_merge_missed(super, input, i);
+        if (gap >= 0 || gap <= -UPIPE_RTP_WINDOW_SIZE)
+            input->last_seqnum = seqnum;
+    } else {
+        input->last_seqnum = seqnum;
+        input->synced = true;
+    }
+
+    struct upipe_rtp_window_slot *slot = upipe_rtp_window_slot(window, seqnum);
+    if (diff < 0 &&
+        upipe_rtp_window_check(window, seqnum, UPIPE_RTP_WINDOW_SKIPPED)) {
+        upipe_verbose_va(upipe, "late RTP packet %"PRIu16, seqnum);
+        input->counters.late++;
+        upipe_rtp_merge->counters.late++;
+        uref_free(uref);
+        upipe_rtp_merge_work(super, now, upump_p);
+        return;
+    }
+    if (diff < 0 ||
+        upipe_rtp_window_check(window, seqnum, UPIPE_RTP_WINDOW_PENDING)) {
+        input->counters.duplicates++;
+        upipe_rtp_merge->counters.duplicates++;
+        uref_free(uref);
+        upipe_rtp_merge_work(super, now, upump_p);
+        return;
+    }
+
+    if (!upipe_rtp_window_check(window, seqnum, UPIPE_RTP_WINDOW_EMPTY))
+        slot->missed = 0;
+    else if (slot->missed & (UINT32_C(1) << input->id)) {
+        /* the packet was only reordered on this path */
+        slot->missed &= ~(UINT32_C(1) << input->id);
+        input->counters.lost--;
+    }
+    upipe_rtp_window_insert(window, uref, seqnum, cr_sys);
+    upipe_rtp_merge_work(super, now, upump_p);
+}
+
+/** @internal @This receives the flow definition of a path.
+ *
+ * @param upipe description structure of the subpipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_rtp_merge_input_set_flow_def(struct upipe *upipe,
+                                              struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct upipe_rtp_merge *upipe_rtp_merge =
+        upipe_rtp_merge_from_input_mgr(upipe->mgr);
+    if (upipe_rtp_merge->flow_def != NULL)
+        return UBASE_ERR_NONE;
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    upipe_rtp_merge_store_flow_def(upipe_rtp_merge_to_upipe(upipe_rtp_merge),
+                                   flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the counters of an input.
+ *
+ * @param upipe description structure of the subpipe
+ * @param counters_p filled in with the counters
+ * @return an error code
+ */
+static int upipe_rtp_merge_input_get_counters(struct upipe *upipe,
+        struct upipe_rtp_merge_counters *counters_p)
+{
+    struct upipe_rtp_merge_input *input =
+        upipe_rtp_merge_input_from_upipe(upipe);
+    assert(counters_p != NULL);
+    *counters_p = input->counters;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on an input subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtp_merge_input_control(struct upipe *upipe,
+                                         int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            struct upipe_rtp_merge *upipe_rtp_merge =
+                upipe_rtp_merge_from_input_mgr(upipe->mgr);
+            return upipe_rtp_merge_alloc_output_proxy(
+                    upipe_rtp_merge_to_upipe(upipe_rtp_merge), request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            struct upipe_rtp_merge *upipe_rtp_merge =
+                upipe_rtp_merge_from_input_mgr(upipe->mgr);
+            return upipe_rtp_merge_free_output_proxy(
+                    upipe_rtp_merge_to_upipe(upipe_rtp_merge), request);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_rtp_merge_input_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtp_merge_input_get_super(upipe, p);
+        }
+
+        case UPIPE_RTP_MERGE_GET_COUNTERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_MERGE_SIGNATURE)
+            struct upipe_rtp_merge_counters *counters_p =
+                va_arg(args, struct upipe_rtp_merge_counters *);
+            return upipe_rtp_merge_input_get_counters(upipe, counters_p);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees an input subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ */
+static void upipe_rtp_merge_input_free(struct upipe *upipe)
+{
+    struct upipe_rtp_merge_input *input =
+        upipe_rtp_merge_input_from_upipe(upipe);
+    struct upipe_rtp_merge *upipe_rtp_merge =
+        upipe_rtp_merge_from_input_mgr(upipe->mgr);
+    upipe_dbg_va(upipe, "%"PRIu64" packets, %"PRIu64" lost, %"PRIu64
+                 " recovered, %"PRIu64" duplicates, %"PRIu64" late",
+                 input->counters.packets, input->counters.lost,
+                 input->counters.recovered, input->counters.duplicates,
+                 input->counters.late);
+    upipe_throw_dead(upipe);
+
+    upipe_rtp_merge->input_ids &= ~(UINT32_C(1) << input->id);
+    upipe_rtp_merge_input_clean_sub(upipe);
+    upipe_rtp_merge_input_clean_urefcount(upipe);
+    upipe_rtp_merge_input_free_void(upipe);
+}
+
+/** @internal @This initializes the input manager for a rtp_merge pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_merge_init_input_mgr(struct upipe *upipe)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    struct upipe_mgr *input_mgr = &upipe_rtp_merge->input_mgr;
+    input_mgr->refcount = upipe_rtp_merge_to_urefcount(upipe_rtp_merge);
+    input_mgr->signature = UPIPE_RTP_MERGE_INPUT_SIGNATURE;
+    input_mgr->upipe_event_str = NULL;
+    input_mgr->upipe_command_str = NULL;
+    input_mgr->upipe_alloc = upipe_rtp_merge_input_alloc;
+    input_mgr->upipe_input = upipe_rtp_merge_input_input;
+    input_mgr->upipe_control = upipe_rtp_merge_input_control;
+    input_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a rtp_merge pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtp_merge_alloc(struct upipe_mgr *mgr,
+                                           struct uprobe *uprobe,
+                                           uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_rtp_merge_alloc_void(mgr, uprobe, signature,
+                                                     args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    upipe_rtp_merge_init_urefcount(upipe);
+    upipe_rtp_merge_init_output(upipe);
+    upipe_rtp_merge_init_upump_mgr(upipe);
+    upipe_rtp_merge_init_upump(upipe);
+    upipe_rtp_merge_init_uclock(upipe);
+    upipe_rtp_merge_init_input_mgr(upipe);
+    upipe_rtp_merge_init_sub_inputs(upipe);
+    upipe_rtp_merge->input_ids = 0;
+    memset(&upipe_rtp_merge->counters, 0, sizeof(upipe_rtp_merge->counters));
+    upipe_rtp_window_init(&upipe_rtp_merge->window, upipe,
+                          upipe_rtp_merge_release, upipe_rtp_merge_lost,
+                          DEFAULT_DELAY);
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This processes control commands on a rtp_merge pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_rtp_merge_control(struct upipe *upipe,
+                                    int command, va_list args)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_rtp_merge_set_upump(upipe, NULL);
+            return upipe_rtp_merge_attach_upump_mgr(upipe);
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_rtp_merge_set_upump(upipe, NULL);
+            upipe_rtp_merge_require_uclock(upipe);
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_rtp_merge_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_rtp_merge_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_rtp_merge_get_flow_def(upipe, p);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtp_merge_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_rtp_merge_set_output(upipe, output);
+        }
+        case UPIPE_GET_SUB_MGR: {
+            struct upipe_mgr **p = va_arg(args, struct upipe_mgr **);
+            return upipe_rtp_merge_get_sub_mgr(upipe, p);
+        }
+        case UPIPE_ITERATE_SUB: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtp_merge_iterate_sub(upipe, p);
+        }
+
+        case UPIPE_RTP_MERGE_GET_DELAY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_MERGE_SIGNATURE)
+            *va_arg(args, uint64_t *) = upipe_rtp_merge->window.delay;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_MERGE_SET_DELAY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_MERGE_SIGNATURE)
+            upipe_rtp_merge->window.delay = va_arg(args, uint64_t);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_MERGE_GET_COUNTERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_MERGE_SIGNATURE)
+            *va_arg(args, struct upipe_rtp_merge_counters *) =
+                upipe_rtp_merge->counters;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This checks the upump manager and the uclock, which are
+ * needed to release the packets after a gap when the inputs stall.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_rtp_merge_check(struct upipe *upipe,
+                                 struct uref *flow_format)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    if (flow_format != NULL)
+        uref_free(flow_format);
+
+    /* without them, packets are only released upon reception */
+    upipe_rtp_merge_check_upump_mgr(upipe);
+    if (unlikely(upipe_rtp_merge->uclock == NULL &&
+                 urequest_get_opaque(&upipe_rtp_merge->uclock_request,
+                                     struct upipe *) == NULL))
+        upipe_rtp_merge_require_uclock(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands and checks the upump manager
+ * and the uclock.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtp_merge_control(struct upipe *upipe,
+                                   int command, va_list args)
+{
+    UBASE_RETURN(_upipe_rtp_merge_control(upipe, command, args))
+    return upipe_rtp_merge_check(upipe, NULL);
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_merge_free(struct upipe *upipe)
+{
+    struct upipe_rtp_merge *upipe_rtp_merge = upipe_rtp_merge_from_upipe(upipe);
+    upipe_dbg_va(upipe, "%"PRIu64" packets, %"PRIu64" lost, %"PRIu64
+                 " recovered, %"PRIu64" duplicates, %"PRIu64" late",
+                 upipe_rtp_merge->counters.packets,
+                 upipe_rtp_merge->counters.lost,
+                 upipe_rtp_merge->counters.recovered,
+                 upipe_rtp_merge->counters.duplicates,
+                 upipe_rtp_merge->counters.late);
+    upipe_throw_dead(upipe);
+
+    upipe_rtp_window_clean(&upipe_rtp_merge->window);
+    upipe_rtp_merge_clean_uclock(upipe);
+    upipe_rtp_merge_clean_upump(upipe);
+    upipe_rtp_merge_clean_upump_mgr(upipe);
+    upipe_rtp_merge_clean_sub_inputs(upipe);
+    upipe_rtp_merge_clean_output(upipe);
+    upipe_rtp_merge_clean_urefcount(upipe);
+    upipe_rtp_merge_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_rtp_merge_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_RTP_MERGE_SIGNATURE,
+
+    .upipe_alloc = upipe_rtp_merge_alloc,
+    .upipe_input = NULL,
+    .upipe_control = upipe_rtp_merge_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all rtp_merge pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtp_merge_mgr_alloc(void)
+{
+    return &upipe_rtp_merge_mgr;
+}
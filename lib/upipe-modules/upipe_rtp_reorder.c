@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module reordering RTP packets (jitter buffer)
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_uclock.h>
+#include <upipe-modules/upipe_rtp_reorder.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#include "upipe_rtp_window.h"
+
+/** we only accept blocks containing RTP packets */
+#define EXPECTED_FLOW_DEF "block."
+/** default latency budget */
+#define DEFAULT_LATENCY (UCLOCK_FREQ / 10)
+
+/** @internal @This is the private context of a rtp_reorder pipe. */
+struct upipe_rtp_reorder {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** timer releasing the packets after a gap */
+    struct upump *upump;
+    /** uclock structure */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+
+    /** highest sequence number received */
+    uint16_t max_seqnum;
+    /** counters */
+    struct upipe_rtp_reorder_counters counters;
+    /** window of sequence numbers, whose delay is the latency budget */
+    struct upipe_rtp_window window;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @hidden */
+static int upipe_rtp_reorder_check(struct upipe *upipe,
+                                   struct uref *flow_format);
+
+UPIPE_HELPER_UPIPE(upipe_rtp_reorder, upipe, UPIPE_RTP_REORDER_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtp_reorder, urefcount, upipe_rtp_reorder_free)
+UPIPE_HELPER_VOID(upipe_rtp_reorder)
+UPIPE_HELPER_OUTPUT(upipe_rtp_reorder, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UPUMP_MGR(upipe_rtp_reorder, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_rtp_reorder, upump, upump_mgr)
+UPIPE_HELPER_UCLOCK(upipe_rtp_reorder, uclock, uclock_request,
+                    upipe_rtp_reorder_check,
+                    upipe_rtp_reorder_register_output_request,
+                    upipe_rtp_reorder_unregister_output_request)
+
+/** @internal @This outputs a packet released by the window.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref packet to output
+ * @param missed unused
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_reorder_release(struct upipe *upipe, struct uref *uref,
+                                      uint32_t missed, struct upump **upump_p)
+{
+    upipe_rtp_reorder_output(upipe, uref, upump_p);
+}
+
+/** @internal @This counts a packet declared lost by the window.
+ *
+ * @param upipe description structure of the pipe
+ * @param seqnum sequence number of the lost packet
+ */
+static void upipe_rtp_reorder_lost(struct upipe *upipe, uint16_t seqnum)
+{
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+    upipe_rtp_reorder->counters.lost++;
+}
+
+/** @hidden */
+static void upipe_rtp_reorder_timer(struct upump *upump);
+
+/** @internal @This releases the packets of the window, and arms the timer
+ * to release the packets held behind a gap when the latency budget of the
+ * first one expires.
+ *
+ * @param upipe description structure of the pipe
+ * @param now current date, or UINT64_MAX
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_reorder_work(struct upipe *upipe, uint64_t now,
+                                   struct upump **upump_p)
+{
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+    uint64_t deadline = upipe_rtp_window_work(&upipe_rtp_reorder->window, now,
+                                              upump_p);
+    if (deadline == UINT64_MAX || now == UINT64_MAX ||
+        upipe_rtp_reorder->upump_mgr == NULL ||
+        upipe_rtp_reorder->uclock == NULL) {
+        upipe_rtp_reorder_set_upump(upipe, NULL);
+        return;
+    }
+    upipe_rtp_reorder_wait_upump(upipe, deadline - now,
+                                 upipe_rtp_reorder_timer);
+}
+
+/** @internal @This is called when the latency budget of the first packet
+ * behind a gap expires.
+ *
+ * @param upump description structure of the timer
+ */
+static void upipe_rtp_reorder_timer(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+    upipe_use(upipe);
+    upipe_rtp_reorder_work(upipe, uclock_now(upipe_rtp_reorder->uclock), NULL);
+    upipe_release(upipe);
+}
+
+/** @internal @This allocates a rtp_reorder pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_rtp_reorder_alloc(struct upipe_mgr *mgr,
+                                             struct uprobe *uprobe,
+                                             uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_rtp_reorder_alloc_void(mgr, uprobe, signature,
+                                                       args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+    upipe_rtp_reorder_init_urefcount(upipe);
+    upipe_rtp_reorder_init_output(upipe);
+    upipe_rtp_reorder_init_upump_mgr(upipe);
+    upipe_rtp_reorder_init_upump(upipe);
+    upipe_rtp_reorder_init_uclock(upipe);
+    upipe_rtp_reorder->max_seqnum = 0;
+    memset(&upipe_rtp_reorder->counters, 0,
+           sizeof(upipe_rtp_reorder->counters));
+    upipe_rtp_window_init(&upipe_rtp_reorder->window, upipe,
+                          upipe_rtp_reorder_release, upipe_rtp_reorder_lost,
+                          DEFAULT_LATENCY);
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This receives a RTP packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_reorder_input(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+
+    uint8_t rtp_buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp_header = uref_block_peek(uref, 0, RTP_HEADER_SIZE,
+                                                rtp_buffer);
+    if (unlikely(rtp_header == NULL)) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return;
+    }
+    bool valid = rtp_check_hdr(rtp_header);
+    uint16_t seqnum = rtp_get_seqnum(rtp_header);
+    uref_block_peek_unmap(uref, 0, rtp_buffer, rtp_header);
+    if (unlikely(!valid)) {
+        upipe_warn(upipe, "invalid RTP header");
+        uref_free(uref);
+        return;
+    }
+
+    upipe_rtp_reorder->counters.packets++;
+    /* without uclock, the arrival dates of the packets act as clock */
+    uint64_t now = UINT64_MAX;
+    if (upipe_rtp_reorder->uclock != NULL)
+        now = uclock_now(upipe_rtp_reorder->uclock);
+    uint64_t cr_sys = now;
+    uref_clock_get_cr_sys(uref, &cr_sys);
+    if (now == UINT64_MAX)
+        now = cr_sys;
+
+    struct upipe_rtp_window *window = &upipe_rtp_reorder->window;
+    bool synced = window->synced;
+    uint16_t next_seqnum = window->next_seqnum;
+    int diff;
+    if (!upipe_rtp_window_locate(window, seqnum, &diff, upump_p)) {
+        upipe_rtp_reorder->counters.late++;
+        uref_free(uref);
+        return;
+    }
+    if (!synced || window->next_seqnum != next_seqnum)
+        /* synced or resynced on this packet */
+        upipe_rtp_reorder->max_seqnum = seqnum;
+
+    if (diff < 0) {
+        if (upipe_rtp_window_check(window, seqnum,
+                                   UPIPE_RTP_WINDOW_SKIPPED)) {
+            upipe_verbose_va(upipe, "late RTP packet %"PRIu16, seqnum);
+            upipe_rtp_reorder->counters.late++;
+        } else
+            upipe_rtp_reorder->counters.duplicates++;
+        uref_free(uref);
+        upipe_rtp_reorder_work(upipe, now, upump_p);
+        return;
+    }
+    if (upipe_rtp_window_check(window, seqnum, UPIPE_RTP_WINDOW_PENDING)) {
+        upipe_rtp_reorder->counters.duplicates++;
+        uref_free(uref);
+        upipe_rtp_reorder_work(upipe, now, upump_p);
+        return;
+    }
+
+    if (upipe_rtp_window_diff(seqnum, upipe_rtp_reorder->max_seqnum) < 0)
+        upipe_rtp_reorder->counters.reordered++;
+    else
+        upipe_rtp_reorder->max_seqnum = seqnum;
+
+    upipe_rtp_window_insert(window, uref, seqnum, cr_sys);
+    upipe_rtp_reorder_work(upipe, now, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_rtp_reorder_set_flow_def(struct upipe *upipe,
+                                          struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    upipe_rtp_reorder_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a rtp_reorder pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_rtp_reorder_control(struct upipe *upipe,
+                                      int command, va_list args)
+{
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_rtp_reorder_set_upump(upipe, NULL);
+            return upipe_rtp_reorder_attach_upump_mgr(upipe);
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_rtp_reorder_set_upump(upipe, NULL);
+            upipe_rtp_reorder_require_uclock(upipe);
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_rtp_reorder_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_rtp_reorder_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_rtp_reorder_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_rtp_reorder_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_rtp_reorder_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_rtp_reorder_set_output(upipe, output);
+        }
+
+        case UPIPE_RTP_REORDER_GET_LATENCY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_REORDER_SIGNATURE)
+            *va_arg(args, uint64_t *) = upipe_rtp_reorder->window.delay;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_REORDER_SET_LATENCY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_REORDER_SIGNATURE)
+            upipe_rtp_reorder->window.delay = va_arg(args, uint64_t);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_REORDER_GET_COUNTERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_REORDER_SIGNATURE)
+            *va_arg(args, struct upipe_rtp_reorder_counters *) =
+                upipe_rtp_reorder->counters;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This checks the upump manager and the uclock, which are
+ * needed to release the packets after a gap when the input stalls.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_rtp_reorder_check(struct upipe *upipe,
+                                   struct uref *flow_format)
+{
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+    if (flow_format != NULL)
+        uref_free(flow_format);
+
+    /* without them, packets are only released upon reception */
+    upipe_rtp_reorder_check_upump_mgr(upipe);
+    if (unlikely(upipe_rtp_reorder->uclock == NULL &&
+                 urequest_get_opaque(&upipe_rtp_reorder->uclock_request,
+                                     struct upipe *) == NULL))
+        upipe_rtp_reorder_require_uclock(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands and checks the upump manager
+ * and the uclock.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtp_reorder_control(struct upipe *upipe,
+                                     int command, va_list args)
+{
+    UBASE_RETURN(_upipe_rtp_reorder_control(upipe, command, args))
+    return upipe_rtp_reorder_check(upipe, NULL);
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_reorder_free(struct upipe *upipe)
+{
+    struct upipe_rtp_reorder *upipe_rtp_reorder =
+        upipe_rtp_reorder_from_upipe(upipe);
+    upipe_dbg_va(upipe, "%"PRIu64" packets, %"PRIu64" lost, %"PRIu64
+                 " late, %"PRIu64" reordered, %"PRIu64" duplicates",
+                 upipe_rtp_reorder->counters.packets,
+                 upipe_rtp_reorder->counters.lost,
+                 upipe_rtp_reorder->counters.late,
+                 upipe_rtp_reorder->counters.reordered,
+                 upipe_rtp_reorder->counters.duplicates);
+    upipe_throw_dead(upipe);
+
+    upipe_rtp_window_clean(&upipe_rtp_reorder->window);
+    upipe_rtp_reorder_clean_uclock(upipe);
+    upipe_rtp_reorder_clean_upump(upipe);
+    upipe_rtp_reorder_clean_upump_mgr(upipe);
+    upipe_rtp_reorder_clean_output(upipe);
+    upipe_rtp_reorder_clean_urefcount(upipe);
+    upipe_rtp_reorder_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_rtp_reorder_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_RTP_REORDER_SIGNATURE,
+
+    .upipe_alloc = upipe_rtp_reorder_alloc,
+    .upipe_input = upipe_rtp_reorder_input,
+    .upipe_control = upipe_rtp_reorder_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all rtp_reorder pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtp_reorder_mgr_alloc(void)
+{
+    return &upipe_rtp_reorder_mgr;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short common functions for the window of RTP sequence numbers of the
+ * rtp_reorder and rtp_merge pipes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "upipe_rtp_window.h"
+
+/** number of consecutive packets outside of the window before resyncing */
+#define MAX_OUT_OF_WINDOW 16
+
+/** @This initializes a window of sequence numbers.
+ *
+ * @param window window of sequence numbers
+ * @param upipe description structure of the pipe owning the window
+ * @param output function outputting a packet
+ * @param lost function called when a packet is lost
+ * @param delay maximum delay of a packet waiting for a gap
+ */
+void upipe_rtp_window_init(struct upipe_rtp_window *window,
+                           struct upipe *upipe,
+                           upipe_rtp_window_output output,
+                           upipe_rtp_window_lost lost, uint64_t delay)
+{
+    window->upipe = upipe;
+    window->output = output;
+    window->lost = lost;
+    window->delay = delay;
+    window->synced = false;
+    window->next_seqnum = 0;
+    window->first_seqnum = 0;
+    window->nb_pending = 0;
+    window->out_of_window = 0;
+    for (unsigned int i = 0; i < UPIPE_RTP_WINDOW_SIZE; i++) {
+        window->slots[i].uref = NULL;
+        window->slots[i].missed = 0;
+        window->slots[i].state = UPIPE_RTP_WINDOW_NONE;
+    }
+}
+
+/** @This releases the packets held by a window.
+ *
+ * @param window window of sequence numbers
+ */
+void upipe_rtp_window_clean(struct upipe_rtp_window *window)
+{
+    for (unsigned int i = 0; i < UPIPE_RTP_WINDOW_SIZE; i++) {
+        uref_free(window->slots[i].uref);
+        window->slots[i].uref = NULL;
+    }
+}
+
+/** @internal @This outputs or skips the slot of the next sequence number,
+ * and moves to the following sequence number.
+ *
+ * @param window window of sequence numbers
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_window_advance(struct upipe_rtp_window *window,
+                                     struct upump **upump_p)
+{
+    uint16_t seqnum = window->next_seqnum++;
+    struct upipe_rtp_window_slot *slot = upipe_rtp_window_slot(window, seqnum);
+
+    if (seqnum != window->first_seqnum || !window->nb_pending) {
+        upipe_verbose_va(window->upipe, "lost RTP packet %"PRIu16, seqnum);
+        slot->seqnum = seqnum;
+        slot->state = UPIPE_RTP_WINDOW_SKIPPED;
+        window->lost(window->upipe, seqnum);
+        return;
+    }
+
+    assert(slot->seqnum == seqnum && slot->state == UPIPE_RTP_WINDOW_PENDING);
+    struct uref *uref = slot->uref;
+    slot->uref = NULL;
+    slot->state = UPIPE_RTP_WINDOW_OUTPUT;
+
+    /* all pending packets lie in the window after the next sequence number,
+     * and the sequence numbers scanned here will not be scanned again */
+    if (--window->nb_pending) {
+        window->first_seqnum = window->next_seqnum;
+        while (!upipe_rtp_window_check(window, window->first_seqnum,
+                                       UPIPE_RTP_WINDOW_PENDING))
+            window->first_seqnum++;
+    }
+    window->output(window->upipe, uref, slot->missed, upump_p);
+}
+
+/** @This outputs all pending packets, skipping the gaps.
+ *
+ * @param window window of sequence numbers
+ * @param upump_p reference to pump that generated the buffer
+ */
+void upipe_rtp_window_flush(struct upipe_rtp_window *window,
+                            struct upump **upump_p)
+{
+    while (window->nb_pending)
+        upipe_rtp_window_advance(window, upump_p);
+}
+
+/** @This locates a received sequence number in the window, syncing on the
+ * first packet, and resyncing after a discontinuity.
+ *
+ * @param window window of sequence numbers
+ * @param seqnum received sequence number
+ * @param diff_p filled in with the distance to the next sequence number
+ * @param upump_p reference to pump that generated the buffer
+ * @return false if the packet is too old for the window and must be dropped
+ */
+bool upipe_rtp_window_locate(struct upipe_rtp_window *window,
+                             uint16_t seqnum, int *diff_p,
+                             struct upump **upump_p)
+{
+    if (unlikely(!window->synced)) {
+        window->next_seqnum = seqnum;
+        window->synced = true;
+    }
+
+    int diff = upipe_rtp_window_diff(seqnum, window->next_seqnum);
+    if (diff > -UPIPE_RTP_WINDOW_SIZE && diff < UPIPE_RTP_WINDOW_SIZE) {
+        window->out_of_window = 0;
+        *diff_p = diff;
+        return true;
+    }
+
+    /* a source well ahead, or a discontinuity */
+    if (++window->out_of_window < MAX_OUT_OF_WINDOW &&
+        diff < UPIPE_RTP_WINDOW_SIZE)
+        return false;
+
+    upipe_warn_va(window->upipe, "resyncing on RTP packet %"PRIu16, seqnum);
+    upipe_rtp_window_flush(window, upump_p);
+    window->next_seqnum = seqnum;
+    window->out_of_window = 0;
+    *diff_p = 0;
+    return true;
+}
+
+/** @This stores a packet in the window. The slot of the sequence number
+ * must not hold a pending packet.
+ *
+ * @param window window of sequence numbers
+ * @param uref received packet
+ * @param seqnum sequence number of the packet
+ * @param cr_sys date of arrival of the packet, or UINT64_MAX
+ */
+void upipe_rtp_window_insert(struct upipe_rtp_window *window,
+                             struct uref *uref, uint16_t seqnum,
+                             uint64_t cr_sys)
+{
+    struct upipe_rtp_window_slot *slot = upipe_rtp_window_slot(window, seqnum);
+    assert(slot->uref == NULL);
+    slot->uref = uref;
+    slot->cr_sys = cr_sys;
+    slot->seqnum = seqnum;
+    slot->state = UPIPE_RTP_WINDOW_PENDING;
+    if (!window->nb_pending++ ||
+        upipe_rtp_window_diff(seqnum, window->first_seqnum) < 0)
+        window->first_seqnum = seqnum;
+}
+
+/** @This outputs the contiguous packets, and skips the gaps whose following
+ * packet has waited for longer than the delay.
+ *
+ * @param window window of sequence numbers
+ * @param now current date, or UINT64_MAX
+ * @param upump_p reference to pump that generated the buffer
+ * @return date at which the packets held behind a gap must be released,
+ * or UINT64_MAX
+ */
+uint64_t upipe_rtp_window_work(struct upipe_rtp_window *window, uint64_t now,
+                               struct upump **upump_p)
+{
+    while (window->nb_pending) {
+        if (window->first_seqnum != window->next_seqnum) {
+            /* gap: check how long the first pending packet has waited */
+            struct upipe_rtp_window_slot *first =
+                upipe_rtp_window_slot(window, window->first_seqnum);
+            if (first->cr_sys == UINT64_MAX)
+                return UINT64_MAX;
+            uint64_t deadline = first->cr_sys + window->delay;
+            if (now == UINT64_MAX || deadline > now)
+                return deadline;
+
+            /* skip the whole gap at once */
+            while (window->next_seqnum != window->first_seqnum)
+                upipe_rtp_window_advance(window, upump_p);
+        }
+        upipe_rtp_window_advance(window, upump_p);
+    }
+    return UINT64_MAX;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short common functions for the window of RTP sequence numbers of the
+ * rtp_reorder and rtp_merge pipes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uref.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** number of sequence numbers in the window (power of 2) */
+#define UPIPE_RTP_WINDOW_SIZE 1024
+
+/** @internal @This is the state of a slot of the window. */
+enum upipe_rtp_window_state {
+    /** slot was never used */
+    UPIPE_RTP_WINDOW_NONE,
+    /** packet is expected but not received yet */
+    UPIPE_RTP_WINDOW_EMPTY,
+    /** packet is received and waits to be output */
+    UPIPE_RTP_WINDOW_PENDING,
+    /** packet was output */
+    UPIPE_RTP_WINDOW_OUTPUT,
+    /** packet was declared lost */
+    UPIPE_RTP_WINDOW_SKIPPED
+};
+
+/** @internal @This is a slot of the window, for one sequence number. */
+struct upipe_rtp_window_slot {
+    /** pending packet */
+    struct uref *uref;
+    /** date of arrival of the pending packet, or UINT64_MAX */
+    uint64_t cr_sys;
+    /** inputs that reported the packet as missing (bit field) */
+    uint32_t missed;
+    /** sequence number */
+    uint16_t seqnum;
+    /** state of the slot */
+    enum upipe_rtp_window_state state;
+};
+
+/** @internal @This is called to output a packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref packet to output
+ * @param missed inputs that reported the packet as missing (bit field)
+ * @param upump_p reference to pump that generated the buffer
+ */
+typedef void (*upipe_rtp_window_output)(struct upipe *upipe,
+                                        struct uref *uref, uint32_t missed,
+                                        struct upump **upump_p);
+
+/** @internal @This is called when a packet is declared lost.
+ *
+ * @param upipe description structure of the pipe
+ * @param seqnum sequence number of the lost packet
+ */
+typedef void (*upipe_rtp_window_lost)(struct upipe *upipe, uint16_t seqnum);
+
+/** @internal @This is the window of sequence numbers. */
+struct upipe_rtp_window {
+    /** pipe owning the window */
+    struct upipe *upipe;
+    /** function outputting a packet */
+    upipe_rtp_window_output output;
+    /** function called when a packet is lost */
+    upipe_rtp_window_lost lost;
+
+    /** maximum delay of a packet waiting for a gap */
+    uint64_t delay;
+    /** true if the next sequence number is known */
+    bool synced;
+    /** next sequence number to output */
+    uint16_t next_seqnum;
+    /** first pending sequence number, valid if nb_pending is not 0 */
+    uint16_t first_seqnum;
+    /** number of pending packets */
+    unsigned int nb_pending;
+    /** number of consecutive packets outside of the window */
+    unsigned int out_of_window;
+    /** slots of the window */
+    struct upipe_rtp_window_slot slots[UPIPE_RTP_WINDOW_SIZE];
+};
+
+/** @internal @This returns the signed distance between two sequence
+ * numbers.
+ *
+ * @param seqnum sequence number
+ * @param ref reference sequence number
+ * @return seqnum - ref, between -32768 and 32767
+ */
+static inline int upipe_rtp_window_diff(uint16_t seqnum, uint16_t ref)
+{
+    return (int16_t)(uint16_t)(seqnum - ref);
+}
+
+/** @internal @This returns the slot of a sequence number.
+ *
+ * @param window window of sequence numbers
+ * @param seqnum sequence number
+ * @return pointer to the slot
+ */
+static inline struct upipe_rtp_window_slot *
+    upipe_rtp_window_slot(struct upipe_rtp_window *window, uint16_t seqnum)
+{
+    return &window->slots[seqnum & (UPIPE_RTP_WINDOW_SIZE - 1)];
+}
+
+/** @internal @This checks if the slot of a sequence number is in a given
+ * state.
+ *
+ * @param window window of sequence numbers
+ * @param seqnum sequence number
+ * @param state state to check
+ * @return true if the slot belongs to the sequence number and is in state
+ */
+static inline bool upipe_rtp_window_check(struct upipe_rtp_window *window,
+                                          uint16_t seqnum,
+                                          enum upipe_rtp_window_state state)
+{
+    struct upipe_rtp_window_slot *slot = upipe_rtp_window_slot(window, seqnum);
+    return slot->seqnum == seqnum && slot->state == state;
+}
+
+/** @internal @This initializes a window of sequence numbers.
+ *
+ * @param window window of sequence numbers
+ * @param upipe description structure of the pipe owning the window
+ * @param output function outputting a packet
+ * @param lost function called when a packet is lost
+ * @param delay maximum delay of a packet waiting for a gap
+ */
+void upipe_rtp_window_init(struct upipe_rtp_window *window,
+                           struct upipe *upipe,
+                           upipe_rtp_window_output output,
+                           upipe_rtp_window_lost lost, uint64_t delay);
+
+/** @internal @This releases the packets held by a window.
+ *
+ * @param window window of sequence numbers
+ */
+void upipe_rtp_window_clean(struct upipe_rtp_window *window);
+
+/** @internal @This locates a received sequence number in the window,
+ * syncing on the first packet, and resyncing after a discontinuity.
+ *
+ * @param window window of sequence numbers
+ * @param seqnum received sequence number
+ * @param diff_p filled in with the distance to the next sequence number
+ * @param upump_p reference to pump that generated the buffer
+ * @return false if the packet is too old for the window and must be dropped
+ */
+bool upipe_rtp_window_locate(struct upipe_rtp_window *window,
+                             uint16_t seqnum, int *diff_p,
+                             struct upump **upump_p);
+
+/** @internal @This stores a packet in the window. The slot of the sequence
+ * number must not hold a pending packet.
+ *
+ * @param window window of sequence numbers
+ * @param uref received packet
+ * @param seqnum sequence number of the packet
+ * @param cr_sys date of arrival of the packet, or UINT64_MAX
+ */
+void upipe_rtp_window_insert(struct upipe_rtp_window *window,
+                             struct uref *uref, uint16_t seqnum,
+                             uint64_t cr_sys);
+
+/** @internal @This outputs the contiguous packets, and skips the gaps whose
+ * following packet has waited for longer than the delay.
+ *
+ * @param window window of sequence numbers
+ * @param now current date, or UINT64_MAX
+ * @param upump_p reference to pump that generated the buffer
+ * @return date at which the packets held behind a gap must be released,
+ * or UINT64_MAX
+ */
+uint64_t upipe_rtp_window_work(struct upipe_rtp_window *window, uint64_t now,
+                               struct upump **upump_p);
+
+/** @internal @This outputs all pending packets, skipping the gaps.
+ *
+ * @param window window of sequence numbers
+ * @param upump_p reference to pump that generated the buffer
+ */
+void upipe_rtp_window_flush(struct upipe_rtp_window *window,
+                            struct upump **upump_p);
@@ -34,6 +34,7 @@
 #include <upipe/ubuf.h>
 #include <upipe/uref_pic_flow.h>
 #include <upipe/uref_pic.h>
+#include <upipe/uband_pool.h>
 #include <upipe/upipe.h>
 #include <upipe/uref_flow.h>
 #include <upipe/uref_dump.h>
@@ -59,6 +60,12 @@
 #include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 
+/** maximum number of slice threads */
+#define UPIPE_SWS_MAX_THREADS 16
+/** slices start on multiples of this number of output lines, so that
+ * they use the same dithering patterns as the unsliced conversion */
+#define UPIPE_SWS_SLICE_ALIGN 8
+
 /** @hidden */
 static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
                              struct upump **upump_p);
@@ -103,6 +110,18 @@ struct upipe_sws {
     int flags;
     /** swscale image conversion context [0] for progressive, [1,2] interlaced */
     struct SwsContext *convert_ctx[3];
+    /** number of slice threads */
+    unsigned int threads;
+    /** pool of slice threads, or NULL for a single thread */
+    struct uband_pool *band_pool;
+    /** conversion contexts of the slices, indexed like convert_ctx */
+    struct SwsContext *slice_ctx[UPIPE_SWS_MAX_THREADS][3];
+    /** scratch pictures of the slices, kept between pictures */
+    struct ubuf *slice_scratch[UPIPE_SWS_MAX_THREADS][3];
+    /** number of lines of the scratch pictures */
+    size_t slice_scratch_vsize[UPIPE_SWS_MAX_THREADS][3];
+    /** width of the scratch pictures */
+    size_t slice_scratch_hsize;
     /** input pixel format */
     enum AVPixelFormat input_pix_fmt;
     /** requested output pixel format */
@@ -137,6 +156,42 @@ UPIPE_HELPER_UBUF_MGR(upipe_sws, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_sws_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_sws, urefs, nb_urefs, max_urefs, blockers, upipe_sws_handle)
 
+/** @internal @This describes a horizontal slice of a picture, scaled with
+ * its own context. The slice is extended with margin lines above and below
+ * so that the filters see the same neighbourhood as in the whole picture;
+ * the extended slice is scaled to a scratch buffer and only the lines of the
+ * slice are copied to the output. */
+struct upipe_sws_slice {
+    /** conversion context */
+    struct SwsContext *ctx;
+    /** input planes, at the first line of the extended slice */
+    const uint8_t *input_planes[UPIPE_AV_MAX_PLANES + 1];
+    /** input strides */
+    int input_strides[UPIPE_AV_MAX_PLANES + 1];
+    /** number of input lines of the extended slice */
+    int input_lines;
+    /** scratch buffer */
+    struct ubuf *scratch;
+    /** scratch planes */
+    uint8_t *scratch_planes[UPIPE_AV_MAX_PLANES + 1];
+    /** scratch strides */
+    int scratch_strides[UPIPE_AV_MAX_PLANES + 1];
+    /** output planes, at the first line of the slice */
+    uint8_t *output_planes[UPIPE_AV_MAX_PLANES + 1];
+    /** output strides */
+    int output_strides[UPIPE_AV_MAX_PLANES + 1];
+    /** vertical subsampling of the output planes */
+    uint8_t vsub[UPIPE_AV_MAX_PLANES];
+    /** octets per line of the output planes */
+    size_t line_size[UPIPE_AV_MAX_PLANES];
+    /** number of lines of the upper margin in the scratch buffer */
+    int skip;
+    /** number of output lines of the slice */
+    int lines;
+    /** return value of sws_scale */
+    int ret;
+};
+
 /** @internal @This converts Upipe color space to sws color space.
  *
  * @param upipe description structure of the pipe
@@ -163,6 +218,334 @@ static int upipe_sws_convert_color(struct upipe *upipe, struct uref *flow_def)
     return colorspace;
 }
 
+/** @internal @This sets the vertical chroma positions of a set of
+ * contexts.
+ *
+ * @param upipe description structure of the pipe
+ * @param ctx contexts for progressive, top and bottom fields
+ */
+static void upipe_sws_set_chroma_pos(struct upipe *upipe,
+                                     struct SwsContext *ctx[3])
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    if (upipe_sws->input_pix_fmt == AV_PIX_FMT_YUV420P) {
+        av_opt_set_int(ctx[0], "src_v_chr_pos", 128, 0);
+        av_opt_set_int(ctx[1], "src_v_chr_pos", 64, 0);
+        av_opt_set_int(ctx[2], "src_v_chr_pos", 192, 0);
+    }
+
+    if (upipe_sws->output_pix_fmt == AV_PIX_FMT_YUV420P) {
+        av_opt_set_int(ctx[0], "dst_v_chr_pos", 128, 0);
+        av_opt_set_int(ctx[1], "dst_v_chr_pos", 64, 0);
+        av_opt_set_int(ctx[2], "dst_v_chr_pos", 192, 0);
+    }
+}
+
+/** @internal @This prepares a conversion context for the given sizes, and
+ * applies the color space settings.
+ *
+ * @param upipe description structure of the pipe
+ * @param ctx_p pointer to the context, possibly reallocated
+ * @param input_hsize input width
+ * @param input_vsize input height
+ * @param output_hsize output width
+ * @param output_vsize output height
+ * @return false if the context could not be allocated
+ */
+static bool upipe_sws_prepare(struct upipe *upipe, struct SwsContext **ctx_p,
+                              int input_hsize, int input_vsize,
+                              int output_hsize, int output_vsize)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    *ctx_p = sws_getCachedContext(*ctx_p,
+                input_hsize, input_vsize, upipe_sws->input_pix_fmt,
+                output_hsize, output_vsize, upipe_sws->output_pix_fmt,
+                upipe_sws->flags, NULL, NULL, NULL);
+
+    if (unlikely(*ctx_p == NULL)) {
+        upipe_err(upipe, "sws_getContext failed");
+        return false;
+    }
+
+    if (upipe_sws->colorspace_invalid)
+        return true;
+
+    int in_full, out_full, brightness, contrast, saturation;
+    const int *inv_table, *table;
+
+    if (unlikely(sws_getColorspaceDetails(*ctx_p,
+                    (int **)&inv_table, &in_full, (int **)&table, &out_full,
+                    &brightness, &contrast, &saturation) < 0)) {
+        upipe_warn(upipe, "unable to set color space data");
+        upipe_sws->colorspace_invalid = true;
+        return true;
+    }
+
+    if (upipe_sws->input_colorspace != -1)
+        inv_table = sws_getCoefficients(upipe_sws->input_colorspace);
+    if (upipe_sws->input_color_range != -1)
+        in_full = upipe_sws->input_color_range;
+    if (upipe_sws->output_colorspace != -1)
+        table = sws_getCoefficients(upipe_sws->output_colorspace);
+    if (upipe_sws->output_color_range != -1)
+        out_full = upipe_sws->output_color_range;
+
+    if (unlikely(sws_setColorspaceDetails(*ctx_p,
+                    inv_table, in_full, table, out_full,
+                    brightness, contrast, saturation) < 0)) {
+        upipe_warn(upipe, "unable to set color space data");
+        upipe_sws->colorspace_invalid = true;
+    }
+    return true;
+}
+
+/** @internal @This frees the scratch pictures of the slices.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_sws_flush_scratch(struct upipe *upipe)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    for (unsigned int k = 0; k < UPIPE_SWS_MAX_THREADS; k++)
+        for (int i = 0; i < 3; i++) {
+            if (upipe_sws->slice_scratch[k][i] != NULL)
+                ubuf_free(upipe_sws->slice_scratch[k][i]);
+            upipe_sws->slice_scratch[k][i] = NULL;
+            upipe_sws->slice_scratch_vsize[k][i] = 0;
+        }
+    upipe_sws->slice_scratch_hsize = 0;
+}
+
+/** @internal @This returns the scratch picture of a slice, allocating it
+ * if the size changed.
+ *
+ * @param upipe description structure of the pipe
+ * @param k index of the slice
+ * @param field index of the contexts
+ * @param hsize width of the scratch picture
+ * @param vsize height of the scratch picture
+ * @return pointer to the scratch picture, or NULL in case of error
+ */
+static struct ubuf *upipe_sws_slice_scratch(struct upipe *upipe,
+                                            unsigned int k, int field,
+                                            size_t hsize, size_t vsize)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    if (hsize != upipe_sws->slice_scratch_hsize) {
+        upipe_sws_flush_scratch(upipe);
+        upipe_sws->slice_scratch_hsize = hsize;
+    }
+
+    struct ubuf **scratch_p = &upipe_sws->slice_scratch[k][field];
+    if (*scratch_p != NULL &&
+        upipe_sws->slice_scratch_vsize[k][field] == vsize)
+        return *scratch_p;
+
+    if (*scratch_p != NULL)
+        ubuf_free(*scratch_p);
+    *scratch_p = ubuf_pic_alloc(upipe_sws->ubuf_mgr, hsize, vsize);
+    upipe_sws->slice_scratch_vsize[k][field] = *scratch_p != NULL ? vsize : 0;
+    return *scratch_p;
+}
+
+/** @internal @This scales a slice and copies its lines to the output.
+ *
+ * @param opaque array of upipe_sws_slice structures
+ * @param k index of the slice
+ * @param nb_slices number of slices
+ */
+static void upipe_sws_slice_run(void *opaque, unsigned int k,
+                                unsigned int nb_slices)
+{
+    struct upipe_sws_slice *slice = (struct upipe_sws_slice *)opaque + k;
+    slice->ret = sws_scale(slice->ctx, slice->input_planes,
+                           slice->input_strides, 0, slice->input_lines,
+                           slice->scratch_planes, slice->scratch_strides);
+    if (slice->ret <= 0)
+        return;
+
+    for (int i = 0; i < UPIPE_AV_MAX_PLANES && slice->output_planes[i]; i++) {
+        const uint8_t *src = slice->scratch_planes[i] +
+            slice->skip / slice->vsub[i] * slice->scratch_strides[i];
+        uint8_t *dst = slice->output_planes[i];
+        for (int y = 0; y < slice->lines / slice->vsub[i]; y++) {
+            memcpy(dst, src, slice->line_size[i]);
+            src += slice->scratch_strides[i];
+            dst += slice->output_strides[i];
+        }
+    }
+}
+
+/** @internal @This scales a picture, or a field, in horizontal slices
+ * processed concurrently by the band pool.
+ *
+ * Slice boundaries are chosen so that the input and output lines match
+ * exactly, which keeps the filter positions of the whole picture. As each
+ * slice has its own context, the edges of the extended slices may still
+ * round differently, so the result may differ from the unsliced conversion
+ * by one code value.
+ *
+ * @param upipe description structure of the pipe
+ * @param field index of the contexts (0 for progressive, 1 or 2 for fields)
+ * @param uref input picture
+ * @param ubuf output buffer
+ * @param input_planes mapped input planes
+ * @param input_strides input strides
+ * @param output_planes mapped output planes
+ * @param output_strides output strides
+ * @param input_hsize input width
+ * @param input_vsize input height
+ * @param output_hsize output width
+ * @param output_vsize output height
+ * @return the number of slices, 0 if the picture may not be split, or -1
+ * in case of error
+ */
+static int upipe_sws_scale_slices(struct upipe *upipe, int field,
+        struct uref *uref, struct ubuf *ubuf,
+        const uint8_t *const *input_planes, const int *input_strides,
+        uint8_t *const *output_planes, const int *output_strides,
+        int input_hsize, int input_vsize, int output_hsize, int output_vsize)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    uint8_t input_vsub[UPIPE_AV_MAX_PLANES];
+    uint8_t output_vsub[UPIPE_AV_MAX_PLANES];
+    size_t line_size[UPIPE_AV_MAX_PLANES];
+    int input_align = 1, output_align = UPIPE_SWS_SLICE_ALIGN;
+    uint8_t macropixel;
+    int i;
+
+    if (unlikely(!ubase_check(ubuf_pic_size(ubuf, NULL, NULL, &macropixel))))
+        return 0;
+    for (i = 0; i < UPIPE_AV_MAX_PLANES &&
+                upipe_sws->input_chroma_map[i] != NULL; i++) {
+        if (unlikely(!ubase_check(uref_pic_plane_size(uref,
+                            upipe_sws->input_chroma_map[i],
+                            NULL, NULL, &input_vsub[i], NULL))))
+            return 0;
+        input_align = input_align * input_vsub[i] /
+                      ubase_gcd(input_align, input_vsub[i]);
+    }
+    for (i = 0; i < UPIPE_AV_MAX_PLANES &&
+                upipe_sws->output_chroma_map[i] != NULL; i++) {
+        uint8_t hsub, macropixel_size;
+        if (unlikely(!ubase_check(ubuf_pic_plane_size(ubuf,
+                            upipe_sws->output_chroma_map[i],
+                            NULL, &hsub, &output_vsub[i], &macropixel_size))))
+            return 0;
+        output_align = output_align * output_vsub[i] /
+                       ubase_gcd(output_align, output_vsub[i]);
+        line_size[i] = output_hsize / hsub / macropixel * macropixel_size;
+    }
+
+    /* split in units of input and output lines of the same ratio */
+    if (unlikely(input_vsize <= 0 || output_vsize <= 0))
+        return 0;
+    int units = ubase_gcd(input_vsize, output_vsize);
+    int unit_in = input_vsize / units;
+    int unit_out = output_vsize / units;
+    while ((unit_in % input_align || unit_out % output_align) &&
+           !(units % 2)) {
+        unit_in *= 2;
+        unit_out *= 2;
+        units /= 2;
+    }
+    if (unit_in % input_align || unit_out % output_align)
+        return 0;
+
+    /* enough input lines around each slice for the widest filters */
+    int ratio = (input_vsize + output_vsize - 1) / output_vsize;
+    int margin = (8 * ratio * input_align + unit_in - 1) / unit_in;
+    int nb_slices = upipe_sws->threads;
+    while (nb_slices > 1 && units / nb_slices < margin)
+        nb_slices--;
+    if (nb_slices < 2)
+        return 0;
+
+    struct upipe_sws_slice slices[UPIPE_SWS_MAX_THREADS];
+    int nb_ready = 0;
+    int ret = nb_slices;
+    for ( ; nb_ready < nb_slices; nb_ready++) {
+        struct upipe_sws_slice *slice = &slices[nb_ready];
+        int start = units * nb_ready / nb_slices;
+        int end = units * (nb_ready + 1) / nb_slices;
+        int ext_start = start > margin ? start - margin : 0;
+        int ext_end = end + margin < units ? end + margin : units;
+
+        slice->input_lines = (ext_end - ext_start) * unit_in;
+        slice->skip = (start - ext_start) * unit_out;
+        slice->lines = (end - start) * unit_out;
+        if (unlikely(!upipe_sws_prepare(upipe,
+                        &upipe_sws->slice_ctx[nb_ready][field],
+                        input_hsize, slice->input_lines, output_hsize,
+                        (ext_end - ext_start) * unit_out)) ||
+            unlikely((slice->scratch = upipe_sws_slice_scratch(upipe,
+                        nb_ready, field, output_hsize,
+                        (ext_end - ext_start) * unit_out)) == NULL)) {
+            ret = -1;
+            break;
+        }
+        slice->ctx = upipe_sws->slice_ctx[nb_ready][field];
+
+        for (i = 0; i < UPIPE_AV_MAX_PLANES && input_planes[i]; i++) {
+            slice->input_planes[i] = input_planes[i] +
+                ext_start * unit_in / input_vsub[i] * input_strides[i];
+            slice->input_strides[i] = input_strides[i];
+        }
+        for ( ; i <= UPIPE_AV_MAX_PLANES; i++) {
+            slice->input_planes[i] = NULL;
+            slice->input_strides[i] = 0;
+        }
+
+        for (i = 0; i < UPIPE_AV_MAX_PLANES && output_planes[i]; i++) {
+            const char *chroma = upipe_sws->output_chroma_map[i];
+            size_t stride;
+            if (unlikely(!ubase_check(ubuf_pic_plane_write(slice->scratch,
+                                chroma, 0, 0, -1, -1,
+                                &slice->scratch_planes[i])) ||
+                         !ubase_check(ubuf_pic_plane_size(slice->scratch,
+                                chroma, &stride, NULL, NULL, NULL)))) {
+                while (i-- > 0)
+                    ubuf_pic_plane_unmap(slice->scratch,
+                                         upipe_sws->output_chroma_map[i],
+                                         0, 0, -1, -1);
+                ret = -1;
+                break;
+            }
+            slice->scratch_strides[i] = stride;
+            slice->output_planes[i] = output_planes[i] +
+                start * unit_out / output_vsub[i] * output_strides[i];
+            slice->output_strides[i] = output_strides[i];
+            slice->vsub[i] = output_vsub[i];
+            slice->line_size[i] = line_size[i];
+        }
+        if (unlikely(ret < 0))
+            break;
+        for ( ; i <= UPIPE_AV_MAX_PLANES; i++) {
+            slice->scratch_planes[i] = NULL;
+            slice->scratch_strides[i] = 0;
+            slice->output_planes[i] = NULL;
+            slice->output_strides[i] = 0;
+        }
+    }
+
+    if (likely(ret > 0)) {
+        uband_pool_run(upipe_sws->band_pool, nb_slices,
+                       upipe_sws_slice_run, slices);
+        for (int k = 0; k < nb_slices; k++)
+            if (unlikely(slices[k].ret <= 0))
+                ret = -1;
+    }
+
+    for (int k = 0; k < nb_ready; k++) {
+        for (i = 0; i < UPIPE_AV_MAX_PLANES &&
+                    upipe_sws->output_chroma_map[i] != NULL; i++)
+            ubuf_pic_plane_unmap(slices[k].scratch,
+                                 upipe_sws->output_chroma_map[i],
+                                 0, 0, -1, -1);
+    }
+    return ret;
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -207,46 +590,12 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
 
     int i;
     for (i = 0; i < 3; i++) {
-        upipe_sws->convert_ctx[i] = sws_getCachedContext(upipe_sws->convert_ctx[i],
-                    input_hsize, input_vsize >> !!i, upipe_sws->input_pix_fmt,
-                    output_hsize, output_vsize >> !!i, upipe_sws->output_pix_fmt,
-                    upipe_sws->flags, NULL, NULL, NULL);
-
-        if (unlikely(upipe_sws->convert_ctx[i] == NULL)) {
-            upipe_err(upipe, "sws_getContext failed");
+        if (unlikely(!upipe_sws_prepare(upipe, &upipe_sws->convert_ctx[i],
+                        input_hsize, input_vsize >> !!i,
+                        output_hsize, output_vsize >> !!i))) {
             uref_free(uref);
             return true;
         }
-
-        if (upipe_sws->colorspace_invalid)
-            continue;
-
-        int in_full, out_full, brightness, contrast, saturation;
-        const int *inv_table, *table;
-
-        if (unlikely(sws_getColorspaceDetails(upipe_sws->convert_ctx[i],
-                        (int **)&inv_table, &in_full, (int **)&table, &out_full,
-                        &brightness, &contrast, &saturation) < 0)) {
-            upipe_warn(upipe, "unable to set color space data");
-            upipe_sws->colorspace_invalid = true;
-            continue;
-        }
-
-        if (upipe_sws->input_colorspace != -1)
-            inv_table = sws_getCoefficients(upipe_sws->input_colorspace);
-        if (upipe_sws->input_color_range != -1)
-            in_full = upipe_sws->input_color_range;
-        if (upipe_sws->output_colorspace != -1)
-            table = sws_getCoefficients(upipe_sws->output_colorspace);
-        if (upipe_sws->output_color_range != -1)
-            out_full = upipe_sws->output_color_range;
-
-        if (unlikely(sws_setColorspaceDetails(upipe_sws->convert_ctx[i],
-                        inv_table, in_full, table, out_full,
-                        brightness, contrast, saturation) < 0)) {
-            upipe_warn(upipe, "unable to set color space data");
-            upipe_sws->colorspace_invalid = true;
-        }
     }
 
     upipe_verbose_va(upipe, "%s -> %s",
@@ -323,15 +672,29 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
 
     /* fire ! */
     int ret = 0, ret2 = 1;
+    /* fields are only sliced when both have the same height */
+    bool sliced = upipe_sws->band_pool != NULL &&
+                  (progressive || (!(input_vsize % 2) && !(output_vsize % 2)));
     if (progressive) {
-        ret = sws_scale(upipe_sws->convert_ctx[0],
-                        input_planes, input_strides, 0, input_vsize,
-                        output_planes, output_strides);
+        if (sliced)
+            ret = upipe_sws_scale_slices(upipe, 0, uref, ubuf,
+                    input_planes, input_strides, output_planes, output_strides,
+                    input_hsize, input_vsize, output_hsize, output_vsize);
+        if (!ret)
+            ret = sws_scale(upipe_sws->convert_ctx[0],
+                            input_planes, input_strides, 0, input_vsize,
+                            output_planes, output_strides);
     }
     else {
-        ret = sws_scale(upipe_sws->convert_ctx[1],
-                        input_planes, input_strides, 0, (input_vsize+1)/2,
-                        output_planes, output_strides);
+        if (sliced)
+            ret = upipe_sws_scale_slices(upipe, 1, uref, ubuf,
+                    input_planes, input_strides, output_planes, output_strides,
+                    input_hsize, input_vsize / 2,
+                    output_hsize, output_vsize / 2);
+        if (!ret)
+            ret = sws_scale(upipe_sws->convert_ctx[1],
+                            input_planes, input_strides, 0, (input_vsize+1)/2,
+                            output_planes, output_strides);
 
         for (i = 0; i < UPIPE_AV_MAX_PLANES && input_planes[i]; i++) {
                 input_planes[i] += input_strides[i] >> 1;
@@ -340,9 +703,16 @@ static bool upipe_sws_handle(struct upipe *upipe, struct uref *uref,
                 output_planes[i] += output_strides[i] >> 1;
         }
 
-        ret2 = sws_scale(upipe_sws->convert_ctx[2],
-                         input_planes, input_strides, 0, input_vsize/2,
-                         output_planes, output_strides);
+        ret2 = 0;
+        if (sliced)
+            ret2 = upipe_sws_scale_slices(upipe, 2, uref, ubuf,
+                    input_planes, input_strides, output_planes, output_strides,
+                    input_hsize, input_vsize / 2,
+                    output_hsize, output_vsize / 2);
+        if (!ret2)
+            ret2 = sws_scale(upipe_sws->convert_ctx[2],
+                             input_planes, input_strides, 0, input_vsize/2,
+                             output_planes, output_strides);
     }
 
     /* unmap pictures */
@@ -397,8 +767,11 @@ static void upipe_sws_input(struct upipe *upipe, struct uref *uref,
 static int upipe_sws_check(struct upipe *upipe, struct uref *flow_format)
 {
     struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
-    if (flow_format != NULL)
+    if (flow_format != NULL) {
+        /* the scratch pictures may come from a previous ubuf manager */
+        upipe_sws_flush_scratch(upipe);
         upipe_sws_store_flow_def(upipe, flow_format);
+    }
 
     if (upipe_sws->flow_def == NULL)
         return UBASE_ERR_NONE;
@@ -517,17 +890,10 @@ static int upipe_sws_set_flow_def(struct upipe *upipe, struct uref *flow_def)
         }
     }
 
-    if (upipe_sws->input_pix_fmt == AV_PIX_FMT_YUV420P) {
-        av_opt_set_int(upipe_sws->convert_ctx[0], "src_v_chr_pos", 128, 0);
-        av_opt_set_int(upipe_sws->convert_ctx[1], "src_v_chr_pos", 64, 0);
-        av_opt_set_int(upipe_sws->convert_ctx[2], "src_v_chr_pos", 192, 0);
-    }
-
-    if (upipe_sws->output_pix_fmt == AV_PIX_FMT_YUV420P) {
-        av_opt_set_int(upipe_sws->convert_ctx[0], "dst_v_chr_pos", 128, 0);
-        av_opt_set_int(upipe_sws->convert_ctx[1], "dst_v_chr_pos", 64, 0);
-        av_opt_set_int(upipe_sws->convert_ctx[2], "dst_v_chr_pos", 192, 0);
-    }
+    upipe_sws_set_chroma_pos(upipe, upipe_sws->convert_ctx);
+    for (unsigned int k = 0; k < UPIPE_SWS_MAX_THREADS; k++)
+        if (upipe_sws->slice_ctx[k][0] != NULL)
+            upipe_sws_set_chroma_pos(upipe, upipe_sws->slice_ctx[k]);
     upipe_sws->colorspace_invalid = false;
 
     upipe_input(upipe, flow_def, NULL);
@@ -561,6 +927,47 @@ static int _upipe_sws_set_flags(struct upipe *upipe, int flags)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the number of slice threads, and allocates the
+ * conversion contexts of the slices.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static int _upipe_sws_set_threads(struct upipe *upipe, unsigned int threads)
+{
+    struct upipe_sws *upipe_sws = upipe_sws_from_upipe(upipe);
+    if (unlikely(threads < 1 || threads > UPIPE_SWS_MAX_THREADS))
+        return UBASE_ERR_INVALID;
+
+    for (unsigned int k = 0; k < threads; k++) {
+        if (upipe_sws->slice_ctx[k][0] != NULL)
+            continue;
+        for (int i = 0; i < 3; i++) {
+            upipe_sws->slice_ctx[k][i] = sws_alloc_context();
+            UBASE_ALLOC_RETURN(upipe_sws->slice_ctx[k][i])
+        }
+        if (upipe_sws->input_pix_fmt != AV_PIX_FMT_NONE)
+            upipe_sws_set_chroma_pos(upipe, upipe_sws->slice_ctx[k]);
+    }
+
+    struct uband_pool *band_pool = NULL;
+    if (threads > 1) {
+        band_pool = uband_pool_alloc(threads);
+        UBASE_ALLOC_RETURN(band_pool)
+        if (uband_pool_threads(band_pool) < threads)
+            upipe_warn_va(upipe, "only %u slice threads available",
+                          uband_pool_threads(band_pool));
+    }
+
+    uband_pool_free(upipe_sws->band_pool);
+    upipe_sws->band_pool = band_pool;
+    upipe_sws_flush_scratch(upipe);
+    upipe_sws->threads = threads;
+    upipe_dbg_va(upipe, "using %u slice threads", threads);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a file source pipe, and
  * checks the status of the pipe afterwards.
  *
@@ -616,6 +1023,17 @@ static int upipe_sws_control(struct upipe *upipe, int command, va_list args)
             int flags = va_arg(args, int);
             return _upipe_sws_set_flags(upipe, flags);
         }
+        case UPIPE_SWS_GET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_SIGNATURE)
+            unsigned int *threads_p = va_arg(args, unsigned int *);
+            *threads_p = upipe_sws_from_upipe(upipe)->threads;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SWS_SET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_SWS_SIGNATURE)
+            unsigned int threads = va_arg(args, unsigned int);
+            return _upipe_sws_set_threads(upipe, threads);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -655,6 +1073,14 @@ static struct upipe *upipe_sws_alloc(struct upipe_mgr *mgr,
     upipe_sws_init_flow_def(upipe);
     upipe_sws_init_input(upipe);
     upipe_sws->colorspace_invalid = false;
+    upipe_sws->input_pix_fmt = AV_PIX_FMT_NONE;
+    upipe_sws->threads = 1;
+    upipe_sws->band_pool = NULL;
+    memset(upipe_sws->slice_ctx, 0, sizeof(upipe_sws->slice_ctx));
+    memset(upipe_sws->slice_scratch, 0, sizeof(upipe_sws->slice_scratch));
+    memset(upipe_sws->slice_scratch_vsize, 0,
+           sizeof(upipe_sws->slice_scratch_vsize));
+    upipe_sws->slice_scratch_hsize = 0;
 
     memset(upipe_sws->convert_ctx, 0, sizeof(upipe_sws->convert_ctx));
     for (int i = 0; i < 3; i++) {
@@ -697,6 +1123,12 @@ static void upipe_sws_free(struct upipe *upipe)
             sws_freeContext(upipe_sws->convert_ctx[i]);
         upipe_sws->convert_ctx[i] = NULL;
     }
+    for (unsigned int k = 0; k < UPIPE_SWS_MAX_THREADS; k++)
+        for (int i = 0; i < 3; i++)
+            if (upipe_sws->slice_ctx[k][i] != NULL)
+                sws_freeContext(upipe_sws->slice_ctx[k][i]);
+    uband_pool_free(upipe_sws->band_pool);
+    upipe_sws_flush_scratch(upipe);
 
     upipe_throw_dead(upipe);
     upipe_sws_clean_input(upipe);
@@ -105,6 +105,12 @@ struct upipe_sws_thumbs {
 
     /** swscale image conversion context */
     struct SwsContext *convert_ctx;
+    /** accumulators of the area-average downscaler */
+    uint16_t *box_acc;
+    /** number of accumulators */
+    size_t box_acc_size;
+    /** function adding a line to the accumulators */
+    upipe_sws_thumbs_accumulate accumulate;
 
     /** output thumb size */
     struct picsize *thumbsize;
@@ -167,6 +173,110 @@ static inline bool upipe_sws_thumbs_set_context(struct upipe *upipe,
     return true;
 }
 
+/** @internal @This checks if a picture may be downscaled by averaging
+ * areas of input samples, which requires the same pixel format on both
+ * sides, 8-bit planar samples and integer ratios.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref input picture
+ * @param srcsize input size
+ * @param dstsize thumbnail size
+ * @return true if the area-average downscaler may be used
+ */
+static bool upipe_sws_thumbs_box_check(struct upipe *upipe, struct uref *uref,
+                                       struct picsize *srcsize,
+                                       struct picsize *dstsize)
+{
+    struct upipe_sws_thumbs *upipe_sws_thumbs = upipe_sws_thumbs_from_upipe(upipe);
+    if (upipe_sws_thumbs->input_pix_fmt != upipe_sws_thumbs->output_pix_fmt ||
+        !dstsize->hsize || !dstsize->vsize ||
+        srcsize->hsize % dstsize->hsize || srcsize->vsize % dstsize->vsize)
+        return false;
+
+    /* the accumulators hold 16 bits */
+    if (srcsize->vsize / dstsize->vsize > UINT16_MAX / UINT8_MAX)
+        return false;
+
+    uint8_t macropixel;
+    if (!ubase_check(uref_pic_size(uref, NULL, NULL, &macropixel)) ||
+        macropixel != 1)
+        return false;
+
+    const char **planes = upipe_sws_thumbs->input_chroma_map;
+    for (int i = 0; i < UPIPE_AV_MAX_PLANES && planes[i]; i++) {
+        uint8_t hsub, vsub, macropixel_size;
+        if (upipe_sws_thumbs->output_chroma_map[i] == NULL ||
+            strcmp(planes[i], upipe_sws_thumbs->output_chroma_map[i]) ||
+            !ubase_check(uref_pic_plane_size(uref, planes[i], NULL,
+                                             &hsub, &vsub, &macropixel_size)) ||
+            macropixel_size != 1 ||
+            srcsize->hsize % hsub || srcsize->vsize % vsub ||
+            dstsize->hsize % hsub || dstsize->vsize % vsub)
+            return false;
+    }
+    return true;
+}
+
+/** @internal @This downscales a picture by averaging areas of input
+ * samples, directly into the gallery.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref input picture
+ * @param slices mapped input planes
+ * @param strides input strides
+ * @param dslices mapped output planes, at the position of the thumbnail
+ * @param dstrides output strides
+ * @param srcsize input size
+ * @param dstsize thumbnail size
+ * @return the number of output lines, or -1 in case of error
+ */
+static int upipe_sws_thumbs_box(struct upipe *upipe, struct uref *uref,
+                                const uint8_t *const *slices,
+                                const int *strides,
+                                uint8_t *const *dslices, const int *dstrides,
+                                struct picsize *srcsize,
+                                struct picsize *dstsize)
+{
+    struct upipe_sws_thumbs *upipe_sws_thumbs = upipe_sws_thumbs_from_upipe(upipe);
+    unsigned int hfactor = srcsize->hsize / dstsize->hsize;
+    unsigned int vfactor = srcsize->vsize / dstsize->vsize;
+
+    if (upipe_sws_thumbs->box_acc_size < srcsize->hsize) {
+        uint16_t *acc = realloc(upipe_sws_thumbs->box_acc,
+                                srcsize->hsize * sizeof(uint16_t));
+        if (unlikely(acc == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return -1;
+        }
+        upipe_sws_thumbs->box_acc = acc;
+        upipe_sws_thumbs->box_acc_size = srcsize->hsize;
+    }
+    uint16_t *acc = upipe_sws_thumbs->box_acc;
+
+    const char **planes = upipe_sws_thumbs->input_chroma_map;
+    for (int i = 0; i < UPIPE_AV_MAX_PLANES && planes[i]; i++) {
+        uint8_t hsub, vsub;
+        if (unlikely(!ubase_check(uref_pic_plane_size(uref, planes[i], NULL,
+                                                      &hsub, &vsub, NULL))))
+            return -1;
+        size_t width = dstsize->hsize / hsub;
+        size_t lines = dstsize->vsize / vsub;
+        const uint8_t *src = slices[i];
+        uint8_t *dst = dslices[i];
+        for (size_t y = 0; y < lines; y++) {
+            memset(acc, 0, width * hfactor * sizeof(uint16_t));
+            for (unsigned int k = 0; k < vfactor; k++) {
+                upipe_sws_thumbs->accumulate(acc, src, width * hfactor);
+                src += strides[i];
+            }
+            upipe_sws_thumbs_average_c(dst, acc, width, hfactor,
+                                       hfactor * vfactor);
+            dst += dstrides[i];
+        }
+    }
+    return dstsize->vsize;
+}
+
 /** @internal @This flushes current thumbs gallery.
  *
  * @param upipe description structure of the pipe
@@ -267,8 +377,12 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
     pos.hsize = thumbsize->hsize*(counter % thumbnum->hsize);
     pos.vsize = thumbsize->vsize*(counter / thumbnum->hsize);
 
+    /* integer ratios are averaged without swscale */
+    bool box = upipe_sws_thumbs_box_check(upipe, uref, &inputsize, &surface);
+
     /* get sws context */
-    if (unlikely(!upipe_sws_thumbs_set_context(upipe, &inputsize, &surface))) {
+    if (!box &&
+        unlikely(!upipe_sws_thumbs_set_context(upipe, &inputsize, &surface))) {
         uref_free(uref);
         return true;
     }
@@ -318,9 +432,13 @@ static bool upipe_sws_thumbs_handle(struct upipe *upipe, struct uref *uref,
     }
 
     /* fire ! */
-    ret = sws_scale(upipe_sws_thumbs->convert_ctx,
-                    (const uint8_t *const*) slices, strides, 0, inputsize.vsize,
-                    dslices, dstrides);
+    if (box)
+        ret = upipe_sws_thumbs_box(upipe, uref, slices, strides,
+                                   dslices, dstrides, &inputsize, &surface);
+    else
+        ret = sws_scale(upipe_sws_thumbs->convert_ctx,
+                        (const uint8_t *const*) slices, strides,
+                        0, inputsize.vsize, dslices, dstrides);
 
     /* unmap pictures */
     planes = upipe_sws_thumbs->input_chroma_map;
@@ -657,6 +775,15 @@ static struct upipe *upipe_sws_thumbs_alloc(struct upipe_mgr *mgr,
     upipe_sws_thumbs_init_input(upipe);
 
     upipe_sws_thumbs->convert_ctx = NULL;
+    upipe_sws_thumbs->box_acc = NULL;
+    upipe_sws_thumbs->box_acc_size = 0;
+    upipe_sws_thumbs->accumulate = upipe_sws_thumbs_accumulate_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_AVX2))
+        upipe_sws_thumbs->accumulate = upipe_sws_thumbs_accumulate_avx2;
+    else if (ucpu_has(UCPU_SSE2))
+        upipe_sws_thumbs->accumulate = upipe_sws_thumbs_accumulate_sse2;
+#endif
 
     upipe_sws_thumbs->thumbsize = NULL;
     upipe_sws_thumbs->thumbnum = NULL;
@@ -685,6 +812,7 @@ static void upipe_sws_thumbs_free(struct upipe *upipe)
     if (likely(upipe_sws_thumbs->convert_ctx)) {
         sws_freeContext(upipe_sws_thumbs->convert_ctx);
     }
+    free(upipe_sws_thumbs->box_acc);
     free(upipe_sws_thumbs->thumbsize);
     free(upipe_sws_thumbs->thumbnum);
     if (upipe_sws_thumbs->gallery) {
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short area-average downscaling functions of the thumbnail pipe
+ *
+ * Lines of input samples are summed into 16-bit accumulators, then groups
+ * of accumulators are averaged into output samples, rounded to nearest.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-swscale/upipe_sws_thumbs.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @This adds a line of 8-bit samples to 16-bit accumulators.
+ *
+ * @param acc accumulators
+ * @param src source line
+ * @param width number of samples
+ */
+void upipe_sws_thumbs_accumulate_c(uint16_t *acc, const uint8_t *src,
+                                   size_t width)
+{
+    for ( ; width > 0; width--)
+        *acc++ += *src++;
+}
+
+/** @This averages groups of accumulators into 8-bit samples.
+ *
+ * @param dest dest line
+ * @param acc accumulators, hfactor per output sample
+ * @param width number of output samples
+ * @param hfactor number of accumulators per output sample
+ * @param area number of input samples per output sample
+ */
+void upipe_sws_thumbs_average_c(uint8_t *dest, const uint16_t *acc,
+                                size_t width, unsigned int hfactor,
+                                unsigned int area)
+{
+    for ( ; width > 0; width--) {
+        uint32_t sum = area / 2;
+        for (unsigned int i = 0; i < hfactor; i++)
+            sum += *acc++;
+        *dest++ = sum / area;
+    }
+}
+
+#ifdef UCPU_X86
+/** @This adds a line of 8-bit samples to 16-bit accumulators, using SSE2.
+ *
+ * @param acc accumulators
+ * @param src source line
+ * @param width number of samples
+ */
+__attribute__((target("sse2")))
+void upipe_sws_thumbs_accumulate_sse2(uint16_t *acc, const uint8_t *src,
+                                      size_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; width >= 16; width -= 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)src);
+        __m128i a0 = _mm_loadu_si128((const __m128i *)acc);
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(acc + 8));
+        a0 = _mm_add_epi16(a0, _mm_unpacklo_epi8(s, zero));
+        a1 = _mm_add_epi16(a1, _mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128((__m128i *)acc, a0);
+        _mm_storeu_si128((__m128i *)(acc + 8), a1);
+        acc += 16;
+        src += 16;
+    }
+    upipe_sws_thumbs_accumulate_c(acc, src, width);
+}
+
+/** @This adds a line of 8-bit samples to 16-bit accumulators, using AVX2.
+ *
+ * @param acc accumulators
+ * @param src source line
+ * @param width number of samples
+ */
+__attribute__((target("avx2")))
+void upipe_sws_thumbs_accumulate_avx2(uint16_t *acc, const uint8_t *src,
+                                      size_t width)
+{
+    for ( ; width >= 32; width -= 32) {
+        __m256i s0 = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *)src));
+        __m256i s1 = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *)(src + 16)));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)acc);
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + 16));
+        _mm256_storeu_si256((__m256i *)acc, _mm256_add_epi16(a0, s0));
+        _mm256_storeu_si256((__m256i *)(acc + 16), _mm256_add_epi16(a1, s1));
+        acc += 32;
+        src += 32;
+    }
+    upipe_sws_thumbs_accumulate_sse2(acc, src, width);
+}
+#endif
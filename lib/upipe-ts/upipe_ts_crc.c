@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe fast CRC-32/MPEG-2 computation for PSI sections
+ * Normative references:
+ *  - ISO/IEC 13818-1:2007(E) (MPEG-2 Systems, Annex A)
+ *  - Intel, Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ *    Instruction (2009)
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ucpu.h>
+#include <upipe-ts/upipe_ts_crc.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef UCPU_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+/** CRC-32/MPEG-2 polynomial */
+#define UPIPE_TS_CRC_POLY UINT32_C(0x04c11db7)
+
+/** slicing-by-8 tables, built at load time */
+static uint32_t upipe_ts_crc_table[8][256];
+
+/** @internal @This builds the slicing-by-8 tables. */
+static void __attribute__((constructor)) upipe_ts_crc_init_table(void)
+{
+    for (unsigned int i = 0; i < 256; i++) {
+        uint32_t crc = i << 24;
+        for (int j = 0; j < 8; j++)
+            crc = (crc << 1) ^ (crc & 0x80000000 ? UPIPE_TS_CRC_POLY : 0);
+        upipe_ts_crc_table[0][i] = crc;
+    }
+    for (unsigned int i = 0; i < 256; i++)
+        for (int j = 1; j < 8; j++) {
+            uint32_t prev = upipe_ts_crc_table[j - 1][i];
+            upipe_ts_crc_table[j][i] =
+                (prev << 8) ^ upipe_ts_crc_table[0][prev >> 24];
+        }
+}
+
+/** @This updates a CRC-32/MPEG-2 with the portable slicing-by-8
+ * implementation.
+ *
+ * @param crc current CRC value
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value
+ */
+uint32_t upipe_ts_crc32_c(uint32_t crc, const uint8_t *buffer, size_t size)
+{
+    const uint32_t (*t)[256] = (const uint32_t (*)[256])upipe_ts_crc_table;
+
+    while (size >= 8) {
+        uint32_t a = crc ^ (((uint32_t)buffer[0] << 24) |
+                            ((uint32_t)buffer[1] << 16) |
+                            ((uint32_t)buffer[2] << 8) | buffer[3]);
+        uint32_t b = ((uint32_t)buffer[4] << 24) |
+                     ((uint32_t)buffer[5] << 16) |
+                     ((uint32_t)buffer[6] << 8) | buffer[7];
+        crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^
+              t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff] ^
+              t[3][b >> 24] ^ t[2][(b >> 16) & 0xff] ^
+              t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+        buffer += 8;
+        size -= 8;
+    }
+
+    while (size--)
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *buffer++];
+    return crc;
+}
+
+#ifdef UCPU_X86
+/* Each 16-octet block is byte-swapped so that bit i of the 128-bit register
+ * is the coefficient of x^i. A block V = H.x^64 + L located D bits before
+ * the next one is folded as H.(x^(D+64) mod P) + L.(x^D mod P). The
+ * constants below are (x^(D+64) mod P) << 64 | (x^D mod P). */
+
+/** fold by 128 bits (one block) */
+#define UPIPE_TS_CRC_K128 0xc5b9cd4c, 0xe8a45605
+/** fold by 256 bits */
+#define UPIPE_TS_CRC_K256 0x569700e5, 0x75be46b7
+/** fold by 384 bits */
+#define UPIPE_TS_CRC_K384 0x64bf7a9b, 0x8c3828a8
+/** fold by 512 bits (four blocks) */
+#define UPIPE_TS_CRC_K512 0x8833794c, 0xe6228b11
+
+/** @internal @This builds a constant pair for @ref upipe_ts_crc_fold. */
+#define UPIPE_TS_CRC_CONST(k) upipe_ts_crc_const(k)
+
+/** @internal @This builds a folding constant.
+ *
+ * @param hi x^(D+64) mod P
+ * @param lo x^D mod P
+ * @return folding constant
+ */
+static inline __attribute__((target("ssse3,pclmul")))
+    __m128i upipe_ts_crc_const(uint32_t hi, uint32_t lo)
+{
+    return _mm_set_epi32(0, hi, 0, lo);
+}
+
+/** @internal @This folds a 128-bit block.
+ *
+ * @param v block to fold
+ * @param k folding constant
+ * @return folded block, to be xored with the block located D bits after
+ */
+static inline __attribute__((target("ssse3,pclmul")))
+    __m128i upipe_ts_crc_fold(__m128i v, __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(v, k, 0x11),
+                         _mm_clmulepi64_si128(v, k, 0x00));
+}
+
+/** @internal @This loads and byte-swaps a 128-bit block.
+ *
+ * @param buffer pointer to octets
+ * @param bswap byte-swapping shuffle mask
+ * @return 128-bit block
+ */
+static inline __attribute__((target("ssse3,pclmul")))
+    __m128i upipe_ts_crc_load(const uint8_t *buffer, __m128i bswap)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buffer), bswap);
+}
+
+/** @internal @This updates a CRC-32/MPEG-2 using PCLMULQDQ folding.
+ *
+ * @param crc current CRC value
+ * @param buffer pointer to octets, at least 64
+ * @param size number of octets
+ * @return updated CRC value
+ */
+static __attribute__((target("ssse3,pclmul")))
+    uint32_t upipe_ts_crc32_clmul_x86(uint32_t crc, const uint8_t *buffer,
+                                      size_t size)
+{
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k128 = UPIPE_TS_CRC_CONST(UPIPE_TS_CRC_K128);
+
+    /* the initial CRC is equivalent to xoring it with the first octets */
+    __m128i x0 = _mm_xor_si128(upipe_ts_crc_load(buffer, bswap),
+                               _mm_set_epi32(crc, 0, 0, 0));
+    __m128i x1 = upipe_ts_crc_load(buffer + 16, bswap);
+    __m128i x2 = upipe_ts_crc_load(buffer + 32, bswap);
+    __m128i x3 = upipe_ts_crc_load(buffer + 48, bswap);
+    buffer += 64;
+    size -= 64;
+
+    const __m128i k512 = UPIPE_TS_CRC_CONST(UPIPE_TS_CRC_K512);
+    while (size >= 64) {
+        x0 = _mm_xor_si128(upipe_ts_crc_fold(x0, k512),
+                           upipe_ts_crc_load(buffer, bswap));
+        x1 = _mm_xor_si128(upipe_ts_crc_fold(x1, k512),
+                           upipe_ts_crc_load(buffer + 16, bswap));
+        x2 = _mm_xor_si128(upipe_ts_crc_fold(x2, k512),
+                           upipe_ts_crc_load(buffer + 32, bswap));
+        x3 = _mm_xor_si128(upipe_ts_crc_fold(x3, k512),
+                           upipe_ts_crc_load(buffer + 48, bswap));
+        buffer += 64;
+        size -= 64;
+    }
+
+    /* merge the four lanes */
+    __m128i x = _mm_xor_si128(
+        _mm_xor_si128(
+            upipe_ts_crc_fold(x0, UPIPE_TS_CRC_CONST(UPIPE_TS_CRC_K384)),
+            upipe_ts_crc_fold(x1, UPIPE_TS_CRC_CONST(UPIPE_TS_CRC_K256))),
+        _mm_xor_si128(upipe_ts_crc_fold(x2, k128), x3));
+
+    while (size >= 16) {
+        x = _mm_xor_si128(upipe_ts_crc_fold(x, k128),
+                          upipe_ts_crc_load(buffer, bswap));
+        buffer += 16;
+        size -= 16;
+    }
+
+    /* the remaining 128-bit block is congruent to the processed octets,
+     * so finish with a zero-initialized table-driven CRC */
+    uint8_t tail[16];
+    _mm_storeu_si128((__m128i *)tail, _mm_shuffle_epi8(x, bswap));
+    crc = upipe_ts_crc32_c(0, tail, sizeof(tail));
+    return upipe_ts_crc32_c(crc, buffer, size);
+}
+#endif
+
+/** @This updates a CRC-32/MPEG-2 with the PCLMULQDQ implementation.
+ *
+ * @param crc current CRC value
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value
+ */
+uint32_t upipe_ts_crc32_clmul(uint32_t crc, const uint8_t *buffer,
+                              size_t size)
+{
+#ifdef UCPU_X86
+    if (size >= 64 && ucpu_has(UCPU_SSSE3 | UCPU_PCLMUL))
+        return upipe_ts_crc32_clmul_x86(crc, buffer, size);
+#endif
+    return upipe_ts_crc32_c(crc, buffer, size);
+}
+
+/** @hidden */
+static uint32_t upipe_ts_crc32_resolve(uint32_t crc, const uint8_t *buffer,
+                                       size_t size);
+
+/** implementation selected at runtime */
+static uint32_t (*upipe_ts_crc32_impl)(uint32_t, const uint8_t *, size_t) =
+    upipe_ts_crc32_resolve;
+
+#ifdef UCPU_X86
+/** @internal @This dispatches small buffers to the table-driven
+ * implementation, which is faster for them.
+ *
+ * @param crc current CRC value
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value
+ */
+static uint32_t upipe_ts_crc32_x86(uint32_t crc, const uint8_t *buffer,
+                                   size_t size)
+{
+    if (size >= 64)
+        return upipe_ts_crc32_clmul_x86(crc, buffer, size);
+    return upipe_ts_crc32_c(crc, buffer, size);
+}
+#endif
+
+/** @internal @This selects the implementation on the first call. Concurrent
+ * first calls are harmless as they all store the same pointer.
+ *
+ * @param crc current CRC value
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value
+ */
+static uint32_t upipe_ts_crc32_resolve(uint32_t crc, const uint8_t *buffer,
+                                       size_t size)
+{
+    upipe_ts_crc32_impl = upipe_ts_crc32_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSSE3 | UCPU_PCLMUL))
+        upipe_ts_crc32_impl = upipe_ts_crc32_x86;
+#endif
+    return upipe_ts_crc32_impl(crc, buffer, size);
+}
+
+/** @This updates a CRC-32/MPEG-2 with the given octets, using the fastest
+ * implementation available on the running CPU.
+ *
+ * @param crc current CRC value, initialize with @ref UPIPE_TS_CRC_INIT
+ * @param buffer pointer to octets
+ * @param size number of octets
+ * @return updated CRC value
+ */
+uint32_t upipe_ts_crc32(uint32_t crc, const uint8_t *buffer, size_t size)
+{
+    return upipe_ts_crc32_impl(crc, buffer, size);
+}
@@ -0,0 +1,962 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module descrambling DVB-CSA transport streams
+ *
+ * The DVB common scrambling algorithm chains a stream cipher, initialized
+ * with the first 8 octets of the payload, and a block cipher working
+ * backwards on 8-octet blocks. Since the keystream only depends on the
+ * control word and on the first block, it is computed for a whole batch at
+ * once, with the state of the stream cipher bitsliced over 64-bit words
+ * (bit l of each word belongs to packet l). The block cipher is then run
+ * independently on every block.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uclock.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe-ts/upipe_ts_csa.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+
+/** we only accept TS packets */
+#define EXPECTED_FLOW_DEF "block.mpegts."
+/** size of a block of the block cipher */
+#define CSA_BLOCK_SIZE 8
+/** max number of blocks deciphered together */
+#define CSA_MAX_BLOCKS 256
+/** number of registers kept for each shift register of the stream cipher */
+#define CSA_STREAM_WINDOW 64
+/** max time a packet is held before its batch is descrambled */
+#define MAX_LATENCY (UCLOCK_FREQ / 25)
+/** scrambling_control value of packets scrambled with the even key */
+#define CSA_SCRAMBLING_EVEN 0x2
+
+/** permutation of the bits of the key schedule (1-based) */
+static const uint8_t upipe_ts_csa_key_perm[64] = {
+    0x12, 0x24, 0x09, 0x07, 0x2a, 0x31, 0x1d, 0x15,
+    0x1c, 0x36, 0x3e, 0x32, 0x13, 0x21, 0x3b, 0x40,
+    0x18, 0x14, 0x25, 0x27, 0x02, 0x35, 0x1b, 0x01,
+    0x22, 0x04, 0x0d, 0x0e, 0x39, 0x28, 0x1a, 0x29,
+    0x33, 0x23, 0x34, 0x0c, 0x16, 0x30, 0x1e, 0x3a,
+    0x2d, 0x1f, 0x08, 0x19, 0x17, 0x2f, 0x3d, 0x11,
+    0x3c, 0x05, 0x38, 0x2b, 0x0b, 0x06, 0x0a, 0x2c,
+    0x20, 0x3f, 0x2e, 0x0f, 0x03, 0x26, 0x10, 0x37
+};
+
+/** S-box of the block cipher */
+static const uint8_t upipe_ts_csa_block_sbox[256] = {
+    0x3a, 0xea, 0x68, 0xfe, 0x33, 0xe9, 0x88, 0x1a,
+    0x83, 0xcf, 0xe1, 0x7f, 0xba, 0xe2, 0x38, 0x12,
+    0xe8, 0x27, 0x61, 0x95, 0x0c, 0x36, 0xe5, 0x70,
+    0xa2, 0x06, 0x82, 0x7c, 0x17, 0xa3, 0x26, 0x49,
+    0xbe, 0x7a, 0x6d, 0x47, 0xc1, 0x51, 0x8f, 0xf3,
+    0xcc, 0x5b, 0x67, 0xbd, 0xcd, 0x18, 0x08, 0xc9,
+    0xff, 0x69, 0xef, 0x03, 0x4e, 0x48, 0x4a, 0x84,
+    0x3f, 0xb4, 0x10, 0x04, 0xdc, 0xf5, 0x5c, 0xc6,
+    0x16, 0xab, 0xac, 0x4c, 0xf1, 0x6a, 0x2f, 0x3c,
+    0x3b, 0xd4, 0xd5, 0x94, 0xd0, 0xc4, 0x63, 0x62,
+    0x71, 0xa1, 0xf9, 0x4f, 0x2e, 0xaa, 0xc5, 0x56,
+    0xe3, 0x39, 0x93, 0xce, 0x65, 0x64, 0xe4, 0x58,
+    0x6c, 0x19, 0x42, 0x79, 0xdd, 0xee, 0x96, 0xf6,
+    0x8a, 0xec, 0x1e, 0x85, 0x53, 0x45, 0xde, 0xbb,
+    0x7e, 0x0a, 0x9a, 0x13, 0x2a, 0x9d, 0xc2, 0x5e,
+    0x5a, 0x1f, 0x32, 0x35, 0x9c, 0xa8, 0x73, 0x30,
+    0x29, 0x3d, 0xe7, 0x92, 0x87, 0x1b, 0x2b, 0x4b,
+    0xa5, 0x57, 0x97, 0x40, 0x15, 0xe6, 0xbc, 0x0e,
+    0xeb, 0xc3, 0x34, 0x2d, 0xb8, 0x44, 0x25, 0xa4,
+    0x1c, 0xc7, 0x23, 0xed, 0x90, 0x6e, 0x50, 0x00,
+    0x99, 0x9e, 0x4d, 0xd9, 0xda, 0x8d, 0x6f, 0x5f,
+    0x3e, 0xd7, 0x21, 0x74, 0x86, 0xdf, 0x6b, 0x05,
+    0x8e, 0x5d, 0x37, 0x11, 0xd2, 0x28, 0x75, 0xd6,
+    0xa7, 0x77, 0x24, 0xbf, 0xf0, 0xb0, 0x02, 0xb7,
+    0xf8, 0xfc, 0x81, 0x09, 0xb1, 0x01, 0x76, 0x91,
+    0x7d, 0x0f, 0xc8, 0xa0, 0xf2, 0xcb, 0x78, 0x60,
+    0xd1, 0xf7, 0xe0, 0xb5, 0x98, 0x22, 0xb3, 0x20,
+    0x1d, 0xa6, 0xdb, 0x7b, 0x59, 0x9f, 0xae, 0x31,
+    0xfb, 0xd3, 0xb6, 0xca, 0x43, 0x72, 0x07, 0xf4,
+    0xd8, 0x41, 0x14, 0x55, 0x0d, 0x54, 0x8b, 0xb9,
+    0xad, 0x46, 0x0b, 0xaf, 0x80, 0x52, 0x2c, 0xfa,
+    0x8c, 0x89, 0x66, 0xfd, 0xb2, 0xa9, 0x9b, 0xc0
+};
+
+/** algebraic normal forms of the low and high output bits of the seven
+ * S-boxes of the stream cipher: bit m is set if the product of the input
+ * bits set in m is a term of the output bit */
+static const uint32_t upipe_ts_csa_stream_anf[7][2] = {
+    { 0x35020b24, 0x5d59766f },
+    { 0x29182835, 0x1e4001e7 },
+    { 0x0001012c, 0x52fd5fe7 },
+    { 0x5b861a1d, 0x5b87419b },
+    { 0x0ff226b8, 0x66d66bef },
+    { 0x48c854d2, 0x02093824 },
+    { 0x0c0111da, 0x48da091e }
+};
+
+/** @This computes the key schedule of a control word.
+ *
+ * @param key key to initialize
+ * @param cw control word
+ */
+void upipe_ts_csa_key_init(struct upipe_ts_csa_key *key, const uint8_t *cw)
+{
+    uint8_t kb[7][UPIPE_TS_CSA_CW_SIZE];
+    memcpy(key->cw, cw, UPIPE_TS_CSA_CW_SIZE);
+    memcpy(kb[6], cw, UPIPE_TS_CSA_CW_SIZE);
+
+    for (int i = 6; i > 0; i--) {
+        memset(kb[i - 1], 0, UPIPE_TS_CSA_CW_SIZE);
+        for (int j = 0; j < 64; j++) {
+            if (!(kb[i][j / 8] & (0x80 >> (j % 8))))
+                continue;
+            int k = upipe_ts_csa_key_perm[j] - 1;
+            kb[i - 1][k / 8] |= 0x80 >> (k % 8);
+        }
+    }
+
+    for (int i = 0; i < 7; i++)
+        for (int j = 0; j < UPIPE_TS_CSA_CW_SIZE; j++)
+            key->kk[i * UPIPE_TS_CSA_CW_SIZE + j] = kb[i][j] ^ i;
+}
+
+/** @internal @This permutes the bits of the output of the block S-box.
+ *
+ * @param x output of the S-box
+ * @return permuted value
+ */
+static inline uint8_t upipe_ts_csa_block_perm(uint8_t x)
+{
+    return ((x & 0x29) << 1) | ((x & 0x02) << 6) | ((x & 0x04) << 3) |
+           ((x & 0x10) >> 2) | ((x & 0x40) >> 6) | ((x & 0x80) >> 4);
+}
+
+/** @internal @This loads a block into a word, first octet in the least
+ * significant bits.
+ *
+ * @param block block of 8 octets
+ * @return loaded word
+ */
+static inline uint64_t upipe_ts_csa_block_load(const uint8_t *block)
+{
+    uint64_t r = 0;
+    for (int k = CSA_BLOCK_SIZE - 1; k >= 0; k--)
+        r = (r << 8) | block[k];
+    return r;
+}
+
+/** @internal @This stores a word loaded with @ref upipe_ts_csa_block_load.
+ *
+ * @param block block of 8 octets
+ * @param r word to store
+ */
+static inline void upipe_ts_csa_block_store(uint8_t *block, uint64_t r)
+{
+    for (int k = 0; k < CSA_BLOCK_SIZE; k++)
+        block[k] = r >> (8 * k);
+}
+
+/** @internal @This deciphers independent blocks in place. The rounds of all
+ * blocks are interleaved so that the table lookups of different blocks
+ * overlap.
+ *
+ * @param kk key schedule
+ * @param blocks blocks loaded with @ref upipe_ts_csa_block_load
+ * @param nb number of blocks
+ */
+static void upipe_ts_csa_block_decipher(const uint8_t *kk, uint64_t *blocks,
+                                        unsigned int nb)
+{
+    for (int i = 55; i >= 0; i--) {
+        for (unsigned int j = 0; j < nb; j++) {
+            /* octet k of r is register R(k+1) */
+            uint64_t r = blocks[j];
+            uint8_t sbox = upipe_ts_csa_block_sbox[kk[i] ^ (uint8_t)(r >> 48)];
+            uint64_t t = (r >> 56) ^ sbox;
+            /* R1 = t, R3..R5 ^= t, R7 ^= perm */
+            blocks[j] = (r << 8) ^ (t * UINT64_C(0x0000000101010001)) ^
+                        ((uint64_t)upipe_ts_csa_block_perm(sbox) << 48);
+        }
+    }
+}
+
+/** @internal @This enciphers a block in place.
+ *
+ * @param kk key schedule
+ * @param block block of 8 octets
+ */
+static inline void upipe_ts_csa_block_encipher(const uint8_t *kk,
+                                               uint8_t *block)
+{
+    uint8_t r1 = block[0], r2 = block[1], r3 = block[2], r4 = block[3],
+            r5 = block[4], r6 = block[5], r7 = block[6], r8 = block[7];
+
+    for (int i = 0; i < 56; i++) {
+        uint8_t sbox = upipe_ts_csa_block_sbox[kk[i] ^ r8];
+        uint8_t t = r1;
+        r1 = r2;
+        r2 = r3 ^ t;
+        r3 = r4 ^ t;
+        r4 = r5 ^ t;
+        r5 = r6;
+        r6 = r7 ^ upipe_ts_csa_block_perm(sbox);
+        r7 = r8;
+        r8 = t ^ sbox;
+    }
+
+    block[0] = r1; block[1] = r2; block[2] = r3; block[3] = r4;
+    block[4] = r5; block[5] = r6; block[6] = r7; block[7] = r8;
+}
+
+/** @internal @This is the bitsliced state of the stream cipher. Each nibble
+ * register is stored as 4 words, from the least significant bit. */
+struct upipe_ts_csa_stream {
+    /** registers A1 to A10, starting at head, sliding down at each clock */
+    uint64_t a[CSA_STREAM_WINDOW][4];
+    /** registers B1 to B10, starting at head, sliding down at each clock */
+    uint64_t b[CSA_STREAM_WINDOW][4];
+    /** index of A1 and B1 */
+    unsigned int head;
+    /** combiner registers */
+    uint64_t x[4], y[4], z[4], d[4], e[4], f[4];
+    /** rotation and carry control bits, carry */
+    uint64_t p, q, r;
+};
+
+/** @internal @This evaluates an S-box of the stream cipher on bitsliced
+ * inputs.
+ *
+ * @param anf algebraic normal forms of the S-box
+ * @param in inputs, from the least significant bit
+ * @param out filled in with the low and high output bits
+ */
+static inline void upipe_ts_csa_stream_sbox(const uint32_t *anf,
+                                            const uint64_t *in,
+                                            uint64_t *out)
+{
+    uint64_t m[32];
+    m[0] = UINT64_MAX;
+    m[1] = in[0];
+    m[2] = in[1];
+    m[3] = in[0] & in[1];
+    for (int i = 0; i < 4; i++)
+        m[4 | i] = m[i] & in[2];
+    for (int i = 0; i < 8; i++)
+        m[8 | i] = m[i] & in[3];
+    for (int i = 0; i < 16; i++)
+        m[16 | i] = m[i] & in[4];
+
+    for (int bit = 0; bit < 2; bit++) {
+        uint64_t o = 0;
+        for (uint32_t terms = anf[bit]; terms; terms &= terms - 1)
+            o ^= m[__builtin_ctz(terms)];
+        out[bit] = o;
+    }
+}
+
+/** @internal @This clocks the stream cipher once.
+ *
+ * @param s bitsliced state
+ * @param in_a nibble injected into A1 during initialization, or NULL
+ * @param in_b nibble injected into B1 during initialization, or NULL
+ * @param out filled in with the two output bits, from the least
+ * significant
+ */
+static void upipe_ts_csa_stream_clock(struct upipe_ts_csa_stream *s,
+                                      const uint64_t *in_a,
+                                      const uint64_t *in_b, uint64_t *out)
+{
+#define A(n, bit) s->a[s->head + (n) - 1][bit]
+#define B(n, bit) s->b[s->head + (n) - 1][bit]
+    const uint64_t sbox_in[7][5] = {
+        { A(9, 0), A(7, 3), A(6, 1), A(1, 2), A(4, 0) },
+        { A(9, 1), A(7, 0), A(6, 3), A(3, 2), A(2, 1) },
+        { A(6, 2), A(5, 3), A(5, 1), A(2, 0), A(1, 3) },
+        { A(8, 0), A(4, 2), A(2, 3), A(1, 1), A(3, 3) },
+        { A(9, 2), A(8, 1), A(6, 0), A(4, 3), A(5, 2) },
+        { A(9, 3), A(7, 2), A(5, 0), A(4, 1), A(3, 1) },
+        { A(8, 3), A(8, 2), A(7, 1), A(3, 0), A(2, 2) }
+    };
+    uint64_t sbox_out[7][2];
+    for (int i = 0; i < 7; i++)
+        upipe_ts_csa_stream_sbox(upipe_ts_csa_stream_anf[i], sbox_in[i],
+                                 sbox_out[i]);
+
+    uint64_t extra[4];
+    extra[0] = B(9, 2) ^ B(6, 3) ^ B(3, 1) ^ B(8, 0);
+    extra[1] = B(5, 3) ^ B(8, 2) ^ B(4, 0) ^ B(5, 1);
+    extra[2] = B(6, 0) ^ B(8, 1) ^ B(3, 3) ^ B(4, 2);
+    extra[3] = B(3, 0) ^ B(6, 1) ^ B(7, 2) ^ B(9, 3);
+
+    uint64_t next_a[4], next_b[4], rot_b[4];
+    for (int k = 0; k < 4; k++) {
+        next_a[k] = A(10, k) ^ s->x[k];
+        next_b[k] = B(7, k) ^ B(10, k) ^ s->y[k];
+        if (in_a != NULL) {
+            next_a[k] ^= s->d[k] ^ in_a[k];
+            next_b[k] ^= in_b[k];
+        }
+    }
+    /* rotate B1 left if p is set */
+    for (int k = 0; k < 4; k++)
+        rot_b[k] = next_b[(k + 3) % 4];
+    for (int k = 0; k < 4; k++)
+        next_b[k] = (next_b[k] & ~s->p) | (rot_b[k] & s->p);
+
+    /* F = Z + E + r if q is set, E otherwise */
+    uint64_t carry = s->r;
+    for (int k = 0; k < 4; k++) {
+        uint64_t t = s->z[k] ^ s->e[k];
+        uint64_t sum = t ^ carry;
+        carry = (s->z[k] & s->e[k]) | (carry & t);
+        s->d[k] = t ^ extra[k];
+        uint64_t next_e = s->f[k];
+        s->f[k] = (sum & s->q) | (s->e[k] & ~s->q);
+        s->e[k] = next_e;
+    }
+    s->r = (carry & s->q) | (s->r & ~s->q);
+
+    /* shift A and B by sliding the window instead of moving registers */
+    if (unlikely(!s->head)) {
+        s->head = CSA_STREAM_WINDOW - 10;
+        memmove(s->a[s->head], s->a[0], sizeof(s->a[0]) * 10);
+        memmove(s->b[s->head], s->b[0], sizeof(s->b[0]) * 10);
+    }
+    s->head--;
+    memcpy(s->a[s->head], next_a, sizeof(next_a));
+    memcpy(s->b[s->head], next_b, sizeof(next_b));
+
+    s->x[0] = sbox_out[0][1];
+    s->x[1] = sbox_out[1][1];
+    s->x[2] = sbox_out[2][0];
+    s->x[3] = sbox_out[3][0];
+    s->y[0] = sbox_out[2][1];
+    s->y[1] = sbox_out[3][1];
+    s->y[2] = sbox_out[4][0];
+    s->y[3] = sbox_out[5][0];
+    s->z[0] = sbox_out[4][1];
+    s->z[1] = sbox_out[5][1];
+    s->z[2] = sbox_out[0][0];
+    s->z[3] = sbox_out[1][0];
+    s->p = sbox_out[6][1];
+    s->q = sbox_out[6][0];
+
+    out[0] = s->d[0] ^ s->d[1];
+    out[1] = s->d[2] ^ s->d[3];
+#undef A
+#undef B
+}
+
+/** @internal @This initializes the stream cipher with the first block of
+ * each payload, and xors the keystream with the rest of the payloads.
+ *
+ * @param key DVB-CSA key
+ * @param payloads array of pointers to the payloads
+ * @param sizes array of sizes of the payloads, at least 8 octets
+ * @param nb number of payloads, at most 64
+ */
+static void upipe_ts_csa_stream_xor(const struct upipe_ts_csa_key *key,
+                                    uint8_t **payloads, const size_t *sizes,
+                                    unsigned int nb)
+{
+    struct upipe_ts_csa_stream s;
+    memset(&s, 0, sizeof(s));
+    s.head = CSA_STREAM_WINDOW - 10;
+    uint64_t (*a)[4] = s.a + s.head, (*b)[4] = s.b + s.head;
+    for (int i = 0; i < 4; i++) {
+        for (int k = 0; k < 4; k++) {
+            a[2 * i][k] = (key->cw[i] >> (4 + k)) & 1 ? UINT64_MAX : 0;
+            a[2 * i + 1][k] = (key->cw[i] >> k) & 1 ? UINT64_MAX : 0;
+            b[2 * i][k] = (key->cw[4 + i] >> (4 + k)) & 1 ? UINT64_MAX : 0;
+            b[2 * i + 1][k] = (key->cw[4 + i] >> k) & 1 ? UINT64_MAX : 0;
+        }
+    }
+
+    size_t max_size = 0;
+    for (unsigned int l = 0; l < nb; l++)
+        if (sizes[l] > max_size)
+            max_size = sizes[l];
+
+    uint64_t w[8], out[2];
+    for (int i = 0; i < CSA_BLOCK_SIZE; i++) {
+        memset(w, 0, sizeof(w));
+        for (unsigned int l = 0; l < nb; l++)
+            for (int k = 0; k < 8; k++)
+                w[k] |= (uint64_t)((payloads[l][i] >> k) & 1) << l;
+
+        /* high nibble first into A1, low nibble first into B1 */
+        for (int j = 0; j < 4; j++)
+            upipe_ts_csa_stream_clock(&s, j % 2 ? w : w + 4,
+                                      j % 2 ? w + 4 : w, out);
+    }
+
+    for (size_t i = CSA_BLOCK_SIZE; i < max_size; i++) {
+        for (int j = 0; j < 4; j++) {
+            upipe_ts_csa_stream_clock(&s, NULL, NULL, out);
+            w[7 - 2 * j] = out[1];
+            w[6 - 2 * j] = out[0];
+        }
+
+        for (unsigned int l = 0; l < nb; l++) {
+            if (i >= sizes[l])
+                continue;
+            uint8_t k = 0;
+            for (int bit = 0; bit < 8; bit++)
+                k |= ((w[bit] >> l) & 1) << bit;
+            payloads[l][i] ^= k;
+        }
+    }
+}
+
+/** @This descrambles a batch of TS payloads in place. Payloads shorter than
+ * 8 octets are not scrambled and are left untouched.
+ *
+ * @param key key used to scramble the payloads
+ * @param payloads array of pointers to the payloads
+ * @param sizes array of sizes of the payloads
+ * @param nb number of payloads, at most @ref UPIPE_TS_CSA_BATCH
+ */
+void upipe_ts_csa_descramble(const struct upipe_ts_csa_key *key,
+                             uint8_t **payloads, const size_t *sizes,
+                             unsigned int nb)
+{
+    uint8_t *scrambled[UPIPE_TS_CSA_BATCH];
+    size_t scrambled_sizes[UPIPE_TS_CSA_BATCH];
+    unsigned int nb_scrambled = 0;
+    assert(nb <= UPIPE_TS_CSA_BATCH);
+
+    for (unsigned int l = 0; l < nb; l++) {
+        if (sizes[l] < CSA_BLOCK_SIZE)
+            continue;
+        scrambled[nb_scrambled] = payloads[l];
+        scrambled_sizes[nb_scrambled] = sizes[l];
+        nb_scrambled++;
+    }
+    if (!nb_scrambled)
+        return;
+
+    /* the keystream only depends on the first (scrambled) block */
+    upipe_ts_csa_stream_xor(key, scrambled, scrambled_sizes, nb_scrambled);
+
+    /* blocks are independent once the keystream is removed; the plaintext
+     * is the deciphered block xored with the next (not yet deciphered)
+     * block, so blocks must be written back in increasing order */
+    uint64_t blocks[CSA_MAX_BLOCKS];
+    uint8_t *dests[CSA_MAX_BLOCKS];
+    bool lasts[CSA_MAX_BLOCKS];
+    unsigned int nb_blocks = 0;
+    for (unsigned int l = 0; l < nb_scrambled; l++) {
+        size_t nb_payload = scrambled_sizes[l] / CSA_BLOCK_SIZE;
+        for (size_t i = 0; i < nb_payload; i++) {
+            uint8_t *block = scrambled[l] + i * CSA_BLOCK_SIZE;
+            blocks[nb_blocks] = upipe_ts_csa_block_load(block);
+            dests[nb_blocks] = block;
+            lasts[nb_blocks] = i + 1 == nb_payload;
+            nb_blocks++;
+
+            if (nb_blocks < CSA_MAX_BLOCKS &&
+                (l + 1 < nb_scrambled || i + 1 < nb_payload))
+                continue;
+
+            upipe_ts_csa_block_decipher(key->kk, blocks, nb_blocks);
+            for (unsigned int j = 0; j < nb_blocks; j++) {
+                uint64_t r = blocks[j];
+                if (!lasts[j])
+                    r ^= upipe_ts_csa_block_load(dests[j] + CSA_BLOCK_SIZE);
+                upipe_ts_csa_block_store(dests[j], r);
+            }
+            nb_blocks = 0;
+        }
+    }
+}
+
+/** @This scrambles a TS payload in place. This is mostly useful to generate
+ * test streams, and is not optimized.
+ *
+ * @param key key used to scramble the payload
+ * @param payload pointer to the payload
+ * @param size size of the payload
+ */
+void upipe_ts_csa_scramble(const struct upipe_ts_csa_key *key,
+                           uint8_t *payload, size_t size)
+{
+    if (size < CSA_BLOCK_SIZE)
+        return;
+
+    size_t blocks = size / CSA_BLOCK_SIZE;
+    for (size_t i = blocks; i-- > 0; ) {
+        uint8_t *block = payload + i * CSA_BLOCK_SIZE;
+        if (i + 1 < blocks)
+            for (int j = 0; j < CSA_BLOCK_SIZE; j++)
+                block[j] ^= block[CSA_BLOCK_SIZE + j];
+        upipe_ts_csa_block_encipher(key->kk, block);
+    }
+
+    upipe_ts_csa_stream_xor(key, &payload, &size, 1);
+}
+
+/** @internal @This is the private context of a ts_csa pipe. */
+struct upipe_ts_csa {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** timer outputting the batch when the input stalls */
+    struct upump *upump;
+
+    /** even and odd keys */
+    struct upipe_ts_csa_key keys[2];
+    /** true if the even or odd key was set */
+    bool has_key[2];
+    /** true if a missing key was already reported */
+    bool warned;
+
+    /** max number of packets in a batch */
+    unsigned int batch_max;
+    /** number of packets in the current batch */
+    unsigned int batch_nb;
+    /** true if the current batch is scrambled with the odd key */
+    bool batch_odd;
+    /** date of the first packet of the current batch, or UINT64_MAX */
+    uint64_t batch_cr_sys;
+    /** packets of the current batch */
+    struct uref *batch[UPIPE_TS_CSA_BATCH];
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_csa, upipe, UPIPE_TS_CSA_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_csa, urefcount, upipe_ts_csa_free)
+UPIPE_HELPER_VOID(upipe_ts_csa)
+UPIPE_HELPER_OUTPUT(upipe_ts_csa, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UPUMP_MGR(upipe_ts_csa, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_ts_csa, upump, upump_mgr)
+
+/** @internal @This allocates a ts_csa pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_csa_alloc(struct upipe_mgr *mgr,
+                                        struct uprobe *uprobe,
+                                        uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_ts_csa_alloc_void(mgr, uprobe, signature,
+                                                  args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_csa *upipe_ts_csa = upipe_ts_csa_from_upipe(upipe);
+    upipe_ts_csa_init_urefcount(upipe);
+    upipe_ts_csa_init_output(upipe);
+    upipe_ts_csa_init_upump_mgr(upipe);
+    upipe_ts_csa_init_upump(upipe);
+    upipe_ts_csa->has_key[0] = upipe_ts_csa->has_key[1] = false;
+    upipe_ts_csa->warned = false;
+    upipe_ts_csa->batch_max = UPIPE_TS_CSA_BATCH;
+    upipe_ts_csa->batch_nb = 0;
+    upipe_ts_csa->batch_odd = false;
+    upipe_ts_csa->batch_cr_sys = UINT64_MAX;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This maps a TS packet for writing, copying it if the buffer
+ * is shared or segmented.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param ts_p filled in with a pointer to the packet
+ * @return false in case of error
+ */
+static bool upipe_ts_csa_map(struct upipe *upipe, struct uref *uref,
+                             uint8_t **ts_p)
+{
+    size_t size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &size)) ||
+                 size < TS_SIZE)) {
+        upipe_warn(upipe, "invalid TS packet");
+        return false;
+    }
+
+    int write_size = -1;
+    if (ubase_check(uref_block_write(uref, 0, &write_size, ts_p))) {
+        if (likely(write_size >= TS_SIZE))
+            return true;
+        uref_block_unmap(uref, 0);
+    }
+
+    struct ubuf *ubuf = ubuf_block_copy(uref->ubuf->mgr, uref->ubuf, 0,
+                                        TS_SIZE);
+    if (unlikely(ubuf == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return false;
+    }
+    uref_attach_ubuf(uref, ubuf);
+
+    write_size = -1;
+    if (unlikely(!ubase_check(uref_block_write(uref, 0, &write_size,
+                                               ts_p)))) {
+        upipe_warn(upipe, "unable to map TS packet");
+        return false;
+    }
+    if (unlikely(write_size < TS_SIZE)) {
+        uref_block_unmap(uref, 0);
+        upipe_warn(upipe, "unable to map TS packet");
+        return false;
+    }
+    return true;
+}
+
+/** @internal @This descrambles and outputs the current batch.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_csa_flush(struct upipe *upipe, struct upump **upump_p)
+{
+    struct upipe_ts_csa *upipe_ts_csa = upipe_ts_csa_from_upipe(upipe);
+    struct uref *urefs[UPIPE_TS_CSA_BATCH];
+    uint8_t *payloads[UPIPE_TS_CSA_BATCH];
+    size_t sizes[UPIPE_TS_CSA_BATCH];
+    unsigned int nb = 0;
+    upipe_ts_csa_set_upump(upipe, NULL);
+
+    for (unsigned int i = 0; i < upipe_ts_csa->batch_nb; i++) {
+        struct uref *uref = upipe_ts_csa->batch[i];
+        uint8_t *ts;
+        if (unlikely(!upipe_ts_csa_map(upipe, uref, &ts))) {
+            uref_free(uref);
+            continue;
+        }
+
+        ts_set_scrambling(ts, 0);
+        size_t offset = TS_HEADER_SIZE;
+        if (ts_has_adaptation(ts))
+            offset += 1 + ts_get_adaptation(ts);
+        urefs[nb] = uref;
+        payloads[nb] = ts + offset;
+        sizes[nb] = ts_has_payload(ts) && offset < TS_SIZE ?
+                    TS_SIZE - offset : 0;
+        nb++;
+    }
+    upipe_ts_csa->batch_nb = 0;
+    if (!nb)
+        return;
+
+    upipe_ts_csa_descramble(&upipe_ts_csa->keys[upipe_ts_csa->batch_odd ?
+                                                 1 : 0],
+                            payloads, sizes, nb);
+
+    for (unsigned int i = 0; i < nb; i++) {
+        uref_block_unmap(urefs[i], 0);
+        upipe_ts_csa_output(upipe, urefs[i], upump_p);
+    }
+}
+
+/** @internal @This is called when the first packet of the batch has been
+ * held for the max latency.
+ *
+ * @param upump description structure of the timer
+ */
+static void upipe_ts_csa_timer(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    upipe_use(upipe);
+    upipe_ts_csa_flush(upipe, NULL);
+    upipe_release(upipe);
+}
+
+/** @internal @This receives a TS packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_csa_input(struct upipe *upipe, struct uref *uref,
+                               struct upump **upump_p)
+{
+    struct upipe_ts_csa *upipe_ts_csa = upipe_ts_csa_from_upipe(upipe);
+    uint8_t buffer[TS_HEADER_SIZE];
+    const uint8_t *ts = uref_block_peek(uref, 0, TS_HEADER_SIZE, buffer);
+    if (unlikely(ts == NULL)) {
+        upipe_warn(upipe, "invalid TS packet");
+        uref_free(uref);
+        return;
+    }
+    uint8_t scrambling = ts_get_scrambling(ts);
+    if (unlikely(!ubase_check(uref_block_peek_unmap(uref, 0, buffer, ts)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_INVALID);
+        return;
+    }
+
+    if (!(scrambling & CSA_SCRAMBLING_EVEN)) {
+        /* clear (or reserved) packet */
+        upipe_ts_csa_flush(upipe, upump_p);
+        upipe_ts_csa_output(upipe, uref, upump_p);
+        return;
+    }
+
+    bool odd = scrambling & 0x1;
+    if (unlikely(!upipe_ts_csa->has_key[odd ? 1 : 0])) {
+        if (!upipe_ts_csa->warned) {
+            upipe_warn_va(upipe, "no %s control word, dropping packets",
+                          odd ? "odd" : "even");
+            upipe_ts_csa->warned = true;
+        }
+        uref_free(uref);
+        return;
+    }
+
+    if (upipe_ts_csa->batch_nb && upipe_ts_csa->batch_odd != odd)
+        upipe_ts_csa_flush(upipe, upump_p);
+    uint64_t cr_sys = UINT64_MAX;
+    uref_clock_get_cr_sys(uref, &cr_sys);
+    if (!upipe_ts_csa->batch_nb)
+        upipe_ts_csa->batch_cr_sys = cr_sys;
+    upipe_ts_csa->batch_odd = odd;
+    upipe_ts_csa->batch[upipe_ts_csa->batch_nb++] = uref;
+
+    /* low-bitrate PIDs get smaller batches */
+    if (upipe_ts_csa->batch_nb >= upipe_ts_csa->batch_max ||
+        (cr_sys != UINT64_MAX &&
+         upipe_ts_csa->batch_cr_sys != UINT64_MAX &&
+         cr_sys >= upipe_ts_csa->batch_cr_sys + MAX_LATENCY))
+        upipe_ts_csa_flush(upipe, upump_p);
+    else if (upipe_ts_csa->batch_nb == 1 && upipe_ts_csa->upump_mgr != NULL)
+        /* do not wait for the next packet if the input stalls */
+        upipe_ts_csa_wait_upump(upipe, MAX_LATENCY, upipe_ts_csa_timer);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_csa_set_flow_def(struct upipe *upipe,
+                                     struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_ts_csa_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the even or odd control word.
+ *
+ * @param upipe description structure of the pipe
+ * @param odd true for the odd control word
+ * @param cw control word, or NULL to unset it
+ * @return an error code
+ */
+static int _upipe_ts_csa_set_cw(struct upipe *upipe, bool odd,
+                                const uint8_t *cw)
+{
+    struct upipe_ts_csa *upipe_ts_csa = upipe_ts_csa_from_upipe(upipe);
+    if (upipe_ts_csa->batch_nb && upipe_ts_csa->batch_odd == odd)
+        upipe_ts_csa_flush(upipe, NULL);
+
+    if (cw == NULL) {
+        upipe_ts_csa->has_key[odd ? 1 : 0] = false;
+        return UBASE_ERR_NONE;
+    }
+    upipe_ts_csa_key_init(&upipe_ts_csa->keys[odd ? 1 : 0], cw);
+    upipe_ts_csa->has_key[odd ? 1 : 0] = true;
+    upipe_ts_csa->warned = false;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the max number of packets in a batch.
+ *
+ * @param upipe description structure of the pipe
+ * @param batch number of packets
+ * @return an error code
+ */
+static int _upipe_ts_csa_set_batch(struct upipe *upipe, unsigned int batch)
+{
+    struct upipe_ts_csa *upipe_ts_csa = upipe_ts_csa_from_upipe(upipe);
+    if (!batch || batch > UPIPE_TS_CSA_BATCH)
+        return UBASE_ERR_INVALID;
+    upipe_ts_csa->batch_max = batch;
+    if (upipe_ts_csa->batch_nb >= batch)
+        upipe_ts_csa_flush(upipe, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_csa pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_ts_csa_control(struct upipe *upipe, int command,
+                                 va_list args)
+{
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_ts_csa_set_upump(upipe, NULL);
+            return upipe_ts_csa_attach_upump_mgr(upipe);
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_csa_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_csa_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_ts_csa_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_csa_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_csa_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_ts_csa_set_output(upipe, output);
+        }
+        case UPIPE_FLUSH:
+            upipe_ts_csa_flush(upipe, NULL);
+            return UBASE_ERR_NONE;
+
+        case UPIPE_TS_CSA_SET_CW: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_CSA_SIGNATURE)
+            int odd = va_arg(args, int);
+            const uint8_t *cw = va_arg(args, const uint8_t *);
+            return _upipe_ts_csa_set_cw(upipe, !!odd, cw);
+        }
+        case UPIPE_TS_CSA_GET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_CSA_SIGNATURE)
+            unsigned int *batch_p = va_arg(args, unsigned int *);
+            *batch_p = upipe_ts_csa_from_upipe(upipe)->batch_max;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_CSA_SET_BATCH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_CSA_SIGNATURE)
+            unsigned int batch = va_arg(args, unsigned int);
+            return _upipe_ts_csa_set_batch(upipe, batch);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands and checks the upump manager,
+ * which is needed to output the batch when the input stalls.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_csa_control(struct upipe *upipe, int command, va_list args)
+{
+    UBASE_RETURN(_upipe_ts_csa_control(upipe, command, args))
+    /* without it, the batch is only output upon reception */
+    upipe_ts_csa_check_upump_mgr(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_csa_free(struct upipe *upipe)
+{
+    struct upipe_ts_csa *upipe_ts_csa = upipe_ts_csa_from_upipe(upipe);
+    upipe_ts_csa_flush(upipe, NULL);
+    upipe_throw_dead(upipe);
+
+    memset(upipe_ts_csa->keys, 0, sizeof(upipe_ts_csa->keys));
+    upipe_ts_csa_clean_upump(upipe);
+    upipe_ts_csa_clean_upump_mgr(upipe);
+    upipe_ts_csa_clean_output(upipe);
+    upipe_ts_csa_clean_urefcount(upipe);
+    upipe_ts_csa_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_csa_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_CSA_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_csa_alloc,
+    .upipe_input = upipe_ts_csa_input,
+    .upipe_control = upipe_ts_csa_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_csa pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_csa_mgr_alloc(void)
+{
+    return &upipe_ts_csa_mgr;
+}
@@ -55,6 +55,7 @@
 #include <upipe/upipe_helper_urefcount.h>
 #include <upipe/upipe_helper_void.h>
 #include <upipe/upipe_helper_uref_mgr.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
 #include <upipe/upipe_helper_flow.h>
 #include <upipe/upipe_helper_inner.h>
 #include <upipe/upipe_helper_uprobe.h>
@@ -78,6 +79,7 @@
 #include <upipe-ts/upipe_ts_psi_split.h>
 #include <upipe-ts/upipe_ts_pat_decoder.h>
 #include <upipe-ts/upipe_ts_pmt_decoder.h>
+#include <upipe-ts/upipe_ts_psi_cache.h>
 #include <upipe-ts/upipe_ts_pes_decaps.h>
 #include <upipe-ts/upipe_ts_scte35_decoder.h>
 #include <upipe-ts/upipe_ts_sdt_decoder.h>
@@ -197,6 +199,13 @@ struct upipe_ts_demux {
     /** uref manager request */
     struct urequest uref_mgr_request;
 
+    /** ubuf manager, to feed sections from the PSI cache */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
     /** pipe acting as output */
     struct upipe *output;
     /** output flow definition */
@@ -260,6 +269,10 @@ struct upipe_ts_demux {
     bool auto_conformance;
     /** current conformance */
     enum upipe_ts_conformance conformance;
+    /** optional PSI cache */
+    struct upipe_ts_psi_cache *psi_cache;
+    /** key of the stream in the PSI cache */
+    char *psi_cache_key;
 
     /** probe to get new flow events from inner pipes created by psi_pid
      * objects */
@@ -301,6 +314,9 @@ UPIPE_HELPER_BIN_INPUT(upipe_ts_demux, input, input_request_list)
 UPIPE_HELPER_UREF_MGR(upipe_ts_demux, uref_mgr, uref_mgr_request, NULL,
                       upipe_ts_demux_register_output_request,
                       upipe_ts_demux_unregister_output_request)
+UPIPE_HELPER_UBUF_MGR(upipe_ts_demux, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      NULL, upipe_ts_demux_register_output_request,
+                      upipe_ts_demux_unregister_output_request)
 
 UBASE_FROM_TO(upipe_ts_demux, urefcount, urefcount_real, urefcount_real)
 
@@ -359,6 +375,15 @@ struct upipe_ts_demux_program {
     /** highest Upipe timestamp given to a frame */
     uint64_t timestamp_highest;
 
+    /** PCR statistics */
+    struct upipe_ts_demux_pcr_stats pcr_stats;
+    /** arrival date of the last PCR, or UINT64_MAX */
+    uint64_t pcr_last_sys;
+    /** PCR of the drift reference, or UINT64_MAX */
+    uint64_t pcr_drift_pcr;
+    /** arrival date of the drift reference */
+    uint64_t pcr_drift_sys;
+
     /** probe to get events from ts_pmtd inner pipe */
     struct uprobe pmtd_probe;
     /** probe to get events from ts_eitd inner pipe */
@@ -601,6 +626,140 @@ static void
     }
 }
 
+/** @internal @This stores the table in effect in a PSI decoder into the PSI
+ * cache.
+ *
+ * @param upipe description structure of the pipe
+ * @param psid PSI decoder inner pipe
+ * @param pid PID of the table
+ */
+static void upipe_ts_demux_psi_cache_store(struct upipe *upipe,
+                                           struct upipe *psid, uint16_t pid)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    if (upipe_ts_demux->psi_cache == NULL)
+        return;
+
+    uint8_t *table = NULL;
+    size_t size = 0;
+    struct uref *section;
+    for (unsigned int i = 0;
+         ubase_check(upipe_ts_psid_get_section(psid, i, &section)); i++) {
+        size_t section_size;
+        uint8_t *tmp;
+        if (unlikely(!ubase_check(uref_block_size(section, &section_size)) ||
+                     (tmp = realloc(table, size + section_size)) == NULL)) {
+            free(table);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        table = tmp;
+        if (unlikely(!ubase_check(uref_block_extract(section, 0, section_size,
+                                                     table + size)))) {
+            free(table);
+            upipe_throw_fatal(upipe, UBASE_ERR_INVALID);
+            return;
+        }
+        size += section_size;
+    }
+
+    if (size && !ubase_check(upipe_ts_psi_cache_set(upipe_ts_demux->psi_cache,
+                    upipe_ts_demux->psi_cache_key, pid, table, size)))
+        upipe_warn_va(upipe, "unable to cache the table of PID %"PRIu16, pid);
+    free(table);
+}
+
+/** @internal @This feeds a PSI decoder which has not received any table yet
+ * with the table found in the PSI cache, so that programs and outputs may be
+ * created before the table is received. The sections go through the filter
+ * of the psi_split output, as they would if they were received.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi_split_output ts_psi_split output inner pipe feeding the decoder
+ * @param psid PSI decoder inner pipe
+ * @param pid PID of the table
+ */
+static void upipe_ts_demux_psi_cache_inject(struct upipe *upipe,
+                                            struct upipe *psi_split_output,
+                                            struct upipe *psid, uint16_t pid)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    const uint8_t *table;
+    size_t size;
+    struct uref *section;
+    if (upipe_ts_demux->psi_cache == NULL ||
+        ubase_check(upipe_ts_psid_get_section(psid, 0, &section)) ||
+        !ubase_check(upipe_ts_psi_cache_get(upipe_ts_demux->psi_cache,
+                upipe_ts_demux->psi_cache_key, pid, &table, &size)))
+        return;
+
+    if (upipe_ts_demux->ubuf_mgr == NULL) {
+        struct uref *flow_format =
+            uref_block_flow_alloc_def(upipe_ts_demux->uref_mgr, "mpegtspsi.");
+        if (unlikely(flow_format == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        if (!upipe_ts_demux_demand_ubuf_mgr(upipe, flow_format)) {
+            upipe_warn(upipe, "no ubuf manager to warm start from the cache");
+            return;
+        }
+    }
+
+    /* the decoder only gets its flow definition with the first section */
+    struct uref *flow_def;
+    const uint8_t *filter, *mask;
+    size_t filter_size;
+    if (!ubase_check(upipe_get_flow_def(psi_split_output, &flow_def)) ||
+        flow_def == NULL ||
+        !ubase_check(uref_ts_flow_get_psi_filter(flow_def, &filter, &mask,
+                                                 &filter_size)) ||
+        !ubase_check(upipe_set_flow_def(psid, flow_def)) ||
+        !ubase_check(upipe_get_flow_def(psid, &flow_def)) ||
+        flow_def == NULL) {
+        upipe_warn_va(upipe, "unable to warm start PID %"PRIu16, pid);
+        return;
+    }
+
+    /* allocate all sections first, as the cache changes when the decoder
+     * throws its update */
+    struct uchain sections;
+    ulist_init(&sections);
+    while (size >= PSI_HEADER_SIZE &&
+           size >= PSI_HEADER_SIZE + psi_get_length(table)) {
+        size_t section_size = PSI_HEADER_SIZE + psi_get_length(table);
+        bool match = section_size >= filter_size;
+        for (size_t i = 0; match && i < filter_size; i++)
+            match = (table[i] & mask[i]) == filter[i];
+
+        if (match) {
+            struct uref *uref = uref_block_alloc(upipe_ts_demux->uref_mgr,
+                                                 upipe_ts_demux->ubuf_mgr,
+                                                 section_size);
+            uint8_t *buffer;
+            int buffer_size = -1;
+            if (unlikely(uref == NULL ||
+                         !ubase_check(uref_block_write(uref, 0, &buffer_size,
+                                                       &buffer)))) {
+                uref_free(uref);
+                break;
+            }
+            memcpy(buffer, table, section_size);
+            uref_block_unmap(uref, 0);
+            ulist_add(&sections, uref_to_uchain(uref));
+        }
+        table += section_size;
+        size -= section_size;
+    }
+
+    if (!ulist_empty(&sections))
+        upipe_dbg_va(upipe, "warm starting PID %"PRIu16" from the PSI cache",
+                     pid);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&sections)) != NULL)
+        upipe_input(psid, uref_from_uchain(uchain), NULL);
+}
+
 
 /*
  * upipe_ts_demux_output structure handling (derived from upipe structure)
@@ -1306,6 +1465,10 @@ static int upipe_ts_demux_program_pmtd_update(struct upipe *upipe,
             upipe_throw_source_end(upipe_ts_demux_output_to_upipe(output));
     }
 
+    struct upipe_ts_demux *demux = upipe_ts_demux_from_program_mgr(upipe->mgr);
+    upipe_ts_demux_psi_cache_store(upipe_ts_demux_to_upipe(demux), pmtd,
+                                   upipe_ts_demux_program->pmt_pid);
+
     /* send the event upstream */
     upipe_split_throw_update(upipe);
 
@@ -1425,6 +1588,89 @@ static int upipe_ts_demux_program_proxy_probe(struct uprobe *uprobe,
     return upipe_throw_proxy(upipe, inner, event, args);
 }
 
+/** @internal @This resets the PCR statistics of a program.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void _upipe_ts_demux_program_reset_pcr_stats(
+        struct upipe *upipe)
+{
+    struct upipe_ts_demux_program *program =
+        upipe_ts_demux_program_from_upipe(upipe);
+    memset(&program->pcr_stats, 0, sizeof(program->pcr_stats));
+    program->pcr_stats.interval_min = UINT64_MAX;
+    program->pcr_stats.jitter_min = INT64_MAX;
+    program->pcr_stats.jitter_max = INT64_MIN;
+    program->pcr_last_sys = UINT64_MAX;
+    program->pcr_drift_pcr = UINT64_MAX;
+}
+
+/** @internal @This updates the PCR statistics of a program.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref carrying the PCR
+ * @param delta interval since the previous PCR
+ * @param discontinuity true if a discontinuity occurred before
+ * @param first true if this is the first PCR of the program
+ */
+static void upipe_ts_demux_program_pcr_stats(struct upipe *upipe,
+                                             struct uref *uref,
+                                             uint64_t delta,
+                                             int discontinuity, bool first)
+{
+    struct upipe_ts_demux_program *program =
+        upipe_ts_demux_program_from_upipe(upipe);
+    struct upipe_ts_demux_pcr_stats *stats = &program->pcr_stats;
+    uint64_t last_sys = program->pcr_last_sys;
+    uint64_t cr_sys = UINT64_MAX;
+    uref_clock_get_cr_sys(uref, &cr_sys);
+    program->pcr_last_sys = cr_sys;
+
+    stats->pcrs++;
+    if (first) {
+        /* no previous PCR, hence no interval */
+        program->pcr_drift_pcr = UINT64_MAX;
+    } else if (discontinuity) {
+        stats->discontinuities++;
+        program->pcr_drift_pcr = UINT64_MAX;
+    } else {
+        if (delta < stats->interval_min)
+            stats->interval_min = delta;
+        if (delta > stats->interval_max)
+            stats->interval_max = delta;
+    }
+    if (cr_sys == UINT64_MAX)
+        return;
+
+    if (program->pcr_drift_pcr == UINT64_MAX) {
+        program->pcr_drift_pcr = program->last_pcr;
+        program->pcr_drift_sys = cr_sys;
+    } else {
+        uint64_t pcr_span = program->last_pcr - program->pcr_drift_pcr;
+        if (pcr_span >= UCLOCK_FREQ)
+            stats->drift_ppm =
+                (double)((int64_t)(cr_sys - program->pcr_drift_sys) -
+                         (int64_t)pcr_span) * 1000000. / pcr_span;
+    }
+    if (discontinuity || last_sys == UINT64_MAX)
+        return;
+
+    int64_t jitter = (int64_t)(cr_sys - last_sys) - (int64_t)delta;
+    stats->jitters++;
+    if (jitter < stats->jitter_min)
+        stats->jitter_min = jitter;
+    if (jitter > stats->jitter_max)
+        stats->jitter_max = jitter;
+
+    uint64_t us = (jitter < 0 ? -jitter : jitter) / (UCLOCK_FREQ / 1000000);
+    unsigned int bucket = 0;
+    while (us && bucket < UPIPE_TS_DEMUX_PCR_JITTER_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    stats->jitter_histogram[bucket]++;
+}
+
 /** @internal @This handles PCRs coming from clock_ref events.
  *
  * @param upipe description structure of the pipe
@@ -1440,6 +1686,7 @@ static void upipe_ts_demux_program_handle_pcr(struct upipe *upipe,
     struct upipe_ts_demux_program *upipe_ts_demux_program =
         upipe_ts_demux_program_from_upipe(upipe);
     upipe_verbose_va(upipe, "read PCR %"PRIu64, pcr_orig);
+    bool first = upipe_ts_demux_program->last_pcr == TS_CLOCK_MAX;
 
     /* handle 2^33 wrap-arounds */
     uint64_t delta =
@@ -1449,12 +1696,15 @@ static void upipe_ts_demux_program_handle_pcr(struct upipe *upipe,
         upipe_ts_demux_program->last_pcr += delta;
     else {
         /* FIXME same clock for all programs */
-        upipe_warn_va(upipe, "PCR discontinuity %"PRIu64, delta);
+        if (!first)
+            upipe_warn_va(upipe, "PCR discontinuity %"PRIu64, delta);
         upipe_ts_demux_program->last_pcr = pcr_orig;
         upipe_ts_demux_program->timestamp_offset =
             upipe_ts_demux_program->timestamp_highest - pcr_orig;
         discontinuity = 1;
     }
+    upipe_ts_demux_program_pcr_stats(upipe, uref, delta, discontinuity,
+                                     first);
     upipe_throw_clock_ref(upipe, uref,
                           upipe_ts_demux_program->last_pcr +
                           upipe_ts_demux_program->timestamp_offset,
@@ -1597,6 +1847,7 @@ static struct upipe *upipe_ts_demux_program_alloc(struct upipe_mgr *mgr,
     upipe_ts_demux_program->timestamp_offset = 0;
     upipe_ts_demux_program->timestamp_highest = TS_CLOCK_MAX;
     upipe_ts_demux_program->last_pcr = TS_CLOCK_MAX;
+    _upipe_ts_demux_program_reset_pcr_stats(upipe);
     uprobe_init(&upipe_ts_demux_program->pmtd_probe,
                 upipe_ts_demux_program_pmtd_probe, NULL);
     upipe_ts_demux_program->pmtd_probe.refcount =
@@ -1674,6 +1925,9 @@ static struct upipe *upipe_ts_demux_program_alloc(struct upipe_mgr *mgr,
         return upipe;
     }
     upipe_ts_demux_program_build_flow_def(upipe);
+    upipe_ts_demux_psi_cache_inject(upipe_ts_demux_to_upipe(demux),
+            upipe_ts_demux_program->psi_split_output_pmt,
+            upipe_ts_demux_program->pmtd, upipe_ts_demux_program->pmt_pid);
 
     return upipe;
 }
@@ -1722,6 +1976,19 @@ static int upipe_ts_demux_program_control(struct upipe *upipe,
             return upipe_split_iterate(upipe_ts_demux_program->pmtd, p);
         }
 
+        case UPIPE_TS_DEMUX_PROGRAM_GET_PCR_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_PROGRAM_SIGNATURE)
+            struct upipe_ts_demux_pcr_stats *stats_p =
+                va_arg(args, struct upipe_ts_demux_pcr_stats *);
+            *stats_p = upipe_ts_demux_program_from_upipe(upipe)->pcr_stats;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_DEMUX_PROGRAM_RESET_PCR_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_PROGRAM_SIGNATURE)
+            _upipe_ts_demux_program_reset_pcr_stats(upipe);
+            return UBASE_ERR_NONE;
+        }
+
         default:
             return UBASE_ERR_NONE;
     }
@@ -2388,6 +2655,7 @@ static int upipe_ts_demux_patd_update(struct upipe *upipe,
     if (program != NULL)
         upipe_release(upipe_ts_demux_program_to_upipe(program));
 
+    upipe_ts_demux_psi_cache_store(upipe, patd, PAT_PID);
     return upipe_ts_demux_build_pat_programs(upipe);
 }
 
@@ -2569,6 +2837,7 @@ static struct upipe *upipe_ts_demux_alloc(struct upipe_mgr *mgr,
     upipe_ts_demux_init_bin_input(upipe);
     upipe_ts_demux_init_output(upipe);
     upipe_ts_demux_init_uref_mgr(upipe);
+    upipe_ts_demux_init_ubuf_mgr(upipe);
     upipe_ts_demux_init_program_mgr(upipe);
     upipe_ts_demux_init_sub_programs(upipe);
 
@@ -2587,6 +2856,8 @@ static struct upipe *upipe_ts_demux_alloc(struct upipe_mgr *mgr,
     upipe_ts_demux->conformance = UPIPE_TS_CONFORMANCE_DVB_NO_TABLES;
     upipe_ts_demux->auto_conformance = true;
     upipe_ts_demux->nit_pid = 0;
+    upipe_ts_demux->psi_cache = NULL;
+    upipe_ts_demux->psi_cache_key = NULL;
     upipe_ts_demux->flow_def_input = NULL;
 
     uprobe_init(&upipe_ts_demux->psi_pid_plumber,
@@ -2808,6 +3079,49 @@ static int _upipe_ts_demux_set_conformance(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the PSI cache, and feeds the decoders with the
+ * tables it contains.
+ *
+ * @param upipe description structure of the pipe
+ * @param cache pointer to the PSI cache, or NULL
+ * @param key key of the stream in the cache
+ * @return an error code
+ */
+static int _upipe_ts_demux_set_psi_cache(struct upipe *upipe,
+                                         struct upipe_ts_psi_cache *cache,
+                                         const char *key)
+{
+    struct upipe_ts_demux *upipe_ts_demux = upipe_ts_demux_from_upipe(upipe);
+    upipe_ts_psi_cache_release(upipe_ts_demux->psi_cache);
+    upipe_ts_demux->psi_cache = NULL;
+    free(upipe_ts_demux->psi_cache_key);
+    upipe_ts_demux->psi_cache_key = NULL;
+    if (cache == NULL)
+        return UBASE_ERR_NONE;
+    if (key == NULL)
+        return UBASE_ERR_INVALID;
+
+    upipe_ts_demux->psi_cache_key = strdup(key);
+    UBASE_ALLOC_RETURN(upipe_ts_demux->psi_cache_key);
+    upipe_ts_demux->psi_cache = upipe_ts_psi_cache_use(cache);
+
+    if (upipe_ts_demux->patd != NULL)
+        upipe_ts_demux_psi_cache_inject(upipe,
+                upipe_ts_demux->psi_split_output_pat, upipe_ts_demux->patd,
+                PAT_PID);
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_demux->programs, uchain) {
+        struct upipe_ts_demux_program *program =
+            upipe_ts_demux_program_from_uchain(uchain);
+        if (program->pmtd != NULL)
+            upipe_ts_demux_psi_cache_inject(upipe,
+                    program->psi_split_output_pmt, program->pmtd,
+                    program->pmt_pid);
+    }
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a ts_demux pipe.
  *
  * @param upipe description structure of the pipe
@@ -2866,6 +3180,13 @@ static int upipe_ts_demux_control(struct upipe *upipe,
                 va_arg(args, enum upipe_ts_conformance);
             return _upipe_ts_demux_set_conformance(upipe, conformance);
         }
+        case UPIPE_TS_DEMUX_SET_PSI_CACHE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_ts_psi_cache *cache =
+                va_arg(args, struct upipe_ts_psi_cache *);
+            const char *key = va_arg(args, const char *);
+            return _upipe_ts_demux_set_psi_cache(upipe, cache, key);
+        }
 
         default:
             break;
@@ -2895,6 +3216,9 @@ static void upipe_ts_demux_free(struct urefcount *urefcount_real)
     upipe_ts_demux_clean_sub_programs(upipe);
     upipe_ts_demux_clean_sync(upipe);
     upipe_ts_demux_clean_uref_mgr(upipe);
+    upipe_ts_demux_clean_ubuf_mgr(upipe);
+    upipe_ts_psi_cache_release(upipe_ts_demux->psi_cache);
+    free(upipe_ts_demux->psi_cache_key);
     urefcount_clean(urefcount_real);
     upipe_ts_demux_clean_urefcount(upipe);
     upipe_ts_demux_free_void(upipe);
@@ -45,6 +45,7 @@
 #include <upipe-ts/upipe_ts_eit_decoder.h>
 #include <upipe-ts/uref_ts_event.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/upipe_ts_crc.h>
 #include "upipe_ts_psi_decoder.h"
 
 #include <stdlib.h>
@@ -94,6 +95,8 @@ struct upipe_ts_eitd {
     UPIPE_TS_PSID_TABLE_DECLARE(eit);
     /** EIT table being gathered */
     UPIPE_TS_PSID_TABLE_DECLARE(next_eit);
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
 
     /** encoding of the following iconv handle */
     const char *current_encoding;
@@ -140,6 +143,7 @@ static struct upipe *upipe_ts_eitd_alloc(struct upipe_mgr *mgr,
     upipe_ts_eitd_init_iconv(upipe);
     upipe_ts_psid_table_init(upipe_ts_eitd->eit);
     upipe_ts_psid_table_init(upipe_ts_eitd->next_eit);
+    upipe_ts_eitd->skipped = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -232,7 +236,7 @@ static bool upipe_ts_eitd_table_validate(struct upipe *upipe)
                                                   &section))))
             return false;
 
-        if (!eit_validate(section)) {
+        if (!eit_validate(section) || !upipe_ts_psi_check_crc(section)) {
             uref_block_unmap(section_uref, 0);
             return false;
         }
@@ -331,6 +335,13 @@ static void upipe_ts_eitd_input(struct upipe *upipe, struct uref *uref,
     struct upipe_ts_eitd *upipe_ts_eitd = upipe_ts_eitd_from_upipe(upipe);
     assert(upipe_ts_eitd->flow_def_input != NULL);
 
+    if (upipe_ts_psid_table_unchanged(upipe_ts_eitd->eit, uref)) {
+        /* Unchanged repetition of the EIT in effect. */
+        upipe_ts_eitd->skipped++;
+        uref_free(uref);
+        return;
+    }
+
     if (!upipe_ts_eitd_table_section(upipe_ts_eitd->next_eit, uref))
         return;
 
@@ -510,6 +521,14 @@ static int upipe_ts_eitd_control(struct upipe *upipe, int command, va_list args)
             return upipe_ts_eitd_set_output(upipe, output);
         }
 
+        case UPIPE_TS_PSID_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_ts_eitd *upipe_ts_eitd =
+                upipe_ts_eitd_from_upipe(upipe);
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_eitd->skipped;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
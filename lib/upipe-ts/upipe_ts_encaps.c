@@ -67,6 +67,9 @@
 #define PADDING_PID 8191
 /** TB buffer size in octets (T-STD model) */
 #define TB_SIZE 512
+/** number of TS headers pre-built in a single buffer, one for each
+ * continuity counter, with and without the unit start flag */
+#define HEADERS_TABLE 32
 /** define to get header verbosity */
 #undef VERBOSE_HEADERS
 /** define to get timing verbosity */
@@ -74,6 +77,8 @@
 
 /** @hidden */
 static int upipe_ts_encaps_check(struct upipe *upipe, struct uref *flow_format);
+/** @hidden */
+static void upipe_ts_encaps_flush_headers(struct upipe *upipe);
 
 /** @internal @This is the private context of a ts_encaps pipe. */
 struct upipe_ts_encaps {
@@ -144,6 +149,8 @@ struct upipe_ts_encaps {
 
     /** a padding packet for PSI streams */
     struct ubuf *padding;
+    /** table of pre-built TS headers without adaptation field */
+    struct ubuf *headers;
     /** last continuity counter for this PID */
     uint8_t last_cc;
     /** last time prepare was called */
@@ -230,6 +237,7 @@ static struct upipe *upipe_ts_encaps_alloc(struct upipe_mgr *mgr,
     upipe_ts_encaps->pes_min_duration = 0;
     upipe_ts_encaps->pes_alignment = true;
     upipe_ts_encaps->padding = NULL;
+    upipe_ts_encaps->headers = NULL;
     upipe_ts_encaps->last_cc = 0;
     upipe_ts_encaps->last_splice = 0;
     upipe_ts_encaps->last_pcr = 0;
@@ -438,6 +446,8 @@ static void upipe_ts_encaps_promote_uref(struct upipe *upipe)
             uref_ts_flow_get_tb_rate(uref, &encaps->tb_rate);
             uint64_t pid = PADDING_PID;
             uref_ts_flow_get_pid(uref, &pid);
+            if (pid != encaps->pid)
+                upipe_ts_encaps_flush_headers(upipe);
             encaps->pid = pid;
             encaps->max_delay = T_STD_MAX_RETENTION;
             uref_ts_flow_get_max_delay(uref, &encaps->max_delay);
@@ -1080,6 +1090,67 @@ static int upipe_ts_encaps_promote_au(struct upipe *upipe)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This releases the table of pre-built TS headers. The headers
+ * already handed out stay valid.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_encaps_flush_headers(struct upipe *upipe)
+{
+    struct upipe_ts_encaps *encaps = upipe_ts_encaps_from_upipe(upipe);
+    ubuf_free(encaps->headers);
+    encaps->headers = NULL;
+}
+
+/** @internal @This returns a TS header without adaptation field, spliced
+ * from a table of headers pre-built for the PID. This avoids allocating and
+ * initializing a buffer for each packet.
+ *
+ * The table holds one header for each continuity counter, with and without
+ * the unit start flag. It is entirely written and unmapped before the
+ * first header is spliced, so that the shared headers are never written.
+ *
+ * @param upipe description structure of the pipe
+ * @param start true if it's the first packet of the access unit
+ * @return spliced TS header, or NULL in case of allocation error
+ */
+static struct ubuf *upipe_ts_encaps_splice_header(struct upipe *upipe,
+                                                  bool start)
+{
+    struct upipe_ts_encaps *encaps = upipe_ts_encaps_from_upipe(upipe);
+    if (unlikely(encaps->headers == NULL)) {
+        struct ubuf *headers = ubuf_block_alloc(encaps->ubuf_mgr,
+                HEADERS_TABLE * TS_HEADER_SIZE);
+        uint8_t *buffer;
+        int size = -1;
+        if (unlikely(headers == NULL ||
+                     !ubase_check(ubuf_block_write(headers, 0,
+                                                   &size, &buffer)))) {
+            ubuf_free(headers);
+            return NULL;
+        }
+        assert(size == HEADERS_TABLE * TS_HEADER_SIZE);
+
+        for (int i = 0; i < HEADERS_TABLE; i++) {
+            uint8_t *header = buffer + i * TS_HEADER_SIZE;
+            ts_init(header);
+            ts_set_pid(header, encaps->pid);
+            ts_set_payload(header);
+            ts_set_cc(header, i & 0xf);
+            if (i >= HEADERS_TABLE / 2)
+                ts_set_unitstart(header);
+        }
+        ubuf_block_unmap(headers, 0);
+        encaps->headers = headers;
+    }
+
+    encaps->last_cc++;
+    encaps->last_cc &= 0xf;
+    int index = (start ? HEADERS_TABLE / 2 : 0) + encaps->last_cc;
+    return ubuf_block_splice(encaps->headers, index * TS_HEADER_SIZE,
+                             TS_HEADER_SIZE);
+}
+
 /** @internal @This builds a TS header.
  *
  * @param upipe description structure of the pipe
@@ -1113,6 +1184,9 @@ static struct ubuf *upipe_ts_encaps_build_ts(struct upipe *upipe,
             discontinuity ? ", disc" : "",
             pcr_prog != UINT64_MAX ? ", pcr" : "");
 #endif
+    if (likely(header_size == TS_HEADER_SIZE && payload_size))
+        return upipe_ts_encaps_splice_header(upipe, start);
+
     struct ubuf *ubuf = ubuf_block_alloc(encaps->ubuf_mgr, header_size);
     uint8_t *buffer;
     int size = -1;
@@ -1265,25 +1339,23 @@ static int _upipe_ts_encaps_splice(struct upipe *upipe, uint64_t cr_sys,
     encaps->last_splice = cr_sys;
 
     if (ubuf_p == NULL) {
-        /* Flush until cr_sys */
-        while (encaps->uref != NULL) {
-            if (encaps->uref_dts_sys != UINT64_MAX) {
-                uint64_t dts_sys = encaps->uref_dts_sys -
-                    (uint64_t)encaps->uref_size * UCLOCK_FREQ / encaps->tb_rate;
-                if (dts_sys >= cr_sys)
-                    break;
-
-                upipe_warn_va(upipe, "dropping late packet (%"PRIu64")",
-                              cr_sys - dts_sys);
-                upipe_ts_encaps_consume_uref(upipe);
-                encaps->au_size = 0;
-                encaps->need_ready = encaps->need_status = true;
+        /* Flush until cr_sys; without a date, lateness cannot be told */
+        while (encaps->uref != NULL && encaps->uref_dts_sys != UINT64_MAX) {
+            uint64_t dts_sys = encaps->uref_dts_sys -
+                (uint64_t)encaps->uref_size * UCLOCK_FREQ / encaps->tb_rate;
+            if (dts_sys >= cr_sys)
+                break;
 
-                /* Flush the rest of the access unit. */
-                while (encaps->uref != NULL &&
-                       !ubase_check(uref_block_get_start(encaps->uref)))
-                    upipe_ts_encaps_consume_uref(upipe);
-            }
+            upipe_warn_va(upipe, "dropping late packet (%"PRIu64")",
+                          cr_sys - dts_sys);
+            upipe_ts_encaps_consume_uref(upipe);
+            encaps->au_size = 0;
+            encaps->need_ready = encaps->need_status = true;
+
+            /* Flush the rest of the access unit. */
+            while (encaps->uref != NULL &&
+                   !ubase_check(uref_block_get_start(encaps->uref)))
+                upipe_ts_encaps_consume_uref(upipe);
         }
         upipe_ts_encaps_check_status(upipe);
         return UBASE_ERR_NONE;
@@ -1452,6 +1524,7 @@ static void upipe_ts_encaps_free(struct upipe *upipe)
 
     uref_free(upipe_ts_encaps->uref);
     ubuf_free(upipe_ts_encaps->padding);
+    upipe_ts_encaps_flush_headers(upipe);
     upipe_ts_encaps_clean_input(upipe);
     upipe_ts_encaps_clean_output(upipe);
     upipe_ts_encaps_clean_ubuf_mgr(upipe);
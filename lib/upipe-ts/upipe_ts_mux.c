@@ -79,6 +79,7 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 
 #include <bitstream/mpeg/ts.h>
@@ -155,6 +156,8 @@
 #define MAX_SDT_INTERVAL (UCLOCK_FREQ * 2)
 /** max EIT interval */
 #define MAX_EIT_INTERVAL (UCLOCK_FREQ * 2)
+/** default EIT schedule interval */
+#define DEFAULT_EIT_SCHED_INTERVAL (UCLOCK_FREQ * 10)
 /** max TDT interval */
 #define MAX_TDT_INTERVAL (UCLOCK_FREQ * 30)
 /** default TSID */
@@ -202,6 +205,21 @@ static int upipe_ts_mux_check(struct upipe *upipe, struct uref *unused);
 
 /** @hidden */
 struct upipe_ts_mux_psi_pid;
+/** @hidden */
+struct upipe_ts_mux_input;
+
+/** @internal @This defines the dates by which inputs are scheduled; each
+ * of them indexes a priority queue of all inputs. */
+enum upipe_ts_mux_sched {
+    /** cr_sys of the next packet */
+    UPIPE_TS_MUX_SCHED_CR,
+    /** dts_sys of the next packet */
+    UPIPE_TS_MUX_SCHED_DTS,
+    /** cr_sys of the next PCR */
+    UPIPE_TS_MUX_SCHED_PCR,
+    /** number of priority queues */
+    UPIPE_TS_MUX_SCHED_MAX
+};
 
 /** @internal @This is the private context of a ts_mux pipe. */
 struct upipe_ts_mux {
@@ -287,6 +305,8 @@ struct upipe_ts_mux {
     uint64_t sdt_interval;
     /** interval between EITs */
     uint64_t eit_interval;
+    /** interval between EIT schedules */
+    uint64_t eit_sched_interval;
     /** interval between TDTs */
     uint64_t tdt_interval;
     /** default maximum retention delay */
@@ -338,6 +358,23 @@ struct upipe_ts_mux {
 
     /** list of programs */
     struct uchain programs;
+    /** order of the next allocated program */
+    uint32_t program_order;
+    /** order of the next allocated input */
+    uint32_t input_order;
+
+    /** binary min-heaps of inputs, one per date */
+    struct upipe_ts_mux_input **sched[UPIPE_TS_MUX_SCHED_MAX];
+    /** scratch array of late inputs, of the allocated size of the heaps */
+    struct upipe_ts_mux_input **sched_late;
+    /** number of scheduled inputs */
+    unsigned int sched_size;
+    /** allocated size of the heaps */
+    unsigned int sched_alloc;
+    /** number of inputs preventing file mode muxing */
+    unsigned int sched_blocking;
+    /** number of deleted inputs waiting for their release */
+    unsigned int sched_zombies;
 
     /** manager to create programs */
     struct upipe_mgr program_mgr;
@@ -397,6 +434,8 @@ struct upipe_ts_mux_program {
     uint16_t sid;
     /** PMT PID */
     uint16_t pmt_pid;
+    /** order of the program in the list of programs */
+    uint32_t order;
 
     /** proxy probe */
     struct uprobe probe;
@@ -422,6 +461,8 @@ struct upipe_ts_mux_program {
     uint64_t scte35_interval;
     /** interval between EITs */
     uint64_t eit_interval;
+    /** interval between EIT schedules */
+    uint64_t eit_sched_interval;
     /** maximum retention delay */
     uint64_t max_delay;
 
@@ -516,6 +557,10 @@ struct upipe_ts_mux_input {
     uint64_t pcr_sys;
     /** true if the input is ready to output packet */
     bool ready;
+    /** order of the input in the lists of programs and inputs */
+    uint64_t order;
+    /** position in the scheduling heaps, or UINT_MAX */
+    unsigned int sched_index[UPIPE_TS_MUX_SCHED_MAX];
 
     /** psi_pid structure for PSI-based elementary streams */
     struct upipe_ts_mux_psi_pid *psi_pid;
@@ -793,6 +838,291 @@ static void upipe_ts_mux_psi_pid_release(struct upipe_ts_mux_psi_pid *psi_pid)
 }
 
 
+/*
+ * input scheduling
+ */
+
+/** @internal @This returns the date of an input for a scheduling heap.
+ *
+ * @param input input structure
+ * @param sched scheduling heap
+ * @return date
+ */
+static inline uint64_t upipe_ts_mux_input_date(struct upipe_ts_mux_input *input,
+                                               enum upipe_ts_mux_sched sched)
+{
+    switch (sched) {
+        case UPIPE_TS_MUX_SCHED_CR: return input->cr_sys;
+        case UPIPE_TS_MUX_SCHED_DTS: return input->dts_sys;
+        case UPIPE_TS_MUX_SCHED_PCR: return input->pcr_sys;
+        default: return UINT64_MAX;
+    }
+}
+
+/** @internal @This compares two inputs in a scheduling heap. Ties are broken
+ * by the order of the inputs in the lists of programs and inputs.
+ *
+ * @param input1 first input
+ * @param input2 second input
+ * @param sched scheduling heap
+ * @return true if input1 is to be scheduled before input2
+ */
+static inline bool upipe_ts_mux_sched_before(struct upipe_ts_mux_input *input1,
+                                             struct upipe_ts_mux_input *input2,
+                                             enum upipe_ts_mux_sched sched)
+{
+    uint64_t date1 = upipe_ts_mux_input_date(input1, sched);
+    uint64_t date2 = upipe_ts_mux_input_date(input2, sched);
+    return date1 < date2 || (date1 == date2 && input1->order < input2->order);
+}
+
+/** @internal @This stores an input at the given position of a heap.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param sched scheduling heap
+ * @param i position in the heap
+ * @param input input structure
+ */
+static inline void upipe_ts_mux_sched_set(struct upipe_ts_mux *mux,
+                                          enum upipe_ts_mux_sched sched,
+                                          unsigned int i,
+                                          struct upipe_ts_mux_input *input)
+{
+    mux->sched[sched][i] = input;
+    input->sched_index[sched] = i;
+}
+
+/** @internal @This restores the heap property after the date of the input
+ * at the given position changed.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param sched scheduling heap
+ * @param i position in the heap
+ */
+static void upipe_ts_mux_sched_fix(struct upipe_ts_mux *mux,
+                                   enum upipe_ts_mux_sched sched,
+                                   unsigned int i)
+{
+    struct upipe_ts_mux_input **heap = mux->sched[sched];
+    struct upipe_ts_mux_input *input = heap[i];
+
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (!upipe_ts_mux_sched_before(input, heap[parent], sched))
+            break;
+        upipe_ts_mux_sched_set(mux, sched, i, heap[parent]);
+        i = parent;
+    }
+
+    for ( ; ; ) {
+        unsigned int child = 2 * i + 1;
+        if (child >= mux->sched_size)
+            break;
+        if (child + 1 < mux->sched_size &&
+            upipe_ts_mux_sched_before(heap[child + 1], heap[child], sched))
+            child++;
+        if (!upipe_ts_mux_sched_before(heap[child], input, sched))
+            break;
+        upipe_ts_mux_sched_set(mux, sched, i, heap[child]);
+        i = child;
+    }
+    upipe_ts_mux_sched_set(mux, sched, i, input);
+}
+
+/** @internal @This returns the first input of a scheduling heap.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param sched scheduling heap
+ * @return pointer to the input, or NULL if there is no input
+ */
+static inline struct upipe_ts_mux_input *
+    upipe_ts_mux_sched_top(struct upipe_ts_mux *mux,
+                           enum upipe_ts_mux_sched sched)
+{
+    return mux->sched_size ? mux->sched[sched][0] : NULL;
+}
+
+/** @internal @This returns true if the input prevents muxing in file mode,
+ * because a packet is expected but not yet available.
+ *
+ * @param input input structure
+ * @return true if the input is blocking
+ */
+static inline bool upipe_ts_mux_input_blocking(struct upipe_ts_mux_input *input)
+{
+    return !input->ready && !input->deleted &&
+           input->input_type != UPIPE_TS_MUX_INPUT_OTHER &&
+           input->input_type != UPIPE_TS_MUX_INPUT_SCTE35;
+}
+
+/** @internal @This returns true if the input was deleted and has nothing
+ * left to output, so its encaps pipe may be released.
+ *
+ * @param input input structure
+ * @return true if the input is to be released
+ */
+static inline bool upipe_ts_mux_input_zombie(struct upipe_ts_mux_input *input)
+{
+    return !input->ready && input->deleted && input->encaps != NULL;
+}
+
+/** @internal @This updates the counters of blocking and deleted inputs. It is
+ * called with -1 before the state of an input changes, and 1 afterwards.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param input input structure
+ * @param sign -1 or 1
+ */
+static void upipe_ts_mux_sched_account(struct upipe_ts_mux *mux,
+                                       struct upipe_ts_mux_input *input,
+                                       int sign)
+{
+    if (input->sched_index[UPIPE_TS_MUX_SCHED_CR] == UINT_MAX)
+        return;
+    if (upipe_ts_mux_input_blocking(input))
+        mux->sched_blocking += sign;
+    if (upipe_ts_mux_input_zombie(input))
+        mux->sched_zombies += sign;
+}
+
+/** @internal @This adds an input to the scheduling heaps.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param input input structure
+ * @return an error code
+ */
+static int upipe_ts_mux_sched_add(struct upipe_ts_mux *mux,
+                                  struct upipe_ts_mux_input *input)
+{
+    if (mux->sched_size >= mux->sched_alloc) {
+        unsigned int alloc = mux->sched_alloc ? mux->sched_alloc * 2 : 16;
+        for (int sched = 0; sched < UPIPE_TS_MUX_SCHED_MAX; sched++) {
+            struct upipe_ts_mux_input **heap = realloc(mux->sched[sched],
+                    alloc * sizeof(struct upipe_ts_mux_input *));
+            UBASE_ALLOC_RETURN(heap);
+            mux->sched[sched] = heap;
+        }
+        struct upipe_ts_mux_input **late = realloc(mux->sched_late,
+                alloc * sizeof(struct upipe_ts_mux_input *));
+        UBASE_ALLOC_RETURN(late);
+        mux->sched_late = late;
+        mux->sched_alloc = alloc;
+    }
+
+    unsigned int i = mux->sched_size++;
+    for (int sched = 0; sched < UPIPE_TS_MUX_SCHED_MAX; sched++) {
+        upipe_ts_mux_sched_set(mux, sched, i, input);
+        upipe_ts_mux_sched_fix(mux, sched, i);
+    }
+    upipe_ts_mux_sched_account(mux, input, 1);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This removes an input from the scheduling heaps.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param input input structure
+ */
+static void upipe_ts_mux_sched_remove(struct upipe_ts_mux *mux,
+                                      struct upipe_ts_mux_input *input)
+{
+    if (input->sched_index[UPIPE_TS_MUX_SCHED_CR] == UINT_MAX)
+        return;
+    upipe_ts_mux_sched_account(mux, input, -1);
+
+    unsigned int last = --mux->sched_size;
+    for (int sched = 0; sched < UPIPE_TS_MUX_SCHED_MAX; sched++) {
+        unsigned int i = input->sched_index[sched];
+        input->sched_index[sched] = UINT_MAX;
+        if (i == last)
+            continue;
+        upipe_ts_mux_sched_set(mux, sched, i, mux->sched[sched][last]);
+        upipe_ts_mux_sched_fix(mux, sched, i);
+    }
+}
+
+/** @internal @This updates the position of an input in the scheduling heaps,
+ * after its dates changed.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param input input structure
+ */
+static void upipe_ts_mux_sched_update(struct upipe_ts_mux *mux,
+                                      struct upipe_ts_mux_input *input)
+{
+    if (input->sched_index[UPIPE_TS_MUX_SCHED_CR] == UINT_MAX)
+        return;
+    for (int sched = 0; sched < UPIPE_TS_MUX_SCHED_MAX; sched++)
+        upipe_ts_mux_sched_fix(mux, sched, input->sched_index[sched]);
+}
+
+/** @internal @This finds, among the inputs whose date is lower than or equal
+ * to the given limit, the first one in the order of the lists. Only the
+ * matching part of the heap is explored.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param sched scheduling heap
+ * @param i position in the heap to start from
+ * @param limit maximum date
+ * @param selected_p filled in with the first matching input, if any
+ */
+static void upipe_ts_mux_sched_first(struct upipe_ts_mux *mux,
+                                     enum upipe_ts_mux_sched sched,
+                                     unsigned int i, uint64_t limit,
+                                     struct upipe_ts_mux_input **selected_p)
+{
+    while (i < mux->sched_size) {
+        struct upipe_ts_mux_input *input = mux->sched[sched][i];
+        if (upipe_ts_mux_input_date(input, sched) > limit)
+            return;
+        if (*selected_p == NULL || input->order < (*selected_p)->order)
+            *selected_p = input;
+        upipe_ts_mux_sched_first(mux, sched, 2 * i + 1, limit, selected_p);
+        i = 2 * i + 2;
+    }
+}
+
+/** @internal @This collects the inputs whose date is lower than or equal to
+ * the given limit. Only the matching part of the heap is explored.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param sched scheduling heap
+ * @param i position in the heap to start from
+ * @param limit maximum date
+ * @param nb_p incremented by the number of inputs appended to sched_late
+ */
+static void upipe_ts_mux_sched_collect(struct upipe_ts_mux *mux,
+                                       enum upipe_ts_mux_sched sched,
+                                       unsigned int i, uint64_t limit,
+                                       unsigned int *nb_p)
+{
+    while (i < mux->sched_size) {
+        struct upipe_ts_mux_input *input = mux->sched[sched][i];
+        if (upipe_ts_mux_input_date(input, sched) > limit)
+            return;
+        mux->sched_late[(*nb_p)++] = input;
+        upipe_ts_mux_sched_collect(mux, sched, 2 * i + 1, limit, nb_p);
+        i = 2 * i + 2;
+    }
+}
+
+/** @internal @This releases the encaps pipe of an input which was deleted
+ * and has nothing left to output. This usually frees the input.
+ *
+ * @param mux private context of the ts_mux pipe
+ * @param input input structure
+ */
+static void upipe_ts_mux_input_reap(struct upipe_ts_mux *mux,
+                                    struct upipe_ts_mux_input *input)
+{
+    struct upipe *encaps = input->encaps;
+    upipe_ts_mux_sched_account(mux, input, -1);
+    input->encaps = NULL;
+    upipe_ts_mux_sched_account(mux, input, 1);
+    upipe_release(encaps);
+}
+
+
 /*
  * upipe_ts_mux_input structure handling (derived from upipe structure)
  */
@@ -840,10 +1170,17 @@ static int upipe_ts_mux_input_encaps_probe(struct uprobe *uprobe,
 
     UBASE_SIGNATURE_CHECK(args, UPIPE_TS_ENCAPS_SIGNATURE)
 
+    struct upipe_ts_mux_program *program =
+        upipe_ts_mux_program_from_input_mgr(upipe->mgr);
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_program_mgr(
+                upipe_ts_mux_program_to_upipe(program)->mgr);
+    upipe_ts_mux_sched_account(mux, upipe_ts_mux_input, -1);
     upipe_ts_mux_input->cr_sys = va_arg(args, uint64_t);
     upipe_ts_mux_input->dts_sys = va_arg(args, uint64_t);
     upipe_ts_mux_input->pcr_sys = va_arg(args, uint64_t);
     upipe_ts_mux_input->ready = !!va_arg(args, int);
+    upipe_ts_mux_sched_account(mux, upipe_ts_mux_input, 1);
+    upipe_ts_mux_sched_update(mux, upipe_ts_mux_input);
     return UBASE_ERR_NONE;
 }
 
@@ -889,6 +1226,10 @@ static struct upipe *upipe_ts_mux_input_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux_input->dts_sys = UINT64_MAX;
     upipe_ts_mux_input->pcr_sys = UINT64_MAX;
     upipe_ts_mux_input->ready = false;
+    upipe_ts_mux_input->order = ((uint64_t)program->order << 32) |
+                                upipe_ts_mux->input_order++;
+    for (int sched = 0; sched < UPIPE_TS_MUX_SCHED_MAX; sched++)
+        upipe_ts_mux_input->sched_index[sched] = UINT_MAX;
     upipe_ts_mux_input->psi_pid = NULL;
     upipe_ts_mux_input->scte35_interval = program->scte35_interval;
     upipe_ts_mux_input->max_delay = program->max_delay;
@@ -906,6 +1247,12 @@ static struct upipe *upipe_ts_mux_input_alloc(struct upipe_mgr *mgr,
         upipe_ts_mux_input_to_urefcount_real(upipe_ts_mux_input);
     upipe_throw_ready(upipe);
 
+    if (unlikely(!ubase_check(upipe_ts_mux_sched_add(upipe_ts_mux,
+                                                     upipe_ts_mux_input)))) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return upipe;
+    }
+
     struct upipe_ts_mux_mgr *ts_mux_mgr =
         upipe_ts_mux_mgr_from_upipe_mgr(upipe_ts_mux_to_upipe(upipe_ts_mux)->mgr);
     if (unlikely((upipe_ts_mux_input->tstd =
@@ -1263,7 +1610,9 @@ static int upipe_ts_mux_input_set_flow_def(struct upipe *upipe,
     }
     uref_free(flow_def_dup);
 
+    upipe_ts_mux_sched_account(upipe_ts_mux, input, -1);
     input->input_type = input_type;
+    upipe_ts_mux_sched_account(upipe_ts_mux, input, 1);
     input->pid = pid;
     input->octetrate = octetrate;
     input->required_octetrate = octetrate + pes_overhead + ts_overhead;
@@ -1416,6 +1765,13 @@ static int upipe_ts_mux_input_control(struct upipe *upipe,
                 upipe_ts_mux_input_from_upipe(upipe);
             return upipe_control_va(upipe_ts_mux_input->input, command, args);
         }
+        case UPIPE_TS_TSTD_SET_TRACE_SIZE:
+        case UPIPE_TS_TSTD_GET_TRACE:
+        case UPIPE_TS_TSTD_DUMP_TRACE: {
+            struct upipe_ts_mux_input *upipe_ts_mux_input =
+                upipe_ts_mux_input_from_upipe(upipe);
+            return upipe_control_va(upipe_ts_mux_input->tstd, command, args);
+        }
         default:
             break;
     }
@@ -1434,7 +1790,10 @@ static void upipe_ts_mux_input_free(struct urefcount *urefcount_real)
     struct upipe *upipe = upipe_ts_mux_input_to_upipe(upipe_ts_mux_input);
     struct upipe_ts_mux_program *program =
         upipe_ts_mux_program_from_input_mgr(upipe->mgr);
+    struct upipe_ts_mux *mux = upipe_ts_mux_from_program_mgr(
+                upipe_ts_mux_program_to_upipe(program)->mgr);
 
+    upipe_ts_mux_sched_remove(mux, upipe_ts_mux_input);
     upipe_ts_mux_input_clean_sub(upipe);
     if (!upipe_single(upipe_ts_mux_program_to_upipe(program)))
         upipe_ts_mux_program_change(upipe_ts_mux_program_to_upipe(program));
@@ -1462,10 +1821,15 @@ static void upipe_ts_mux_input_no_input(struct upipe *upipe)
                 upipe_ts_mux_program_to_upipe(program)->mgr);
     upipe_use(upipe_ts_mux_to_upipe(mux));
 
+    upipe_ts_mux_sched_account(mux, upipe_ts_mux_input, -1);
     upipe_ts_mux_input->deleted = true;
+    upipe_ts_mux_sched_account(mux, upipe_ts_mux_input, 1);
     if (upipe_ts_mux_input->input_type == UPIPE_TS_MUX_INPUT_SCTE35) {
-        upipe_release(upipe_ts_mux_input->encaps);
+        upipe_ts_mux_sched_account(mux, upipe_ts_mux_input, -1);
+        struct upipe *encaps = upipe_ts_mux_input->encaps;
         upipe_ts_mux_input->encaps = NULL;
+        upipe_ts_mux_sched_account(mux, upipe_ts_mux_input, 1);
+        upipe_release(encaps);
     } else
         upipe_ts_encaps_eos(upipe_ts_mux_input->encaps);
     upipe_release(upipe_ts_mux_input->tstd);
@@ -1591,8 +1955,11 @@ static struct upipe *upipe_ts_mux_program_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux_program->sig_service = NULL;
     upipe_ts_mux_program->sid = 0;
     upipe_ts_mux_program->pmt_pid = 8192;
+    upipe_ts_mux_program->order = upipe_ts_mux->program_order++;
     upipe_ts_mux_program->pmt_interval = upipe_ts_mux->pmt_interval;
     upipe_ts_mux_program->eit_interval = upipe_ts_mux->eit_interval;
+    upipe_ts_mux_program->eit_sched_interval =
+        upipe_ts_mux->eit_sched_interval;
     upipe_ts_mux_program->pcr_interval = upipe_ts_mux->pcr_interval;
     upipe_ts_mux_program->scte35_interval = upipe_ts_mux->scte35_interval;
     upipe_ts_mux_program->max_delay = upipe_ts_mux->max_delay;
@@ -1880,6 +2247,39 @@ static int upipe_ts_mux_program_set_eit_interval(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the current EIT schedule interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p filled in with the interval
+ * @return an error code
+ */
+static int upipe_ts_mux_program_get_eit_sched_interval(struct upipe *upipe,
+                                                       uint64_t *interval_p)
+{
+    struct upipe_ts_mux_program *upipe_ts_mux_program =
+        upipe_ts_mux_program_from_upipe(upipe);
+    assert(interval_p != NULL);
+    *interval_p = upipe_ts_mux_program->eit_sched_interval;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the EIT schedule interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval new interval
+ * @return an error code
+ */
+static int upipe_ts_mux_program_set_eit_sched_interval(struct upipe *upipe,
+                                                       uint64_t interval)
+{
+    struct upipe_ts_mux_program *upipe_ts_mux_program =
+        upipe_ts_mux_program_from_upipe(upipe);
+    upipe_ts_mux_program->eit_sched_interval = interval;
+    /* will trigger set_eit_sched_interval */
+    upipe_ts_mux_program_update(upipe);
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This returns the current PCR interval.
  *
  * @param upipe description structure of the pipe
@@ -2037,6 +2437,18 @@ static int upipe_ts_mux_program_control(struct upipe *upipe,
             uint64_t interval = va_arg(args, uint64_t);
             return upipe_ts_mux_program_set_eit_interval(upipe, interval);
         }
+        case UPIPE_TS_MUX_GET_EIT_SCHED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            return upipe_ts_mux_program_get_eit_sched_interval(upipe,
+                                                               interval_p);
+        }
+        case UPIPE_TS_MUX_SET_EIT_SCHED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t interval = va_arg(args, uint64_t);
+            return upipe_ts_mux_program_set_eit_sched_interval(upipe,
+                                                               interval);
+        }
         case UPIPE_TS_MUX_GET_PCR_INTERVAL: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
             uint64_t *interval_p = va_arg(args, uint64_t *);
@@ -2285,6 +2697,7 @@ static struct upipe *upipe_ts_mux_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux->nit_interval = DEFAULT_NIT_INTERVAL;
     upipe_ts_mux->sdt_interval = MAX_SDT_INTERVAL;
     upipe_ts_mux->eit_interval = MAX_EIT_INTERVAL;
+    upipe_ts_mux->eit_sched_interval = DEFAULT_EIT_SCHED_INTERVAL;
     upipe_ts_mux->tdt_interval = MAX_TDT_INTERVAL;
     upipe_ts_mux->pcr_interval = DEFAULT_PCR_INTERVAL;
     upipe_ts_mux->scte35_interval = DEFAULT_SCTE35_INTERVAL;
@@ -2300,6 +2713,12 @@ static struct upipe *upipe_ts_mux_alloc(struct upipe_mgr *mgr,
     upipe_ts_mux->interval = 0;
 
     ulist_init(&upipe_ts_mux->psi_pids);
+    upipe_ts_mux->program_order = upipe_ts_mux->input_order = 0;
+    for (int sched = 0; sched < UPIPE_TS_MUX_SCHED_MAX; sched++)
+        upipe_ts_mux->sched[sched] = NULL;
+    upipe_ts_mux->sched_late = NULL;
+    upipe_ts_mux->sched_size = upipe_ts_mux->sched_alloc = 0;
+    upipe_ts_mux->sched_blocking = upipe_ts_mux->sched_zombies = 0;
     upipe_ts_mux->mode = UPIPE_TS_MUX_MODE_CBR;
     upipe_ts_mux->tb_size = T_STD_TS_BUFFER;
     upipe_ts_mux->mtu = TS_SIZE;
@@ -2462,36 +2881,31 @@ static void upipe_ts_mux_splice(struct upipe *upipe, struct ubuf **ubuf_p,
         }
     }
 
-    /* 2. Inputs */
-    uint64_t cr_sys = UINT64_MAX;
+    /* Flush late inputs; their status events update the heaps, so the
+     * selection below sees the dates after the flush. */
+    unsigned int nb_late = 0;
+    if (original_cr_sys)
+        upipe_ts_mux_sched_collect(mux, UPIPE_TS_MUX_SCHED_DTS, 0,
+                                   original_cr_sys - 1, &nb_late);
+    for (unsigned int i = 0; i < nb_late; i++)
+        if (mux->sched_late[i]->encaps != NULL)
+            upipe_ts_encaps_splice(mux->sched_late[i]->encaps,
+                                   original_cr_sys, NULL, NULL);
+
+    /* 2. Inputs with an urgent DTS or PCR, in the order of the lists */
     struct upipe_ts_mux_input *selected_input = NULL;
-    ulist_foreach (&mux->programs, uchain) {
-        struct upipe_ts_mux_program *program =
-            upipe_ts_mux_program_from_uchain(uchain);
-        struct uchain *uchain_input;
-        ulist_foreach (&program->inputs, uchain_input) {
-            struct upipe_ts_mux_input *input =
-                upipe_ts_mux_input_from_uchain(uchain_input);
-            if (input->dts_sys < original_cr_sys) /* flush */
-                upipe_ts_encaps_splice(input->encaps, original_cr_sys,
-                                       NULL, NULL);
-
-            if (input->dts_sys <= original_cr_sys + mux->interval ||
-                input->pcr_sys <= original_cr_sys) {
-                selected_input = input;
-                goto upipe_ts_mux_splice_done;
-            }
-            if (input->cr_sys < cr_sys) {
-                selected_input = input;
-                cr_sys = input->cr_sys;
-            }
-        }
+    upipe_ts_mux_sched_first(mux, UPIPE_TS_MUX_SCHED_DTS, 0,
+                             original_cr_sys + mux->interval, &selected_input);
+    upipe_ts_mux_sched_first(mux, UPIPE_TS_MUX_SCHED_PCR, 0,
+                             original_cr_sys, &selected_input);
+    if (selected_input == NULL) {
+        /* 3. Input with the lowest cr_sys */
+        selected_input = upipe_ts_mux_sched_top(mux, UPIPE_TS_MUX_SCHED_CR);
+        if (selected_input == NULL ||
+            selected_input->cr_sys > original_cr_sys)
+            return;
     }
 
-    if (selected_input == NULL || selected_input->cr_sys > original_cr_sys)
-        return;
-
-upipe_ts_mux_splice_done:
     err = upipe_ts_encaps_splice(selected_input->encaps, original_cr_sys,
                                  ubuf_p, dts_sys_p);
     if (!ubase_check(err)) {
@@ -2499,9 +2913,9 @@ upipe_ts_mux_splice_done:
         upipe_throw_fatal(upipe, err);
     }
 
-    if (selected_input->deleted && !selected_input->ready) {
+    if (upipe_ts_mux_input_zombie(selected_input)) {
         /* This triggers the immediate deletion of the input. */
-        upipe_release(selected_input->encaps);
+        upipe_ts_mux_input_reap(mux, selected_input);
     }
 }
 
@@ -2594,21 +3008,24 @@ static void _upipe_ts_mux_watcher(struct upipe *upipe)
         upipe_ts_mux_complete(upipe, &mux->upump);
 
     /* Check for deleted inputs */
-    struct uchain *uchain_program, *uchain_program_tmp;
-    ulist_delete_foreach (&mux->programs, uchain_program, uchain_program_tmp) {
-        struct upipe_ts_mux_program *program =
-            upipe_ts_mux_program_from_uchain(uchain_program);
-        upipe_use(upipe_ts_mux_program_to_upipe(program));
+    if (mux->sched_zombies) {
+        struct uchain *uchain_program, *uchain_program_tmp;
+        ulist_delete_foreach (&mux->programs, uchain_program,
+                              uchain_program_tmp) {
+            struct upipe_ts_mux_program *program =
+                upipe_ts_mux_program_from_uchain(uchain_program);
+            upipe_use(upipe_ts_mux_program_to_upipe(program));
 
-        struct uchain *uchain_input, *uchain_input_tmp;
-        ulist_delete_foreach (&program->inputs, uchain_input,
-                              uchain_input_tmp) {
-            struct upipe_ts_mux_input *input =
-                upipe_ts_mux_input_from_uchain(uchain_input);
-            if (input->deleted && !input->ready)
-                upipe_release(input->encaps);
+            struct uchain *uchain_input, *uchain_input_tmp;
+            ulist_delete_foreach (&program->inputs, uchain_input,
+                                  uchain_input_tmp) {
+                struct upipe_ts_mux_input *input =
+                    upipe_ts_mux_input_from_uchain(uchain_input);
+                if (upipe_ts_mux_input_zombie(input))
+                    upipe_ts_mux_input_reap(mux, input);
+            }
+            upipe_release(upipe_ts_mux_program_to_upipe(program));
         }
-        upipe_release(upipe_ts_mux_program_to_upipe(program));
     }
 
     upipe_ts_mux_set_upump(upipe, NULL);
@@ -2634,36 +3051,38 @@ static void upipe_ts_mux_watcher(struct upump *upump)
 static uint64_t upipe_ts_mux_check_available(struct upipe *upipe)
 {
     struct upipe_ts_mux *mux = upipe_ts_mux_from_upipe(upipe);
-    uint64_t min_cr_sys = UINT64_MAX;
 
-    struct uchain *uchain_program, *uchain_program_tmp;
-    ulist_delete_foreach (&mux->programs, uchain_program,
-                          uchain_program_tmp) {
-        struct upipe_ts_mux_program *program =
-            upipe_ts_mux_program_from_uchain(uchain_program);
-        upipe_use(upipe_ts_mux_program_to_upipe(program));
+    if (mux->sched_zombies) {
+        /* release deleted inputs until the first blocking input */
+        struct uchain *uchain_program, *uchain_program_tmp;
+        ulist_delete_foreach (&mux->programs, uchain_program,
+                              uchain_program_tmp) {
+            struct upipe_ts_mux_program *program =
+                upipe_ts_mux_program_from_uchain(uchain_program);
+            upipe_use(upipe_ts_mux_program_to_upipe(program));
 
-        struct uchain *uchain_input, *uchain_input_tmp;
-        ulist_delete_foreach (&program->inputs, uchain_input,
-                              uchain_input_tmp) {
-            struct upipe_ts_mux_input *input =
-                upipe_ts_mux_input_from_uchain(uchain_input);
-            if (!input->ready) {
-                if (input->deleted) {
-                    upipe_release(input->encaps);
-                    continue;
-                } else if (input->input_type != UPIPE_TS_MUX_INPUT_OTHER &&
-                           input->input_type != UPIPE_TS_MUX_INPUT_SCTE35) {
+            struct uchain *uchain_input, *uchain_input_tmp;
+            ulist_delete_foreach (&program->inputs, uchain_input,
+                                  uchain_input_tmp) {
+                struct upipe_ts_mux_input *input =
+                    upipe_ts_mux_input_from_uchain(uchain_input);
+                if (upipe_ts_mux_input_zombie(input))
+                    upipe_ts_mux_input_reap(mux, input);
+                else if (upipe_ts_mux_input_blocking(input)) {
                     upipe_release(upipe_ts_mux_program_to_upipe(program));
                     return UINT64_MAX;
                 }
             }
-            if (min_cr_sys > input->cr_sys)
-                min_cr_sys = input->cr_sys;
+            upipe_release(upipe_ts_mux_program_to_upipe(program));
         }
-        upipe_release(upipe_ts_mux_program_to_upipe(program));
     }
-    return min_cr_sys;
+
+    if (mux->sched_blocking)
+        return UINT64_MAX;
+
+    struct upipe_ts_mux_input *input =
+        upipe_ts_mux_sched_top(mux, UPIPE_TS_MUX_SCHED_CR);
+    return input != NULL ? input->cr_sys : UINT64_MAX;
 }
 
 /** @internal @This sets the initial cr_prog of all programs.
@@ -3034,6 +3453,11 @@ static void upipe_ts_mux_update(struct upipe *upipe)
                         program->eit_interval -
                         (program->eit_interval % mux->interval) :
                         program->eit_interval);
+                upipe_ts_mux_set_eit_sched_interval(program->sig_service,
+                        mux->interval < program->eit_sched_interval / 2 ?
+                        program->eit_sched_interval -
+                        (program->eit_sched_interval % mux->interval) :
+                        program->eit_sched_interval);
             }
 
             struct uchain *uchain_input;
@@ -3612,6 +4036,43 @@ static int _upipe_ts_mux_set_eit_interval(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the current EIT schedule interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval_p filled in with the interval
+ * @return an error code
+ */
+static int _upipe_ts_mux_get_eit_sched_interval(struct upipe *upipe,
+                                                uint64_t *interval_p)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    assert(interval_p != NULL);
+    *interval_p = upipe_ts_mux->eit_sched_interval;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the EIT schedule interval.
+ *
+ * @param upipe description structure of the pipe
+ * @param interval new interval
+ * @return an error code
+ */
+static int _upipe_ts_mux_set_eit_sched_interval(struct upipe *upipe,
+                                                uint64_t interval)
+{
+    struct upipe_ts_mux *upipe_ts_mux = upipe_ts_mux_from_upipe(upipe);
+    upipe_ts_mux->eit_sched_interval = interval;
+
+    struct uchain *uchain;
+    ulist_foreach (&upipe_ts_mux->programs, uchain) {
+        struct upipe_ts_mux_program *program =
+            upipe_ts_mux_program_from_uchain(uchain);
+        upipe_ts_mux_set_eit_sched_interval(
+                upipe_ts_mux_program_to_upipe(program), interval);
+    }
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This returns the current TDT interval.
  *
  * @param upipe description structure of the pipe
@@ -3997,6 +4458,16 @@ static int _upipe_ts_mux_control(struct upipe *upipe, int command, va_list args)
             uint64_t interval = va_arg(args, uint64_t);
             return _upipe_ts_mux_set_eit_interval(upipe, interval);
         }
+        case UPIPE_TS_MUX_GET_EIT_SCHED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            return _upipe_ts_mux_get_eit_sched_interval(upipe, interval_p);
+        }
+        case UPIPE_TS_MUX_SET_EIT_SCHED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t interval = va_arg(args, uint64_t);
+            return _upipe_ts_mux_set_eit_sched_interval(upipe, interval);
+        }
         case UPIPE_TS_MUX_GET_TDT_INTERVAL: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
             uint64_t *interval_p = va_arg(args, uint64_t *);
@@ -4147,6 +4618,9 @@ static void upipe_ts_mux_free(struct urefcount *urefcount_real)
     upipe_throw_dead(upipe);
 
     ubuf_free(mux->padding);
+    for (int sched = 0; sched < UPIPE_TS_MUX_SCHED_MAX; sched++)
+        free(mux->sched[sched]);
+    free(mux->sched_late);
     uref_free(mux->flow_def_input);
     uprobe_clean(&mux->probe);
     urefcount_clean(urefcount_real);
@@ -43,6 +43,7 @@
 #include <upipe/upipe_helper_iconv.h>
 #include <upipe-ts/upipe_ts_nit_decoder.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/upipe_ts_crc.h>
 #include "upipe_ts_psi_decoder.h"
 
 #include <stdlib.h>
@@ -92,6 +93,8 @@ struct upipe_ts_nitd {
     UPIPE_TS_PSID_TABLE_DECLARE(nit);
     /** NIT table being gathered */
     UPIPE_TS_PSID_TABLE_DECLARE(next_nit);
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
 
     /** encoding of the following iconv handle */
     const char *current_encoding;
@@ -138,6 +141,7 @@ static struct upipe *upipe_ts_nitd_alloc(struct upipe_mgr *mgr,
     upipe_ts_nitd_init_iconv(upipe);
     upipe_ts_psid_table_init(upipe_ts_nitd->nit);
     upipe_ts_psid_table_init(upipe_ts_nitd->next_nit);
+    upipe_ts_nitd->skipped = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -195,7 +199,7 @@ static bool upipe_ts_nitd_table_validate(struct upipe *upipe)
                                                   &section))))
             return false;
 
-        if (!nit_validate(section) || !psi_check_crc(section)) {
+        if (!nit_validate(section) || !upipe_ts_psi_check_crc(section)) {
             uref_block_unmap(section_uref, 0);
             return false;
         }
@@ -314,6 +318,13 @@ static void upipe_ts_nitd_input(struct upipe *upipe, struct uref *uref,
     struct upipe_ts_nitd *upipe_ts_nitd = upipe_ts_nitd_from_upipe(upipe);
     assert(upipe_ts_nitd->flow_def_input != NULL);
 
+    if (upipe_ts_psid_table_unchanged(upipe_ts_nitd->nit, uref)) {
+        /* Unchanged repetition of the NIT in effect. */
+        upipe_ts_nitd->skipped++;
+        uref_free(uref);
+        return;
+    }
+
     if (!upipe_ts_psid_table_section(upipe_ts_nitd->next_nit, uref))
         return;
 
@@ -477,6 +488,14 @@ static int upipe_ts_nitd_control(struct upipe *upipe, int command, va_list args)
             return upipe_ts_nitd_set_output(upipe, output);
         }
 
+        case UPIPE_TS_PSID_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_ts_nitd *upipe_ts_nitd =
+                upipe_ts_nitd_from_upipe(upipe);
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_nitd->skipped;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -0,0 +1,496 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module padding a transport stream back to CBR
+ *
+ * Null packets share a single buffer, so padding only costs a uref
+ * duplication per slot.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uclock.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe-ts/upipe_ts_null_pad.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+
+/** we only accept TS packets */
+#define EXPECTED_FLOW_DEF "block.mpegts."
+/** max gap between two packets before the slot clock is restarted */
+#define MAX_GAP UCLOCK_FREQ
+/** PCR wraparound, in 27 MHz units */
+#define PCR_WRAP ((UINT64_C(1) << 33) * 300)
+
+/** @hidden */
+static int upipe_ts_null_pad_check(struct upipe *upipe,
+                                   struct uref *flow_format);
+
+/** @internal @This is the private context of a ts_null_pad pipe. */
+struct upipe_ts_null_pad {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** input flow definition packet */
+    struct uref *flow_def_input;
+    /** octet rate set by the application, or 0 */
+    uint64_t octetrate_set;
+    /** octet rate of the output */
+    uint64_t octetrate;
+
+    /** a null packet */
+    struct ubuf *padding;
+    /** null packet uref, duplicated for every empty slot */
+    struct uref *padding_uref;
+    /** date of the next slot, or UINT64_MAX */
+    uint64_t slot_cr_sys;
+    /** remainder of the slot clock, in 1/octetrate units */
+    uint64_t slot_remainder;
+    /** number of null packets inserted */
+    uint64_t nb_padded;
+    /** true if we already warned about passing packets through */
+    bool warned;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_null_pad, upipe, UPIPE_TS_NULL_PAD_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_null_pad, urefcount, upipe_ts_null_pad_free)
+UPIPE_HELPER_VOID(upipe_ts_null_pad)
+UPIPE_HELPER_OUTPUT(upipe_ts_null_pad, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UBUF_MGR(upipe_ts_null_pad, ubuf_mgr, flow_format,
+                      ubuf_mgr_request, upipe_ts_null_pad_check,
+                      upipe_ts_null_pad_register_output_request,
+                      upipe_ts_null_pad_unregister_output_request)
+
+/** @internal @This allocates a ts_null_pad pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_null_pad_alloc(struct upipe_mgr *mgr,
+                                             struct uprobe *uprobe,
+                                             uint32_t signature,
+                                             va_list args)
+{
+    struct upipe *upipe = upipe_ts_null_pad_alloc_void(mgr, uprobe,
+                                                       signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+    upipe_ts_null_pad_init_urefcount(upipe);
+    upipe_ts_null_pad_init_ubuf_mgr(upipe);
+    upipe_ts_null_pad_init_output(upipe);
+    upipe_ts_null_pad->flow_def_input = NULL;
+    upipe_ts_null_pad->octetrate_set = 0;
+    upipe_ts_null_pad->octetrate = 0;
+    upipe_ts_null_pad->padding = NULL;
+    upipe_ts_null_pad->padding_uref = NULL;
+    upipe_ts_null_pad->slot_cr_sys = UINT64_MAX;
+    upipe_ts_null_pad->slot_remainder = 0;
+    upipe_ts_null_pad->nb_padded = 0;
+    upipe_ts_null_pad->warned = false;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This allocates the null packet once the ubuf manager is
+ * known.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_ts_null_pad_check(struct upipe *upipe,
+                                   struct uref *flow_format)
+{
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+    if (flow_format != NULL)
+        uref_free(flow_format);
+
+    if (upipe_ts_null_pad->ubuf_mgr != NULL &&
+        upipe_ts_null_pad->padding == NULL) {
+        struct ubuf *padding = ubuf_block_alloc(upipe_ts_null_pad->ubuf_mgr,
+                                                TS_SIZE);
+        uint8_t *buffer;
+        int size = -1;
+        if (unlikely(padding == NULL ||
+                     !ubase_check(ubuf_block_write(padding, 0,
+                                                   &size, &buffer)))) {
+            ubuf_free(padding);
+            return UBASE_ERR_ALLOC;
+        }
+        ts_pad(buffer);
+        ubuf_block_unmap(padding, 0);
+        upipe_ts_null_pad->padding = padding;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This moves the slot clock to the next slot.
+ *
+ * @param upipe description structure of the pipe
+ */
+static inline void upipe_ts_null_pad_next_slot(struct upipe *upipe)
+{
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+    upipe_ts_null_pad->slot_remainder += (uint64_t)TS_SIZE * UCLOCK_FREQ;
+    upipe_ts_null_pad->slot_cr_sys +=
+        upipe_ts_null_pad->slot_remainder / upipe_ts_null_pad->octetrate;
+    upipe_ts_null_pad->slot_remainder %= upipe_ts_null_pad->octetrate;
+}
+
+/** @internal @This adds the given shift to the PCR of a TS packet, if it
+ * carries one.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param shift difference between the output and input dates
+ */
+static void upipe_ts_null_pad_shift_pcr(struct upipe *upipe,
+                                        struct uref *uref, int64_t shift)
+{
+    uint8_t buffer[TS_HEADER_SIZE_PCR];
+    const uint8_t *ts = uref_block_peek(uref, 0, TS_HEADER_SIZE_PCR, buffer);
+    if (unlikely(ts == NULL))
+        return;
+    bool has_pcr = ts_has_adaptation(ts) &&
+                   ts_get_adaptation(ts) >= TS_HEADER_SIZE_PCR -
+                                            TS_HEADER_SIZE - 1 &&
+                   tsaf_has_pcr(ts);
+    uint64_t pcr = has_pcr ? tsaf_get_pcr(ts) * 300 + tsaf_get_pcrext(ts) : 0;
+    if (unlikely(!ubase_check(uref_block_peek_unmap(uref, 0, buffer, ts)))) {
+        upipe_throw_fatal(upipe, UBASE_ERR_INVALID);
+        return;
+    }
+    if (!has_pcr)
+        return;
+
+    uint8_t *w;
+    int size = TS_HEADER_SIZE_PCR;
+    if (!ubase_check(uref_block_write(uref, 0, &size, &w)) ||
+        size < TS_HEADER_SIZE_PCR) {
+        if (size >= 0)
+            uref_block_unmap(uref, 0);
+        /* the packet is shared or segmented */
+        struct ubuf *ubuf = ubuf_block_copy(uref->ubuf->mgr, uref->ubuf,
+                                            0, -1);
+        if (unlikely(ubuf == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_attach_ubuf(uref, ubuf);
+        size = TS_HEADER_SIZE_PCR;
+        if (unlikely(!ubase_check(uref_block_write(uref, 0, &size, &w)))) {
+            upipe_warn(upipe, "unable to map TS packet");
+            return;
+        }
+    }
+
+    pcr = (pcr + PCR_WRAP + shift % (int64_t)PCR_WRAP) % PCR_WRAP;
+    tsaf_set_pcr(w, pcr / 300);
+    tsaf_set_pcrext(w, pcr % 300);
+    uref_block_unmap(uref, 0);
+}
+
+/** @internal @This receives a TS packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_null_pad_input(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+    uint64_t cr_sys;
+    if (unlikely(!upipe_ts_null_pad->octetrate ||
+                 upipe_ts_null_pad->padding == NULL ||
+                 !ubase_check(uref_clock_get_cr_sys(uref, &cr_sys)))) {
+        if (!upipe_ts_null_pad->warned) {
+            upipe_warn(upipe, "unable to pad, passing packets through");
+            upipe_ts_null_pad->warned = true;
+        }
+        upipe_ts_null_pad_output(upipe, uref, upump_p);
+        return;
+    }
+
+    if (unlikely(upipe_ts_null_pad->padding_uref == NULL)) {
+        struct uref *padding_uref = uref_alloc(uref->mgr);
+        struct ubuf *padding = ubuf_dup(upipe_ts_null_pad->padding);
+        if (unlikely(padding_uref == NULL || padding == NULL)) {
+            uref_free(padding_uref);
+            ubuf_free(padding);
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_attach_ubuf(padding_uref, padding);
+        upipe_ts_null_pad->padding_uref = padding_uref;
+    }
+
+    if (unlikely(upipe_ts_null_pad->slot_cr_sys == UINT64_MAX ||
+                 cr_sys > upipe_ts_null_pad->slot_cr_sys + MAX_GAP ||
+                 cr_sys + MAX_GAP < upipe_ts_null_pad->slot_cr_sys)) {
+        if (upipe_ts_null_pad->slot_cr_sys != UINT64_MAX)
+            upipe_warn_va(upipe, "discontinuity, restarting slot clock (%"PRId64")",
+                          (int64_t)(cr_sys - upipe_ts_null_pad->slot_cr_sys));
+        upipe_ts_null_pad->slot_cr_sys = cr_sys;
+        upipe_ts_null_pad->slot_remainder = 0;
+    }
+
+    uint64_t half_slot = (uint64_t)TS_SIZE * UCLOCK_FREQ /
+                         upipe_ts_null_pad->octetrate / 2;
+    while (cr_sys >= upipe_ts_null_pad->slot_cr_sys + half_slot) {
+        /* nothing was scheduled in this slot */
+        struct uref *padding = uref_dup(upipe_ts_null_pad->padding_uref);
+        if (unlikely(padding == NULL)) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        uref_clock_set_cr_sys(padding, upipe_ts_null_pad->slot_cr_sys);
+        upipe_ts_null_pad_next_slot(upipe);
+        upipe_ts_null_pad->nb_padded++;
+        upipe_ts_null_pad_output(upipe, padding, upump_p);
+    }
+
+    int64_t shift = upipe_ts_null_pad->slot_cr_sys - cr_sys;
+    if (shift)
+        upipe_ts_null_pad_shift_pcr(upipe, uref, shift);
+    uref_clock_set_cr_sys(uref, upipe_ts_null_pad->slot_cr_sys);
+    upipe_ts_null_pad_next_slot(upipe);
+    upipe_ts_null_pad_output(upipe, uref, upump_p);
+}
+
+/** @internal @This builds the output flow definition.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_null_pad_build_flow_def(struct upipe *upipe)
+{
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+    if (upipe_ts_null_pad->flow_def_input == NULL)
+        return;
+
+    uint64_t octetrate = upipe_ts_null_pad->octetrate_set;
+    if (!octetrate)
+        uref_block_flow_get_octetrate(upipe_ts_null_pad->flow_def_input,
+                                      &octetrate);
+    if (octetrate != upipe_ts_null_pad->octetrate) {
+        upipe_ts_null_pad->octetrate = octetrate;
+        upipe_ts_null_pad->slot_cr_sys = UINT64_MAX;
+        upipe_ts_null_pad->warned = false;
+    }
+
+    struct uref *flow_def = uref_dup(upipe_ts_null_pad->flow_def_input);
+    if (unlikely(flow_def == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    if (octetrate)
+        UBASE_FATAL(upipe, uref_block_flow_set_octetrate(flow_def, octetrate))
+    upipe_ts_null_pad_store_flow_def(upipe, flow_def);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_null_pad_set_flow_def(struct upipe *upipe,
+                                          struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+    uref_free(upipe_ts_null_pad->flow_def_input);
+    upipe_ts_null_pad->flow_def_input = flow_def_dup;
+    upipe_ts_null_pad_build_flow_def(upipe);
+
+    if (upipe_ts_null_pad->ubuf_mgr == NULL) {
+        if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        upipe_ts_null_pad_require_ubuf_mgr(upipe, flow_def_dup);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_null_pad pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_null_pad_control(struct upipe *upipe,
+                                     int command, va_list args)
+{
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_ts_null_pad_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return UBASE_ERR_NONE;
+            return upipe_ts_null_pad_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_ts_null_pad_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_null_pad_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_null_pad_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_ts_null_pad_set_output(upipe, output);
+        }
+        case UPIPE_FLUSH:
+            upipe_ts_null_pad->slot_cr_sys = UINT64_MAX;
+            return UBASE_ERR_NONE;
+
+        case UPIPE_TS_NULL_PAD_GET_OCTETRATE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_NULL_PAD_SIGNATURE)
+            uint64_t *octetrate_p = va_arg(args, uint64_t *);
+            *octetrate_p = upipe_ts_null_pad->octetrate;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_NULL_PAD_SET_OCTETRATE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_NULL_PAD_SIGNATURE)
+            upipe_ts_null_pad->octetrate_set = va_arg(args, uint64_t);
+            upipe_ts_null_pad_build_flow_def(upipe);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_null_pad_free(struct upipe *upipe)
+{
+    struct upipe_ts_null_pad *upipe_ts_null_pad =
+        upipe_ts_null_pad_from_upipe(upipe);
+    upipe_dbg_va(upipe, "inserted %"PRIu64" null packets",
+                 upipe_ts_null_pad->nb_padded);
+    upipe_throw_dead(upipe);
+
+    uref_free(upipe_ts_null_pad->padding_uref);
+    ubuf_free(upipe_ts_null_pad->padding);
+    uref_free(upipe_ts_null_pad->flow_def_input);
+    upipe_ts_null_pad_clean_output(upipe);
+    upipe_ts_null_pad_clean_ubuf_mgr(upipe);
+    upipe_ts_null_pad_clean_urefcount(upipe);
+    upipe_ts_null_pad_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_null_pad_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_NULL_PAD_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_null_pad_alloc,
+    .upipe_input = upipe_ts_null_pad_input,
+    .upipe_control = upipe_ts_null_pad_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_null_pad pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_null_pad_mgr_alloc(void)
+{
+    return &upipe_ts_null_pad_mgr;
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module stripping null packets from a CBR transport stream
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe-ts/upipe_ts_null_strip.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+
+/** we only accept TS packets */
+#define EXPECTED_FLOW_DEF "block.mpegts."
+/** PID of null packets */
+#define NULL_PID 0x1fff
+/** max difference between the slot clock and the input dates */
+#define MAX_DRIFT (UCLOCK_FREQ / 10)
+
+/** @internal @This is the private context of a ts_null_strip pipe. */
+struct upipe_ts_null_strip {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** octet rate of the CBR stream, or 0 */
+    uint64_t octetrate;
+    /** date of the next slot, or UINT64_MAX */
+    uint64_t slot_cr_sys;
+    /** remainder of the slot clock, in 1/octetrate units */
+    uint64_t slot_remainder;
+    /** number of stripped packets */
+    uint64_t nb_stripped;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_null_strip, upipe, UPIPE_TS_NULL_STRIP_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_null_strip, urefcount, upipe_ts_null_strip_free)
+UPIPE_HELPER_VOID(upipe_ts_null_strip)
+UPIPE_HELPER_OUTPUT(upipe_ts_null_strip, output, flow_def, output_state,
+                    request_list)
+
+/** @internal @This allocates a ts_null_strip pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_null_strip_alloc(struct upipe_mgr *mgr,
+                                               struct uprobe *uprobe,
+                                               uint32_t signature,
+                                               va_list args)
+{
+    struct upipe *upipe = upipe_ts_null_strip_alloc_void(mgr, uprobe,
+                                                         signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_null_strip *upipe_ts_null_strip =
+        upipe_ts_null_strip_from_upipe(upipe);
+    upipe_ts_null_strip_init_urefcount(upipe);
+    upipe_ts_null_strip_init_output(upipe);
+    upipe_ts_null_strip->octetrate = 0;
+    upipe_ts_null_strip->slot_cr_sys = UINT64_MAX;
+    upipe_ts_null_strip->slot_remainder = 0;
+    upipe_ts_null_strip->nb_stripped = 0;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This receives a TS packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_null_strip_input(struct upipe *upipe, struct uref *uref,
+                                      struct upump **upump_p)
+{
+    struct upipe_ts_null_strip *upipe_ts_null_strip =
+        upipe_ts_null_strip_from_upipe(upipe);
+    uint8_t buffer[TS_HEADER_SIZE];
+    const uint8_t *ts = uref_block_peek(uref, 0, TS_HEADER_SIZE, buffer);
+    if (unlikely(ts == NULL)) {
+        upipe_warn(upipe, "invalid TS packet");
+        uref_free(uref);
+        return;
+    }
+    uint16_t pid = ts_get_pid(ts);
+    if (unlikely(!ubase_check(uref_block_peek_unmap(uref, 0, buffer, ts)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_INVALID);
+        return;
+    }
+
+    uint64_t cr_sys;
+    if (upipe_ts_null_strip->octetrate &&
+        ubase_check(uref_clock_get_cr_sys(uref, &cr_sys))) {
+        if (unlikely(upipe_ts_null_strip->slot_cr_sys == UINT64_MAX ||
+                     cr_sys > upipe_ts_null_strip->slot_cr_sys + MAX_DRIFT ||
+                     cr_sys + MAX_DRIFT < upipe_ts_null_strip->slot_cr_sys)) {
+            if (upipe_ts_null_strip->slot_cr_sys != UINT64_MAX)
+                upipe_dbg_va(upipe, "resynchronizing slot clock (%"PRId64")",
+                             (int64_t)(cr_sys -
+                                       upipe_ts_null_strip->slot_cr_sys));
+            upipe_ts_null_strip->slot_cr_sys = cr_sys;
+            upipe_ts_null_strip->slot_remainder = 0;
+        }
+        uint64_t slot_cr_sys = upipe_ts_null_strip->slot_cr_sys;
+
+        upipe_ts_null_strip->slot_remainder += (uint64_t)TS_SIZE * UCLOCK_FREQ;
+        upipe_ts_null_strip->slot_cr_sys +=
+            upipe_ts_null_strip->slot_remainder /
+            upipe_ts_null_strip->octetrate;
+        upipe_ts_null_strip->slot_remainder %= upipe_ts_null_strip->octetrate;
+
+        if (pid != NULL_PID)
+            uref_clock_set_cr_sys(uref, slot_cr_sys);
+    }
+
+    if (pid == NULL_PID) {
+        upipe_ts_null_strip->nb_stripped++;
+        uref_free(uref);
+        return;
+    }
+    upipe_ts_null_strip_output(upipe, uref, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_null_strip_set_flow_def(struct upipe *upipe,
+                                            struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct upipe_ts_null_strip *upipe_ts_null_strip =
+        upipe_ts_null_strip_from_upipe(upipe);
+    uint64_t octetrate = 0;
+    uref_block_flow_get_octetrate(flow_def, &octetrate);
+    if (octetrate != upipe_ts_null_strip->octetrate) {
+        upipe_ts_null_strip->octetrate = octetrate;
+        upipe_ts_null_strip->slot_cr_sys = UINT64_MAX;
+    }
+    upipe_ts_null_strip_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_null_strip pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_null_strip_control(struct upipe *upipe,
+                                       int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_null_strip_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_null_strip_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_ts_null_strip_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_null_strip_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_null_strip_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_ts_null_strip_set_output(upipe, output);
+        }
+        case UPIPE_FLUSH:
+            upipe_ts_null_strip_from_upipe(upipe)->slot_cr_sys = UINT64_MAX;
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_null_strip_free(struct upipe *upipe)
+{
+    struct upipe_ts_null_strip *upipe_ts_null_strip =
+        upipe_ts_null_strip_from_upipe(upipe);
+    upipe_dbg_va(upipe, "stripped %"PRIu64" null packets",
+                 upipe_ts_null_strip->nb_stripped);
+    upipe_throw_dead(upipe);
+
+    upipe_ts_null_strip_clean_output(upipe);
+    upipe_ts_null_strip_clean_urefcount(upipe);
+    upipe_ts_null_strip_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_null_strip_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_NULL_STRIP_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_null_strip_alloc,
+    .upipe_input = upipe_ts_null_strip_input,
+    .upipe_control = upipe_ts_null_strip_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_null_strip pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_null_strip_mgr_alloc(void)
+{
+    return &upipe_ts_null_strip_mgr;
+}
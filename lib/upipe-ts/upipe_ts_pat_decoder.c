@@ -41,6 +41,7 @@
 #include <upipe/upipe_helper_flow_def.h>
 #include <upipe-ts/upipe_ts_pat_decoder.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/upipe_ts_crc.h>
 #include "upipe_ts_psi_decoder.h"
 
 #include <stdlib.h>
@@ -93,6 +94,11 @@ struct upipe_ts_patd {
     struct uref *nit;
     /** list of programs */
     struct uchain programs;
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
+    /** earliest cr_sys of the unchanged sections skipped since the last
+     * new rap event */
+    uint64_t skipped_cr_sys;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -135,6 +141,8 @@ static struct upipe *upipe_ts_patd_alloc(struct upipe_mgr *mgr,
     upipe_ts_patd->tsid = -1;
     upipe_ts_patd->nit = NULL;
     ulist_init(&upipe_ts_patd->programs);
+    upipe_ts_patd->skipped = 0;
+    upipe_ts_patd->skipped_cr_sys = UINT64_MAX;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -204,7 +212,7 @@ static bool upipe_ts_patd_table_validate(struct upipe *upipe)
                                                   &section))))
             return false;
 
-        if (!pat_validate(section) || !psi_check_crc(section)) {
+        if (!pat_validate(section) || !upipe_ts_psi_check_crc(section)) {
             uref_block_unmap(section_uref, 0);
             return false;
         }
@@ -248,6 +256,35 @@ static void upipe_ts_patd_table_rap(struct upipe *upipe, struct uref *uref)
     }
 }
 
+/** @internal @This skips an unchanged repetition of a section of the PAT in
+ * effect, and sends the new rap event when the last section of the table is
+ * received, as if the whole table had been gathered again.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ */
+static void upipe_ts_patd_skip(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_ts_patd *upipe_ts_patd = upipe_ts_patd_from_upipe(upipe);
+    upipe_ts_patd->skipped++;
+
+    uint64_t cr_sys;
+    if (ubase_check(uref_clock_get_cr_sys(uref, &cr_sys)) &&
+        cr_sys < upipe_ts_patd->skipped_cr_sys)
+        upipe_ts_patd->skipped_cr_sys = cr_sys;
+
+    uint8_t header[PSI_HEADER_SIZE_SYNTAX1];
+    if (ubase_check(uref_block_extract(uref, 0, PSI_HEADER_SIZE_SYNTAX1,
+                                       header)) &&
+        psi_get_section(header) == psi_get_lastsection(header) &&
+        upipe_ts_patd->skipped_cr_sys != UINT64_MAX) {
+        uref_clock_set_rap_sys(uref, upipe_ts_patd->skipped_cr_sys);
+        upipe_throw_new_rap(upipe, uref);
+        upipe_ts_patd->skipped_cr_sys = UINT64_MAX;
+    }
+    uref_free(uref);
+}
+
 /** @internal @This builds the flow definition corresponding to a program.
  *
  * @param upipe description structure of the pipe
@@ -345,6 +382,12 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
     assert(upipe_ts_patd->flow_def_input != NULL);
     assert(upipe_ts_patd->ubuf_mgr != NULL);
 
+    if (upipe_ts_psid_table_unchanged(upipe_ts_patd->pat, uref)) {
+        /* Unchanged repetition of the PAT in effect. */
+        upipe_ts_patd_skip(upipe, uref);
+        return;
+    }
+
     if (!upipe_ts_psid_table_section(upipe_ts_patd->next_pat, uref))
         return;
 
@@ -353,6 +396,7 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
                                     upipe_ts_patd->next_pat)) {
         /* Identical PAT. */
         upipe_ts_patd_table_rap(upipe, uref);
+        upipe_ts_patd->skipped_cr_sys = UINT64_MAX;
         upipe_ts_psid_table_clean(upipe_ts_patd->next_pat);
         upipe_ts_psid_table_init(upipe_ts_patd->next_pat);
         return;
@@ -389,6 +433,7 @@ static void upipe_ts_patd_input(struct upipe *upipe, struct uref *uref,
     }
 
     upipe_ts_patd_table_rap(upipe, uref);
+    upipe_ts_patd->skipped_cr_sys = UINT64_MAX;
     upipe_ts_patd_clean_programs(upipe);
     uref_free(upipe_ts_patd->nit);
     upipe_ts_patd->nit = NULL;
@@ -543,6 +588,27 @@ static int upipe_ts_patd_control(struct upipe *upipe, int command, va_list args)
             struct uref **p = va_arg(args, struct uref **);
             return _upipe_ts_patd_get_nit(upipe, p);
         }
+        case UPIPE_TS_PSID_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_ts_patd *upipe_ts_patd =
+                upipe_ts_patd_from_upipe(upipe);
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_patd->skipped;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_PSID_GET_SECTION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_ts_patd *upipe_ts_patd =
+                upipe_ts_patd_from_upipe(upipe);
+            unsigned int section = va_arg(args, unsigned int);
+            struct uref **p = va_arg(args, struct uref **);
+            if (!upipe_ts_psid_table_validate(upipe_ts_patd->pat) ||
+                section > upipe_ts_psid_table_get_lastsection(
+                    upipe_ts_patd->pat))
+                return UBASE_ERR_INVALID;
+            *p = upipe_ts_patd->pat[section];
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -43,6 +43,7 @@
 #include <upipe-framers/uref_mpga_flow.h>
 #include <upipe-ts/upipe_ts_pmt_decoder.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/upipe_ts_crc.h>
 #include "upipe_ts_psi_decoder.h"
 
 #include <stdlib.h>
@@ -97,6 +98,8 @@ struct upipe_ts_pmtd {
 
     /** currently in effect PMT table */
     struct uref *pmt;
+    /** number of unchanged sections skipped */
+    uint64_t skipped;
     /** list of flows */
     struct uchain flows;
 
@@ -137,6 +140,7 @@ static struct upipe *upipe_ts_pmtd_alloc(struct upipe_mgr *mgr,
     upipe_ts_pmtd_init_ubuf_mgr(upipe);
     upipe_ts_pmtd_init_flow_def(upipe);
     upipe_ts_pmtd->pmt = NULL;
+    upipe_ts_pmtd->skipped = 0;
     ulist_init(&upipe_ts_pmtd->flows);
     upipe_throw_ready(upipe);
     return upipe;
@@ -546,9 +550,9 @@ static void upipe_ts_pmtd_input(struct upipe *upipe, struct uref *uref,
 {
     struct upipe_ts_pmtd *upipe_ts_pmtd = upipe_ts_pmtd_from_upipe(upipe);
     assert(upipe_ts_pmtd->flow_def_input != NULL);
-    if (upipe_ts_pmtd->pmt != NULL &&
-        ubase_check(uref_block_equal(upipe_ts_pmtd->pmt, uref))) {
-        /* Identical PMT. */
+    if (upipe_ts_psid_unchanged(upipe_ts_pmtd->pmt, uref)) {
+        /* Unchanged repetition of the PMT in effect. */
+        upipe_ts_pmtd->skipped++;
         upipe_throw_new_rap(upipe, uref);
         uref_free(uref);
         return;
@@ -564,7 +568,7 @@ static void upipe_ts_pmtd_input(struct upipe *upipe, struct uref *uref,
         return;
     }
 
-    if (!pmt_validate(pmt)) {
+    if (!pmt_validate(pmt) || !upipe_ts_psi_check_crc(pmt)) {
         upipe_warn(upipe, "invalid PMT section received");
         uref_block_unmap(uref, 0);
         uref_free(uref);
@@ -716,6 +720,25 @@ static int upipe_ts_pmtd_control(struct upipe *upipe, int command, va_list args)
             return upipe_ts_pmtd_iterate(upipe, p);
         }
 
+        case UPIPE_TS_PSID_GET_SKIPPED: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_ts_pmtd *upipe_ts_pmtd =
+                upipe_ts_pmtd_from_upipe(upipe);
+            uint64_t *p = va_arg(args, uint64_t *);
+            *p = upipe_ts_pmtd->skipped;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_PSID_GET_SECTION: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_DEMUX_SIGNATURE)
+            struct upipe_ts_pmtd *upipe_ts_pmtd =
+                upipe_ts_pmtd_from_upipe(upipe);
+            unsigned int section = va_arg(args, unsigned int);
+            struct uref **p = va_arg(args, struct uref **);
+            if (upipe_ts_pmtd->pmt == NULL || section)
+                return UBASE_ERR_INVALID;
+            *p = upipe_ts_pmtd->pmt;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
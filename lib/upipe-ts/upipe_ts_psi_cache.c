@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe cache of PSI tables, used to warm start ts_demux
+ *
+ * The file format is a header made of the four characters "UPSC" and a
+ * version byte, followed by the tables. Each table is stored as the length
+ * of the key (2 octets), the key, the PID (2 octets), the size of the table
+ * (4 octets) and the table. Integers are big endian.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/ulist.h>
+#include <upipe-ts/upipe_ts_psi_cache.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/** magic at the beginning of cache files */
+#define CACHE_MAGIC "UPSC"
+/** version of the file format */
+#define CACHE_VERSION 1
+/** size of the file header */
+#define CACHE_HEADER_SIZE 5
+/** size of the fixed part of a table record */
+#define CACHE_RECORD_SIZE 8
+/** max size of a table (256 sections of 4096 octets) */
+#define CACHE_MAX_TABLE (256 * 4096)
+
+/** @internal @This is a table in the cache. */
+struct upipe_ts_psi_cache_table {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** key of the stream */
+    char *key;
+    /** PID of the table */
+    uint16_t pid;
+    /** size of the table */
+    size_t size;
+    /** concatenated sections */
+    uint8_t *table;
+};
+
+UBASE_FROM_TO(upipe_ts_psi_cache_table, uchain, uchain, uchain)
+UBASE_FROM_TO(upipe_ts_psi_cache, urefcount, urefcount, urefcount)
+
+/** @internal @This frees a table.
+ *
+ * @param table pointer to the table
+ */
+static void upipe_ts_psi_cache_table_free(
+        struct upipe_ts_psi_cache_table *table)
+{
+    free(table->key);
+    free(table->table);
+    free(table);
+}
+
+/** @internal @This finds a table in the cache.
+ *
+ * @param cache pointer to the cache
+ * @param key key of the stream
+ * @param pid PID of the table
+ * @return pointer to the table, or NULL if it is not in the cache
+ */
+static struct upipe_ts_psi_cache_table *
+    upipe_ts_psi_cache_find(struct upipe_ts_psi_cache *cache,
+                            const char *key, uint16_t pid)
+{
+    struct uchain *uchain;
+    ulist_foreach (&cache->tables, uchain) {
+        struct upipe_ts_psi_cache_table *table =
+            upipe_ts_psi_cache_table_from_uchain(uchain);
+        if (table->pid == pid && !strcmp(table->key, key))
+            return table;
+    }
+    return NULL;
+}
+
+/** @internal @This frees a PSI cache.
+ *
+ * @param urefcount pointer to the urefcount structure
+ */
+static void upipe_ts_psi_cache_free(struct urefcount *urefcount)
+{
+    struct upipe_ts_psi_cache *cache =
+        upipe_ts_psi_cache_from_urefcount(urefcount);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&cache->tables, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        upipe_ts_psi_cache_table_free(
+                upipe_ts_psi_cache_table_from_uchain(uchain));
+    }
+    urefcount_clean(urefcount);
+    free(cache);
+}
+
+/** @This allocates an empty PSI cache.
+ *
+ * @return pointer to the cache, or NULL in case of allocation error
+ */
+struct upipe_ts_psi_cache *upipe_ts_psi_cache_alloc(void)
+{
+    struct upipe_ts_psi_cache *cache =
+        malloc(sizeof(struct upipe_ts_psi_cache));
+    if (unlikely(cache == NULL))
+        return NULL;
+    urefcount_init(&cache->urefcount, upipe_ts_psi_cache_free);
+    ulist_init(&cache->tables);
+    return cache;
+}
+
+/** @This stores a table in the cache, replacing the previous one.
+ *
+ * @param cache pointer to the cache
+ * @param key key of the stream, typically its URI
+ * @param pid PID of the table
+ * @param table concatenated sections of the table, or NULL to remove it
+ * @param size size of the table
+ * @return an error code
+ */
+int upipe_ts_psi_cache_set(struct upipe_ts_psi_cache *cache, const char *key,
+                           uint16_t pid, const uint8_t *table, size_t size)
+{
+    if (unlikely(key == NULL || strlen(key) > UINT16_MAX ||
+                 size > CACHE_MAX_TABLE))
+        return UBASE_ERR_INVALID;
+
+    struct upipe_ts_psi_cache_table *entry =
+        upipe_ts_psi_cache_find(cache, key, pid);
+    if (table == NULL || !size) {
+        if (entry != NULL) {
+            ulist_delete(upipe_ts_psi_cache_table_to_uchain(entry));
+            upipe_ts_psi_cache_table_free(entry);
+        }
+        return UBASE_ERR_NONE;
+    }
+
+    if (entry != NULL && entry->size == size &&
+        !memcmp(entry->table, table, size))
+        return UBASE_ERR_NONE;
+
+    uint8_t *copy = malloc(size);
+    UBASE_ALLOC_RETURN(copy);
+    memcpy(copy, table, size);
+
+    if (entry == NULL) {
+        entry = malloc(sizeof(struct upipe_ts_psi_cache_table));
+        if (unlikely(entry == NULL || (entry->key = strdup(key)) == NULL)) {
+            free(entry);
+            free(copy);
+            return UBASE_ERR_ALLOC;
+        }
+        uchain_init(upipe_ts_psi_cache_table_to_uchain(entry));
+        entry->pid = pid;
+        entry->table = NULL;
+        ulist_add(&cache->tables, upipe_ts_psi_cache_table_to_uchain(entry));
+    }
+    free(entry->table);
+    entry->table = copy;
+    entry->size = size;
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns a table from the cache. The returned buffer is only valid
+ * until the next change of the cache.
+ *
+ * @param cache pointer to the cache
+ * @param key key of the stream, typically its URI
+ * @param pid PID of the table
+ * @param table_p filled in with the concatenated sections of the table
+ * @param size_p filled in with the size of the table
+ * @return an error code
+ */
+int upipe_ts_psi_cache_get(struct upipe_ts_psi_cache *cache, const char *key,
+                           uint16_t pid, const uint8_t **table_p,
+                           size_t *size_p)
+{
+    if (unlikely(key == NULL))
+        return UBASE_ERR_INVALID;
+    struct upipe_ts_psi_cache_table *entry =
+        upipe_ts_psi_cache_find(cache, key, pid);
+    if (entry == NULL)
+        return UBASE_ERR_INVALID;
+    *table_p = entry->table;
+    *size_p = entry->size;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This parses the tables of a cache file, and optionally adds
+ * them to the cache.
+ *
+ * @param cache pointer to the cache, or NULL to only check the file
+ * @param buffer content of the file
+ * @param size size of the file
+ * @return an error code
+ */
+static int upipe_ts_psi_cache_parse(struct upipe_ts_psi_cache *cache,
+                                    const uint8_t *buffer, size_t size)
+{
+    if (size < CACHE_HEADER_SIZE || memcmp(buffer, CACHE_MAGIC, 4) ||
+        buffer[4] != CACHE_VERSION)
+        return UBASE_ERR_INVALID;
+    buffer += CACHE_HEADER_SIZE;
+    size -= CACHE_HEADER_SIZE;
+
+    while (size) {
+        if (size < 2)
+            return UBASE_ERR_INVALID;
+        size_t key_size = (buffer[0] << 8) | buffer[1];
+        if (size < 2 + key_size + CACHE_RECORD_SIZE - 2)
+            return UBASE_ERR_INVALID;
+        const uint8_t *record = buffer + 2 + key_size;
+        uint16_t pid = (record[0] << 8) | record[1];
+        size_t table_size = ((size_t)record[2] << 24) | (record[3] << 16) |
+                            (record[4] << 8) | record[5];
+        size_t record_size = key_size + CACHE_RECORD_SIZE + table_size;
+        if (size < record_size || table_size > CACHE_MAX_TABLE ||
+            memchr(buffer + 2, '\0', key_size) != NULL)
+            return UBASE_ERR_INVALID;
+
+        if (cache != NULL) {
+            char key[key_size + 1];
+            memcpy(key, buffer + 2, key_size);
+            key[key_size] = '\0';
+            UBASE_RETURN(upipe_ts_psi_cache_set(cache, key, pid,
+                                                record + 6, table_size))
+        }
+        buffer += record_size;
+        size -= record_size;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This loads the tables saved in a file, and adds them to the cache.
+ *
+ * @param cache pointer to the cache
+ * @param path path of the file
+ * @return an error code
+ */
+int upipe_ts_psi_cache_load(struct upipe_ts_psi_cache *cache,
+                            const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return UBASE_ERR_EXTERNAL;
+
+    long file_size;
+    if (fseek(file, 0, SEEK_END) || (file_size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET)) {
+        fclose(file);
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    size_t size = file_size;
+    uint8_t *buffer = malloc(size ? size : 1);
+    if (unlikely(buffer == NULL)) {
+        fclose(file);
+        return UBASE_ERR_ALLOC;
+    }
+    int err = size && fread(buffer, size, 1, file) != 1 ?
+              UBASE_ERR_EXTERNAL : UBASE_ERR_NONE;
+    fclose(file);
+
+    if (ubase_check(err))
+        err = upipe_ts_psi_cache_parse(NULL, buffer, size);
+    if (ubase_check(err))
+        err = upipe_ts_psi_cache_parse(cache, buffer, size);
+    free(buffer);
+    return err;
+}
+
+/** @This saves all the tables of the cache to a file. The file is written
+ * under a temporary name and then renamed, so that a crash does not leave
+ * a truncated cache.
+ *
+ * @param cache pointer to the cache
+ * @param path path of the file
+ * @return an error code
+ */
+int upipe_ts_psi_cache_save(struct upipe_ts_psi_cache *cache,
+                            const char *path)
+{
+    char tmp_path[strlen(path) + sizeof(".tmp")];
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL)
+        return UBASE_ERR_EXTERNAL;
+
+    uint8_t header[CACHE_HEADER_SIZE] = { 'U', 'P', 'S', 'C', CACHE_VERSION };
+    bool ok = fwrite(header, CACHE_HEADER_SIZE, 1, file) == 1;
+
+    struct uchain *uchain;
+    ulist_foreach (&cache->tables, uchain) {
+        if (!ok)
+            break;
+        struct upipe_ts_psi_cache_table *table =
+            upipe_ts_psi_cache_table_from_uchain(uchain);
+        size_t key_size = strlen(table->key);
+        uint8_t record[CACHE_RECORD_SIZE];
+        record[0] = key_size >> 8;
+        record[1] = key_size;
+        ok = fwrite(record, 2, 1, file) == 1 &&
+             (!key_size || fwrite(table->key, key_size, 1, file) == 1);
+        record[0] = table->pid >> 8;
+        record[1] = table->pid;
+        record[2] = table->size >> 24;
+        record[3] = table->size >> 16;
+        record[4] = table->size >> 8;
+        record[5] = table->size;
+        ok = ok && fwrite(record, CACHE_RECORD_SIZE - 2, 1, file) == 1 &&
+             fwrite(table->table, table->size, 1, file) == 1;
+    }
+
+    if (fclose(file) || !ok || rename(tmp_path, path)) {
+        remove(tmp_path);
+        return UBASE_ERR_EXTERNAL;
+    }
+    return UBASE_ERR_NONE;
+}
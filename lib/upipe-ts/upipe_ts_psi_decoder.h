@@ -29,6 +29,7 @@
 #include <upipe/uref_block.h>
 
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #include <bitstream/mpeg/psi.h>
@@ -49,6 +50,45 @@ static inline bool upipe_ts_psid_equal(struct uref *section1,
     return ubase_check(uref_block_equal(section1, section2));
 }
 
+/** @This checks if two PSI sections are the same repetition, by comparing
+ * their sizes, syntax headers (including version and section numbers) and
+ * CRCs. Contrary to @ref upipe_ts_psid_equal, this only reads a few octets
+ * and never allocates memory, so it is suitable to weed out the many
+ * unchanged repetitions of a section before any processing.
+ *
+ * @param section1 PSI section 1
+ * @param section2 PSI section 2
+ * @return true if the sections are the same repetition
+ */
+static inline bool upipe_ts_psid_unchanged(struct uref *section1,
+                                           struct uref *section2)
+{
+    if (section1 == NULL || section2 == NULL)
+        return false;
+
+    size_t size1, size2;
+    if (unlikely(!ubase_check(uref_block_size(section1, &size1)) ||
+                 !ubase_check(uref_block_size(section2, &size2)) ||
+                 size1 != size2 ||
+                 size1 < PSI_HEADER_SIZE_SYNTAX1 + PSI_CRC_SIZE))
+        return false;
+
+    uint8_t header1[PSI_HEADER_SIZE_SYNTAX1], header2[PSI_HEADER_SIZE_SYNTAX1];
+    uint8_t crc1[PSI_CRC_SIZE], crc2[PSI_CRC_SIZE];
+    if (unlikely(!ubase_check(uref_block_extract(section1, 0,
+                        PSI_HEADER_SIZE_SYNTAX1, header1)) ||
+                 !ubase_check(uref_block_extract(section2, 0,
+                        PSI_HEADER_SIZE_SYNTAX1, header2)) ||
+                 !ubase_check(uref_block_extract(section1,
+                        size1 - PSI_CRC_SIZE, PSI_CRC_SIZE, crc1)) ||
+                 !ubase_check(uref_block_extract(section2,
+                        size2 - PSI_CRC_SIZE, PSI_CRC_SIZE, crc2))))
+        return false;
+
+    return !memcmp(header1, header2, PSI_HEADER_SIZE_SYNTAX1) &&
+           !memcmp(crc1, crc2, PSI_CRC_SIZE);
+}
+
 /** @This declares a PSI table in a structure.
  *
  * @param table name of the member
@@ -194,6 +234,23 @@ static inline bool upipe_ts_psid_table_section(struct uref **sections,
     return true;
 }
 
+/** @This checks if a new section is an unchanged repetition of the section
+ * with the same number in a PSI table (typically the table in effect).
+ *
+ * @param sections PSI table
+ * @param uref new section
+ * @return true if the section is already in the table
+ */
+static inline bool upipe_ts_psid_table_unchanged(struct uref **sections,
+                                                 struct uref *uref)
+{
+    uint8_t header[PSI_HEADER_SIZE_SYNTAX1];
+    if (unlikely(!ubase_check(uref_block_extract(uref, 0,
+                        PSI_HEADER_SIZE_SYNTAX1, header))))
+        return false;
+    return upipe_ts_psid_unchanged(sections[psi_get_section(header)], uref);
+}
+
 /** @This returns a section from a PSI table.
  *
  * @param sections PSI table
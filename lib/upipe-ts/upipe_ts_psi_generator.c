@@ -48,6 +48,7 @@
 #include <upipe-ts/upipe_ts_psi_generator.h>
 #include <upipe-ts/upipe_ts_mux.h>
 #include <upipe-ts/uref_ts_flow.h>
+#include <upipe-ts/upipe_ts_crc.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -900,7 +901,7 @@ static void upipe_ts_psig_program_build(struct upipe *upipe)
     uint8_t *es = pmt_get_es(buffer, j);
     pmt_set_length(buffer, es - buffer - PMT_HEADER_SIZE);
     uint16_t pmt_size = psi_get_length(buffer) + PSI_HEADER_SIZE;
-    psi_set_crc(buffer);
+    upipe_ts_psi_set_crc(buffer);
     ubuf_block_unmap(ubuf, 0);
     ubuf_block_resize(ubuf, 0, pmt_size);
 
@@ -1446,7 +1447,7 @@ static void upipe_ts_psig_build(struct upipe *upipe)
         }
 
         psi_set_lastsection(buffer, nb_sections - 1);
-        psi_set_crc(buffer);
+        upipe_ts_psi_set_crc(buffer);
 
         ubuf_block_unmap(ubuf, 0);
     }
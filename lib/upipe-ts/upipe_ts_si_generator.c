@@ -51,6 +51,7 @@
 #include <upipe-ts/upipe_ts_mux.h>
 #include <upipe-ts/uref_ts_flow.h>
 #include <upipe-ts/uref_ts_event.h>
+#include <upipe-ts/upipe_ts_crc.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -74,6 +75,16 @@
 #define DEFAULT_NAME "Upipe"
 /** we only store UTF-8 at the moment */
 #define NATIVE_ENCODING "UTF-8"
+/** number of EIT tables of a service (EITp/f and EIT schedule) */
+#define EIT_NB_TABLES 17
+/** number of segments in an EIT schedule table */
+#define EIT_SCHED_SEGMENTS 32
+/** number of sections in an EIT schedule segment */
+#define EIT_SCHED_SEGMENT_SECTIONS 8
+/** duration of an EIT schedule segment */
+#define EIT_SCHED_SEGMENT_DURATION (UINT64_C(3 * 3600) * UCLOCK_FREQ)
+/** duration of a day */
+#define DAY_DURATION (UINT64_C(86400) * UCLOCK_FREQ)
 
 /** @internal @This is the private context of a ts sig subpipe outputting a
  * table. */
@@ -171,6 +182,10 @@ struct upipe_ts_sig {
     /** last TDT cr_sys */
     uint64_t tdt_cr_sys;
 
+    /** midnight UTC of the current date, origin of the EIT schedule, or
+     * UINT64_MAX */
+    uint64_t eit_date;
+
     /** NIT output */
     struct upipe_ts_sig_output nit_output;
     /** SDT output */
@@ -216,8 +231,32 @@ static void upipe_ts_sig_build_sdt_flow_def(struct upipe *upipe);
 static void upipe_ts_sig_build_sdt(struct upipe *upipe);
 static void upipe_ts_sig_build_eit_flow_def(struct upipe *upipe);
 
+/** @internal @This is a segment of the EIT of a service. Segments are cached
+ * and only serialized again when the events they carry change. */
+struct upipe_ts_sig_eit_segment {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** table index (0 for EITp/f, n + 1 for the n-th EIT schedule table) */
+    uint8_t table;
+    /** segment number in the table (always 0 for EITp/f) */
+    uint8_t segment;
+    /** fingerprint of the events carried by the segment */
+    uint64_t fingerprint;
+    /** true if the segment is still wanted by the current build */
+    bool wanted;
+
+    /** sections of the segment */
+    struct uchain sections;
+    /** number of sections */
+    uint8_t nb_sections;
+    /** size of sections */
+    uint64_t size;
+};
+
+UBASE_FROM_TO(upipe_ts_sig_eit_segment, uchain, uchain, uchain)
+
 /** @internal @This is the private context of a service of a ts_sig pipe
- * (outputs EITp/f). */
+ * (outputs EITp/f and EIT schedule). */
 struct upipe_ts_sig_service {
     /** refcount management structure */
     struct urefcount urefcount;
@@ -226,20 +265,26 @@ struct upipe_ts_sig_service {
     /** input flow definition packet */
     struct uref *flow_def;
 
-    /** EIT version number */
-    uint8_t eit_version;
-    /** EIT sections */
-    struct uchain eit_sections;
-    /** number of EIT sections */
-    uint8_t eit_nb_sections;
-    /** size of EIT sections */
-    uint64_t eit_size;
-    /** EIT interval */
+    /** EIT version numbers, per table */
+    uint8_t eit_versions[EIT_NB_TABLES];
+    /** mask of EIT tables sent since their last version change */
+    uint32_t eit_sent;
+    /** cached EIT segments, by ascending table and segment */
+    struct uchain eit_segments;
+    /** EITp/f interval */
     uint64_t eit_interval;
-    /** last EIT cr_sys */
-    uint64_t eit_cr_sys;
-    /** false if a new EIT was built but not sent yet */
-    bool eit_sent;
+    /** EIT schedule interval */
+    uint64_t eit_sched_interval;
+    /** number of EIT sections, in the EITp/f and EIT schedule carousels */
+    unsigned int eit_nb_sections[2];
+    /** size of EIT sections, in the EITp/f and EIT schedule carousels */
+    uint64_t eit_size[2];
+    /** cr_sys of the last EIT section of each carousel */
+    uint64_t eit_cr_sys[2];
+    /** table index of the next EIT section of each carousel */
+    uint8_t eit_next_table[2];
+    /** section number of the next EIT section of each carousel */
+    unsigned int eit_next_section[2];
 
     /** public upipe structure */
     struct upipe upipe;
@@ -276,64 +321,282 @@ static struct upipe *upipe_ts_sig_service_alloc(struct upipe_mgr *mgr,
     upipe_ts_sig_service_init_urefcount(upipe);
     upipe_ts_sig_service_init_sub(upipe);
     service->flow_def = NULL;
-    service->eit_version = 0;
-    ulist_init(&service->eit_sections);
-    service->eit_nb_sections = 0;
-    service->eit_size = 0;
+    memset(service->eit_versions, 0, sizeof(service->eit_versions));
+    service->eit_sent = 0;
+    ulist_init(&service->eit_segments);
     service->eit_interval = 0;
-    service->eit_cr_sys = 0;
-    service->eit_sent = false;
+    service->eit_sched_interval = 0;
+    for (int i = 0; i < 2; i++) {
+        service->eit_nb_sections[i] = 0;
+        service->eit_size[i] = 0;
+        service->eit_cr_sys[i] = 0;
+        service->eit_next_table[i] = 0;
+        service->eit_next_section[i] = 0;
+    }
 
     upipe_throw_ready(upipe);
     return upipe;
 }
 
-/** @internal @This generates a new EIT PSI section.
+/** @internal @This returns the table ID of an EIT table index.
+ *
+ * @param table table index
+ * @return table ID
+ */
+static inline uint8_t upipe_ts_sig_eit_table_id(uint8_t table)
+{
+    return table ? EIT_TABLE_ID_SCHED_ACTUAL_FIRST + table - 1 :
+                   EIT_TABLE_ID_PF_ACTUAL;
+}
+
+/** @internal @This returns the number of the first section of a segment.
+ *
+ * @param segment cached EIT segment
+ * @return section number
+ */
+static inline unsigned int
+    upipe_ts_sig_eit_segment_first(struct upipe_ts_sig_eit_segment *segment)
+{
+    return segment->segment * EIT_SCHED_SEGMENT_SECTIONS;
+}
+
+/** @internal @This returns the interval of an EIT carousel of a service.
+ *
+ * @param service service structure
+ * @param sched 1 for the EIT schedule carousel, 0 for EITp/f
+ * @return interval, or 0 if the carousel is disabled
+ */
+static inline uint64_t
+    upipe_ts_sig_service_eit_interval(struct upipe_ts_sig_service *service,
+                                      int sched)
+{
+    return sched ? service->eit_sched_interval : service->eit_interval;
+}
+
+/** @internal @This frees a cached EIT segment.
+ *
+ * @param segment cached EIT segment
+ */
+static void upipe_ts_sig_eit_segment_free(
+        struct upipe_ts_sig_eit_segment *segment)
+{
+    struct uchain *section_chain;
+    while ((section_chain = ulist_pop(&segment->sections)) != NULL)
+        ubuf_free(ubuf_from_uchain(section_chain));
+    free(segment);
+}
+
+/** @internal @This frees all cached EIT segments of a service.
  *
  * @param upipe description structure of the pipe
  */
-static void upipe_ts_sig_service_build_eit(struct upipe *upipe)
+static void upipe_ts_sig_service_flush_eit(struct upipe *upipe)
 {
     struct upipe_ts_sig_service *service =
         upipe_ts_sig_service_from_upipe(upipe);
-    struct upipe_ts_sig *sig =
-        upipe_ts_sig_from_service_mgr(upipe->mgr);
-    uint64_t sid, tsid, onid;
-    if (unlikely(service->flow_def == NULL ||
-                 !ubase_check(uref_flow_get_id(service->flow_def, &sid)) ||
-                 sig->flow_def == NULL ||
-                 !ubase_check(uref_flow_get_id(sig->flow_def, &tsid)) ||
-                 !ubase_check(uref_ts_flow_get_onid(sig->flow_def, &onid))))
-        return;
-    if (!ubase_check(uref_ts_flow_get_eit(service->flow_def))) {
-        /* no EIT */
-        struct uchain *section_chain;
-        while ((section_chain = ulist_pop(&service->eit_sections)) != NULL)
-            ubuf_free(ubuf_from_uchain(section_chain));
-        return;
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&service->eit_segments)) != NULL)
+        upipe_ts_sig_eit_segment_free(
+                upipe_ts_sig_eit_segment_from_uchain(uchain));
+    for (int i = 0; i < 2; i++) {
+        service->eit_nb_sections[i] = 0;
+        service->eit_size[i] = 0;
     }
-    if (unlikely(sig->frozen)) {
-        upipe_dbg_va(upipe, "not rebuilding an EIT");
-        return;
+}
+
+/** @internal @This updates an FNV-1a hash with a buffer.
+ *
+ * @param hash current hash
+ * @param p pointer to the buffer
+ * @param size size of the buffer
+ * @return new hash
+ */
+static uint64_t upipe_ts_sig_hash(uint64_t hash, const void *p, size_t size)
+{
+    const uint8_t *buffer = p;
+    while (size--) {
+        hash ^= *buffer++;
+        hash *= UINT64_C(0x100000001b3);
     }
+    return hash;
+}
 
+/** @internal @This updates an FNV-1a hash with a string, including the
+ * terminating nul so that consecutive strings cannot be confused.
+ *
+ * @param hash current hash
+ * @param string string, or NULL
+ * @return new hash
+ */
+static uint64_t upipe_ts_sig_hash_string(uint64_t hash, const char *string)
+{
+    if (string == NULL)
+        return upipe_ts_sig_hash(hash, "", 1);
+    return upipe_ts_sig_hash(hash, string, strlen(string) + 1);
+}
 
-    upipe_notice_va(upipe, "new EIT sid=%"PRIu64" version=%"PRIu8,
-                    sid, service->eit_version);
+/** @internal @This updates the fingerprint of a segment with all the
+ * attributes of an event which are serialized in the EIT.
+ *
+ * @param flow_def flow definition of the service
+ * @param hash current fingerprint
+ * @param i event number
+ * @return new fingerprint
+ */
+static uint64_t upipe_ts_sig_hash_event(struct uref *flow_def, uint64_t hash,
+                                        uint64_t i)
+{
+    uint64_t values[5] = { 0, 0, 0, 0, 0 };
+    uint8_t running = 0;
+    uref_event_get_id(flow_def, &values[0], i);
+    uref_event_get_start(flow_def, &values[1], i);
+    uref_event_get_duration(flow_def, &values[2], i);
+    uref_ts_event_get_running_status(flow_def, &running, i);
+    values[3] = running;
+    values[4] = ubase_check(uref_ts_event_get_scrambled(flow_def, i));
+    hash = upipe_ts_sig_hash(hash, values, sizeof(values));
+
+    const char *string;
+    string = NULL;
+    uref_event_get_language(flow_def, &string, i);
+    hash = upipe_ts_sig_hash_string(hash, string);
+    string = NULL;
+    uref_event_get_name(flow_def, &string, i);
+    hash = upipe_ts_sig_hash_string(hash, string);
+    string = NULL;
+    uref_event_get_description(flow_def, &string, i);
+    hash = upipe_ts_sig_hash_string(hash, string);
+
+    uint64_t descriptors = 0;
+    uref_ts_event_get_descriptors(flow_def, &descriptors, i);
+    for (uint64_t j = 0; j < descriptors; j++) {
+        const uint8_t *desc;
+        size_t desc_len;
+        if (ubase_check(uref_ts_event_get_descriptor(flow_def, &desc,
+                        &desc_len, i, j)))
+            hash = upipe_ts_sig_hash(hash, desc, desc_len);
+    }
+    return hash;
+}
 
-    unsigned int nb_sections = 0;
-    uint64_t i = 0;
-    uint64_t event_number = 0;
-    uref_event_get_events(service->flow_def, &event_number);
-    uint64_t total_size = 0;
+/** @internal @This writes an event into an EIT section.
+ *
+ * @param upipe description structure of the pipe
+ * @param buffer EIT section
+ * @param event pointer to the event in the section
+ * @param i event number in the flow definition
+ * @return UBASE_ERR_INVALID if the event is incomplete, UBASE_ERR_NOSPC if
+ * it doesn't fit in the section, or UBASE_ERR_NONE
+ */
+static int upipe_ts_sig_service_write_event(struct upipe *upipe,
+                                            uint8_t *buffer, uint8_t *event,
+                                            uint64_t i)
+{
+    struct upipe_ts_sig_service *service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    uint64_t event_id;
+    uint64_t start, duration;
+    uint8_t running;
+    if (!ubase_check(uref_event_get_id(service->flow_def, &event_id, i)) ||
+        !ubase_check(uref_event_get_start(service->flow_def, &start, i)) ||
+        !ubase_check(uref_event_get_duration(service->flow_def,
+                &duration, i)) ||
+        !ubase_check(uref_ts_event_get_running_status(service->flow_def,
+                &running, i)))
+        return UBASE_ERR_INVALID;
+
+    bool ca = ubase_check(uref_ts_event_get_scrambled(service->flow_def, i));
+    const char *language, *name_str = NULL, *description_str;
+    uint8_t *name = NULL, *description = NULL;
+    size_t name_size = 0, description_size = 0;
+    bool desc4d =
+        ubase_check(uref_event_get_language(service->flow_def,
+                    &language, i)) &&
+        ubase_check(uref_event_get_name(service->flow_def, &name_str, i)) &&
+        ubase_check(uref_event_get_description(service->flow_def,
+                    &description_str, i));
+    if (desc4d) {
+        name = dvb_string_set((const uint8_t *)name_str, strlen(name_str),
+                              NATIVE_ENCODING, &name_size);
+        description = dvb_string_set((const uint8_t *)description_str,
+                                     strlen(description_str),
+                                     NATIVE_ENCODING, &description_size);
+    }
+
+    size_t descriptors_size =
+        uref_ts_event_size_descriptors(service->flow_def, i);
+    size_t desclength = descriptors_size +
+        (desc4d ? (DESC4D_HEADER_SIZE + name_size + 1 +
+                   description_size + 1) : 0);
+    if (event == NULL || !eit_validate_event(buffer, event, desclength)) {
+        free(name);
+        free(description);
+        return UBASE_ERR_NOSPC;
+    }
 
+    start /= UCLOCK_FREQ;
+    duration /= UCLOCK_FREQ;
+    upipe_verbose_va(upipe,
+            " * event id=%"PRIu64" start=%"PRIu64" duration=%"PRIu64" name=\"%s\"",
+            event_id, start, duration, name_str);
+
+    eitn_init(event);
+    eitn_set_event_id(event, event_id);
+    eitn_set_start_time(event, dvb_time_encode_UTC(start));
+    eitn_set_duration_bcd(event, dvb_time_encode_duration(duration));
+    eitn_set_running(event, running);
+    if (ca)
+        eitn_set_ca(event);
+    eitn_set_desclength(event, desclength);
+    uint16_t k = 0;
+    if (desc4d) {
+        uint8_t *desc = descs_get_desc(eitn_get_descs(event), k++);
+        desc4d_init(desc);
+        desc4d_set_lang(desc, (const uint8_t *)language);
+        desc4d_set_event_name(desc, name, name_size);
+        desc4d_set_text(desc, description, description_size);
+        desc4d_set_length(desc);
+        free(name);
+        free(description);
+    }
+    if (descriptors_size)
+        uref_ts_event_extract_descriptors(service->flow_def,
+                descs_get_desc(eitn_get_descs(event), k), i);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This serializes the events of a segment into new sections.
+ * The version number, last section numbers and CRC are set later by
+ * @ref upipe_ts_sig_service_stamp_eit.
+ *
+ * @param upipe description structure of the pipe
+ * @param segment cached EIT segment
+ * @param events array of event numbers, in chronological order
+ * @param nb_events number of events
+ * @param ids array of service_id, transport_stream_id and
+ * original_network_id
+ */
+static void upipe_ts_sig_service_build_eit_segment(struct upipe *upipe,
+        struct upipe_ts_sig_eit_segment *segment,
+        const uint64_t *events, unsigned int nb_events, const uint64_t *ids)
+{
+    struct upipe_ts_sig *sig = upipe_ts_sig_from_service_mgr(upipe->mgr);
     struct uchain *section_chain;
-    while ((section_chain = ulist_pop(&service->eit_sections)) != NULL)
+    while ((section_chain = ulist_pop(&segment->sections)) != NULL)
         ubuf_free(ubuf_from_uchain(section_chain));
-
-    do {
-        if (unlikely(nb_sections >= PSI_TABLE_MAX_SECTIONS)) {
-            upipe_warn(upipe, "EIT too large");
+    segment->nb_sections = 0;
+    segment->size = 0;
+
+    /* DVB only allows 1 event per section for EITp/f */
+    unsigned int max_events = segment->table ? UINT16_MAX : 1;
+    unsigned int max_sections = segment->table ?
+        EIT_SCHED_SEGMENT_SECTIONS : PSI_TABLE_MAX_SECTIONS;
+    unsigned int i = 0;
+    while (i < nb_events) {
+        if (unlikely(segment->nb_sections >= max_sections)) {
+            upipe_warn_va(upipe, "EIT segment %"PRIu8"/%"PRIu8" too large",
+                          upipe_ts_sig_eit_table_id(segment->table),
+                          segment->segment);
             upipe_throw_error(upipe, UBASE_ERR_INVALID);
             break;
         }
@@ -354,138 +617,351 @@ static void upipe_ts_sig_service_build_eit(struct upipe *upipe)
         }
 
         eit_init(buffer, true);
+        psi_set_tableid(buffer, upipe_ts_sig_eit_table_id(segment->table));
         /* set length later */
         psi_set_length(buffer, PSI_PRIVATE_MAX_SIZE);
-        eit_set_sid(buffer, sid);
-        eit_set_tsid(buffer, tsid);
-        eit_set_onid(buffer, onid);
-        eit_set_last_table_id(buffer, EIT_TABLE_ID_PF_ACTUAL);
-        psi_set_version(buffer, service->eit_version);
+        eit_set_sid(buffer, ids[0]);
+        eit_set_tsid(buffer, ids[1]);
+        eit_set_onid(buffer, ids[2]);
         psi_set_current(buffer);
-        psi_set_section(buffer, nb_sections);
-        /* set last section and segment_last_sec_number in the end */
+        psi_set_section(buffer, upipe_ts_sig_eit_segment_first(segment) +
+                                segment->nb_sections);
+        /* set version and last section numbers when stamping */
 
         uint16_t j = 0;
-        uint8_t *event;
-        while ((event = eit_get_event(buffer, j)) != NULL && i < event_number) {
-            if (j) /* DVB only allows 1 event per section for EITp/f */
+        uint8_t *event = eit_get_event(buffer, j);
+        while (i < nb_events && j < max_events) {
+            int err = upipe_ts_sig_service_write_event(upipe, buffer, event,
+                                                       events[i]);
+            if (err == UBASE_ERR_NOSPC && j)
                 break;
-
-            uint64_t event_id;
-            uint64_t start, duration;
-            uint8_t running;
-            if (!ubase_check(uref_event_get_id(service->flow_def,
-                            &event_id, i)) ||
-                !ubase_check(uref_event_get_start(service->flow_def,
-                            &start, i)) ||
-                !ubase_check(uref_event_get_duration(service->flow_def,
-                            &duration, i)) ||
-                !ubase_check(uref_ts_event_get_running_status(service->flow_def,
-                            &running, i))) {
-                i++;
-                continue;
-            }
-            bool ca =
-                ubase_check(uref_ts_event_get_scrambled(service->flow_def, i));
-            const char *language, *name_str = NULL, *description_str;
-            uint8_t *name = NULL, *description = NULL;
-            size_t name_size = 0, description_size = 0;
-            bool desc4d = 
-                ubase_check(uref_event_get_language(service->flow_def,
-                            &language, i)) &&
-                ubase_check(uref_event_get_name(service->flow_def,
-                            &name_str, i)) &&
-                ubase_check(uref_event_get_description(service->flow_def,
-                            &description_str, i));
-            if (desc4d) {
-                name = dvb_string_set((const uint8_t *)name_str,
-                        strlen(name_str), NATIVE_ENCODING,
-                        &name_size);
-                description = dvb_string_set((const uint8_t *)description_str,
-                        strlen(description_str), NATIVE_ENCODING,
-                        &description_size);
-            }
-
-            size_t descriptors_size =
-                uref_ts_event_size_descriptors(service->flow_def, i);
-            if (!eit_validate_event(buffer, event, descriptors_size +
-                        (desc4d ? (DESC4D_HEADER_SIZE + name_size + 1 +
-                         description_size + 1) : 0))) {
-                free(name);
-                free(description);
-                if (j)
-                    break;
+            if (err == UBASE_ERR_NOSPC)
                 upipe_err_va(upipe, "EIT event too large");
-                ubuf_free(ubuf);
-                upipe_throw_error(upipe, UBASE_ERR_INVALID);
-                return;
-            }
-
-            start /= UCLOCK_FREQ;
-            duration /= UCLOCK_FREQ;
-            upipe_notice_va(upipe,
-                    " * event id=%"PRIu64" start=%"PRIu64" duration=%"PRIu64" name=\"%s\"",
-                    event_id, start, duration, name_str);
-
-            j++;
-            eitn_init(event);
-            eitn_set_event_id(event, event_id);
-            eitn_set_start_time(event, dvb_time_encode_UTC(start));
-            eitn_set_duration_bcd(event, dvb_time_encode_duration(duration));
-            eitn_set_running(event, running);
-            if (ca)
-                eitn_set_ca(event);
-            eitn_set_desclength(event, descriptors_size +
-                        (desc4d ? (DESC4D_HEADER_SIZE + name_size + 1 +
-                                   description_size + 1) : 0));
-            uint16_t k = 0;
-            if (desc4d) {
-                uint8_t *desc = descs_get_desc(eitn_get_descs(event), k++);
-                desc4d_init(desc);
-                desc4d_set_lang(desc, (const uint8_t *)language);
-                desc4d_set_event_name(desc, name, name_size);
-                desc4d_set_text(desc, description, description_size);
-                desc4d_set_length(desc);
-                free(name);
-                free(description);
-            }
-            if (descriptors_size)
-                uref_ts_event_extract_descriptors(service->flow_def,
-                        descs_get_desc(eitn_get_descs(event), k), i);
             i++;
+            if (!ubase_check(err))
+                continue;
+            j++;
+            event = eit_get_event(buffer, j);
         }
 
         eit_set_length(buffer, event - buffer - EIT_HEADER_SIZE);
         uint16_t eit_size = psi_get_length(buffer) + PSI_HEADER_SIZE;
         ubuf_block_unmap(ubuf, 0);
 
+        if (!j) {
+            ubuf_free(ubuf);
+            continue;
+        }
+
         ubuf_block_resize(ubuf, 0, eit_size);
-        ulist_add(&service->eit_sections, ubuf_to_uchain(ubuf));
-        nb_sections++;
-        total_size += eit_size;
-    } while (i < event_number);
+        ulist_add(&segment->sections, ubuf_to_uchain(ubuf));
+        segment->nb_sections++;
+        segment->size += eit_size;
+    }
+}
 
-    ulist_foreach (&service->eit_sections, section_chain) {
-        struct ubuf *ubuf = ubuf_from_uchain(section_chain);
-        uint8_t *buffer;
-        int size = -1;
-        if (!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer))) {
+/** @internal @This sets the version number, last section numbers and CRC
+ * of all sections of an EIT table, after one of its segments changed.
+ * Sections which are still referenced by the output are copied first.
+ *
+ * @param upipe description structure of the pipe
+ * @param table table index
+ * @param last_table_id last table ID of the EIT of the service
+ */
+static void upipe_ts_sig_service_stamp_eit(struct upipe *upipe,
+                                           uint8_t table,
+                                           uint8_t last_table_id)
+{
+    struct upipe_ts_sig_service *service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    struct upipe_ts_sig *sig = upipe_ts_sig_from_service_mgr(upipe->mgr);
+
+    if (service->eit_sent & (UINT32_C(1) << table)) {
+        service->eit_versions[table]++;
+        service->eit_versions[table] &= 0x1f;
+        service->eit_sent &= ~(UINT32_C(1) << table);
+    }
+
+    uint8_t last_section = 0;
+    struct uchain *uchain;
+    ulist_foreach (&service->eit_segments, uchain) {
+        struct upipe_ts_sig_eit_segment *segment =
+            upipe_ts_sig_eit_segment_from_uchain(uchain);
+        if (segment->table == table && segment->nb_sections)
+            last_section = upipe_ts_sig_eit_segment_first(segment) +
+                           segment->nb_sections - 1;
+    }
+
+    ulist_foreach (&service->eit_segments, uchain) {
+        struct upipe_ts_sig_eit_segment *segment =
+            upipe_ts_sig_eit_segment_from_uchain(uchain);
+        if (segment->table != table)
+            continue;
+
+        struct uchain *section_chain, *section_tmp;
+        ulist_delete_foreach (&segment->sections, section_chain,
+                              section_tmp) {
+            struct ubuf *ubuf = ubuf_from_uchain(section_chain);
+            uint8_t *buffer;
+            int size = -1;
+            if (!ubase_check(ubuf_block_write(ubuf, 0, &size, &buffer))) {
+                /* the section is still being output */
+                struct ubuf *copy = ubuf_block_copy(sig->ubuf_mgr, ubuf,
+                                                    0, -1);
+                if (unlikely(copy == NULL ||
+                             !ubase_check(ubuf_block_write(copy, 0, &size,
+                                                           &buffer)))) {
+                    if (copy != NULL)
+                        ubuf_free(copy);
+                    upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                    continue;
+                }
+                struct uchain *prev = section_chain->prev;
+                ulist_delete(section_chain);
+                ubuf_free(ubuf);
+                ubuf = copy;
+                ulist_insert(prev, prev->next, ubuf_to_uchain(ubuf));
+            }
+
+            psi_set_version(buffer, service->eit_versions[table]);
+            psi_set_lastsection(buffer, last_section);
+            eit_set_last_table_id(buffer, last_table_id);
+            eit_set_segment_last_sec_number(buffer,
+                    upipe_ts_sig_eit_segment_first(segment) +
+                    segment->nb_sections - 1);
+            upipe_ts_psi_set_crc(buffer);
+            ubuf_block_unmap(ubuf, 0);
+        }
+    }
+}
+
+/** @internal @This updates the EIT of a service. Events are dispatched to
+ * EITp/f and, if the service announces an EIT schedule, to the 3-hour
+ * segments of the EIT schedule tables, counted from midnight UTC of the
+ * current date (or of the first event if the date is not known yet). Events
+ * which ended before that are left out of the schedule. Only the segments
+ * whose events changed are serialized again.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_sig_service_build_eit(struct upipe *upipe)
+{
+    struct upipe_ts_sig_service *service =
+        upipe_ts_sig_service_from_upipe(upipe);
+    struct upipe_ts_sig *sig =
+        upipe_ts_sig_from_service_mgr(upipe->mgr);
+    uint64_t ids[3];
+    if (unlikely(service->flow_def == NULL ||
+                 !ubase_check(uref_flow_get_id(service->flow_def, &ids[0])) ||
+                 sig->flow_def == NULL ||
+                 !ubase_check(uref_flow_get_id(sig->flow_def, &ids[1])) ||
+                 !ubase_check(uref_ts_flow_get_onid(sig->flow_def, &ids[2]))))
+        return;
+    if (!ubase_check(uref_ts_flow_get_eit(service->flow_def))) {
+        /* no EIT */
+        upipe_ts_sig_service_flush_eit(upipe);
+        return;
+    }
+    if (unlikely(sig->frozen)) {
+        upipe_dbg_va(upipe, "not rebuilding an EIT");
+        return;
+    }
+
+    bool schedule =
+        ubase_check(uref_ts_flow_get_eit_schedule(service->flow_def));
+    uint64_t event_number = 0;
+    uref_event_get_events(service->flow_def, &event_number);
+
+    /* event number of each event, ordered by segment and start date */
+    struct upipe_ts_sig_eit_event {
+        uint64_t start;
+        uint64_t event;
+        uint16_t segment;
+    } *events = NULL;
+    unsigned int nb_events = 0;
+    if (event_number) {
+        events = malloc(sizeof(*events) * event_number * (schedule ? 2 : 1));
+        if (unlikely(events == NULL)) {
             upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+    }
+
+    uint64_t midnight = sig->eit_date;
+    for (uint64_t i = 0; i < event_number; i++) {
+        uint64_t start, duration = 0;
+        bool has_start =
+            ubase_check(uref_event_get_start(service->flow_def, &start, i));
+        uref_event_get_duration(service->flow_def, &duration, i);
+        /* EITp/f carries the present and following events */
+        if (!schedule || i < 2) {
+            events[nb_events].start = 0;
+            events[nb_events].event = i;
+            events[nb_events].segment = 0;
+            nb_events++;
+        }
+        if (schedule && has_start &&
+            (sig->eit_date == UINT64_MAX ||
+             start + duration > sig->eit_date)) {
+            events[nb_events].start = start;
+            events[nb_events].event = i;
+            events[nb_events].segment = UINT16_MAX;
+            nb_events++;
+            if (sig->eit_date == UINT64_MAX && start < midnight)
+                midnight = start - start % DAY_DURATION;
+        }
+    }
+
+    for (unsigned int i = 0; i < nb_events; i++) {
+        if (events[i].segment != UINT16_MAX)
             continue;
+        /* events which started before midnight are in the first segment */
+        uint64_t segment = events[i].start < midnight ? 0 :
+            (events[i].start - midnight) / EIT_SCHED_SEGMENT_DURATION;
+        if (segment >= (EIT_NB_TABLES - 1) * EIT_SCHED_SEGMENTS) {
+            upipe_warn_va(upipe, "event %"PRIu64" is too far in the future",
+                          events[i].event);
+            continue;
+        }
+        events[i].segment = segment + EIT_SCHED_SEGMENTS;
+    }
+
+    /* stable insertion sort, events are usually already in order */
+    for (unsigned int i = 1; i < nb_events; i++) {
+        struct upipe_ts_sig_eit_event event = events[i];
+        unsigned int j = i;
+        while (j && (events[j - 1].segment > event.segment ||
+                     (events[j - 1].segment == event.segment &&
+                      events[j - 1].start > event.start))) {
+            events[j] = events[j - 1];
+            j--;
         }
+        events[j] = event;
+    }
 
-        eit_set_segment_last_sec_number(buffer, nb_sections - 1);
-        psi_set_lastsection(buffer, nb_sections - 1);
-        psi_set_crc(buffer);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_foreach (&service->eit_segments, uchain)
+        upipe_ts_sig_eit_segment_from_uchain(uchain)->wanted = false;
 
-        ubuf_block_unmap(ubuf, 0);
+    uint64_t *segment_events = NULL;
+    if (nb_events) {
+        segment_events = malloc(sizeof(uint64_t) * nb_events);
+        if (unlikely(segment_events == NULL)) {
+            free(events);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+    }
+
+    uint32_t changed = 0;
+    unsigned int nb_built = 0;
+    struct uchain *cursor = &service->eit_segments;
+    unsigned int i = 0;
+    while (i < nb_events && events[i].segment != UINT16_MAX) {
+        uint16_t segment_nb = events[i].segment;
+        uint8_t table = segment_nb ?
+            segment_nb / EIT_SCHED_SEGMENTS : 0;
+        uint8_t segment_in_table = segment_nb % EIT_SCHED_SEGMENTS;
+        uint64_t fingerprint = UINT64_C(0xcbf29ce484222325);
+        fingerprint = upipe_ts_sig_hash(fingerprint, ids, sizeof(ids));
+        unsigned int nb = 0;
+        for ( ; i < nb_events && events[i].segment == segment_nb; i++) {
+            segment_events[nb++] = events[i].event;
+            fingerprint = upipe_ts_sig_hash_event(service->flow_def,
+                                                  fingerprint,
+                                                  events[i].event);
+        }
+
+        /* find the cached segment, the list is sorted */
+        struct upipe_ts_sig_eit_segment *segment = NULL;
+        while (!ulist_is_last(&service->eit_segments, cursor)) {
+            struct upipe_ts_sig_eit_segment *next =
+                upipe_ts_sig_eit_segment_from_uchain(cursor->next);
+            if (next->table > table ||
+                (next->table == table && next->segment > segment_in_table))
+                break;
+            cursor = cursor->next;
+            if (next->table == table && next->segment == segment_in_table) {
+                segment = next;
+                break;
+            }
+        }
+
+        if (segment == NULL) {
+            segment = malloc(sizeof(struct upipe_ts_sig_eit_segment));
+            if (unlikely(segment == NULL)) {
+                upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+                break;
+            }
+            uchain_init(&segment->uchain);
+            segment->table = table;
+            segment->segment = segment_in_table;
+            ulist_init(&segment->sections);
+            segment->nb_sections = 0;
+            segment->size = 0;
+            ulist_insert(cursor, cursor->next, &segment->uchain);
+            cursor = &segment->uchain;
+        } else if (segment->fingerprint == fingerprint) {
+            segment->wanted = true;
+            continue;
+        }
+
+        segment->fingerprint = fingerprint;
+        segment->wanted = true;
+        upipe_ts_sig_service_build_eit_segment(upipe, segment, segment_events,
+                                               nb, ids);
+        changed |= UINT32_C(1) << table;
+        nb_built++;
+    }
+    free(segment_events);
+    free(events);
+
+    uint32_t tables = 0, old_tables = 0;
+    ulist_delete_foreach (&service->eit_segments, uchain, uchain_tmp) {
+        struct upipe_ts_sig_eit_segment *segment =
+            upipe_ts_sig_eit_segment_from_uchain(uchain);
+        old_tables |= UINT32_C(1) << segment->table;
+        if (!segment->wanted) {
+            changed |= UINT32_C(1) << segment->table;
+            ulist_delete(uchain);
+            upipe_ts_sig_eit_segment_free(segment);
+            continue;
+        }
+        tables |= UINT32_C(1) << segment->table;
     }
 
-    upipe_notice_va(upipe, "end EIT (%u sections)", nb_sections);
+    /* last_table_id changed, all schedule tables must be stamped again */
+    uint8_t last_table = 0;
+    for (uint8_t table = 1; table < EIT_NB_TABLES; table++)
+        if (tables & (UINT32_C(1) << table))
+            last_table = table;
+    if ((tables & ~UINT32_C(1)) != (old_tables & ~UINT32_C(1)))
+        changed |= tables & ~UINT32_C(1);
+    if (!changed)
+        return;
 
-    service->eit_nb_sections = nb_sections;
-    service->eit_size = total_size;
-    service->eit_sent = false;
+    for (int k = 0; k < 2; k++) {
+        service->eit_nb_sections[k] = 0;
+        service->eit_size[k] = 0;
+    }
+    ulist_foreach (&service->eit_segments, uchain) {
+        struct upipe_ts_sig_eit_segment *segment =
+            upipe_ts_sig_eit_segment_from_uchain(uchain);
+        int k = segment->table ? 1 : 0;
+        service->eit_nb_sections[k] += segment->nb_sections;
+        service->eit_size[k] += segment->size;
+    }
+
+    for (uint8_t table = 0; table < EIT_NB_TABLES; table++)
+        if (changed & tables & (UINT32_C(1) << table))
+            upipe_ts_sig_service_stamp_eit(upipe, table,
+                    table ? upipe_ts_sig_eit_table_id(last_table) :
+                            EIT_TABLE_ID_PF_ACTUAL);
+
+    upipe_notice_va(upipe,
+            "new EIT sid=%"PRIu64" (%u segments rebuilt, %u+%u sections)",
+            ids[0], nb_built, service->eit_nb_sections[0],
+            service->eit_nb_sections[1]);
 }
 
 /** @internal @This compares two services wrt. ascending service IDs.
@@ -549,7 +1025,8 @@ static int upipe_ts_sig_service_set_flow_def(struct upipe *upipe,
     bool eit = ubase_check(uref_ts_flow_get_eit(flow_def));
     bool eit_change = service->flow_def == NULL ||
         uref_flow_cmp_id(flow_def, service->flow_def) ||
-        uref_ts_flow_cmp_eit(flow_def, service->flow_def);
+        uref_ts_flow_cmp_eit(flow_def, service->flow_def) ||
+        uref_ts_flow_cmp_eit_schedule(flow_def, service->flow_def);
     if (!eit_change && eit) {
         eit_change = uref_event_cmp_events(flow_def, service->flow_def);
         if (!eit_change) {
@@ -638,6 +1115,18 @@ static int upipe_ts_sig_service_control(struct upipe *upipe,
             upipe_ts_sig_build_eit_flow_def(upipe_ts_sig_to_upipe(sig));
             return UBASE_ERR_NONE;
         }
+        case UPIPE_TS_MUX_GET_EIT_SCHED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            *interval_p = upipe_ts_sig_service->eit_sched_interval;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_MUX_SET_EIT_SCHED_INTERVAL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_MUX_SIGNATURE)
+            upipe_ts_sig_service->eit_sched_interval = va_arg(args, uint64_t);
+            upipe_ts_sig_build_eit_flow_def(upipe_ts_sig_to_upipe(sig));
+            return UBASE_ERR_NONE;
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -656,13 +1145,12 @@ static void upipe_ts_sig_service_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     upipe_ts_sig_service_clean_sub(upipe);
-    struct uchain *section_chain;
-    while ((section_chain = ulist_pop(&service->eit_sections)) != NULL)
-        ubuf_free(ubuf_from_uchain(section_chain));
+    upipe_ts_sig_service_flush_eit(upipe);
     uref_free(service->flow_def);
 
     upipe_ts_sig_build_sdt(upipe_ts_sig_to_upipe(sig));
     upipe_ts_sig_build_sdt_flow_def(upipe_ts_sig_to_upipe(sig));
+    upipe_ts_sig_build_eit_flow_def(upipe_ts_sig_to_upipe(sig));
 
     upipe_ts_sig_service_clean_urefcount(upipe);
     upipe_ts_sig_service_free_void(upipe);
@@ -846,6 +1334,8 @@ static struct upipe *_upipe_ts_sig_alloc(struct upipe_mgr *mgr,
     upipe_ts_sig->tdt_interval = 0;
     upipe_ts_sig->tdt_cr_sys = 0;
 
+    upipe_ts_sig->eit_date = UINT64_MAX;
+
     upipe_throw_ready(upipe);
     upipe_ts_sig_demand_uref_mgr(upipe);
     if (likely(upipe_ts_sig->uref_mgr != NULL)) {
@@ -860,38 +1350,52 @@ static struct upipe *_upipe_ts_sig_alloc(struct upipe_mgr *mgr,
  *
  * @param upipe description structure of the pipe
  * @param output pointer to upipe_ts_sig_output pipe
- * @param sections ulist of PSI sections to send
+ * @param section PSI section to send
+ * @param last true if the section is the last of the table
  */
-static void upipe_ts_sig_send(struct upipe *upipe, struct upipe *output_pipe,
-                              struct uchain *sections)
+static void upipe_ts_sig_send_section(struct upipe *upipe,
+                                      struct upipe *output_pipe,
+                                      struct ubuf *section, bool last)
 {
     struct upipe_ts_sig *sig = upipe_ts_sig_from_upipe(upipe);
     struct upipe_ts_sig_output *output =
         upipe_ts_sig_output_from_upipe(output_pipe);
-    struct uchain *section_chain;
-    ulist_foreach (sections, section_chain) {
-        bool last = ulist_is_last(sections, section_chain);
-        struct ubuf *ubuf = ubuf_dup(ubuf_from_uchain(section_chain));
-        struct uref *uref = uref_alloc(sig->uref_mgr);
-        size_t ubuf_size;
-        if (unlikely(uref == NULL || ubuf == NULL ||
-                     !ubase_check(ubuf_block_size(ubuf, &ubuf_size)))) {
-            ubuf_free(ubuf);
-            uref_free(uref);
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            continue;
-        }
-
-        uref_attach_ubuf(uref, ubuf);
-        uref_block_set_start(uref);
-        if (last)
-            uref_block_set_end(uref);
-        uref_clock_set_cr_sys(uref, output->cr_sys);
-        upipe_ts_sig_output_output(output_pipe, uref, NULL);
-        output->cr_sys +=
-            (uint64_t)ubuf_size * UCLOCK_FREQ / output->octetrate +
-            MIN_SECTION_INTERVAL;
+    struct ubuf *ubuf = ubuf_dup(section);
+    struct uref *uref = uref_alloc(sig->uref_mgr);
+    size_t ubuf_size;
+    if (unlikely(uref == NULL || ubuf == NULL ||
+                 !ubase_check(ubuf_block_size(ubuf, &ubuf_size)))) {
+        ubuf_free(ubuf);
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
     }
+
+    uref_attach_ubuf(uref, ubuf);
+    uref_block_set_start(uref);
+    if (last)
+        uref_block_set_end(uref);
+    uref_clock_set_cr_sys(uref, output->cr_sys);
+    upipe_ts_sig_output_output(output_pipe, uref, NULL);
+    output->cr_sys +=
+        (uint64_t)ubuf_size * UCLOCK_FREQ / output->octetrate +
+        MIN_SECTION_INTERVAL;
+}
+
+/** @internal @This sends a table of PSI sections.
+ *
+ * @param upipe description structure of the pipe
+ * @param output pointer to upipe_ts_sig_output pipe
+ * @param sections ulist of PSI sections to send
+ */
+static void upipe_ts_sig_send(struct upipe *upipe, struct upipe *output_pipe,
+                              struct uchain *sections)
+{
+    struct uchain *section_chain;
+    ulist_foreach (sections, section_chain)
+        upipe_ts_sig_send_section(upipe, output_pipe,
+                                  ubuf_from_uchain(section_chain),
+                                  ulist_is_last(sections, section_chain));
 }
 
 /** @internal @This builds a new output flow definition for NIT.
@@ -1104,7 +1608,7 @@ static void upipe_ts_sig_build_nit(struct upipe *upipe)
         }
 
         psi_set_lastsection(buffer, nb_sections - 1);
-        psi_set_crc(buffer);
+        upipe_ts_psi_set_crc(buffer);
 
         ubuf_block_unmap(ubuf, 0);
     }
@@ -1363,7 +1867,7 @@ static void upipe_ts_sig_build_sdt(struct upipe *upipe)
         }
 
         psi_set_lastsection(buffer, nb_sections - 1);
-        psi_set_crc(buffer);
+        upipe_ts_psi_set_crc(buffer);
 
         ubuf_block_unmap(ubuf, 0);
     }
@@ -1422,28 +1926,34 @@ static void upipe_ts_sig_build_eit_flow_def(struct upipe *upipe)
     ulist_foreach (&sig->services, uchain) {
         struct upipe_ts_sig_service *service =
             upipe_ts_sig_service_from_uchain(uchain);
-        if (!service->eit_interval)
-            continue;
-        size += service->eit_size;
-
-        if (service->eit_nb_sections) {
-            struct urational freq;
-            freq.num = 1;
-            freq.den = service->eit_interval / service->eit_nb_sections;
-            urational_simplify(&freq);
-            section_freq = urational_add(&section_freq, &freq);
-        }
-
-        /* duration during which we transmit the EIT */
-        int64_t duration = service->eit_interval -
-            MIN_SECTION_INTERVAL * service->eit_nb_sections;
-        if (duration < MIN_SECTION_INTERVAL) {
-            upipe_warn_va(upipe_ts_sig_service_to_upipe(service),
-                          "EIT interval is too short (missing %"PRId64")",
-                          MIN_SECTION_INTERVAL - duration);
-            duration = MIN_SECTION_INTERVAL;
-        }
-        octetrate += (uint64_t)service->eit_size * UCLOCK_FREQ / duration;
+        for (int k = 0; k < 2; k++) {
+            uint64_t interval =
+                upipe_ts_sig_service_eit_interval(service, k);
+            if (!interval)
+                continue;
+            size += service->eit_size[k];
+
+            if (service->eit_nb_sections[k]) {
+                struct urational freq;
+                freq.num = 1;
+                freq.den = interval / service->eit_nb_sections[k];
+                urational_simplify(&freq);
+                section_freq = urational_add(&section_freq, &freq);
+            }
+
+            /* duration during which we transmit the EIT */
+            int64_t duration = interval -
+                MIN_SECTION_INTERVAL * service->eit_nb_sections[k];
+            if (duration < MIN_SECTION_INTERVAL) {
+                upipe_warn_va(upipe_ts_sig_service_to_upipe(service),
+                              "EIT%s interval is too short "
+                              "(missing %"PRId64")", k ? " schedule" : "p/f",
+                              MIN_SECTION_INTERVAL - duration);
+                duration = MIN_SECTION_INTERVAL;
+            }
+            octetrate += (uint64_t)service->eit_size[k] * UCLOCK_FREQ /
+                         duration;
+        }
     }
 
     if (unlikely(!size || !section_freq.num)) {
@@ -1478,7 +1988,57 @@ static void upipe_ts_sig_build_eit_flow_def(struct upipe *upipe)
                                NULL, NULL);
 }
 
-/** @internal @This sends a EIT PSI section.
+/** @internal @This returns the next section of an EIT carousel of a
+ * service, and moves the carousel forward.
+ *
+ * @param service service structure
+ * @param sched 1 for the EIT schedule carousel, 0 for EITp/f
+ * @param table_p filled in with the table index of the section
+ * @return pointer to the section, or NULL if there is none
+ */
+static struct ubuf *
+    upipe_ts_sig_service_next_eit(struct upipe_ts_sig_service *service,
+                                  int sched, uint8_t *table_p)
+{
+    struct upipe_ts_sig_eit_segment *first = NULL;
+    struct uchain *uchain;
+    ulist_foreach (&service->eit_segments, uchain) {
+        struct upipe_ts_sig_eit_segment *segment =
+            upipe_ts_sig_eit_segment_from_uchain(uchain);
+        if (!segment->nb_sections || !segment->table != !sched)
+            continue;
+        if (first == NULL)
+            first = segment;
+        if (segment->table < service->eit_next_table[sched])
+            continue;
+
+        unsigned int section = upipe_ts_sig_eit_segment_first(segment);
+        struct uchain *section_chain;
+        ulist_foreach (&segment->sections, section_chain) {
+            if (segment->table > service->eit_next_table[sched] ||
+                section >= service->eit_next_section[sched]) {
+                service->eit_next_table[sched] = segment->table;
+                service->eit_next_section[sched] = section + 1;
+                *table_p = segment->table;
+                return ubuf_from_uchain(section_chain);
+            }
+            section++;
+        }
+    }
+
+    if (first == NULL)
+        return NULL;
+    /* start over */
+    service->eit_next_table[sched] = first->table;
+    service->eit_next_section[sched] =
+        upipe_ts_sig_eit_segment_first(first) + 1;
+    *table_p = first->table;
+    return ubuf_from_uchain(ulist_peek(&first->sections));
+}
+
+/** @internal @This sends a EIT PSI section. The EITp/f sections of each
+ * service are spread over the EIT interval, and its EIT schedule sections
+ * over the EIT schedule interval, instead of being sent in a burst.
  *
  * @param upipe description structure of the pipe
  * @param cr_sys cr_sys of the next muxed packet
@@ -1497,23 +2057,32 @@ static void upipe_ts_sig_send_eit(struct upipe *upipe, uint64_t cr_sys)
     ulist_foreach (&sig->services, uchain) {
         struct upipe_ts_sig_service *service =
             upipe_ts_sig_service_from_uchain(uchain);
-        if (ulist_empty(&service->eit_sections) || !service->eit_interval ||
-            service->eit_cr_sys + service->eit_interval > cr_sys)
-            continue;
+        for (int k = 0; k < 2; k++) {
+            uint64_t interval = upipe_ts_sig_service_eit_interval(service, k);
+            if (!service->eit_nb_sections[k] || !interval ||
+                service->eit_cr_sys[k] +
+                    interval / service->eit_nb_sections[k] > cr_sys)
+                continue;
 
-        output->cr_sys = cr_sys;
-        service->eit_cr_sys = cr_sys;
-        if (!service->eit_sent) {
-            service->eit_version++;
-            service->eit_version &= 0x1f;
-            service->eit_sent = true;
-        }
+            uint8_t table;
+            struct ubuf *section =
+                upipe_ts_sig_service_next_eit(service, k, &table);
+            if (unlikely(section == NULL))
+                continue;
 
-        upipe_verbose_va(upipe_ts_sig_service_to_upipe(service),
-                         "sending EIT (%"PRIu64")", cr_sys);
-        upipe_ts_sig_send(upipe, upipe_ts_sig_output_to_upipe(output),
-                          &service->eit_sections);
-        return;
+            output->cr_sys = cr_sys;
+            service->eit_cr_sys[k] = cr_sys;
+            service->eit_sent |= UINT32_C(1) << table;
+
+            upipe_verbose_va(upipe_ts_sig_service_to_upipe(service),
+                    "sending EIT table %"PRIu8" section %u (%"PRIu64")",
+                    upipe_ts_sig_eit_table_id(table),
+                    service->eit_next_section[k] - 1, cr_sys);
+            upipe_ts_sig_send_section(upipe,
+                                      upipe_ts_sig_output_to_upipe(output),
+                                      section, true);
+            return;
+        }
     }
 }
 
@@ -1691,6 +2260,42 @@ static int upipe_ts_sig_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This checks the current date, and segments the EIT schedules
+ * again when it changes.
+ *
+ * @param upipe description structure of the pipe
+ * @param cr_sys current muxing date
+ * @param latency latency before the packet is output
+ */
+static void upipe_ts_sig_check_date(struct upipe *upipe, uint64_t cr_sys,
+                                    uint64_t latency)
+{
+    struct upipe_ts_sig *sig = upipe_ts_sig_from_upipe(upipe);
+    uint64_t now;
+    if (sig->uclock == NULL ||
+        (now = uclock_to_real(sig->uclock, cr_sys + latency)) == UINT64_MAX)
+        return;
+    uint64_t date = now - now % DAY_DURATION;
+    if (likely(date == sig->eit_date))
+        return;
+
+    sig->eit_date = date;
+    bool changed = false;
+    struct uchain *uchain;
+    ulist_foreach (&sig->services, uchain) {
+        struct upipe_ts_sig_service *service =
+            upipe_ts_sig_service_from_uchain(uchain);
+        if (service->flow_def == NULL ||
+            !ubase_check(uref_ts_flow_get_eit_schedule(service->flow_def)))
+            continue;
+        upipe_ts_sig_service_build_eit(
+                upipe_ts_sig_service_to_upipe(service));
+        changed = true;
+    }
+    if (changed)
+        upipe_ts_sig_build_eit_flow_def(upipe);
+}
+
 /** @This prepares the next PSI sections for the given date.
  *
  * @param upipe description structure of the pipe
@@ -1701,6 +2306,7 @@ static int upipe_ts_sig_set_flow_def(struct upipe *upipe, struct uref *flow_def)
 static int upipe_ts_sig_prepare(struct upipe *upipe, uint64_t cr_sys,
                                 uint64_t latency)
 {
+    upipe_ts_sig_check_date(upipe, cr_sys, latency);
     upipe_ts_sig_send_nit(upipe, cr_sys);
     upipe_ts_sig_send_sdt(upipe, cr_sys);
     upipe_ts_sig_send_eit(upipe, cr_sys);
@@ -0,0 +1,927 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ */
+
+/** @file
+ * @short Upipe module computing TR 101 290 priority 1 and 2 indicators
+ * Normative references:
+ *  - ETSI TR 101 290 V1.2.1 (2001-05) (measurement guidelines for DVB
+ *  systems)
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe-ts/upipe_ts_tr101290.h>
+#include <upipe-ts/upipe_ts_crc.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/pes.h>
+#include <bitstream/mpeg/psi.h>
+
+/** we only accept TS packets */
+#define EXPECTED_FLOW_DEF "block.mpegts."
+/** max number of PIDs */
+#define MAX_PIDS 8192
+/** PID of null packets */
+#define PADDING_PID 8191
+/** 2^33 (max resolution of PCR, PTS and DTS) */
+#define POW2_33 UINT64_C(8589934592)
+/** wrap-around of PCR and PTS values in 27 MHz units */
+#define WRAP_27M (POW2_33 * 300)
+/** number of consecutive corrupted sync bytes before loss of sync (1.1) */
+#define SYNC_LOSS_BAD 2
+/** number of consecutive correct sync bytes to acquire sync (1.1) */
+#define SYNC_ACQUIRE_GOOD 5
+/** max interval between PAT and PMT sections (1.3, 1.5) */
+#define PSI_TIMEOUT (UCLOCK_FREQ / 2)
+/** max interval between packets of a referenced PID (1.6) */
+#define PID_TIMEOUT (UCLOCK_FREQ * 5)
+/** period of the checks for missing PIDs */
+#define SWEEP_PERIOD (UCLOCK_FREQ / 10)
+/** max interval between PCRs (2.3a) */
+#define PCR_REPETITION (UCLOCK_FREQ / 25)
+/** max interval between PCRs without discontinuity indicator (2.3b) */
+#define PCR_DISCONTINUITY (UCLOCK_FREQ / 10)
+/** max PCR inaccuracy, 500 ns in 27 MHz units with 16 bits of fraction
+ * (2.4) */
+#define PCR_ACCURACY (UINT64_C(27) << 15)
+/** max interval between PTSs (2.5) */
+#define PTS_REPETITION (UCLOCK_FREQ * 7 / 10)
+
+/** @This is the type of data carried by a PID. */
+enum upipe_ts_tr101290_pid_type {
+    /** elementary stream or unknown */
+    UPIPE_TS_TR101290_PID_ES,
+    /** PAT */
+    UPIPE_TS_TR101290_PID_PAT,
+    /** PMT */
+    UPIPE_TS_TR101290_PID_PMT
+};
+
+/** @internal @This is the analysis state of a PID. */
+struct upipe_ts_tr101290_pid {
+    /** counters of the PID */
+    struct upipe_ts_tr101290_counters counters;
+    /** type of the PID */
+    enum upipe_ts_tr101290_pid_type type;
+    /** version of the last PMT, or -1 */
+    int pmt_version;
+    /** PID of the PMT referencing this PID, or MAX_PIDS */
+    uint16_t pmt_pid;
+    /** buffer reassembling a PSI section, allocated when first needed */
+    uint8_t *section;
+    /** number of bytes of the section received so far, or 0 */
+    uint16_t section_size;
+
+    /** date of the last section (PSI) or packet (ES), or UINT64_MAX */
+    uint64_t last_seen;
+    /** true if the current absence was already reported */
+    bool missing;
+
+    /** last continuity counter, or -1 */
+    int last_cc;
+    /** true if the last packet was a duplicate */
+    bool duplicate;
+
+    /** last PCR value, or UINT64_MAX */
+    uint64_t last_pcr;
+    /** packet index of the last PCR */
+    uint64_t last_pcr_packet;
+    /** PCR increment per packet with 16 bits of fraction, or 0 */
+    uint64_t pcr_rate;
+
+    /** last PTS value in 27 MHz units, or UINT64_MAX */
+    uint64_t last_pts;
+};
+
+/** @internal @This is the private context of a ts_tr101290 pipe. */
+struct upipe_ts_tr101290 {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** counters of the TS */
+    struct upipe_ts_tr101290_counters counters;
+    /** index of the next packet, not affected by resets */
+    uint64_t packet;
+    /** true if the TS is synchronized */
+    bool synced;
+    /** number of consecutive corrupted or correct sync bytes */
+    unsigned int sync_count;
+    /** version of the last PAT, or -1 */
+    int pat_version;
+    /** date of the last check for missing PIDs, or UINT64_MAX */
+    uint64_t last_sweep;
+    /** analysis state of PIDs, allocated when first seen */
+    struct upipe_ts_tr101290_pid *pids[MAX_PIDS];
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_tr101290, upipe, UPIPE_TS_TR101290_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_tr101290, urefcount, upipe_ts_tr101290_free)
+UPIPE_HELPER_VOID(upipe_ts_tr101290)
+UPIPE_HELPER_OUTPUT(upipe_ts_tr101290, output, flow_def, output_state,
+                    request_list)
+
+/** @internal @This returns the analysis state of a PID, allocating it if
+ * needed.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID
+ * @return pointer to the analysis state, or NULL in case of allocation error
+ */
+static struct upipe_ts_tr101290_pid *
+    upipe_ts_tr101290_pid_get(struct upipe *upipe, uint16_t pid)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    struct upipe_ts_tr101290_pid *pid_s = tr->pids[pid];
+    if (likely(pid_s != NULL))
+        return pid_s;
+
+    pid_s = malloc(sizeof(struct upipe_ts_tr101290_pid));
+    if (unlikely(pid_s == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return NULL;
+    }
+    memset(&pid_s->counters, 0, sizeof(pid_s->counters));
+    pid_s->type = UPIPE_TS_TR101290_PID_ES;
+    pid_s->pmt_version = -1;
+    pid_s->pmt_pid = MAX_PIDS;
+    pid_s->section = NULL;
+    pid_s->section_size = 0;
+    pid_s->last_seen = UINT64_MAX;
+    pid_s->missing = false;
+    pid_s->last_cc = -1;
+    pid_s->duplicate = false;
+    pid_s->last_pcr = UINT64_MAX;
+    pid_s->last_pcr_packet = 0;
+    pid_s->pcr_rate = 0;
+    pid_s->last_pts = UINT64_MAX;
+    tr->pids[pid] = pid_s;
+    return pid_s;
+}
+
+/** @internal @This allocates a ts_tr101290 pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_tr101290_alloc(struct upipe_mgr *mgr,
+                                             struct uprobe *uprobe,
+                                             uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_ts_tr101290_alloc_void(mgr, uprobe, signature,
+                                                       args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    upipe_ts_tr101290_init_urefcount(upipe);
+    upipe_ts_tr101290_init_output(upipe);
+    memset(&tr->counters, 0, sizeof(tr->counters));
+    tr->packet = 0;
+    tr->synced = true;
+    tr->sync_count = 0;
+    tr->pat_version = -1;
+    tr->last_sweep = UINT64_MAX;
+    for (int i = 0; i < MAX_PIDS; i++)
+        tr->pids[i] = NULL;
+    upipe_throw_ready(upipe);
+
+    struct upipe_ts_tr101290_pid *pid_s =
+        upipe_ts_tr101290_pid_get(upipe, PAT_PID);
+    if (likely(pid_s != NULL))
+        pid_s->type = UPIPE_TS_TR101290_PID_PAT;
+    return upipe;
+}
+
+/** @internal @This records an error.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid_s analysis state of the PID, or NULL
+ * @param pid PID, or MAX_PIDS
+ * @param indicator TR 101 290 indicator
+ */
+static void upipe_ts_tr101290_error(struct upipe *upipe,
+                                    struct upipe_ts_tr101290_pid *pid_s,
+                                    uint16_t pid,
+                                    enum upipe_ts_tr101290_indicator indicator)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    tr->counters.errors[indicator]++;
+    if (pid_s != NULL)
+        pid_s->counters.errors[indicator]++;
+    upipe_throw(upipe, UPROBE_TS_TR101290_ERROR, UPIPE_TS_TR101290_SIGNATURE,
+                (unsigned int)indicator, (unsigned int)pid);
+}
+
+/** @internal @This reports PAT, PMT and referenced PIDs which have been
+ * missing for too long. The check is only run periodically.
+ *
+ * @param upipe description structure of the pipe
+ * @param now date of the current packet
+ */
+static void upipe_ts_tr101290_sweep(struct upipe *upipe, uint64_t now)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    if (likely(tr->last_sweep != UINT64_MAX && now >= tr->last_sweep &&
+               now - tr->last_sweep < SWEEP_PERIOD))
+        return;
+    tr->last_sweep = now;
+
+    for (uint16_t pid = 0; pid < MAX_PIDS; pid++) {
+        struct upipe_ts_tr101290_pid *pid_s = tr->pids[pid];
+        if (pid_s == NULL)
+            continue;
+
+        uint64_t timeout;
+        enum upipe_ts_tr101290_indicator indicator;
+        if (pid_s->type == UPIPE_TS_TR101290_PID_PAT) {
+            timeout = PSI_TIMEOUT;
+            indicator = UPIPE_TS_TR101290_PAT;
+        } else if (pid_s->type == UPIPE_TS_TR101290_PID_PMT) {
+            timeout = PSI_TIMEOUT;
+            indicator = UPIPE_TS_TR101290_PMT;
+        } else if (pid_s->pmt_pid != MAX_PIDS) {
+            timeout = PID_TIMEOUT;
+            indicator = UPIPE_TS_TR101290_PID;
+        } else
+            continue;
+
+        if (pid_s->last_seen == UINT64_MAX || now < pid_s->last_seen) {
+            /* start counting from now */
+            pid_s->last_seen = now;
+            continue;
+        }
+        if (!pid_s->missing && now - pid_s->last_seen > timeout) {
+            pid_s->missing = true;
+            upipe_ts_tr101290_error(upipe, pid_s, pid, indicator);
+        }
+    }
+}
+
+/** @internal @This marks a PID as present.
+ *
+ * @param pid_s analysis state of the PID
+ * @param now date of the current packet, or UINT64_MAX
+ */
+static inline void upipe_ts_tr101290_seen(struct upipe_ts_tr101290_pid *pid_s,
+                                          uint64_t now)
+{
+    if (now != UINT64_MAX)
+        pid_s->last_seen = now;
+    pid_s->missing = false;
+}
+
+/** @internal @This parses a complete PAT section.
+ *
+ * @param upipe description structure of the pipe
+ * @param section pointer to the section
+ */
+static void upipe_ts_tr101290_handle_pat(struct upipe *upipe,
+                                         const uint8_t *section)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    if (!pat_validate(section) || !psi_get_current(section))
+        return;
+
+    int version = psi_get_version(section);
+    if (version != tr->pat_version) {
+        tr->pat_version = version;
+        for (uint16_t pid = 0; pid < MAX_PIDS; pid++)
+            if (tr->pids[pid] != NULL &&
+                tr->pids[pid]->type == UPIPE_TS_TR101290_PID_PMT) {
+                tr->pids[pid]->type = UPIPE_TS_TR101290_PID_ES;
+                tr->pids[pid]->pmt_version = -1;
+                tr->pids[pid]->section_size = 0;
+            }
+    }
+
+    const uint8_t *program;
+    int j = 0;
+    while ((program = pat_get_program((uint8_t *)section, j++)) != NULL) {
+        if (!patn_get_program(program))
+            /* NIT */
+            continue;
+        struct upipe_ts_tr101290_pid *pid_s =
+            upipe_ts_tr101290_pid_get(upipe, patn_get_pid(program));
+        if (unlikely(pid_s == NULL))
+            return;
+        if (pid_s->type != UPIPE_TS_TR101290_PID_PMT) {
+            pid_s->type = UPIPE_TS_TR101290_PID_PMT;
+            pid_s->last_seen = tr->last_sweep;
+            pid_s->missing = false;
+        }
+    }
+}
+
+/** @internal @This marks a PID as referenced by a PMT.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid referenced PID
+ * @param pmt_pid PID of the PMT
+ */
+static void upipe_ts_tr101290_reference(struct upipe *upipe, uint16_t pid,
+                                        uint16_t pmt_pid)
+{
+    if (pid == PADDING_PID)
+        return;
+    struct upipe_ts_tr101290_pid *pid_s = upipe_ts_tr101290_pid_get(upipe,
+                                                                    pid);
+    if (likely(pid_s != NULL))
+        pid_s->pmt_pid = pmt_pid;
+}
+
+/** @internal @This parses a complete PMT section.
+ *
+ * @param upipe description structure of the pipe
+ * @param pmt_pid PID of the PMT
+ * @param pmt_s analysis state of the PMT PID
+ * @param section pointer to the section
+ */
+static void upipe_ts_tr101290_handle_pmt(struct upipe *upipe, uint16_t pmt_pid,
+                                         struct upipe_ts_tr101290_pid *pmt_s,
+                                         const uint8_t *section)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    if (!pmt_validate(section) || !psi_get_current(section))
+        return;
+
+    int version = psi_get_version(section);
+    if (likely(version == pmt_s->pmt_version))
+        return;
+    pmt_s->pmt_version = version;
+
+    for (uint16_t pid = 0; pid < MAX_PIDS; pid++)
+        if (tr->pids[pid] != NULL && tr->pids[pid]->pmt_pid == pmt_pid)
+            tr->pids[pid]->pmt_pid = MAX_PIDS;
+
+    upipe_ts_tr101290_reference(upipe, pmt_get_pcrpid(section), pmt_pid);
+    const uint8_t *es;
+    int j = 0;
+    while ((es = pmt_get_es((uint8_t *)section, j++)) != NULL)
+        upipe_ts_tr101290_reference(upipe, pmtn_get_pid(es), pmt_pid);
+}
+
+/** @internal @This appends a part of the payload of a PAT or PMT PID to
+ * the section being reassembled, and checks the section once complete.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID of the packet
+ * @param pid_s analysis state of the PID
+ * @param payload pointer to the part of the payload
+ * @param size size of the part of the payload, strictly positive
+ * @param now date of the packet, or UINT64_MAX
+ * @return number of bytes consumed, the rest of the payload being ignored
+ * if it is size
+ */
+static size_t upipe_ts_tr101290_merge_psi(struct upipe *upipe, uint16_t pid,
+                                          struct upipe_ts_tr101290_pid *pid_s,
+                                          const uint8_t *payload, size_t size,
+                                          uint64_t now)
+{
+    bool pat = pid_s->type == UPIPE_TS_TR101290_PID_PAT;
+    uint8_t *section = pid_s->section;
+    if (!pid_s->section_size && payload[0] == 0xff)
+        /* stuffing until the end of the packet */
+        return size;
+
+    size_t consumed = 0;
+    if (pid_s->section_size < PSI_HEADER_SIZE) {
+        consumed = PSI_HEADER_SIZE - pid_s->section_size;
+        if (consumed > size)
+            consumed = size;
+        memcpy(section + pid_s->section_size, payload, consumed);
+        pid_s->section_size += consumed;
+        if (pid_s->section_size < PSI_HEADER_SIZE)
+            return consumed;
+
+        if (psi_get_tableid(section) != (pat ? PAT_TABLE_ID : PMT_TABLE_ID)) {
+            pid_s->section_size = 0;
+            upipe_ts_tr101290_error(upipe, pid_s, pid,
+                    pat ? UPIPE_TS_TR101290_PAT : UPIPE_TS_TR101290_PMT);
+            return size;
+        }
+        upipe_ts_tr101290_seen(pid_s, now);
+
+        uint16_t length = psi_get_length(section);
+        if (length < PSI_HEADER_SIZE_SYNTAX1 - PSI_HEADER_SIZE + PSI_CRC_SIZE ||
+            length > PSI_MAX_SIZE) {
+            pid_s->section_size = 0;
+            upipe_ts_tr101290_error(upipe, pid_s, pid, UPIPE_TS_TR101290_CRC);
+            return size;
+        }
+    }
+
+    size_t total = PSI_HEADER_SIZE + psi_get_length(section);
+    size_t copy = total - pid_s->section_size;
+    if (copy > size - consumed)
+        copy = size - consumed;
+    memcpy(section + pid_s->section_size, payload + consumed, copy);
+    pid_s->section_size += copy;
+    consumed += copy;
+    if (pid_s->section_size < total)
+        return consumed;
+
+    pid_s->section_size = 0;
+    if (!psi_validate(section) || !upipe_ts_psi_check_crc(section)) {
+        upipe_ts_tr101290_error(upipe, pid_s, pid, UPIPE_TS_TR101290_CRC);
+        return consumed;
+    }
+
+    if (pat)
+        upipe_ts_tr101290_handle_pat(upipe, section);
+    else
+        upipe_ts_tr101290_handle_pmt(upipe, pid, pid_s, section);
+    return consumed;
+}
+
+/** @internal @This checks a packet of a PAT or PMT PID, reassembling the
+ * sections spanning several packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID of the packet
+ * @param pid_s analysis state of the PID
+ * @param ts pointer to the TS packet
+ * @param now date of the packet, or UINT64_MAX
+ */
+static void upipe_ts_tr101290_handle_psi(struct upipe *upipe, uint16_t pid,
+                                         struct upipe_ts_tr101290_pid *pid_s,
+                                         uint8_t *ts, uint64_t now)
+{
+    if (ts_get_scrambling(ts)) {
+        pid_s->section_size = 0;
+        upipe_ts_tr101290_error(upipe, pid_s, pid,
+                pid_s->type == UPIPE_TS_TR101290_PID_PAT ?
+                UPIPE_TS_TR101290_PAT : UPIPE_TS_TR101290_PMT);
+        return;
+    }
+    if (!ts_has_payload(ts) || pid_s->duplicate)
+        return;
+
+    if (unlikely(pid_s->section == NULL)) {
+        pid_s->section = malloc(PSI_MAX_SIZE + PSI_HEADER_SIZE);
+        if (unlikely(pid_s->section == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+    }
+
+    const uint8_t *payload = ts_payload(ts);
+    const uint8_t *end = ts + TS_SIZE;
+    if (unlikely(payload >= end))
+        return;
+
+    if (ts_get_unitstart(ts)) {
+        uint8_t pointer_field = *payload++;
+        if (unlikely(pointer_field > end - payload)) {
+            pid_s->section_size = 0;
+            return;
+        }
+        /* the bytes before the pointer end the previous section */
+        if (pid_s->section_size && pointer_field)
+            upipe_ts_tr101290_merge_psi(upipe, pid, pid_s, payload,
+                                        pointer_field, now);
+        pid_s->section_size = 0;
+        payload += pointer_field;
+    } else if (!pid_s->section_size)
+        /* not synchronized on the start of a section */
+        return;
+
+    while (payload < end)
+        payload += upipe_ts_tr101290_merge_psi(upipe, pid, pid_s, payload,
+                                               end - payload, now);
+}
+
+/** @internal @This checks the continuity counter of a packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID of the packet
+ * @param pid_s analysis state of the PID
+ * @param ts pointer to the TS packet
+ * @param discontinuity true if the discontinuity indicator is set
+ */
+static void upipe_ts_tr101290_handle_cc(struct upipe *upipe, uint16_t pid,
+                                        struct upipe_ts_tr101290_pid *pid_s,
+                                        const uint8_t *ts, bool discontinuity)
+{
+    int cc = ts_get_cc(ts);
+    int last_cc = pid_s->last_cc;
+    pid_s->last_cc = cc;
+    if (last_cc == -1 || discontinuity) {
+        pid_s->duplicate = false;
+        pid_s->section_size = 0;
+        return;
+    }
+
+    if (!ts_has_payload(ts)) {
+        /* the counter is not incremented without payload */
+        if (cc != last_cc)
+            upipe_ts_tr101290_error(upipe, pid_s, pid, UPIPE_TS_TR101290_CC);
+        return;
+    }
+
+    if (cc == last_cc) {
+        /* a packet may be sent twice, but not more */
+        if (pid_s->duplicate)
+            upipe_ts_tr101290_error(upipe, pid_s, pid, UPIPE_TS_TR101290_CC);
+        pid_s->duplicate = true;
+        return;
+    }
+    pid_s->duplicate = false;
+    if (cc != ((last_cc + 1) & 0xf)) {
+        /* the section being reassembled lacks a packet */
+        pid_s->section_size = 0;
+        upipe_ts_tr101290_error(upipe, pid_s, pid, UPIPE_TS_TR101290_CC);
+    }
+}
+
+/** @internal @This checks the PCR of a packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID of the packet
+ * @param pid_s analysis state of the PID
+ * @param ts pointer to the TS packet
+ * @param discontinuity true if the discontinuity indicator is set
+ */
+static void upipe_ts_tr101290_handle_pcr(struct upipe *upipe, uint16_t pid,
+                                         struct upipe_ts_tr101290_pid *pid_s,
+                                         const uint8_t *ts, bool discontinuity)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    uint64_t pcr = tsaf_get_pcr(ts) * 300 + tsaf_get_pcrext(ts);
+    uint64_t last_pcr = pid_s->last_pcr;
+    uint64_t packets = tr->packet - pid_s->last_pcr_packet;
+    pid_s->last_pcr = pcr;
+    pid_s->last_pcr_packet = tr->packet;
+    if (last_pcr == UINT64_MAX || discontinuity) {
+        pid_s->pcr_rate = 0;
+        return;
+    }
+
+    /* PCRs going backwards yield a very large delta */
+    uint64_t delta = (pcr + WRAP_27M - last_pcr) % WRAP_27M;
+    if (delta > PCR_DISCONTINUITY) {
+        upipe_ts_tr101290_error(upipe, pid_s, pid,
+                                UPIPE_TS_TR101290_PCR_DISCONTINUITY);
+        pid_s->pcr_rate = 0;
+        return;
+    }
+    if (delta > PCR_REPETITION)
+        upipe_ts_tr101290_error(upipe, pid_s, pid,
+                                UPIPE_TS_TR101290_PCR_REPETITION);
+
+    /* compare with the value interpolated from the previous PCR interval,
+     * assuming a constant bitrate; after an error the bitrate is learnt
+     * again, so that a single jump is only reported once */
+    if (pid_s->pcr_rate) {
+        uint64_t expected = pid_s->pcr_rate * packets;
+        uint64_t actual = delta << 16;
+        if ((actual > expected ? actual - expected : expected - actual) >
+                PCR_ACCURACY) {
+            upipe_ts_tr101290_error(upipe, pid_s, pid,
+                                    UPIPE_TS_TR101290_PCR_ACCURACY);
+            pid_s->pcr_rate = 0;
+            return;
+        }
+    }
+    pid_s->pcr_rate = (delta << 16) / packets;
+}
+
+/** @internal @This checks the PTS of a packet starting a PES.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID of the packet
+ * @param pid_s analysis state of the PID
+ * @param ts pointer to the TS packet
+ * @param discontinuity true if the discontinuity indicator is set
+ */
+static void upipe_ts_tr101290_handle_pts(struct upipe *upipe, uint16_t pid,
+                                         struct upipe_ts_tr101290_pid *pid_s,
+                                         uint8_t *ts, bool discontinuity)
+{
+    if (!ts_get_unitstart(ts) || !ts_has_payload(ts) ||
+        ts_get_scrambling(ts))
+        return;
+
+    size_t offset = ts_payload(ts) - ts;
+    if (unlikely(offset + PES_HEADER_SIZE_PTS > TS_SIZE))
+        return;
+    const uint8_t *pes = ts + offset;
+    if (!pes_validate(pes))
+        return;
+    uint8_t streamid = pes_get_streamid(pes);
+    if (streamid == PES_STREAM_ID_PADDING ||
+        streamid == PES_STREAM_ID_PRIVATE_2 ||
+        !pes_validate_header(pes) || !pes_has_pts(pes))
+        return;
+
+    uint64_t pts = pes_get_pts(pes) * 300;
+    uint64_t last_pts = pid_s->last_pts;
+    pid_s->last_pts = pts;
+    if (last_pts == UINT64_MAX || discontinuity)
+        return;
+
+    /* PTSs going backwards (reordered pictures) are ignored */
+    uint64_t delta = (pts + WRAP_27M - last_pts) % WRAP_27M;
+    if (delta > PTS_REPETITION && delta < WRAP_27M / 2)
+        upipe_ts_tr101290_error(upipe, pid_s, pid, UPIPE_TS_TR101290_PTS);
+}
+
+/** @internal @This analyzes a TS packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param ts pointer to the TS packet
+ * @param now date of the packet, or UINT64_MAX
+ */
+static void upipe_ts_tr101290_analyze(struct upipe *upipe, uint8_t *ts,
+                                      uint64_t now)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    tr->counters.packets++;
+    tr->packet++;
+    if (now != UINT64_MAX)
+        upipe_ts_tr101290_sweep(upipe, now);
+
+    if (unlikely(!ts_validate(ts))) {
+        if (tr->synced)
+            tr->sync_count++;
+        else
+            tr->sync_count = 0;
+        upipe_ts_tr101290_error(upipe, NULL, MAX_PIDS,
+                                UPIPE_TS_TR101290_SYNC_BYTE);
+        if (tr->synced && tr->sync_count >= SYNC_LOSS_BAD) {
+            tr->synced = false;
+            tr->sync_count = 0;
+            upipe_ts_tr101290_error(upipe, NULL, MAX_PIDS,
+                                    UPIPE_TS_TR101290_SYNC_LOSS);
+        }
+        return;
+    }
+    if (tr->synced)
+        tr->sync_count = 0;
+    else if (++tr->sync_count >= SYNC_ACQUIRE_GOOD) {
+        tr->synced = true;
+        tr->sync_count = 0;
+    }
+
+    uint16_t pid = ts_get_pid(ts);
+    struct upipe_ts_tr101290_pid *pid_s = upipe_ts_tr101290_pid_get(upipe,
+                                                                    pid);
+    if (unlikely(pid_s == NULL))
+        return;
+    pid_s->counters.packets++;
+
+    if (unlikely(ts_get_transporterror(ts))) {
+        /* the rest of the packet cannot be trusted */
+        upipe_ts_tr101290_error(upipe, pid_s, pid,
+                                UPIPE_TS_TR101290_TRANSPORT);
+        return;
+    }
+    if (pid == PADDING_PID)
+        return;
+
+    bool discontinuity = false;
+    if (ts_has_adaptation(ts) && ts_get_adaptation(ts)) {
+        discontinuity = tsaf_has_discontinuity(ts);
+        if (ts_get_adaptation(ts) + 1 + TS_HEADER_SIZE >= TS_HEADER_SIZE_PCR &&
+            tsaf_has_pcr(ts))
+            upipe_ts_tr101290_handle_pcr(upipe, pid, pid_s, ts,
+                                         discontinuity);
+    }
+    upipe_ts_tr101290_handle_cc(upipe, pid, pid_s, ts, discontinuity);
+
+    if (pid_s->type != UPIPE_TS_TR101290_PID_ES)
+        upipe_ts_tr101290_handle_psi(upipe, pid, pid_s, ts, now);
+    else {
+        upipe_ts_tr101290_seen(pid_s, now);
+        upipe_ts_tr101290_handle_pts(upipe, pid, pid_s, ts, discontinuity);
+    }
+}
+
+/** @internal @This receives TS packets, analyzes and forwards them.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_tr101290_input(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    uint8_t buffer[TS_SIZE];
+    const uint8_t *ts = uref_block_peek(uref, 0, TS_SIZE, buffer);
+    if (unlikely(ts == NULL)) {
+        upipe_warn(upipe, "invalid TS packet");
+        upipe_ts_tr101290_output(upipe, uref, upump_p);
+        return;
+    }
+
+    uint64_t now = UINT64_MAX;
+    uref_clock_get_cr_sys(uref, &now);
+    upipe_ts_tr101290_analyze(upipe, (uint8_t *)ts, now);
+
+    if (unlikely(!ubase_check(uref_block_peek_unmap(uref, 0, buffer, ts)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_INVALID);
+        return;
+    }
+    upipe_ts_tr101290_output(upipe, uref, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_tr101290_set_flow_def(struct upipe *upipe,
+                                          struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if (unlikely((flow_def_dup = uref_dup(flow_def)) == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_ts_tr101290_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the counters of a PID.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid PID to query
+ * @param counters_p filled in with the counters
+ * @return an error code
+ */
+static int _upipe_ts_tr101290_get_pid_counters(struct upipe *upipe,
+        unsigned int pid, struct upipe_ts_tr101290_counters *counters_p)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    if (pid >= MAX_PIDS || tr->pids[pid] == NULL)
+        return UBASE_ERR_INVALID;
+    *counters_p = tr->pids[pid]->counters;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This resets all counters.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int _upipe_ts_tr101290_reset_counters(struct upipe *upipe)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    memset(&tr->counters, 0, sizeof(tr->counters));
+    for (int i = 0; i < MAX_PIDS; i++)
+        if (tr->pids[i] != NULL)
+            memset(&tr->pids[i]->counters, 0,
+                   sizeof(tr->pids[i]->counters));
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_tr101290 pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_tr101290_control(struct upipe *upipe,
+                                     int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_tr101290_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            return upipe_ts_tr101290_free_output_proxy(upipe, request);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_ts_tr101290_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_tr101290_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_ts_tr101290_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_ts_tr101290_set_output(upipe, output);
+        }
+
+        case UPIPE_TS_TR101290_GET_COUNTERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_TR101290_SIGNATURE)
+            struct upipe_ts_tr101290_counters *counters_p =
+                va_arg(args, struct upipe_ts_tr101290_counters *);
+            *counters_p = upipe_ts_tr101290_from_upipe(upipe)->counters;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_TR101290_GET_PID_COUNTERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_TR101290_SIGNATURE)
+            unsigned int pid = va_arg(args, unsigned int);
+            struct upipe_ts_tr101290_counters *counters_p =
+                va_arg(args, struct upipe_ts_tr101290_counters *);
+            return _upipe_ts_tr101290_get_pid_counters(upipe, pid, counters_p);
+        }
+        case UPIPE_TS_TR101290_RESET_COUNTERS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_TR101290_SIGNATURE)
+            return _upipe_ts_tr101290_reset_counters(upipe);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_tr101290_free(struct upipe *upipe)
+{
+    struct upipe_ts_tr101290 *tr = upipe_ts_tr101290_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    for (int i = 0; i < MAX_PIDS; i++)
+        if (tr->pids[i] != NULL) {
+            free(tr->pids[i]->section);
+            free(tr->pids[i]);
+        }
+    upipe_ts_tr101290_clean_output(upipe);
+    upipe_ts_tr101290_clean_urefcount(upipe);
+    upipe_ts_tr101290_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_tr101290_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_TR101290_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_tr101290_alloc,
+    .upipe_input = upipe_ts_tr101290_input,
+    .upipe_control = upipe_ts_tr101290_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_tr101290 pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_tr101290_mgr_alloc(void)
+{
+    return &upipe_ts_tr101290_mgr;
+}
@@ -76,6 +76,15 @@ struct upipe_ts_tstd {
     /** previous DTS */
     uint64_t last_dts;
 
+    /** ring buffer of samples of the trace */
+    struct upipe_ts_tstd_sample *trace;
+    /** size of the ring buffer, in samples */
+    unsigned int trace_size;
+    /** index of the oldest sample */
+    unsigned int trace_start;
+    /** number of samples in the ring buffer */
+    unsigned int trace_nb;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -85,6 +94,29 @@ UPIPE_HELPER_UREFCOUNT(upipe_ts_tstd, urefcount, upipe_ts_tstd_free)
 UPIPE_HELPER_VOID(upipe_ts_tstd)
 UPIPE_HELPER_OUTPUT(upipe_ts_tstd, output, flow_def, output_state, request_list)
 
+/** @internal @This records a sample into the ring buffer of the trace.
+ *
+ * @param upipe description structure of the pipe
+ * @param sample sample to record
+ */
+static void upipe_ts_tstd_record(struct upipe *upipe,
+                                 const struct upipe_ts_tstd_sample *sample)
+{
+    struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
+    if (!upipe_ts_tstd->trace_size)
+        return;
+
+    unsigned int index = upipe_ts_tstd->trace_start +
+                         upipe_ts_tstd->trace_nb;
+    if (index >= upipe_ts_tstd->trace_size)
+        index -= upipe_ts_tstd->trace_size;
+    upipe_ts_tstd->trace[index] = *sample;
+    if (upipe_ts_tstd->trace_nb < upipe_ts_tstd->trace_size)
+        upipe_ts_tstd->trace_nb++;
+    else if (++upipe_ts_tstd->trace_start >= upipe_ts_tstd->trace_size)
+        upipe_ts_tstd->trace_start = 0;
+}
+
 /** @internal @This handles urefs.
  *
  * @param upipe description structure of the pipe
@@ -95,7 +127,7 @@ static void upipe_ts_tstd_input(struct upipe *upipe, struct uref *uref,
                                 struct upump **upump_p)
 {
     struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
-    uint64_t dts;
+    uint64_t dts = UINT64_MAX;
     if (ubase_check(uref_clock_get_dts_prog(uref, &dts))) {
         if (upipe_ts_tstd->last_dts != UINT64_MAX) {
             uint64_t duration = dts - upipe_ts_tstd->last_dts;
@@ -110,18 +142,33 @@ static void upipe_ts_tstd_input(struct upipe *upipe, struct uref *uref,
     size_t uref_size = 0;
     uref_block_size(uref, &uref_size);
     upipe_ts_tstd->fullness -= uref_size;
+    int64_t excess = 0;
     if (upipe_ts_tstd->fullness < 0) {
-        upipe_warn_va(upipe, "T-STD underflow (%"PRId64" octets)",
-                      -upipe_ts_tstd->fullness);
+        excess = upipe_ts_tstd->fullness;
+        upipe_warn_va(upipe, "T-STD underflow (%"PRId64" octets)", -excess);
         upipe_ts_tstd->fullness = 0;
+        upipe_throw(upipe, UPROBE_TS_TSTD_UNDERFLOW, UPIPE_TS_TSTD_SIGNATURE,
+                    dts, (uint64_t)-excess);
     } else if (upipe_ts_tstd->fullness > upipe_ts_tstd->bs) {
-        upipe_verbose_va(upipe, "T-STD overflow (%"PRId64" octets)",
-                         upipe_ts_tstd->fullness - upipe_ts_tstd->bs);
+        excess = upipe_ts_tstd->fullness - upipe_ts_tstd->bs;
+        upipe_verbose_va(upipe, "T-STD overflow (%"PRId64" octets)", excess);
         upipe_ts_tstd->fullness = upipe_ts_tstd->bs;
+        upipe_throw(upipe, UPROBE_TS_TSTD_OVERFLOW, UPIPE_TS_TSTD_SIGNATURE,
+                    dts, (uint64_t)excess);
     }
 
     uint64_t delay = (upipe_ts_tstd->fullness * UCLOCK_FREQ) /
                      upipe_ts_tstd->octetrate;
+    struct upipe_ts_tstd_sample sample = {
+        .dts_prog = dts,
+        .delay = delay,
+        .fullness = upipe_ts_tstd->fullness > UINT32_MAX ? UINT32_MAX :
+                    upipe_ts_tstd->fullness,
+        .size = uref_size > UINT32_MAX ? UINT32_MAX : uref_size,
+        .excess = excess < INT32_MIN ? INT32_MIN :
+                  excess > INT32_MAX ? INT32_MAX : excess
+    };
+    upipe_ts_tstd_record(upipe, &sample);
     uref_clock_set_cr_dts_delay(uref, delay);
     uref_clock_rebase_cr_prog(uref);
     uref_clock_rebase_cr_orig(uref);
@@ -210,6 +257,82 @@ static int upipe_ts_tstd_set_max_delay(struct upipe *upipe, uint64_t delay)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This sets the number of samples kept in the trace.
+ *
+ * @param upipe description structure of the pipe
+ * @param trace_size number of samples, or 0 to disable the trace
+ * @return an error code
+ */
+static int _upipe_ts_tstd_set_trace_size(struct upipe *upipe,
+                                         unsigned int trace_size)
+{
+    struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
+    struct upipe_ts_tstd_sample *trace = NULL;
+    if (trace_size) {
+        trace = malloc(trace_size * sizeof(struct upipe_ts_tstd_sample));
+        UBASE_ALLOC_RETURN(trace);
+    }
+    free(upipe_ts_tstd->trace);
+    upipe_ts_tstd->trace = trace;
+    upipe_ts_tstd->trace_size = trace_size;
+    upipe_ts_tstd->trace_start = upipe_ts_tstd->trace_nb = 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This copies the samples of the trace, oldest first.
+ *
+ * @param upipe description structure of the pipe
+ * @param samples array filled in with the samples
+ * @param nb_p number of elements in the array, filled in with the number of
+ * copied samples
+ * @return an error code
+ */
+static int _upipe_ts_tstd_get_trace(struct upipe *upipe,
+                                    struct upipe_ts_tstd_sample *samples,
+                                    unsigned int *nb_p)
+{
+    struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
+    assert(nb_p != NULL);
+    unsigned int nb = upipe_ts_tstd->trace_nb;
+    unsigned int skip = 0;
+    if (nb > *nb_p) {
+        skip = nb - *nb_p;
+        nb = *nb_p;
+    }
+    for (unsigned int i = 0; i < nb; i++) {
+        unsigned int index = upipe_ts_tstd->trace_start + skip + i;
+        if (index >= upipe_ts_tstd->trace_size)
+            index -= upipe_ts_tstd->trace_size;
+        samples[i] = upipe_ts_tstd->trace[index];
+    }
+    *nb_p = nb;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This prints the samples of the trace at debug level.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int _upipe_ts_tstd_dump_trace(struct upipe *upipe)
+{
+    struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
+    upipe_dbg_va(upipe, "T-STD trace (%u samples, buffer %"PRIu64" octets)",
+                 upipe_ts_tstd->trace_nb, upipe_ts_tstd->bs);
+    for (unsigned int i = 0; i < upipe_ts_tstd->trace_nb; i++) {
+        unsigned int index = upipe_ts_tstd->trace_start + i;
+        if (index >= upipe_ts_tstd->trace_size)
+            index -= upipe_ts_tstd->trace_size;
+        const struct upipe_ts_tstd_sample *sample =
+            &upipe_ts_tstd->trace[index];
+        upipe_dbg_va(upipe, " dts %"PRIu64" size %"PRIu32" fullness %"PRIu32
+                     " delay %"PRIu64" excess %"PRId32,
+                     sample->dts_prog, sample->size, sample->fullness,
+                     sample->delay, sample->excess);
+    }
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on a pipe, and
  * checks the status of the pipe afterwards.
  *
@@ -256,6 +379,22 @@ static int upipe_ts_tstd_control(struct upipe *upipe, int command, va_list args)
             uint64_t delay = va_arg(args, uint64_t);
             return upipe_ts_tstd_set_max_delay(upipe, delay);
         }
+
+        case UPIPE_TS_TSTD_SET_TRACE_SIZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_TSTD_SIGNATURE)
+            unsigned int trace_size = va_arg(args, unsigned int);
+            return _upipe_ts_tstd_set_trace_size(upipe, trace_size);
+        }
+        case UPIPE_TS_TSTD_GET_TRACE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_TSTD_SIGNATURE)
+            struct upipe_ts_tstd_sample *samples =
+                va_arg(args, struct upipe_ts_tstd_sample *);
+            unsigned int *nb_p = va_arg(args, unsigned int *);
+            return _upipe_ts_tstd_get_trace(upipe, samples, nb_p);
+        }
+        case UPIPE_TS_TSTD_DUMP_TRACE:
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_TSTD_SIGNATURE)
+            return _upipe_ts_tstd_dump_trace(upipe);
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -284,6 +423,9 @@ static struct upipe *upipe_ts_tstd_alloc(struct upipe_mgr *mgr,
     upipe_ts_tstd->max_delay = UINT64_MAX;
     upipe_ts_tstd->bs = upipe_ts_tstd->fullness = 0;
     upipe_ts_tstd->last_dts = UINT64_MAX;
+    upipe_ts_tstd->trace = NULL;
+    upipe_ts_tstd->trace_size = 0;
+    upipe_ts_tstd->trace_start = upipe_ts_tstd->trace_nb = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -294,7 +436,9 @@ static struct upipe *upipe_ts_tstd_alloc(struct upipe_mgr *mgr,
  */
 static void upipe_ts_tstd_free(struct upipe *upipe)
 {
+    struct upipe_ts_tstd *upipe_ts_tstd = upipe_ts_tstd_from_upipe(upipe);
     upipe_throw_dead(upipe);
+    free(upipe_ts_tstd->trace);
     upipe_ts_tstd_clean_output(upipe);
     upipe_ts_tstd_clean_urefcount(upipe);
     upipe_ts_tstd_free_void(upipe);
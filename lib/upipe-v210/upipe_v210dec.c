@@ -0,0 +1,661 @@
+/*
+ * V210 decoder
+ *
+ * Copyright (c) 2015 Open Broadcast Systems Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** @file
+ * @short Upipe v210dec module
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ucpu.h>
+#include <upipe/uprobe.h>
+#include <upipe/uband_pool.h>
+#include <upipe/uref.h>
+#include <upipe/ubuf.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/upipe.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_dump.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_input.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <upipe-v210/upipe_v210dec.h>
+
+#include <libavutil/intreadwrite.h>
+
+#define UPIPE_V210_MAX_PLANES 3
+/** maximum number of slice threads */
+#define UPIPE_V210DEC_MAX_THREADS 16
+
+/** upipe_v210dec structure with v210dec parameters */
+struct upipe_v210dec {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** temporary uref storage (used during urequest) */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers (used during udeal) */
+    struct uchain blockers;
+
+    /** requested output bit depth */
+    int bit_depth;
+    /** output bit depth of the current flow */
+    int output_bit_depth;
+    /** number of slice threads */
+    unsigned int threads;
+    /** pool of slice threads, or NULL for a single thread */
+    struct uband_pool *band_pool;
+
+    /** 8-bit line unpacking function **/
+    upipe_v210dec_unpack_line_8 unpack_line_8;
+    /** 10-bit line unpacking function **/
+    upipe_v210dec_unpack_line_10 unpack_line_10;
+
+    /** input chroma map */
+    const char *input_chroma_map;
+    /** output chroma map */
+    const char *output_chroma_map[UPIPE_V210_MAX_PLANES+1];
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @internal @This describes a picture to unpack in slices. */
+struct upipe_v210dec_picture {
+    /** pointer to the private context */
+    struct upipe_v210dec *upipe_v210dec;
+    /** v210 input */
+    const uint8_t *src;
+    /** input stride */
+    size_t src_stride;
+    /** output planes */
+    uint8_t **dst;
+    /** output strides */
+    size_t *dst_strides;
+    /** width of the picture in pixels */
+    size_t hsize;
+    /** height of the picture in lines */
+    size_t vsize;
+};
+
+/** @hidden */
+static bool upipe_v210dec_handle(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p);
+/** @hidden */
+static int upipe_v210dec_check(struct upipe *upipe, struct uref *flow_format);
+
+UPIPE_HELPER_UPIPE(upipe_v210dec, upipe, UPIPE_V210DEC_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_v210dec, urefcount, upipe_v210dec_free);
+UPIPE_HELPER_VOID(upipe_v210dec);
+UPIPE_HELPER_OUTPUT(upipe_v210dec, output, flow_def, output_state, request_list)
+UPIPE_HELPER_UBUF_MGR(upipe_v210dec, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      upipe_v210dec_check,
+                      upipe_v210dec_register_output_request,
+                      upipe_v210dec_unregister_output_request)
+UPIPE_HELPER_INPUT(upipe_v210dec, urefs, nb_urefs, max_urefs, blockers, upipe_v210dec_handle)
+
+#define READ_PIXELS(a, b, c, shift)                 \
+    do {                                            \
+        val = AV_RL32(src);                         \
+        src += 4;                                   \
+        *a++ = (val & 0x3ff) >> shift;              \
+        *b++ = ((val >> 10) & 0x3ff) >> shift;      \
+        *c++ = ((val >> 20) & 0x3ff) >> shift;      \
+    } while (0)
+
+/** @internal @This unpacks the last 2 or 4 pixels of a line, when the width
+ * is not a multiple of 6.
+ */
+#define UNPACK_TAIL(shift)                          \
+    do {                                            \
+        uint32_t val = 0;                           \
+        if (w + 1 < hsize) {                        \
+            READ_PIXELS(u, y, v, shift);            \
+            val = AV_RL32(src);                     \
+            *y++ = (val & 0x3ff) >> shift;          \
+        }                                           \
+        if (w + 3 < hsize) {                        \
+            *u++ = ((val >> 10) & 0x3ff) >> shift;  \
+            *y++ = ((val >> 20) & 0x3ff) >> shift;  \
+            val = AV_RL32(src + 4);                 \
+            *v++ = (val & 0x3ff) >> shift;          \
+            *y++ = ((val >> 10) & 0x3ff) >> shift;  \
+        }                                           \
+    } while (0)
+
+/** @internal @This unpacks a slice of a picture.
+ *
+ * @param opaque pointer to a struct upipe_v210dec_picture
+ * @param slice index of the slice
+ * @param nb_slices number of slices
+ */
+static void upipe_v210dec_unpack_slice(void *opaque, unsigned int slice,
+                                       unsigned int nb_slices)
+{
+    struct upipe_v210dec_picture *picture = opaque;
+    struct upipe_v210dec *upipe_v210dec = picture->upipe_v210dec;
+    size_t hsize = picture->hsize;
+    size_t w = (hsize / 6) * 6;
+    size_t first = picture->vsize * slice / nb_slices;
+    size_t last = picture->vsize * (slice + 1) / nb_slices;
+    uint8_t **dst = picture->dst;
+    size_t *dst_strides = picture->dst_strides;
+
+    for (size_t h = first; h < last; h++) {
+        const uint8_t *src = picture->src + h * picture->src_stride;
+        if (upipe_v210dec->output_bit_depth == 10) {
+            uint16_t *y = (uint16_t *)(dst[0] + h * dst_strides[0]);
+            uint16_t *u = (uint16_t *)(dst[1] + h * dst_strides[1]);
+            uint16_t *v = (uint16_t *)(dst[2] + h * dst_strides[2]);
+            upipe_v210dec->unpack_line_10(src, y, u, v, w);
+            src += (w / 6) * 16;
+            y += w;
+            u += w / 2;
+            v += w / 2;
+            UNPACK_TAIL(0);
+        } else {
+            uint8_t *y = dst[0] + h * dst_strides[0];
+            uint8_t *u = dst[1] + h * dst_strides[1];
+            uint8_t *v = dst[2] + h * dst_strides[2];
+            upipe_v210dec->unpack_line_8(src, y, u, v, w);
+            src += (w / 6) * 16;
+            y += w;
+            u += w / 2;
+            v += w / 2;
+            UNPACK_TAIL(2);
+        }
+    }
+}
+
+/** @internal @This unpacks a picture, possibly splitting it into slices
+ * handled by the band pool.
+ *
+ * @param upipe description structure of the pipe
+ * @param src v210 plane
+ * @param src_stride v210 stride
+ * @param dst output planes
+ * @param dst_strides output strides
+ * @param hsize width of the picture
+ * @param vsize height of the picture
+ */
+static void upipe_v210dec_unpack(struct upipe *upipe, const uint8_t *src,
+                                 size_t src_stride, uint8_t **dst,
+                                 size_t *dst_strides,
+                                 size_t hsize, size_t vsize)
+{
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    struct upipe_v210dec_picture picture = {
+        .upipe_v210dec = upipe_v210dec,
+        .src = src,
+        .src_stride = src_stride,
+        .dst = dst,
+        .dst_strides = dst_strides,
+        .hsize = hsize,
+        .vsize = vsize
+    };
+
+    if (upipe_v210dec->band_pool == NULL) {
+        upipe_v210dec_unpack_slice(&picture, 0, 1);
+        return;
+    }
+
+    unsigned int nb_slices = upipe_v210dec->threads;
+    if (nb_slices > vsize)
+        nb_slices = vsize ? vsize : 1;
+    uband_pool_run(upipe_v210dec->band_pool, nb_slices,
+                   upipe_v210dec_unpack_slice, &picture);
+}
+
+/** @internal @This handles data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure describing the picture
+ * @param upump_p reference to pump that generated the buffer
+ * @return false if the input must be blocked
+ */
+static bool upipe_v210dec_handle(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_v210dec_store_flow_def(upipe, NULL);
+        upipe_v210dec_require_ubuf_mgr(upipe, uref);
+        return true;
+    }
+
+    if (upipe_v210dec->flow_def == NULL)
+        return false;
+
+    size_t hsize, vsize;
+    if (!ubase_check(uref_pic_size(uref, &hsize, &vsize, NULL))) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return true;
+    }
+    /* v210 pictures are padded to 48 pixels, restore the real width */
+    uint64_t flow_hsize;
+    if (ubase_check(uref_pic_flow_get_hsize(upipe_v210dec->flow_def,
+                                            &flow_hsize)) &&
+        flow_hsize < hsize)
+        hsize = flow_hsize & ~(uint64_t)1;
+
+    /* map input */
+    const uint8_t *input_plane;
+    size_t input_stride;
+    if (unlikely(!ubase_check(uref_pic_plane_read(uref,
+                                      upipe_v210dec->input_chroma_map,
+                                      0, 0, -1, -1, &input_plane)) ||
+                 !ubase_check(uref_pic_plane_size(uref,
+                                      upipe_v210dec->input_chroma_map,
+                                      &input_stride, NULL, NULL, NULL)))) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return true;
+    }
+
+    /* allocate dest ubuf */
+    struct ubuf *ubuf = ubuf_pic_alloc(upipe_v210dec->ubuf_mgr, hsize, vsize);
+    if (unlikely(ubuf == NULL)) {
+        uref_pic_plane_unmap(uref, upipe_v210dec->input_chroma_map,
+                             0, 0, -1, -1);
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return true;
+    }
+
+    /* map output */
+    uint8_t *output_planes[UPIPE_V210_MAX_PLANES];
+    size_t output_strides[UPIPE_V210_MAX_PLANES];
+    int i;
+    for (i = 0; i < UPIPE_V210_MAX_PLANES; i++) {
+        if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf,
+                                          upipe_v210dec->output_chroma_map[i],
+                                          0, 0, -1, -1, &output_planes[i])) ||
+                     !ubase_check(ubuf_pic_plane_size(ubuf,
+                                          upipe_v210dec->output_chroma_map[i],
+                                          &output_strides[i],
+                                          NULL, NULL, NULL))))
+            break;
+    }
+    if (unlikely(i < UPIPE_V210_MAX_PLANES)) {
+        upipe_warn(upipe, "unable to map output buffer");
+        while (--i >= 0)
+            ubuf_pic_plane_unmap(ubuf, upipe_v210dec->output_chroma_map[i],
+                                 0, 0, -1, -1);
+        ubuf_free(ubuf);
+        uref_pic_plane_unmap(uref, upipe_v210dec->input_chroma_map,
+                             0, 0, -1, -1);
+        uref_free(uref);
+        return true;
+    }
+
+    upipe_v210dec_unpack(upipe, input_plane, input_stride,
+                         output_planes, output_strides, hsize, vsize);
+
+    /* unmap pictures */
+    uref_pic_plane_unmap(uref, upipe_v210dec->input_chroma_map, 0, 0, -1, -1);
+    for (i = 0; i < UPIPE_V210_MAX_PLANES; i++)
+        ubuf_pic_plane_unmap(ubuf, upipe_v210dec->output_chroma_map[i],
+                             0, 0, -1, -1);
+
+    uref_attach_ubuf(uref, ubuf);
+    upipe_v210dec_output(upipe, uref, upump_p);
+    return true;
+}
+
+/** @internal @This receives incoming uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure describing the picture
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_v210dec_input(struct upipe *upipe, struct uref *uref,
+                                struct upump **upump_p)
+{
+    if (!upipe_v210dec_check_input(upipe)) {
+        upipe_v210dec_hold_input(upipe, uref);
+        upipe_v210dec_block_input(upipe, upump_p);
+    } else if (!upipe_v210dec_handle(upipe, uref, upump_p)) {
+        upipe_v210dec_hold_input(upipe, uref);
+        upipe_v210dec_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This receives a provided ubuf manager.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_v210dec_check(struct upipe *upipe, struct uref *flow_format)
+{
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    if (flow_format != NULL)
+        upipe_v210dec_store_flow_def(upipe, flow_format);
+
+    if (upipe_v210dec->flow_def == NULL)
+        return UBASE_ERR_NONE;
+
+    bool was_buffered = !upipe_v210dec_check_input(upipe);
+    upipe_v210dec_output_input(upipe);
+    upipe_v210dec_unblock_input(upipe);
+    if (was_buffered && upipe_v210dec_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_v210dec_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_v210dec_set_flow_def(struct upipe *upipe,
+                                      struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+
+    UBASE_RETURN(uref_flow_match_def(flow_def, "pic."))
+
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    struct uref *flow_def_dup;
+
+    upipe_v210dec->input_chroma_map = "u10y10v10y10u10y10v10y10u10y10v10y10";
+
+    uint8_t macropixel;
+    if (!ubase_check(uref_pic_flow_get_macropixel(flow_def, &macropixel)) ||
+        macropixel != 48 ||
+        !ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 128,
+                                        upipe_v210dec->input_chroma_map))) {
+        upipe_err(upipe, "incompatible input flow def");
+        uref_dump(flow_def, upipe->uprobe);
+        return UBASE_ERR_EXTERNAL;
+    }
+
+    upipe_v210dec->output_bit_depth = upipe_v210dec->bit_depth;
+    if (upipe_v210dec->output_bit_depth == 8) {
+        upipe_v210dec->output_chroma_map[0] = "y8";
+        upipe_v210dec->output_chroma_map[1] = "u8";
+        upipe_v210dec->output_chroma_map[2] = "v8";
+    } else {
+        upipe_v210dec->output_chroma_map[0] = "y10l";
+        upipe_v210dec->output_chroma_map[1] = "u10l";
+        upipe_v210dec->output_chroma_map[2] = "v10l";
+    }
+    upipe_v210dec->output_chroma_map[3] = NULL;
+
+    if ((flow_def_dup = uref_dup(flow_def)) == NULL)
+        return UBASE_ERR_ALLOC;
+
+    uint8_t size = upipe_v210dec->output_bit_depth == 8 ? 1 : 2;
+    uref_pic_flow_clear_format(flow_def_dup);
+    uref_pic_flow_set_align(flow_def_dup, 32);
+    uref_pic_flow_set_macropixel(flow_def_dup, 1);
+    if (!ubase_check(uref_pic_flow_add_plane(flow_def_dup, 1, 1, size,
+                            upipe_v210dec->output_chroma_map[0])) ||
+        !ubase_check(uref_pic_flow_add_plane(flow_def_dup, 2, 1, size,
+                            upipe_v210dec->output_chroma_map[1])) ||
+        !ubase_check(uref_pic_flow_add_plane(flow_def_dup, 2, 1, size,
+                            upipe_v210dec->output_chroma_map[2]))) {
+        uref_free(flow_def_dup);
+        return UBASE_ERR_ALLOC;
+    }
+
+    upipe_input(upipe, flow_def_dup, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the output bit depth.
+ *
+ * @param upipe description structure of the pipe
+ * @param bit_depth 8 or 10
+ * @return an error code
+ */
+static int _upipe_v210dec_set_bit_depth(struct upipe *upipe, int bit_depth)
+{
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    if (unlikely(bit_depth != 8 && bit_depth != 10))
+        return UBASE_ERR_INVALID;
+
+    upipe_v210dec->bit_depth = bit_depth;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the number of slice threads.
+ *
+ * @param upipe description structure of the pipe
+ * @param threads number of threads
+ * @return an error code
+ */
+static int _upipe_v210dec_set_threads(struct upipe *upipe,
+                                      unsigned int threads)
+{
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    if (unlikely(threads < 1 || threads > UPIPE_V210DEC_MAX_THREADS))
+        return UBASE_ERR_INVALID;
+
+    struct uband_pool *band_pool = NULL;
+    if (threads > 1) {
+        band_pool = uband_pool_alloc(threads);
+        if (unlikely(band_pool == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        if (uband_pool_threads(band_pool) < threads)
+            upipe_warn_va(upipe, "only %u slice threads available",
+                          uband_pool_threads(band_pool));
+    }
+
+    uband_pool_free(upipe_v210dec->band_pool);
+    upipe_v210dec->band_pool = band_pool;
+    upipe_v210dec->threads = threads;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a v210dec pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_v210dec_control(struct upipe *upipe, int command,
+                                 va_list args)
+{
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_v210dec_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return UBASE_ERR_NONE;
+            return upipe_v210dec_free_output_proxy(upipe, request);
+        }
+
+        case UPIPE_GET_OUTPUT: {
+            struct upipe **p = va_arg(args, struct upipe **);
+            return upipe_v210dec_get_output(upipe, p);
+        }
+        case UPIPE_SET_OUTPUT: {
+            struct upipe *output = va_arg(args, struct upipe *);
+            return upipe_v210dec_set_output(upipe, output);
+        }
+        case UPIPE_GET_FLOW_DEF: {
+            struct uref **p = va_arg(args, struct uref **);
+            return upipe_v210dec_get_flow_def(upipe, p);
+        }
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow = va_arg(args, struct uref *);
+            return upipe_v210dec_set_flow_def(upipe, flow);
+        }
+
+        case UPIPE_V210DEC_SET_BIT_DEPTH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_V210DEC_SIGNATURE)
+            return _upipe_v210dec_set_bit_depth(upipe, va_arg(args, int));
+        }
+        case UPIPE_V210DEC_GET_BIT_DEPTH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_V210DEC_SIGNATURE)
+            int *p = va_arg(args, int *);
+            *p = upipe_v210dec->bit_depth;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_V210DEC_SET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_V210DEC_SIGNATURE)
+            return _upipe_v210dec_set_threads(upipe,
+                                              va_arg(args, unsigned int));
+        }
+        case UPIPE_V210DEC_GET_THREADS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_V210DEC_SIGNATURE)
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = upipe_v210dec->threads;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This allocates a v210dec pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_v210dec_alloc(struct upipe_mgr *mgr,
+                                         struct uprobe *uprobe,
+                                         uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_v210dec_alloc_void(mgr, uprobe, signature,
+                                                   args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    upipe_v210dec->bit_depth = 10;
+    upipe_v210dec->output_bit_depth = 10;
+    upipe_v210dec->threads = 1;
+    upipe_v210dec->band_pool = NULL;
+    upipe_v210dec->unpack_line_8  = upipe_v210dec_unpack_8_c;
+    upipe_v210dec->unpack_line_10 = upipe_v210dec_unpack_10_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSSE3)) {
+        upipe_v210dec->unpack_line_8  = upipe_v210dec_unpack_8_ssse3;
+        upipe_v210dec->unpack_line_10 = upipe_v210dec_unpack_10_ssse3;
+    }
+    if (ucpu_has(UCPU_AVX2)) {
+        upipe_v210dec->unpack_line_8  = upipe_v210dec_unpack_8_avx2;
+        upipe_v210dec->unpack_line_10 = upipe_v210dec_unpack_10_avx2;
+    }
+#endif
+
+    upipe_v210dec_init_urefcount(upipe);
+    upipe_v210dec_init_ubuf_mgr(upipe);
+    upipe_v210dec_init_output(upipe);
+    upipe_v210dec_init_input(upipe);
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_v210dec_free(struct upipe *upipe)
+{
+    struct upipe_v210dec *upipe_v210dec = upipe_v210dec_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+    uband_pool_free(upipe_v210dec->band_pool);
+    upipe_v210dec_clean_input(upipe);
+    upipe_v210dec_clean_output(upipe);
+    upipe_v210dec_clean_ubuf_mgr(upipe);
+    upipe_v210dec_clean_urefcount(upipe);
+    upipe_v210dec_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_v210dec_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_V210DEC_SIGNATURE,
+
+    .upipe_alloc = upipe_v210dec_alloc,
+    .upipe_input = upipe_v210dec_input,
+    .upipe_control = upipe_v210dec_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for v210dec pipes
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_v210dec_mgr_alloc(void)
+{
+    return &upipe_v210dec_mgr;
+}
@@ -0,0 +1,305 @@
+/*
+ * V210 decoder
+ *
+ * Copyright (c) 2015 Open Broadcast Systems Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** @file
+ * @short line unpacking functions of the v210dec module
+ *
+ * Like the packing functions of v210enc, the SIMD versions are built with
+ * function-level target attributes and produce the same output as the C
+ * versions.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-v210/upipe_v210dec.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @internal @This reads a 32-bit little-endian word. */
+static inline uint32_t v210dec_rl32(const uint8_t *src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+#define READ_PIXELS(a, b, c, shift)                                         \
+    do {                                                                    \
+        val = v210dec_rl32(src);                                            \
+        src += 4;                                                           \
+        *a++ = (val & 0x3ff) >> shift;                                      \
+        *b++ = ((val >> 10) & 0x3ff) >> shift;                              \
+        *c++ = ((val >> 20) & 0x3ff) >> shift;                              \
+    } while (0)
+
+/** @This unpacks a line of v210 to 8-bit planar 4:2:2.
+ *
+ * @param src v210 input
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param width number of pixels, multiple of 6
+ */
+void upipe_v210dec_unpack_8_c(const uint8_t *src, uint8_t *y, uint8_t *u,
+                              uint8_t *v, ptrdiff_t width)
+{
+    uint32_t val;
+    for (ptrdiff_t i = 0; i < width - 5; i += 6) {
+        READ_PIXELS(u, y, v, 2);
+        READ_PIXELS(y, u, y, 2);
+        READ_PIXELS(v, y, u, 2);
+        READ_PIXELS(y, v, y, 2);
+    }
+}
+
+/** @This unpacks a line of v210 to 10-bit planar 4:2:2.
+ *
+ * @param src v210 input
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param width number of pixels, multiple of 6
+ */
+void upipe_v210dec_unpack_10_c(const uint8_t *src, uint16_t *y, uint16_t *u,
+                               uint16_t *v, ptrdiff_t width)
+{
+    uint32_t val;
+    for (ptrdiff_t i = 0; i < width - 5; i += 6) {
+        READ_PIXELS(u, y, v, 0);
+        READ_PIXELS(y, u, y, 0);
+        READ_PIXELS(v, y, u, 0);
+        READ_PIXELS(y, v, y, 0);
+    }
+}
+
+#ifdef UCPU_X86
+/*
+ * The 4 words of a group of 6 pixels are split into their first (A),
+ * second (B) and third (C) 10-bit fields, which are narrowed to 16 bits:
+ *   A = U0 Y1 V1 Y4, B = Y0 U1 Y3 V2, C = V0 Y2 U2 Y5.
+ * Shuffles of AB and CC then give Y0..Y5 and U0..U2 V0..V2.
+ */
+
+/** Y0 Y1 _ Y3 Y4 _ from A0..A3 B0..B3 */
+#define SHUF_Y_AB \
+    8, 9, 2, 3, -1, -1, 12, 13, 6, 7, -1, -1, -1, -1, -1, -1
+/** _ _ Y2 _ _ Y5 from C0..C3 */
+#define SHUF_Y_C \
+    -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1
+/** U0 U1 _ _ V1 V2 from A0..A3 B0..B3 */
+#define SHUF_UV_AB \
+    0, 1, 10, 11, -1, -1, -1, -1, 4, 5, 14, 15, -1, -1, -1, -1
+/** _ _ U2 V0 _ _ from C0..C3 */
+#define SHUF_UV_C \
+    -1, -1, -1, -1, 4, 5, 0, 1, -1, -1, -1, -1, -1, -1, -1, -1
+
+/** @internal @This unpacks 6 pixels.
+ *
+ * @param src 4 words
+ * @param uv_p filled in with U0..U2 V0..V2 (16 bits)
+ * @return Y0..Y5 (16 bits)
+ */
+__attribute__((target("ssse3")))
+static inline __m128i v210dec_unpack_ssse3(__m128i src, __m128i *uv_p)
+{
+    const __m128i mask = _mm_set1_epi32(0x3ff);
+    __m128i a = _mm_and_si128(src, mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(src, 10), mask);
+    __m128i c = _mm_and_si128(_mm_srli_epi32(src, 20), mask);
+    __m128i ab = _mm_packs_epi32(a, b);
+    __m128i cc = _mm_packs_epi32(c, c);
+    *uv_p = _mm_or_si128(_mm_shuffle_epi8(ab, _mm_setr_epi8(SHUF_UV_AB)),
+                         _mm_shuffle_epi8(cc, _mm_setr_epi8(SHUF_UV_C)));
+    return _mm_or_si128(_mm_shuffle_epi8(ab, _mm_setr_epi8(SHUF_Y_AB)),
+                        _mm_shuffle_epi8(cc, _mm_setr_epi8(SHUF_Y_C)));
+}
+
+/** @This unpacks a line of v210 to 8-bit planar 4:2:2, using SSSE3.
+ *
+ * @param src v210 input
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param width number of pixels, multiple of 6
+ */
+__attribute__((target("ssse3")))
+void upipe_v210dec_unpack_8_ssse3(const uint8_t *src, uint8_t *y,
+                                  uint8_t *u, uint8_t *v, ptrdiff_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    ptrdiff_t i;
+
+    /* stores span 8 luma and 4 chroma samples */
+    for (i = 0; i + 8 <= width; i += 6) {
+        __m128i uv;
+        __m128i yy = v210dec_unpack_ssse3(
+                _mm_loadu_si128((const __m128i *)src), &uv);
+        yy = _mm_packus_epi16(_mm_srli_epi16(yy, 2), zero);
+        uv = _mm_packus_epi16(_mm_srli_epi16(uv, 2), zero);
+        _mm_storel_epi64((__m128i *)y, yy);
+        uint32_t uu = _mm_cvtsi128_si32(uv);
+        uint32_t vv = _mm_cvtsi128_si32(_mm_srli_si128(uv, 3));
+        memcpy(u, &uu, 4);
+        memcpy(v, &vv, 4);
+
+        src += 16;
+        y += 6;
+        u += 3;
+        v += 3;
+    }
+    upipe_v210dec_unpack_8_c(src, y, u, v, width - i);
+}
+
+/** @This unpacks a line of v210 to 10-bit planar 4:2:2, using SSSE3.
+ *
+ * @param src v210 input
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param width number of pixels, multiple of 6
+ */
+__attribute__((target("ssse3")))
+void upipe_v210dec_unpack_10_ssse3(const uint8_t *src, uint16_t *y,
+                                   uint16_t *u, uint16_t *v, ptrdiff_t width)
+{
+    ptrdiff_t i;
+
+    /* stores span 8 luma and 4 chroma samples */
+    for (i = 0; i + 8 <= width; i += 6) {
+        __m128i uv;
+        __m128i yy = v210dec_unpack_ssse3(
+                _mm_loadu_si128((const __m128i *)src), &uv);
+        _mm_storeu_si128((__m128i *)y, yy);
+        _mm_storel_epi64((__m128i *)u, uv);
+        _mm_storel_epi64((__m128i *)v, _mm_srli_si128(uv, 6));
+
+        src += 16;
+        y += 6;
+        u += 3;
+        v += 3;
+    }
+    upipe_v210dec_unpack_10_c(src, y, u, v, width - i);
+}
+
+/** @internal @This unpacks 12 pixels, 6 pixels in each lane.
+ *
+ * @param src 8 words
+ * @param uv_p filled in with U0..U2 V0..V2 (16 bits) in each lane
+ * @return Y0..Y5 (16 bits) in each lane
+ */
+__attribute__((target("avx2")))
+static inline __m256i v210dec_unpack_avx2(__m256i src, __m256i *uv_p)
+{
+    const __m256i mask = _mm256_set1_epi32(0x3ff);
+    __m256i a = _mm256_and_si256(src, mask);
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(src, 10), mask);
+    __m256i c = _mm256_and_si256(_mm256_srli_epi32(src, 20), mask);
+    __m256i ab = _mm256_packs_epi32(a, b);
+    __m256i cc = _mm256_packs_epi32(c, c);
+    *uv_p = _mm256_or_si256(
+            _mm256_shuffle_epi8(ab, _mm256_setr_epi8(SHUF_UV_AB, SHUF_UV_AB)),
+            _mm256_shuffle_epi8(cc, _mm256_setr_epi8(SHUF_UV_C, SHUF_UV_C)));
+    return _mm256_or_si256(
+            _mm256_shuffle_epi8(ab, _mm256_setr_epi8(SHUF_Y_AB, SHUF_Y_AB)),
+            _mm256_shuffle_epi8(cc, _mm256_setr_epi8(SHUF_Y_C, SHUF_Y_C)));
+}
+
+/** @This unpacks a line of v210 to 8-bit planar 4:2:2, using AVX2.
+ *
+ * @param src v210 input
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param width number of pixels, multiple of 6
+ */
+__attribute__((target("avx2")))
+void upipe_v210dec_unpack_8_avx2(const uint8_t *src, uint8_t *y,
+                                 uint8_t *u, uint8_t *v, ptrdiff_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    ptrdiff_t i;
+
+    /* stores span 14 luma and 7 chroma samples */
+    for (i = 0; i + 14 <= width; i += 12) {
+        __m256i uv;
+        __m256i yy = v210dec_unpack_avx2(
+                _mm256_loadu_si256((const __m256i *)src), &uv);
+        yy = _mm256_packus_epi16(_mm256_srli_epi16(yy, 2), zero);
+        uv = _mm256_packus_epi16(_mm256_srli_epi16(uv, 2), zero);
+        __m128i uv0 = _mm256_castsi256_si128(uv);
+        __m128i uv1 = _mm256_extracti128_si256(uv, 1);
+        _mm_storel_epi64((__m128i *)y, _mm256_castsi256_si128(yy));
+        _mm_storel_epi64((__m128i *)(y + 6), _mm256_extracti128_si256(yy, 1));
+        uint32_t uu0 = _mm_cvtsi128_si32(uv0);
+        uint32_t vv0 = _mm_cvtsi128_si32(_mm_srli_si128(uv0, 3));
+        uint32_t uu1 = _mm_cvtsi128_si32(uv1);
+        uint32_t vv1 = _mm_cvtsi128_si32(_mm_srli_si128(uv1, 3));
+        memcpy(u, &uu0, 4);
+        memcpy(v, &vv0, 4);
+        memcpy(u + 3, &uu1, 4);
+        memcpy(v + 3, &vv1, 4);
+
+        src += 32;
+        y += 12;
+        u += 6;
+        v += 6;
+    }
+    upipe_v210dec_unpack_8_ssse3(src, y, u, v, width - i);
+}
+
+/** @This unpacks a line of v210 to 10-bit planar 4:2:2, using AVX2.
+ *
+ * @param src v210 input
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param width number of pixels, multiple of 6
+ */
+__attribute__((target("avx2")))
+void upipe_v210dec_unpack_10_avx2(const uint8_t *src, uint16_t *y,
+                                  uint16_t *u, uint16_t *v, ptrdiff_t width)
+{
+    ptrdiff_t i;
+
+    /* stores span 14 luma and 7 chroma samples */
+    for (i = 0; i + 14 <= width; i += 12) {
+        __m256i uv;
+        __m256i yy = v210dec_unpack_avx2(
+                _mm256_loadu_si256((const __m256i *)src), &uv);
+        __m128i uv0 = _mm256_castsi256_si128(uv);
+        __m128i uv1 = _mm256_extracti128_si256(uv, 1);
+        _mm_storeu_si128((__m128i *)y, _mm256_castsi256_si128(yy));
+        _mm_storeu_si128((__m128i *)(y + 6), _mm256_extracti128_si256(yy, 1));
+        _mm_storel_epi64((__m128i *)u, uv0);
+        _mm_storel_epi64((__m128i *)v, _mm_srli_si128(uv0, 6));
+        _mm_storel_epi64((__m128i *)(u + 3), uv1);
+        _mm_storel_epi64((__m128i *)(v + 3), _mm_srli_si128(uv1, 6));
+
+        src += 32;
+        y += 12;
+        u += 6;
+        v += 6;
+    }
+    upipe_v210dec_unpack_10_ssse3(src, y, u, v, width - i);
+}
+#endif
@@ -27,6 +27,7 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ucpu.h>
 #include <upipe/uprobe.h>
 #include <upipe/uref.h>
 #include <upipe/ubuf.h>
@@ -54,7 +55,6 @@
 #include <upipe-v210/upipe_v210enc.h>
 
 #include <libavutil/common.h>
-#include <libavutil/cpu.h>
 #include <libavutil/intreadwrite.h>
 
 #define UPIPE_V210_MAX_PLANES 3
@@ -92,9 +92,6 @@ struct upipe_v210enc {
     /** input bit depth **/
     int input_bit_depth;
 
-    /** cpu flags **/
-    int cpu_flags;
-
     /** 8-bit line packing function **/
     upipe_v210enc_pack_line_8 pack_line_8;
     /** 10-bit line packing function **/
@@ -147,39 +144,6 @@ UPIPE_HELPER_INPUT(upipe_v210enc, urefs, nb_urefs, max_urefs, blockers, upipe_v2
         dst += 4;                       \
     } while (0)
 
-static void v210enc_planar_pack_8_c(const uint8_t *y, const uint8_t *u,
-                                 const uint8_t *v, uint8_t *dst, ptrdiff_t width)
-{
-    uint32_t val;
-    int i;
-
-    /* unroll this to match the assembly */
-    for( i = 0; i < width-11; i += 12 ){
-        WRITE_PIXELS8(u, y, v);
-        WRITE_PIXELS8(y, u, y);
-        WRITE_PIXELS8(v, y, u);
-        WRITE_PIXELS8(y, v, y);
-        WRITE_PIXELS8(u, y, v);
-        WRITE_PIXELS8(y, u, y);
-        WRITE_PIXELS8(v, y, u);
-        WRITE_PIXELS8(y, v, y);
-    }
-}
-
-static void v210enc_planar_pack_10_c(const uint16_t *y, const uint16_t *u,
-                                  const uint16_t *v, uint8_t *dst, ptrdiff_t width)
-{
-    uint32_t val;
-    int i;
-
-    for( i = 0; i < width-5; i += 6 ){
-        WRITE_PIXELS(u, y, v);
-        WRITE_PIXELS(y, u, y);
-        WRITE_PIXELS(v, y, u);
-        WRITE_PIXELS(y, v, y);
-    }
-}
-
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -633,10 +597,18 @@ static struct upipe *upipe_v210enc_alloc(struct upipe_mgr *mgr,
         return NULL;
 
     struct upipe_v210enc *upipe_v210enc = upipe_v210enc_from_upipe(upipe);
-    upipe_v210enc->cpu_flags = av_get_cpu_flags();
-
-    upipe_v210enc->pack_line_8  = v210enc_planar_pack_8_c;
-    upipe_v210enc->pack_line_10 = v210enc_planar_pack_10_c;
+    upipe_v210enc->pack_line_8  = upipe_v210enc_pack_8_c;
+    upipe_v210enc->pack_line_10 = upipe_v210enc_pack_10_c;
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSSE3)) {
+        upipe_v210enc->pack_line_8  = upipe_v210enc_pack_8_ssse3;
+        upipe_v210enc->pack_line_10 = upipe_v210enc_pack_10_ssse3;
+    }
+    if (ucpu_has(UCPU_AVX2)) {
+        upipe_v210enc->pack_line_8  = upipe_v210enc_pack_8_avx2;
+        upipe_v210enc->pack_line_10 = upipe_v210enc_pack_10_avx2;
+    }
+#endif
 
     upipe_v210enc_init_urefcount(upipe);
     upipe_v210enc_init_ubuf_mgr(upipe);
@@ -0,0 +1,396 @@
+/*
+ * V210 encoder
+ *
+ * Copyright (C) 2009 Michael Niedermayer <michaelni@gmx.at>
+ * Copyright (c) 2009 Baptiste Coudurier <baptiste dot coudurier at gmail dot com>
+ * Copyright (c) 2015 Open Broadcast Systems Ltd
+ *
+ * This file is based on the implementation in FFmpeg.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** @file
+ * @short line packing functions of the v210enc module
+ *
+ * The SIMD versions are built with function-level target attributes, so
+ * they do not require special compiler flags, and are only called after
+ * the CPU features have been checked. They produce the same output as the
+ * C versions, including clipping.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe-v210/upipe_v210enc.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef UCPU_X86
+#include <immintrin.h>
+#endif
+
+/** @internal @This clips a value to the 10-bit legal range. */
+static inline uint32_t v210enc_clip(uint32_t v)
+{
+    return v < 4 ? 4 : v > 1019 ? 1019 : v;
+}
+
+/** @internal @This clips a value to the 8-bit legal range. */
+static inline uint32_t v210enc_clip8(uint32_t v)
+{
+    return v < 1 ? 1 : v > 254 ? 254 : v;
+}
+
+/** @internal @This writes a 32-bit little-endian word. */
+static inline void v210enc_wl32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+    dst[2] = val >> 16;
+    dst[3] = val >> 24;
+}
+
+#define WRITE_PIXELS(a, b, c)                                               \
+    do {                                                                    \
+        val =  v210enc_clip(*a++);                                          \
+        val |= (v210enc_clip(*b++) << 10) |                                 \
+               (v210enc_clip(*c++) << 20);                                  \
+        v210enc_wl32(dst, val);                                             \
+        dst += 4;                                                           \
+    } while (0)
+
+#define WRITE_PIXELS8(a, b, c)                                              \
+    do {                                                                    \
+        val =  (v210enc_clip8(*a++) << 2);                                  \
+        val |= (v210enc_clip8(*b++) << 12) |                                \
+               (v210enc_clip8(*c++) << 22);                                 \
+        v210enc_wl32(dst, val);                                             \
+        dst += 4;                                                           \
+    } while (0)
+
+/** @This packs a line of 8-bit planar 4:2:2 to v210.
+ *
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param dst v210 output
+ * @param width number of pixels, multiple of 12
+ */
+void upipe_v210enc_pack_8_c(const uint8_t *y, const uint8_t *u,
+                            const uint8_t *v, uint8_t *dst, ptrdiff_t width)
+{
+    uint32_t val;
+    int i;
+
+    /* unroll this to match the assembly */
+    for( i = 0; i < width-11; i += 12 ){
+        WRITE_PIXELS8(u, y, v);
+        WRITE_PIXELS8(y, u, y);
+        WRITE_PIXELS8(v, y, u);
+        WRITE_PIXELS8(y, v, y);
+        WRITE_PIXELS8(u, y, v);
+        WRITE_PIXELS8(y, u, y);
+        WRITE_PIXELS8(v, y, u);
+        WRITE_PIXELS8(y, v, y);
+    }
+}
+
+/** @This packs a line of 10-bit planar 4:2:2 to v210.
+ *
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param dst v210 output
+ * @param width number of pixels, multiple of 6
+ */
+void upipe_v210enc_pack_10_c(const uint16_t *y, const uint16_t *u,
+                             const uint16_t *v, uint8_t *dst, ptrdiff_t width)
+{
+    uint32_t val;
+    int i;
+
+    for( i = 0; i < width-5; i += 6 ){
+        WRITE_PIXELS(u, y, v);
+        WRITE_PIXELS(y, u, y);
+        WRITE_PIXELS(v, y, u);
+        WRITE_PIXELS(y, v, y);
+    }
+}
+
+#ifdef UCPU_X86
+/*
+ * A group of 6 pixels makes 4 words of the form a | b << 10 | c << 20.
+ * Luma is expanded to 16 bits in one register (Y0..Y7), and chroma in
+ * another (U0..U3 V0..V3). Two shuffles build the (a, b) pairs, which
+ * pmaddwd merges into a | b << 10, and the c values, which are shifted by
+ * 20 and or'ed. The 8-bit versions use the same layout with an extra
+ * shift of 2.
+ */
+
+/** (a, b) pairs taken from luma: _ Y0 Y1 _ _ Y3 Y4 _ */
+#define SHUF_AB_Y \
+    -1, -1, 0, 1, 2, 3, -1, -1, -1, -1, 6, 7, 8, 9, -1, -1
+/** (a, b) pairs taken from chroma: U0 _ _ U1 V1 _ _ V2 */
+#define SHUF_AB_UV \
+    0, 1, -1, -1, -1, -1, 2, 3, 10, 11, -1, -1, -1, -1, 12, 13
+/** c values taken from luma: _ 0 Y2 0 _ 0 Y5 0 */
+#define SHUF_C_Y \
+    -1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1
+/** c values taken from chroma: V0 0 _ 0 U2 0 _ 0 */
+#define SHUF_C_UV \
+    8, 9, -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1
+
+/** @internal @This clips 16-bit unsigned values, without SSE4.1. */
+__attribute__((target("ssse3")))
+static inline __m128i v210enc_clip_ssse3(__m128i x, __m128i min, __m128i max)
+{
+    /* max(x, min) = (x -sat min) + min, min(x, max) = x - (x -sat max) */
+    x = _mm_add_epi16(_mm_subs_epu16(x, min), min);
+    return _mm_sub_epi16(x, _mm_subs_epu16(x, max));
+}
+
+/** @internal @This packs 6 pixels to 4 words.
+ *
+ * @param y Y0..Y7 (16 bits)
+ * @param uv U0..U3 V0..V3 (16 bits)
+ * @param mul multipliers of a and b
+ * @param shift shift of c
+ * @return packed words
+ */
+__attribute__((target("ssse3")))
+static inline __m128i v210enc_pack_ssse3(__m128i y, __m128i uv,
+                                         __m128i mul, int shift)
+{
+    const __m128i shuf_ab_y = _mm_setr_epi8(SHUF_AB_Y);
+    const __m128i shuf_ab_uv = _mm_setr_epi8(SHUF_AB_UV);
+    const __m128i shuf_c_y = _mm_setr_epi8(SHUF_C_Y);
+    const __m128i shuf_c_uv = _mm_setr_epi8(SHUF_C_UV);
+    __m128i ab = _mm_or_si128(_mm_shuffle_epi8(y, shuf_ab_y),
+                              _mm_shuffle_epi8(uv, shuf_ab_uv));
+    __m128i c = _mm_or_si128(_mm_shuffle_epi8(y, shuf_c_y),
+                             _mm_shuffle_epi8(uv, shuf_c_uv));
+    return _mm_or_si128(_mm_madd_epi16(ab, mul), _mm_slli_epi32(c, shift));
+}
+
+/** @This packs a line of 8-bit planar 4:2:2 to v210, using SSSE3.
+ *
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param dst v210 output
+ * @param width number of pixels, multiple of 12
+ */
+__attribute__((target("ssse3")))
+void upipe_v210enc_pack_8_ssse3(const uint8_t *y, const uint8_t *u,
+                                const uint8_t *v, uint8_t *dst,
+                                ptrdiff_t width)
+{
+    const __m128i min = _mm_set1_epi8(1);
+    const __m128i max = _mm_set1_epi8(254);
+    const __m128i mul = _mm_set1_epi32(4 | (4096 << 16));
+    const __m128i zero = _mm_setzero_si128();
+    ptrdiff_t i;
+
+    /* loads span 16 luma and 8 chroma samples */
+    for (i = 0; i + 16 <= width; i += 12) {
+        __m128i yy = _mm_loadu_si128((const __m128i *)y);
+        __m128i uu = _mm_loadl_epi64((const __m128i *)u);
+        __m128i vv = _mm_loadl_epi64((const __m128i *)v);
+        yy = _mm_min_epu8(_mm_max_epu8(yy, min), max);
+        __m128i uv = _mm_unpacklo_epi64(uu, vv);
+        uv = _mm_min_epu8(_mm_max_epu8(uv, min), max);
+
+        __m128i y0 = _mm_unpacklo_epi8(yy, zero);
+        __m128i uv0 = _mm_unpacklo_epi64(_mm_unpacklo_epi8(uv, zero),
+                                         _mm_unpackhi_epi8(uv, zero));
+        _mm_storeu_si128((__m128i *)dst,
+                         v210enc_pack_ssse3(y0, uv0, mul, 22));
+
+        __m128i y1 = _mm_unpacklo_epi8(_mm_srli_si128(yy, 6), zero);
+        __m128i uv1 = _mm_srli_epi64(uv, 24);
+        uv1 = _mm_unpacklo_epi64(_mm_unpacklo_epi8(uv1, zero),
+                                 _mm_unpackhi_epi8(uv1, zero));
+        _mm_storeu_si128((__m128i *)(dst + 16),
+                         v210enc_pack_ssse3(y1, uv1, mul, 22));
+
+        y += 12;
+        u += 6;
+        v += 6;
+        dst += 32;
+    }
+    upipe_v210enc_pack_8_c(y, u, v, dst, width - i);
+}
+
+/** @This packs a line of 10-bit planar 4:2:2 to v210, using SSSE3.
+ *
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param dst v210 output
+ * @param width number of pixels, multiple of 6
+ */
+__attribute__((target("ssse3")))
+void upipe_v210enc_pack_10_ssse3(const uint16_t *y, const uint16_t *u,
+                                 const uint16_t *v, uint8_t *dst,
+                                 ptrdiff_t width)
+{
+    const __m128i min = _mm_set1_epi16(4);
+    const __m128i max = _mm_set1_epi16(1019);
+    const __m128i mul = _mm_set1_epi32(1 | (1024 << 16));
+    ptrdiff_t i;
+
+    /* loads span 8 luma and 4 chroma samples */
+    for (i = 0; i + 8 <= width; i += 6) {
+        __m128i yy = _mm_loadu_si128((const __m128i *)y);
+        __m128i uv = _mm_unpacklo_epi64(
+                _mm_loadl_epi64((const __m128i *)u),
+                _mm_loadl_epi64((const __m128i *)v));
+        yy = v210enc_clip_ssse3(yy, min, max);
+        uv = v210enc_clip_ssse3(uv, min, max);
+        _mm_storeu_si128((__m128i *)dst,
+                         v210enc_pack_ssse3(yy, uv, mul, 20));
+
+        y += 6;
+        u += 3;
+        v += 3;
+        dst += 16;
+    }
+    upipe_v210enc_pack_10_c(y, u, v, dst, width - i);
+}
+
+/** @internal @This packs 12 pixels to 8 words, 6 pixels in each lane.
+ *
+ * @param y Y0..Y7 (16 bits) in each lane
+ * @param uv U0..U3 V0..V3 (16 bits) in each lane
+ * @param mul multipliers of a and b
+ * @param shift shift of c
+ * @return packed words
+ */
+__attribute__((target("avx2")))
+static inline __m256i v210enc_pack_avx2(__m256i y, __m256i uv,
+                                        __m256i mul, int shift)
+{
+    const __m256i shuf_ab_y = _mm256_setr_epi8(SHUF_AB_Y, SHUF_AB_Y);
+    const __m256i shuf_ab_uv = _mm256_setr_epi8(SHUF_AB_UV, SHUF_AB_UV);
+    const __m256i shuf_c_y = _mm256_setr_epi8(SHUF_C_Y, SHUF_C_Y);
+    const __m256i shuf_c_uv = _mm256_setr_epi8(SHUF_C_UV, SHUF_C_UV);
+    __m256i ab = _mm256_or_si256(_mm256_shuffle_epi8(y, shuf_ab_y),
+                                 _mm256_shuffle_epi8(uv, shuf_ab_uv));
+    __m256i c = _mm256_or_si256(_mm256_shuffle_epi8(y, shuf_c_y),
+                                _mm256_shuffle_epi8(uv, shuf_c_uv));
+    return _mm256_or_si256(_mm256_madd_epi16(ab, mul),
+                           _mm256_slli_epi32(c, shift));
+}
+
+/** @This packs a line of 8-bit planar 4:2:2 to v210, using AVX2.
+ *
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param dst v210 output
+ * @param width number of pixels, multiple of 12
+ */
+__attribute__((target("avx2")))
+void upipe_v210enc_pack_8_avx2(const uint8_t *y, const uint8_t *u,
+                               const uint8_t *v, uint8_t *dst,
+                               ptrdiff_t width)
+{
+    const __m128i min = _mm_set1_epi8(1);
+    const __m128i max = _mm_set1_epi8(254);
+    const __m256i mul = _mm256_set1_epi32(4 | (4096 << 16));
+    ptrdiff_t i;
+
+    /* loads span 32 luma and 16 chroma samples */
+    for (i = 0; i + 32 <= width; i += 24) {
+        __m128i yy0 = _mm_loadu_si128((const __m128i *)y);
+        __m128i yy1 = _mm_loadu_si128((const __m128i *)(y + 12));
+        __m128i uu = _mm_loadu_si128((const __m128i *)u);
+        __m128i vv = _mm_loadu_si128((const __m128i *)v);
+        yy0 = _mm_min_epu8(_mm_max_epu8(yy0, min), max);
+        yy1 = _mm_min_epu8(_mm_max_epu8(yy1, min), max);
+        uu = _mm_min_epu8(_mm_max_epu8(uu, min), max);
+        vv = _mm_min_epu8(_mm_max_epu8(vv, min), max);
+
+        /* each lane holds 8 luma and 4 + 4 chroma samples of a group */
+        __m256i y01 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(yy0,
+                                           _mm_srli_si128(yy0, 6)));
+        __m256i y23 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(yy1,
+                                           _mm_srli_si128(yy1, 6)));
+        __m128i uv0 = _mm_unpacklo_epi32(uu, vv);
+        __m128i uv1 = _mm_unpacklo_epi32(_mm_srli_si128(uu, 3),
+                                         _mm_srli_si128(vv, 3));
+        __m128i uv2 = _mm_unpacklo_epi32(_mm_srli_si128(uu, 6),
+                                         _mm_srli_si128(vv, 6));
+        __m128i uv3 = _mm_unpacklo_epi32(_mm_srli_si128(uu, 9),
+                                         _mm_srli_si128(vv, 9));
+        __m256i uv01 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(uv0, uv1));
+        __m256i uv23 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(uv2, uv3));
+
+        _mm256_storeu_si256((__m256i *)dst,
+                            v210enc_pack_avx2(y01, uv01, mul, 22));
+        _mm256_storeu_si256((__m256i *)(dst + 32),
+                            v210enc_pack_avx2(y23, uv23, mul, 22));
+
+        y += 24;
+        u += 12;
+        v += 12;
+        dst += 64;
+    }
+    upipe_v210enc_pack_8_ssse3(y, u, v, dst, width - i);
+}
+
+/** @This packs a line of 10-bit planar 4:2:2 to v210, using AVX2.
+ *
+ * @param y luma plane
+ * @param u blue chroma plane
+ * @param v red chroma plane
+ * @param dst v210 output
+ * @param width number of pixels, multiple of 6
+ */
+__attribute__((target("avx2")))
+void upipe_v210enc_pack_10_avx2(const uint16_t *y, const uint16_t *u,
+                                const uint16_t *v, uint8_t *dst,
+                                ptrdiff_t width)
+{
+    const __m256i min = _mm256_set1_epi16(4);
+    const __m256i max = _mm256_set1_epi16(1019);
+    const __m256i mul = _mm256_set1_epi32(1 | (1024 << 16));
+    ptrdiff_t i;
+
+    /* loads span 14 luma and 7 chroma samples */
+    for (i = 0; i + 14 <= width; i += 12) {
+        __m256i yy = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i *)y)),
+                _mm_loadu_si128((const __m128i *)(y + 6)), 1);
+        __m256i uv = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)u),
+                                       _mm_loadl_epi64((const __m128i *)v))),
+                _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(u + 3)),
+                                   _mm_loadl_epi64((const __m128i *)(v + 3))),
+                1);
+        yy = _mm256_min_epu16(_mm256_max_epu16(yy, min), max);
+        uv = _mm256_min_epu16(_mm256_max_epu16(uv, min), max);
+        _mm256_storeu_si256((__m256i *)dst,
+                            v210enc_pack_avx2(yy, uv, mul, 20));
+
+        y += 12;
+        u += 6;
+        v += 6;
+        dst += 32;
+    }
+    upipe_v210enc_pack_10_ssse3(y, u, v, dst, width - i);
+}
+#endif
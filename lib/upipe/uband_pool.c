@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe pool of persistent threads processing picture bands
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uband_pool.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/** @This is the private structure of a band pool. */
+struct uband_pool {
+    /** number of workers */
+    unsigned int nb_workers;
+#ifdef HAVE_PTHREAD
+    /** protects the fields below */
+    pthread_mutex_t mutex;
+    /** signaled when bands are available or the pool is freed */
+    pthread_cond_t start_cond;
+    /** signaled when the last band is done */
+    pthread_cond_t done_cond;
+    /** true when the workers must exit */
+    bool exit;
+    /** function processing a band */
+    uband_pool_cb cb;
+    /** opaque passed to cb */
+    void *opaque;
+    /** number of bands of the current picture */
+    unsigned int nb_bands;
+    /** next band to process */
+    unsigned int next_band;
+    /** number of bands done */
+    unsigned int done;
+    /** worker threads */
+    pthread_t workers[];
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+/** @internal @This is the main loop of a worker.
+ *
+ * @param opaque pointer to the pool
+ * @return NULL
+ */
+static void *uband_pool_worker(void *opaque)
+{
+    struct uband_pool *pool = opaque;
+    pthread_mutex_lock(&pool->mutex);
+    for ( ; ; ) {
+        while (!pool->exit && pool->next_band >= pool->nb_bands)
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+        if (pool->exit)
+            break;
+
+        unsigned int band = pool->next_band++;
+        unsigned int nb_bands = pool->nb_bands;
+        uband_pool_cb cb = pool->cb;
+        void *cb_opaque = pool->opaque;
+        pthread_mutex_unlock(&pool->mutex);
+        cb(cb_opaque, band, nb_bands);
+        pthread_mutex_lock(&pool->mutex);
+        if (++pool->done == nb_bands)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+#endif
+
+/** @This allocates a pool of band threads.
+ *
+ * @param threads number of threads, including the calling thread
+ * @return pointer to the pool, or NULL in case of allocation error
+ */
+struct uband_pool *uband_pool_alloc(unsigned int threads)
+{
+    unsigned int nb_workers = threads > 1 ? threads - 1 : 0;
+#ifdef HAVE_PTHREAD
+    struct uband_pool *pool = malloc(sizeof(struct uband_pool) +
+                                     nb_workers * sizeof(pthread_t));
+    if (unlikely(pool == NULL))
+        return NULL;
+
+    pool->exit = false;
+    pool->cb = NULL;
+    pool->opaque = NULL;
+    pool->nb_bands = pool->next_band = pool->done = 0;
+    if (unlikely(pthread_mutex_init(&pool->mutex, NULL))) {
+        free(pool);
+        return NULL;
+    }
+    if (unlikely(pthread_cond_init(&pool->start_cond, NULL))) {
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+        return NULL;
+    }
+    if (unlikely(pthread_cond_init(&pool->done_cond, NULL))) {
+        pthread_cond_destroy(&pool->start_cond);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+        return NULL;
+    }
+
+    for (pool->nb_workers = 0; pool->nb_workers < nb_workers;
+         pool->nb_workers++)
+        if (unlikely(pthread_create(&pool->workers[pool->nb_workers], NULL,
+                                    uband_pool_worker, pool)))
+            break;
+#else
+    struct uband_pool *pool = malloc(sizeof(struct uband_pool));
+    if (unlikely(pool == NULL))
+        return NULL;
+    pool->nb_workers = 0;
+#endif
+    return pool;
+}
+
+/** @This stops the workers and frees a pool.
+ *
+ * @param pool pointer to the pool, may be NULL
+ */
+void uband_pool_free(struct uband_pool *pool)
+{
+    if (pool == NULL)
+        return;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&pool->mutex);
+    pool->exit = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (unsigned int i = 0; i < pool->nb_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->mutex);
+#endif
+    free(pool);
+}
+
+/** @This returns the number of threads actually processing bands.
+ *
+ * @param pool pointer to the pool
+ * @return number of threads
+ */
+unsigned int uband_pool_threads(struct uband_pool *pool)
+{
+    return pool->nb_workers + 1;
+}
+
+/** @This processes all bands of a picture.
+ *
+ * @param pool pointer to the pool
+ * @param nb_bands number of bands
+ * @param cb function processing a band
+ * @param opaque opaque passed to cb
+ */
+void uband_pool_run(struct uband_pool *pool, unsigned int nb_bands,
+                    uband_pool_cb cb, void *opaque)
+{
+#ifdef HAVE_PTHREAD
+    if (pool->nb_workers && nb_bands > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->cb = cb;
+        pool->opaque = opaque;
+        pool->nb_bands = nb_bands;
+        pool->next_band = 0;
+        pool->done = 0;
+        pthread_cond_broadcast(&pool->start_cond);
+
+        /* the calling thread takes its share of the bands */
+        while (pool->next_band < nb_bands) {
+            unsigned int band = pool->next_band++;
+            pthread_mutex_unlock(&pool->mutex);
+            cb(opaque, band, nb_bands);
+            pthread_mutex_lock(&pool->mutex);
+            pool->done++;
+        }
+        while (pool->done < nb_bands)
+            pthread_cond_wait(&pool->done_cond, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+#endif
+    for (unsigned int band = 0; band < nb_bands; band++)
+        cb(opaque, band, nb_bands);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for band pools
+ */
+
+#undef NDEBUG
+
+#include <upipe/uband_pool.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define NB_BANDS 16
+#define NB_RUNS 1000
+
+/** counts how many times each band was processed */
+static unsigned int counts[NB_BANDS];
+
+/** processes a band */
+static void process(void *opaque, unsigned int band, unsigned int nb_bands)
+{
+    unsigned int *expected = opaque;
+    assert(nb_bands == *expected);
+    assert(band < nb_bands);
+    counts[band]++;
+}
+
+/** runs a pool with the given number of threads */
+static void test_pool(unsigned int threads)
+{
+    struct uband_pool *pool = uband_pool_alloc(threads);
+    assert(pool != NULL);
+    assert(uband_pool_threads(pool) >= 1);
+    assert(uband_pool_threads(pool) <= (threads ? threads : 1));
+
+    for (unsigned int run = 0; run < NB_RUNS; run++) {
+        unsigned int nb_bands = run % (NB_BANDS + 1);
+        memset(counts, 0, sizeof(counts));
+        uband_pool_run(pool, nb_bands, process, &nb_bands);
+        for (unsigned int band = 0; band < NB_BANDS; band++)
+            assert(counts[band] == (band < nb_bands ? 1 : 0));
+    }
+    uband_pool_free(pool);
+}
+
+int main(int argc, char **argv)
+{
+    test_pool(0);
+    test_pool(1);
+    test_pool(2);
+    test_pool(4);
+    test_pool(NB_BANDS + 3);
+    uband_pool_free(NULL);
+    return 0;
+}
@@ -48,15 +48,19 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #define UDICT_POOL_DEPTH    0
 #define UREF_POOL_DEPTH     0
 #define UBUF_POOL_DEPTH     0
 #define SAMPLES             1024
+#define SDI_CHANNELS        16
 #define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
 
 static int counter = 0;
+/** size of a sample of one channel in the checked packets */
+static uint8_t check_sample_size = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -113,6 +117,152 @@ static int test_control(struct upipe *upipe, int command, va_list args)
     }
 }
 
+/** @hidden */
+static void test_free(struct upipe *upipe);
+
+/** returns the value of a sample of the input */
+static uint32_t sample_value(size_t i, uint8_t c)
+{
+    return (i * 0x10001 + c * 0x101) ^ 0x80402010;
+}
+
+/** helper phony pipe checking the extracted channels, whose planes are
+ * named after the index of the input channel ('a' for 0) */
+static void check_input(struct upipe *upipe, struct uref *uref,
+                        struct upump **upump_p)
+{
+    assert(uref != NULL);
+    size_t samples;
+    ubase_assert(uref_sound_size(uref, &samples, NULL));
+    assert(samples == SAMPLES);
+    const char *channel = NULL;
+    while (ubase_check(uref_sound_plane_iterate(uref, &channel)) && channel) {
+        const uint8_t *buf;
+        uint8_t c = channel[0] - 'a';
+        ubase_assert(uref_sound_plane_read_uint8_t(uref, channel, 0, -1,
+                                                   &buf));
+        for (size_t i = 0; i < samples; i++) {
+            uint32_t v = sample_value(i, c);
+            assert(!memcmp(buf + i * check_sample_size, &v,
+                           check_sample_size));
+        }
+        uref_sound_plane_unmap(uref, channel, 0, -1);
+    }
+    counter++;
+    uref_free(uref);
+}
+
+/** checks a channel extraction function against the C version */
+static void check_extract(upipe_audio_split_extract extract,
+                          uint8_t sample_size)
+{
+    static const uint8_t channels_list[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24 };
+    for (int k = 0; k < sizeof(channels_list); k++) {
+        uint8_t channels = channels_list[k];
+        for (size_t samples = 0; samples <= 40; samples++) {
+            size_t size = samples * channels * sample_size;
+            uint8_t *in = malloc(size + 1);
+            assert(in != NULL);
+            for (size_t i = 0; i < size; i++)
+                in[i] = i * 7 + samples;
+            uint8_t *outs[channels], *refs[channels];
+            for (uint8_t c = 0; c < channels; c++) {
+                /* leave some channels unused */
+                if (channels > 2 && c % 3 == 1) {
+                    outs[c] = refs[c] = NULL;
+                    continue;
+                }
+                outs[c] = malloc(samples * sample_size + 1);
+                refs[c] = malloc(samples * sample_size + 1);
+                assert(outs[c] != NULL && refs[c] != NULL);
+            }
+            upipe_audio_split_extract_c(refs, in, samples, channels,
+                                        sample_size);
+            extract(outs, in, samples, channels);
+            for (uint8_t c = 0; c < channels; c++) {
+                if (outs[c] == NULL)
+                    continue;
+                assert(!memcmp(outs[c], refs[c], samples * sample_size));
+                free(outs[c]);
+                free(refs[c]);
+            }
+            free(in);
+        }
+    }
+}
+
+/** splits SDI-like interleaved audio into stereo pairs, plus one output
+ * duplicating channels of the first pair */
+static void test_pairs(struct uref_mgr *uref_mgr, struct umem_mgr *umem_mgr,
+                       struct uprobe *logger, const char *def,
+                       uint8_t sample_size)
+{
+    struct upipe_mgr check_mgr = {
+        .refcount = NULL,
+        .upipe_alloc = test_alloc,
+        .upipe_input = check_input,
+        .upipe_control = test_control
+    };
+    struct upipe *sink = upipe_void_alloc(&check_mgr, uprobe_use(logger));
+    assert(sink != NULL);
+
+    struct uref *flow = uref_sound_flow_alloc_def(uref_mgr, def, SDI_CHANNELS,
+                                                  SDI_CHANNELS * sample_size);
+    assert(flow != NULL);
+    ubase_assert(uref_sound_flow_add_plane(flow, "all"));
+    struct ubuf_mgr *sound_mgr = ubuf_mem_mgr_alloc_from_flow_def(
+                 UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, umem_mgr, flow);
+    assert(sound_mgr != NULL);
+    struct upipe *split = upipe_void_alloc(upipe_audio_split_mgr_alloc(),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_DEBUG, "split"));
+    assert(split != NULL);
+    ubase_assert(upipe_set_flow_def(split, flow));
+    uref_free(flow);
+
+    struct upipe *outputs[SDI_CHANNELS / 2 + 1];
+    for (int i = 0; i <= SDI_CHANNELS / 2; i++) {
+        /* the last output takes the first pair, reversed */
+        uint8_t left = i < SDI_CHANNELS / 2 ? 2 * i : 1;
+        uint8_t right = i < SDI_CHANNELS / 2 ? 2 * i + 1 : 0;
+        char l[2] = { 'a' + left, 0 }, r[2] = { 'a' + right, 0 };
+        flow = uref_sound_flow_alloc_def(uref_mgr, "", 2, 0);
+        assert(flow != NULL);
+        ubase_assert(uref_sound_flow_add_plane(flow, l));
+        ubase_assert(uref_sound_flow_add_plane(flow, r));
+        ubase_assert(uref_audio_split_set_orig_index(flow, left, l));
+        ubase_assert(uref_audio_split_set_orig_index(flow, right, r));
+        outputs[i] = upipe_flow_alloc_sub(split,
+                uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_DEBUG,
+                                 "split output"), flow);
+        assert(outputs[i] != NULL);
+        uref_free(flow);
+        ubase_assert(upipe_set_output(outputs[i], sink));
+    }
+
+    struct uref *uref = uref_sound_alloc(uref_mgr, sound_mgr, SAMPLES);
+    assert(uref != NULL);
+    uint8_t *buf;
+    ubase_assert(uref_sound_write_uint8_t(uref, 0, -1, &buf, 1));
+    for (size_t i = 0; i < SAMPLES; i++)
+        for (uint8_t c = 0; c < SDI_CHANNELS; c++) {
+            uint32_t v = sample_value(i, c);
+            memcpy(buf, &v, sample_size);
+            buf += sample_size;
+        }
+    uref_sound_unmap(uref, 0, -1, 1);
+
+    counter = 0;
+    check_sample_size = sample_size;
+    upipe_input(split, uref, NULL);
+    assert(counter == SDI_CHANNELS / 2 + 1);
+
+    upipe_release(split);
+    for (int i = 0; i <= SDI_CHANNELS / 2; i++)
+        upipe_release(outputs[i]);
+    ubuf_mgr_release(sound_mgr);
+    test_free(sink);
+}
+
 /** helper phony pipe */
 static void test_free(struct upipe *upipe)
 {
@@ -226,6 +376,22 @@ int main(int argc, char *argv[])
     test_free(upipe_sink0);
     test_free(upipe_sink1);
 
+    /* channel extraction functions */
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSE2)) {
+        check_extract(upipe_audio_split_extract16_sse2, 2);
+        check_extract(upipe_audio_split_extract32_sse2, 4);
+    }
+#endif
+    check_extract(upipe_audio_split_extract16_c, 2);
+    check_extract(upipe_audio_split_extract32_c, 4);
+
+    /* stereo pairs of 16-channel audio */
+    test_pairs(uref_mgr, umem_mgr, logger, "s16.", 2);
+    test_pairs(uref_mgr, umem_mgr, logger, "s32.", 4);
+    test_pairs(uref_mgr, umem_mgr, logger, "f32.", 4);
+    test_pairs(uref_mgr, umem_mgr, logger, "s24.", 3);
+
     uref_mgr_release(uref_mgr);
     udict_mgr_release(udict_mgr);
     umem_mgr_release(umem_mgr);
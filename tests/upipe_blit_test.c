@@ -60,6 +60,10 @@
 #define UBUF_POOL_DEPTH     0
 #define SUBSIZE             16
 #define BGSIZE              (2 * SUBSIZE)
+#define BGVAL               10
+#define ALPHA_YVAL          200
+#define ALPHA_UVAL          100
+#define ALPHA_VVAL          50
 #define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
 
 /** definition of our uprobe */
@@ -124,6 +128,77 @@ static void check_chroma(struct uref *uref, const char *chroma, uint8_t val)
     uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
 }
 
+/* alpha of the column x of the alpha subpicture */
+static uint8_t alpha_at(int x)
+{
+    return x < BGSIZE / 4 ? 0 : x < BGSIZE / 2 ? 255 : 128;
+}
+
+/* reference alpha blending */
+static uint8_t blend_ref(uint8_t src, uint8_t dest, uint8_t alpha)
+{
+    return (src * alpha + dest * (255 - alpha) + 127) / 255;
+}
+
+/* fill the alpha plane with vertical stripes */
+static void fill_in_alpha(struct uref *uref)
+{
+    size_t hsize, vsize, stride;
+    uint8_t *buffer;
+    ubase_assert(uref_pic_plane_write(uref, "a8", 0, 0, -1, -1, &buffer));
+    ubase_assert(uref_pic_plane_size(uref, "a8", &stride, NULL, NULL, NULL));
+    ubase_assert(uref_pic_size(uref, &hsize, &vsize, NULL));
+    for (int y = 0; y < vsize; y++) {
+        for (int x = 0; x < hsize; x++)
+            buffer[x] = alpha_at(x);
+        buffer += stride;
+    }
+    uref_pic_plane_unmap(uref, "a8", 0, 0, -1, -1);
+}
+
+/* check a chroma blended with the alpha subpicture */
+static void check_chroma_alpha(struct uref *uref, const char *chroma,
+                               uint8_t val)
+{
+    uint8_t hsub, vsub;
+    size_t hsize, vsize, stride;
+    const uint8_t *buffer;
+
+    ubase_assert(uref_pic_plane_read(uref, chroma, 0, 0, -1, -1, &buffer));
+    ubase_assert(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub, NULL));
+    ubase_assert(uref_pic_size(uref, &hsize, &vsize, NULL));
+    hsize /= hsub;
+    vsize /= vsub;
+
+    for (int y = 0; y < vsize; y++) {
+        for (int x = 0; x < hsize; x++)
+            assert(buffer[x] == blend_ref(val, BGVAL, alpha_at(x * hsub)));
+        buffer += stride;
+    }
+
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+}
+
+/* check the alpha blending functions against the reference */
+static void check_blend(upipe_blit_blend blend)
+{
+    uint8_t dest[256], src[256], alpha[256];
+    for (int a = 0; a < 256; a++) {
+        for (int v = 0; v < 256; v++) {
+            for (int i = 0; i < 256; i++) {
+                dest[i] = i;
+                src[i] = v;
+                alpha[i] = a;
+            }
+            /* odd width to exercise the tails */
+            blend(dest, src, alpha, 255);
+            for (int i = 0; i < 255; i++)
+                assert(dest[i] == blend_ref(v, i, a));
+            assert(dest[255] == 255);
+        }
+    }
+}
+
 struct offsets {
    uint64_t loffset;
    uint64_t roffset;
@@ -210,6 +285,18 @@ static void test_input(struct upipe *upipe, struct uref *uref,
             check_chroma(uref, "u8", 0);
             check_chroma(uref, "v8", 0);
             break;
+        case 2:
+        case 3:
+        case 4:
+            check_chroma_alpha(uref, "y8", ALPHA_YVAL);
+            check_chroma_alpha(uref, "u8", ALPHA_UVAL);
+            check_chroma_alpha(uref, "v8", ALPHA_VVAL);
+            break;
+        case 5:
+            check_chroma(uref, "y8", BGVAL);
+            check_chroma(uref, "u8", BGVAL);
+            check_chroma(uref, "v8", BGVAL);
+            break;
         case 1:
             uref_pic_resize(uref, 0, 0, SUBSIZE, SUBSIZE);
             check_chroma(uref, "y8", 1);
@@ -285,6 +372,14 @@ int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
 
+    check_blend(upipe_blit_blend8_c);
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSE2))
+        check_blend(upipe_blit_blend8_sse2);
+    if (ucpu_has(UCPU_AVX2))
+        check_blend(upipe_blit_blend8_avx2);
+#endif
+
     /* uref and mem management */
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
     assert(umem_mgr != NULL);
@@ -372,16 +467,91 @@ int main(int argc, char **argv)
     uref_attr_set_priv(uref, 1);
     upipe_input(blit, uref, NULL);
 
+    /* subpicture with an alpha plane, covering the whole frame */
+    struct ubuf_mgr *yuva_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1, 0, 0, 0, 0, 0, 0);
+    assert(yuva_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(yuva_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(yuva_mgr, "u8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(yuva_mgr, "v8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(yuva_mgr, "a8", 1, 1, 1));
+
+    struct upipe *subpipe4 = upipe_void_alloc_sub(blit,
+            uprobe_pfx_alloc_va(uprobe_use(logger),
+                                UPROBE_LOG_LEVEL, "sub4"));
+    assert(subpipe4);
+    upipe_blit_sub_set_rect(subpipe4, 0, 0, 0, 0);
+    bool cache;
+    ubase_assert(upipe_blit_sub_get_cache(subpipe4, &cache));
+    assert(!cache);
+    ubase_assert(upipe_blit_sub_set_cache(subpipe4, true));
+    ubase_assert(upipe_blit_sub_get_cache(subpipe4, &cache));
+    assert(cache);
+
+    flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "a8"));
+    ubase_assert(uref_pic_flow_set_hsize(flow_def, BGSIZE));
+    ubase_assert(uref_pic_flow_set_vsize(flow_def, BGSIZE));
+
+    struct offsets offsets;
+    memset(&offsets, 0, sizeof(offsets));
+    struct urequest request;
+    urequest_init_flow_format(&request, flow_def, provide_urequest, NULL);
+    urequest_set_opaque(&request, &offsets);
+    upipe_register_request(subpipe4, &request);
+    assert(offsets.flow_format != NULL);
+    upipe_unregister_request(subpipe4, &request);
+    urequest_clean(&request);
+    ubase_assert(uref_pic_flow_check_chroma(offsets.flow_format,
+                                            1, 1, 1, "a8"));
+    ubase_assert(upipe_set_flow_def(subpipe4, offsets.flow_format));
+    uref_free(offsets.flow_format);
+
+    struct uref *sub_uref = uref_pic_alloc(uref_mgr, yuva_mgr,
+                                           BGSIZE, BGSIZE);
+    assert(sub_uref != NULL);
+    fill_in(sub_uref, "y8", ALPHA_YVAL);
+    fill_in(sub_uref, "u8", ALPHA_UVAL);
+    fill_in(sub_uref, "v8", ALPHA_VVAL);
+    fill_in_alpha(sub_uref);
+    upipe_input(subpipe4, uref_dup(sub_uref), NULL);
+
+    for (int i = 2; i <= 5; i++) {
+        uref = uref_pic_alloc(uref_mgr, pic_mgr, BGSIZE, BGSIZE);
+        assert(uref != NULL);
+        uref_pic_set_progressive(uref);
+        fill_in(uref, "y8", BGVAL);
+        fill_in(uref, "u8", BGVAL);
+        fill_in(uref, "v8", BGVAL);
+        uref_attr_set_priv(uref, i);
+        upipe_input(blit, uref, NULL);
+
+        if (i == 2) {
+            /* same subpicture again, its analysis is kept */
+            upipe_input(subpipe4, uref_dup(sub_uref), NULL);
+        } else if (i == 3) {
+            /* the cached subpicture is blitted one last time */
+            ubase_assert(upipe_blit_sub_set_cache(subpipe4, false));
+        }
+    }
+    uref_free(sub_uref);
+
     /* release blit pipe and subpipes */
     upipe_release(subpipe1);
     upipe_release(subpipe2);
     upipe_release(subpipe3);
+    upipe_release(subpipe4);
     upipe_release(blit);
     test_free(test);
 
     /* release managers */
     upipe_mgr_release(upipe_blit_mgr); // no-op
     ubuf_mgr_release(pic_mgr);
+    ubuf_mgr_release(yuva_mgr);
     uref_mgr_release(uref_mgr);
     umem_mgr_release(umem_mgr);
     udict_mgr_release(udict_mgr);
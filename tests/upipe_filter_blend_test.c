@@ -64,6 +64,7 @@
 
 static struct ubuf_mgr *ubuf_mgr;
 static struct uref_mgr *uref_mgr;
+static int nb_checked = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -81,6 +82,114 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** value of a 10-bit test sample */
+static uint16_t sample10(int x, int y, int plane)
+{
+    return (x * 7 + y * 13 + plane * 101 + (x * y) % 5) % 1024;
+}
+
+/** checks a 10-bit planar picture output by the blend pipe */
+static void check_plane10(struct uref *uref, const char *chroma, int plane,
+                          int sub)
+{
+    const uint8_t *buf;
+    size_t stride;
+    ubase_assert(uref_pic_plane_read(uref, chroma, 0, 0, -1, -1, &buf));
+    ubase_assert(uref_pic_plane_size(uref, chroma, &stride, NULL, NULL, NULL));
+    for (int y = 0; y < HEIGHT / sub; y++) {
+        const uint16_t *line = (const uint16_t *)(buf + y * stride);
+        for (int x = 0; x < WIDTH / sub; x++) {
+            uint16_t expected = y == 0 ? sample10(x, y, plane) :
+                (sample10(x, y - 1, plane) + sample10(x, y, plane)) >> 1;
+            assert(line[x] == expected);
+        }
+    }
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    check_plane10(uref, "y10l", 0, 1);
+    check_plane10(uref, "u10l", 1, 2);
+    check_plane10(uref, "v10l", 2, 2);
+    nb_checked++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+#ifdef UCPU_X86
+/** checks a line merging function against the C version */
+static void check_merge(upipe_filter_blend_merge merge,
+                        upipe_filter_blend_merge merge_c)
+{
+    for (size_t bytes = 2; bytes <= 200; bytes += 2) {
+        /* exact allocations so that overflows are caught by checkers */
+        uint8_t *s1 = malloc(bytes);
+        uint8_t *s2 = malloc(bytes);
+        uint8_t *ref = malloc(bytes);
+        uint8_t *out = malloc(bytes);
+        assert(s1 != NULL && s2 != NULL && ref != NULL && out != NULL);
+        for (size_t i = 0; i < bytes; i++) {
+            s1[i] = rand();
+            s2[i] = rand();
+        }
+        merge_c(ref, s1, s2, bytes);
+        merge(out, s1, s2, bytes);
+        assert(!memcmp(ref, out, bytes));
+        free(s1);
+        free(s2);
+        free(ref);
+        free(out);
+    }
+}
+#endif
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s (%s)\n", __DATE__, __TIME__, __FILE__);
@@ -153,8 +262,79 @@ int main(int argc, char **argv)
         upipe_input(filter_blend, pic, NULL);
     }
 
+    upipe_release(filter_blend);
+
+#ifdef UCPU_X86
+    /* line merging functions */
+    if (ucpu_has(UCPU_SSE2)) {
+        check_merge(upipe_filter_blend_merge8_sse2,
+                    upipe_filter_blend_merge8_c);
+        check_merge(upipe_filter_blend_merge16_sse2,
+                    upipe_filter_blend_merge16_c);
+    }
+    if (ucpu_has(UCPU_AVX2)) {
+        check_merge(upipe_filter_blend_merge8_avx2,
+                    upipe_filter_blend_merge8_c);
+        check_merge(upipe_filter_blend_merge16_avx2,
+                    upipe_filter_blend_merge16_c);
+    }
+#endif
+
+    /* yuv420p10le in bands */
+    struct ubuf_mgr *ubuf10_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1,
+            UBUF_PREPEND, UBUF_APPEND, UBUF_PREPEND, UBUF_APPEND,
+            UBUF_ALIGN, UBUF_ALIGN_HOFFSET);
+    assert(ubuf10_mgr);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf10_mgr, "y10l", 1, 1, 2));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf10_mgr, "u10l", 2, 2, 2));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf10_mgr, "v10l", 2, 2, 2));
+
+    uref = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(uref);
+    ubase_assert(uref_pic_flow_add_plane(uref, 1, 1, 2, "y10l"));
+    ubase_assert(uref_pic_flow_add_plane(uref, 2, 2, 2, "u10l"));
+    ubase_assert(uref_pic_flow_add_plane(uref, 2, 2, 2, "v10l"));
+
+    struct upipe *test = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(test);
+    filter_blend = upipe_void_alloc(blend_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "blend"));
+    assert(filter_blend);
+    unsigned int threads;
+    ubase_assert(upipe_filter_blend_get_threads(filter_blend, &threads));
+    assert(threads == 1);
+    ubase_nassert(upipe_filter_blend_set_threads(filter_blend, 0));
+    ubase_assert(upipe_filter_blend_set_threads(filter_blend, 4));
+    ubase_assert(upipe_filter_blend_get_threads(filter_blend, &threads));
+    assert(threads == 4);
+    ubase_assert(upipe_set_flow_def(filter_blend, uref));
+    ubase_assert(upipe_set_output(filter_blend, test));
+    uref_free(uref);
+
+    const char *chromas[] = { "y10l", "u10l", "v10l" };
+    pic = uref_pic_alloc(uref_mgr, ubuf10_mgr, WIDTH, HEIGHT);
+    assert(pic);
+    for (int plane = 0; plane < 3; plane++) {
+        int sub = plane ? 2 : 1;
+        ubase_assert(uref_pic_plane_write(pic, chromas[plane],
+                                          0, 0, -1, -1, &buf));
+        ubase_assert(uref_pic_plane_size(pic, chromas[plane], &stride,
+                                         NULL, NULL, NULL));
+        for (y = 0; y < HEIGHT / sub; y++) {
+            uint16_t *line = (uint16_t *)(buf + y * stride);
+            for (x = 0; x < WIDTH / sub; x++)
+                line[x] = sample10(x, y, plane);
+        }
+        uref_pic_plane_unmap(pic, chromas[plane], 0, 0, -1, -1);
+    }
+    upipe_input(filter_blend, pic, NULL);
+    assert(nb_checked == 1);
+
     // Clean - release
     upipe_release(filter_blend);
+    test_free(test);
+    ubuf_mgr_release(ubuf10_mgr);
 
     upipe_mgr_release(blend_mgr); // noop
     upipe_mgr_release(null_mgr); // noop
@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for pixel format conversion pipes
+ *
+ * The SIMD line functions are checked against the C versions on random
+ * lines, then pictures are sent through the pipe between planar,
+ * semi-planar and high bit depth formats.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-filters/upipe_filter_convert.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    5
+#define UREF_POOL_DEPTH     5
+#define UBUF_POOL_DEPTH     5
+#define UBUF_ALIGN          32
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+#define WIDTH               70
+#define HEIGHT              8
+
+/** description of a plane of a test format */
+struct plane {
+    const char *chroma;
+    uint8_t hsub;
+    uint8_t vsub;
+    uint8_t macropixel_size;
+};
+
+/** description of a test format */
+struct format {
+    uint8_t nb_planes;
+    struct plane planes[3];
+};
+
+static const struct format i420 = { 3, {
+    { "y8", 1, 1, 1 }, { "u8", 2, 2, 1 }, { "v8", 2, 2, 1 } } };
+static const struct format yv12 = { 3, {
+    { "y8", 1, 1, 1 }, { "v8", 2, 2, 1 }, { "u8", 2, 2, 1 } } };
+static const struct format nv12 = { 2, {
+    { "y8", 1, 1, 1 }, { "u8v8", 2, 2, 2 } } };
+static const struct format nv21 = { 2, {
+    { "y8", 1, 1, 1 }, { "v8u8", 2, 2, 2 } } };
+static const struct format i420p10 = { 3, {
+    { "y10l", 1, 1, 2 }, { "u10l", 2, 2, 2 }, { "v10l", 2, 2, 2 } } };
+static const struct format p010 = { 2, {
+    { "y10l", 1, 1, 2 }, { "u10lv10l", 2, 2, 4 } } };
+static const struct format p010_swapped = { 2, {
+    { "y10l", 1, 1, 2 }, { "v10lu10l", 2, 2, 4 } } };
+static const struct format i422 = { 3, {
+    { "y8", 1, 1, 1 }, { "u8", 2, 1, 1 }, { "v8", 2, 1, 1 } } };
+static const struct format rgb = { 1, {
+    { "r8g8b8", 1, 1, 3 } } };
+
+/** format expected by the test pipe */
+static const struct format *expected;
+/** bit depth of the input pictures */
+static unsigned int input_depth;
+/** number of received pictures */
+static int nb_received = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** value of a test sample */
+static unsigned int sample(char comp, int x, int y, unsigned int depth)
+{
+    return (x * 37 + y * 1031 + comp * 101 + x * y) & ((1 << depth) - 1);
+}
+
+/** value of a test sample after conversion */
+static unsigned int converted(char comp, int x, int y, unsigned int depth)
+{
+    unsigned int v = sample(comp, x, y, input_depth);
+    if (depth > input_depth)
+        return v << (depth - input_depth);
+    if (depth < input_depth) {
+        unsigned int shift = input_depth - depth;
+        v = (v + (1 << (shift - 1))) >> shift;
+        return v > 255 ? 255 : v;
+    }
+    return v;
+}
+
+/** fills in or checks the planes of a picture */
+static void do_pic(struct uref *uref, const struct format *format, bool fill)
+{
+    for (uint8_t p = 0; p < format->nb_planes; p++) {
+        const struct plane *plane = &format->planes[p];
+        char comps[2];
+        unsigned int nb = 0, depth = 0;
+        for (const char *c = plane->chroma; *c; c++)
+            if (*c >= 'a' && *c <= 'z' && *c != 'l')
+                comps[nb++] = *c;
+            else if (*c >= '0' && *c <= '9' && nb == 1)
+                depth = depth * 10 + *c - '0';
+        size_t size = depth > 8 ? 2 : 1;
+
+        uint8_t *buf;
+        size_t stride;
+        if (fill)
+            ubase_assert(uref_pic_plane_write(uref, plane->chroma,
+                                              0, 0, -1, -1, &buf));
+        else
+            ubase_assert(uref_pic_plane_read(uref, plane->chroma, 0, 0, -1, -1,
+                                             (const uint8_t **)&buf));
+        ubase_assert(uref_pic_plane_size(uref, plane->chroma, &stride,
+                                         NULL, NULL, NULL));
+        for (int y = 0; y < HEIGHT / plane->vsub; y++) {
+            for (int x = 0; x < WIDTH / plane->hsub; x++) {
+                for (unsigned int c = 0; c < nb; c++) {
+                    uint8_t *s = buf + y * stride + (x * nb + c) * size;
+                    unsigned int v;
+                    if (fill) {
+                        v = sample(comps[c], x, y, depth);
+                        if (size == 2) {
+                            uint16_t w = v;
+                            memcpy(s, &w, 2);
+                        } else
+                            *s = v;
+                    } else {
+                        if (size == 2) {
+                            uint16_t w;
+                            memcpy(&w, s, 2);
+                            v = w;
+                        } else
+                            v = *s;
+                        assert(v == converted(comps[c], x, y, depth));
+                    }
+                }
+            }
+        }
+        uref_pic_plane_unmap(uref, plane->chroma, 0, 0, -1, -1);
+    }
+}
+
+/** allocates a flow definition for a format */
+static struct uref *alloc_flow_def(struct uref_mgr *uref_mgr,
+                                   const struct format *format)
+{
+    struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    for (uint8_t p = 0; p < format->nb_planes; p++) {
+        const struct plane *plane = &format->planes[p];
+        ubase_assert(uref_pic_flow_add_plane(flow_def, plane->hsub,
+                                             plane->vsub,
+                                             plane->macropixel_size,
+                                             plane->chroma));
+    }
+    return flow_def;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    size_t hsize, vsize;
+    ubase_assert(uref_pic_size(uref, &hsize, &vsize, NULL));
+    assert(hsize == WIDTH);
+    assert(vsize == HEIGHT);
+    do_pic(uref, expected, false);
+    nb_received++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            uint8_t planes;
+            ubase_assert(uref_pic_flow_get_planes(flow_def, &planes));
+            assert(planes == expected->nb_planes);
+            for (uint8_t p = 0; p < planes; p++)
+                ubase_assert(uref_pic_flow_check_chroma(flow_def,
+                            expected->planes[p].hsub,
+                            expected->planes[p].vsub,
+                            expected->planes[p].macropixel_size,
+                            expected->planes[p].chroma));
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** fills a buffer with random octets */
+static void randomize(uint8_t *buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        buf[i] = rand();
+}
+
+#ifdef UCPU_X86
+/** checks the line functions of a set against the C versions */
+static void check_lines(upipe_filter_convert_interleave interleave8,
+                        upipe_filter_convert_interleave interleave16,
+                        upipe_filter_convert_deinterleave deinterleave8,
+                        upipe_filter_convert_deinterleave deinterleave16,
+                        upipe_filter_convert_swap swap8,
+                        upipe_filter_convert_swap swap16,
+                        upipe_filter_convert_depth expand,
+                        upipe_filter_convert_depth reduce)
+{
+    for (size_t w = 1; w <= 100; w++) {
+        /* exact allocations so that overflows are caught by checkers */
+        uint8_t *src1 = malloc(w * 4);
+        uint8_t *src2 = malloc(w * 2);
+        uint8_t *ref1 = malloc(w * 4);
+        uint8_t *ref2 = malloc(w * 2);
+        uint8_t *out1 = malloc(w * 4);
+        uint8_t *out2 = malloc(w * 2);
+        assert(src1 != NULL && src2 != NULL && ref1 != NULL &&
+               ref2 != NULL && out1 != NULL && out2 != NULL);
+        randomize(src1, w * 4);
+        randomize(src2, w * 2);
+
+        for (size_t size = 1; size <= 2; size++) {
+            (size == 1 ? upipe_filter_convert_interleave8_c :
+                         upipe_filter_convert_interleave16_c)
+                (ref1, src1, src2, w);
+            (size == 1 ? interleave8 : interleave16)(out1, src1, src2, w);
+            assert(!memcmp(ref1, out1, w * 2 * size));
+
+            (size == 1 ? upipe_filter_convert_deinterleave8_c :
+                         upipe_filter_convert_deinterleave16_c)
+                (ref1, ref2, src1, w);
+            (size == 1 ? deinterleave8 : deinterleave16)(out1, out2, src1, w);
+            assert(!memcmp(ref1, out1, w * size));
+            assert(!memcmp(ref2, out2, w * size));
+
+            (size == 1 ? upipe_filter_convert_swap8_c :
+                         upipe_filter_convert_swap16_c)(ref1, src1, w);
+            (size == 1 ? swap8 : swap16)(out1, src1, w);
+            assert(!memcmp(ref1, out1, w * 2 * size));
+        }
+
+        for (unsigned int shift = 1; shift <= 8; shift++) {
+            upipe_filter_convert_expand_c(ref1, src1, w, shift);
+            expand(out1, src1, w, shift);
+            assert(!memcmp(ref1, out1, w * 2));
+
+            upipe_filter_convert_reduce_c(ref1, src1, w, shift);
+            reduce(out1, src1, w, shift);
+            assert(!memcmp(ref1, out1, w));
+        }
+
+        free(src1);
+        free(src2);
+        free(ref1);
+        free(ref2);
+        free(out1);
+        free(out2);
+    }
+}
+#endif
+
+/** checks the C line functions on known values */
+static void check_lines_c(void)
+{
+    uint8_t a[4] = { 1, 2, 3, 4 }, b[4] = { 5, 6, 7, 8 };
+    uint8_t out[8], out2[4];
+    upipe_filter_convert_interleave8_c(out, a, b, 2);
+    assert(out[0] == 1 && out[1] == 5 && out[2] == 2 && out[3] == 6);
+    upipe_filter_convert_deinterleave8_c(out, out2, a, 2);
+    assert(out[0] == 1 && out[1] == 3 && out2[0] == 2 && out2[1] == 4);
+    upipe_filter_convert_swap8_c(out, a, 2);
+    assert(out[0] == 2 && out[1] == 1 && out[2] == 4 && out[3] == 3);
+
+    uint16_t w[2] = { 1023, 2 };
+    upipe_filter_convert_reduce_c(out, (const uint8_t *)w, 2, 2);
+    assert(out[0] == 255 && out[1] == 1);
+    uint8_t s[2] = { 255, 1 };
+    upipe_filter_convert_expand_c((uint8_t *)w, s, 2, 2);
+    assert(w[0] == 1020 && w[1] == 4);
+}
+
+/** converts a picture from a format to another */
+static void run(struct uref_mgr *uref_mgr, struct umem_mgr *umem_mgr,
+                struct uprobe *logger, const struct format *in,
+                unsigned int in_depth, const struct format *out)
+{
+    struct ubuf_mgr *ubuf_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1, 0, 0, 0, 0, UBUF_ALIGN, 0);
+    assert(ubuf_mgr != NULL);
+    for (uint8_t p = 0; p < in->nb_planes; p++)
+        ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr,
+                    in->planes[p].chroma, in->planes[p].hsub,
+                    in->planes[p].vsub, in->planes[p].macropixel_size));
+    struct uref *flow_def = alloc_flow_def(uref_mgr, in);
+    struct uref *flow_def_out = alloc_flow_def(uref_mgr, out);
+    ubase_assert(upipe_filter_convert_mgr_check(
+                upipe_filter_convert_mgr_alloc(), flow_def, flow_def_out));
+
+    struct upipe *test = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(test != NULL);
+    struct upipe *convert = upipe_flow_alloc(upipe_filter_convert_mgr_alloc(),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "convert"),
+            flow_def_out);
+    assert(convert != NULL);
+    uref_free(flow_def_out);
+    expected = out;
+    input_depth = in_depth;
+    ubase_assert(upipe_set_output(convert, test));
+    ubase_assert(upipe_set_flow_def(convert, flow_def));
+    uref_free(flow_def);
+
+    nb_received = 0;
+    struct uref *pic = uref_pic_alloc(uref_mgr, ubuf_mgr, WIDTH, HEIGHT);
+    assert(pic != NULL);
+    do_pic(pic, in, true);
+    upipe_input(convert, pic, NULL);
+    assert(nb_received == 1);
+
+    upipe_release(convert);
+    test_free(test);
+    ubuf_mgr_release(ubuf_mgr);
+}
+
+/** checks that a conversion is refused */
+static void refuse(struct uref_mgr *uref_mgr, const struct format *in,
+                   const struct format *out)
+{
+    struct uref *flow_def = alloc_flow_def(uref_mgr, in);
+    struct uref *flow_def_out = alloc_flow_def(uref_mgr, out);
+    ubase_nassert(upipe_filter_convert_mgr_check(
+                upipe_filter_convert_mgr_alloc(), flow_def, flow_def_out));
+    uref_free(flow_def);
+    uref_free(flow_def_out);
+}
+
+/** checks that a conversion changing colours is refused */
+static void refuse_colour(struct uref_mgr *uref_mgr)
+{
+    struct upipe_mgr *mgr = upipe_filter_convert_mgr_alloc();
+    struct uref *flow_def = alloc_flow_def(uref_mgr, &i420);
+    struct uref *flow_def_out = alloc_flow_def(uref_mgr, &nv12);
+    ubase_assert(uref_pic_flow_set_matrix_coefficients(flow_def, "bt709"));
+    ubase_assert(uref_pic_flow_set_matrix_coefficients(flow_def_out,
+                                                       "bt470bg"));
+    ubase_nassert(upipe_filter_convert_mgr_check(mgr, flow_def, flow_def_out));
+
+    ubase_assert(uref_pic_flow_set_matrix_coefficients(flow_def_out,
+                                                       "bt709"));
+    ubase_assert(upipe_filter_convert_mgr_check(mgr, flow_def, flow_def_out));
+
+    ubase_assert(uref_pic_flow_set_full_range(flow_def_out));
+    ubase_nassert(upipe_filter_convert_mgr_check(mgr, flow_def, flow_def_out));
+
+    ubase_assert(uref_pic_flow_set_full_range(flow_def));
+    ubase_assert(upipe_filter_convert_mgr_check(mgr, flow_def, flow_def_out));
+    uref_free(flow_def);
+    uref_free(flow_def_out);
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s (%s)\n", __DATE__, __TIME__, __FILE__);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    check_lines_c();
+#ifdef UCPU_X86
+#define CHECK_LINES(suffix)                                                 \
+    check_lines(upipe_filter_convert_interleave8_##suffix,                  \
+                upipe_filter_convert_interleave16_##suffix,                 \
+                upipe_filter_convert_deinterleave8_##suffix,                \
+                upipe_filter_convert_deinterleave16_##suffix,               \
+                upipe_filter_convert_swap8_##suffix,                        \
+                upipe_filter_convert_swap16_##suffix,                       \
+                upipe_filter_convert_expand_##suffix,                       \
+                upipe_filter_convert_reduce_##suffix);
+    if (ucpu_has(UCPU_SSE2))
+        CHECK_LINES(sse2)
+    if (ucpu_has(UCPU_AVX2))
+        CHECK_LINES(avx2)
+#undef CHECK_LINES
+#endif
+
+    run(uref_mgr, umem_mgr, logger, &i420, 8, &nv12);
+    run(uref_mgr, umem_mgr, logger, &nv12, 8, &nv21);
+    run(uref_mgr, umem_mgr, logger, &nv21, 8, &i420);
+    run(uref_mgr, umem_mgr, logger, &i420, 8, &yv12);
+    run(uref_mgr, umem_mgr, logger, &i420, 8, &i420p10);
+    run(uref_mgr, umem_mgr, logger, &i420p10, 10, &i420);
+    run(uref_mgr, umem_mgr, logger, &i420p10, 10, &p010);
+    run(uref_mgr, umem_mgr, logger, &p010, 10, &p010_swapped);
+    run(uref_mgr, umem_mgr, logger, &p010_swapped, 10, &i420p10);
+
+    refuse(uref_mgr, &i420, &p010);
+    refuse(uref_mgr, &i420, &i422);
+    refuse(uref_mgr, &i420, &rgb);
+    refuse(uref_mgr, &rgb, &i420);
+    refuse_colour(uref_mgr);
+
+    uref_mgr_release(uref_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
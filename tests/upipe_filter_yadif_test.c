@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for yadif deinterlace filter pipes
+ *
+ * The SIMD line functions are checked against the C versions on random
+ * lines, and still pictures without vertical detail, which yadif must
+ * leave untouched, are sent through the pipe in both output modes.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-filters/upipe_filter_yadif.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    5
+#define UREF_POOL_DEPTH     5
+#define UBUF_POOL_DEPTH     5
+#define UBUF_ALIGN          32
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+#define WIDTH               720
+#define HEIGHT              576
+#define NB_PICS             3
+#define DURATION            (UCLOCK_FREQ / 25)
+
+/** true for 10-bit 4:2:2 pictures, false for 8-bit 4:2:0 */
+static bool wide;
+/** number of received pictures */
+static int nb_received = 0;
+/** expected pts of the next picture */
+static uint64_t next_pts;
+/** expected duration of the pictures */
+static uint64_t duration;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** value of a test sample, without vertical detail */
+static uint16_t sample(int x, int plane)
+{
+    return (x * 7 + plane * 101 + x % 5) % (wide ? 1024 : 256);
+}
+
+/** fills in or checks a plane */
+static void do_plane(struct uref *uref, const char *chroma, int plane,
+                     int hsub, int vsub, bool fill)
+{
+    uint8_t *buf;
+    size_t stride;
+    if (fill)
+        ubase_assert(uref_pic_plane_write(uref, chroma, 0, 0, -1, -1, &buf));
+    else
+        ubase_assert(uref_pic_plane_read(uref, chroma, 0, 0, -1, -1,
+                                         (const uint8_t **)&buf));
+    ubase_assert(uref_pic_plane_size(uref, chroma, &stride, NULL, NULL, NULL));
+    for (int y = 0; y < HEIGHT / vsub; y++) {
+        for (int x = 0; x < WIDTH / hsub; x++) {
+            if (wide) {
+                uint16_t *line = (uint16_t *)(buf + y * stride);
+                if (fill)
+                    line[x] = sample(x, plane);
+                else
+                    assert(line[x] == sample(x, plane));
+            } else {
+                uint8_t *line = buf + y * stride;
+                if (fill)
+                    line[x] = sample(x, plane);
+                else
+                    assert(line[x] == sample(x, plane));
+            }
+        }
+    }
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+}
+
+/** fills in or checks a picture */
+static void do_pic(struct uref *uref, bool fill)
+{
+    if (wide) {
+        do_plane(uref, "y10l", 0, 1, 1, fill);
+        do_plane(uref, "u10l", 1, 2, 1, fill);
+        do_plane(uref, "v10l", 2, 2, 1, fill);
+    } else {
+        do_plane(uref, "y8", 0, 1, 1, fill);
+        do_plane(uref, "u8", 1, 2, 2, fill);
+        do_plane(uref, "v8", 2, 2, 2, fill);
+    }
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    uint64_t pts, dur;
+    ubase_assert(uref_pic_get_progressive(uref));
+    ubase_nassert(uref_pic_get_tff(uref));
+    ubase_assert(uref_clock_get_pts_prog(uref, &pts));
+    ubase_assert(uref_clock_get_duration(uref, &dur));
+    assert(pts == next_pts);
+    assert(dur == duration);
+    next_pts += duration;
+    do_pic(uref, false);
+    nb_received++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+#ifdef UCPU_X86
+/** checks a line function against the C version */
+static void check_line(upipe_filter_yadif_line line,
+                       upipe_filter_yadif_line line_c, bool line_wide)
+{
+    size_t size = line_wide ? 2 : 1;
+    for (size_t w = 1; w <= 100; w++) {
+        size_t stride = w * size;
+        /* exact allocations so that overflows are caught by checkers */
+        uint8_t *prev = malloc(stride * 5);
+        uint8_t *cur = malloc(stride * 5);
+        uint8_t *next = malloc(stride * 5);
+        uint8_t *ref = malloc(stride);
+        uint8_t *out = malloc(stride);
+        assert(prev != NULL && cur != NULL && next != NULL &&
+               ref != NULL && out != NULL);
+        for (size_t i = 0; i < stride * 5; i++) {
+            cur[i] = rand();
+            /* some still samples */
+            prev[i] = rand() % 4 ? rand() : cur[i];
+            next[i] = rand() % 4 ? rand() : cur[i];
+        }
+        if (line_wide)
+            /* 10-bit samples */
+            for (size_t i = 1; i < stride * 5; i += 2) {
+                prev[i] &= 3;
+                cur[i] &= 3;
+                next[i] &= 3;
+            }
+
+        for (int parity = 0; parity < 2; parity++) {
+            for (int check = 0; check < 2; check++) {
+                line_c(ref, prev + 2 * stride, cur + 2 * stride,
+                       next + 2 * stride, w, stride, -stride, parity, check);
+                line(out, prev + 2 * stride, cur + 2 * stride,
+                     next + 2 * stride, w, stride, -stride, parity, check);
+                assert(!memcmp(ref, out, stride));
+            }
+        }
+        free(prev);
+        free(cur);
+        free(next);
+        free(ref);
+        free(out);
+    }
+}
+#endif
+
+/** sends pictures through a yadif pipe */
+static void run(struct uref_mgr *uref_mgr, struct umem_mgr *umem_mgr,
+                struct uprobe *logger, enum upipe_filter_yadif_mode mode,
+                unsigned int threads)
+{
+    struct ubuf_mgr *ubuf_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1, 0, 0, 0, 0, UBUF_ALIGN, 0);
+    assert(ubuf_mgr != NULL);
+    struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    if (wide) {
+        ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "y10l", 1, 1, 2));
+        ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "u10l", 2, 1, 2));
+        ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "v10l", 2, 1, 2));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 2, "y10l"));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 2, "u10l"));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 2, "v10l"));
+    } else {
+        ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "y8", 1, 1, 1));
+        ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "u8", 2, 2, 1));
+        ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "v8", 2, 2, 1));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
+    }
+    struct urational fps = { .num = 25, .den = 1 };
+    ubase_assert(uref_pic_flow_set_fps(flow_def, fps));
+
+    struct upipe *test = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(test != NULL);
+    struct upipe *yadif = upipe_void_alloc(upipe_filter_yadif_mgr_alloc(),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "yadif"));
+    assert(yadif != NULL);
+    ubase_assert(upipe_filter_yadif_set_mode(yadif, mode));
+    ubase_assert(upipe_filter_yadif_set_threads(yadif, threads));
+    ubase_assert(upipe_set_flow_def(yadif, flow_def));
+    ubase_assert(upipe_set_output(yadif, test));
+    uref_free(flow_def);
+
+    struct uref *flow_def_out;
+    ubase_assert(upipe_get_flow_def(yadif, &flow_def_out));
+    ubase_assert(uref_pic_flow_get_fps(flow_def_out, &fps));
+    assert(fps.num == (mode == UPIPE_FILTER_YADIF_MODE_FIELD ? 50 : 25));
+    assert(fps.den == 1);
+
+    nb_received = 0;
+    next_pts = UCLOCK_FREQ;
+    duration = mode == UPIPE_FILTER_YADIF_MODE_FIELD ?
+               DURATION / 2 : DURATION;
+    for (int i = 0; i < NB_PICS; i++) {
+        struct uref *pic = uref_pic_alloc(uref_mgr, ubuf_mgr, WIDTH, HEIGHT);
+        assert(pic != NULL);
+        do_pic(pic, true);
+        uref_pic_set_tff(pic);
+        uref_clock_set_pts_prog(pic, UCLOCK_FREQ + i * DURATION);
+        uref_clock_set_duration(pic, DURATION);
+        upipe_input(yadif, pic, NULL);
+        /* the current picture is output with the next one */
+        assert(nb_received == (mode == UPIPE_FILTER_YADIF_MODE_FIELD ?
+                               2 * i : i));
+    }
+    ubase_assert(upipe_flush(yadif));
+    assert(nb_received == (mode == UPIPE_FILTER_YADIF_MODE_FIELD ?
+                           2 * NB_PICS : NB_PICS));
+
+    upipe_release(yadif);
+    test_free(test);
+    ubuf_mgr_release(ubuf_mgr);
+}
+
+int main(int argc, char **argv)
+{
+    printf("Compiled %s %s (%s)\n", __DATE__, __TIME__, __FILE__);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSE2)) {
+        check_line(upipe_filter_yadif_line8_sse2,
+                   upipe_filter_yadif_line8_c, false);
+        check_line(upipe_filter_yadif_line16_sse2,
+                   upipe_filter_yadif_line16_c, true);
+    }
+    if (ucpu_has(UCPU_AVX2)) {
+        check_line(upipe_filter_yadif_line8_avx2,
+                   upipe_filter_yadif_line8_c, false);
+        check_line(upipe_filter_yadif_line16_avx2,
+                   upipe_filter_yadif_line16_c, true);
+    }
+#endif
+
+    wide = false;
+    run(uref_mgr, umem_mgr, logger, UPIPE_FILTER_YADIF_MODE_FRAME, 1);
+    wide = true;
+    run(uref_mgr, umem_mgr, logger, UPIPE_FILTER_YADIF_MODE_FIELD, 4);
+
+    uref_mgr_release(uref_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -52,6 +52,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <string.h>
 #include <arpa/inet.h>
 #include <assert.h>
 
@@ -63,7 +64,11 @@
 #define PACKETS_NUM 45
 #define PACKET_SIZE 524
 
+#define SEGMENTS_SIZE 24
+
 static unsigned int nb_packets = 0;
+/** expected content of packets of 24- or 32-bit words */
+static uint8_t expected[SEGMENTS_SIZE];
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -103,6 +108,13 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     ubase_assert(uref_block_size(uref, &size));
     upipe_dbg_va(upipe, "received packet of size %zu", size);
 
+    if (size == SEGMENTS_SIZE) {
+        uint8_t buf[SEGMENTS_SIZE];
+        ubase_assert(uref_block_extract(uref, 0, size, buf));
+        assert(!memcmp(buf, expected, size));
+        size = 0;
+    }
+
     while (size > 0) {
         ubase_assert(uref_block_read(uref, pos, &len, &buffer));
         pos += len;
@@ -137,6 +149,62 @@ static void test_free(struct upipe *upipe)
     free(upipe);
 }
 
+/** checks a swapping function against the C version */
+static void check_swap(upipe_htons_swap swap, upipe_htons_swap swap_c,
+                       unsigned int word_size)
+{
+    for (size_t words = 0; words <= 100; words++) {
+        size_t size = words * word_size;
+        uint8_t *buf = malloc(size + 1);
+        uint8_t *ref = malloc(size + 1);
+        assert(buf != NULL && ref != NULL);
+        for (size_t i = 0; i < size; i++)
+            buf[i] = ref[i] = i * 37 + words;
+        swap_c(ref, words);
+        swap(buf, words);
+        assert(!memcmp(buf, ref, size));
+        free(buf);
+        free(ref);
+    }
+}
+
+/** sends a packet of two segments to the pipe, and checks its words were
+ * swapped */
+static void send_segments(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                          struct ubuf_mgr *ubuf_mgr, unsigned int word_size,
+                          int first_size)
+{
+    uint8_t src[SEGMENTS_SIZE];
+    for (int i = 0; i < SEGMENTS_SIZE; i++)
+        src[i] = i;
+    for (int i = 0; i < SEGMENTS_SIZE; i += word_size)
+        for (int j = 0; j < word_size; j++)
+            expected[i + j] = src[i + word_size - 1 - j];
+
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, first_size);
+    assert(uref != NULL);
+    struct ubuf *ubuf = ubuf_block_alloc(ubuf_mgr,
+                                         SEGMENTS_SIZE - first_size);
+    assert(ubuf != NULL);
+    ubase_assert(uref_block_append(uref, ubuf));
+    int offset = 0;
+    while (offset < SEGMENTS_SIZE) {
+        int size = -1;
+        uint8_t *buffer;
+        ubase_assert(uref_block_write(uref, offset, &size, &buffer));
+        memcpy(buffer, src + offset, size);
+        uref_block_unmap(uref, offset);
+        offset += size;
+    }
+
+    ubase_assert(upipe_htons_set_word_size(upipe, word_size));
+    unsigned int word_size_get;
+    ubase_assert(upipe_htons_get_word_size(upipe, &word_size_get));
+    assert(word_size_get == word_size);
+    nb_packets++;
+    upipe_input(upipe, uref, NULL);
+}
+
 /** helper phony pipe */
 static struct upipe_mgr htons_test_mgr = {
     .refcount = NULL,
@@ -147,6 +215,27 @@ static struct upipe_mgr htons_test_mgr = {
 
 int main(int argc, char *argv[])
 {
+    /* swapping functions */
+    uint8_t words[4] = { 1, 2, 3, 4 };
+    upipe_htons_swap16_c(words, 2);
+    assert(words[0] == 2 && words[1] == 1 && words[2] == 4 && words[3] == 3);
+    upipe_htons_swap24_c(words, 1);
+    assert(words[0] == 4 && words[1] == 1 && words[2] == 2 && words[3] == 3);
+    upipe_htons_swap32_c(words, 1);
+    assert(words[0] == 3 && words[1] == 2 && words[2] == 1 && words[3] == 4);
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSSE3)) {
+        check_swap(upipe_htons_swap16_ssse3, upipe_htons_swap16_c, 2);
+        check_swap(upipe_htons_swap24_ssse3, upipe_htons_swap24_c, 3);
+        check_swap(upipe_htons_swap32_ssse3, upipe_htons_swap32_c, 4);
+    }
+    if (ucpu_has(UCPU_AVX2)) {
+        check_swap(upipe_htons_swap16_avx2, upipe_htons_swap16_c, 2);
+        check_swap(upipe_htons_swap24_avx2, upipe_htons_swap24_c, 3);
+        check_swap(upipe_htons_swap32_avx2, upipe_htons_swap32_c, 4);
+    }
+#endif
+
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
     assert(umem_mgr != NULL);
     struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
@@ -201,7 +290,16 @@ int main(int argc, char *argv[])
         uref_block_unmap(uref, 0);
         upipe_input(upipe_htons, uref, NULL);
     }
-    /* TODO test segmented, shared, unaligned ubufs */
+
+#ifndef UPIPE_WORDS_BIGENDIAN
+    /* segments ending in the middle of a word, and on a word boundary */
+    send_segments(upipe_htons, uref_mgr, ubuf_mgr, 3, 7);
+    send_segments(upipe_htons, uref_mgr, ubuf_mgr, 3, 12);
+    send_segments(upipe_htons, uref_mgr, ubuf_mgr, 4, 7);
+    send_segments(upipe_htons, uref_mgr, ubuf_mgr, 4, 12);
+    send_segments(upipe_htons, uref_mgr, ubuf_mgr, 2, 11);
+    ubase_nassert(upipe_htons_set_word_size(upipe_htons, 5));
+#endif
 
     /* flush */
     upipe_release(upipe_htons);
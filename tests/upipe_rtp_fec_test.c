@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for RTP FEC module (SMPTE 2022-1)
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_rtp_fec.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define SIZE                1316
+#define SHORT_SIZE          188
+#define COLUMNS             5
+#define ROWS                4
+#define NB_MATRICES         6
+#define NB_PACKETS          (COLUMNS * ROWS * NB_MATRICES)
+#define FEC_HEADER_SIZE     16
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *block_mgr;
+static unsigned int nb_packets = 0;
+static int last_seqnum = -1;
+static uint16_t fec_seqnum = 0;
+
+/** returns the payload size of a media packet */
+static unsigned int payload_size(uint16_t seqnum)
+{
+    return seqnum == 22 ? SHORT_SIZE : SIZE;
+}
+
+/** returns true if the media packet is lost on the network */
+static bool is_lost(uint16_t seqnum)
+{
+    /* 7 is recovered by its row, 22 and 23 by their columns, and the
+     * square 41 42 46 47 cannot be recovered */
+    return seqnum == 7 || seqnum == 22 || seqnum == 23 || seqnum == 41 ||
+           seqnum == 42 || seqnum == 46 || seqnum == 47;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    const uint8_t *buffer;
+    int read_size = -1;
+    ubase_assert(uref_block_read(uref, 0, &read_size, &buffer));
+    assert(read_size == size);
+    assert(rtp_check_hdr(buffer));
+    uint16_t seqnum = rtp_get_seqnum(buffer);
+    upipe_dbg_va(upipe, "received %u", seqnum);
+    assert(rtp_get_type(buffer) == RTP_TYPE_TS);
+    assert(rtp_get_timestamp(buffer) == seqnum * 100);
+    assert(size == RTP_HEADER_SIZE + payload_size(seqnum));
+    for (unsigned int i = 0; i < payload_size(seqnum); i++)
+        assert(buffer[RTP_HEADER_SIZE + i] == (uint8_t)(seqnum + i));
+    ubase_assert(uref_block_unmap(uref, 0));
+
+    assert((int)seqnum > last_seqnum);
+    assert(seqnum == last_seqnum + 1 || (seqnum == 43 && last_seqnum == 40) ||
+           (seqnum == 48 && last_seqnum == 45));
+    last_seqnum = seqnum;
+    nb_packets++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr rtp_fec_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** writes a media packet */
+static void write_packet(uint8_t *buf, uint16_t seqnum)
+{
+    memset(buf, 0, RTP_HEADER_SIZE);
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, RTP_TYPE_TS);
+    rtp_set_seqnum(buf, seqnum);
+    rtp_set_timestamp(buf, seqnum * 100);
+    for (unsigned int i = 0; i < payload_size(seqnum); i++)
+        buf[RTP_HEADER_SIZE + i] = seqnum + i;
+}
+
+/** sends a media packet */
+static void send_packet(struct upipe *upipe, uint16_t seqnum)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, block_mgr,
+                                         RTP_HEADER_SIZE +
+                                         payload_size(seqnum));
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    write_packet(buf, seqnum);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
+/** sends a FEC packet protecting na packets */
+static void send_fec(struct upipe *upipe, uint16_t snbase, uint8_t offset,
+                     uint8_t na, bool row)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, block_mgr,
+            RTP_HEADER_SIZE + FEC_HEADER_SIZE + SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, size);
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, 96);
+    rtp_set_seqnum(buf, fec_seqnum++);
+
+    uint8_t *fec = buf + RTP_HEADER_SIZE;
+    uint8_t *payload = fec + FEC_HEADER_SIZE;
+    uint16_t length = 0;
+    uint8_t pt = 0;
+    uint32_t ts = 0;
+    for (unsigned int i = 0; i < na; i++) {
+        uint16_t seqnum = snbase + i * offset;
+        uint8_t media[RTP_HEADER_SIZE + SIZE];
+        write_packet(media, seqnum);
+        length ^= payload_size(seqnum);
+        pt ^= rtp_get_type(media);
+        ts ^= rtp_get_timestamp(media);
+        for (unsigned int j = 0; j < payload_size(seqnum); j++)
+            payload[j] ^= media[RTP_HEADER_SIZE + j];
+    }
+    fec[0] = snbase >> 8;
+    fec[1] = snbase;
+    fec[2] = length >> 8;
+    fec[3] = length;
+    fec[4] = 0x80 | pt;
+    fec[8] = ts >> 24;
+    fec[9] = ts >> 16;
+    fec[10] = ts >> 8;
+    fec[11] = ts;
+    fec[12] = row ? 0x40 : 0;
+    fec[13] = offset;
+    fec[14] = na;
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
+/** checks a XOR function against the C version */
+static void check_xor(upipe_rtp_fec_xor xor_words)
+{
+    uint64_t src[48], dst[48], ref[48];
+    for (size_t offset = 0; offset < 3; offset++) {
+        for (size_t words = 0; words <= 40; words++) {
+            for (size_t i = 0; i < 48; i++) {
+                src[i] = UINT64_C(0x9e3779b97f4a7c15) * (i + words);
+                dst[i] = ref[i] = UINT64_C(0xc2b2ae3d27d4eb4f) * (i + offset);
+            }
+            upipe_rtp_fec_xor_c(ref + offset, src + 2 * offset, words);
+            xor_words(dst + offset, src + 2 * offset, words);
+            assert(!memcmp(dst, ref, sizeof(dst)));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    /* XOR functions */
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSE2))
+        check_xor(upipe_rtp_fec_xor_sse2);
+    if (ucpu_has(UCPU_AVX2))
+        check_xor(upipe_rtp_fec_xor_avx2);
+#endif
+    check_xor(upipe_rtp_fec_xor_c);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    block_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                         umem_mgr, -1, 0);
+    assert(block_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe_mgr *upipe_rtp_fec_mgr = upipe_rtp_fec_mgr_alloc();
+    assert(upipe_rtp_fec_mgr != NULL);
+    struct upipe *fec = upipe_void_alloc(upipe_rtp_fec_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "fec"));
+    assert(fec != NULL);
+
+    struct upipe *sink = upipe_void_alloc(&rtp_fec_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "sink"));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(fec, sink));
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(fec, flow_def));
+    struct upipe *col = upipe_void_alloc_sub(fec,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "col"));
+    assert(col != NULL);
+    ubase_assert(upipe_set_flow_def(col, flow_def));
+    struct upipe *row = upipe_void_alloc_sub(fec,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "row"));
+    assert(row != NULL);
+    ubase_assert(upipe_set_flow_def(row, flow_def));
+    uref_free(flow_def);
+
+    /* row FEC packets follow their row, and column FEC packets follow
+     * their matrix; 30 is duplicated */
+    for (unsigned int i = 0; i < NB_PACKETS; i++) {
+        if (!is_lost(i))
+            send_packet(fec, i);
+        if (i == 30)
+            send_packet(fec, i);
+        if (i % COLUMNS == COLUMNS - 1)
+            send_fec(row, i - (COLUMNS - 1), 1, COLUMNS, true);
+        if (i % (COLUMNS * ROWS) == COLUMNS * ROWS - 1)
+            for (unsigned int j = 0; j < COLUMNS; j++)
+                send_fec(col, i - (COLUMNS * ROWS - 1) + j, COLUMNS, ROWS,
+                         false);
+    }
+    assert(last_seqnum == NB_PACKETS - 1);
+    assert(nb_packets == NB_PACKETS - 4);
+
+    unsigned int columns, rows;
+    ubase_assert(upipe_rtp_fec_get_matrix(fec, &columns, &rows));
+    assert(columns == COLUMNS);
+    assert(rows == ROWS);
+    struct upipe_rtp_fec_counters counters;
+    ubase_assert(upipe_rtp_fec_get_counters(fec, &counters));
+    assert(counters.packets == NB_PACKETS - 7 + 1);
+    assert(counters.fec_packets == NB_MATRICES * (ROWS + COLUMNS));
+    assert(counters.recovered == 3);
+    assert(counters.lost == 4);
+    assert(counters.late == 0);
+    assert(counters.duplicates == 1);
+
+    upipe_release(col);
+    upipe_release(row);
+    upipe_release(fec);
+    test_free(sink);
+
+    upipe_mgr_release(upipe_rtp_fec_mgr); // no-op
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(block_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+    return 0;
+}
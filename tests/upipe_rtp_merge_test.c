@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for RTP merge module (SMPTE 2022-7)
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_rtp_merge.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define SIZE                1328
+#define NB_PACKETS          100
+#define SKEW                5
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *block_mgr;
+static unsigned int nb_packets = 0;
+static int last_seqnum = -1;
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    uint8_t buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp = uref_block_peek(uref, 0, RTP_HEADER_SIZE, buffer);
+    assert(rtp != NULL);
+    uint16_t seqnum = rtp_get_seqnum(rtp);
+    ubase_assert(uref_block_peek_unmap(uref, 0, buffer, rtp));
+    upipe_dbg_va(upipe, "received %u", seqnum);
+    assert((int)seqnum > last_seqnum);
+    /* packet 50 is lost on both paths */
+    assert(seqnum == last_seqnum + 1 || (seqnum == 51 && last_seqnum == 49));
+    last_seqnum = seqnum;
+    nb_packets++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr rtp_merge_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_NEED_UPUMP_MGR:
+        case UPROBE_PROVIDE_REQUEST:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** sends a RTP packet to an input */
+static void send_packet(struct upipe *input, uint16_t seqnum, uint64_t cr_sys)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, RTP_HEADER_SIZE);
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, RTP_TYPE_TS);
+    rtp_set_seqnum(buf, seqnum);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, cr_sys);
+    upipe_input(input, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    block_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                         umem_mgr, -1, 0);
+    assert(block_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe_mgr *upipe_rtp_merge_mgr = upipe_rtp_merge_mgr_alloc();
+    assert(upipe_rtp_merge_mgr != NULL);
+    struct upipe *merge = upipe_void_alloc(upipe_rtp_merge_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "merge"));
+    assert(merge != NULL);
+    ubase_assert(upipe_rtp_merge_set_delay(merge, UCLOCK_FREQ / 50));
+    uint64_t delay;
+    ubase_assert(upipe_rtp_merge_get_delay(merge, &delay));
+    assert(delay == UCLOCK_FREQ / 50);
+
+    struct upipe *sink = upipe_void_alloc(&rtp_merge_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "sink"));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(merge, sink));
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(flow_def != NULL);
+    struct upipe *path_a = upipe_void_alloc_sub(merge,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "path a"));
+    assert(path_a != NULL);
+    ubase_assert(upipe_set_flow_def(path_a, flow_def));
+    struct upipe *path_b = upipe_void_alloc_sub(merge,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "path b"));
+    assert(path_b != NULL);
+    ubase_assert(upipe_set_flow_def(path_b, flow_def));
+    uref_free(flow_def);
+
+    /* path b lags path a by SKEW packets, one packet per millisecond; 10 and
+     * 11 are lost on a, 70 on b, and 50 on both */
+    for (unsigned int t = 0; t < NB_PACKETS + SKEW; t++) {
+        uint64_t cr_sys = t * UCLOCK_FREQ / 1000;
+        if (t < NB_PACKETS && t != 10 && t != 11 && t != 50)
+            send_packet(path_a, t, cr_sys);
+        if (t >= SKEW && t - SKEW != 50 && t - SKEW != 70)
+            send_packet(path_b, t - SKEW, cr_sys);
+    }
+    assert(last_seqnum == NB_PACKETS - 1);
+    assert(nb_packets == NB_PACKETS - 1);
+
+    /* packet 50 eventually shows up on path a, after it was declared lost */
+    send_packet(path_a, 50, (NB_PACKETS + SKEW) * UCLOCK_FREQ / 1000);
+    assert(nb_packets == NB_PACKETS - 1);
+
+    struct upipe_rtp_merge_counters counters;
+    ubase_assert(upipe_rtp_merge_get_counters(path_a, &counters));
+    assert(counters.packets == NB_PACKETS - 2);
+    assert(counters.lost == 3);
+    assert(counters.recovered == 2);
+    assert(counters.duplicates == 0);
+    assert(counters.late == 1);
+    ubase_assert(upipe_rtp_merge_get_counters(path_b, &counters));
+    assert(counters.packets == NB_PACKETS - 2);
+    assert(counters.lost == 2);
+    assert(counters.recovered == 1);
+    assert(counters.duplicates == NB_PACKETS - 4);
+    assert(counters.late == 0);
+    ubase_assert(upipe_rtp_merge_get_counters(merge, &counters));
+    assert(counters.packets == NB_PACKETS - 1);
+    assert(counters.lost == 1);
+    assert(counters.recovered == 3);
+    assert(counters.duplicates == NB_PACKETS - 4);
+    assert(counters.late == 1);
+
+    upipe_release(path_a);
+    upipe_release(path_b);
+    upipe_release(merge);
+    test_free(sink);
+
+    upipe_mgr_release(upipe_rtp_merge_mgr); // no-op
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(block_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+    return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/** @file
+ * @short unit tests for RTP reorder module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_rtp_reorder.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define SIZE                1328
+#define NB_PACKETS          100
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *block_mgr;
+static unsigned int nb_packets = 0;
+static int last_seqnum = -1;
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    uint8_t buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp = uref_block_peek(uref, 0, RTP_HEADER_SIZE, buffer);
+    assert(rtp != NULL);
+    uint16_t seqnum = rtp_get_seqnum(rtp);
+    ubase_assert(uref_block_peek_unmap(uref, 0, buffer, rtp));
+    upipe_dbg_va(upipe, "received %u", seqnum);
+    assert((int)seqnum > last_seqnum);
+    /* packet 50 is lost, and packet 70 arrives too late */
+    assert(seqnum == last_seqnum + 1 || (seqnum == 51 && last_seqnum == 49) ||
+           (seqnum == 71 && last_seqnum == 69));
+    last_seqnum = seqnum;
+    nb_packets++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr rtp_reorder_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_NEED_UPUMP_MGR:
+        case UPROBE_PROVIDE_REQUEST:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** sends a RTP packet */
+static void send_packet(struct upipe *upipe, uint16_t seqnum, uint64_t cr_sys)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, block_mgr, SIZE);
+    assert(uref != NULL);
+    uint8_t *buf;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buf));
+    memset(buf, 0, RTP_HEADER_SIZE);
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, RTP_TYPE_TS);
+    rtp_set_seqnum(buf, seqnum);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, cr_sys);
+    upipe_input(upipe, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    block_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                         umem_mgr, -1, 0);
+    assert(block_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe_mgr *upipe_rtp_reorder_mgr = upipe_rtp_reorder_mgr_alloc();
+    assert(upipe_rtp_reorder_mgr != NULL);
+    struct upipe *reorder = upipe_void_alloc(upipe_rtp_reorder_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "reorder"));
+    assert(reorder != NULL);
+    ubase_assert(upipe_rtp_reorder_set_latency(reorder, UCLOCK_FREQ / 200));
+    uint64_t latency;
+    ubase_assert(upipe_rtp_reorder_get_latency(reorder, &latency));
+    assert(latency == UCLOCK_FREQ / 200);
+
+    struct upipe *sink = upipe_void_alloc(&rtp_reorder_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "sink"));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(reorder, sink));
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(reorder, flow_def));
+    uref_free(flow_def);
+
+    /* one packet per millisecond with a latency of 5 ms; 10 and 11 are
+     * swapped, 30 is delayed by 3 packets, 50 is lost, 70 is delayed by 10
+     * packets and 90 is duplicated */
+    unsigned int t = 0;
+    for (unsigned int i = 0; i < NB_PACKETS; i++) {
+        uint64_t cr_sys = t * UCLOCK_FREQ / 1000;
+        switch (i) {
+            case 10:
+                send_packet(reorder, 11, cr_sys);
+                break;
+            case 11:
+                send_packet(reorder, 10, cr_sys);
+                break;
+            case 30:
+            case 50:
+            case 70:
+                t--;
+                break;
+            case 33:
+                send_packet(reorder, 33, cr_sys);
+                send_packet(reorder, 30, cr_sys);
+                break;
+            case 80:
+                send_packet(reorder, 80, cr_sys);
+                send_packet(reorder, 70, cr_sys);
+                break;
+            case 90:
+                send_packet(reorder, 90, cr_sys);
+                send_packet(reorder, 90, cr_sys);
+                break;
+            default:
+                send_packet(reorder, i, cr_sys);
+                break;
+        }
+        t++;
+    }
+    assert(last_seqnum == NB_PACKETS - 1);
+    assert(nb_packets == NB_PACKETS - 2);
+
+    struct upipe_rtp_reorder_counters counters;
+    ubase_assert(upipe_rtp_reorder_get_counters(reorder, &counters));
+    assert(counters.packets == NB_PACKETS);
+    assert(counters.lost == 2);
+    assert(counters.late == 1);
+    assert(counters.reordered == 2);
+    assert(counters.duplicates == 1);
+
+    upipe_release(reorder);
+    test_free(sink);
+
+    upipe_mgr_release(upipe_rtp_reorder_mgr); // no-op
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(block_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+    return 0;
+}
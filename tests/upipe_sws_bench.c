@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short benchmark of sliced swscale conversions
+ *
+ * This program is not run by make check; it prints the time taken to scale
+ * large pictures with and without slice threads.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-swscale/upipe_sws.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define UBUF_ALIGN          16
+#define UPROBE_LOG_LEVEL    UPROBE_LOG_NOTICE
+#define BENCH_FRAMES        20
+#define BENCH_THREADS       4
+
+/** number of received pictures */
+static unsigned int nb_pics = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    nb_pics++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** returns the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.;
+}
+
+/** fills a plane with a textured pattern */
+static void fill_pattern(struct uref *uref, const char *chroma)
+{
+    size_t hsize, vsize, stride;
+    uint8_t hsub, vsub;
+    uint8_t *buffer;
+    ubase_assert(uref_pic_plane_write(uref, chroma, 0, 0, -1, -1, &buffer));
+    ubase_assert(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub,
+                                     NULL));
+    ubase_assert(uref_pic_size(uref, &hsize, &vsize, NULL));
+    for (int y = 0; y < vsize / vsub; y++) {
+        for (int x = 0; x < hsize / hsub; x++)
+            buffer[x] = (x * 3 + y * 5) ^ (x * y);
+        buffer += stride;
+    }
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+}
+
+/** scales a picture several times with the given number of slice threads,
+ * and prints the time taken */
+static void bench(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                  struct uprobe *logger, struct uref *pic_flow,
+                  size_t hsize, size_t vsize,
+                  size_t output_hsize, size_t output_vsize,
+                  unsigned int threads)
+{
+    struct uref *output_flow = uref_dup(pic_flow);
+    assert(output_flow != NULL);
+    ubase_assert(uref_pic_flow_set_hsize(output_flow, output_hsize));
+    ubase_assert(uref_pic_flow_set_vsize(output_flow, output_vsize));
+    struct upipe *sws = upipe_flow_alloc(upipe_sws_mgr_alloc(),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "sws"),
+            output_flow);
+    assert(sws != NULL);
+    uref_free(output_flow);
+    ubase_assert(upipe_sws_set_threads(sws, threads));
+    ubase_assert(upipe_set_flow_def(sws, pic_flow));
+
+    struct upipe *test = upipe_void_alloc(&test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "test"));
+    assert(test != NULL);
+    ubase_assert(upipe_set_output(sws, test));
+
+    struct uref *pic = uref_pic_alloc(uref_mgr, ubuf_mgr, hsize, vsize);
+    assert(pic != NULL);
+    ubase_assert(uref_pic_set_progressive(pic));
+    fill_pattern(pic, "y8");
+    fill_pattern(pic, "u8");
+    fill_pattern(pic, "v8");
+
+    /* the first picture allocates the contexts */
+    upipe_input(sws, uref_dup(pic), NULL);
+    nb_pics = 0;
+    double start = now();
+    for (int i = 0; i < BENCH_FRAMES; i++)
+        upipe_input(sws, uref_dup(pic), NULL);
+    double elapsed = now() - start;
+    assert(nb_pics == BENCH_FRAMES);
+    printf("%zux%zu -> %zux%zu, %u thread(s): %.3f ms/frame\n",
+           hsize, vsize, output_hsize, output_vsize, threads,
+           elapsed * 1000. / BENCH_FRAMES);
+    uref_free(pic);
+
+    upipe_release(sws);
+    test_free(test);
+}
+
+/** benchmarks a conversion without and with slice threads */
+static void bench_sizes(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                        struct uprobe *logger, struct uref *pic_flow,
+                        size_t hsize, size_t vsize,
+                        size_t output_hsize, size_t output_vsize)
+{
+    bench(uref_mgr, ubuf_mgr, logger, pic_flow,
+          hsize, vsize, output_hsize, output_vsize, 1);
+    bench(uref_mgr, ubuf_mgr, logger, pic_flow,
+          hsize, vsize, output_hsize, output_vsize, BENCH_THREADS);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+
+    struct ubuf_mgr *ubuf_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1, 0, 0, 0, 0, UBUF_ALIGN, 0);
+    assert(ubuf_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "u8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "v8", 2, 2, 1));
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct uref *pic_flow = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(pic_flow != NULL);
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 2, 2, 1, "v8"));
+    ubase_assert(uref_pic_flow_set_align(pic_flow, UBUF_ALIGN));
+    bench_sizes(uref_mgr, ubuf_mgr, logger, pic_flow, 3840, 2160, 1920, 1080);
+    bench_sizes(uref_mgr, ubuf_mgr, logger, pic_flow, 1920, 1080, 1280, 720);
+    bench_sizes(uref_mgr, ubuf_mgr, logger, pic_flow, 720, 576, 1920, 1080);
+    uref_free(pic_flow);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -69,6 +69,7 @@
 
 #define SRCSIZE             32
 #define DSTSIZE             16
+#define SLICE_THREADS       4
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -271,6 +272,127 @@ static struct upipe_mgr sws_test_mgr = {
     .upipe_control = test_control
 };
 
+/** fills a plane with a textured pattern */
+static void fill_pattern(struct uref *uref, const char *chroma)
+{
+    size_t hsize, vsize, stride;
+    uint8_t hsub, vsub;
+    uint8_t *buffer;
+    ubase_assert(uref_pic_plane_write(uref, chroma, 0, 0, -1, -1, &buffer));
+    ubase_assert(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub,
+                                     NULL));
+    ubase_assert(uref_pic_size(uref, &hsize, &vsize, NULL));
+    for (int y = 0; y < vsize / vsub; y++) {
+        for (int x = 0; x < hsize / hsub; x++)
+            buffer[x] = (x * 3 + y * 5) ^ (x * y);
+        buffer += stride;
+    }
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+}
+
+/** returns the largest difference between a plane of two pictures */
+static int max_difference(struct uref *uref1, struct uref *uref2,
+                          const char *chroma)
+{
+    size_t hsize, vsize, stride1, stride2;
+    uint8_t hsub, vsub;
+    const uint8_t *buffer1, *buffer2;
+    ubase_assert(uref_pic_plane_read(uref1, chroma, 0, 0, -1, -1, &buffer1));
+    ubase_assert(uref_pic_plane_read(uref2, chroma, 0, 0, -1, -1, &buffer2));
+    ubase_assert(uref_pic_plane_size(uref1, chroma, &stride1, &hsub, &vsub,
+                                     NULL));
+    ubase_assert(uref_pic_plane_size(uref2, chroma, &stride2, NULL, NULL,
+                                     NULL));
+    ubase_assert(uref_pic_size(uref1, &hsize, &vsize, NULL));
+    int max = 0;
+    for (int y = 0; y < vsize / vsub; y++) {
+        for (int x = 0; x < hsize / hsub; x++) {
+            int diff = abs(buffer1[x] - buffer2[x]);
+            if (diff > max)
+                max = diff;
+        }
+        buffer1 += stride1;
+        buffer2 += stride2;
+    }
+    uref_pic_plane_unmap(uref1, chroma, 0, 0, -1, -1);
+    uref_pic_plane_unmap(uref2, chroma, 0, 0, -1, -1);
+    return max;
+}
+
+/** scales a picture with the given number of slice threads, and returns
+ * the output picture */
+static struct uref *scale(struct uref_mgr *uref_mgr,
+                          struct ubuf_mgr *ubuf_mgr, struct uprobe *logger,
+                          struct uref *pic_flow, size_t hsize, size_t vsize,
+                          size_t output_hsize, size_t output_vsize,
+                          unsigned int threads)
+{
+    struct uref *output_flow = uref_dup(pic_flow);
+    assert(output_flow != NULL);
+    ubase_assert(uref_pic_flow_set_hsize(output_flow, output_hsize));
+    ubase_assert(uref_pic_flow_set_vsize(output_flow, output_vsize));
+    struct upipe *sws = upipe_flow_alloc(upipe_sws_mgr_alloc(),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_NOTICE, "sws"),
+            output_flow);
+    assert(sws != NULL);
+    uref_free(output_flow);
+    ubase_assert(upipe_sws_set_threads(sws, threads));
+    unsigned int threads_get;
+    ubase_assert(upipe_sws_get_threads(sws, &threads_get));
+    assert(threads_get == threads);
+    ubase_assert(upipe_set_flow_def(sws, pic_flow));
+
+    struct upipe *sws_test = upipe_void_alloc(&sws_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_NOTICE,
+                             "sws_test"));
+    assert(sws_test != NULL);
+    ubase_assert(upipe_set_output(sws, sws_test));
+
+    struct uref *pic = uref_pic_alloc(uref_mgr, ubuf_mgr, hsize, vsize);
+    assert(pic != NULL);
+    ubase_assert(uref_pic_set_progressive(pic));
+    fill_pattern(pic, "y8");
+    fill_pattern(pic, "u8");
+    fill_pattern(pic, "v8");
+
+    upipe_input(sws, pic, NULL);
+
+    struct uref *output = sws_test_from_upipe(sws_test)->pic;
+    assert(output != NULL);
+    sws_test_from_upipe(sws_test)->pic = NULL;
+    size_t output_hsize_get, output_vsize_get;
+    ubase_assert(uref_pic_size(output, &output_hsize_get, &output_vsize_get,
+                               NULL));
+    assert(output_hsize_get == output_hsize);
+    assert(output_vsize_get == output_vsize);
+
+    upipe_release(sws);
+    test_free(sws_test);
+    return output;
+}
+
+/** compares sliced scaling with the unsliced conversion */
+static void check_slices(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                         struct uprobe *logger, struct uref *pic_flow,
+                         size_t hsize, size_t vsize,
+                         size_t output_hsize, size_t output_vsize)
+{
+    struct uref *ref = scale(uref_mgr, ubuf_mgr, logger, pic_flow,
+                             hsize, vsize, output_hsize, output_vsize, 1);
+    struct uref *sliced = scale(uref_mgr, ubuf_mgr, logger, pic_flow,
+                                hsize, vsize, output_hsize, output_vsize,
+                                SLICE_THREADS);
+    static const char *chromas[] = { "y8", "u8", "v8" };
+    for (int i = 0; i < 3; i++) {
+        int diff = max_difference(ref, sliced, chromas[i]);
+        printf("%s: max difference %d\n", chromas[i], diff);
+        /* slices only differ by rounding, if at all */
+        assert(diff <= 1);
+    }
+    uref_free(ref);
+    uref_free(sliced);
+}
+
 // DEBUG - from swscale/swscale_unscaled.c
 static int check_image_pointers(const uint8_t * const data[4], enum AVPixelFormat pix_fmt, const int linesizes[4])
 {
@@ -430,6 +552,17 @@ int main(int argc, char **argv)
     upipe_release(sws);
     test_free(sws_test);
 
+    /* slice threads */
+    pic_flow = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(pic_flow != NULL);
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 2, 2, 1, "v8"));
+    ubase_assert(uref_pic_flow_set_align(pic_flow, UBUF_ALIGN));
+    check_slices(uref_mgr, ubuf_mgr, logger, pic_flow, 320, 240, 176, 144);
+    check_slices(uref_mgr, ubuf_mgr, logger, pic_flow, 176, 144, 320, 240);
+    uref_free(pic_flow);
+
     /* release managers */
     ubuf_mgr_release(ubuf_mgr);
     uref_mgr_release(uref_mgr); 
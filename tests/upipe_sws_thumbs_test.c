@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for sws_thumbs pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe-swscale/upipe_sws_thumbs.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define UBUF_ALIGN          16
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+#define SRC_HSIZE           64
+#define SRC_VSIZE           48
+#define THUMB_HSIZE         16
+#define THUMB_VSIZE         12
+#define COLS                2
+#define ROWS                2
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** returns the value of a sample of picture n */
+static uint8_t sample(int n, int p, int x, int y)
+{
+    return (x * 7 + y * 13 + p * 31 + n * 57) ^ (x * y);
+}
+
+/** fills a plane of picture n */
+static void fill_plane(struct uref *uref, const char *chroma, int p, int n)
+{
+    size_t stride;
+    uint8_t hsub, vsub;
+    uint8_t *buffer;
+    ubase_assert(uref_pic_plane_write(uref, chroma, 0, 0, -1, -1, &buffer));
+    ubase_assert(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub,
+                                     NULL));
+    for (int y = 0; y < SRC_VSIZE / vsub; y++) {
+        for (int x = 0; x < SRC_HSIZE / hsub; x++)
+            buffer[x] = sample(n, p, x, y);
+        buffer += stride;
+    }
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+}
+
+/** checks that a plane of the gallery holds the averages of picture n */
+static void check_plane(struct uref *uref, const char *chroma, int p, int n)
+{
+    size_t stride;
+    uint8_t hsub, vsub;
+    const uint8_t *buffer;
+    ubase_assert(uref_pic_plane_read(uref, chroma,
+                                     (n % COLS) * THUMB_HSIZE,
+                                     (n / COLS) * THUMB_VSIZE,
+                                     THUMB_HSIZE, THUMB_VSIZE, &buffer));
+    ubase_assert(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub,
+                                     NULL));
+    int hfactor = SRC_HSIZE / THUMB_HSIZE;
+    int vfactor = SRC_VSIZE / THUMB_VSIZE;
+    int area = hfactor * vfactor;
+    for (int y = 0; y < THUMB_VSIZE / vsub; y++) {
+        for (int x = 0; x < THUMB_HSIZE / hsub; x++) {
+            int sum = area / 2;
+            for (int j = 0; j < vfactor; j++)
+                for (int i = 0; i < hfactor; i++)
+                    sum += sample(n, p, x * hfactor + i, y * vfactor + j);
+            assert(buffer[x] == sum / area);
+        }
+        buffer += stride;
+    }
+    uref_pic_plane_unmap(uref, chroma, (n % COLS) * THUMB_HSIZE,
+                         (n / COLS) * THUMB_VSIZE, THUMB_HSIZE, THUMB_VSIZE);
+}
+
+/** checks a line accumulation function against the C version */
+static void check_accumulate(upipe_sws_thumbs_accumulate accumulate)
+{
+    for (size_t width = 1; width <= 100; width++) {
+        uint8_t *src = malloc(width);
+        uint16_t *acc = malloc(width * sizeof(uint16_t));
+        uint16_t *ref = malloc(width * sizeof(uint16_t));
+        assert(src != NULL && acc != NULL && ref != NULL);
+        for (size_t i = 0; i < width; i++) {
+            acc[i] = ref[i] = i * 251;
+            src[i] = i * 37 + width;
+        }
+        upipe_sws_thumbs_accumulate_c(ref, src, width);
+        accumulate(acc, src, width);
+        assert(!memcmp(acc, ref, width * sizeof(uint16_t)));
+        free(src);
+        free(acc);
+        free(ref);
+    }
+}
+
+/** helper phony pipe */
+struct thumbs_test {
+    struct uref *pic;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+UPIPE_HELPER_UPIPE(thumbs_test, upipe, 0);
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct thumbs_test *thumbs_test = malloc(sizeof(struct thumbs_test));
+    assert(thumbs_test != NULL);
+    thumbs_test->pic = NULL;
+    upipe_init(&thumbs_test->upipe, mgr, uprobe);
+    upipe_throw_ready(&thumbs_test->upipe);
+    return &thumbs_test->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct thumbs_test *thumbs_test = thumbs_test_from_upipe(upipe);
+    assert(uref != NULL);
+    assert(thumbs_test->pic == NULL);
+    thumbs_test->pic = uref;
+    upipe_dbg(upipe, "received gallery");
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    struct thumbs_test *thumbs_test = thumbs_test_from_upipe(upipe);
+    if (thumbs_test->pic)
+        uref_free(thumbs_test->pic);
+    upipe_clean(upipe);
+    free(thumbs_test);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr thumbs_test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+int main(int argc, char **argv)
+{
+    /* line accumulation */
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSE2))
+        check_accumulate(upipe_sws_thumbs_accumulate_sse2);
+    if (ucpu_has(UCPU_AVX2))
+        check_accumulate(upipe_sws_thumbs_accumulate_avx2);
+#endif
+    check_accumulate(upipe_sws_thumbs_accumulate_c);
+
+    /* horizontal averaging with rounding */
+    uint16_t acc[6] = { 0, 1, 2, 2, 1020, 1020 };
+    uint8_t dest[3];
+    upipe_sws_thumbs_average_c(dest, acc, 3, 2, 8);
+    assert(dest[0] == 0);
+    assert(dest[1] == 1);
+    assert(dest[2] == 255);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1, 0, 0, 0, 0, UBUF_ALIGN, 0);
+    assert(ubuf_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "u8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "v8", 2, 2, 1));
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct uref *pic_flow = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(pic_flow != NULL);
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(pic_flow, 2, 2, 1, "v8"));
+
+    struct upipe_mgr *upipe_sws_thumbs_mgr = upipe_sws_thumbs_mgr_alloc();
+    assert(upipe_sws_thumbs_mgr != NULL);
+    struct upipe *thumbs = upipe_flow_alloc(upipe_sws_thumbs_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "thumbs"),
+            pic_flow);
+    assert(thumbs != NULL);
+    upipe_mgr_release(upipe_sws_thumbs_mgr);
+    ubase_assert(upipe_set_flow_def(thumbs, pic_flow));
+    uref_free(pic_flow);
+    upipe_sws_thumbs_set_size(thumbs, THUMB_HSIZE, THUMB_VSIZE, COLS, ROWS);
+
+    struct upipe *thumbs_test = upipe_void_alloc(&thumbs_test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "thumbs_test"));
+    assert(thumbs_test != NULL);
+    ubase_assert(upipe_set_output(thumbs, thumbs_test));
+
+    /* integer ratios are averaged without swscale */
+    for (int n = 0; n < COLS * ROWS; n++) {
+        struct uref *pic = uref_pic_alloc(uref_mgr, ubuf_mgr,
+                                          SRC_HSIZE, SRC_VSIZE);
+        assert(pic != NULL);
+        fill_plane(pic, "y8", 0, n);
+        fill_plane(pic, "u8", 1, n);
+        fill_plane(pic, "v8", 2, n);
+        upipe_input(thumbs, pic, NULL);
+    }
+
+    struct uref *gallery = thumbs_test_from_upipe(thumbs_test)->pic;
+    assert(gallery != NULL);
+    size_t hsize, vsize;
+    ubase_assert(uref_pic_size(gallery, &hsize, &vsize, NULL));
+    assert(hsize == THUMB_HSIZE * COLS);
+    assert(vsize == THUMB_VSIZE * ROWS);
+    for (int n = 0; n < COLS * ROWS; n++) {
+        check_plane(gallery, "y8", 0, n);
+        check_plane(gallery, "u8", 1, n);
+        check_plane(gallery, "v8", 2, n);
+    }
+
+    upipe_release(thumbs);
+    test_free(thumbs_test);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
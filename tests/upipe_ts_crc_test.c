@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS CRC-32 functions
+ */
+
+#undef NDEBUG
+
+#include <upipe-ts/upipe_ts_crc.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/psi.h>
+
+#define BUFFER_SIZE 4096
+
+/** bit-by-bit reference implementation */
+static uint32_t crc32_ref(uint32_t crc, const uint8_t *buffer, size_t size)
+{
+    while (size--) {
+        crc ^= (uint32_t)*buffer++ << 24;
+        for (int i = 0; i < 8; i++)
+            crc = (crc << 1) ^ (crc & 0x80000000 ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t buffer[BUFFER_SIZE + 1];
+    srand(42);
+    for (int i = 0; i < sizeof(buffer); i++)
+        buffer[i] = rand();
+
+    /* check value of CRC-32/MPEG-2 */
+    assert(upipe_ts_crc32(UPIPE_TS_CRC_INIT,
+                          (const uint8_t *)"123456789", 9) == 0x0376e6e7);
+
+    /* all implementations, all sizes and misalignments */
+    for (int offset = 0; offset < 2; offset++) {
+        for (int size = 0; size <= BUFFER_SIZE; size++) {
+            uint32_t crc = crc32_ref(UPIPE_TS_CRC_INIT, buffer + offset,
+                                     size);
+            assert(upipe_ts_crc32_c(UPIPE_TS_CRC_INIT, buffer + offset,
+                                    size) == crc);
+            assert(upipe_ts_crc32_clmul(UPIPE_TS_CRC_INIT, buffer + offset,
+                                        size) == crc);
+            assert(upipe_ts_crc32(UPIPE_TS_CRC_INIT, buffer + offset,
+                                  size) == crc);
+        }
+    }
+
+    /* incremental computation */
+    uint32_t crc = upipe_ts_crc32(UPIPE_TS_CRC_INIT, buffer, 1000);
+    crc = upipe_ts_crc32(crc, buffer + 1000, 3000);
+    assert(crc == crc32_ref(UPIPE_TS_CRC_INIT, buffer, 4000));
+
+    /* compatibility with biTStream on PSI sections */
+    uint8_t *section = buffer;
+    psi_init(section, true);
+    psi_set_length(section, PSI_MAX_SIZE - PSI_HEADER_SIZE);
+    upipe_ts_psi_set_crc(section);
+    assert(psi_check_crc(section));
+    assert(upipe_ts_psi_check_crc(section));
+    section[100]++;
+    assert(!upipe_ts_psi_check_crc(section));
+    psi_set_length(section, 20);
+    psi_set_crc(section);
+    assert(upipe_ts_psi_check_crc(section));
+
+    return 0;
+}
@@ -0,0 +1,591 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS DVB-CSA descrambler module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_csa.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define PID 0x100
+#define NB_PACKETS 600
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static struct upipe *upipe_ts_csa;
+static const uint8_t cw_even[UPIPE_TS_CSA_CW_SIZE] =
+    { 0x12, 0x34, 0x56, 0x9c, 0x78, 0x9a, 0xbc, 0xce };
+static const uint8_t cw_odd[UPIPE_TS_CSA_CW_SIZE] =
+    { 0xde, 0xad, 0xbe, 0x49, 0xca, 0xfe, 0xba, 0x32 };
+static struct upipe_ts_csa_key key_even, key_odd;
+
+/*
+ * Byte-wise implementation of the descrambler, following the structure of
+ * the published description of the algorithm (key schedule, block cipher
+ * rounds and stream cipher registers), without any bitslicing. It shares no
+ * code with upipe_ts_csa and is used to cross-check it.
+ */
+
+/** key schedule permutation */
+static const uint8_t ref_key_perm[64] = {
+    0x12, 0x24, 0x09, 0x07, 0x2a, 0x31, 0x1d, 0x15, 0x1c, 0x36, 0x3e, 0x32,
+    0x13, 0x21, 0x3b, 0x40, 0x18, 0x14, 0x25, 0x27, 0x02, 0x35, 0x1b, 0x01,
+    0x22, 0x04, 0x0d, 0x0e, 0x39, 0x28, 0x1a, 0x29, 0x33, 0x23, 0x34, 0x0c,
+    0x16, 0x30, 0x1e, 0x3a, 0x2d, 0x1f, 0x08, 0x19, 0x17, 0x2f, 0x3d, 0x11,
+    0x3c, 0x05, 0x38, 0x2b, 0x0b, 0x06, 0x0a, 0x2c, 0x20, 0x3f, 0x2e, 0x0f,
+    0x03, 0x26, 0x10, 0x37
+};
+/** block cipher S-box */
+static const uint8_t ref_block_sbox[256] = {
+    0x3a, 0xea, 0x68, 0xfe, 0x33, 0xe9, 0x88, 0x1a, 0x83, 0xcf, 0xe1, 0x7f,
+    0xba, 0xe2, 0x38, 0x12, 0xe8, 0x27, 0x61, 0x95, 0x0c, 0x36, 0xe5, 0x70,
+    0xa2, 0x06, 0x82, 0x7c, 0x17, 0xa3, 0x26, 0x49, 0xbe, 0x7a, 0x6d, 0x47,
+    0xc1, 0x51, 0x8f, 0xf3, 0xcc, 0x5b, 0x67, 0xbd, 0xcd, 0x18, 0x08, 0xc9,
+    0xff, 0x69, 0xef, 0x03, 0x4e, 0x48, 0x4a, 0x84, 0x3f, 0xb4, 0x10, 0x04,
+    0xdc, 0xf5, 0x5c, 0xc6, 0x16, 0xab, 0xac, 0x4c, 0xf1, 0x6a, 0x2f, 0x3c,
+    0x3b, 0xd4, 0xd5, 0x94, 0xd0, 0xc4, 0x63, 0x62, 0x71, 0xa1, 0xf9, 0x4f,
+    0x2e, 0xaa, 0xc5, 0x56, 0xe3, 0x39, 0x93, 0xce, 0x65, 0x64, 0xe4, 0x58,
+    0x6c, 0x19, 0x42, 0x79, 0xdd, 0xee, 0x96, 0xf6, 0x8a, 0xec, 0x1e, 0x85,
+    0x53, 0x45, 0xde, 0xbb, 0x7e, 0x0a, 0x9a, 0x13, 0x2a, 0x9d, 0xc2, 0x5e,
+    0x5a, 0x1f, 0x32, 0x35, 0x9c, 0xa8, 0x73, 0x30, 0x29, 0x3d, 0xe7, 0x92,
+    0x87, 0x1b, 0x2b, 0x4b, 0xa5, 0x57, 0x97, 0x40, 0x15, 0xe6, 0xbc, 0x0e,
+    0xeb, 0xc3, 0x34, 0x2d, 0xb8, 0x44, 0x25, 0xa4, 0x1c, 0xc7, 0x23, 0xed,
+    0x90, 0x6e, 0x50, 0x00, 0x99, 0x9e, 0x4d, 0xd9, 0xda, 0x8d, 0x6f, 0x5f,
+    0x3e, 0xd7, 0x21, 0x74, 0x86, 0xdf, 0x6b, 0x05, 0x8e, 0x5d, 0x37, 0x11,
+    0xd2, 0x28, 0x75, 0xd6, 0xa7, 0x77, 0x24, 0xbf, 0xf0, 0xb0, 0x02, 0xb7,
+    0xf8, 0xfc, 0x81, 0x09, 0xb1, 0x01, 0x76, 0x91, 0x7d, 0x0f, 0xc8, 0xa0,
+    0xf2, 0xcb, 0x78, 0x60, 0xd1, 0xf7, 0xe0, 0xb5, 0x98, 0x22, 0xb3, 0x20,
+    0x1d, 0xa6, 0xdb, 0x7b, 0x59, 0x9f, 0xae, 0x31, 0xfb, 0xd3, 0xb6, 0xca,
+    0x43, 0x72, 0x07, 0xf4, 0xd8, 0x41, 0x14, 0x55, 0x0d, 0x54, 0x8b, 0xb9,
+    0xad, 0x46, 0x0b, 0xaf, 0x80, 0x52, 0x2c, 0xfa, 0x8c, 0x89, 0x66, 0xfd,
+    0xb2, 0xa9, 0x9b, 0xc0
+};
+/** stream cipher S-box 1 */
+static const uint8_t ref_sbox1[32] = {
+    2, 0, 1, 1, 2, 3, 3, 0, 3, 2, 2, 0, 1, 1, 0, 3,
+    0, 3, 3, 0, 2, 2, 1, 1, 2, 2, 0, 3, 1, 1, 3, 0
+};
+/** stream cipher S-box 2 */
+static const uint8_t ref_sbox2[32] = {
+    3, 1, 0, 2, 2, 3, 3, 0, 1, 3, 2, 1, 0, 0, 1, 2,
+    3, 1, 0, 3, 3, 2, 0, 2, 0, 0, 1, 2, 2, 1, 3, 1
+};
+/** stream cipher S-box 3 */
+static const uint8_t ref_sbox3[32] = {
+    2, 0, 1, 2, 2, 3, 3, 1, 1, 1, 0, 3, 3, 0, 2, 0,
+    1, 3, 0, 1, 3, 0, 2, 2, 2, 0, 1, 2, 0, 3, 3, 1
+};
+/** stream cipher S-box 4 */
+static const uint8_t ref_sbox4[32] = {
+    3, 1, 2, 3, 0, 2, 1, 2, 1, 2, 0, 1, 3, 0, 0, 3,
+    1, 0, 3, 1, 2, 3, 0, 3, 0, 3, 2, 0, 1, 2, 2, 1
+};
+/** stream cipher S-box 5 */
+static const uint8_t ref_sbox5[32] = {
+    2, 0, 0, 1, 3, 2, 3, 2, 0, 1, 3, 3, 1, 0, 2, 1,
+    2, 3, 2, 0, 0, 3, 1, 1, 1, 0, 3, 2, 3, 1, 0, 2
+};
+/** stream cipher S-box 6 */
+static const uint8_t ref_sbox6[32] = {
+    0, 1, 2, 3, 1, 2, 2, 0, 0, 1, 3, 0, 2, 3, 1, 3,
+    2, 3, 0, 2, 3, 0, 1, 1, 2, 1, 1, 2, 0, 3, 3, 0
+};
+/** stream cipher S-box 7 */
+static const uint8_t ref_sbox7[32] = {
+    0, 3, 2, 2, 3, 0, 0, 1, 3, 0, 1, 3, 1, 2, 2, 1,
+    1, 0, 3, 3, 0, 1, 1, 2, 2, 3, 1, 0, 2, 3, 0, 2
+};
+
+/** block cipher bit permutation */
+static uint8_t ref_block_perm(uint8_t x)
+{
+    return ((x & 0x29) << 1) | ((x & 0x02) << 6) | ((x & 0x04) << 3) |
+           ((x & 0x10) >> 2) | ((x & 0x40) >> 6) | ((x & 0x80) >> 4);
+}
+
+/** stream cipher state */
+struct ref_stream {
+    int A[11], B[11], X, Y, Z, D, E, F, p, q, r;
+};
+
+/** expands a control word into the 56 block cipher round keys */
+static void ref_key_schedule(uint8_t kk[57], const uint8_t cw[8])
+{
+    int bit[64], newbit[64], kb[9][9];
+    for (int i = 0; i < 8; i++)
+        kb[7][i + 1] = cw[i];
+    for (int i = 0; i < 7; i++) {
+        for (int j = 0; j < 8; j++)
+            for (int k = 0; k < 8; k++) {
+                bit[j * 8 + k] = (kb[7 - i][1 + j] >> (7 - k)) & 1;
+                newbit[ref_key_perm[j * 8 + k] - 1] = bit[j * 8 + k];
+            }
+        for (int j = 0; j < 8; j++) {
+            kb[6 - i][1 + j] = 0;
+            for (int k = 0; k < 8; k++)
+                kb[6 - i][1 + j] |= newbit[j * 8 + k] << (7 - k);
+        }
+    }
+    for (int i = 0; i < 7; i++)
+        for (int j = 0; j < 8; j++)
+            kk[1 + i * 8 + j] = kb[1 + i][1 + j] ^ i;
+}
+
+/** deciphers a block with the block cipher */
+static void ref_block_decipher(const uint8_t kk[57], const uint8_t in[8],
+                               uint8_t out[8])
+{
+    int R[9];
+    for (int i = 0; i < 8; i++)
+        R[i + 1] = in[i];
+    for (int i = 56; i > 0; i--) {
+        int sbox_out = ref_block_sbox[kk[i] ^ R[7]];
+        int perm_out = ref_block_perm(sbox_out);
+        int next_R8 = R[7];
+        R[7] = R[6] ^ perm_out;
+        R[6] = R[5];
+        R[5] = R[4] ^ R[8] ^ sbox_out;
+        R[4] = R[3] ^ R[8] ^ sbox_out;
+        R[3] = R[2] ^ R[8] ^ sbox_out;
+        R[2] = R[1];
+        R[1] = R[8] ^ sbox_out;
+        R[8] = next_R8;
+    }
+    for (int i = 0; i < 8; i++)
+        out[i] = R[i + 1];
+}
+
+/** runs the stream cipher for 8 octets, initializing it with the first
+ * block if init is true */
+static void ref_stream_cipher(struct ref_stream *c, bool init,
+                              const uint8_t cw[8], const uint8_t *in,
+                              uint8_t out[8])
+{
+#define BIT(r, n) (((r) >> (n)) & 1)
+    if (init) {
+        memset(c, 0, sizeof(*c));
+        for (int i = 0; i < 4; i++) {
+            c->A[1 + 2 * i] = (cw[i] >> 4) & 0xf;
+            c->A[2 + 2 * i] = cw[i] & 0xf;
+            c->B[1 + 2 * i] = (cw[4 + i] >> 4) & 0xf;
+            c->B[2 + 2 * i] = cw[4 + i] & 0xf;
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        int op = 0, in1 = 0, in2 = 0;
+        if (init) {
+            in1 = (in[i] >> 4) & 0xf;
+            in2 = in[i] & 0xf;
+        }
+        for (int j = 0; j < 4; j++) {
+            int *A = c->A, *B = c->B;
+            int s1 = ref_sbox1[(BIT(A[4], 0) << 4) | (BIT(A[1], 2) << 3) |
+                (BIT(A[6], 1) << 2) | (BIT(A[7], 3) << 1) | BIT(A[9], 0)];
+            int s2 = ref_sbox2[(BIT(A[2], 1) << 4) | (BIT(A[3], 2) << 3) |
+                (BIT(A[6], 3) << 2) | (BIT(A[7], 0) << 1) | BIT(A[9], 1)];
+            int s3 = ref_sbox3[(BIT(A[1], 3) << 4) | (BIT(A[2], 0) << 3) |
+                (BIT(A[5], 1) << 2) | (BIT(A[5], 3) << 1) | BIT(A[6], 2)];
+            int s4 = ref_sbox4[(BIT(A[3], 3) << 4) | (BIT(A[1], 1) << 3) |
+                (BIT(A[2], 3) << 2) | (BIT(A[4], 2) << 1) | BIT(A[8], 0)];
+            int s5 = ref_sbox5[(BIT(A[5], 2) << 4) | (BIT(A[4], 3) << 3) |
+                (BIT(A[6], 0) << 2) | (BIT(A[8], 1) << 1) | BIT(A[9], 2)];
+            int s6 = ref_sbox6[(BIT(A[3], 1) << 4) | (BIT(A[4], 1) << 3) |
+                (BIT(A[5], 0) << 2) | (BIT(A[7], 2) << 1) | BIT(A[9], 3)];
+            int s7 = ref_sbox7[(BIT(A[2], 2) << 4) | (BIT(A[3], 0) << 3) |
+                (BIT(A[7], 1) << 2) | (BIT(A[8], 2) << 1) | BIT(A[8], 3)];
+            int extra_B =
+                ((((B[3] & 1) << 3) ^ ((B[6] & 2) << 2) ^ ((B[7] & 4) << 1) ^
+                  (B[9] & 8)) & 8) |
+                ((((B[6] & 1) << 2) ^ ((B[8] & 2) << 1) ^ ((B[3] & 8) >> 1) ^
+                  (B[4] & 4)) & 4) |
+                ((((B[5] & 8) >> 2) ^ ((B[8] & 4) >> 1) ^ ((B[4] & 1) << 1) ^
+                  (B[5] & 2)) & 2) |
+                ((((B[9] & 4) >> 2) ^ ((B[6] & 8) >> 3) ^ ((B[3] & 2) >> 1) ^
+                  (B[8] & 1)) & 1);
+            int next_A1 = A[10] ^ c->X;
+            if (init)
+                next_A1 ^= c->D ^ ((j % 2) ? in2 : in1);
+            int next_B1 = B[7] ^ B[10] ^ c->Y;
+            if (init)
+                next_B1 ^= (j % 2) ? in1 : in2;
+            if (c->p)
+                next_B1 = ((next_B1 << 1) | ((next_B1 >> 3) & 1)) & 0xf;
+            c->D = c->E ^ c->Z ^ extra_B;
+            int next_E = c->F;
+            if (c->q) {
+                c->F = c->Z + c->E + c->r;
+                c->r = (c->F >> 4) & 1;
+                c->F &= 0xf;
+            } else
+                c->F = c->E;
+            c->E = next_E;
+            for (int k = 10; k > 1; k--) {
+                A[k] = A[k - 1];
+                B[k] = B[k - 1];
+            }
+            A[1] = next_A1;
+            B[1] = next_B1;
+            c->X = ((s4 & 1) << 3) | ((s3 & 1) << 2) | (s2 & 2) |
+                   ((s1 & 2) >> 1);
+            c->Y = ((s6 & 1) << 3) | ((s5 & 1) << 2) | (s4 & 2) |
+                   ((s3 & 2) >> 1);
+            c->Z = ((s2 & 1) << 3) | ((s1 & 1) << 2) | (s6 & 2) |
+                   ((s5 & 2) >> 1);
+            c->p = (s7 & 2) >> 1;
+            c->q = s7 & 1;
+            op = (op << 2) ^ ((((c->D ^ (c->D >> 1)) >> 1) & 2) |
+                              ((c->D ^ (c->D >> 1)) & 1));
+        }
+        out[i] = init ? in[i] : op;
+    }
+#undef BIT
+}
+
+/** descrambles a payload in place */
+static void ref_descramble(const uint8_t cw[8], uint8_t *payload, size_t size)
+{
+    uint8_t kk[57], ib[8], stream[8], block[8];
+    struct ref_stream c;
+    size_t n = size / 8, residue = size % 8;
+    if (!n)
+        return;
+
+    ref_key_schedule(kk, cw);
+    ref_stream_cipher(&c, true, cw, payload, ib);
+    for (size_t i = 1; i <= n; i++) {
+        ref_block_decipher(kk, ib, block);
+        if (i != n) {
+            ref_stream_cipher(&c, false, cw, NULL, stream);
+            for (int j = 0; j < 8; j++)
+                ib[j] = payload[8 * i + j] ^ stream[j];
+        } else
+            memset(ib, 0, 8);
+        for (int j = 0; j < 8; j++)
+            payload[8 * (i - 1) + j] = ib[j] ^ block[j];
+    }
+    if (residue) {
+        ref_stream_cipher(&c, false, cw, NULL, stream);
+        for (size_t j = 0; j < residue; j++)
+            payload[size - residue + j] ^= stream[j];
+    }
+}
+
+/** expected output packets */
+static uint8_t expected[NB_PACKETS][TS_SIZE];
+static unsigned int nb_expected = 0;
+static unsigned int nb_packets = 0;
+static uint64_t now = 0;
+static uint64_t period = UCLOCK_FREQ / 10000;
+static uint8_t cc = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_NEED_UPUMP_MGR:
+        case UPROBE_LOG:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    assert(nb_packets < nb_expected);
+    uint8_t buffer[TS_SIZE];
+    const uint8_t *ts = uref_block_peek(uref, 0, TS_SIZE, buffer);
+    assert(ts != NULL);
+    assert(!ts_get_scrambling(ts));
+    assert(!memcmp(ts, expected[nb_packets], TS_SIZE));
+    ubase_assert(uref_block_peek_unmap(uref, 0, buffer, ts));
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** sends a TS packet, scrambled if scrambling is not 0
+ *
+ * @param af_size size of the adaptation field, or 0
+ * @param scrambling scrambling_control bits
+ * @param output true if the packet is expected at the output
+ */
+static void send_ts(unsigned int af_size, uint8_t scrambling, bool output)
+{
+    uint8_t ts[TS_SIZE];
+    ts_init(ts);
+    ts_set_pid(ts, PID);
+    ts_set_payload(ts);
+    ts_set_cc(ts, cc++);
+    if (af_size)
+        ts_set_adaptation(ts, af_size - 1);
+    for (unsigned int i = TS_HEADER_SIZE + af_size; i < TS_SIZE; i++)
+        ts[i] = rand();
+
+    if (output) {
+        assert(nb_expected < NB_PACKETS);
+        memcpy(expected[nb_expected++], ts, TS_SIZE);
+    }
+
+    if (scrambling) {
+        ts_set_scrambling(ts, scrambling);
+        upipe_ts_csa_scramble(scrambling & 1 ? &key_odd : &key_even,
+                              ts + TS_HEADER_SIZE + af_size,
+                              TS_SIZE - TS_HEADER_SIZE - af_size);
+    }
+
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    memcpy(buffer, ts, TS_SIZE);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, now);
+    now += period;
+    upipe_input(upipe_ts_csa, uref, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    upipe_ts_csa_key_init(&key_even, cw_even);
+    upipe_ts_csa_key_init(&key_odd, cw_odd);
+
+    /* cross-check with the reference, including payloads shorter than a
+     * block and payloads with a residue */
+    for (int n = 0; n < 256; n++) {
+        uint8_t cw[UPIPE_TS_CSA_CW_SIZE];
+        for (int i = 0; i < UPIPE_TS_CSA_CW_SIZE; i++)
+            cw[i] = rand();
+        struct upipe_ts_csa_key ref_key;
+        upipe_ts_csa_key_init(&ref_key, cw);
+
+        uint8_t payload[TS_SIZE - TS_HEADER_SIZE], clear[sizeof(payload)];
+        size_t size = n < 185 ? n : rand() % (sizeof(payload) + 1);
+        for (int i = 0; i < sizeof(payload); i++)
+            clear[i] = payload[i] = rand();
+        upipe_ts_csa_scramble(&ref_key, payload, size);
+        ref_descramble(cw, payload, size);
+        assert(!memcmp(payload, clear, sizeof(payload)));
+    }
+
+    /* the cipher alone: a batch gives the same result as single packets */
+    uint8_t payloads[UPIPE_TS_CSA_BATCH][TS_SIZE];
+    uint8_t clear[UPIPE_TS_CSA_BATCH][TS_SIZE];
+    uint8_t *pointers[UPIPE_TS_CSA_BATCH];
+    size_t sizes[UPIPE_TS_CSA_BATCH];
+    for (int i = 0; i < UPIPE_TS_CSA_BATCH; i++) {
+        sizes[i] = TS_SIZE - TS_HEADER_SIZE - (i * 7) % 184;
+        pointers[i] = payloads[i];
+        for (int j = 0; j < TS_SIZE; j++)
+            clear[i][j] = payloads[i][j] = rand();
+        upipe_ts_csa_scramble(&key_even, payloads[i], sizes[i]);
+        if (sizes[i] >= 8)
+            assert(memcmp(payloads[i], clear[i], sizes[i]));
+    }
+    upipe_ts_csa_descramble(&key_even, pointers, sizes, UPIPE_TS_CSA_BATCH);
+    for (int i = 0; i < UPIPE_TS_CSA_BATCH; i++)
+        assert(!memcmp(payloads[i], clear[i], TS_SIZE));
+
+    struct upipe_mgr *upipe_ts_csa_mgr = upipe_ts_csa_mgr_alloc();
+    assert(upipe_ts_csa_mgr != NULL);
+    upipe_ts_csa = upipe_void_alloc(upipe_ts_csa_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts csa"));
+    assert(upipe_ts_csa != NULL);
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_csa, uref));
+    uref_free(uref);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(upipe_sink != NULL);
+    ubase_assert(upipe_set_output(upipe_ts_csa, upipe_sink));
+
+    unsigned int batch;
+    ubase_assert(upipe_ts_csa_get_batch(upipe_ts_csa, &batch));
+    assert(batch == UPIPE_TS_CSA_BATCH);
+    ubase_nassert(upipe_ts_csa_set_batch(upipe_ts_csa, 0));
+    ubase_nassert(upipe_ts_csa_set_batch(upipe_ts_csa,
+                                         UPIPE_TS_CSA_BATCH + 1));
+
+    /* no key yet: scrambled packets are dropped, clear ones go through */
+    send_ts(0, 0x2, false);
+    send_ts(0, 0, true);
+    assert(nb_packets == 1);
+
+    ubase_assert(upipe_ts_csa_set_cw(upipe_ts_csa, false, cw_even));
+    ubase_assert(upipe_ts_csa_set_cw(upipe_ts_csa, true, cw_odd));
+
+    /* packets are held until the batch is full */
+    for (int i = 0; i < UPIPE_TS_CSA_BATCH - 1; i++)
+        send_ts(0, 0x2, true);
+    assert(nb_packets == 1);
+    send_ts(0, 0x2, true);
+    assert(nb_packets == nb_expected);
+
+    /* a change of key or a clear packet outputs the batch */
+    for (int i = 0; i < 10; i++)
+        send_ts(0, 0x2, true);
+    send_ts(0, 0x3, true);
+    assert(nb_packets == nb_expected - 1);
+    send_ts(0, 0, true);
+    assert(nb_packets == nb_expected);
+
+    /* adaptation fields, residues and unscrambled short payloads */
+    ubase_assert(upipe_ts_csa_set_batch(upipe_ts_csa, 16));
+    for (unsigned int af_size = 1; af_size < TS_SIZE - TS_HEADER_SIZE;
+         af_size += 3)
+        send_ts(af_size, af_size % 2 ? 0x3 : 0x2, true);
+    ubase_assert(upipe_flush(upipe_ts_csa));
+    assert(nb_packets == nb_expected);
+
+    /* the batch is output when it spans more than 40 ms */
+    ubase_assert(upipe_ts_csa_set_batch(upipe_ts_csa, UPIPE_TS_CSA_BATCH));
+    period = UCLOCK_FREQ / 1000;
+    for (int i = 0; i < 40; i++)
+        send_ts(0, 0x3, true);
+    assert(nb_packets < nb_expected);
+    send_ts(0, 0x3, true);
+    assert(nb_packets == nb_expected);
+
+    /* a new key first outputs the batch scrambled with the previous one */
+    send_ts(0, 0x3, true);
+    ubase_assert(upipe_ts_csa_set_cw(upipe_ts_csa, true, cw_even));
+    assert(nb_packets == nb_expected);
+    upipe_ts_csa_key_init(&key_odd, cw_even);
+    send_ts(0, 0x3, true);
+
+    upipe_release(upipe_ts_csa);
+    assert(nb_packets == nb_expected);
+
+    test_free(upipe_sink);
+    upipe_mgr_release(upipe_ts_csa_mgr); // nop
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
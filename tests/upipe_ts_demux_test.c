@@ -36,6 +36,7 @@
 #include <upipe/uprobe_ubuf_mem.h>
 #include <upipe/umem.h>
 #include <upipe/umem_alloc.h>
+#include <upipe/uclock.h>
 #include <upipe/udict.h>
 #include <upipe/udict_inline.h>
 #include <upipe/ubuf.h>
@@ -45,9 +46,11 @@
 #include <upipe/uref_flow.h>
 #include <upipe/uref_block_flow.h>
 #include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
 #include <upipe/uref_std.h>
 #include <upipe/upipe.h>
 #include <upipe-ts/upipe_ts_demux.h>
+#include <upipe-ts/upipe_ts_psi_cache.h>
 #include <upipe-ts/upipe_ts_pat_decoder.h>
 #include <upipe-ts/upipe_ts_pmt_decoder.h>
 #include <upipe-ts/uref_ts_flow.h>
@@ -70,12 +73,19 @@
 #define UREF_POOL_DEPTH 0
 #define UBUF_POOL_DEPTH 0
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+/** interval between PCRs of the jitter test (40 ms) */
+#define PCR_INTERVAL (UCLOCK_FREQ / 25)
+/** drift of the local clock (+100 ppm) */
+#define PCR_DRIFT (PCR_INTERVAL / 10000)
+/** delay of every tenth PCR (500 us) */
+#define PCR_JITTER (UCLOCK_FREQ / 2000)
 
 static struct upipe *upipe_ts_demux;
 static struct upipe *upipe_ts_demux_output_pmt = NULL;
 static struct upipe *upipe_ts_demux_output_video = NULL;
 static struct uprobe *logger;
 static uint64_t wanted_flow_id;
+static uint64_t wanted_es_id;
 static int expect_new_flow_def = 0;
 
 /** definition of our uprobe */
@@ -103,7 +113,8 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
                    flow_def != NULL) {
                 uint64_t flow_id;
                 ubase_assert(uref_flow_get_id(flow_def, &flow_id));
-                assert(flow_id == wanted_flow_id);
+                assert(flow_id == (upipe == upipe_ts_demux ?
+                                   wanted_flow_id : wanted_es_id));
                 const char *def;
                 ubase_assert(uref_flow_get_def(flow_def, &def));
                 if (!ubase_ncmp(def, "void.")) {
@@ -124,8 +135,10 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
                 } else if (!ubase_ncmp(def, "block.mpeg2video")) {
                     if (upipe_ts_demux_output_video != NULL)
                         upipe_release(upipe_ts_demux_output_video);
+                    /* the program may still be being allocated when it
+                     * is warm started from the PSI cache */
                     upipe_ts_demux_output_video =
-                        upipe_flow_alloc_sub(upipe_ts_demux_output_pmt,
+                        upipe_flow_alloc_sub(upipe,
                             uprobe_pfx_alloc(uprobe_use(logger),
                                              UPROBE_LOG_LEVEL,
                                              "ts demux video"),
@@ -143,180 +156,168 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
-int main(int argc, char *argv[])
+/** sends a TS packet carrying a PAT with a single program on PID 42 */
+static void send_pat(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                     uint16_t program, uint8_t version, uint8_t cc)
 {
-    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
-    assert(umem_mgr != NULL);
-    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
-                                                         umem_mgr, -1, -1);
-    assert(udict_mgr != NULL);
-    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
-                                                   0);
-    assert(uref_mgr != NULL);
-    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
-                                                         UBUF_POOL_DEPTH,
-                                                         umem_mgr, -1, 0);
-    assert(ubuf_mgr != NULL);
-    struct uprobe uprobe;
-    uprobe_init(&uprobe, catch, NULL);
-    logger = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_LEVEL);
-    assert(logger != NULL);
-    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
-    assert(logger != NULL);
-    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr,
-                                   UBUF_POOL_DEPTH, UBUF_POOL_DEPTH);
-    assert(logger != NULL);
-
-    struct upipe_mgr *upipe_mpgvf_mgr = upipe_mpgvf_mgr_alloc();
-    assert(upipe_mpgvf_mgr != NULL);
-
-    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
-    assert(upipe_ts_demux_mgr != NULL);
-    ubase_assert(upipe_ts_demux_mgr_set_mpgvf_mgr(upipe_ts_demux_mgr,
-                                                  upipe_mpgvf_mgr));
-
-    struct uref *uref;
-    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
-    assert(uref != NULL);
-
-    upipe_ts_demux = upipe_void_alloc(upipe_ts_demux_mgr,
-            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "ts demux"));
-    assert(upipe_ts_demux != NULL);
-    ubase_assert(upipe_set_flow_def(upipe_ts_demux, uref));
-    uref_free(uref);
-
-    uint8_t *buffer, *payload, *pat_program, *pmt_es;
-    int size;
-
-    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
     assert(uref != NULL);
-    size = -1;
+    uint8_t *buffer, *payload, *pat_program;
+    int size = -1;
     ubase_assert(uref_block_write(uref, 0, &size, &buffer));
     assert(size == TS_SIZE);
     ts_init(buffer);
     ts_set_unitstart(buffer);
     ts_set_pid(buffer, 0);
-    ts_set_cc(buffer, 0);
+    ts_set_cc(buffer, cc);
     ts_set_payload(buffer);
     payload = ts_payload(buffer);
     *payload++ = 0; /* pointer_field */
     pat_init(payload);
     pat_set_length(payload, PAT_PROGRAM_SIZE);
     pat_set_tsid(payload, 42);
-    psi_set_version(payload, 0);
+    psi_set_version(payload, version);
     psi_set_current(payload);
     psi_set_section(payload, 0);
     psi_set_lastsection(payload, 0);
     pat_program = pat_get_program(payload, 0);
     patn_init(pat_program);
-    patn_set_program(pat_program, 12);
+    patn_set_program(pat_program, program);
     patn_set_pid(pat_program, 42);
     psi_set_crc(payload);
     payload += PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE;
     *payload = 0xff;
     uref_block_unmap(uref, 0);
-    wanted_flow_id = 12;
-    expect_new_flow_def = 1;
     upipe_input(upipe_ts_demux, uref, NULL);
+}
 
-    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+/** sends a TS packet carrying a PMT with a single MPEG-2 video ES, on PID 42
+ */
+static void send_pmt(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                     uint16_t program, uint8_t version, uint16_t es_pid,
+                     uint8_t cc)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
     assert(uref != NULL);
-    size = -1;
+    uint8_t *buffer, *payload, *pmt_es;
+    int size = -1;
     ubase_assert(uref_block_write(uref, 0, &size, &buffer));
     assert(size == TS_SIZE);
     ts_init(buffer);
     ts_set_unitstart(buffer);
     ts_set_pid(buffer, 42);
-    ts_set_cc(buffer, 0);
+    ts_set_cc(buffer, cc);
     ts_set_payload(buffer);
     payload = ts_payload(buffer);
     *payload++ = 0; /* pointer_field */
     pmt_init(payload);
     pmt_set_length(payload, PMT_ES_SIZE);
-    pmt_set_program(payload, 12);
-    psi_set_version(payload, 0);
+    pmt_set_program(payload, program);
+    psi_set_version(payload, version);
     psi_set_current(payload);
     psi_set_section(payload, 0);
     psi_set_lastsection(payload, 0);
-    pmt_set_pcrpid(payload, 43);
+    pmt_set_pcrpid(payload, es_pid);
     pmt_set_desclength(payload, 0);
     pmt_es = pmt_get_es(payload, 0);
     pmtn_init(pmt_es);
-    pmtn_set_pid(pmt_es, 43);
+    pmtn_set_pid(pmt_es, es_pid);
     pmtn_set_streamtype(pmt_es, 2);
     pmtn_set_desclength(pmt_es, 0);
     psi_set_crc(payload);
     payload += PMT_HEADER_SIZE + PMT_ES_SIZE + PSI_CRC_SIZE;
     *payload = 0xff;
     uref_block_unmap(uref, 0);
-    wanted_flow_id = 43;
-    expect_new_flow_def = 1;
     upipe_input(upipe_ts_demux, uref, NULL);
-    assert(!expect_new_flow_def);
+}
 
-    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+/** sends a TS packet carrying only a PCR on PID 43 */
+static void send_pcr(struct uref_mgr *uref_mgr, struct ubuf_mgr *ubuf_mgr,
+                     uint64_t pcr, uint64_t cr_sys)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
     assert(uref != NULL);
-    size = -1;
+    uint8_t *buffer;
+    int size = -1;
     ubase_assert(uref_block_write(uref, 0, &size, &buffer));
     assert(size == TS_SIZE);
     ts_init(buffer);
-    ts_set_unitstart(buffer);
-    ts_set_pid(buffer, 0);
-    ts_set_cc(buffer, 1);
-    ts_set_payload(buffer);
-    payload = ts_payload(buffer);
-    *payload++ = 0; /* pointer_field */
-    pat_init(payload);
-    pat_set_length(payload, PAT_PROGRAM_SIZE);
-    pat_set_tsid(payload, 42);
-    psi_set_version(payload, 1);
-    psi_set_current(payload);
-    psi_set_section(payload, 0);
-    psi_set_lastsection(payload, 0);
-    pat_program = pat_get_program(payload, 0);
-    patn_init(pat_program);
-    patn_set_program(pat_program, 13);
-    patn_set_pid(pat_program, 42);
-    psi_set_crc(payload);
-    payload += PAT_HEADER_SIZE + PAT_PROGRAM_SIZE + PSI_CRC_SIZE;
-    *payload = 0xff;
+    ts_set_pid(buffer, 43);
+    ts_set_cc(buffer, 0);
+    ts_set_adaptation(buffer, TS_SIZE - TS_HEADER_SIZE - 1);
+    tsaf_set_pcr(buffer, pcr / 300);
+    tsaf_set_pcrext(buffer, pcr % 300);
     uref_block_unmap(uref, 0);
-    wanted_flow_id = 13;
+    uref_clock_set_cr_sys(uref, cr_sys);
     upipe_input(upipe_ts_demux, uref, NULL);
+}
 
-    uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    logger = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr,
+                                   UBUF_POOL_DEPTH, UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct upipe_mgr *upipe_mpgvf_mgr = upipe_mpgvf_mgr_alloc();
+    assert(upipe_mpgvf_mgr != NULL);
+
+    struct upipe_mgr *upipe_ts_demux_mgr = upipe_ts_demux_mgr_alloc();
+    assert(upipe_ts_demux_mgr != NULL);
+    ubase_assert(upipe_ts_demux_mgr_set_mpgvf_mgr(upipe_ts_demux_mgr,
+                                                  upipe_mpgvf_mgr));
+
+    struct uref *uref;
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
     assert(uref != NULL);
-    size = -1;
-    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
-    assert(size == TS_SIZE);
-    ts_init(buffer);
-    ts_set_unitstart(buffer);
-    ts_set_pid(buffer, 42);
-    ts_set_cc(buffer, 1);
-    ts_set_payload(buffer);
-    payload = ts_payload(buffer);
-    *payload++ = 0; /* pointer_field */
-    pmt_init(payload);
-    pmt_set_length(payload, PMT_ES_SIZE);
-    pmt_set_program(payload, 13);
-    psi_set_version(payload, 0);
-    psi_set_current(payload);
-    psi_set_section(payload, 0);
-    psi_set_lastsection(payload, 0);
-    pmt_set_pcrpid(payload, 43);
-    pmt_set_desclength(payload, 0);
-    pmt_es = pmt_get_es(payload, 0);
-    pmtn_init(pmt_es);
-    pmtn_set_pid(pmt_es, 43);
-    pmtn_set_streamtype(pmt_es, 2);
-    pmtn_set_desclength(pmt_es, 0);
-    psi_set_crc(payload);
-    payload += PMT_HEADER_SIZE + PMT_ES_SIZE + PSI_CRC_SIZE;
-    *payload = 0xff;
-    uref_block_unmap(uref, 0);
-    wanted_flow_id = 43;
+
+    upipe_ts_demux = upipe_void_alloc(upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "ts demux"));
+    assert(upipe_ts_demux != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_demux, uref));
+    uref_free(uref);
+
+    /* the PAT and PMTs are stored into the cache as they are received */
+    struct upipe_ts_psi_cache *psi_cache = upipe_ts_psi_cache_alloc();
+    assert(psi_cache != NULL);
+    ubase_assert(upipe_ts_demux_set_psi_cache(upipe_ts_demux, psi_cache,
+                                              "test"));
+
+    uint8_t *buffer, *payload;
+    int size;
+
+    wanted_flow_id = 12;
     expect_new_flow_def = 1;
-    upipe_input(upipe_ts_demux, uref, NULL);
+    send_pat(uref_mgr, ubuf_mgr, 12, 0, 0);
+
+    wanted_es_id = 43;
+    expect_new_flow_def = 1;
+    send_pmt(uref_mgr, ubuf_mgr, 12, 0, 43, 0);
+    assert(!expect_new_flow_def);
+
+    wanted_flow_id = 13;
+    send_pat(uref_mgr, ubuf_mgr, 13, 1, 1);
+
+    wanted_es_id = 43;
+    expect_new_flow_def = 1;
+    send_pmt(uref_mgr, ubuf_mgr, 13, 0, 43, 1);
     assert(!expect_new_flow_def);
 
     uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
@@ -392,9 +393,101 @@ int main(int argc, char *argv[])
     upipe_input(upipe_ts_demux, uref, NULL);
     assert(!expect_new_flow_def);
 
+    struct upipe_ts_demux_pcr_stats pcr_stats;
+    ubase_assert(upipe_ts_demux_program_get_pcr_stats(upipe_ts_demux_output_pmt,
+                                                      &pcr_stats));
+    assert(pcr_stats.pcrs == 1);
+    /* the first PCR has no predecessor, hence no interval */
+    assert(pcr_stats.discontinuities == 0);
+    assert(pcr_stats.interval_min == UINT64_MAX);
+    assert(pcr_stats.interval_max == 0);
+    assert(pcr_stats.jitters == 0);
+    assert(upipe_ts_demux_pcr_stats_percentile(&pcr_stats, 99) == 0);
+
+    /* PCRs every 40 ms received by a local clock running 100 ppm fast,
+     * with every tenth PCR delayed by 500 us */
+    ubase_assert(upipe_ts_demux_program_reset_pcr_stats(
+                upipe_ts_demux_output_pmt));
+    for (int i = 0; i <= 100; i++)
+        send_pcr(uref_mgr, ubuf_mgr, 27000000 + (i + 1) * PCR_INTERVAL,
+                 UINT32_MAX + i * (PCR_INTERVAL + PCR_DRIFT) +
+                 (i % 10 == 5 ? PCR_JITTER : 0));
+    ubase_assert(upipe_ts_demux_program_get_pcr_stats(upipe_ts_demux_output_pmt,
+                                                      &pcr_stats));
+    assert(pcr_stats.pcrs == 101);
+    assert(pcr_stats.discontinuities == 0);
+    assert(pcr_stats.interval_min == PCR_INTERVAL);
+    assert(pcr_stats.interval_max == PCR_INTERVAL);
+    assert(pcr_stats.jitters == 100);
+    assert(pcr_stats.jitter_min == PCR_DRIFT - PCR_JITTER);
+    assert(pcr_stats.jitter_max == PCR_DRIFT + PCR_JITTER);
+    /* 80 jitters of 4 us, 10 of 504 us and 10 of 496 us */
+    for (int i = 0; i < UPIPE_TS_DEMUX_PCR_JITTER_BUCKETS; i++)
+        assert(pcr_stats.jitter_histogram[i] ==
+               (i == 3 ? 80 : i == 9 ? 20 : 0));
+    assert(upipe_ts_demux_pcr_stats_percentile(&pcr_stats, 50) == 8);
+    assert(upipe_ts_demux_pcr_stats_percentile(&pcr_stats, 80) == 8);
+    assert(upipe_ts_demux_pcr_stats_percentile(&pcr_stats, 81) == 512);
+    assert(upipe_ts_demux_pcr_stats_percentile(&pcr_stats, 99) == 512);
+    assert(pcr_stats.drift_ppm > 99.99 && pcr_stats.drift_ppm < 100.01);
+
+    upipe_release(upipe_ts_demux_output_video);
+    upipe_release(upipe_ts_demux_output_pmt);
+    upipe_release(upipe_ts_demux);
+    upipe_ts_demux_output_video = NULL;
+    upipe_ts_demux_output_pmt = NULL;
+
+    /* a new demux is warm started from the cache, before any TS packet */
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    upipe_ts_demux = upipe_void_alloc(upipe_ts_demux_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts demux cached"));
+    assert(upipe_ts_demux != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_demux, uref));
+    uref_free(uref);
+
+    wanted_flow_id = 13;
+    wanted_es_id = 43;
+    expect_new_flow_def = 2;
+    ubase_assert(upipe_ts_demux_set_psi_cache(upipe_ts_demux, psi_cache,
+                                              "test"));
+    assert(upipe_ts_demux_output_pmt != NULL);
+    assert(upipe_ts_demux_output_video != NULL);
+    struct upipe *output_pmt = upipe_ts_demux_output_pmt;
+    struct upipe *output_video = upipe_ts_demux_output_video;
+    expect_new_flow_def = 0;
+
+    /* the same PAT is received and keeps the cached program */
+    send_pat(uref_mgr, ubuf_mgr, 13, 1, 0);
+    assert(upipe_ts_demux_output_pmt == output_pmt);
+    assert(upipe_ts_demux_output_video == output_video);
+
+    /* a different PMT is received and replaces the cached one */
+    wanted_es_id = 44;
+    expect_new_flow_def = 1;
+    send_pmt(uref_mgr, ubuf_mgr, 13, 1, 44, 0);
+    assert(!expect_new_flow_def);
+    assert(upipe_ts_demux_output_pmt == output_pmt);
+    struct uref *flow_def;
+    uint64_t flow_id;
+    ubase_assert(upipe_get_flow_def(upipe_ts_demux_output_video, &flow_def));
+    ubase_assert(uref_flow_get_id(flow_def, &flow_id));
+    assert(flow_id == 44);
+
+    /* and the cache follows */
+    const uint8_t *table;
+    size_t table_size;
+    ubase_assert(upipe_ts_psi_cache_get(psi_cache, "test", 42, &table,
+                                        &table_size));
+    assert(table_size == PMT_HEADER_SIZE + PMT_ES_SIZE + PSI_CRC_SIZE);
+    assert(psi_get_version(table) == 1);
+    assert(pmtn_get_pid(pmt_get_es((uint8_t *)table, 0)) == 44);
+
     upipe_release(upipe_ts_demux_output_video);
     upipe_release(upipe_ts_demux_output_pmt);
     upipe_release(upipe_ts_demux);
+    upipe_ts_psi_cache_release(psi_cache);
 
     upipe_mgr_release(upipe_ts_demux_mgr);
     upipe_mgr_release(upipe_mpgvf_mgr);
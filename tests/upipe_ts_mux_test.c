@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests and benchmark for TS mux module (file mode, MPTS)
+ *
+ * Usage: upipe_ts_mux_test [<number of frames per input>]
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/uclock.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_sound_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_mux.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+#define UPROBE_LOG_LEVEL UPROBE_LOG_WARNING
+#define NB_PROGRAMS 20
+#define NB_INPUTS_PER_PROGRAM 10
+#define NB_FRAMES 50
+#define FRAME_SAMPLES 1152
+#define FRAME_RATE 48000
+#define FRAME_SIZE 576
+#define FRAME_DURATION (FRAME_SAMPLES * UCLOCK_FREQ / FRAME_RATE)
+#define START_DATE (UINT32_MAX + UCLOCK_FREQ)
+
+static uint64_t nb_packets = 0;
+static uint64_t nb_padding = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_FATAL:
+        case UPROBE_ERROR:
+            assert(0);
+            break;
+        default:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size % TS_SIZE == 0);
+
+    for (int offset = 0; offset < size; offset += TS_SIZE) {
+        uint8_t buffer[TS_HEADER_SIZE];
+        const uint8_t *ts = uref_block_peek(uref, offset, TS_HEADER_SIZE,
+                                            buffer);
+        assert(ts != NULL);
+        assert(ts_validate(ts));
+        if (ts_get_pid(ts) == 8191)
+            nb_padding++;
+        ubase_assert(uref_block_peek_unmap(uref, offset, buffer, ts));
+        nb_packets++;
+    }
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr ts_test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** returns the monotonic time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int nb_frames = NB_FRAMES;
+    if (argc > 1)
+        nb_frames = atoi(argv[1]);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&ts_test_mgr,
+                                                uprobe_use(logger));
+    assert(upipe_sink != NULL);
+
+    /* no uclock is provided, so the mux runs in file mode */
+    struct upipe_mgr *upipe_ts_mux_mgr = upipe_ts_mux_mgr_alloc();
+    assert(upipe_ts_mux_mgr != NULL);
+    struct upipe *upipe_ts_mux = upipe_void_alloc(upipe_ts_mux_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "ts mux"));
+    assert(upipe_ts_mux != NULL);
+    upipe_mgr_release(upipe_ts_mux_mgr);
+
+    struct uref *flow_def = uref_alloc_control(uref_mgr);
+    assert(flow_def != NULL);
+    ubase_assert(uref_flow_set_def(flow_def, "void."));
+    ubase_assert(upipe_set_flow_def(upipe_ts_mux, flow_def));
+    ubase_assert(upipe_ts_mux_set_mode(upipe_ts_mux,
+                                       UPIPE_TS_MUX_MODE_CAPPED));
+    ubase_assert(upipe_ts_mux_set_cr_prog(upipe_ts_mux, 0));
+    ubase_assert(upipe_set_output(upipe_ts_mux, upipe_sink));
+
+    /* 20 programs of 10 MPEG-1 audio streams each */
+    struct upipe *inputs[NB_PROGRAMS * NB_INPUTS_PER_PROGRAM];
+    for (int i = 0; i < NB_PROGRAMS; i++) {
+        struct upipe *program = upipe_void_alloc_sub(upipe_ts_mux,
+                uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                    "program %d", i));
+        assert(program != NULL);
+        ubase_assert(upipe_set_flow_def(program, flow_def));
+
+        for (int j = 0; j < NB_INPUTS_PER_PROGRAM; j++) {
+            struct uref *flow_def_input =
+                uref_block_flow_alloc_def(uref_mgr, "mp2.sound.");
+            assert(flow_def_input != NULL);
+            ubase_assert(uref_block_flow_set_octetrate(flow_def_input,
+                    (uint64_t)FRAME_SIZE * FRAME_RATE / FRAME_SAMPLES));
+            ubase_assert(uref_sound_flow_set_rate(flow_def_input, FRAME_RATE));
+            ubase_assert(uref_sound_flow_set_samples(flow_def_input,
+                                                     FRAME_SAMPLES));
+
+            struct upipe *input = upipe_void_alloc_sub(program,
+                    uprobe_pfx_alloc_va(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                        "input %d.%d", i, j));
+            assert(input != NULL);
+            ubase_assert(upipe_set_flow_def(input, flow_def_input));
+            uref_free(flow_def_input);
+            inputs[i * NB_INPUTS_PER_PROGRAM + j] = input;
+        }
+        upipe_release(program);
+    }
+    uref_free(flow_def);
+
+    double start = now();
+    for (unsigned int frame = 0; frame < nb_frames; frame++) {
+        for (int i = 0; i < NB_PROGRAMS * NB_INPUTS_PER_PROGRAM; i++) {
+            struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                                                 FRAME_SIZE);
+            assert(uref != NULL);
+            uint8_t *buffer;
+            int size = -1;
+            ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+            memset(buffer, i, size);
+            uref_block_unmap(uref, 0);
+
+            uint64_t date = START_DATE + frame * FRAME_DURATION;
+            uref_clock_set_dts_sys(uref, date);
+            uref_clock_set_dts_prog(uref, date - START_DATE + UCLOCK_FREQ);
+            uref_clock_set_dts_pts_delay(uref, 0);
+            uref_clock_set_duration(uref, FRAME_DURATION);
+            uref_block_set_start(uref);
+            upipe_input(inputs[i], uref, NULL);
+        }
+    }
+
+    /* flush the remaining packets */
+    for (int i = 0; i < NB_PROGRAMS * NB_INPUTS_PER_PROGRAM; i++)
+        upipe_release(inputs[i]);
+    upipe_release(upipe_ts_mux);
+    double elapsed = now() - start;
+
+    printf("%"PRIu64" packets (%"PRIu64" padding) in %.3f s: %.0f packets/s\n",
+           nb_packets, nb_padding, elapsed,
+           elapsed > 0 ? nb_packets / elapsed : 0.);
+    /* a PES of two frames takes at least seven TS packets, hence more than
+     * three per frame */
+    assert(nb_packets - nb_padding >=
+           (uint64_t)nb_frames * NB_PROGRAMS * NB_INPUTS_PER_PROGRAM * 3);
+
+    test_free(upipe_sink);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS null packet padding module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_null_strip.h>
+#include <upipe-ts/upipe_ts_null_pad.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define PID 0x100
+#define OCTETRATE (TS_SIZE * 1000)
+#define SLOT (UCLOCK_FREQ / 1000)
+#define NB_PACKETS 1000
+#define BURST 7
+#define PCR_WRAP ((UINT64_C(1) << 33) * 300)
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+
+/** expected output packets */
+static uint8_t expected[NB_PACKETS][TS_SIZE];
+static uint64_t expected_cr_sys[NB_PACKETS];
+static unsigned int nb_expected = 0;
+static unsigned int nb_packets = 0;
+static uint8_t cc = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_LOG:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    assert(nb_packets < nb_expected);
+    uint8_t buffer[TS_SIZE];
+    const uint8_t *ts = uref_block_peek(uref, 0, TS_SIZE, buffer);
+    assert(ts != NULL);
+    assert(!memcmp(ts, expected[nb_packets], TS_SIZE));
+    ubase_assert(uref_block_peek_unmap(uref, 0, buffer, ts));
+    uint64_t cr_sys;
+    ubase_assert(uref_clock_get_cr_sys(uref, &cr_sys));
+    assert(cr_sys == expected_cr_sys[nb_packets]);
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_UNHANDLED;
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            uint64_t octetrate;
+            ubase_assert(uref_block_flow_get_octetrate(flow_def, &octetrate));
+            return UBASE_ERR_NONE;
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** builds a TS packet
+ *
+ * @param ts filled in with the packet
+ * @param null true for a null packet
+ * @param pcr PCR in 27 MHz units, or UINT64_MAX
+ */
+static void build_ts(uint8_t *ts, bool null, uint64_t pcr)
+{
+    if (null) {
+        ts_pad(ts);
+        return;
+    }
+    ts_init(ts);
+    ts_set_pid(ts, PID);
+    ts_set_payload(ts);
+    ts_set_cc(ts, cc++);
+    unsigned int af_size = 0;
+    if (pcr != UINT64_MAX) {
+        af_size = TS_HEADER_SIZE_PCR - TS_HEADER_SIZE;
+        ts_set_adaptation(ts, af_size - 1);
+        tsaf_set_pcr(ts, (pcr / 300) % (UINT64_C(1) << 33));
+        tsaf_set_pcrext(ts, pcr % 300);
+    }
+    for (unsigned int i = TS_HEADER_SIZE + af_size; i < TS_SIZE; i++)
+        ts[i] = rand();
+}
+
+/** sends a TS packet
+ *
+ * @param upipe pipe to send the packet to
+ * @param ts TS packet
+ * @param cr_sys date of the packet
+ */
+static void send_ts(struct upipe *upipe, const uint8_t *ts, uint64_t cr_sys)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    memcpy(buffer, ts, TS_SIZE);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, cr_sys);
+    upipe_input(upipe, uref, NULL);
+}
+
+/** adds an expected output packet
+ *
+ * @param ts TS packet
+ * @param cr_sys expected date of the packet
+ */
+static void expect_ts(const uint8_t *ts, uint64_t cr_sys)
+{
+    assert(nb_expected < NB_PACKETS);
+    memcpy(expected[nb_expected], ts, TS_SIZE);
+    expected_cr_sys[nb_expected++] = cr_sys;
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct upipe_mgr *upipe_ts_null_strip_mgr = upipe_ts_null_strip_mgr_alloc();
+    assert(upipe_ts_null_strip_mgr != NULL);
+    struct upipe *upipe_ts_null_strip = upipe_void_alloc(
+            upipe_ts_null_strip_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts null strip"));
+    assert(upipe_ts_null_strip != NULL);
+
+    struct upipe_mgr *upipe_ts_null_pad_mgr = upipe_ts_null_pad_mgr_alloc();
+    assert(upipe_ts_null_pad_mgr != NULL);
+    struct upipe *upipe_ts_null_pad = upipe_void_alloc_output(
+            upipe_ts_null_strip, upipe_ts_null_pad_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts null pad"));
+    assert(upipe_ts_null_pad != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(upipe_sink != NULL);
+    ubase_assert(upipe_set_output(upipe_ts_null_pad, upipe_sink));
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    ubase_assert(uref_block_flow_set_octetrate(uref, OCTETRATE));
+    ubase_assert(upipe_set_flow_def(upipe_ts_null_strip, uref));
+    uref_free(uref);
+
+    /* stripping then padding gives back the original stream */
+    uint64_t start = UCLOCK_FREQ;
+    for (unsigned int i = 0; i < NB_PACKETS / 2; i++) {
+        uint8_t ts[TS_SIZE];
+        build_ts(ts, i % 3 == 2 || i % 50 > 45,
+                 i % 10 == 1 ? i * SLOT + 12345 : UINT64_MAX);
+        expect_ts(ts, start + i * SLOT);
+        send_ts(upipe_ts_null_strip, ts, start + (i / BURST) * BURST * SLOT);
+    }
+    /* the last null packets are only output with the next packet */
+    while (nb_expected > 0 && expected[nb_expected - 1][1] == 0x1f)
+        nb_expected--;
+    assert(nb_packets == nb_expected);
+
+    uint64_t octetrate;
+    ubase_assert(upipe_ts_null_pad_get_octetrate(upipe_ts_null_pad,
+                                                 &octetrate));
+    assert(octetrate == OCTETRATE);
+
+    upipe_release(upipe_ts_null_strip);
+    upipe_release(upipe_ts_null_pad);
+    assert(nb_packets == nb_expected);
+
+    /* late packets are moved to the next slot and their PCR is corrected */
+    upipe_ts_null_pad = upipe_void_alloc(upipe_ts_null_pad_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "ts null pad"));
+    assert(upipe_ts_null_pad != NULL);
+    ubase_assert(upipe_set_output(upipe_ts_null_pad, upipe_sink));
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_null_pad, uref));
+    uref_free(uref);
+    ubase_assert(upipe_ts_null_pad_set_octetrate(upipe_ts_null_pad,
+                                                 OCTETRATE));
+    ubase_assert(upipe_ts_null_pad_get_octetrate(upipe_ts_null_pad,
+                                                 &octetrate));
+    assert(octetrate == OCTETRATE);
+
+    start = 100 * UCLOCK_FREQ;
+    uint8_t ts[TS_SIZE], ts_out[TS_SIZE], null_ts[TS_SIZE];
+    build_ts(null_ts, true, UINT64_MAX);
+    build_ts(ts, false, UINT64_MAX);
+    expect_ts(ts, start);
+    send_ts(upipe_ts_null_pad, ts, start);
+
+    uint64_t pcr = PCR_WRAP - SLOT / 2;
+    build_ts(ts, false, pcr);
+    build_ts(ts_out, false, UINT64_MAX);
+    memcpy(ts_out, ts, TS_SIZE);
+    tsaf_set_pcr(ts_out, (SLOT / 2) / 300);
+    tsaf_set_pcrext(ts_out, (SLOT / 2) % 300);
+    expect_ts(ts_out, start + SLOT);
+    send_ts(upipe_ts_null_pad, ts, start);
+
+    /* empty slots are filled with null packets */
+    for (int i = 2; i < 5; i++)
+        expect_ts(null_ts, start + i * SLOT);
+    build_ts(ts, false, UINT64_MAX);
+    expect_ts(ts, start + 5 * SLOT);
+    send_ts(upipe_ts_null_pad, ts, start + 5 * SLOT - SLOT / 3);
+    assert(nb_packets == nb_expected);
+
+    /* a long gap restarts the slot clock */
+    build_ts(ts, false, UINT64_MAX);
+    expect_ts(ts, start + 3 * UCLOCK_FREQ);
+    send_ts(upipe_ts_null_pad, ts, start + 3 * UCLOCK_FREQ);
+    assert(nb_packets == nb_expected);
+
+    upipe_release(upipe_ts_null_pad);
+
+    test_free(upipe_sink);
+    upipe_mgr_release(upipe_ts_null_pad_mgr); // nop
+    upipe_mgr_release(upipe_ts_null_strip_mgr); // nop
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
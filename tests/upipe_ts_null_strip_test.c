@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS null packet stripping module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_null_strip.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define PID 0x100
+#define OCTETRATE (TS_SIZE * 1000)
+#define SLOT (UCLOCK_FREQ / 1000)
+#define NB_PACKETS 1000
+#define BURST 7
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static struct upipe *upipe_ts_null_strip;
+static unsigned int nb_packets = 0;
+static uint64_t expected_cr_sys;
+static uint8_t cc = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_LOG:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    uint8_t buffer[TS_HEADER_SIZE];
+    const uint8_t *ts = uref_block_peek(uref, 0, TS_HEADER_SIZE, buffer);
+    assert(ts != NULL);
+    assert(ts_get_pid(ts) == PID);
+    assert(ts_get_cc(ts) == (nb_packets & 0xf));
+    ubase_assert(uref_block_peek_unmap(uref, 0, buffer, ts));
+    uint64_t cr_sys;
+    ubase_assert(uref_clock_get_cr_sys(uref, &cr_sys));
+    assert(cr_sys == expected_cr_sys);
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** sends a TS packet
+ *
+ * @param null true for a null packet
+ * @param cr_sys date of the packet
+ */
+static void send_ts(bool null, uint64_t cr_sys)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    if (null)
+        ts_pad(buffer);
+    else {
+        ts_init(buffer);
+        ts_set_pid(buffer, PID);
+        ts_set_payload(buffer);
+        ts_set_cc(buffer, cc++);
+    }
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, cr_sys);
+    upipe_input(upipe_ts_null_strip, uref, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe_mgr *upipe_ts_null_strip_mgr = upipe_ts_null_strip_mgr_alloc();
+    assert(upipe_ts_null_strip_mgr != NULL);
+    upipe_ts_null_strip = upipe_void_alloc(upipe_ts_null_strip_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts null strip"));
+    assert(upipe_ts_null_strip != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(upipe_sink != NULL);
+    ubase_assert(upipe_set_output(upipe_ts_null_strip, upipe_sink));
+
+    /* without octet rate, dates are kept */
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_null_strip, uref));
+    expected_cr_sys = UCLOCK_FREQ;
+    send_ts(true, UCLOCK_FREQ);
+    send_ts(false, UCLOCK_FREQ);
+    send_ts(true, UCLOCK_FREQ + SLOT);
+    assert(nb_packets == 1);
+
+    /* packets received in bursts are dated with their CBR slot */
+    ubase_assert(uref_block_flow_set_octetrate(uref, OCTETRATE));
+    ubase_assert(upipe_set_flow_def(upipe_ts_null_strip, uref));
+    uref_free(uref);
+    uint64_t start = 2 * UCLOCK_FREQ;
+    for (unsigned int i = 0; i < NB_PACKETS; i++) {
+        uint64_t burst_cr_sys = start + (i / BURST) * BURST * SLOT;
+        expected_cr_sys = start + i * SLOT;
+        send_ts(i % 3 == 0, burst_cr_sys);
+    }
+    assert(nb_packets == 1 + NB_PACKETS - (NB_PACKETS + 2) / 3);
+
+    /* a jump in the input dates resynchronizes the slot clock */
+    start = 10 * UCLOCK_FREQ;
+    expected_cr_sys = start;
+    send_ts(false, start);
+    expected_cr_sys += SLOT;
+    send_ts(false, start);
+
+    /* a flush also resynchronizes */
+    ubase_assert(upipe_flush(upipe_ts_null_strip));
+    expected_cr_sys = start + UCLOCK_FREQ / 20;
+    send_ts(false, expected_cr_sys);
+    assert(nb_packets == 4 + NB_PACKETS - (NB_PACKETS + 2) / 3);
+
+    upipe_release(upipe_ts_null_strip);
+
+    test_free(upipe_sink);
+    upipe_mgr_release(upipe_ts_null_strip_mgr); // nop
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
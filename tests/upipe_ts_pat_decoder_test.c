@@ -368,6 +368,42 @@ int main(int argc, char *argv[])
     assert(!program_sum);
     assert(!pid_sum);
 
+    uint64_t skipped;
+    ubase_assert(upipe_ts_psid_get_skipped(upipe_ts_patd, &skipped));
+    assert(skipped == 0);
+
+    /* unchanged repetition */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                            PAT_HEADER_SIZE + PAT_PROGRAM_SIZE * 2 +
+                            PSI_CRC_SIZE);
+    assert(uref != NULL);
+    size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == PAT_HEADER_SIZE + PAT_PROGRAM_SIZE * 2 + PSI_CRC_SIZE);
+    pat_init(buffer);
+    pat_set_length(buffer, PAT_PROGRAM_SIZE * 2);
+    pat_set_tsid(buffer, tsid);
+    psi_set_version(buffer, 5);
+    psi_set_current(buffer);
+    psi_set_section(buffer, 0);
+    psi_set_lastsection(buffer, 0);
+    pat_program = pat_get_program(buffer, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 13);
+    patn_set_pid(pat_program, 43);
+    pat_program = pat_get_program(buffer, 1);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 14);
+    patn_set_pid(pat_program, 44);
+    psi_set_crc(buffer);
+    uref_block_unmap(uref, 0);
+    systime = UINT32_MAX;
+    uref_clock_set_cr_sys(uref, systime);
+    upipe_input(upipe_ts_patd, uref, NULL);
+    assert(!systime);
+    ubase_assert(upipe_ts_psid_get_skipped(upipe_ts_patd, &skipped));
+    assert(skipped == 1);
+
     upipe_release(upipe_ts_patd);
     assert(!program_sum);
     assert(!pid_sum);
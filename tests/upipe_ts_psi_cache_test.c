@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS PSI cache
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe-ts/upipe_ts_psi_cache.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+int main(int argc, char *argv[])
+{
+    char path[] = "/tmp/upipe_ts_psi_cache_test.XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+
+    struct upipe_ts_psi_cache *cache = upipe_ts_psi_cache_alloc();
+    assert(cache != NULL);
+
+    const uint8_t pat[] = { 0x00, 0xb0, 0x0d, 0x00, 0x2a, 0xc1, 0x00, 0x00,
+                            0x00, 0x0c, 0xe0, 0x2a, 0x01, 0x02, 0x03, 0x04 };
+    const uint8_t pmt[] = { 0x02, 0xb0, 0x05, 0x00, 0x0c, 0xc1, 0x00, 0x00 };
+    const uint8_t *table;
+    size_t size;
+
+    ubase_nassert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.1:1234", 0,
+                                         &table, &size));
+    ubase_assert(upipe_ts_psi_cache_set(cache, "udp://@239.0.0.1:1234", 0,
+                                        pat, sizeof(pat)));
+    ubase_assert(upipe_ts_psi_cache_set(cache, "udp://@239.0.0.1:1234", 42,
+                                        pmt, sizeof(pmt)));
+    ubase_assert(upipe_ts_psi_cache_set(cache, "udp://@239.0.0.2:1234", 0,
+                                        pmt, sizeof(pmt)));
+    ubase_assert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.1:1234", 0,
+                                        &table, &size));
+    assert(size == sizeof(pat) && !memcmp(table, pat, size));
+    ubase_nassert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.1:1234", 43,
+                                         &table, &size));
+
+    /* replace and remove */
+    ubase_assert(upipe_ts_psi_cache_set(cache, "udp://@239.0.0.2:1234", 0,
+                                        pat, sizeof(pat)));
+    ubase_assert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.2:1234", 0,
+                                        &table, &size));
+    assert(size == sizeof(pat) && !memcmp(table, pat, size));
+    ubase_assert(upipe_ts_psi_cache_set(cache, "udp://@239.0.0.1:1234", 42,
+                                        NULL, 0));
+    ubase_nassert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.1:1234", 42,
+                                         &table, &size));
+    ubase_assert(upipe_ts_psi_cache_set(cache, "", 42, pmt, sizeof(pmt)));
+
+    /* save and load */
+    ubase_assert(upipe_ts_psi_cache_save(cache, path));
+    upipe_ts_psi_cache_release(cache);
+
+    cache = upipe_ts_psi_cache_alloc();
+    assert(cache != NULL);
+    ubase_assert(upipe_ts_psi_cache_load(cache, path));
+    ubase_assert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.1:1234", 0,
+                                        &table, &size));
+    assert(size == sizeof(pat) && !memcmp(table, pat, size));
+    ubase_assert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.2:1234", 0,
+                                        &table, &size));
+    assert(size == sizeof(pat) && !memcmp(table, pat, size));
+    ubase_assert(upipe_ts_psi_cache_get(cache, "", 42, &table, &size));
+    assert(size == sizeof(pmt) && !memcmp(table, pmt, size));
+    ubase_nassert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.1:1234", 42,
+                                         &table, &size));
+
+    /* truncated files are rejected without changing the cache */
+    FILE *file = fopen(path, "r+b");
+    assert(file != NULL);
+    assert(!fseek(file, 0, SEEK_END));
+    long file_size = ftell(file);
+    fclose(file);
+    assert(!truncate(path, file_size - 1));
+    ubase_assert(upipe_ts_psi_cache_set(cache, "", 42, NULL, 0));
+    ubase_nassert(upipe_ts_psi_cache_load(cache, path));
+    ubase_nassert(upipe_ts_psi_cache_get(cache, "", 42, &table, &size));
+    ubase_assert(upipe_ts_psi_cache_get(cache, "udp://@239.0.0.1:1234", 0,
+                                        &table, &size));
+
+    upipe_ts_psi_cache_release(cache);
+    unlink(path);
+    return 0;
+}
@@ -75,6 +75,20 @@ static bool nit = false;
 static bool sdt = false;
 static bool eit = false;
 static bool tdt = false;
+/** true when testing the EIT schedule */
+static bool schedule = false;
+/** versions of the received EIT schedule sections, by table and section */
+static int schedule_versions[4][256];
+/** expected last section number of the EIT schedule tables 0x50 and 0x51 */
+static uint8_t schedule_last[2];
+/** number of received EITp/f and EIT schedule sections */
+static unsigned int schedule_nb[2];
+/** cr_sys of the last received EITp/f and EIT schedule section */
+static uint64_t schedule_cr_sys[2];
+/** EITp/f interval of the EIT schedule test */
+#define SCHEDULE_PF_INTERVAL UCLOCK_FREQ
+/** EIT schedule interval of the EIT schedule test */
+#define SCHEDULE_INTERVAL (UCLOCK_FREQ * 3)
 
 static const char *psz_native_encoding = "UTF-8";
 static const char *psz_current_encoding = "";
@@ -164,12 +178,51 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(uref != NULL);
     uint64_t cr;
     ubase_assert(uref_clock_get_cr_sys(uref, &cr));
-    assert(cr == UINT32_MAX);
     const uint8_t *buffer;
     int size = -1;
     ubase_assert(uref_block_read(uref, 0, &size, &buffer));
     upipe_dbg_va(upipe, "received table %"PRIu8, psi_get_tableid(buffer));
     assert(psi_validate(buffer));
+
+    if (schedule) {
+        uint8_t table_id = psi_get_tableid(buffer);
+        if (table_id >= EIT_TABLE_ID_PF_ACTUAL &&
+            table_id <= EIT_TABLE_ID_SCHED_ACTUAL_FIRST + 1) {
+            assert(psi_check_crc(buffer));
+            assert(eit_get_sid(buffer) == 49);
+            uint8_t section = psi_get_section(buffer);
+            int sched = table_id != EIT_TABLE_ID_PF_ACTUAL;
+            if (!sched) {
+                assert(eit_get_last_table_id(buffer) ==
+                       EIT_TABLE_ID_PF_ACTUAL);
+                assert(section <= 1);
+                assert(psi_get_lastsection(buffer) == 1);
+            } else {
+                /* only one section in each segment */
+                assert(eit_get_last_table_id(buffer) ==
+                       EIT_TABLE_ID_SCHED_ACTUAL_FIRST + 1);
+                assert(eit_get_segment_last_sec_number(buffer) == section);
+                assert(psi_get_lastsection(buffer) ==
+                       schedule_last[table_id -
+                                     EIT_TABLE_ID_SCHED_ACTUAL_FIRST]);
+            }
+            /* the sections of each carousel are spread over its interval:
+             * two EITp/f sections, at most three EIT schedule sections */
+            assert(!schedule_nb[sched] ||
+                   cr >= schedule_cr_sys[sched] +
+                         (sched ? SCHEDULE_INTERVAL / 3 :
+                                  SCHEDULE_PF_INTERVAL / 2));
+            schedule_cr_sys[sched] = cr;
+            schedule_versions[table_id - EIT_TABLE_ID_PF_ACTUAL][section] =
+                psi_get_version(buffer);
+            schedule_nb[sched]++;
+        }
+        uref_block_unmap(uref, 0);
+        uref_free(uref);
+        return;
+    }
+
+    assert(cr == UINT32_MAX);
     if (!nit || !sdt || !eit) {
         assert(psi_get_length(buffer) + PSI_HEADER_SIZE == size);
         assert(psi_check_crc(buffer));
@@ -311,10 +364,42 @@ static struct upipe_mgr ts_test_mgr = {
     .upipe_control = test_control
 };
 
-/** helper uclock to test upipe_ts_sig */
+/** helper to define an event in a flow definition */
+static void set_event(struct uref *uref, uint64_t event, uint64_t id,
+                      uint64_t start, const char *name)
+{
+    ubase_assert(uref_event_set_id(uref, id, event));
+    ubase_assert(uref_event_set_start(uref, start, event));
+    ubase_assert(uref_event_set_duration(uref, (uint64_t)1800 * UCLOCK_FREQ,
+                event));
+    ubase_assert(uref_ts_event_set_running_status(uref, 1, event));
+    ubase_assert(uref_event_set_language(uref, "unk", event));
+    ubase_assert(uref_event_set_name(uref, name, event));
+    ubase_assert(uref_event_set_description(uref, "gaga", event));
+}
+
+/** helper to run the EIT carousels for a bit more than the EIT schedule
+ * interval, with the given number of EIT schedule sections */
+static void run_schedule(struct upipe *upipe_ts_sig, uint64_t *cr_sys_p,
+                         unsigned int nb_sched)
+{
+    memset(schedule_versions, -1, sizeof(schedule_versions));
+    schedule_nb[0] = schedule_nb[1] = 0;
+    for (int i = 0; i < 400; i++) {
+        ubase_assert(upipe_ts_mux_prepare(upipe_ts_sig, *cr_sys_p, 0));
+        *cr_sys_p += UCLOCK_FREQ / 100;
+    }
+    /* the EITp/f carousel runs faster than the EIT schedule */
+    assert(schedule_nb[0] >= 6);
+    assert(schedule_nb[1] >= nb_sched && schedule_nb[1] <= nb_sched + 1);
+    assert(schedule_versions[0][0] != -1);
+    assert(schedule_versions[0][1] != -1);
+}
+
+/** helper uclock to test upipe_ts_sig, UINT32_MAX is 1993-10-13 12:45 */
 static uint64_t test_to_real(struct uclock *uclock, uint64_t cr_sys)
 {
-    assert(cr_sys == UINT32_MAX);
+    assert(cr_sys >= UINT32_MAX);
     struct tm tm;
     tm.tm_year = 93;
     tm.tm_mon = 10 - 1;
@@ -323,7 +408,7 @@ static uint64_t test_to_real(struct uclock *uclock, uint64_t cr_sys)
     tm.tm_min = 45;
     tm.tm_sec = 0;
     tm.tm_isdst = 0;
-    return mktime(&tm) * UCLOCK_FREQ;
+    return mktime(&tm) * UCLOCK_FREQ + cr_sys - UINT32_MAX;
 }
 
 int main(int argc, char *argv[])
@@ -456,6 +541,77 @@ int main(int argc, char *argv[])
 
     upipe_release(upipe_ts_sig_service1);
 
+    /* EIT schedule */
+    schedule = true;
+    ubase_assert(upipe_ts_mux_set_tdt_interval(upipe_ts_sig, 0));
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    uint64_t midnight = (uint64_t)mktime(&tm) * UCLOCK_FREQ;
+    uint64_t hour = (uint64_t)3600 * UCLOCK_FREQ;
+
+    uref = uref_alloc_control(uref_mgr);
+    assert(uref != NULL);
+    ubase_assert(uref_flow_set_def(uref, "void."));
+    ubase_assert(uref_flow_set_id(uref, 49));
+    ubase_assert(uref_ts_flow_set_pid(uref, 50));
+    ubase_assert(uref_ts_flow_set_service_type(uref, 1));
+    ubase_assert(uref_ts_flow_set_eit(uref));
+    ubase_assert(uref_ts_flow_set_eit_schedule(uref));
+    ubase_assert(uref_ts_flow_set_running_status(uref, 5));
+    ubase_assert(uref_event_set_events(uref, 3));
+    /* segments 4 and 5 of table 0x50, segment 11 of table 0x51 */
+    set_event(uref, 0, 10, midnight + 12 * hour + hour * 3 / 4, "meuh");
+    set_event(uref, 1, 11, midnight + 15 * hour, "moo");
+    set_event(uref, 2, 12, midnight + 5 * 24 * hour + 10 * hour, "muh");
+
+    struct upipe *upipe_ts_sig_service2 = upipe_void_alloc_sub(upipe_ts_sig,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                   "ts sig service2"));
+    assert(upipe_ts_sig_service2 != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_sig_service2, uref));
+    ubase_assert(upipe_ts_mux_set_eit_interval(upipe_ts_sig_service2,
+                                               SCHEDULE_PF_INTERVAL));
+    ubase_assert(upipe_ts_mux_set_eit_sched_interval(upipe_ts_sig_service2,
+                                                     SCHEDULE_INTERVAL));
+    uint64_t interval;
+    ubase_assert(upipe_ts_mux_get_eit_sched_interval(upipe_ts_sig_service2,
+                                                     &interval));
+    assert(interval == SCHEDULE_INTERVAL);
+
+    /* two segments in the first EIT schedule table and one in the second
+     * one, counted from the current date */
+    schedule_last[0] = 5 * 8;
+    schedule_last[1] = 11 * 8;
+    uint64_t cr_sys = (uint64_t)UINT32_MAX + UCLOCK_FREQ;
+    run_schedule(upipe_ts_sig, &cr_sys, 3);
+    assert(schedule_versions[0][0] == 0);
+    assert(schedule_versions[2][4 * 8] == 0);
+    assert(schedule_versions[2][5 * 8] == 0);
+    assert(schedule_versions[3][11 * 8] == 0);
+
+    /* only the table of the changed event gets a new version */
+    set_event(uref, 2, 12, midnight + 5 * 24 * hour + 10 * hour, "mu");
+    ubase_assert(upipe_set_flow_def(upipe_ts_sig_service2, uref));
+    run_schedule(upipe_ts_sig, &cr_sys, 3);
+    assert(schedule_versions[0][0] == 0);
+    assert(schedule_versions[2][4 * 8] == 0);
+    assert(schedule_versions[2][5 * 8] == 0);
+    assert(schedule_versions[3][11 * 8] == 1);
+
+    /* the next day, the events of the first day are over and the last event
+     * moves to segment 3 of the second table */
+    cr_sys += 24 * hour;
+    schedule_last[1] = 3 * 8;
+    run_schedule(upipe_ts_sig, &cr_sys, 1);
+    assert(schedule_versions[0][0] == 0);
+    for (int i = 0; i < 256; i++)
+        assert(schedule_versions[2][i] == -1);
+    assert(schedule_versions[3][3 * 8] == 2);
+    assert(schedule_versions[3][11 * 8] == -1);
+    uref_free(uref);
+
+    upipe_release(upipe_ts_sig_service2);
+
     upipe_release(upipe_ts_sig);
     upipe_mgr_release(upipe_ts_sig_mgr); // nop
 
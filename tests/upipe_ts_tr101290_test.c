@@ -0,0 +1,516 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS TR 101 290 analyzer module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/uclock.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_tr101290.h>
+#include <upipe-ts/upipe_ts_crc.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/pes.h>
+#include <bitstream/mpeg/psi.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define PMT_PID 0x100
+#define ES_PID 0x101
+/** period of the test loop (20 ms) */
+#define PERIOD (UCLOCK_FREQ / 50)
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static struct upipe *upipe_ts_tr101290;
+static unsigned int nb_packets = 0;
+static unsigned int nb_errors[UPIPE_TS_TR101290_MAX];
+
+/** state of the generated stream */
+static uint64_t now = 0;
+static uint64_t pcr_offset = 0;
+static uint64_t pts_offset = 0;
+static uint8_t cc_pat = 0, cc_pmt = 0, cc_es = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_TS_TR101290_ERROR: {
+            unsigned int signature = va_arg(args, unsigned int);
+            assert(signature == UPIPE_TS_TR101290_SIGNATURE);
+            unsigned int indicator = va_arg(args, unsigned int);
+            unsigned int pid = va_arg(args, unsigned int);
+            assert(indicator < UPIPE_TS_TR101290_MAX);
+            assert(pid <= 8192);
+            nb_errors[indicator]++;
+            break;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == TS_SIZE);
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** sends a TS packet to the analyzer */
+static void send_ts(const uint8_t *ts)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == TS_SIZE);
+    memcpy(buffer, ts, TS_SIZE);
+    uref_block_unmap(uref, 0);
+    uref_clock_set_cr_sys(uref, now);
+    upipe_input(upipe_ts_tr101290, uref, NULL);
+}
+
+/** sends a null packet */
+static void send_null(bool transport_error)
+{
+    uint8_t ts[TS_SIZE];
+    ts_pad(ts);
+    if (transport_error)
+        ts_set_transporterror(ts);
+    send_ts(ts);
+}
+
+/** sends a PSI section in a TS packet */
+static void send_section(uint16_t pid, uint8_t *cc, const uint8_t *section)
+{
+    uint8_t ts[TS_SIZE];
+    memset(ts, 0xff, TS_SIZE);
+    ts_init(ts);
+    ts_set_pid(ts, pid);
+    ts_set_unitstart(ts);
+    ts_set_payload(ts);
+    ts_set_cc(ts, (*cc)++);
+    ts[TS_HEADER_SIZE] = 0;
+    memcpy(ts + TS_HEADER_SIZE + 1, section,
+           psi_get_length(section) + PSI_HEADER_SIZE);
+    send_ts(ts);
+}
+
+/** sends a PSI section split over two TS packets, the first one carrying
+ * only the given number of bytes of the section */
+static void send_section_split(uint16_t pid, uint8_t *cc,
+                               const uint8_t *section, unsigned int first)
+{
+    unsigned int length = psi_get_length(section) + PSI_HEADER_SIZE;
+    assert(first < length && length - first <= TS_SIZE - TS_HEADER_SIZE);
+    uint8_t ts[TS_SIZE];
+    memset(ts, 0xff, TS_SIZE);
+    ts_init(ts);
+    ts_set_pid(ts, pid);
+    ts_set_unitstart(ts);
+    ts_set_payload(ts);
+    ts_set_cc(ts, (*cc)++);
+    ts_set_adaptation(ts, TS_SIZE - TS_HEADER_SIZE - 2 - first);
+    uint8_t *payload = ts_payload(ts);
+    payload[0] = 0;
+    memcpy(payload + 1, section, first);
+    send_ts(ts);
+
+    memset(ts, 0xff, TS_SIZE);
+    ts_init(ts);
+    ts_set_pid(ts, pid);
+    ts_set_payload(ts);
+    ts_set_cc(ts, (*cc)++);
+    memcpy(ts + TS_HEADER_SIZE, section + first, length - first);
+    send_ts(ts);
+}
+
+/** sends two PSI sections in one TS packet */
+static void send_sections(uint16_t pid, uint8_t *cc, const uint8_t *section1,
+                          const uint8_t *section2)
+{
+    unsigned int length1 = psi_get_length(section1) + PSI_HEADER_SIZE;
+    unsigned int length2 = psi_get_length(section2) + PSI_HEADER_SIZE;
+    assert(length1 + length2 <= TS_SIZE - TS_HEADER_SIZE - 1);
+    uint8_t ts[TS_SIZE];
+    memset(ts, 0xff, TS_SIZE);
+    ts_init(ts);
+    ts_set_pid(ts, pid);
+    ts_set_unitstart(ts);
+    ts_set_payload(ts);
+    ts_set_cc(ts, (*cc)++);
+    ts[TS_HEADER_SIZE] = 0;
+    memcpy(ts + TS_HEADER_SIZE + 1, section1, length1);
+    memcpy(ts + TS_HEADER_SIZE + 1 + length1, section2, length2);
+    send_ts(ts);
+}
+
+/** builds a PAT */
+static void make_pat(uint8_t *section, bool bad_crc)
+{
+    pat_init(section);
+    pat_set_length(section, PAT_PROGRAM_SIZE);
+    psi_set_tableidext(section, 1);
+    psi_set_version(section, 0);
+    psi_set_current(section);
+    psi_set_section(section, 0);
+    psi_set_lastsection(section, 0);
+    uint8_t *program = pat_get_program(section, 0);
+    patn_init(program);
+    patn_set_program(program, 1);
+    patn_set_pid(program, PMT_PID);
+    upipe_ts_psi_set_crc(section);
+    if (bad_crc)
+        section[PSI_HEADER_SIZE + psi_get_length(section) - 1] ^= 0xff;
+}
+
+/** sends a PAT */
+static void send_pat(bool bad_crc)
+{
+    uint8_t section[PSI_MAX_SIZE];
+    make_pat(section, bad_crc);
+    send_section(PAT_PID, &cc_pat, section);
+}
+
+/** builds a PMT */
+static void make_pmt(uint8_t *section, bool bad_crc)
+{
+    pmt_init(section);
+    pmt_set_length(section, PMT_ES_SIZE);
+    psi_set_tableidext(section, 1);
+    psi_set_version(section, 0);
+    psi_set_current(section);
+    psi_set_section(section, 0);
+    psi_set_lastsection(section, 0);
+    pmt_set_pcrpid(section, ES_PID);
+    uint8_t *es = pmt_get_es(section, 0);
+    pmtn_init(es);
+    pmtn_set_streamtype(es, 0x2);
+    pmtn_set_pid(es, ES_PID);
+    upipe_ts_psi_set_crc(section);
+    if (bad_crc)
+        section[PSI_HEADER_SIZE + psi_get_length(section) - 1] ^= 0xff;
+}
+
+/** sends a PMT */
+static void send_pmt(void)
+{
+    uint8_t section[PSI_MAX_SIZE];
+    make_pmt(section, false);
+    send_section(PMT_PID, &cc_pmt, section);
+}
+
+/** sends a packet of the elementary stream, starting a PES */
+static void send_es(bool pcr)
+{
+    uint8_t ts[TS_SIZE];
+    memset(ts, 0xff, TS_SIZE);
+    ts_init(ts);
+    ts_set_pid(ts, ES_PID);
+    ts_set_unitstart(ts);
+    ts_set_payload(ts);
+    ts_set_cc(ts, cc_es++);
+    if (pcr) {
+        ts_set_adaptation(ts, TS_HEADER_SIZE_PCR - TS_HEADER_SIZE_AF + 1);
+        uint64_t value = now + pcr_offset;
+        tsaf_set_pcr(ts, value / 300);
+        tsaf_set_pcrext(ts, value % 300);
+    }
+    uint8_t *pes = ts_payload(ts);
+    pes_init(pes);
+    pes_set_streamid(pes, PES_STREAM_ID_VIDEO_MPEG);
+    pes_set_length(pes, 0);
+    pes_set_headerlength(pes, PES_HEADER_SIZE_PTS - PES_HEADER_SIZE_NOPTS);
+    pes_set_pts(pes, (now + pts_offset) / 300);
+    send_ts(ts);
+}
+
+/** runs the stream for the given number of periods; each period has exactly
+ * three packets, so that the bitrate is constant */
+static void run(unsigned int periods, bool psi, bool es, bool pcr)
+{
+    for (unsigned int i = 0; i < periods; i++) {
+        bool has_psi = psi && !((now / PERIOD) % 5);
+        if (has_psi) {
+            send_pat(false);
+            send_pmt();
+        } else {
+            send_null(false);
+            send_null(false);
+        }
+        if (es)
+            send_es(pcr);
+        else
+            send_null(false);
+        now += PERIOD;
+    }
+}
+
+/** checks the number of errors since the last call, and resets them */
+static void check_errors(const unsigned int *expected)
+{
+    struct upipe_ts_tr101290_counters counters;
+    ubase_assert(upipe_ts_tr101290_get_counters(upipe_ts_tr101290,
+                                                &counters));
+    for (int i = 0; i < UPIPE_TS_TR101290_MAX; i++) {
+        if (nb_errors[i] != expected[i] || counters.errors[i] != expected[i])
+            fprintf(stderr, "%s: %u/%"PRIu64" errors, expected %u\n",
+                    upipe_ts_tr101290_indicator_str(i), nb_errors[i],
+                    counters.errors[i], expected[i]);
+        assert(nb_errors[i] == expected[i]);
+        assert(counters.errors[i] == expected[i]);
+        nb_errors[i] = 0;
+    }
+    ubase_assert(upipe_ts_tr101290_reset_counters(upipe_ts_tr101290));
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct uref *uref;
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(upipe_sink != NULL);
+
+    struct upipe_mgr *upipe_ts_tr101290_mgr = upipe_ts_tr101290_mgr_alloc();
+    assert(upipe_ts_tr101290_mgr != NULL);
+    upipe_ts_tr101290 = upipe_void_alloc(upipe_ts_tr101290_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts tr101290"));
+    assert(upipe_ts_tr101290 != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_tr101290, uref));
+    ubase_assert(upipe_set_output(upipe_ts_tr101290, upipe_sink));
+    uref_free(uref);
+
+    unsigned int expected[UPIPE_TS_TR101290_MAX];
+
+    /* clean stream */
+    run(50, true, true, true);
+    assert(nb_packets == 150);
+    struct upipe_ts_tr101290_counters counters;
+    ubase_assert(upipe_ts_tr101290_get_pid_counters(upipe_ts_tr101290,
+                                                    ES_PID, &counters));
+    assert(counters.packets == 50);
+    ubase_nassert(upipe_ts_tr101290_get_pid_counters(upipe_ts_tr101290,
+                                                     0x1234, &counters));
+    memset(expected, 0, sizeof(expected));
+    check_errors(expected);
+
+    /* lost packet */
+    cc_es++;
+    run(5, true, true, true);
+    expected[UPIPE_TS_TR101290_CC] = 1;
+    check_errors(expected);
+    expected[UPIPE_TS_TR101290_CC] = 0;
+
+    /* two corrupted sync bytes, then transport error */
+    uint8_t ts[TS_SIZE];
+    ts_pad(ts);
+    ts[0] = 0;
+    send_ts(ts);
+    send_ts(ts);
+    send_es(true);
+    now += PERIOD;
+    send_null(true);
+    send_null(false);
+    send_es(true);
+    now += PERIOD;
+    run(5, true, true, true);
+    expected[UPIPE_TS_TR101290_SYNC_BYTE] = 2;
+    expected[UPIPE_TS_TR101290_SYNC_LOSS] = 1;
+    expected[UPIPE_TS_TR101290_TRANSPORT] = 1;
+    check_errors(expected);
+    memset(expected, 0, sizeof(expected));
+
+    /* PCRs 60 ms apart */
+    run(2, true, true, false);
+    run(5, true, true, true);
+    expected[UPIPE_TS_TR101290_PCR_REPETITION] = 1;
+    check_errors(expected);
+    expected[UPIPE_TS_TR101290_PCR_REPETITION] = 0;
+
+    /* PCR jump of 10 us */
+    pcr_offset += 270;
+    run(5, true, true, true);
+    expected[UPIPE_TS_TR101290_PCR_ACCURACY] = 1;
+    check_errors(expected);
+    expected[UPIPE_TS_TR101290_PCR_ACCURACY] = 0;
+
+    /* PTS gap of 800 ms */
+    pts_offset += UCLOCK_FREQ * 8 / 10;
+    run(5, true, true, true);
+    expected[UPIPE_TS_TR101290_PTS] = 1;
+    check_errors(expected);
+    expected[UPIPE_TS_TR101290_PTS] = 0;
+
+    /* PAT and PMT missing for 0.8 s, then PAT with a wrong CRC */
+    run(40, false, true, true);
+    send_pat(true);
+    send_null(false);
+    send_es(true);
+    now += PERIOD;
+    run(10, true, true, true);
+    expected[UPIPE_TS_TR101290_PAT] = 1;
+    expected[UPIPE_TS_TR101290_PMT] = 1;
+    expected[UPIPE_TS_TR101290_CRC] = 1;
+    check_errors(expected);
+    memset(expected, 0, sizeof(expected));
+
+    /* PMT with a wrong CRC split over two packets, then a correct PAT
+     * followed by a PAT with a wrong CRC in the same packet */
+    uint8_t section[PSI_MAX_SIZE], section2[PSI_MAX_SIZE];
+    make_pmt(section, true);
+    send_section_split(PMT_PID, &cc_pmt, section, 5);
+    send_es(true);
+    now += PERIOD;
+    make_pat(section, false);
+    make_pat(section2, true);
+    send_sections(PAT_PID, &cc_pat, section, section2);
+    send_null(false);
+    send_es(true);
+    now += PERIOD;
+    run(5, true, true, true);
+    expected[UPIPE_TS_TR101290_CRC] = 2;
+    check_errors(expected);
+    expected[UPIPE_TS_TR101290_CRC] = 0;
+
+    /* elementary stream missing for 6 s */
+    run(300, true, false, false);
+    run(5, true, true, true);
+    expected[UPIPE_TS_TR101290_PID] = 1;
+    expected[UPIPE_TS_TR101290_PCR_DISCONTINUITY] = 1;
+    expected[UPIPE_TS_TR101290_PTS] = 1;
+    check_errors(expected);
+
+    upipe_release(upipe_ts_tr101290);
+    test_free(upipe_sink);
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -64,6 +64,7 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
 
 static uint64_t cr_dts_delay = UINT64_MAX;
+static uint64_t underflow = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -79,6 +80,14 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_SYNC_LOST:
         case UPROBE_NEW_FLOW_DEF:
             break;
+        case UPROBE_TS_TSTD_UNDERFLOW: {
+            unsigned int signature = va_arg(args, unsigned int);
+            assert(signature == UPIPE_TS_TSTD_SIGNATURE);
+            uint64_t dts_prog = va_arg(args, uint64_t);
+            assert(dts_prog == 7 * UCLOCK_FREQ / 10);
+            underflow = va_arg(args, uint64_t);
+            break;
+        }
     }
     return UBASE_ERR_NONE;
 }
@@ -177,6 +186,7 @@ int main(int argc, char *argv[])
     ubase_assert(upipe_set_flow_def(upipe_ts_tstd, uref));
     ubase_assert(upipe_set_output(upipe_ts_tstd, upipe_sink));
     uref_free(uref);
+    ubase_assert(upipe_ts_tstd_set_trace_size(upipe_ts_tstd, 4));
 
     uref = uref_block_alloc(uref_mgr, ubuf_mgr, 10);
     assert(uref != NULL);
@@ -226,6 +236,34 @@ int main(int argc, char *argv[])
     upipe_input(upipe_ts_tstd, uref, NULL);
     assert(cr_dts_delay == UCLOCK_FREQ / 5);
 
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 60);
+    assert(uref != NULL);
+    uref_clock_set_dts_prog(uref, 7 * UCLOCK_FREQ / 10);
+    cr_dts_delay = UINT64_MAX;
+    upipe_input(upipe_ts_tstd, uref, NULL);
+    assert(cr_dts_delay == 0);
+    assert(underflow == 30);
+
+    struct upipe_ts_tstd_sample samples[8];
+    unsigned int nb = 8;
+    ubase_assert(upipe_ts_tstd_get_trace(upipe_ts_tstd, samples, &nb));
+    assert(nb == 4);
+    assert(samples[0].dts_prog == 4 * UCLOCK_FREQ / 10);
+    assert(samples[0].fullness == 10);
+    assert(samples[0].size == 10);
+    assert(samples[2].fullness == 20);
+    assert(samples[2].delay == UCLOCK_FREQ / 5);
+    assert(samples[2].excess == 0);
+    assert(samples[3].dts_prog == 7 * UCLOCK_FREQ / 10);
+    assert(samples[3].fullness == 0);
+    assert(samples[3].excess == -30);
+
+    nb = 2;
+    ubase_assert(upipe_ts_tstd_get_trace(upipe_ts_tstd, samples, &nb));
+    assert(nb == 2);
+    assert(samples[0].dts_prog == 6 * UCLOCK_FREQ / 10);
+    ubase_assert(upipe_ts_tstd_dump_trace(upipe_ts_tstd));
+
     upipe_release(upipe_ts_tstd);
     upipe_mgr_release(upipe_ts_tstd_mgr);
 
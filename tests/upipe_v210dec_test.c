@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for the line unpacking functions of v210dec
+ *
+ * Random lines are packed with v210enc and unpacked back; the SIMD versions
+ * are checked against the C versions and timed on 1080-line frames.
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe-v210/upipe_v210enc.h>
+#include <upipe-v210/upipe_v210dec.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#define FRAME_WIDTH     1920
+#define FRAME_HEIGHT    1080
+#define NB_FRAMES       50
+
+/** returns the size of a v210 line */
+static size_t v210_size(size_t width)
+{
+    return width * 16 / 6;
+}
+
+/** returns the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.;
+}
+
+/** packs a random legal line of the given width */
+static uint8_t *random_line(size_t width, uint16_t *y, uint16_t *u,
+                            uint16_t *v)
+{
+    uint8_t *src = malloc(v210_size(width));
+    assert(src != NULL);
+    for (size_t i = 0; i < width; i++)
+        y[i] = 4 + rand() % 1016;
+    for (size_t i = 0; i < width / 2; i++) {
+        u[i] = 4 + rand() % 1016;
+        v[i] = 4 + rand() % 1016;
+    }
+    upipe_v210enc_pack_10_c(y, u, v, src, width);
+    return src;
+}
+
+/** checks a 10-bit unpacking function against the original samples */
+static void check_10(const char *name, upipe_v210dec_unpack_line_10 unpack)
+{
+    for (size_t width = 6; width <= FRAME_WIDTH + 6; width += 6) {
+        uint16_t *y = malloc(width * sizeof(uint16_t));
+        uint16_t *u = malloc(width / 2 * sizeof(uint16_t));
+        uint16_t *v = malloc(width / 2 * sizeof(uint16_t));
+        /* exact allocations so that overwrites are caught by checkers */
+        uint16_t *oy = malloc(width * sizeof(uint16_t));
+        uint16_t *ou = malloc(width / 2 * sizeof(uint16_t));
+        uint16_t *ov = malloc(width / 2 * sizeof(uint16_t));
+        assert(y != NULL && u != NULL && v != NULL &&
+               oy != NULL && ou != NULL && ov != NULL);
+        uint8_t *src = random_line(width, y, u, v);
+        unpack(src, oy, ou, ov, width);
+        if (memcmp(y, oy, width * sizeof(uint16_t)) ||
+            memcmp(u, ou, width / 2 * sizeof(uint16_t)) ||
+            memcmp(v, ov, width / 2 * sizeof(uint16_t))) {
+            fprintf(stderr, "%s: mismatch at width %zu\n", name, width);
+            abort();
+        }
+        free(src);
+        free(y);
+        free(u);
+        free(v);
+        free(oy);
+        free(ou);
+        free(ov);
+    }
+}
+
+/** checks an 8-bit unpacking function against the truncated samples */
+static void check_8(const char *name, upipe_v210dec_unpack_line_8 unpack)
+{
+    for (size_t width = 6; width <= FRAME_WIDTH + 6; width += 6) {
+        uint16_t *y = malloc(width * sizeof(uint16_t));
+        uint16_t *u = malloc(width / 2 * sizeof(uint16_t));
+        uint16_t *v = malloc(width / 2 * sizeof(uint16_t));
+        uint8_t *oy = malloc(width);
+        uint8_t *ou = malloc(width / 2);
+        uint8_t *ov = malloc(width / 2);
+        assert(y != NULL && u != NULL && v != NULL &&
+               oy != NULL && ou != NULL && ov != NULL);
+        uint8_t *src = random_line(width, y, u, v);
+        unpack(src, oy, ou, ov, width);
+        for (size_t i = 0; i < width; i++) {
+            if (oy[i] != y[i] >> 2 ||
+                (i < width / 2 && (ou[i] != u[i] >> 2 ||
+                                   ov[i] != v[i] >> 2))) {
+                fprintf(stderr, "%s: mismatch at width %zu\n", name, width);
+                abort();
+            }
+        }
+        free(src);
+        free(y);
+        free(u);
+        free(v);
+        free(oy);
+        free(ou);
+        free(ov);
+    }
+}
+
+/** prints the time taken to unpack a frame with an 8-bit function */
+static void bench_8(const char *name, upipe_v210dec_unpack_line_8 unpack)
+{
+    static uint16_t y[FRAME_WIDTH], u[FRAME_WIDTH / 2], v[FRAME_WIDTH / 2];
+    static uint8_t oy[FRAME_WIDTH], ou[FRAME_WIDTH / 2], ov[FRAME_WIDTH / 2];
+    uint8_t *src = random_line(FRAME_WIDTH, y, u, v);
+
+    double start = now();
+    for (unsigned int f = 0; f < NB_FRAMES; f++)
+        for (unsigned int l = 0; l < FRAME_HEIGHT; l++)
+            unpack(src, oy, ou, ov, FRAME_WIDTH);
+    printf("%s: %.3f ms/frame\n", name,
+           (now() - start) * 1000. / NB_FRAMES);
+    free(src);
+}
+
+/** prints the time taken to unpack a frame with a 10-bit function */
+static void bench_10(const char *name, upipe_v210dec_unpack_line_10 unpack)
+{
+    static uint16_t y[FRAME_WIDTH], u[FRAME_WIDTH / 2], v[FRAME_WIDTH / 2];
+    static uint16_t oy[FRAME_WIDTH], ou[FRAME_WIDTH / 2], ov[FRAME_WIDTH / 2];
+    uint8_t *src = random_line(FRAME_WIDTH, y, u, v);
+
+    double start = now();
+    for (unsigned int f = 0; f < NB_FRAMES; f++)
+        for (unsigned int l = 0; l < FRAME_HEIGHT; l++)
+            unpack(src, oy, ou, ov, FRAME_WIDTH);
+    printf("%s: %.3f ms/frame\n", name,
+           (now() - start) * 1000. / NB_FRAMES);
+    free(src);
+}
+
+int main(int argc, char **argv)
+{
+    srand(42);
+    check_8("unpack_8_c", upipe_v210dec_unpack_8_c);
+    check_10("unpack_10_c", upipe_v210dec_unpack_10_c);
+    bench_8("unpack_8_c", upipe_v210dec_unpack_8_c);
+    bench_10("unpack_10_c", upipe_v210dec_unpack_10_c);
+
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSSE3)) {
+        check_8("unpack_8_ssse3", upipe_v210dec_unpack_8_ssse3);
+        check_10("unpack_10_ssse3", upipe_v210dec_unpack_10_ssse3);
+        bench_8("unpack_8_ssse3", upipe_v210dec_unpack_8_ssse3);
+        bench_10("unpack_10_ssse3", upipe_v210dec_unpack_10_ssse3);
+    }
+    if (ucpu_has(UCPU_AVX2)) {
+        check_8("unpack_8_avx2", upipe_v210dec_unpack_8_avx2);
+        check_10("unpack_10_avx2", upipe_v210dec_unpack_10_avx2);
+        bench_8("unpack_8_avx2", upipe_v210dec_unpack_8_avx2);
+        bench_10("unpack_10_avx2", upipe_v210dec_unpack_10_avx2);
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2015 OpenHeadend S.A.R.L.
+ *
+ * Authors: Christophe Massiot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for the line packing functions of v210enc
+ *
+ * The SIMD versions are checked against the C versions on random lines,
+ * including out of range samples, and timed on 1080-line frames.
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe-v210/upipe_v210enc.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#define FRAME_WIDTH     1920
+#define FRAME_HEIGHT    1080
+#define NB_FRAMES       50
+
+/** returns the size of a v210 line */
+static size_t v210_size(size_t width)
+{
+    return width * 16 / 6;
+}
+
+/** returns the current time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.;
+}
+
+/** checks an 8-bit packing function against the C version */
+static void check_8(const char *name, upipe_v210enc_pack_line_8 pack)
+{
+    for (size_t width = 12; width <= FRAME_WIDTH + 12; width += 12) {
+        /* exact allocations so that overreads are caught by checkers */
+        uint8_t *y = malloc(width);
+        uint8_t *u = malloc(width / 2);
+        uint8_t *v = malloc(width / 2);
+        uint8_t *ref = malloc(v210_size(width));
+        uint8_t *out = malloc(v210_size(width));
+        assert(y != NULL && u != NULL && v != NULL &&
+               ref != NULL && out != NULL);
+        for (size_t i = 0; i < width; i++)
+            y[i] = rand();
+        for (size_t i = 0; i < width / 2; i++) {
+            u[i] = rand();
+            v[i] = rand();
+        }
+        upipe_v210enc_pack_8_c(y, u, v, ref, width);
+        pack(y, u, v, out, width);
+        if (memcmp(ref, out, v210_size(width))) {
+            fprintf(stderr, "%s: mismatch at width %zu\n", name, width);
+            abort();
+        }
+        free(y);
+        free(u);
+        free(v);
+        free(ref);
+        free(out);
+    }
+}
+
+/** checks a 10-bit packing function against the C version */
+static void check_10(const char *name, upipe_v210enc_pack_line_10 pack)
+{
+    for (size_t width = 6; width <= FRAME_WIDTH + 6; width += 6) {
+        uint16_t *y = malloc(width * sizeof(uint16_t));
+        uint16_t *u = malloc(width / 2 * sizeof(uint16_t));
+        uint16_t *v = malloc(width / 2 * sizeof(uint16_t));
+        uint8_t *ref = malloc(v210_size(width));
+        uint8_t *out = malloc(v210_size(width));
+        assert(y != NULL && u != NULL && v != NULL &&
+               ref != NULL && out != NULL);
+        /* mostly legal samples, with some out of the 10-bit range */
+        for (size_t i = 0; i < width; i++)
+            y[i] = rand() % 16 ? rand() % 1024 : rand();
+        for (size_t i = 0; i < width / 2; i++) {
+            u[i] = rand() % 16 ? rand() % 1024 : rand();
+            v[i] = rand() % 16 ? rand() % 1024 : rand();
+        }
+        upipe_v210enc_pack_10_c(y, u, v, ref, width);
+        pack(y, u, v, out, width);
+        if (memcmp(ref, out, v210_size(width))) {
+            fprintf(stderr, "%s: mismatch at width %zu\n", name, width);
+            abort();
+        }
+        free(y);
+        free(u);
+        free(v);
+        free(ref);
+        free(out);
+    }
+}
+
+/** prints the time taken to pack a frame with an 8-bit function */
+static void bench_8(const char *name, upipe_v210enc_pack_line_8 pack)
+{
+    static uint8_t y[FRAME_WIDTH], u[FRAME_WIDTH / 2], v[FRAME_WIDTH / 2];
+    static uint8_t out[FRAME_WIDTH * 16 / 6];
+    memset(y, 0x80, sizeof(y));
+    memset(u, 0x40, sizeof(u));
+    memset(v, 0xc0, sizeof(v));
+
+    double start = now();
+    for (unsigned int f = 0; f < NB_FRAMES; f++)
+        for (unsigned int l = 0; l < FRAME_HEIGHT; l++)
+            pack(y, u, v, out, FRAME_WIDTH);
+    printf("%s: %.3f ms/frame\n", name,
+           (now() - start) * 1000. / NB_FRAMES);
+}
+
+/** prints the time taken to pack a frame with a 10-bit function */
+static void bench_10(const char *name, upipe_v210enc_pack_line_10 pack)
+{
+    static uint16_t y[FRAME_WIDTH], u[FRAME_WIDTH / 2], v[FRAME_WIDTH / 2];
+    static uint8_t out[FRAME_WIDTH * 16 / 6];
+    for (unsigned int i = 0; i < FRAME_WIDTH; i++)
+        y[i] = i % 1024;
+    for (unsigned int i = 0; i < FRAME_WIDTH / 2; i++) {
+        u[i] = 512;
+        v[i] = 1023 - i % 1024;
+    }
+
+    double start = now();
+    for (unsigned int f = 0; f < NB_FRAMES; f++)
+        for (unsigned int l = 0; l < FRAME_HEIGHT; l++)
+            pack(y, u, v, out, FRAME_WIDTH);
+    printf("%s: %.3f ms/frame\n", name,
+           (now() - start) * 1000. / NB_FRAMES);
+}
+
+int main(int argc, char **argv)
+{
+    srand(42);
+    bench_8("pack_8_c", upipe_v210enc_pack_8_c);
+    bench_10("pack_10_c", upipe_v210enc_pack_10_c);
+
+#ifdef UCPU_X86
+    if (ucpu_has(UCPU_SSSE3)) {
+        check_8("pack_8_ssse3", upipe_v210enc_pack_8_ssse3);
+        check_10("pack_10_ssse3", upipe_v210enc_pack_10_ssse3);
+        bench_8("pack_8_ssse3", upipe_v210enc_pack_8_ssse3);
+        bench_10("pack_10_ssse3", upipe_v210enc_pack_10_ssse3);
+    }
+    if (ucpu_has(UCPU_AVX2)) {
+        check_8("pack_8_avx2", upipe_v210enc_pack_8_avx2);
+        check_10("pack_10_avx2", upipe_v210enc_pack_10_avx2);
+        bench_8("pack_8_avx2", upipe_v210enc_pack_8_avx2);
+        bench_10("pack_10_avx2", upipe_v210enc_pack_10_avx2);
+    }
+#endif
+    return 0;
+}